@@ -255,6 +255,7 @@ void app_event_loop_common(void) {
     PebbleEvent event;
 
     sys_get_pebble_event(&event);
+    SYS_PROFILER_EVENT_DISPATCH_START(event.type);
 
     if (event.type == PEBBLE_PROCESS_DEINIT_EVENT) {
       prv_handle_deinit_event();
@@ -270,6 +271,7 @@ void app_event_loop_common(void) {
     } else {
       event_service_client_handle_event(&event);
     }
+    SYS_PROFILER_EVENT_DISPATCH_STOP(event.type);
 
     mcu_fpu_cleanup();
     event_cleanup(&event);
@@ -82,6 +82,11 @@ void event_service_client_unsubscribe(EventServiceInfo *handler) {
 }
 
 void event_service_client_handle_event(PebbleEvent *e) {
+  if (event_service_get_coalesce_policy(e->type) != EventServiceCoalescePolicy_None) {
+    // Newer events of this type got folded into this one while it was waiting in our queue
+    sys_event_service_get_coalesced(e);
+  }
+
   EventServiceInfo *state = prv_get_state();
   const uintptr_t type = e->type;
   // find the first callback
@@ -47,15 +47,71 @@ void framebuffer_clear(FrameBuffer *f) {
   f->is_dirty = true;
 }
 
-void framebuffer_mark_dirty_rect(FrameBuffer *f, GRect rect) {
+//! Grows the dirty rect to cover the given rect without touching the dirty rows
+static void prv_grow_dirty_rect(FrameBuffer *f, const GRect *rect) {
   if (!f->is_dirty) {
-    f->dirty_rect = rect;
+    f->dirty_rect = *rect;
   } else {
-    f->dirty_rect = grect_union(&f->dirty_rect, &rect);
+    f->dirty_rect = grect_union(&f->dirty_rect, rect);
   }
 
   const GRect clip_rect = (GRect) { GPointZero, f->size };
   grect_clip(&f->dirty_rect, &clip_rect);
-
   f->is_dirty = true;
 }
+
+void framebuffer_mark_dirty_rect(FrameBuffer *f, GRect rect) {
+  prv_grow_dirty_rect(f, &rect);
+
+  const GRect clip_rect = (GRect) { GPointZero, f->size };
+  grect_clip(&rect, &clip_rect);
+  if (rect.size.w > 0) {
+    const int16_t y_end = rect.origin.y + rect.size.h;
+    for (int16_t y = rect.origin.y; y < y_end; y++) {
+      bitset8_set(f->dirty_rows, y);
+    }
+  }
+}
+
+void framebuffer_copy_changed_rows(FrameBuffer *f, const FrameBuffer *src) {
+  const int16_t words_per_row = (f->size.w / 32) + 1;
+  int16_t changed_x1 = f->size.w;
+  int16_t changed_x2 = -1;
+  int16_t changed_y1 = -1;
+  int16_t changed_y2 = -1;
+  for (int16_t y = 0; y < f->size.h; y++) {
+    uint32_t *line = framebuffer_get_line(f, y);
+    const uint32_t *src_line = src->buffer + (line - f->buffer);
+
+    // Rows are only a few words long, so look for the changed words without a memcmp first
+    int16_t word1 = 0;
+    while ((word1 < words_per_row) && (line[word1] == src_line[word1])) {
+      word1++;
+    }
+    if (word1 == words_per_row) {
+      continue;
+    }
+    int16_t word2 = words_per_row - 1;
+    while (line[word2] == src_line[word2]) {
+      word2--;
+    }
+    // This includes the bits past the row's width which never get displayed
+    memcpy(&line[word1], &src_line[word1], (word2 - word1 + 1) * sizeof(uint32_t));
+
+    const int16_t x1 = MIN(word1 * 32, f->size.w - 1);
+    const int16_t x2 = MIN(word2 * 32 + 31, f->size.w - 1);
+    bitset8_set(f->dirty_rows, y);
+    changed_x1 = MIN(changed_x1, x1);
+    changed_x2 = MAX(changed_x2, x2);
+    if (changed_y1 < 0) {
+      changed_y1 = y;
+    }
+    changed_y2 = y;
+  }
+
+  // The changed rows are already flagged, so don't mark every row between them
+  if (changed_y1 >= 0) {
+    prv_grow_dirty_rect(f, &GRect(changed_x1, changed_y1, changed_x2 - changed_x1 + 1,
+                                  changed_y2 - changed_y1 + 1));
+  }
+}
@@ -16,16 +16,20 @@
 
 #pragma once
 
+#include "util/math.h"
+
 #define FRAMEBUFFER_WORDS_PER_ROW ((DISP_COLS / 32) + 1)
 #define FRAMEBUFFER_SIZE_DWORDS (DISP_ROWS * FRAMEBUFFER_WORDS_PER_ROW)
 
 #define FRAMEBUFFER_BYTES_PER_ROW (FRAMEBUFFER_WORDS_PER_ROW * 4)
 #define FRAMEBUFFER_SIZE_BYTES (DISP_ROWS * FRAMEBUFFER_BYTES_PER_ROW)
+#define FRAMEBUFFER_DIRTY_ROWS_BYTES DIVIDE_CEIL(DISP_ROWS, 8)
 
 typedef struct FrameBuffer {
   uint32_t buffer[FRAMEBUFFER_SIZE_DWORDS];
   GSize size;
   GRect dirty_rect; //<! Smallest rect covering all dirty pixels.
+  uint8_t dirty_rows[FRAMEBUFFER_DIRTY_ROWS_BYTES]; //<! Bitset of the rows with dirty pixels.
   bool is_dirty;
 } FrameBuffer;
 
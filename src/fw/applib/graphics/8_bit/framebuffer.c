@@ -61,16 +61,76 @@ void framebuffer_clear(FrameBuffer *f) {
   framebuffer_dirty_all(f);
 }
 
-void framebuffer_mark_dirty_rect(FrameBuffer *f, GRect rect) {
-  PBL_ASSERTN(!gsize_equal(&f->size, &GSizeZero));
+//! Grows the dirty rect to cover the given rect without touching the dirty rows
+static void prv_grow_dirty_rect(FrameBuffer *f, const GRect *rect) {
   if (!f->is_dirty) {
-    f->dirty_rect = rect;
+    f->dirty_rect = *rect;
   } else {
-    f->dirty_rect = grect_union(&f->dirty_rect, &rect);
+    f->dirty_rect = grect_union(&f->dirty_rect, rect);
   }
 
   const GRect clip_rect = (GRect) { GPointZero, f->size };
   grect_clip(&f->dirty_rect, &clip_rect);
-
   f->is_dirty = true;
 }
+
+void framebuffer_mark_dirty_rect(FrameBuffer *f, GRect rect) {
+  PBL_ASSERTN(!gsize_equal(&f->size, &GSizeZero));
+  prv_grow_dirty_rect(f, &rect);
+
+  const GRect clip_rect = (GRect) { GPointZero, f->size };
+  grect_clip(&rect, &clip_rect);
+  if (rect.size.w > 0) {
+    const int16_t y_end = rect.origin.y + rect.size.h;
+    for (int16_t y = rect.origin.y; y < y_end; y++) {
+      bitset8_set(f->dirty_rows, y);
+    }
+  }
+}
+
+void framebuffer_copy_changed_rows(FrameBuffer *f, const FrameBuffer *src) {
+  PBL_ASSERTN(!gsize_equal(&f->size, &GSizeZero));
+  int16_t changed_x1 = f->size.w;
+  int16_t changed_x2 = -1;
+  int16_t changed_y1 = -1;
+  int16_t changed_y2 = -1;
+  for (int16_t y = 0; y < f->size.h; y++) {
+#if PLATFORM_SPALDING
+    const GBitmapDataRowInfoInternal *row_info = &g_gbitmap_spalding_data_row_infos[y];
+    const int16_t min_x = row_info->min_x;
+    const int16_t max_x = row_info->max_x;
+#else
+    const int16_t min_x = 0;
+    const int16_t max_x = f->size.w - 1;
+#endif
+    uint8_t *line = framebuffer_get_line(f, y);
+    const uint8_t *src_line = src->buffer + (line - f->buffer);
+    if (memcmp(&line[min_x], &src_line[min_x], max_x - min_x + 1) == 0) {
+      continue;
+    }
+
+    int16_t x1 = min_x;
+    while (line[x1] == src_line[x1]) {
+      x1++;
+    }
+    int16_t x2 = max_x;
+    while (line[x2] == src_line[x2]) {
+      x2--;
+    }
+    memcpy(&line[x1], &src_line[x1], x2 - x1 + 1);
+
+    bitset8_set(f->dirty_rows, y);
+    changed_x1 = MIN(changed_x1, x1);
+    changed_x2 = MAX(changed_x2, x2);
+    if (changed_y1 < 0) {
+      changed_y1 = y;
+    }
+    changed_y2 = y;
+  }
+
+  // The changed rows are already flagged, so don't mark every row between them
+  if (changed_y1 >= 0) {
+    prv_grow_dirty_rect(f, &GRect(changed_x1, changed_y1, changed_x2 - changed_x1 + 1,
+                                  changed_y2 - changed_y1 + 1));
+  }
+}
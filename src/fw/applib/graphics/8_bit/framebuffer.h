@@ -19,18 +19,21 @@
 #include "applib/graphics/gtypes.h"
 #include "drivers/display/display.h"
 #include "util/attributes.h"
+#include "util/math.h"
 
 #include <stdint.h>
 #include <stdbool.h>
 
 #define FRAMEBUFFER_BYTES_PER_ROW DISP_COLS
 #define FRAMEBUFFER_SIZE_BYTES DISPLAY_FRAMEBUFFER_BYTES
+#define FRAMEBUFFER_DIRTY_ROWS_BYTES DIVIDE_CEIL(DISP_ROWS, 8)
 
 #ifndef UNITTEST
 typedef struct FrameBuffer {
   uint8_t buffer[FRAMEBUFFER_SIZE_BYTES];
   GSize size; //<! Active size of the framebuffer
   GRect dirty_rect; //<! Smallest rect covering all dirty pixels.
+  uint8_t dirty_rows[FRAMEBUFFER_DIRTY_ROWS_BYTES]; //<! Bitset of the rows with dirty pixels.
   bool is_dirty;
 } FrameBuffer;
 #else // UNITTEST
@@ -39,6 +42,7 @@ typedef struct FrameBuffer {
 typedef struct PACKED FrameBuffer {
   GSize size; //<! Active size of the framebuffer
   GRect dirty_rect; //<! Smallest rect covering all dirty pixels.
+  uint8_t dirty_rows[FRAMEBUFFER_DIRTY_ROWS_BYTES]; //<! Bitset of the rows with dirty pixels.
   bool is_dirty;
   uint8_t buffer[FRAMEBUFFER_SIZE_BYTES];
 } FrameBuffer;
@@ -21,6 +21,9 @@
 
 #include "applib/graphics/framebuffer.h"
 #include "system/passert.h"
+#include "util/bitset.h"
+
+#include <string.h>
 
 void framebuffer_init(FrameBuffer *fb, const GSize *size) {
   PBL_ASSERTN(!gsize_equal(size, &GSizeZero));
@@ -47,12 +50,14 @@ GBitmap framebuffer_get_as_bitmap(FrameBuffer *fb, const GSize *size) {
 void framebuffer_dirty_all(FrameBuffer *fb) {
   PBL_ASSERTN(!gsize_equal(&fb->size, &GSizeZero));
   fb->dirty_rect = (GRect) { GPointZero, fb->size };
+  memset(fb->dirty_rows, 0xff, sizeof(fb->dirty_rows));
   fb->is_dirty = true;
 }
 
 void framebuffer_reset_dirty(FrameBuffer *fb) {
   PBL_ASSERTN(!gsize_equal(&fb->size, &GSizeZero));
   fb->dirty_rect = GRectZero;
+  memset(fb->dirty_rows, 0, sizeof(fb->dirty_rows));
   fb->is_dirty = false;
 }
 
@@ -61,6 +66,10 @@ bool framebuffer_is_dirty(FrameBuffer *fb) {
   return fb->is_dirty;
 }
 
+bool framebuffer_is_row_dirty(FrameBuffer *fb, uint8_t y) {
+  return (y < fb->size.h) && bitset8_get(fb->dirty_rows, y);
+}
+
 GSize framebuffer_get_size(FrameBuffer *fb) {
   return fb->size;
 }
@@ -52,6 +52,14 @@ void framebuffer_reset_dirty(FrameBuffer* f);
 //! Query the dirty status for this framebuffer
 bool framebuffer_is_dirty(FrameBuffer* f);
 
+//! Query whether any pixel in the given row has been marked dirty
+bool framebuffer_is_row_dirty(FrameBuffer *f, uint8_t y);
+
+//! Copy the pixels of another framebuffer of the same size into this one, marking only the
+//! pixels that actually changed as dirty.
+//! @note Only the size of f is used, the size field of src is not trusted.
+void framebuffer_copy_changed_rows(FrameBuffer *f, const FrameBuffer *src);
+
 //! Creates a GBitmap struct that points to the framebuffer. Useful for using the framebuffer data
 //! with graphics routines. Note that updating this bitmap won't mark the appropriate lines as
 //! dirty in the framebuffer, so this will have to be done manually.
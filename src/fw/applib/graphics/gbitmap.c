@@ -472,20 +472,20 @@ bool gbitmap_init_with_resource_system(GBitmap* bitmap, ResAppNum app_num, uint3
 
   memset(bitmap, 0, prv_gbitmap_size());
 
+  // PNGs are inflated straight out of the resource, the compressed data is never loaded whole
+  uint8_t signature[sizeof(uint32_t)];
+  if (sys_resource_load_range(app_num, resource_id, 0, signature, sizeof(signature)) ==
+          sizeof(signature) &&
+      gbitmap_png_data_is_png(signature, sizeof(signature))) {
+    return gbitmap_init_with_png_resource(bitmap, app_num, resource_id);
+  }
+
   const size_t data_size = sys_resource_size(app_num, resource_id);
   uint8_t *data = applib_resource_mmap_or_load(app_num, resource_id, 0, data_size, false);
   if (!data) {
     return false;
   }
 
-  // Scan the resource data to see if it contains PNG data
-  if (gbitmap_png_data_is_png(data, data_size)) {
-    const bool result = gbitmap_init_with_png_data(bitmap, data, data_size);
-    // the actual pixels live uncompressed on the heap now, we can free the PNG data
-    applib_resource_munmap_or_free(data);
-    return result;
-  }
-
   const bool mmapped = applib_resource_is_mmapped(data);
   if (prv_init_with_pbi_data(bitmap, data, data_size, mmapped)) {
     // in order to make memory-mapped bitmaps work, we need to decrement the reference counter
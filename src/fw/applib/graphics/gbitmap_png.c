@@ -18,8 +18,10 @@
 
 #include "applib/app_logging.h"
 #include "applib/applib_malloc.auto.h"
+#include "applib/applib_resource_private.h"
 #include "system/logging.h"
 #include "syscall/syscall.h"
+#include "util/math.h"
 #include "util/net.h"
 
 #define PNG_DECODE_ERROR "PNG decoding failed"
@@ -27,6 +29,21 @@
 #define PNG_FORMAT_ERROR "Unsupported PNG format, only PNG8 is supported!"
 #define PNG_LOAD_ERROR "Failed to load PNG"
 
+// How much compressed image data is read from the resource at a time
+#define PNG_READ_BUFFER_SIZE (256)
+
+typedef struct PNGResourceStream {
+  ResAppNum app_num;
+  uint32_t resource_id;
+  //! Offset of the next byte of image data, or of the next chunk if chunk_remaining is 0
+  uint32_t offset;
+  uint32_t chunk_remaining;
+  //! Palette to apply to each row as it's decoded, only for 8-bit images
+  const GColor8 *palette;
+  uint32_t width;
+  uint8_t buffer[PNG_READ_BUFFER_SIZE];
+} PNGResourceStream;
+
 static GBitmapFormat prv_get_format_for_bpp(uint8_t bits_per_pixel) {
   if (bits_per_pixel == 1)  return GBitmapFormat1BitPalette;
   if (bits_per_pixel == 2)  return GBitmapFormat2BitPalette;
@@ -109,6 +126,23 @@ GBitmap* gbitmap_create_from_png_data(const uint8_t *png_data, size_t png_data_s
   return bitmap;
 }
 
+//! Hands the decoded image over to the bitmap, 8-bit images must already be de-palettized
+static void prv_set_bitmap_data(GBitmap *bitmap, upng_t *upng, GColor8 *palette) {
+  const uint32_t width = upng_get_width(upng);
+  const uint32_t height = upng_get_height(upng);
+  const GBitmapFormat format = prv_get_format_for_bpp(upng_get_bpp(upng));
+
+  // Set the image or pixel data
+  gbitmap_set_data(bitmap, (uint8_t *)upng_get_buffer(upng), format,
+      gbitmap_format_get_row_size_bytes(width, format), true);
+  gbitmap_set_bounds(bitmap, (GRect){.origin = {0, 0}, .size = {width, height}});
+  bitmap->info.version = GBITMAP_VERSION_CURRENT;
+
+  if (palette) {
+    gbitmap_set_palette(bitmap, palette, true);
+  }
+}
+
 bool gbitmap_init_with_png_data(GBitmap *bitmap, const uint8_t *data, size_t data_size) {
   GColor8 *palette = NULL;
   bool retval = false;
@@ -155,16 +189,7 @@ bool gbitmap_init_with_png_data(GBitmap *bitmap, const uint8_t *data, size_t dat
     palette = NULL;
   }
 
-  // Set the image or pixel data
-  gbitmap_set_data(bitmap, upng_buffer, format,
-      gbitmap_format_get_row_size_bytes(width, format), true);
-  gbitmap_set_bounds(bitmap, (GRect){.origin = {0, 0}, .size = {width, height}});
-  bitmap->info.version = GBITMAP_VERSION_CURRENT;
-
-  if (palette) {
-    gbitmap_set_palette(bitmap, palette, true);
-  }
-
+  prv_set_bitmap_data(bitmap, upng, palette);
   retval = true;
 
 cleanup:
@@ -291,3 +316,151 @@ int32_t gbitmap_png_get_transparent_gray_value(upng_t *upng) {
   }
   return transparent_gray;
 }
+
+//! Reads the image data of the consecutive IDAT chunks, one buffer at a time
+static uint32_t prv_read_image_data(void *context, const uint8_t **data) {
+  PNGResourceStream *stream = context;
+  if (stream->chunk_remaining == 0) {
+    struct png_chunk_marker {
+      uint32_t length;
+      uint32_t chunk_type;
+    } marker;
+    if (sys_resource_load_range(stream->app_num, stream->resource_id, stream->offset,
+                                (uint8_t *)&marker, sizeof(marker)) != sizeof(marker) ||
+        ntohl(marker.chunk_type) != CHUNK_IDAT) {
+      return 0;
+    }
+    stream->offset += sizeof(marker);
+    stream->chunk_remaining = ntohl(marker.length);
+  }
+
+  const uint32_t size = MIN(stream->chunk_remaining, sizeof(stream->buffer));
+  if (sys_resource_load_range(stream->app_num, stream->resource_id, stream->offset,
+                              stream->buffer, size) != size) {
+    return 0;
+  }
+  stream->offset += size;
+  stream->chunk_remaining -= size;
+  if (stream->chunk_remaining == 0) {
+    stream->offset += sizeof(uint32_t);  // Skip the CRC, the next chunk follows
+  }
+
+  *data = stream->buffer;
+  return size;
+}
+
+static void prv_depalettize_row(void *context, uint8_t *row, uint32_t y) {
+  const PNGResourceStream *stream = context;
+  if (stream->palette) {
+    for (uint32_t x = 0; x < stream->width; x++) {
+      row[x] = stream->palette[row[x]].argb;
+    }
+  }
+}
+
+//! Loads the whole PNG and decodes it from RAM, needed for APNGs whose first frame can have its
+//! own frame control
+static bool prv_init_with_png_resource_data(GBitmap *bitmap, ResAppNum app_num,
+                                            uint32_t resource_id) {
+  const size_t data_size = sys_resource_size(app_num, resource_id);
+  uint8_t *data = applib_resource_mmap_or_load(app_num, resource_id, 0, data_size, false);
+  if (!data) {
+    return false;
+  }
+  const bool result = gbitmap_init_with_png_data(bitmap, data, data_size);
+  applib_resource_munmap_or_free(data);
+  return result;
+}
+
+bool gbitmap_init_with_png_resource(GBitmap *bitmap, ResAppNum app_num, uint32_t resource_id) {
+  // Everything up to the first IDAT chunk is metadata, the only part that gets loaded as a whole
+  bool is_apng = false;
+  const int32_t metadata_chunks_size =
+      png_seek_chunk_in_resource_system(app_num, resource_id, PNG_HEADER_SIZE, false, &is_apng);
+  if (metadata_chunks_size < 0) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, PNG_LOAD_ERROR);
+    return false;
+  }
+  if (is_apng) {
+    return prv_init_with_png_resource_data(bitmap, app_num, resource_id);
+  }
+
+  GColor8 *palette = NULL;
+  PNGResourceStream *stream = NULL;
+  bool retval = false;
+
+  upng_t *upng = upng_create();
+  const uint32_t metadata_size = PNG_HEADER_SIZE + metadata_chunks_size;
+  uint8_t *metadata = applib_malloc(metadata_size);
+  if (!upng || !metadata) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, PNG_MEMORY_ERROR);
+    goto cleanup;
+  }
+  if (sys_resource_load_range(app_num, resource_id, 0, metadata, metadata_size) !=
+      metadata_size) {
+    goto cleanup;
+  }
+  upng_load_bytes(upng, metadata, metadata_size);
+  upng_error upng_state = upng_decode_metadata(upng);
+  // The palettes have been copied out, the metadata isn't needed while decoding the image
+  applib_free(metadata);
+  metadata = NULL;
+  if (upng_state != UPNG_EOK) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, (upng_state == UPNG_ENOMEM) ? PNG_MEMORY_ERROR : PNG_DECODE_ERROR);
+    goto cleanup;
+  }
+
+  if (!gbitmap_png_is_format_supported(upng)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, PNG_FORMAT_ERROR);
+    goto cleanup;
+  }
+
+  // Create a color palette in GColor8 format from RGB24 + ALPHA8 PNG Palettes (or Grayscale)
+  if (gbitmap_png_load_palette(upng, &palette) == 0) {
+    goto cleanup;
+  }
+
+  stream = applib_type_malloc(PNGResourceStream);
+  if (!stream) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, PNG_MEMORY_ERROR);
+    goto cleanup;
+  }
+  *stream = (PNGResourceStream) {
+    .app_num = app_num,
+    .resource_id = resource_id,
+    .offset = metadata_size,
+    .width = upng_get_width(upng),
+  };
+
+  // 8-bit palettized PNGs are converted to raw ARGB a row at a time as they're decoded,
+  // as we don't support palettized bitdepths above 4
+  const bool is_8bit = (prv_get_format_for_bpp(upng_get_bpp(upng)) == GBitmapFormat8Bit);
+  if (is_8bit) {
+    stream->palette = palette;
+  }
+
+  upng_state = upng_decode_image_stream(upng, prv_read_image_data, prv_depalettize_row, stream);
+  if (upng_state != UPNG_EOK) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, (upng_state == UPNG_ENOMEM) ? PNG_MEMORY_ERROR : PNG_DECODE_ERROR);
+    goto cleanup;
+  }
+
+  if (is_8bit) {
+    applib_free(palette);  // Free the palette to avoid storing it as part of GBitmap
+    palette = NULL;
+  }
+
+  prv_set_bitmap_data(bitmap, upng, palette);
+  retval = true;
+
+cleanup:
+  if (!retval) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, PNG_LOAD_ERROR);
+    applib_free(palette);
+  }
+  applib_free(metadata);
+  applib_free(stream);
+  // we are keeping the image data to avoid copying it
+  upng_destroy(upng, !retval);
+  return retval;
+}
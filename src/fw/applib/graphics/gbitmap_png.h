@@ -93,6 +93,15 @@ GBitmap* gbitmap_create_from_png_data(const uint8_t *png_data, size_t png_data_s
 
 bool gbitmap_init_with_png_data(GBitmap *bitmap, const uint8_t *data, size_t data_size);
 
+//! @internal
+//! Decodes a PNG resource into the bitmap without loading the compressed image data into RAM,
+//! it is read from the resource as the image is inflated.
+//! @param bitmap the bitmap to initialize
+//! @param app_num the app resource space from which to read the resource
+//! @param resource_id the PNG resource
+//! @return True if the bitmap was initialized, False otherwise
+bool gbitmap_init_with_png_resource(GBitmap *bitmap, ResAppNum app_num, uint32_t resource_id);
+
 //!   @} // end addtogroup GraphicsTypes
 //! @} // end addtogroup Graphics
 
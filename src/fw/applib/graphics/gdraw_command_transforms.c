@@ -111,6 +111,47 @@ void gdraw_command_image_attract_to_square(GDrawCommandImage *image, int32_t nor
   gdraw_command_list_attract_to_square(&image->command_list, image->size, normalized);
 }
 
+//! Commands of a list and its clone are at the same offsets, so the clone's command can be found
+//! from the source's without walking the clone
+static GDrawCommand *prv_get_dest_command(GDrawCommandList *dest, GDrawCommandList *source,
+                                          GDrawCommand *command) {
+  return (GDrawCommand *)((uint8_t *)dest + ((uint8_t *)command - (uint8_t *)source));
+}
+
+typedef struct {
+  ToSquareCBContext to_square;
+  GDrawCommandList *dest;
+  GDrawCommandList *source;
+} ToSquareFromCBContext;
+
+static bool prv_gdraw_command_attract_to_square_from(GDrawCommand *command, uint32_t index,
+                                                     void *context) {
+  ToSquareFromCBContext *ctx = context;
+  GDrawCommand *dest_command = prv_get_dest_command(ctx->dest, ctx->source, command);
+  const GSize size = (command->type == GDrawCommandTypePrecisePath)
+      ? ctx->to_square.precise_size : ctx->to_square.integer_size;
+  const uint16_t num_points = gdraw_command_get_num_points(command);
+  for (uint16_t i = 0; i < num_points; i++) {
+    dest_command->points[i] = gpoint_attract_to_square(command->points[i], size,
+                                                       ctx->to_square.normalized);
+  }
+  return true;
+}
+
+void gdraw_command_list_attract_to_square_from(GDrawCommandList *dest, GDrawCommandList *source,
+                                               GSize size, int32_t normalized) {
+  ToSquareFromCBContext ctx = {
+    .to_square = {
+      .integer_size = size,
+      .precise_size = gsize_scalar_lshift(size, GPOINT_PRECISE_PRECISION),
+      .normalized = normalized,
+    },
+    .dest = dest,
+    .source = source,
+  };
+  gdraw_command_list_iterate(source, prv_gdraw_command_attract_to_square_from, &ctx);
+}
+
 
 ////////////////////
 // gpoint index lookup creator
@@ -250,6 +291,46 @@ void gpoint_index_lookup_set_groups(GPointIndexLookup *lookup, int num_groups,
   }
 }
 
+#define SEGMENTED_TIMING_NEVER (UINT16_MAX)
+
+GPointSegmentedTiming *gpoint_segmented_timing_create(const GPointIndexLookup *lookup,
+                                                      Fixed_S32_16 duration_fraction) {
+  PBL_ASSERTN(duration_fraction.raw_value > 0);
+  GPointSegmentedTiming *timing = applib_malloc(sizeof(GPointSegmentedTiming) +
+                                                lookup->num_points * sizeof(uint16_t));
+  if (!timing) {
+    return NULL;
+  }
+  timing->duration_fraction = duration_fraction;
+  timing->num_points = lookup->num_points;
+
+  // Same as animation_timing_segmented, minus the parts that don't depend on the time
+  const uint32_t num_segments = lookup->max_index + 1;
+  const int32_t duration_per_item = ((int64_t) ANIMATION_NORMALIZED_MAX
+      * duration_fraction.raw_value) / FIXED_S32_16_ONE.raw_value;
+  const int32_t delay_per_item = (ANIMATION_NORMALIZED_MAX - duration_per_item) / num_segments;
+  for (uint16_t i = 0; i < lookup->num_points; i++) {
+    const uint16_t index = lookup->index_lookup[i];
+    timing->start[i] = (index < num_segments) ? (index * delay_per_item) : SEGMENTED_TIMING_NEVER;
+  }
+  return timing;
+}
+
+static AnimationProgress prv_segmented_timing_get_progress(const GPointSegmentedTiming *timing,
+                                                           uint32_t point_index,
+                                                           AnimationProgress normalized) {
+  if (point_index >= timing->num_points || timing->start[point_index] == SEGMENTED_TIMING_NEVER) {
+    return 0;
+  }
+  const int32_t normalized_offset = normalized - timing->start[point_index];
+  if (normalized_offset < 0) {
+    return 0;
+  }
+  const int32_t relative_progress = ((int64_t) normalized_offset
+      * FIXED_S32_16_ONE.raw_value) / timing->duration_fraction.raw_value;
+  return MIN(relative_progress, ANIMATION_NORMALIZED_MAX);
+}
+
 ////////////////////
 // segmented scale: index based segmentation of scale + transform
 
@@ -307,6 +388,22 @@ T_STATIC int64_t prv_default_interpolate(int32_t normalized, int64_t from, int64
   return interpolate_int64_linear(curved, from, to);
 }
 
+static GPoint prv_scale_segmented_point(GPoint point, const ScaleToGValues *gvalues,
+                                        AnimationProgress normalized,
+                                        InterpolateInt64Function interpolate, bool is_offset) {
+  if (is_offset) {
+    gpoint_sub_eq(&point, gvalues->offset);
+  }
+
+  point = gpoint_scale_to(point, gvalues->size, gvalues->from, gvalues->to, normalized,
+                          interpolate);
+
+  if (is_offset) {
+    gpoint_add_eq(&point, gvalues->offset);
+  }
+  return point;
+}
+
 T_STATIC bool prv_gdraw_command_scale_segmented(GDrawCommand *command, uint32_t index,
                                                 void *context) {
   ScaleToCBContext *scale = context;
@@ -316,11 +413,6 @@ T_STATIC bool prv_gdraw_command_scale_segmented(GDrawCommand *command, uint32_t
   const uint16_t num_points = gdraw_command_get_num_points(command);
   for (uint16_t i = 0; i < num_points; i++) {
     const int32_t point_index = scale->values.lookup->index_lookup[scale->iter.current_index];
-    GPoint point = command->points[i];
-
-    if (scale->values.is_offset) {
-      gpoint_sub_eq(&point, gvalues->offset);
-    }
 
     const AnimationProgress normalized = animation_timing_segmented(
         scale->values.normalized, point_index, scale->values.lookup->max_index + 1,
@@ -329,24 +421,16 @@ T_STATIC bool prv_gdraw_command_scale_segmented(GDrawCommand *command, uint32_t
     const InterpolateInt64Function interpolate = scale->values.interpolate ?
         scale->values.interpolate : prv_default_interpolate;
 
-    point = gpoint_scale_to(point, gvalues->size, gvalues->from, gvalues->to, normalized,
-                            interpolate);
-
-    if (scale->values.is_offset) {
-      gpoint_add_eq(&point, gvalues->offset);
-    }
-
-    command->points[i] = point;
+    command->points[i] = prv_scale_segmented_point(command->points[i], gvalues, normalized,
+                                                   interpolate, scale->values.is_offset);
 
     scale->iter.current_index++;
   }
   return true;
 }
 
-void gdraw_command_list_scale_segmented_to(
-    GDrawCommandList *list, GSize size, GRect from, GRect to, AnimationProgress normalized,
-    InterpolateInt64Function interpolate, GPointIndexLookup *lookup, Fixed_S32_16 duration_fraction,
-    bool is_offset) {
+static void prv_scale_to_gvalues_init(GSize size, GRect from, GRect to, bool is_offset,
+                                      ScaleToGValues *integer, ScaleToGValues *precise) {
   GPoint offset = GPointZero;
   if (is_offset) {
     offset = from.origin;
@@ -354,20 +438,32 @@ void gdraw_command_list_scale_segmented_to(
     from.origin = GPointZero;
   }
 
+  *integer = (ScaleToGValues) {
+    .from = from,
+    .to = to,
+    .size = size,
+    .offset = offset,
+  };
+  *precise = (ScaleToGValues) {
+    .from = grect_scalar_lshift(from, GPOINT_PRECISE_PRECISION),
+    .to = grect_scalar_lshift(to, GPOINT_PRECISE_PRECISION),
+    .size = gsize_scalar_lshift(size, GPOINT_PRECISE_PRECISION),
+    .offset = gpoint_scalar_lshift(offset, GPOINT_PRECISE_PRECISION),
+  };
+}
+
+void gdraw_command_list_scale_segmented_to(
+    GDrawCommandList *list, GSize size, GRect from, GRect to, AnimationProgress normalized,
+    InterpolateInt64Function interpolate, GPointIndexLookup *lookup, Fixed_S32_16 duration_fraction,
+    bool is_offset) {
+  ScaleToGValues integer;
+  ScaleToGValues precise;
+  prv_scale_to_gvalues_init(size, from, to, is_offset, &integer, &precise);
+
   ScaleToCBContext ctx = {
     .values = {
-      .integer = {
-        .from = from,
-        .to = to,
-        .size = size,
-        .offset = offset,
-      },
-      .precise = {
-        .from = grect_scalar_lshift(from, GPOINT_PRECISE_PRECISION),
-        .to = grect_scalar_lshift(to, GPOINT_PRECISE_PRECISION),
-        .size = gsize_scalar_lshift(size, GPOINT_PRECISE_PRECISION),
-        .offset = gpoint_scalar_lshift(offset, GPOINT_PRECISE_PRECISION),
-      },
+      .integer = integer,
+      .precise = precise,
       .duration_fraction = duration_fraction,
       .lookup = lookup,
       .normalized = normalized,
@@ -392,16 +488,6 @@ void gdraw_command_image_scale_segmented_to(
 ////////////////////
 // scale stroke width
 
-typedef struct {
-  Fixed_S16_3 from;
-  Fixed_S16_3 to;
-
-  AnimationProgress progress;
-
-  GStrokeWidthOp from_op;
-  GStrokeWidthOp to_op;
-} ScaleStrokeWidthCBContext;
-
 Fixed_S16_3 prv_stroke_width_transform(Fixed_S16_3 native, Fixed_S16_3 op_value,
                                        GStrokeWidthOp op) {
   switch (op) {
@@ -416,11 +502,9 @@ Fixed_S16_3 prv_stroke_width_transform(Fixed_S16_3 native, Fixed_S16_3 op_value,
   }
 }
 
-static bool prv_gdraw_command_scale_stroke_width(GDrawCommand *command, uint32_t index,
-                                                 void *context) {
-  ScaleStrokeWidthCBContext *scale = context;
-  const Fixed_S16_3 stroke_width =
-      Fixed_S16_3(gdraw_command_get_stroke_width(command) << FIXED_S16_3_PRECISION);
+static uint8_t prv_scale_stroke_width(uint8_t native_stroke_width,
+                                      const GStrokeWidthScale *scale) {
+  const Fixed_S16_3 stroke_width = Fixed_S16_3(native_stroke_width << FIXED_S16_3_PRECISION);
 
   Fixed_S16_3 from_stroke_width = prv_stroke_width_transform(stroke_width, scale->from,
                                                              scale->from_op);
@@ -429,8 +513,14 @@ static bool prv_gdraw_command_scale_stroke_width(GDrawCommand *command, uint32_t
 
   const uint16_t new_stroke_width = interpolate_int64_linear(
       scale->progress, from_stroke_width.raw_value, to_stroke_width.raw_value);
+  return ((new_stroke_width + FIXED_S16_3_HALF.raw_value) >> FIXED_S16_3_PRECISION);
+}
+
+static bool prv_gdraw_command_scale_stroke_width(GDrawCommand *command, uint32_t index,
+                                                 void *context) {
+  const GStrokeWidthScale *scale = context;
   gdraw_command_set_stroke_width(
-      command, ((new_stroke_width + FIXED_S16_3_HALF.raw_value) >> FIXED_S16_3_PRECISION));
+      command, prv_scale_stroke_width(gdraw_command_get_stroke_width(command), scale));
 
   return true;
 }
@@ -438,7 +528,7 @@ static bool prv_gdraw_command_scale_stroke_width(GDrawCommand *command, uint32_t
 void gdraw_command_list_scale_stroke_width(GDrawCommandList *list, Fixed_S16_3 from, Fixed_S16_3 to,
                                            GStrokeWidthOp from_op, GStrokeWidthOp to_op,
                                            AnimationProgress progress) {
-  ScaleStrokeWidthCBContext ctx = {
+  GStrokeWidthScale ctx = {
     .from = from,
     .to = to,
     .from_op = from_op,
@@ -455,6 +545,81 @@ void gdraw_command_image_scale_stroke_width(GDrawCommandImage *image, Fixed_S16_
 }
 
 
+////////////////////
+// segmented scale from a source list: all stages and the stroke width in a single pass
+
+#define SCALE_SEGMENTED_FROM_MAX_STAGES (2)
+
+typedef struct {
+  ScaleToGValues integer;
+  ScaleToGValues precise;
+  AnimationProgress normalized;
+  bool is_offset;
+} ScaleSegmentedFromStage;
+
+typedef struct {
+  GDrawCommandList *dest;
+  GDrawCommandList *source;
+  ScaleSegmentedFromStage stages[SCALE_SEGMENTED_FROM_MAX_STAGES];
+  size_t num_stages;
+  InterpolateInt64Function interpolate;
+  const GPointSegmentedTiming *timing;
+  const GStrokeWidthScale *stroke_width;
+  uint32_t current_index;
+} ScaleSegmentedFromCBContext;
+
+static bool prv_gdraw_command_scale_segmented_from(GDrawCommand *command, uint32_t index,
+                                                   void *context) {
+  ScaleSegmentedFromCBContext *ctx = context;
+  GDrawCommand *dest_command = prv_get_dest_command(ctx->dest, ctx->source, command);
+  const bool is_precise = (command->type == GDrawCommandTypePrecisePath);
+
+  const uint16_t num_points = gdraw_command_get_num_points(command);
+  for (uint16_t i = 0; i < num_points; i++) {
+    GPoint point = command->points[i];
+    for (size_t stage_index = 0; stage_index < ctx->num_stages; stage_index++) {
+      const ScaleSegmentedFromStage *stage = &ctx->stages[stage_index];
+      const AnimationProgress normalized = prv_segmented_timing_get_progress(
+          ctx->timing, ctx->current_index, stage->normalized);
+      point = prv_scale_segmented_point(point, is_precise ? &stage->precise : &stage->integer,
+                                        normalized, ctx->interpolate, stage->is_offset);
+    }
+    dest_command->points[i] = point;
+    ctx->current_index++;
+  }
+
+  if (ctx->stroke_width) {
+    gdraw_command_set_stroke_width(
+        dest_command,
+        prv_scale_stroke_width(gdraw_command_get_stroke_width(command), ctx->stroke_width));
+  }
+  return true;
+}
+
+void gdraw_command_list_scale_segmented_from(
+    GDrawCommandList *dest, GDrawCommandList *source, const GScaleSegmentedStage *stages,
+    size_t num_stages, InterpolateInt64Function interpolate, const GPointSegmentedTiming *timing,
+    const GStrokeWidthScale *stroke_width) {
+  PBL_ASSERTN(num_stages <= SCALE_SEGMENTED_FROM_MAX_STAGES);
+  ScaleSegmentedFromCBContext ctx = {
+    .dest = dest,
+    .source = source,
+    .num_stages = num_stages,
+    .interpolate = interpolate ? interpolate : prv_default_interpolate,
+    .timing = timing,
+    .stroke_width = stroke_width,
+  };
+  for (size_t i = 0; i < num_stages; i++) {
+    const GScaleSegmentedStage *stage = &stages[i];
+    ctx.stages[i].normalized = stage->normalized;
+    ctx.stages[i].is_offset = stage->is_offset;
+    prv_scale_to_gvalues_init(stage->size, stage->from, stage->to, stage->is_offset,
+                              &ctx.stages[i].integer, &ctx.stages[i].precise);
+  }
+  gdraw_command_list_iterate(source, prv_gdraw_command_scale_segmented_from, &ctx);
+}
+
+
 ////////////////////
 // replace color
 
@@ -73,6 +73,12 @@ void gdraw_command_list_attract_to_square(GDrawCommandList *list, GSize size, in
 
 //! Attracts points of an image to a square
 void gdraw_command_image_attract_to_square(GDrawCommandImage *image, int32_t normalized);
+
+//! Writes the points of `source` attracted to a square into `dest`
+//! @param dest GDrawCommandList with the same structure as `source`, e.g. a clone of it. Only its
+//! points are written.
+void gdraw_command_list_attract_to_square_from(GDrawCommandList *dest, GDrawCommandList *source,
+                                               GSize size, int32_t normalized);
 GPoint gpoint_attract_to_square(GPoint point, GSize size, int32_t normalized);
 
 //! Creates a GPointIndexLookup based on the angle to the center of an image
@@ -149,6 +155,56 @@ void gdraw_command_image_scale_segmented_to(
     InterpolateInt64Function interpolate, GPointIndexLookup *lookup, Fixed_S32_16 duration_fraction,
     bool is_offset);
 
+//! The \ref animation_timing_segmented start time of each point of a GPointIndexLookup. This
+//! doesn't depend on the animation position, so it can be worked out once for all frames.
+//! @see gpoint_segmented_timing_create
+typedef struct {
+  Fixed_S32_16 duration_fraction;
+  uint16_t num_points;
+  uint16_t start[];
+} GPointSegmentedTiming;
+
+//! Creates the per-point timing of a segmented animation. Free it with applib_free.
+//! @param lookup \ref GPointIndexLookup delay index that each point's delay is derived from.
+//! @param duration_fraction \ref animation_timing_segmented animation duration that each
+//! point would animate in within the animation's duration.
+//! @return the timing, or NULL if out of memory
+GPointSegmentedTiming *gpoint_segmented_timing_create(const GPointIndexLookup *lookup,
+                                                      Fixed_S32_16 duration_fraction);
+
+//! One stage of \ref gdraw_command_list_scale_segmented_from. The fields have the same meaning
+//! as the arguments of \ref gdraw_command_list_scale_segmented_to.
+typedef struct {
+  GSize size;
+  GRect from;
+  GRect to;
+  AnimationProgress normalized;
+  bool is_offset;
+} GScaleSegmentedStage;
+
+//! A stroke width transform, @see gdraw_command_list_scale_stroke_width
+typedef struct {
+  Fixed_S16_3 from;
+  Fixed_S16_3 to;
+  GStrokeWidthOp from_op;
+  GStrokeWidthOp to_op;
+  AnimationProgress progress;
+} GStrokeWidthScale;
+
+//! Writes the result of copying `source` and then applying \ref
+//! gdraw_command_list_scale_segmented_to once per stage followed by \ref
+//! gdraw_command_list_scale_stroke_width into `dest`. Each point goes through all stages at once
+//! and `source` is left untouched.
+//! @param dest GDrawCommandList with the same structure as `source`, e.g. a clone of it. Only its
+//! points and stroke widths are written.
+//! @param stages Stages to apply in order, at most two.
+//! @param timing Per-point timing shared by all stages.
+//! @param stroke_width Stroke width transform, or NULL to leave the stroke widths alone.
+void gdraw_command_list_scale_segmented_from(
+    GDrawCommandList *dest, GDrawCommandList *source, const GScaleSegmentedStage *stages,
+    size_t num_stages, InterpolateInt64Function interpolate, const GPointSegmentedTiming *timing,
+    const GStrokeWidthScale *stroke_width);
+
 //! Scales and translates a GPoint.
 //! @param point Point to transform.
 //! @param size Dimensions of the canvas or image the point belongs to.
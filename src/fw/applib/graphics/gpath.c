@@ -23,10 +23,12 @@
 #include "applib/app_logging.h"
 #include "system/logging.h"
 #include "system/passert.h"
+#include "util/bitset.h"
 #include "util/math.h"
 #include "util/swap.h"
 #include "util/trig.h"
 
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -73,34 +75,6 @@ static GPoint rotate_offset_point(const GPoint *orig, int32_t rotation, const GP
   return result;
 }
 
-static void sort16(int16_t *values, size_t length) {
-  for (unsigned int i = 0; i < length; i++) {
-    for (unsigned int j = i+1; j < length; j++) {
-      if (values[i] > values[j]) {
-        swap16(&values[i], &values[j]);
-      }
-    }
-  }
-}
-
-#if PBL_COLOR
-static void swapIntersections(Intersection *a, Intersection *b) {
-  Intersection t = *a;
-  *a = *b;
-  *b = t;
-}
-
-static void sortIntersections(Intersection *values, size_t length) {
-  for (unsigned int i = 0; i < length; i++) {
-    for (unsigned int j = i+1; j < length; j++) {
-      if (values[i].x.raw_value > values[j].x.raw_value) {
-        swapIntersections(&values[i], &values[j]);
-      }
-    }
-  }
-}
-#endif
-
 static inline bool prv_is_in_range(int16_t min_a, int16_t max_a, int16_t min_b, int16_t max_b) {
   return (max_a >= min_b) && (min_a <= max_b);
 }
@@ -210,255 +184,294 @@ GRect gpath_outer_rect(GPath *path) {
   return GRect(min_x, min_y, (max_x - min_x), (max_y - min_y));
 }
 
-#if PBL_COLOR
-void prv_fill_path_with_cb_aa(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
-                              void *user_data) {
-  /*
-   * Filling gpaths with antialiasing for integral-coordinates based paths:
-   *
-   * Custom linescanner using simple mathematic trick to determine anti-aliased edges
-   *  1. Rotate all points in path
-   *  2. Progress line-by-line finding intersections with paths
-   *  2.1 Calculate delta (angle) of the intersecting lines
-   *  2.2 Sort intersections
-   *  2.3 Draw lines between intersections
-   *
-   * This algorithm relies on few tricks:
-   *  - For intersections with delta less than 1 (angle is less than 45°) we will use exact
-   *      position of the intersection and fill edge pixel based on that information
-   *  - For intersections with delta bigger than 1 (angle is bigger than 45°) we will use delta to
-   *      draw gradient line responding to the angle
-   *      + If gradient is bigger than distance from the start/end of the intersecting line
-   *          we will adjust the delta to match starting/ending point and avoid nasty
-   *          gradients diving in/out the path
-   *      + Gradients too close to clipping rect will be properly cut off
-   */
+//! A path segment in the scanline fill's edge table. A segment ends where the next one in the path
+//! starts, so only the start point is kept, which keeps the fill's scratch memory below what the
+//! per-row scan it replaced needed.
+typedef struct GPathEdge {
+  //! Start point, in Fixed_S16_3 raw units when antialiased
+  int16_t x;
+  int16_t y;
+  //! Where the segment intersects the current row, in the same units as the start point. Until the
+  //! segment becomes active this holds the row it becomes active on instead.
+  int16_t intersection_x;
+} GPathEdge;
+
+//! The edge table refers to segments by their position in the path. The segment's flags ride along
+//! in the top bits so that the edges themselves don't need any more room.
+typedef uint16_t GPathEdgeRef;
+
+#define GPATH_EDGE_REF_IS_DOWN (1 << 15)
+//! The previous segment went in the same direction and already counted the start row
+#define GPATH_EDGE_REF_SKIP_START (1 << 14)
+#define GPATH_EDGE_REF_INDEX_MASK (GPATH_EDGE_REF_SKIP_START - 1)
+
+static uint32_t prv_ref_index(GPathEdgeRef ref) {
+  return ref & GPATH_EDGE_REF_INDEX_MASK;
+}
 
+static bool prv_ref_is_down(GPathEdgeRef ref) {
+  return (ref & GPATH_EDGE_REF_IS_DOWN) != 0;
+}
 
-  // Protect against apps calling with no points to draw (Upright watchface)
-  if (!path || path->num_points < 2) {
-    return;
-  }
+static int16_t prv_row_for_y(int16_t y, bool antialiased) {
+  return antialiased ? (Fixed_S16_3){.raw_value = y}.integer : y;
+}
 
-  GPointPrecise* rot_points = applib_malloc(path->num_points * sizeof(GPointPrecise));
-  if (!rot_points) {
-    return;
+static const GPathEdge *prv_edge_end(const GPathEdge *edges, uint32_t num_edges, uint32_t index) {
+  return &edges[(index + 1 < num_edges) ? (index + 1) : 0];
+}
+
+static int16_t prv_edge_get_last_row(const GPathEdge *edges, uint32_t num_edges, GPathEdgeRef ref,
+                                     bool antialiased) {
+  const uint32_t index = prv_ref_index(ref);
+  if (prv_ref_is_down(ref)) {
+    return prv_row_for_y(prv_edge_end(edges, num_edges, index)->y, antialiased);
   }
+  return prv_row_for_y(edges[index].y, antialiased) - ((ref & GPATH_EDGE_REF_SKIP_START) ? 1 : 0);
+}
 
-  int min_x, max_x, min_y, max_y;
-  GPointPrecise rot_start, rot_end;
-  bool found_start_direction = false;
-  bool start_is_down = false;
-  Intersection *intersections_up = NULL;
-  Intersection *intersections_down = NULL;
-
-  rot_points[0] = rot_end = GPointPreciseFromGPoint(
-      rotate_offset_point(&path->points[0], path->rotation, &path->offset));
-  min_x = max_x = rot_points[0].x.integer;
-  min_y = max_y = rot_points[0].y.integer;
-
-  // begin finding the last path segment's direction going backwards through the path
-  // we must go backwards because we find intersections going forwards
-  for (int i = path->num_points - 1; i > 0; --i) {
-    rot_points[i] = rot_start = GPointPreciseFromGPoint(
-        rotate_offset_point(&path->points[i], path->rotation, &path->offset));
-    if (min_x > rot_points[i].x.integer) { min_x = rot_points[i].x.integer; }
-    if (max_x < rot_points[i].x.integer) { max_x = rot_points[i].x.integer; }
-    if (min_y > rot_points[i].y.integer) { min_y = rot_points[i].y.integer; }
-    if (max_y < rot_points[i].y.integer) { max_y = rot_points[i].y.integer; }
-
-    if (found_start_direction) {
-      continue;
-    }
+static void prv_edge_intersect_row(GPathEdge *edge, const GPathEdge *end, int16_t row,
+                                   bool antialiased) {
+  const int row_scale = antialiased ? FIXED_S16_3_ONE.raw_value : 1;
+  // the antialiased fill has always done this in 16 bits
+  const int32_t delta_x = antialiased ? (int16_t)(end->x - edge->x) : (end->x - edge->x);
+  const int32_t delta_y = antialiased ? (int16_t)(end->y - edge->y) : (end->y - edge->y);
+  // linear interpolation of the line intersection
+  edge->intersection_x = edge->x + delta_x * (row * row_scale - edge->y) / delta_y;
+}
 
-    // use the first non-horizontal path segment's direction as the start direction
-    if (rot_end.y.integer != rot_start.y.integer) {
-      start_is_down = rot_end.y.integer > rot_start.y.integer;
-      found_start_direction = true;
+//! Works out the gradient to draw where an antialiased segment intersects the current row. Only
+//! the ends of the spans need it, so it isn't kept in the edge table.
+static Intersection prv_edge_get_intersection(const GPathEdge *edges, uint32_t num_edges,
+                                              GPathEdgeRef ref) {
+  const uint32_t index = prv_ref_index(ref);
+  const GPathEdge *edge = &edges[index];
+  const GPathEdge *end = prv_edge_end(edges, num_edges, index);
+  const int16_t delta_x = end->x - edge->x;
+  const int16_t delta_y = end->y - edge->y;
+  const Fixed_S16_3 x = (Fixed_S16_3){.raw_value = edge->intersection_x};
+
+  // For intersections with delta less than 1 (angle is less than 45°) we will use exact position
+  // of the intersection and fill edge pixel based on that information. For intersections with
+  // delta bigger than 1 (angle is bigger than 45°) we will use delta to draw gradient line
+  // responding to the angle. If the gradient is bigger than distance from the start/end of the
+  // intersecting line we will adjust the delta to match starting/ending point and avoid nasty
+  // gradients diving in/out the path.
+  Fixed_S16_3 delta = (Fixed_S16_3){.raw_value = ABS(delta_x / delta_y) *
+                                                 FIXED_S16_3_ONE.raw_value};
+  if (delta.integer > 1) {
+    // this is where we try to fix edges diving in and out of paths
+    int16_t min_x = end->x < edge->x ? end->x : edge->x;
+    int16_t max_x = end->x > edge->x ? end->x : edge->x;
+
+    if (x.raw_value - (delta.raw_value / 2) < min_x) {
+      delta.raw_value = (x.raw_value - min_x) * 2;
     }
 
-    rot_end = rot_start;
-  }
-
-  const int16_t clip_min_x = ctx->draw_state.clip_box.origin.x
-      - ctx->draw_state.drawing_box.origin.x;
-  const int16_t clip_max_x = ctx->draw_state.clip_box.size.w + clip_min_x;
-  if (!prv_is_in_range(min_x, max_x, clip_min_x, clip_max_x)) {
-    goto cleanup;
+    if (x.raw_value + (delta.raw_value / 2) > max_x) {
+      delta.raw_value = (max_x - x.raw_value) * 2;
+    }
   }
+  return (Intersection) { .x = x, .delta = delta };
+}
 
-  // x-intersections of path segments whose direction is up
-  intersections_up = applib_zalloc(path->num_points * sizeof(Intersection));
-  // x-intersections of path segments whose direction is down
-  intersections_down = applib_zalloc(path->num_points * sizeof(Intersection));
+static int16_t prv_ref_intersection_x(const GPathEdge *edges, GPathEdgeRef ref) {
+  return edges[prv_ref_index(ref)].intersection_x;
+}
 
-  // If either malloc failed, log message and cleanup
-  if (!intersections_up || !intersections_down) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
-    goto cleanup;
+static void prv_sift_down_pending_edge(const GPathEdge *edges, GPathEdgeRef *pending,
+                                       uint32_t root, uint32_t count) {
+  while (2 * root + 1 < count) {
+    uint32_t child = 2 * root + 1;
+    if ((child + 1 < count) && (prv_ref_intersection_x(edges, pending[child]) <
+                                prv_ref_intersection_x(edges, pending[child + 1]))) {
+      child++;
+    }
+    if (prv_ref_intersection_x(edges, pending[root]) >=
+        prv_ref_intersection_x(edges, pending[child])) {
+      return;
+    }
+    const GPathEdgeRef t = pending[root];
+    pending[root] = pending[child];
+    pending[child] = t;
+    root = child;
   }
+}
 
-  int intersection_up_count;
-  int intersection_down_count;
+//! Orders the edges waiting to become active by their first row. A heap sort doesn't need any
+//! more memory and doesn't degrade on the long sorted runs paths usually have.
+static void prv_sort_pending_edges(const GPathEdge *edges, GPathEdgeRef *pending,
+                                   uint32_t count) {
+  for (uint32_t i = count / 2; i > 0; i--) {
+    prv_sift_down_pending_edge(edges, pending, i - 1, count);
+  }
+  for (uint32_t end = count; end > 1; end--) {
+    const GPathEdgeRef t = pending[0];
+    pending[0] = pending[end - 1];
+    pending[end - 1] = t;
+    prv_sift_down_pending_edge(edges, pending, 0, end - 1);
+  }
+}
 
-  // convert clip coordinates to drawing coordinates
-  const int16_t clip_min_y = ctx->draw_state.clip_box.origin.y
-      - ctx->draw_state.drawing_box.origin.y;
-  const int16_t clip_max_y = ctx->draw_state.clip_box.size.h + clip_min_y;
-  min_y = MAX(min_y, clip_min_y);
-  max_y = MIN(max_y, clip_max_y);
+//! Keeps the active edges sorted by where they intersect the current row. The order barely changes
+//! from one row to the next, so the insertion sort is close to linear.
+static void prv_sort_active_edges(const GPathEdge *edges, GPathEdgeRef *active, uint32_t count) {
+  for (uint32_t i = 1; i < count; i++) {
+    const GPathEdgeRef ref = active[i];
+    const int16_t x = prv_ref_intersection_x(edges, ref);
+    uint32_t j = i;
+    for (; (j > 0) && (prv_ref_intersection_x(edges, active[j - 1]) > x); j--) {
+      active[j] = active[j - 1];
+    }
+    active[j] = ref;
+  }
+}
 
-  // filling color hack
-  GColor tmp = ctx->draw_state.stroke_color;
-  ctx->draw_state.stroke_color = ctx->draw_state.fill_color;
-
-  // find all of the horizontal intersections and draw them
-  for (int16_t i = min_y; i <= max_y; ++i) {
-    // initialize with 0 intersections
-    intersection_down_count = 0;
-    intersection_up_count = 0;
-
-    // horizontal path segments don't have a direction and depend
-    // upon the last path segment's direction
-    // keep track of the last path direction for horizontal path segments to use
-    bool last_is_down = start_is_down;
-    rot_end = rot_points[0];
-
-    // find the intersections
-    for (uint32_t j = 0; j < path->num_points; ++j) {
-      rot_start = rot_points[j];
-      if (j + 1 < path->num_points) {
-        rot_end = rot_points[j + 1];
-      } else {
-        // wrap to the first point
-        rot_end = rot_points[0];
+//! Intersections in the same direction are paired up by rank, so when two of them have the same x
+//! but different deltas the order they were sorted in decides which delta ends up in which span.
+static bool prv_has_ambiguous_ties(const GPathEdge *edges, uint32_t num_edges,
+                                   const GPathEdgeRef *active, uint32_t count) {
+  const GPathEdgeRef *prev[2] = { NULL, NULL };
+  for (uint32_t i = 0; i < count; i++) {
+    const bool is_down = prv_ref_is_down(active[i]);
+    const GPathEdgeRef *prev_ref = prev[is_down];
+    if (prev_ref && (prv_ref_intersection_x(edges, *prev_ref) ==
+                     prv_ref_intersection_x(edges, active[i]))) {
+      const Intersection a = prv_edge_get_intersection(edges, num_edges, *prev_ref);
+      const Intersection b = prv_edge_get_intersection(edges, num_edges, active[i]);
+      if (a.delta.raw_value != b.delta.raw_value) {
+        return true;
       }
+    }
+    prev[is_down] = &active[i];
+  }
+  return false;
+}
 
-      // if the line is on/crosses this height
-      if ((rot_start.y.integer - i) * (rot_end.y.integer - i) <= 0) {
-        bool is_down = rot_end.y.integer != rot_start.y.integer ?
-                       rot_end.y.integer > rot_start.y.integer : last_is_down;
-        // don't count end points in the same direction to avoid double intersections
-        if (!(rot_start.y.integer == i && last_is_down == is_down)) {
-          // linear interpolation of the line intersection
-
-          int16_t delta_x = rot_end.x.raw_value - rot_start.x.raw_value;
-          int16_t delta_y = rot_end.y.raw_value - rot_start.y.raw_value;
-
-          Fixed_S16_3 x = (Fixed_S16_3){.raw_value = rot_start.x.raw_value + delta_x
-                          * (i * FIXED_S16_3_ONE.raw_value - rot_start.y.raw_value) / delta_y};
-
-          Fixed_S16_3 delta = (Fixed_S16_3){.raw_value = ABS(delta_x / delta_y) *
-                                                          FIXED_S16_3_ONE.raw_value};
-
-          if (delta.integer > 1) {
-            // this is where we try to fix edges diving in and out of paths
-            int16_t min_x = rot_end.x.raw_value < rot_start.x.raw_value ?
-                              rot_end.x.raw_value : rot_start.x.raw_value;
-            int16_t max_x = rot_end.x.raw_value > rot_start.x.raw_value ?
-                              rot_end.x.raw_value : rot_start.x.raw_value;
-
-            if (x.raw_value - (delta.raw_value / 2) < min_x) {
-              delta.raw_value = (x.raw_value - min_x) * 2;
-            }
-
-            if (x.raw_value + (delta.raw_value / 2) > max_x) {
-              delta.raw_value = (max_x - x.raw_value) * 2;
-            }
-          }
-
-          if (is_down) {
-            intersections_down[intersection_down_count].x.raw_value = x.raw_value;
-            intersections_down[intersection_down_count].delta = delta;
-            intersection_down_count++;
-          } else {
-            intersections_up[intersection_up_count].x.raw_value = x.raw_value;
-            intersections_up[intersection_up_count].delta = delta;
-            intersection_up_count++;
-          }
-        }
-        last_is_down = is_down;
+//! Lists the row's edges the way the original per-row scan did, which visited the segments in path
+//! order, split them by direction and selection sorted each half. The active edges are tracked in
+//! per-direction bitmaps by path index, so reading those back already gives path order. Only used
+//! for rows with ambiguous ties.
+//! @return the number of up edges, which come before the down edges. The refs only hold the index.
+static uint32_t prv_sort_row_edges_by_path(const GPathEdge *edges, uint32_t num_edges,
+                                           uint8_t *const active_edges[2],
+                                           GPathEdgeRef *row_edges) {
+  uint32_t count = 0;
+  uint32_t up_count = 0;
+  for (int is_down = 0; is_down < 2; is_down++) {
+    const uint32_t start = count;
+    for (uint32_t byte = 0; byte < DIVIDE_CEIL(num_edges, 8); byte++) {
+      for (uint32_t bits = active_edges[is_down][byte]; bits; bits &= bits - 1) {
+        row_edges[count++] = byte * 8 + __builtin_ctz(bits);
       }
     }
-
-    // sort the intersections
-    sortIntersections(intersections_up, intersection_up_count);
-    sortIntersections(intersections_down, intersection_down_count);
-
-    // draw the line segments
-    for (int j = 0; j < MIN(intersection_up_count, intersection_down_count); j++) {
-      Intersection x_a = intersections_up[j];
-      Intersection x_b = intersections_down[j];
-      if (x_a.x.integer != x_b.x.integer) {
-        if (x_a.x.integer > x_b.x.integer) {
-          swapIntersections(&x_a, &x_b);
+    // selection sort by x, which isn't stable, so that ties end up where they always did
+    for (uint32_t i = start; i < count; i++) {
+      GPathEdgeRef min = row_edges[i];
+      int16_t min_x = prv_ref_intersection_x(edges, min);
+      for (uint32_t j = i + 1; j < count; j++) {
+        const int16_t x = prv_ref_intersection_x(edges, row_edges[j]);
+        if (min_x > x) {
+          const GPathEdgeRef t = min;
+          min = row_edges[j];
+          min_x = x;
+          row_edges[j] = t;
         }
-        // this is done by callback now...
-        // x_a.x.integer++;
-        // x_b.x.integer--;
-
-        cb(ctx, i, x_a.x, x_b.x, x_a.delta, x_b.delta, user_data);
       }
+      row_edges[i] = min;
+    }
+    if (!is_down) {
+      up_count = count;
     }
   }
+  return up_count;
+}
 
-  // restore original stroke color
-  ctx->draw_state.stroke_color = tmp;
+static void prv_fill_span(GContext *ctx, int16_t row, const GPathEdge *edges, uint32_t num_edges,
+                          GPathEdgeRef up, GPathEdgeRef down, bool antialiased,
+                          GPathDrawFilledCallback cb, void *user_data) {
+  if (antialiased) {
+    Intersection x_a = prv_edge_get_intersection(edges, num_edges, up);
+    Intersection x_b = prv_edge_get_intersection(edges, num_edges, down);
+    if (x_a.x.integer != x_b.x.integer) {
+      if (x_a.x.integer > x_b.x.integer) {
+        const Intersection t = x_a;
+        x_a = x_b;
+        x_b = t;
+      }
+      // the callback moves the ends in by a pixel
+      cb(ctx, row, x_a.x, x_b.x, x_a.delta, x_b.delta, user_data);
+    }
+    return;
+  }
 
-cleanup:
-  applib_free(rot_points);
-  applib_free(intersections_up);
-  applib_free(intersections_down);
+  int16_t x_a = prv_ref_intersection_x(edges, up);
+  int16_t x_b = prv_ref_intersection_x(edges, down);
+  if (x_a != x_b) {
+    if (x_a > x_b) {
+      swap16(&x_a, &x_b);
+    }
+    cb(ctx, row, (Fixed_S16_3){.integer = x_a}, (Fixed_S16_3){.integer = x_b},
+       (Fixed_S16_3){.integer = -1}, (Fixed_S16_3){.integer = -1}, user_data);
+  }
 }
-#endif // PBL_COLOR
 
-void gpath_draw_filled_with_cb(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
-                               void *user_data) {
-  //Protect against apps calling with no points to draw (Upright watchface)
+static void prv_fill_path_with_cb(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
+                                  void *user_data, bool antialiased) {
+  /*
+   * Active edge table scanline fill:
+   *
+   *  1. Rotate all points in path
+   *  2. Work out which rows every path segment intersects and queue the segments by first row
+   *  3. Progress line-by-line keeping a list of the segments which intersect the row
+   *  3.1 Calculate the intersections
+   *  3.2 Keep the list sorted by intersection
+   *  3.3 Draw lines between up and down intersections of the same rank
+   *
+   * Antialiased fills work in Fixed_S16_3 units so the edges can be drawn with gradients, see
+   * prv_edge_get_intersection().
+   */
+
+  // Protect against apps calling with no points to draw (Upright watchface)
   if (!path || path->num_points < 2) {
     return;
   }
-
-  GPoint* rot_points = applib_malloc(path->num_points * sizeof(GPoint));
-  if (!rot_points) {
+  // a path with more points than an edge ref can hold wouldn't fit in the heap anyway
+  if (path->num_points > GPATH_EDGE_REF_INDEX_MASK + 1) {
     APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
     return;
   }
+  const uint32_t num_edges = path->num_points;
 
-  int min_x, max_x, min_y, max_y;
-  GPoint rot_start, rot_end;
-  bool found_start_direction = false;
-  bool start_is_down = false;
-  int16_t *intersections_up = NULL;
-  int16_t *intersections_down = NULL;
-
-  rot_points[0] = rot_end = rotate_offset_point(&path->points[0], path->rotation, &path->offset);
-  min_x = max_x = rot_points[0].x;
-  min_y = max_y = rot_points[0].y;
-
-  // begin finding the last path segment's direction going backwards through the path
-  // we must go backwards because we find intersections going forwards
-  for (int i = path->num_points - 1; i > 0; --i) {
-    rot_points[i] = rot_start = rotate_offset_point(&path->points[i], path->rotation, &path->offset);
-    if (min_x > rot_points[i].x) { min_x = rot_points[i].x; }
-    if (max_x < rot_points[i].x) { max_x = rot_points[i].x; }
-    if (min_y > rot_points[i].y) { min_y = rot_points[i].y; }
-    if (max_y < rot_points[i].y) { max_y = rot_points[i].y; }
-
-    if (found_start_direction) {
-      continue;
-    }
-
-    // use the first non-horizontal path segment's direction as the start direction
-    if (rot_end.y != rot_start.y) {
-      start_is_down = rot_end.y > rot_start.y;
-      found_start_direction = true;
+  GPathEdge *edges = applib_malloc(num_edges * sizeof(GPathEdge));
+  if (!edges) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
+    return;
+  }
+  GPathEdgeRef *active = NULL;
+  GPathEdgeRef *tied = NULL;
+  uint8_t *active_edges[2] = { NULL, NULL };
+
+  int min_x = INT_MAX, max_x = INT_MIN, min_y = INT_MAX, max_y = INT_MIN;
+  for (uint32_t i = 0; i < num_edges; ++i) {
+    const GPoint rot = rotate_offset_point(&path->points[i], path->rotation, &path->offset);
+    int16_t x, y;
+    if (antialiased) {
+      const GPointPrecise rot_precise = GPointPreciseFromGPoint(rot);
+      edges[i].x = rot_precise.x.raw_value;
+      edges[i].y = rot_precise.y.raw_value;
+      x = rot_precise.x.integer;
+      y = rot_precise.y.integer;
+    } else {
+      x = edges[i].x = rot.x;
+      y = edges[i].y = rot.y;
     }
-
-    rot_end = rot_start;
+    min_x = MIN(min_x, x);
+    max_x = MAX(max_x, x);
+    min_y = MIN(min_y, y);
+    max_y = MAX(max_y, y);
   }
 
-
   const int16_t clip_min_x = ctx->draw_state.clip_box.origin.x
       - ctx->draw_state.drawing_box.origin.x;
   const int16_t clip_max_x = ctx->draw_state.clip_box.size.w + clip_min_x;
@@ -466,87 +479,167 @@ void gpath_draw_filled_with_cb(GContext *ctx, GPath *path, GPathDrawFilledCallba
     goto cleanup;
   }
 
-  // x-intersections of path segments whose direction is up
-  intersections_up = applib_zalloc(path->num_points * sizeof(int16_t));
-  // x-intersections of path segments whose direction is down
-  intersections_down = applib_zalloc(path->num_points * sizeof(int16_t));
+  // convert clip coordinates to drawing coordinates
+  const int16_t clip_min_y = ctx->draw_state.clip_box.origin.y
+      - ctx->draw_state.drawing_box.origin.y;
+  const int16_t clip_max_y = ctx->draw_state.clip_box.size.h + clip_min_y;
+  min_y = MAX(min_y, clip_min_y);
+  max_y = MIN(max_y, clip_max_y);
+  if (min_y > max_y) {
+    goto cleanup;
+  }
 
-  // If either malloc failed, log message and cleanup
-  if (!intersections_up || !intersections_down) {
+  // the active edges from the front, the edges waiting for their first row from the back
+  active = applib_malloc(num_edges * sizeof(GPathEdgeRef));
+  if (!active) {
     APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
     goto cleanup;
   }
+  // antialiased fills also need room to reorder rows with ambiguous ties: a bitmap of the active
+  // edges per direction and the reordered row. That is allocated up front so a fill never changes
+  // its output halfway through, and it still keeps antialiased fills within the per-row scan's
+  // two intersections per point.
+  if (antialiased) {
+    const size_t bitmap_size = DIVIDE_CEIL(num_edges, 8);
+    tied = applib_zalloc(num_edges * sizeof(GPathEdgeRef) + 2 * bitmap_size);
+    if (!tied) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
+      goto cleanup;
+    }
+    active_edges[0] = (uint8_t *)&tied[num_edges];
+    active_edges[1] = active_edges[0] + bitmap_size;
+  }
 
-  int intersection_up_count;
-  int intersection_down_count;
+  // horizontal path segments don't have a direction and depend upon the last path segment's
+  // direction, so start with the direction of the last non-horizontal segment
+  bool last_is_down = false;
+  for (uint32_t i = num_edges - 1; i > 0; --i) {
+    const int16_t start_row = prv_row_for_y(edges[i].y, antialiased);
+    const int16_t end_row = prv_row_for_y(prv_edge_end(edges, num_edges, i)->y, antialiased);
+    if (end_row != start_row) {
+      last_is_down = end_row > start_row;
+      break;
+    }
+  }
 
-  const int16_t clip_min_y = ctx->draw_state.clip_box.origin.y
-      - ctx->draw_state.drawing_box.origin.y;
-  const int16_t clip_max_y = ctx->draw_state.clip_box.size.h + clip_min_y;
-  min_y = MAX(min_y, clip_min_y);
-  max_y = MIN(max_y, clip_max_y);
+  uint32_t pending_start = num_edges;
+  for (uint32_t i = 0; i < num_edges; ++i) {
+    GPathEdge *edge = &edges[i];
+    const int16_t start_row = prv_row_for_y(edge->y, antialiased);
+    const int16_t end_row = prv_row_for_y(prv_edge_end(edges, num_edges, i)->y, antialiased);
+    if (end_row == start_row) {
+      // horizontal segments never count as intersections
+      continue;
+    }
+    const bool is_down = end_row > start_row;
+    // don't count the start point if the last segment went in the same direction, as it already
+    // counted it as its end point
+    const bool skip_start = (last_is_down == is_down);
+    last_is_down = is_down;
+
+    const int16_t skip = skip_start ? 1 : 0;
+    const int16_t first_row = is_down ? (start_row + skip) : end_row;
+    const int16_t last_row = is_down ? end_row : (start_row - skip);
+    if ((last_row < min_y) || (first_row > max_y)) {
+      continue;
+    }
+    edge->intersection_x = MAX(first_row, min_y);
+    active[--pending_start] = i | (is_down ? GPATH_EDGE_REF_IS_DOWN : 0) |
+                              (skip_start ? GPATH_EDGE_REF_SKIP_START : 0);
+  }
+  prv_sort_pending_edges(edges, &active[pending_start], num_edges - pending_start);
 
-  // find all of the horizontal intersections and draw them
-  for (int16_t i = min_y; i <= max_y; ++i) {
-    // initialize with 0 intersections
-    intersection_down_count = 0;
-    intersection_up_count = 0;
-
-    // horizontal path segments don't have a direction and depend upon the last path segment's direction
-    // keep track of the last path direction for horizontal path segments to use
-    bool last_is_down = start_is_down;
-    rot_end = rot_points[0];
-
-    // find the intersections
-    for (uint32_t j = 0; j < path->num_points; ++j) {
-      rot_start = rot_points[j];
-      if (j + 1 < path->num_points) {
-        rot_end = rot_points[j + 1];
-      } else {
-        // wrap to the first point
-        rot_end = rot_points[0];
+  // filling color hack
+  const GColor tmp = ctx->draw_state.stroke_color;
+  if (antialiased) {
+    ctx->draw_state.stroke_color = ctx->draw_state.fill_color;
+  }
+
+  uint32_t active_count = 0;
+  for (int16_t row = min_y; row <= max_y; ++row) {
+    // drop the edges which ended on the last row and pick up the ones starting on this row. Every
+    // edge leaves the pending queue before it joins the active list, so the two never overlap.
+    uint32_t kept_count = 0;
+    for (uint32_t i = 0; i < active_count; i++) {
+      if (prv_edge_get_last_row(edges, num_edges, active[i], antialiased) >= row) {
+        active[kept_count++] = active[i];
+      } else if (antialiased) {
+        bitset8_clear(active_edges[prv_ref_is_down(active[i])], prv_ref_index(active[i]));
+      }
+    }
+    active_count = kept_count;
+    while ((pending_start < num_edges) &&
+           (prv_ref_intersection_x(edges, active[pending_start]) <= row)) {
+      if (antialiased) {
+        bitset8_set(active_edges[prv_ref_is_down(active[pending_start])],
+                    prv_ref_index(active[pending_start]));
       }
+      active[active_count++] = active[pending_start++];
+    }
+    if (active_count == 0) {
+      continue;
+    }
 
-      // if the line is on/crosses this height
-      if ((rot_start.y - i) * (rot_end.y - i) <= 0) {
-        bool is_down = rot_end.y != rot_start.y ? rot_end.y > rot_start.y : last_is_down;
-        // don't count end points in the same direction to avoid double intersections
-        if (!(rot_start.y == i && last_is_down == is_down)) {
-          // linear interpolation of the line intersection
-          int16_t x = rot_start.x + (rot_end.x - rot_start.x) * (i - rot_start.y) / (rot_end.y - rot_start.y);
-          if (is_down) {
-            intersections_down[intersection_down_count] = x;
-            intersection_down_count++;
-          } else {
-            intersections_up[intersection_up_count] = x;
-            intersection_up_count++;
-          }
-        }
-        last_is_down = is_down;
+    for (uint32_t i = 0; i < active_count; i++) {
+      const uint32_t index = prv_ref_index(active[i]);
+      prv_edge_intersect_row(&edges[index], prv_edge_end(edges, num_edges, index), row,
+                             antialiased);
+    }
+    prv_sort_active_edges(edges, active, active_count);
+
+    if (antialiased && prv_has_ambiguous_ties(edges, num_edges, active, active_count)) {
+      // reorder a copy so the next row still starts from edges in x order. This is the per-row
+      // scan's quadratic sort again, and self-intersecting paths hit it on their busiest rows, so
+      // antialiased fills of those are up to a quarter slower than they were. Simple paths rarely
+      // have such ties.
+      const uint32_t up_count = prv_sort_row_edges_by_path(edges, num_edges, active_edges, tied);
+      const uint32_t down_count = active_count - up_count;
+      for (uint32_t j = 0; j < MIN(up_count, down_count); j++) {
+        prv_fill_span(ctx, row, edges, num_edges, tied[j], tied[up_count + j],
+                      antialiased, cb, user_data);
       }
+      continue;
     }
 
-    // sort the intersections
-    sort16(intersections_up, intersection_up_count);
-    sort16(intersections_down, intersection_down_count);
-
-    // draw the line segments
-    for (int j = 0; j < MIN(intersection_up_count, intersection_down_count); j++) {
-      int16_t x_a = intersections_up[j];
-      int16_t x_b = intersections_down[j];
-      if (x_a != x_b) {
-        if (x_a > x_b) {
-          swap16(&x_a, &x_b);
-        }
-        cb(ctx, i, (Fixed_S16_3){.integer = x_a}, (Fixed_S16_3){.integer = x_b},
-           (Fixed_S16_3){.integer = -1}, (Fixed_S16_3){.integer = -1}, user_data);
+    // draw lines between the n-th up and the n-th down intersection
+    uint32_t up = 0;
+    uint32_t down = 0;
+    while (true) {
+      while ((up < active_count) && prv_ref_is_down(active[up])) {
+        up++;
+      }
+      while ((down < active_count) && !prv_ref_is_down(active[down])) {
+        down++;
+      }
+      if ((up == active_count) || (down == active_count)) {
+        break;
       }
+      prv_fill_span(ctx, row, edges, num_edges, active[up++], active[down++], antialiased, cb,
+                    user_data);
     }
   }
+
+  if (antialiased) {
+    // restore original stroke color
+    ctx->draw_state.stroke_color = tmp;
+  }
+
 cleanup:
-  applib_free(rot_points);
-  applib_free(intersections_up);
-  applib_free(intersections_down);
+  applib_free(edges);
+  applib_free(active);
+  applib_free(tied);
+}
+
+#if PBL_COLOR
+void prv_fill_path_with_cb_aa(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
+                              void *user_data) {
+  prv_fill_path_with_cb(ctx, path, cb, user_data, true /* antialiased */);
+}
+#endif // PBL_COLOR
+
+void gpath_draw_filled_with_cb(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
+                               void *user_data) {
+  prv_fill_path_with_cb(ctx, path, cb, user_data, false /* !antialiased */);
 }
 
 void gpath_fill_precise_internal(GContext *ctx, GPointPrecise *points, size_t num_points) {
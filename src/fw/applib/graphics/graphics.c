@@ -715,3 +715,8 @@ MOCKABLE bool graphics_release_frame_buffer(GContext *ctx, GBitmap *buffer) {
 
   return false;
 }
+
+void graphics_private_release_frame_buffer(GContext *ctx, GBitmap *buffer) {
+  PBL_ASSERTN(ctx);
+  ctx->lock = false;
+}
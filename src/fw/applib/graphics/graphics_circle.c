@@ -345,8 +345,11 @@ T_STATIC void graphics_circle_quadrant_draw_1px_aa(GContext* ctx, GPoint p, uint
     prv_plot4(framebuffer, &ctx->draw_state.clip_box, p, GPoint(2, 3), 2, stroke_color, quadrant);
   }
 
+  graphics_context_mark_dirty_rect(ctx, GRect(p.x - radius, p.y - radius,
+                                              radius * 2 + 1, radius * 2 + 1));
+
   // Releasing framebuffer...
-  graphics_release_frame_buffer(ctx, framebuffer);
+  graphics_private_release_frame_buffer(ctx, framebuffer);
 }
 #endif // PBL_COLOR
 
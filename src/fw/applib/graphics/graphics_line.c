@@ -95,6 +95,8 @@ MOCKABLE void graphics_line_draw_1px_aa(GContext* ctx, GPoint p0, GPoint p1) {
     tmp = y1; y1 = y2; y2 = tmp;
     tmp = x1; x1 = x2; x2 = tmp;
   }
+  // Besides the pixels on the line, the blending also touches the ones beside and below it
+  graphics_context_mark_dirty_rect(ctx, GRect(MIN(x1, x2) - 1, y1, abs(x2 - x1) + 3, y2 - y1 + 2));
 
   // Draw the initial pixel
   // TODO: PBL-14743: Make a unit test that will test case of .frame.origin != {0,0}
@@ -201,7 +203,7 @@ MOCKABLE void graphics_line_draw_1px_aa(GContext* ctx, GPoint p0, GPoint p1) {
   }
 
   // Release the framebuffer after we're done
-  graphics_release_frame_buffer(ctx, framebuffer);
+  graphics_private_release_frame_buffer(ctx, framebuffer);
 }
 #endif // PBL_COLOR
 
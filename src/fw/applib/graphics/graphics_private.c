@@ -119,7 +119,7 @@ void prv_assign_line_horizontal_non_aa(GContext* ctx, int16_t y, int16_t x1, int
   ctx->draw_state.draw_implementation->blend_horizontal_line(ctx, y, x1, x2,
                                                              ctx->draw_state.stroke_color);
 
-  graphics_release_frame_buffer(ctx, framebuffer);
+  graphics_private_release_frame_buffer(ctx, framebuffer);
 }
 
 void prv_assign_line_vertical_non_aa(GContext* ctx, int16_t x, int16_t y1, int16_t y2) {
@@ -154,7 +154,7 @@ void prv_assign_line_vertical_non_aa(GContext* ctx, int16_t x, int16_t y1, int16
   ctx->draw_state.draw_implementation->blend_vertical_line(ctx, x, y1, y2,
                                                            ctx->draw_state.stroke_color);
 
-  graphics_release_frame_buffer(ctx, framebuffer);
+  graphics_private_release_frame_buffer(ctx, framebuffer);
 }
 
 // ## Line blending wrappers:
@@ -255,7 +255,7 @@ void graphics_private_draw_horizontal_line(GContext *ctx, int16_t y, Fixed_S16_3
     graphics_private_draw_horizontal_line_prepared(ctx, framebuffer, &ctx->draw_state.clip_box, y,
                                                    x1, x2, ctx->draw_state.stroke_color);
 
-    graphics_release_frame_buffer(ctx, framebuffer);
+    graphics_private_release_frame_buffer(ctx, framebuffer);
     return;
   }
 #endif // PBL_COLOR
@@ -290,7 +290,7 @@ void graphics_private_draw_vertical_line(GContext *ctx, int16_t x, Fixed_S16_3 y
     graphics_private_draw_vertical_line_prepared(ctx, framebuffer, &ctx->draw_state.clip_box, x, y1,
                                                  y2, ctx->draw_state.stroke_color);
 
-    graphics_release_frame_buffer(ctx, framebuffer);
+    graphics_private_release_frame_buffer(ctx, framebuffer);
     return;
   }
 #endif // PBL_COLOR
@@ -415,7 +415,7 @@ void graphics_private_plot_horizontal_line(GContext *ctx, int16_t y, Fixed_S16_3
                                                    x1.integer, x2.integer, opacity,
                                                    ctx->draw_state.stroke_color);
 
-    graphics_release_frame_buffer(ctx, framebuffer);
+    graphics_private_release_frame_buffer(ctx, framebuffer);
     return;
   }
 #endif // PBL_COLOR
@@ -457,7 +457,7 @@ void graphics_private_plot_vertical_line(GContext *ctx, int16_t x, Fixed_S16_3 y
                                                  y1.integer, y2.integer, opacity,
                                                  ctx->draw_state.stroke_color);
 
-    graphics_release_frame_buffer(ctx, framebuffer);
+    graphics_private_release_frame_buffer(ctx, framebuffer);
     return;
   }
 #endif // PBL_COLOR
@@ -523,7 +523,7 @@ void graphics_private_draw_horizontal_line_delta_aa(GContext *ctx, int16_t y, Fi
                                                        y, x1, x2, delta1, delta2,
                                                        ctx->draw_state.stroke_color);
 
-  graphics_release_frame_buffer(ctx, framebuffer);
+  graphics_private_release_frame_buffer(ctx, framebuffer);
 }
 #endif // PBL_COLOR
 
@@ -28,6 +28,14 @@
 //! @param point Point to set pixel at using draw state's stroke color
 void graphics_private_set_pixel(GContext* ctx, GPoint point);
 
+//! Releases the framebuffer after a drawing routine captured it with
+//! graphics_capture_frame_buffer. Unlike graphics_release_frame_buffer this doesn't mark the whole
+//! framebuffer as dirty, so the routine has to have marked the pixels it touched itself.
+//! @internal
+//! @param ctx Graphics context the framebuffer was captured from
+//! @param buffer The captured framebuffer
+void graphics_private_release_frame_buffer(GContext *ctx, GBitmap *buffer);
+
 //! Draws horizontal line with antialiased starting and ending pixel
 //! Will adjust to the drawing_box and clip_box
 //! Note: this only works for lines where x1 < x2
@@ -88,6 +88,11 @@ static void prv_assign_row_with_pattern_1bit(GBitmap *framebuffer, int16_t y, in
   }
 }
 
+// Marks the rows and columns between the given (inclusive) coordinates as dirty
+static void prv_mark_dirty(GContext *ctx, int16_t x1, int16_t y1, int16_t x2, int16_t y2) {
+  graphics_context_mark_dirty_rect(ctx, GRect(x1, y1, x2 - x1 + 1, y2 - y1 + 1));
+}
+
 // ## Line blending functions:
 
 // This function draws horizontal line with AA edges, given values have to be adjusted for
@@ -106,6 +111,8 @@ T_STATIC void prv_assign_horizontal_line_raw(GContext *ctx, int16_t y, Fixed_S16
   if (x1.integer > x2.integer) {
     return;
   }
+  // The blended last pixel can be the one after x2
+  prv_mark_dirty(ctx, x1.integer, y, x2.integer + 1, y);
 
 #if PBL_COLOR
   GColor8 *output = (GColor8 *)(data_row_info.data + x1.integer);
@@ -150,6 +157,9 @@ T_STATIC void prv_assign_vertical_line_raw(GContext *ctx, int16_t x, Fixed_S16_3
   GBitmap *framebuffer = &ctx->dest_bitmap;
   PBL_ASSERTN(framebuffer->bounds.origin.x == 0 && framebuffer->bounds.origin.y == 0);
 
+  // The blended last pixel can be the one after y2
+  prv_mark_dirty(ctx, x, y1.integer, x, y2.integer + 1);
+
   GBitmapDataRowInfo data_row_info = gbitmap_get_data_row_info(framebuffer, y1.integer);
   GColor8 *output = (GColor8 *)(data_row_info.data + x);
 
@@ -197,6 +207,7 @@ T_STATIC void prv_blend_horizontal_line_raw(GContext *ctx, int16_t y, int16_t x1
   const GBitmapDataRowInfo data_row_info = gbitmap_get_data_row_info(framebuffer, y);
   x1 = MAX(x1, data_row_info.min_x);
   x2 = MIN(x2, data_row_info.max_x);
+  prv_mark_dirty(ctx, x1, y, x2, y);
 
 #if PBL_COLOR
   for (int i = x1; i <= x2; i++) {
@@ -217,6 +228,7 @@ T_STATIC void prv_blend_vertical_line_raw(GContext *ctx, int16_t x, int16_t y1,
                                           GColor color) {
   PBL_ASSERTN(ctx);
   GBitmap *framebuffer = &ctx->dest_bitmap;
+  prv_mark_dirty(ctx, x, y1, x, y2 - 1);
 #if SCREEN_COLOR_DEPTH_BITS == 8
   for (int i = y1; i < y2; i++) {
     // Skip over pixels outside the bitmap data row's range
@@ -267,6 +279,8 @@ T_STATIC void prv_assign_horizontal_line_delta_raw(GContext *ctx, int16_t y,
   if (x1.integer > x2.integer) {
     return;
   }
+  prv_mark_dirty(ctx, MAX(x1.integer, clip_box_min_x), y,
+                 MIN(x2.integer + MAX(right_aa_offset, 1), clip_box_max_x), y);
 
   GColor8 *output = (GColor8 *)(data_row_info.data + x1.integer);
 
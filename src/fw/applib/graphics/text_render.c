@@ -24,6 +24,8 @@
 #include "util/bitset.h"
 #include "util/math.h"
 
+#include <string.h>
+
 #if !defined(__clang__)
 #pragma GCC optimize ("O2")
 #endif
@@ -40,92 +42,139 @@ static GRect get_glyph_rect(const GlyphData* glyph) {
 }
 
 #if SCREEN_COLOR_DEPTH_BITS == 8
-/// This function returns the x coordinate of where to write the contents of a given word (32-bits)
-/// of data from the 1-bit frame buffer into the 8-bit framebuffer
-/// @param dest_bitmap 8-bit destination frame buffer bitmap
-/// @param block_addr source address in 1-bit frame buffer of where the word is being updated
-///                   within a given row; assumed to be zero-based
-/// @param y_offset row offset within the source 1-bit frame buffer
-T_STATIC int32_t prv_convert_1bit_addr_to_8bit_x(GBitmap *dest_bitmap, uint32_t *block_addr,
-                                                 int32_t y_offset) {
-  // Each byte block_addr corresponds to 8 pixels (i.e. 4-bytes in the 8-bit frame buffer).
-  // Thus multiply by 8 to get the word offset within the destination 8-bit frame buffer.
-  // Also need to account for the fact that the 1-bit frame buffer has 16 bits of unused space
-  // on each row (thus 16 bytes need to be subtracted from the destination address since there is
-  // no padding on each row of the 8-bit frame buffer.
-  const int32_t padding = (32 - (dest_bitmap->bounds.size.w % 32)) % 32;
-  // Calculate the overall offset in the 8-bit bitmap
-  const int32_t bitmap_offset_8bit = ((uint32_t)block_addr * 8) - (padding * y_offset);
-  // Calculate just the offset from the start of the target row in the 8-bit bitmap (i.e. "x")
-  return bitmap_offset_8bit - (dest_bitmap->bounds.size.w * y_offset);
+//! Expands a nibble of glyph bits into a mask over the 4 bytes of 8-bit pixels that it covers. The
+//! lowest bit is the leftmost pixel, which is the lowest byte in memory.
+static const uint32_t s_nibble_to_byte_mask[16] = {
+  0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff,
+  0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
+  0xff000000, 0xff0000ff, 0xff00ff00, 0xff00ffff,
+  0xffff0000, 0xffff00ff, 0xffffff00, 0xffffffff,
+};
+
+//! Returns `num_bits` (at most 32) bits of glyph data starting at bit `index`, the first one in
+//! the lowest bit. Glyph bitmaps are packed row after row without any padding.
+static uint32_t prv_get_glyph_bits(const uint32_t *data, uint32_t index, unsigned int num_bits) {
+  const uint32_t *word = data + (index / 32);
+  const unsigned int shift = index % 32;
+  uint32_t bits = word[0] >> shift;
+  if (shift + num_bits > 32) {
+    bits |= word[1] << (32 - shift);
+  }
+  return (num_bits < 32) ? (bits & ((1u << num_bits) - 1)) : bits;
 }
-#endif
 
-// PRO TIP: if you have to modify this function, expect to waste the rest of your day on it
-void render_glyph(GContext* const ctx, const uint32_t codepoint, FontInfo* const font,
-                  const GRect cursor) {
-  if (codepoint_is_special(codepoint)) {
-    TextRenderState *state = app_state_get_text_render_state();
-    if (state->special_codepoint_handler_cb) {
-      state->special_codepoint_handler_cb(ctx, codepoint, cursor,
-          state->special_codepoint_handler_context);
+//! Writes `color` to each pixel of a span whose glyph bit is set, 4 pixels at a time
+static void prv_blit_span_opaque(uint8_t *dest, const uint32_t *glyph_data, uint32_t bit_index,
+                                 int num_pixels, GColor color) {
+  const uint32_t color_word = color.argb * 0x01010101;
+  while (num_pixels > 0) {
+    const unsigned int num_bits = MIN(num_pixels, 32);
+    uint32_t bits = prv_get_glyph_bits(glyph_data, bit_index, num_bits);
+    // Only whole words that lie inside the span are read and written back
+    const uint8_t *whole_words_end = dest + (num_bits & ~3);
+    for (uint8_t *pixel = dest; bits; bits >>= 4, pixel += 4) {
+      const uint32_t mask = s_nibble_to_byte_mask[bits & 0xf];
+      if (mask == UINT32_MAX) {
+        memcpy(pixel, &color_word, sizeof(color_word));
+      } else if (mask && (pixel < whole_words_end)) {
+        uint32_t word;
+        memcpy(&word, pixel, sizeof(word));
+        word = (word & ~mask) | (color_word & mask);
+        memcpy(pixel, &word, sizeof(word));
+      } else {
+        for (unsigned int i = 0; i < 4; i++) {
+          if (bits & (1 << i)) {
+            pixel[i] = color.argb;
+          }
+        }
+      }
     }
-    return;
+    dest += num_bits;
+    bit_index += num_bits;
+    num_pixels -= num_bits;
   }
+}
 
-  const GlyphData* glyph = text_resources_get_glyph(&ctx->font_cache, codepoint, font);
+//! Blends `color` onto each pixel of a span whose glyph bit is set
+static void prv_blit_span_blended(uint8_t *dest, const uint32_t *glyph_data, uint32_t bit_index,
+                                  int num_pixels, GColor color) {
+  while (num_pixels > 0) {
+    const unsigned int num_bits = MIN(num_pixels, 32);
+    uint32_t bits = prv_get_glyph_bits(glyph_data, bit_index, num_bits);
+    while (bits) {
+      const unsigned int x = __builtin_ctz(bits);
+      dest[x] = gcolor_alpha_blend(color, (GColor) { .argb = dest[x] }).argb;
+      bits &= bits - 1;
+    }
+    dest += num_bits;
+    bit_index += num_bits;
+    num_pixels -= num_bits;
+  }
+}
 
-  PBL_ASSERTN(glyph);
-  // Bitfiddle the metrics data:
-  GRect glyph_metrics = get_glyph_rect(glyph);
+typedef void (*GlyphSpanBlitter)(uint8_t *dest, const uint32_t *glyph_data, uint32_t bit_index,
+                                 int num_pixels, GColor color);
+
+//! Renders the part of a glyph inside `clipped_target` straight into an 8-bit bitmap. Each row of
+//! glyph bits is written as a span of pixels, rather than going through the 1-bit block walk.
+static void prv_render_glyph_8bit(GContext *ctx, const GlyphData *glyph,
+                                  const GRect *glyph_target, const GRect *clipped_target) {
+  GBitmap *dest_bitmap = graphics_context_get_bitmap(ctx);
+  GColor color = ctx->draw_state.text_color;
+  GlyphSpanBlitter blit_span = prv_blit_span_opaque;
+  if (ctx->draw_state.compositing_mode != GCompOpSet) {
+    color.a = 3;
+  } else if (color.a == 0) {
+    return;
+  } else if (color.a != 3) {
+    blit_span = prv_blit_span_blended;
+  }
 
-  // Calculate the box that we intend to draw to the screen, in screen coordinates
-  GRect glyph_target = {
-    .origin = { .x = cursor.origin.x + glyph_metrics.origin.x,
-                .y = cursor.origin.y + glyph_metrics.origin.y },
-    .size = { .w = glyph_metrics.size.w,
-              .h = glyph_metrics.size.h }
-  };
+  const uint32_t *glyph_data = glyph->data;
+  const int glyph_width = glyph_target->size.w;
+  const int x_begin = clipped_target->origin.x;
+  const int x_end = grect_get_max_x(clipped_target);
+  const int y_end = grect_get_max_y(clipped_target);
+  uint32_t row_bit_index = glyph_width * (clipped_target->origin.y - glyph_target->origin.y) +
+                           (x_begin - glyph_target->origin.x);
+
+  for (int y = clipped_target->origin.y; y < y_end; y++) {
+    // Rows of round displays may not cover the whole clip box
+    const GBitmapDataRowInfo data_row = gbitmap_get_data_row_info(dest_bitmap, y);
+    const int row_x_begin = MAX(x_begin, data_row.min_x);
+    const int row_x_end = MIN(x_end, data_row.max_x + 1);
+    if (row_x_begin < row_x_end) {
+      blit_span(data_row.data + row_x_begin, glyph_data, row_bit_index + (row_x_begin - x_begin),
+                row_x_end - row_x_begin, color);
+    }
+    row_bit_index += glyph_width;
+  }
+}
+#endif
 
+#if SCREEN_COLOR_DEPTH_BITS != 8
+// PRO TIP: if you have to modify this function, expect to waste the rest of your day on it
+static void prv_render_glyph_1bit(GContext *ctx, const GlyphData *glyph,
+                                  const GRect *target, const GRect *clipped_target) {
+  const GRect glyph_target = *target;
+  const GRect clipped_glyph_target = *clipped_target;
 
   // The destination bitmap's x-coordinate and row advance. Used in the loop below.
   GBitmap* dest_bitmap = graphics_context_get_bitmap(ctx);
-  const int32_t x = (int32_t)((int16_t)cursor.origin.x + (int16_t)glyph_metrics.origin.x);
-
-  // Now clip that box against the screen/other UI elements. This rect will be the rect that we
-  // actually fill with bits on the screen.
-  GRect clipped_glyph_target = glyph_target;
-  grect_clip(&clipped_glyph_target, &ctx->draw_state.clip_box);
+  const int32_t x = glyph_target.origin.x;
 
   // The number of bits to be clipped off the edges
   const int left_clip = clipped_glyph_target.origin.x - glyph_target.origin.x;
   const int right_clip = MIN(glyph_target.size.w,
                              MAX(0, glyph_target.size.w - clipped_glyph_target.size.w - left_clip));
 
-#if SCREEN_COLOR_DEPTH_BITS == 8
-  // Set base address to 0 for 8-bit as this will be later translated to the destination bitmap
-  // address - so do all calculations so everything is offset from 0
-  uint32_t * base_addr = 0;
-#else
   uint32_t * base_addr = ((uint32_t*)dest_bitmap->addr);
-#endif
 
   const uint32_t * const dest_block_x_begin = base_addr +
                                               (left_clip ?
                                                MAX(0, (((x + left_clip + 31)/ 32) - 1)) : (x / 32));
 
-  if (clipped_glyph_target.size.h == 0 || clipped_glyph_target.size.w == 0) {
-    return;
-  }
-
-#if SCREEN_COLOR_DEPTH_BITS == 8
-  // NOTE: Since all calculations are based on 1-bit calculation - use the row size from
-  // the 1-bit frame buffer
-  const int row_size_bytes = 4 * ((dest_bitmap->bounds.size.w / 32) +
-                                  ((dest_bitmap->bounds.size.w % 32) ? 1 : 0));
-#else
   const int row_size_bytes = dest_bitmap->row_size_bytes;
-#endif // SCREEN_COLOR_DEPTH_BITS == 8
 
   // Number of blocks (i.e. 32-bit chunks)
   const int dest_row_length = row_size_bytes / 4;
@@ -161,15 +210,15 @@ void render_glyph(GContext* const ctx, const uint32_t codepoint, FontInfo* const
                                           (((dest_shift + left_clip) % 32) ? 1 : 0);
 
   // Handle clipping at the top of the character. We need to skip a number of bits in our source data.
-  const unsigned int bits_to_skip = glyph_metrics.size.w * (clipped_glyph_target.origin.y - glyph_target.origin.y);
+  const unsigned int bits_to_skip = glyph_target.size.w * (clipped_glyph_target.origin.y - glyph_target.origin.y);
   if (bits_to_skip) {
     glyph_block += bits_to_skip / 32;
     src = *glyph_block;
 
     // Simulate the rotate that happens at the bottom of the bitblt loop so our source value is set
     // up just as if we actually rendered those first few lines.
-    rotl32(src, (dest_shift_at_line_begin + ((0 - ((uint8_t)glyph_metrics.size.w)) % 32) * (clipped_glyph_target.origin.y - glyph_target.origin.y)) % 32);
-    src_rotated = (dest_shift_at_line_begin + ((0 - ((uint8_t)glyph_metrics.size.w)) % 32) * (clipped_glyph_target.origin.y - glyph_target.origin.y)) % 32;
+    rotl32(src, (dest_shift_at_line_begin + ((0 - ((uint8_t)glyph_target.size.w)) % 32) * (clipped_glyph_target.origin.y - glyph_target.origin.y)) % 32);
+    src_rotated = (dest_shift_at_line_begin + ((0 - ((uint8_t)glyph_target.size.w)) % 32) * (clipped_glyph_target.origin.y - glyph_target.origin.y)) % 32;
     glyph_block_bits_left -= bits_to_skip % 32;
   }
 
@@ -212,50 +261,11 @@ void render_glyph(GContext* const ctx, const uint32_t codepoint, FontInfo* const
       const uint8_t number_of_bits = MIN(32 - dest_shift, MIN(glyph_line_bits_left, glyph_block_bits_left));
       const uint32_t mask = (((1 << number_of_bits) - 1) << dest_shift);
 
-#if SCREEN_COLOR_DEPTH_BITS == 8
-      // dest_block points to the block if the dest image was a 1-bit buffer
-      // translate this to an x coordinate in the 8-bit buffer
-      const int32_t block_start_x = prv_convert_1bit_addr_to_8bit_x(dest_bitmap, dest_block,
-                                                                    dest_y);
-      const GBitmapDataRowInfo data_row = gbitmap_get_data_row_info(dest_bitmap, dest_y);
-      // Only enter the loop if the current block is within the valid data row range
-      if (block_start_x + 31 >= data_row.min_x && block_start_x <= data_row.max_x) {
-        uint8_t *dest_addr = data_row.data + block_start_x;
-
-        // For each bit in block, write that bit to the dest_bitmap
-        for (unsigned int bitindex = 0; bitindex < 32; bitindex++) {
-          const int32_t current_x = block_start_x + bitindex;
-          // Stop iteration early if we have reached the end of the data row
-          if (current_x > data_row.max_x) {
-            break;
-          }
-          // Skip over pixels outside of the bitmap data's x coordinate range
-          if (current_x < data_row.min_x) {
-            continue;
-          }
-          // Find position in dest_bitmap that corresponds to the bit index
-          // Write to that position if mask for that bit is 1
-          if ((mask & src) & (1 << bitindex)) {
-            GColor dest_color;
-            if (ctx->draw_state.compositing_mode == GCompOpSet) {
-              // Blend (i.e. for transparency) if GCompOpSet
-              dest_color = gcolor_alpha_blend(ctx->draw_state.text_color,
-                                              (GColor) {.argb = dest_addr[bitindex]});
-            } else {
-              dest_color = ctx->draw_state.text_color;
-              dest_color.a = 3;
-            }
-            dest_addr[bitindex] = dest_color.argb;
-          }
-        }
-      }
-#else
       if (gcolor_equal(ctx->draw_state.text_color, GColorBlack)) {
         *(dest_block) &= ~(mask & src);
       } else {
         *(dest_block) |= mask & src;
       }
-#endif
 
       dest_shift = (dest_shift + number_of_bits) % 32;
       glyph_block_bits_left -= number_of_bits;
@@ -294,6 +304,48 @@ void render_glyph(GContext* const ctx, const uint32_t codepoint, FontInfo* const
     rotl32(src, dest_shift % 32);
     src_rotated = (src_rotated + dest_shift) % 32;
   }
+}
+#endif
+
+void render_glyph(GContext* const ctx, const uint32_t codepoint, FontInfo* const font,
+                  const GRect cursor) {
+  if (codepoint_is_special(codepoint)) {
+    TextRenderState *state = app_state_get_text_render_state();
+    if (state->special_codepoint_handler_cb) {
+      state->special_codepoint_handler_cb(ctx, codepoint, cursor,
+          state->special_codepoint_handler_context);
+    }
+    return;
+  }
+
+  const GlyphData* glyph = text_resources_get_glyph(&ctx->font_cache, codepoint, font);
+
+  PBL_ASSERTN(glyph);
+  // Bitfiddle the metrics data:
+  GRect glyph_metrics = get_glyph_rect(glyph);
+
+  // Calculate the box that we intend to draw to the screen, in screen coordinates
+  GRect glyph_target = {
+    .origin = { .x = cursor.origin.x + glyph_metrics.origin.x,
+                .y = cursor.origin.y + glyph_metrics.origin.y },
+    .size = { .w = glyph_metrics.size.w,
+              .h = glyph_metrics.size.h }
+  };
+
+  // Now clip that box against the screen/other UI elements. This rect will be the rect that we
+  // actually fill with bits on the screen.
+  GRect clipped_glyph_target = glyph_target;
+  grect_clip(&clipped_glyph_target, &ctx->draw_state.clip_box);
+
+  if (clipped_glyph_target.size.h == 0 || clipped_glyph_target.size.w == 0) {
+    return;
+  }
+
+#if SCREEN_COLOR_DEPTH_BITS == 8
+  prv_render_glyph_8bit(ctx, glyph, &glyph_target, &clipped_glyph_target);
+#else
+  prv_render_glyph_1bit(ctx, glyph, &glyph_target, &clipped_glyph_target);
+#endif
 
   graphics_context_mark_dirty_rect(ctx, clipped_glyph_target);
 }
@@ -58,14 +58,14 @@ DEFINE_SYSCALL(int, persist_get_size, const uint32_t key) {
 DEFINE_SYSCALL(bool, persist_read_bool, const uint32_t key) {
   bool value = false;
   LOCK_AND_GET_STORE(store);
-  settings_file_get(store, &key, sizeof(key), &value, sizeof(value));
+  persist_service_store_get(store, key, &value, sizeof(value));
   return value;
 }
 
 DEFINE_SYSCALL(int32_t, persist_read_int, const uint32_t key) {
   int32_t value = 0;
   LOCK_AND_GET_STORE(store);
-  settings_file_get(store, &key, sizeof(key), &value, sizeof(value));
+  persist_service_store_get(store, key, &value, sizeof(value));
   return value;
 }
 
@@ -84,8 +84,8 @@ DEFINE_SYSCALL(int, persist_read_data, const uint32_t key,
   }
 
   const size_t restricted_size = MIN(buffer_size, (size_t)len);
-  const status_t read_result = settings_file_get(
-      store, &key, sizeof(key), buffer, restricted_size);
+  const status_t read_result = persist_service_store_get(
+      store, key, buffer, restricted_size);
   if (FAILED(read_result)) {
     RETURN_STATUS_UP(read_result);
   }
@@ -115,15 +115,13 @@ int persist_read_string__deprecated(const uint32_t key,
 
 DEFINE_SYSCALL(status_t, persist_write_bool, const uint32_t key, const bool value) {
   LOCK_AND_GET_STORE(store);
-  status_t result = settings_file_set(store, &key, sizeof(key),
-                                      &value, sizeof(value));
+  status_t result = persist_service_store_set(store, key, &value, sizeof(value));
   return PASSED(result) ? (status_t)sizeof(value) : result;
 }
 
 DEFINE_SYSCALL(status_t, persist_write_int, const uint32_t key, const int32_t value) {
   LOCK_AND_GET_STORE(store);
-  status_t result = settings_file_set(store, &key, sizeof(key),
-                                      &value, sizeof(value));
+  status_t result = persist_service_store_set(store, key, &value, sizeof(value));
   return PASSED(result) ? (status_t)sizeof(value) : result;
 }
 
@@ -135,8 +133,7 @@ DEFINE_SYSCALL(int, persist_write_data, const uint32_t key,
   }
   const size_t restricted_size = MIN(buffer_size, PERSIST_DATA_MAX_LENGTH);
   LOCK_AND_GET_STORE(store);
-  int result = settings_file_set(store, &key, sizeof(key),
-                                 buffer, restricted_size);
+  int result = persist_service_store_set(store, key, buffer, restricted_size);
   return PASSED(result) ? (int)restricted_size : result;
 }
 
@@ -160,7 +157,7 @@ DEFINE_SYSCALL(status_t, persist_delete, const uint32_t key) {
   LOCK_AND_GET_STORE(store);
   status_t result;
   if (settings_file_exists(store, &key, sizeof(key))) {
-    result = settings_file_delete(store, &key, sizeof(key));
+    result = persist_service_store_delete(store, key);
     if (PASSED(result)) {
       result = S_TRUE;
     }
@@ -78,6 +78,113 @@ static bool prv_handle_list_filter(ListNode* node, void* data) {
 }
 
 
+// ------------------------------------------------------------------------------------
+// Handle lookup table. This is an open addressed hash table with linear probing. Handles are
+// handed out sequentially, so the low bits of the handle alone spread them evenly over the table.
+// The table is kept at most half full.
+#define ANIMATION_HANDLE_TABLE_MIN_SIZE 16
+
+static uint32_t prv_handle_table_home_slot(const AnimationAuxState *aux, Animation *handle) {
+  return (uintptr_t)handle & (aux->handle_table_size - 1);
+}
+
+static void prv_handle_table_insert(AnimationAuxState *aux, AnimationPrivate *animation) {
+  const uint32_t mask = aux->handle_table_size - 1;
+  uint32_t slot = prv_handle_table_home_slot(aux, animation->handle);
+  while (aux->handle_table[slot]) {
+    slot = (slot + 1) & mask;
+  }
+  aux->handle_table[slot] = animation;
+}
+
+static AnimationPrivate **prv_handle_table_find(AnimationAuxState *aux, Animation *handle) {
+  const uint32_t mask = aux->handle_table_size - 1;
+  uint32_t slot = prv_handle_table_home_slot(aux, handle);
+  while (aux->handle_table[slot]) {
+    if (aux->handle_table[slot]->handle == handle) {
+      return &aux->handle_table[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  return NULL;
+}
+
+static void prv_handle_table_insert_list(AnimationAuxState *aux, ListNode *head) {
+  for (ListNode *node = head; node; node = list_get_next(node)) {
+    prv_handle_table_insert(aux, (AnimationPrivate *)node);
+  }
+}
+
+// Index a newly created animation. It must already be linked into the unscheduled list.
+static void prv_handle_table_add(AnimationState *state, AnimationPrivate *animation) {
+  AnimationAuxState *aux = state->aux;
+  aux->num_animations++;
+  if (aux->handle_table && (aux->num_animations * 2 <= aux->handle_table_size)) {
+    prv_handle_table_insert(aux, animation);
+    return;
+  }
+
+  uint32_t new_size = MAX(aux->handle_table_size, ANIMATION_HANDLE_TABLE_MIN_SIZE);
+  while (new_size < aux->num_animations * 2) {
+    new_size *= 2;
+  }
+  AnimationPrivate **new_table = NULL;
+  if (new_size <= UINT16_MAX) {
+    new_table = applib_zalloc(new_size * sizeof(AnimationPrivate *));
+  }
+  if (!new_table) {
+    if (aux->handle_table && (aux->num_animations < aux->handle_table_size)) {
+      // Out of memory, but there's still a free slot in the table we have
+      prv_handle_table_insert(aux, animation);
+    } else {
+      // Give up on the table and search the lists until we can allocate one again
+      applib_free(aux->handle_table);
+      aux->handle_table = NULL;
+      aux->handle_table_size = 0;
+    }
+    return;
+  }
+
+  // Re-index from the lists rather than the old table so that animations created while we had
+  // no table get picked up as well
+  applib_free(aux->handle_table);
+  aux->handle_table = new_table;
+  aux->handle_table_size = new_size;
+  prv_handle_table_insert_list(aux, state->unscheduled_head);
+  prv_handle_table_insert_list(aux, state->scheduled_head);
+}
+
+static void prv_handle_table_remove(AnimationState *state, AnimationPrivate *animation) {
+  AnimationAuxState *aux = state->aux;
+  aux->num_animations--;
+  if (!aux->handle_table) {
+    return;
+  }
+
+  AnimationPrivate **entry = prv_handle_table_find(aux, animation->handle);
+  PBL_ASSERTN(entry);
+
+  // Shift later entries of the probe sequence back into the hole so no tombstones are needed.
+  // An entry can move into the hole if the hole lies between its home slot and its current slot.
+  const uint32_t mask = aux->handle_table_size - 1;
+  uint32_t hole = entry - aux->handle_table;
+  uint32_t slot = hole;
+  while (true) {
+    slot = (slot + 1) & mask;
+    AnimationPrivate *next = aux->handle_table[slot];
+    if (!next) {
+      break;
+    }
+    const uint32_t home = prv_handle_table_home_slot(aux, next->handle);
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      aux->handle_table[hole] = next;
+      hole = slot;
+    }
+  }
+  aux->handle_table[hole] = NULL;
+}
+
+
 // ------------------------------------------------------------------------------------
 // Find annotation by handle. If quiet is true, don't print out a log error message if we detect
 // an invalid handle. Quiet mode is used by animation_unschedule and animation_is_scheduled.
@@ -92,10 +199,16 @@ static AnimationPrivate* prv_find_animation_by_handle(AnimationState *state, Ani
     state = prv_animation_state_get(PebbleTask_Current);
   }
 
-  // Look for this animation by id. It could either be in the unscheduled or scheduled list
-  ListNode* node = list_find(state->unscheduled_head, prv_handle_list_filter, (void*)handle);
-  if (!node) {
-    node = list_find(state->scheduled_head, prv_handle_list_filter, (void*)handle);
+  ListNode *node = NULL;
+  if (state->aux->handle_table) {
+    AnimationPrivate **entry = prv_handle_table_find(state->aux, handle);
+    node = entry ? &(*entry)->list_node : NULL;
+  } else {
+    // Look for this animation by id. It could either be in the unscheduled or scheduled list
+    node = list_find(state->unscheduled_head, prv_handle_list_filter, (void*)handle);
+    if (!node) {
+      node = list_find(state->scheduled_head, prv_handle_list_filter, (void*)handle);
+    }
   }
   if (!node) {
     if (!quiet) {
@@ -162,6 +275,7 @@ static void prv_unlink_and_free(AnimationState *state, AnimationPrivate *animati
   // It's an error if it's scheduled
   PBL_ASSERTN(list_contains(state->unscheduled_head, &animation->list_node));
   list_remove(&animation->list_node, &state->unscheduled_head /* &head */, NULL /* &tail */);
+  prv_handle_table_remove(state, animation);
 
   ANIMATION_LOG_DEBUG("destroying %d (%p) ", (int)animation->handle, animation);
   applib_free(animation);
@@ -1092,6 +1206,7 @@ void animation_private_state_init(AnimationState *state) {
 void animation_private_state_deinit(AnimationState *state) {
 
   if (!process_manager_compiled_with_legacy2_sdk()) {
+    applib_free(state->aux->handle_table);
     applib_free(state->aux);
   }
 }
@@ -1129,6 +1244,7 @@ Animation *animation_private_animation_init(AnimationPrivate *animation) {
   PBL_ASSERTN(animation->handle);
 
   state->unscheduled_head = list_insert_before(state->unscheduled_head, &animation->list_node);
+  prv_handle_table_add(state, animation);
   ANIMATION_LOG_DEBUG("creating %d (%p)", (int)animation->handle, animation);
   return (Animation *)(animation->handle);
 }
@@ -105,6 +105,14 @@ typedef struct {
   //! The next Animation to be iterated, NULL if at end of iteration or not iterating.
   //! This allows arbitrarily unscheduling any animation at any time.
   ListNode *iter_next;
+
+  //! Open addressed hash table of all animations (scheduled and unscheduled) keyed by handle.
+  //! handle_table_size is always a power of 2. NULL if it couldn't be allocated, in which case
+  //! lookups fall back to searching the lists.
+  AnimationPrivate **handle_table;
+  uint16_t handle_table_size;
+  //! Number of animations that currently exist, whether or not they are in the handle table
+  uint16_t num_animations;
 } AnimationAuxState;
 
 
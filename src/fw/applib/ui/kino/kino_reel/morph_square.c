@@ -32,7 +32,8 @@ static void prv_destructor(void *context) {
   applib_free(data);
 }
 
-static void prv_apply_transform(GDrawCommandList *list, const GSize size, const GRect *from,
+static void prv_apply_transform(GDrawCommandList *list, GDrawCommandList *source,
+                                bool source_changed, const GSize size, const GRect *from,
                                 const GRect *to, AnimationProgress normalized, void *context) {
   MorphSquareData *data = context;
 
@@ -46,12 +47,12 @@ static void prv_apply_transform(GDrawCommandList *list, const GSize size, const
                                     AnimationCurveEaseInOut);
   }
 
-  gdraw_command_list_attract_to_square(list, size, curved);
+  gdraw_command_list_attract_to_square_from(list, source, size, curved);
 }
 
 static const TransformImpl MORPH_SQUARE_TRANSFORM_IMPL = {
   .destructor = prv_destructor,
-  .apply = prv_apply_transform,
+  .apply_to = prv_apply_transform,
 };
 
 KinoReel *kino_reel_morph_square_create(KinoReel *from_reel, bool take_ownership) {
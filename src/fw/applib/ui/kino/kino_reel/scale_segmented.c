@@ -18,6 +18,7 @@
 #include "scale_segmented.h"
 
 #include "applib/applib_malloc.auto.h"
+#include "applib/graphics/gdraw_command_list.h"
 #include "applib/graphics/gdraw_command_transforms.h"
 #include "applib/ui/animation.h"
 #include "applib/ui/animation_interpolate.h"
@@ -49,6 +50,9 @@ typedef struct {
     void *userdata;
     bool owns_userdata;
   } lookup;
+
+  //! Per-point timing built from the lookup, kept for as long as the image stays the same
+  GPointSegmentedTiming *timing;
 } ScaleSegmentedData;
 
 
@@ -62,66 +66,105 @@ static GPointIndexLookup *prv_create_lookup_by_distance(GDelayCreatorContext *ct
   return gdraw_command_list_create_index_lookup_by_distance(ctx->list, data->target);
 };
 
+static void prv_reset_timing(ScaleSegmentedData *data) {
+  applib_free(data->timing);
+  data->timing = NULL;
+}
+
 static void prv_destructor(void *context) {
   ScaleSegmentedData *data = context;
   if (data->lookup.owns_userdata) {
     applib_free(data->lookup.userdata);
   }
+  prv_reset_timing(data);
   applib_free(context);
 }
 
-static void prv_apply_transform(GDrawCommandList *list, GSize size, const GRect *from,
-                                const GRect *to, AnimationProgress normalized, void *context) {
-  if (!list || !context) {
-    return;
+static const GPointSegmentedTiming *prv_get_timing(ScaleSegmentedData *data,
+                                                   GDrawCommandList *list, bool list_changed,
+                                                   GSize size) {
+  if (data->timing && !list_changed) {
+    return data->timing;
+  }
+  prv_reset_timing(data);
+  if (!data->lookup.creator) {
+    return NULL;
   }
-  ScaleSegmentedData *data = context;
 
   GDelayCreatorContext delay_ctx = {
     .list = list,
     .size = size,
   };
-  if (!data->lookup.creator) {
+  GPointIndexLookup *index_lookup = data->lookup.creator(&delay_ctx, data->lookup.userdata);
+  if (!index_lookup) {
+    return NULL;
+  }
+  data->timing = gpoint_segmented_timing_create(index_lookup, data->point_duration);
+
+  if (delay_ctx.owns_lookup) {
+    applib_free(index_lookup);
+  }
+  return data->timing;
+}
+
+static void prv_apply_transform(GDrawCommandList *list, GDrawCommandList *source,
+                                bool source_changed, GSize size, const GRect *from,
+                                const GRect *to, AnimationProgress normalized, void *context) {
+  if (!list || !source || !context) {
     return;
   }
-  GPointIndexLookup *index_lookup = data->lookup.creator(&delay_ctx, data->lookup.userdata);
+  ScaleSegmentedData *data = context;
 
-  GRect intermediate;
-  AnimationProgress second_normalized;
+  const GPointSegmentedTiming *timing = prv_get_timing(data, source, source_changed, size);
+  if (!timing) {
+    // Without a delay lookup there is nothing to transform
+    gdraw_command_list_copy(list, gdraw_command_list_get_data_size(source), source);
+    return;
+  }
+
+  GScaleSegmentedStage stages[2];
+  size_t num_stages = 0;
 
   const bool two_stage = (data->expand || data->bounce.x || data->bounce.y);
 
   if (two_stage) {
-    intermediate = grect_scalar_expand(*to, data->expand);
+    GRect intermediate = grect_scalar_expand(*to, data->expand);
     gpoint_add_eq(&intermediate.origin, data->bounce);
 
-    const AnimationProgress first_normalized = animation_timing_segmented(
-        normalized, 0, 2, data->effect_duration);
-    gdraw_command_list_scale_segmented_to(
-        list, size, *from, intermediate, first_normalized, data->interpolate, index_lookup,
-        data->point_duration, false);
-
-    size = intermediate.size;
-    second_normalized = animation_timing_segmented(normalized, 1, 2, data->effect_duration);
+    stages[num_stages++] = (GScaleSegmentedStage) {
+      .size = size,
+      .from = *from,
+      .to = intermediate,
+      .normalized = animation_timing_segmented(normalized, 0, 2, data->effect_duration),
+    };
+    stages[num_stages++] = (GScaleSegmentedStage) {
+      .size = intermediate.size,
+      .from = intermediate,
+      .to = *to,
+      .normalized = animation_timing_segmented(normalized, 1, 2, data->effect_duration),
+      .is_offset = true,
+    };
   } else {
-    intermediate = *from;
-    second_normalized = normalized;
+    stages[num_stages++] = (GScaleSegmentedStage) {
+      .size = size,
+      .from = *from,
+      .to = *to,
+      .normalized = normalized,
+    };
   }
 
-  gdraw_command_list_scale_segmented_to(
-      list, size, intermediate, *to, second_normalized, data->interpolate, index_lookup,
-      data->point_duration, two_stage);
-
-  const AnimationProgress stroke_width_progress = data->stroke_width.curve ?
-      data->stroke_width.curve(normalized) :
-      animation_timing_curve(normalized, AnimationCurveEaseInOut);
-  gdraw_command_list_scale_stroke_width(
-      list, data->stroke_width.from, data->stroke_width.to,
-      data->stroke_width.from_op, data->stroke_width.to_op, stroke_width_progress);
+  const GStrokeWidthScale stroke_width = {
+    .from = data->stroke_width.from,
+    .to = data->stroke_width.to,
+    .from_op = data->stroke_width.from_op,
+    .to_op = data->stroke_width.to_op,
+    .progress = data->stroke_width.curve ?
+        data->stroke_width.curve(normalized) :
+        animation_timing_curve(normalized, AnimationCurveEaseInOut),
+  };
 
-  if (delay_ctx.owns_lookup) {
-    applib_free(index_lookup);
-  }
+  gdraw_command_list_scale_segmented_from(list, source, stages, num_stages, data->interpolate,
+                                          timing, &stroke_width);
 }
 
 static GPoint prv_calc_bounce_offset(GRect from, GRect to, int16_t bounce) {
@@ -146,7 +189,7 @@ static GPoint prv_calc_bounce_offset(GRect from, GRect to, int16_t bounce) {
 
 static const TransformImpl SCALE_SEGMENTED_TRANSFORM_IMPL = {
   .destructor = prv_destructor,
-  .apply = prv_apply_transform,
+  .apply_to = prv_apply_transform,
 };
 
 KinoReel *kino_reel_scale_segmented_create(KinoReel *from_reel, bool take_ownership,
@@ -192,6 +235,7 @@ void kino_reel_scale_segmented_set_delay_lookup_creator(
   data->lookup.creator = creator;
   data->lookup.userdata = userdata;
   data->lookup.owns_userdata = take_ownership;
+  prv_reset_timing(data);
 }
 
 bool kino_reel_scale_segmented_set_delay_by_distance(KinoReel *reel, GPoint target) {
@@ -219,6 +263,7 @@ void kino_reel_scale_segmented_set_point_duration(KinoReel *reel, Fixed_S32_16 p
   ScaleSegmentedData *data = kino_reel_transform_get_context(reel);
   if (data) {
     data->point_duration = point_duration;
+    prv_reset_timing(data);
   }
 }
 
@@ -47,6 +47,9 @@ typedef struct {
 
   GDrawCommandList *list_copy;
   GSize list_copy_size;
+  //! The list that `list_copy` was last copied from by an `apply_to` transform, which only needs
+  //! the copy to have the same structure. Cleared whenever the copy or the reels change.
+  GDrawCommandList *list_copy_source;
 
   bool owns_from_reel;
   bool owns_to_reel;
@@ -80,6 +83,7 @@ static bool prv_image_size_eq_rect_size(KinoReelTransformData *data, GRect rect)
 static void prv_free_list_copy(KinoReelTransformData *data) {
   applib_free(data->list_copy);
   data->list_copy = NULL;
+  data->list_copy_source = NULL;
 }
 
 static GDrawCommandList *prv_get_or_create_list_copy(KinoReelTransformData *data,
@@ -187,12 +191,26 @@ static void prv_transform_list(KinoReelTransformData *data) {
   if (!list) {
     return;
   }
+  const GSize size = kino_reel_get_size(reel);
+  if (data->impl->apply_to) {
+    const bool source_changed = (data->list_copy_source != source_list);
+    if (source_changed) {
+      if (!gdraw_command_list_copy(list, gdraw_command_list_get_data_size(source_list),
+                                   source_list)) {
+        return;
+      }
+      data->list_copy_source = source_list;
+    }
+    data->impl->apply_to(list, source_list, source_changed, size, &data->from, &data->to,
+                         data->normalized, data->context);
+    return;
+  }
   if (!gdraw_command_list_copy(list, gdraw_command_list_get_data_size(source_list),
                                 source_list)) {
     return;
   }
+  data->list_copy_source = NULL;
   if (data->impl->apply) {
-    const GSize size = kino_reel_get_size(reel);
     data->impl->apply(list, size, &data->from, &data->to, data->normalized, data->context);
   }
 }
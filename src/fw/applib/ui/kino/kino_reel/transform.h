@@ -44,6 +44,18 @@ typedef bool (*TransformPositionSetter)(int32_t normalized, void *context);
 typedef void (*TransformApply)(GDrawCommandList *list, const GSize size, const GRect *from,
                                    const GRect *to, AnimationProgress normalized, void *context);
 
+//! Transform applier that reads the image instead of modifying a copy of it. The output list
+//! keeps the structure of the image between frames, so it is only copied again when the image
+//! changes, but the applier must write every point and stroke width it transforms on each call.
+//! @param list GDrawCommandList with the same structure as `source` to write the result into.
+//! @param source GDrawCommandList of the image in its source form.
+//! @param source_changed true if `source` may differ from the previous call, so anything derived
+//! from it needs to be worked out again.
+//! @see TransformApply for the other parameters.
+typedef void (*TransformApplyTo)(GDrawCommandList *list, GDrawCommandList *source,
+                                 bool source_changed, const GSize size, const GRect *from,
+                                 const GRect *to, AnimationProgress normalized, void *context);
+
 //! Transform Implementation Callbacks.
 typedef struct {
   //! Callback that is called when the kino reel is destroyed.
@@ -56,6 +68,8 @@ typedef struct {
   //! This callback is only called once for the start or end position unless the kino reel's
   //! position is changed again after reaching the start or end.
   TransformApply apply;
+  //! Used instead of `apply` if set, which saves copying the whole image on every frame.
+  TransformApplyTo apply_to;
 } TransformImpl;
 
 //! Creates Transform Kino Reel with a custom transform implementation.
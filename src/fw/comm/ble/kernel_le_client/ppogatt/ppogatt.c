@@ -23,6 +23,7 @@
 #include "comm/ble/gatt_client_operations.h"
 #include "comm/bt_lock.h"
 
+#include "drivers/rtc.h"
 #include "kernel/pbl_malloc.h"
 #include "services/common/analytics/analytics.h"
 #include "services/common/comm_session/session_transport.h"
@@ -74,6 +75,16 @@ typedef enum {
   AckTimeoutState_TimedOut = AckTimeoutState_Active + PPOGATT_TIMEOUT_TICKS,
 } AckTimeoutState;
 
+typedef enum {
+  //! No selective retransmission is going on
+  ResendState_None,
+  //! The oldest packet awaiting an Ack timed out and needs to be sent again, by itself
+  ResendState_Pending,
+  //! The oldest packet has been sent again. The next Ack tells whether the server held on to the
+  //! packets that were sent after it.
+  ResendState_InFlight,
+} ResendState;
+
 typedef struct PPoGATTClient {
   ListNode node;
   State state;
@@ -109,11 +120,24 @@ typedef struct PPoGATTClient {
     uint8_t tx_window_size;
     uint8_t rx_window_size;
 
+    //! Timeout waiting for a Reset Complete. Data packets use rto_timer instead.
     AckTimeoutState ack_timeout_state;
 
     //! Number of consecutive timeouts so far
     uint8_t timeouts_counter;
 
+    //! Selective retransmission of the oldest packet awaiting an Ack. Only used if the server
+    //! supports the enhanced throughput features, otherwise everything is rolled back on timeout.
+    ResendState resend_state;
+
+    //! One packet at a time is timed to measure the round trip time
+    bool is_timing_rtt;
+    uint8_t timed_sn;
+    RtcTicks timed_sent_ticks;
+
+    //! When the oldest packet awaiting an Ack was sent, or the last Ack making progress came in
+    RtcTicks last_progress_ticks;
+
     uint8_t next_expected_ack_sn;
     uint8_t next_data_sn;
 
@@ -125,6 +149,16 @@ typedef struct PPoGATTClient {
   uint8_t resets_counter;
 
   TimerID rx_ack_timer;   //! Timer to ensure Acks for data are dispatched regularly
+  TimerID rto_timer;      //! Retransmission timer for the oldest data packet awaiting an Ack
+
+  //! Round trip time estimate of the data packets, see RFC 6298. It's kept across resets,
+  //! because the link stays the same.
+  struct {
+    uint16_t srtt_ms;     //! Smoothed round trip time, 0 until the first measurement
+    uint16_t rttvar_ms;   //! Round trip time variation
+    uint16_t rto_ms;      //! Retransmission timeout derived from the above
+    uint8_t backoff;      //! The timeout doubles for every consecutive timeout
+  } rtt;
 
   //! Whether the PPoGATT server transports "System", "App" or "Hybrid" PP sessions.
   TransportDestination destination;
@@ -272,35 +306,14 @@ static void prv_clear_payload_sizes_up_to(PPoGATTClient *client,
 }
 
 // -------------------------------------------------------------------------------------------------
-// Ack Time-out related things.
-// The effective timeout duration will be between 2 and 3 seconds, depending on when in the second
+// Reset Complete time-out related things.
+// The effective timeout duration will be between 4 and 6 seconds, depending on when in the second
 // the timeout is set (RegularTimer is used).
 
 static void prv_reset_ack_timeout(PPoGATTClient *client) {
   client->out.ack_timeout_state = AckTimeoutState_Active;
 }
 
-static void prv_roll_back(PPoGATTClient *client, uint32_t sn) {
-  if (++client->out.timeouts_counter >= PPOGATT_TIMEOUT_COUNT_MAX) {
-    PBL_LOG(LOG_LEVEL_ERROR, "Resetting because max timeouts reached...");
-    prv_start_reset(client);
-    return;
-  }
-
-  PBL_LOG(LOG_LEVEL_WARNING, "Rolling back from (%u, %u) to %"PRIu32,
-          client->out.next_data_sn, client->out.next_expected_ack_sn, sn);
-
-  // Go back and send again:
-  // No need to worry about the timeouts of these packets hitting, because prv_check_timeouts uses
-  // next_data_sn and next_expected_ack_sn to determine which packets can time-out.
-  client->out.next_data_sn = sn;
-  client->out.next_expected_ack_sn = sn;
-  prv_reset_ack_timeout(client);
-
-  // Don't send from Timer task
-  prv_send_next_packets_async(client);
-}
-
 static bool prv_has_timeout(const PPoGATTClient *client) {
   return (client->out.ack_timeout_state != AckTimeoutState_Inactive &&
           client->out.ack_timeout_state >= AckTimeoutState_TimedOut);
@@ -338,15 +351,7 @@ static void prv_check_timeouts(PPoGATTClient *client) {
     return;
   }
 
-  uint8_t sn = client->out.next_expected_ack_sn;
-  if (prv_has_timeout(client)) {
-    prv_roll_back(client, sn);
-    // Return, because all packets after the timed-out one have been "rolled back" now,
-    // no point in continuing.
-    return;
-  }
-
-  // No timeouts
+  // No timeouts (data packets time out through the rto_timer)
   s_ppogatt_timeout_count = 0;
 }
 
@@ -373,6 +378,8 @@ static PPoGATTClient *prv_create_client(void) {
   *client = (PPoGATTClient){};
   client->app_uuid = UUID_INVALID;
   client->rx_ack_timer = new_timer_create();
+  client->rto_timer = new_timer_create();
+  client->rtt.rto_ms = PPOGATT_INITIAL_RTO_MS;
   s_ppogatt_head = (PPoGATTClient *) list_prepend((ListNode *)s_ppogatt_head, &client->node);
   if (!regular_timer_is_scheduled(&s_ack_timer)) {
     s_ack_timer.cb = prv_timer_callback;
@@ -396,6 +403,7 @@ static void prv_delete_client(PPoGATTClient *client, bool is_disconnected, Delet
 
   list_remove(&client->node, (ListNode **) &s_ppogatt_head, NULL);
   new_timer_delete(client->rx_ack_timer);
+  new_timer_delete(client->rto_timer);
   kernel_free(client);
 
   if (s_ppogatt_head == NULL) {
@@ -447,6 +455,105 @@ static bool prv_is_client_valid(const PPoGATTClient *client) {
                     prv_client_filter_callback, (void *) client) != NULL);
 }
 
+// -------------------------------------------------------------------------------------------------
+// Data packet retransmission.
+// The retransmission timeout (RTO) is derived from the measured round trip times of the data
+// packets, following RFC 6298. One packet at a time is timed and, as per Karn's algorithm, packets
+// that got retransmitted are never timed, because it's ambiguous which transmission got Ack'd.
+
+static uint32_t prv_ms_since(RtcTicks ticks) {
+  return ((rtc_get_ticks() - ticks) * 1000) / RTC_TICKS_HZ;
+}
+
+static void prv_update_rto(PPoGATTClient *client, uint32_t rtt_ms) {
+  rtt_ms = MIN(rtt_ms, PPOGATT_MAX_RTO_MS);
+  if (client->rtt.srtt_ms == 0) {
+    client->rtt.srtt_ms = MAX(rtt_ms, 1);
+    client->rtt.rttvar_ms = rtt_ms / 2;
+  } else {
+    const int32_t delta = (int32_t)client->rtt.srtt_ms - (int32_t)rtt_ms;
+    client->rtt.rttvar_ms = (3 * client->rtt.rttvar_ms + ABS(delta)) / 4;
+    client->rtt.srtt_ms = (7 * client->rtt.srtt_ms + rtt_ms) / 8;
+  }
+  const uint32_t rto_ms = client->rtt.srtt_ms + 4 * client->rtt.rttvar_ms;
+  client->rtt.rto_ms = CLIP(rto_ms, PPOGATT_MIN_RTO_MS, PPOGATT_MAX_RTO_MS);
+}
+
+static uint32_t prv_get_rto_ms(const PPoGATTClient *client) {
+  return MIN((uint32_t)client->rtt.rto_ms << client->rtt.backoff, PPOGATT_MAX_RTO_MS);
+}
+
+static void prv_rto_timer_cb(void *data);
+
+static void prv_start_rto_timer(PPoGATTClient *client) {
+  new_timer_start(client->rto_timer, prv_get_rto_ms(client), prv_rto_timer_cb, client, 0);
+}
+
+static void prv_stop_rto_timer(PPoGATTClient *client) {
+  if (new_timer_scheduled(client->rto_timer, NULL)) {
+    new_timer_stop(client->rto_timer);
+  }
+}
+
+//! Goes back to sn and sends everything from there again.
+static void prv_roll_back(PPoGATTClient *client, uint32_t sn) {
+  PBL_LOG(LOG_LEVEL_WARNING, "Rolling back from (%u, %u) to %"PRIu32,
+          client->out.next_data_sn, client->out.next_expected_ack_sn, sn);
+
+  // No need to worry about the packets after sn, because they are only considered to be awaiting an
+  // Ack once they're sent again (see prv_num_packets_in_flight).
+  client->out.next_data_sn = sn;
+  client->out.next_expected_ack_sn = sn;
+  client->out.resend_state = ResendState_None;
+  client->out.is_timing_rtt = false;
+}
+
+static void prv_handle_rto_expired(PPoGATTClient *client) {
+  const uint32_t sn = client->out.next_expected_ack_sn;
+  if (!prv_is_packet_with_sn_awaiting_ack(client, sn)) {
+    // Everything got Ack'd in the mean time
+    return;
+  }
+
+  if (++client->out.timeouts_counter >= PPOGATT_TIMEOUT_COUNT_MAX &&
+      prv_ms_since(client->out.last_progress_ticks) >= PPOGATT_MIN_STALL_BEFORE_RESET_MS) {
+    PBL_LOG(LOG_LEVEL_ERROR, "Resetting because max timeouts reached...");
+    prv_start_reset(client);
+    return;
+  }
+
+  // Back off, in case the link got congested or slowed down
+  if (prv_get_rto_ms(client) < PPOGATT_MAX_RTO_MS) {
+    ++client->rtt.backoff;
+  }
+  client->out.is_timing_rtt = false;
+
+  if (prv_client_supports_enhanced_throughput_features(client)) {
+    // With a large window, most packets after the timed out one probably made it. Only send the
+    // oldest one again. The next Ack tells whether the server kept the packets after it.
+    PBL_LOG(LOG_LEVEL_WARNING, "Resending sn %"PRIu32", next RTO %"PRIu32" ms",
+            sn, prv_get_rto_ms(client));
+    client->out.resend_state = ResendState_Pending;
+  } else {
+    prv_roll_back(client, sn);
+  }
+
+  // Don't send from Timer task
+  prv_send_next_packets_async(client);
+}
+
+static void prv_rto_timer_cb(void *data) {
+  PPoGATTClient *client = (PPoGATTClient *)data;
+  bt_lock();
+  {
+    // make sure we didn't disconnect in between
+    if (prv_is_client_valid(client) && client->state == StateConnectedOpen) {
+      prv_handle_rto_expired(client);
+    }
+  }
+  bt_unlock();
+}
+
 // -------------------------------------------------------------------------------------------------
 
 static uint16_t prv_get_max_payload_size(const PPoGATTClient *client) {
@@ -475,6 +582,7 @@ static void prv_enter_awaiting_reset_complete(PPoGATTClient *client, bool self_i
   client->in.next_expected_data_sn = 0;
   // FIXME: Use SN for RR / RC (https://pebbletechnology.atlassian.net/browse/PBL-12424)
   client->out = (__typeof__(client->out)) {};
+  prv_stop_rto_timer(client);
 
   if (prv_client_supports_enhanced_throughput_features(client)) {
     // Set our desired window sizes
@@ -603,6 +711,7 @@ static void prv_handle_reset_complete(PPoGATTClient *client, const PPoGATTPacket
   }
   client->state = StateConnectedOpen;
   client->session = session;
+  client->out.ack_timeout_state = AckTimeoutState_Inactive;
 
   if (prv_client_supports_enhanced_throughput_features(client)) {
     if (payload_length < sizeof(PPoGATTResetCompleteClientIDPayloadV1)) {
@@ -630,10 +739,18 @@ static void prv_handle_reset_complete(PPoGATTClient *client, const PPoGATTPacket
 static void prv_handle_ack(PPoGATTClient *client, uint32_t sn) {
   if (prv_is_packet_with_sn_awaiting_ack(client, sn)) {
     client->out.timeouts_counter = 0;
-    client->out.ack_timeout_state = AckTimeoutState_Inactive;
+    // The link is moving again, even if this Ack can't be used to measure the round trip time
+    client->rtt.backoff = 0;
 
     // Ack'd one of the packets in flight
+    const uint32_t oldest_sn = client->out.next_expected_ack_sn;
     const uint32_t next_sn = prv_next_sn(sn);
+
+    if (client->out.is_timing_rtt &&
+        prv_sn_distance(oldest_sn, client->out.timed_sn) < prv_sn_distance(oldest_sn, next_sn)) {
+      prv_update_rto(client, prv_ms_since(client->out.timed_sent_ticks));
+      client->out.is_timing_rtt = false;
+    }
     const uint16_t num_bytes_acked = prv_total_num_bytes_awaiting_ack_up_to(client, next_sn);
     comm_session_send_queue_consume(client->session, num_bytes_acked);
 
@@ -649,9 +766,24 @@ static void prv_handle_ack(PPoGATTClient *client, uint32_t sn) {
     prv_clear_payload_sizes_up_to(client, next_sn);
 
     client->out.next_expected_ack_sn = next_sn;
-
-    if (prv_get_payload_size_for_sn(client, next_sn) != 0) { // Still awaiting ACKs
-      prv_reset_ack_timeout(client);
+    client->out.last_progress_ticks = rtc_get_ticks();
+
+    const bool was_resent = (client->out.resend_state == ResendState_InFlight);
+    client->out.resend_state = ResendState_None;
+
+    if (prv_is_packet_with_sn_awaiting_ack(client, next_sn)) { // Still awaiting ACKs
+      if (was_resent) {
+        if (sn == oldest_sn) {
+          // Only the resent packet got Ack'd: the server dropped the ones after it.
+          prv_roll_back(client, next_sn);
+        } else {
+          // The server kept the packets after the resent one, but there's another one missing.
+          client->out.resend_state = ResendState_Pending;
+        }
+      }
+      prv_start_rto_timer(client);
+    } else {
+      prv_stop_rto_timer(client);
     }
 
     prv_send_next_packets(client);
@@ -1032,6 +1164,23 @@ void rx_ack_timer_cb(void *data) {
   bt_unlock();
 }
 
+static const PPoGATTPacket * prv_prepare_data_packet(const PPoGATTClient *client,
+                                                     PPoGATTPacket **heap_packet_in_out,
+                                                     uint32_t sn, uint16_t offset,
+                                                     uint16_t payload_size,
+                                                     uint16_t *payload_size_out) {
+  PPoGATTPacket *packet = prv_lazily_allocate_packet_if_needed(client, heap_packet_in_out);
+  if (!packet) {
+    return NULL;
+  }
+  packet->type = PPoGATTPacketTypeData;
+  packet->sn = sn;
+  PBL_ASSERTN(comm_session_send_queue_copy(client->session, offset,
+                                           payload_size, packet->payload));
+  *payload_size_out = payload_size;
+  return packet;
+}
+
 static const PPoGATTPacket * prv_prepare_next_packet(PPoGATTClient *client,
                                                      PPoGATTPacket **heap_packet_in_out,
                                                      uint16_t *payload_size_out) {
@@ -1070,6 +1219,12 @@ static const PPoGATTPacket * prv_prepare_next_packet(PPoGATTClient *client,
   if (client->state != StateConnectedOpen) {
     return NULL;
   };
+  if (client->out.resend_state == ResendState_Pending) {
+    // The oldest packet awaiting an Ack sits at the start of the send queue:
+    const uint32_t sn = client->out.next_expected_ack_sn;
+    return prv_prepare_data_packet(client, heap_packet_in_out, sn, 0 /* offset */,
+                                   prv_get_payload_size_for_sn(client, sn), payload_size_out);
+  }
   if (prv_num_packets_in_flight(client) >= client->out.tx_window_size) {
     // Max number of data packets in flight, try again when we got some of them Ack'd.
     return NULL;
@@ -1105,16 +1260,8 @@ static const PPoGATTPacket * prv_prepare_next_packet(PPoGATTClient *client,
     payload_size = MIN(payload_size, max_payload_size);
   }
 
-  PPoGATTPacket *packet = prv_lazily_allocate_packet_if_needed(client, heap_packet_in_out);
-  if (!packet) {
-    return NULL;
-  }
-  packet->type = PPoGATTPacketTypeData;
-  packet->sn = client->out.next_data_sn;
-  PBL_ASSERTN(comm_session_send_queue_copy(client->session, offset,
-                                           payload_size, packet->payload));
-  *payload_size_out = payload_size;
-  return packet;
+  return prv_prepare_data_packet(client, heap_packet_in_out, client->out.next_data_sn, offset,
+                                 payload_size, payload_size_out);
 }
 
 // -------------------------------------------------------------------------------------------------
@@ -1126,11 +1273,24 @@ static void prv_finalize_queued_packet(PPoGATTClient *client, uint16_t payload_s
     client->out.ack_packet_byte = 0;
     client->out.send_rx_ack_now = false;
     client->out.outstanding_rx_ack_count = 0;
+  } else if (client->out.resend_state == ResendState_Pending) {
+    client->out.resend_state = ResendState_InFlight;
+    prv_start_rto_timer(client);
   } else { // we are sending a data packet
     const uint32_t sn = client->out.next_data_sn;
+    const RtcTicks now = rtc_get_ticks();
+    if (!prv_is_packet_with_sn_awaiting_ack(client, client->out.next_expected_ack_sn)) {
+      // Nothing was in flight, so we haven't been waiting for anything until now
+      client->out.last_progress_ticks = now;
+    }
+    if (!client->out.is_timing_rtt && !prv_is_packet_with_sn_awaiting_ack(client, sn)) {
+      client->out.is_timing_rtt = true;
+      client->out.timed_sn = sn;
+      client->out.timed_sent_ticks = now;
+    }
     prv_set_payload_size_for_sn(client, sn, payload_size);
-    if (client->out.ack_timeout_state == AckTimeoutState_Inactive) {
-      prv_reset_ack_timeout(client); // Enable timeout if we don't already have it set
+    if (!new_timer_scheduled(client->rto_timer, NULL)) {
+      prv_start_rto_timer(client); // Enable timeout if we don't already have it set
     }
     client->out.next_data_sn = prv_next_sn(sn);
   }
@@ -1272,3 +1432,23 @@ void ppogatt_trigger_rx_ack_send_timeout(void) {
     client = (PPoGATTClient *) client->node.next;
   }
 }
+
+void ppogatt_trigger_rto_timeout(void) {
+  PPoGATTClient *client = s_ppogatt_head;
+  while (client) {
+    PPoGATTClient *next = (PPoGATTClient *) client->node.next;
+    if (new_timer_scheduled(client->rto_timer, NULL)) {
+      new_timer_stop(client->rto_timer);
+      prv_rto_timer_cb(client);
+    }
+    client = next;
+  }
+}
+
+bool ppogatt_is_rto_timer_scheduled(Transport *transport) {
+  return new_timer_scheduled(((PPoGATTClient *)transport)->rto_timer, NULL);
+}
+
+uint32_t ppogatt_get_rto_ms(Transport *transport) {
+  return prv_get_rto_ms((PPoGATTClient *)transport);
+}
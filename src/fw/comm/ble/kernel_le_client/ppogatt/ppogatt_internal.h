@@ -31,12 +31,21 @@
 #define PPOGATT_SN_MOD_DIV (1 << PPOGATT_SN_BITS)
 #define PPOGATT_V0_WINDOW_SIZE (4)
 #define PPOGATT_TIMEOUT_TICK_INTERVAL_SECS (2)
-//! Effective timeout: between 5 - 6 secs, because packet could be sent out just before the
-//! RegularTimer second tick is about to fire.
+//! Timeout waiting for a Reset Complete. Effective timeout: between 5 - 6 secs, because the Reset
+//! Request could be sent out just before the RegularTimer second tick is about to fire.
 #define PPOGATT_TIMEOUT_TICKS (3)
 
-//! Number of maximum consecutive timeouts without getting a packet Ack'd
+//! Retransmission timeout used for data packets until the first round trip time is measured
+#define PPOGATT_INITIAL_RTO_MS (3000)
+//! Bounds of the retransmission timeout that is derived from the measured round trip times
+#define PPOGATT_MIN_RTO_MS (500)
+#define PPOGATT_MAX_RTO_MS (12000)
+
+//! Number of minimum consecutive timeouts without getting a packet Ack'd before resetting
 #define PPOGATT_TIMEOUT_COUNT_MAX (2)
+//! Minimum amount of time without getting a packet Ack'd before timeouts cause a reset. Because the
+//! retransmission timeout adapts to the link, a couple of consecutive timeouts alone can be short.
+#define PPOGATT_MIN_STALL_BEFORE_RESET_MS (8000)
 //! Number of maximum consecutive resets without getting a packet Ack'd
 #define PPOGATT_RESET_COUNT_MAX (10)
 //! Number of maximum consecutive disconnects without getting a packet Ack'd
@@ -231,6 +231,8 @@ extern void dump_current_runtime_stats(void);
 
 extern void command_set_runlevel(const char *runlevel);
 
+extern void command_system_task_stats(void);
+
 extern void command_litter_filesystem(void);
 
 typedef struct Command {
@@ -242,6 +244,7 @@ typedef struct Command {
 extern void command_profiler_start(void);
 extern void command_profiler_stop(void);
 extern void command_profiler_stats(void);
+extern void command_profiler_trace(void);
 
 extern void command_battery_ui_display(const char *, const char *, const char *);
 extern void command_battery_ui_update(const char *, const char *, const char *);
@@ -640,10 +643,15 @@ static const Command s_prompt_commands[] = {
 
   { "runlevel", command_set_runlevel, 1 },
 
+  { "system task stats", command_system_task_stats, 0 },
+
 #if defined(PROFILER)
   { "profiler start", command_profiler_start, 0 },
   { "profiler stop", command_profiler_stop, 0 },
   { "profiler stats", command_profiler_stats, 0 },
+#if defined(PROFILER_TRACE)
+  { "profiler trace", command_profiler_trace, 0 },
+#endif
 #endif
 
 #if (LOG_DOMAIN_BT_PAIRING_INFO != 0)
@@ -103,6 +103,8 @@ static SemaphoreHandle_t s_fpga_busy;
 
 static UpdateCompleteCallback s_update_complete_callback;
 
+ANALYTICS_BATCHED_COUNTER(s_display_updates, ANALYTICS_DEVICE_METRIC_DISPLAY_UPDATES_PER_HOUR);
+
 static void prv_start_dma_transfer(uint8_t *addr, uint32_t length);
 static void display_interrupt_intn(bool *should_context_switch);
 
@@ -383,7 +385,7 @@ static void prv_do_display_update(void) {
   }
 
   analytics_stopwatch_start(ANALYTICS_APP_METRIC_DISPLAY_WRITE_TIME, PebbleTask_App);
-  analytics_inc(ANALYTICS_DEVICE_METRIC_DISPLAY_UPDATES_PER_HOUR, AnalyticsClient_System);
+  analytics_batched_inc(&s_display_updates);
 
   // Communicating with the display, need intn.
   exti_enable(ICE40LP->busy_exti);
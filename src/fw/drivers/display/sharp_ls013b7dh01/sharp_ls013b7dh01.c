@@ -70,6 +70,8 @@ static uint32_t s_dma_line_buffer[DISP_DMA_BUFFER_SIZE_WORDS];
 
 static SemaphoreHandle_t s_dma_update_in_progress_semaphore;
 
+ANALYTICS_BATCHED_COUNTER(s_display_updates, ANALYTICS_DEVICE_METRIC_DISPLAY_UPDATES_PER_HOUR);
+
 static void prv_display_write_byte(uint8_t d);
 static void prv_display_context_init(DisplayContext* context);
 static void prv_setup_dma_transfer(uint8_t* framebuffer_addr, int framebuffer_size);
@@ -220,7 +222,7 @@ void display_update(NextRowCallback nrcb, UpdateCompleteCallback uccb) {
   stop_mode_disable(InhibitorDisplay);
   xSemaphoreTake(s_dma_update_in_progress_semaphore, portMAX_DELAY);
   analytics_stopwatch_start(ANALYTICS_APP_METRIC_DISPLAY_WRITE_TIME, AnalyticsClient_App);
-  analytics_inc(ANALYTICS_DEVICE_METRIC_DISPLAY_UPDATES_PER_HOUR, AnalyticsClient_System);
+  analytics_batched_inc(&s_display_updates);
 
   prv_enable_display_spi_clock();
   power_tracking_start(PowerSystemMcuDma1);
@@ -50,6 +50,8 @@ static uint32_t s_dma_line_buffer[DISP_DMA_BUFFER_SIZE_WORDS];
 
 static SemaphoreHandle_t s_dma_update_in_progress_semaphore;
 
+ANALYTICS_BATCHED_COUNTER(s_display_updates, ANALYTICS_DEVICE_METRIC_DISPLAY_UPDATES_PER_HOUR);
+
 static void prv_display_context_init(DisplayContext* context);
 static bool prv_do_dma_update(void);
 
@@ -224,7 +226,7 @@ void display_update(NextRowCallback nrcb, UpdateCompleteCallback uccb) {
   stop_mode_disable(InhibitorDisplay);
   xSemaphoreTake(s_dma_update_in_progress_semaphore, portMAX_DELAY);
   analytics_stopwatch_start(ANALYTICS_APP_METRIC_DISPLAY_WRITE_TIME, AnalyticsClient_App);
-  analytics_inc(ANALYTICS_DEVICE_METRIC_DISPLAY_UPDATES_PER_HOUR, AnalyticsClient_System);
+  analytics_batched_inc(&s_display_updates);
 
   power_tracking_start(PowerSystemMcuDma1);
 
@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "system/status_codes.h"
+#include "util/list.h"
 
 static const uint32_t EXPECTED_SPI_FLASH_ID_32MBIT = 0x20bb16;
 static const uint32_t EXPECTED_SPI_FLASH_ID_64MBIT = 0x20bb17;
@@ -52,6 +53,41 @@ uint32_t flash_whoami(void);
  */
 void flash_read_bytes(uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size);
 
+typedef void (*FlashOperationCompleteCb)(void *context, status_t result);
+
+//! State of a queued asynchronous read. The storage is owned by the caller and must not be
+//! touched until the completion callback has been called.
+typedef struct FlashReadRequest {
+  ListNode list_node;
+  uint8_t *buffer;
+  uint32_t start_addr;
+  uint32_t buffer_size;
+  FlashOperationCompleteCb on_complete;
+  void *context;
+  //! Result of the read, set by the flash driver before the callback is called
+  status_t result;
+} FlashReadRequest;
+
+/**
+ * Read 1 or more bytes asynchronously.
+ *
+ * The request is queued and returns immediately; the caller is never put to sleep waiting for an
+ * in-progress erase to be suspended. Queued requests are serviced in address order in a single
+ * erase suspend window, and requests which are contiguous both in flash and in RAM are merged
+ * into a single transfer.
+ *
+ * The callback function will be called when the read completes. The callback will be executed on
+ * an arbitrary (possibly high-priority) task, so the callback function must return quickly.
+ *
+ * @param request Caller-owned storage for the queued request.
+ * @param buffer A byte-buffer that will be used to store the data read from flash.
+ * @param start_addr The address of the first byte to be read from flash.
+ * @param buffer_size The total number of bytes to be read from flash.
+ */
+void flash_read_bytes_async(FlashReadRequest *request, uint8_t *buffer, uint32_t start_addr,
+                            uint32_t buffer_size, FlashOperationCompleteCb on_complete,
+                            void *context);
+
 /**
  * Write 1 or more bytes from the buffer to flash starting at the
  * specified 24bit address. This function will handle both writing a
@@ -64,8 +100,6 @@ void flash_read_bytes(uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size
  */
 void flash_write_bytes(const uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size);
 
-typedef void (*FlashOperationCompleteCb)(void *context, status_t result);
-
 /**
  * Erase a subsector asynchronously.
  *
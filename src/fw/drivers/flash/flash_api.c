@@ -22,6 +22,7 @@
 #include <stdint.h>
 
 #include "drivers/flash/flash_impl.h"
+#include "drivers/rtc.h"
 #include "drivers/task_watchdog.h"
 #include "drivers/watchdog.h"
 #include "flash_region/flash_region.h"
@@ -34,12 +35,25 @@
 #include "system/logging.h"
 #include "system/passert.h"
 #include "kernel/util/sleep.h"
+#include "util/list.h"
 
 #include "FreeRTOS.h"
 #include "semphr.h"
 
 #define MAX_ERASE_RETRIES (3)
 
+//! Minimum amount of time an erase is allowed to run after it has been started or resumed before
+//! it may be suspended again. Without this, a steady stream of reads could starve it completely.
+#define ERASE_MIN_SLICE_MS (100)
+
+//! How long an erase stays suspended after the last read or write before it is resumed
+#define ERASE_RESUME_AFTER_READ_MS (5)
+#define ERASE_RESUME_AFTER_WRITE_MS (50)
+
+//! Number of times the status of a page write is polled back-to-back before the waiting task
+//! starts sleeping between polls. Most page programs finish within a few polls.
+#define WRITE_STATUS_SPIN_POLLS (8)
+
 static PebbleMutex *s_flash_lock;
 static SemaphoreHandle_t s_erase_semphr;
 
@@ -53,11 +67,17 @@ static struct FlashEraseContext {
   FlashOperationCompleteCb on_complete_cb;
   void *cb_context;
   uint32_t expected_duration;
+  //! When the erase was last started or resumed
+  RtcTicks resumed_ticks;
 } s_erase = { 0 };
 
 static TimerID s_erase_poll_timer;
 static TimerID s_erase_suspend_timer;
 
+//! Asynchronous reads waiting to be serviced, sorted by address. Protected by s_flash_lock.
+static ListNode *s_read_queue;
+static TimerID s_read_queue_timer;
+
 static uint32_t s_analytics_read_count;
 static uint32_t s_analytics_read_bytes_count;
 static uint32_t s_analytics_write_bytes_count;
@@ -134,6 +154,7 @@ void flash_init(void) {
   xSemaphoreGive(s_erase_semphr);
   s_erase_poll_timer = new_timer_create();
   s_erase_suspend_timer = new_timer_create();
+  s_read_queue_timer = new_timer_create();
   flash_erase_init();
 
   mutex_lock(s_flash_lock);
@@ -176,6 +197,7 @@ void flash_init(void) {
 #if UNITTEST
 void flash_api_reset_for_test(void) {
   s_erase = (struct FlashEraseContext) {0};
+  s_read_queue = NULL;
   s_flash_lock = NULL;
 }
 
@@ -184,12 +206,28 @@ TimerID flash_api_get_erase_poll_timer_for_test(void) {
 }
 #endif
 
+//! Assumes that s_flash_lock is held.
+//! @return How much longer a running erase must be left alone before it may be suspended, 0 if
+//! there is no running erase or it may be suspended right away.
+static uint32_t prv_erase_slice_remaining_ms(void) {
+  if (!s_erase.in_progress || s_erase.suspended) {
+    return 0;
+  }
+  const uint64_t elapsed_ms = ((rtc_get_ticks() - s_erase.resumed_ticks) * 1000) / RTC_TICKS_HZ;
+  return (elapsed_ms < ERASE_MIN_SLICE_MS) ? (ERASE_MIN_SLICE_MS - elapsed_ms) : 0;
+}
+
 //! Assumes that s_flash_lock is held.
 static void prv_erase_pause(void) {
   if (s_erase.in_progress && !s_erase.suspended) {
     // If an erase is in progress, make sure it gets at least a mininum time slice to progress.
-    // If not, the successive kicking of the suspend timer could starve it out completely
-    psleep(100);
+    // If not, the successive kicking of the suspend timer could starve it out completely. Only
+    // the part of the slice which hasn't elapsed yet since the erase was started or last resumed
+    // needs to be waited out.
+    const uint32_t slice_remaining_ms = prv_erase_slice_remaining_ms();
+    if (slice_remaining_ms) {
+      psleep(slice_remaining_ms);
+    }
     task_watchdog_bit_set(s_erase.task);
     status_t status = flash_impl_erase_suspend(s_erase.address);
     PBL_ASSERT(PASSED(status), "Erase suspend failure: %" PRId32, status);
@@ -208,6 +246,7 @@ static void prv_erase_resume(void) {
     status_t status = flash_impl_erase_resume(s_erase.address);
     PBL_ASSERT(PASSED(status), "Erase resume failure: %" PRId32, status);
     s_erase.suspended = false;
+    s_erase.resumed_ticks = rtc_get_ticks();
   }
 }
 
@@ -217,20 +256,140 @@ static void prv_erase_suspend_timer_cb(void *unused) {
   mutex_unlock(s_flash_lock);
 }
 
-void flash_read_bytes(uint8_t* buffer, uint32_t start_addr,
-                      uint32_t buffer_size) {
-  mutex_lock(s_flash_lock);
+//! Assumes that s_flash_lock is held.
+static void prv_account_read(uint32_t buffer_size) {
   s_analytics_read_count++;
   s_analytics_read_bytes_count += buffer_size;
   s_system_analytics_read_bytes_count += buffer_size;
+}
+
+// -------------------------------------------------------------------------------------------
+// Asynchronous reads
+
+static int prv_read_request_addr_comparator(void *a, void *b) {
+  const FlashReadRequest *queued = a;
+  const FlashReadRequest *new_request = b;
+  if (new_request->start_addr < queued->start_addr) {
+    return -1;
+  }
+  return (new_request->start_addr > queued->start_addr) ? 1 : 0;
+}
+
+//! Read everything in the queue. Requests which are contiguous both in flash and in their
+//! destination buffers are read with a single transfer.
+//! Assumes that s_flash_lock is held and that any erase has been paused.
+//! @return The serviced requests, which still need their callbacks called once the lock has
+//! been released.
+static ListNode *prv_read_queue_service(void) {
+  ListNode *serviced = s_read_queue;
+  s_read_queue = NULL;
+
+  FlashReadRequest *run_start = (FlashReadRequest *)serviced;
+  while (run_start) {
+    uint32_t run_size = run_start->buffer_size;
+    FlashReadRequest *run_end = (FlashReadRequest *)list_get_next(&run_start->list_node);
+    while (run_end && (run_end->start_addr == run_start->start_addr + run_size) &&
+           (run_end->buffer == run_start->buffer + run_size)) {
+      run_size += run_end->buffer_size;
+      run_end = (FlashReadRequest *)list_get_next(&run_end->list_node);
+    }
+    const status_t status = flash_impl_read_sync(run_start->buffer, run_start->start_addr,
+                                                 run_size);
+    for (FlashReadRequest *request = run_start; request != run_end;
+         request = (FlashReadRequest *)list_get_next(&request->list_node)) {
+      request->result = status;
+    }
+    run_start = run_end;
+  }
+  return serviced;
+}
+
+//! Must be called without s_flash_lock held so that callbacks may access flash again.
+static void prv_read_queue_complete(ListNode *serviced) {
+  while (serviced) {
+    FlashReadRequest *request = (FlashReadRequest *)serviced;
+    serviced = list_pop_head(serviced);
+    request->on_complete(request->context, request->result);
+  }
+}
+
+static void prv_read_queue_timer_cb(void *unused);
+
+//! Assumes that s_flash_lock is held.
+static void prv_read_queue_schedule(void) {
+  if (s_read_queue) {
+    // Don't hold up the timer task sleeping in prv_erase_pause, come back once the erase has had
+    // its minimum slice instead
+    new_timer_start(s_read_queue_timer, prv_erase_slice_remaining_ms(), prv_read_queue_timer_cb,
+                    NULL, 0);
+  }
+}
+
+static void prv_read_queue_timer_cb(void *unused) {
+  mutex_lock(s_flash_lock);
+  if (prv_erase_slice_remaining_ms()) {
+    // An erase got started or resumed since the timer was scheduled
+    prv_read_queue_schedule();
+    mutex_unlock(s_flash_lock);
+    return;
+  }
+  ListNode *serviced = NULL;
+  if (s_read_queue) {
+    prv_erase_pause();
+    new_timer_start(s_erase_suspend_timer, ERASE_RESUME_AFTER_READ_MS, prv_erase_suspend_timer_cb,
+                    NULL, 0);
+    serviced = prv_read_queue_service();
+  }
+  mutex_unlock(s_flash_lock);
+
+  prv_read_queue_complete(serviced);
+}
+
+void flash_read_bytes_async(FlashReadRequest *request, uint8_t *buffer, uint32_t start_addr,
+                            uint32_t buffer_size, FlashOperationCompleteCb on_complete,
+                            void *context) {
+  PBL_ASSERTN(on_complete);
+  *request = (FlashReadRequest) {
+    .buffer = buffer,
+    .start_addr = start_addr,
+    .buffer_size = buffer_size,
+    .on_complete = on_complete,
+    .context = context,
+  };
+
+  mutex_lock(s_flash_lock);
+  prv_account_read(buffer_size);
+  const bool was_idle = (s_read_queue == NULL);
+  s_read_queue = list_sorted_add(s_read_queue, &request->list_node,
+                                 prv_read_request_addr_comparator, true /* ascending */);
+  if (was_idle) {
+    prv_read_queue_schedule();
+  }
+  mutex_unlock(s_flash_lock);
+}
+
+void flash_read_bytes(uint8_t* buffer, uint32_t start_addr,
+                      uint32_t buffer_size) {
+  mutex_lock(s_flash_lock);
+  prv_account_read(buffer_size);
   // TODO: use DMA when possible
   // TODO: be smarter about pausing erases. Some flash chips allow concurrent
   // reads while an erase is in progress, as long as the read is to another bank
   // than the one being erased.
   prv_erase_pause();
-  new_timer_start(s_erase_suspend_timer, 5, prv_erase_suspend_timer_cb, NULL, 0);
+  new_timer_start(s_erase_suspend_timer, ERASE_RESUME_AFTER_READ_MS, prv_erase_suspend_timer_cb,
+                  NULL, 0);
   flash_impl_read_sync(buffer, start_addr, buffer_size);
+
+  // The erase is paused now anyway, so service any queued asynchronous reads in the same window
+  ListNode *serviced = NULL;
+  if (s_read_queue) {
+    new_timer_stop(s_read_queue_timer);
+    serviced = prv_read_queue_service();
+  }
   mutex_unlock(s_flash_lock);
+
+  prv_read_queue_complete(serviced);
 }
 
 #ifdef TEST_FLASH_LOCK_PROTECTION
@@ -240,6 +399,19 @@ void flash_expect_program_failure(bool expect_failure) {
 }
 #endif
 
+//! Wait for the page write in progress to finish. The status is polled back-to-back a few times
+//! since most page programs finish quickly, after which the task sleeps between polls rather
+//! than keeping the CPU busy.
+//! Assumes that s_flash_lock is held.
+static status_t prv_wait_for_write_complete(void) {
+  status_t status;
+  uint32_t num_polls = 0;
+  while ((status = flash_impl_get_write_status()) == E_BUSY) {
+    psleep((++num_polls <= WRITE_STATUS_SPIN_POLLS) ? 0 : 1);
+  }
+  return status;
+}
+
 void flash_write_bytes(const uint8_t *buffer, uint32_t start_addr,
                        uint32_t buffer_size) {
   mutex_lock(s_flash_lock);
@@ -247,7 +419,8 @@ void flash_write_bytes(const uint8_t *buffer, uint32_t start_addr,
   s_analytics_write_bytes_count += buffer_size;
   s_system_analytics_write_bytes_count += buffer_size;
   prv_erase_pause();
-  new_timer_start(s_erase_suspend_timer, 50, prv_erase_suspend_timer_cb, NULL, 0);
+  new_timer_start(s_erase_suspend_timer, ERASE_RESUME_AFTER_WRITE_MS, prv_erase_suspend_timer_cb,
+                  NULL, 0);
   while (buffer_size) {
     int written = flash_impl_write_page_begin(buffer, start_addr, buffer_size);
     PBL_ASSERT(
@@ -256,10 +429,7 @@ void flash_write_bytes(const uint8_t *buffer, uint32_t start_addr,
 #endif
         PASSED(written),
         "flash_impl_write_page_begin failed: %d", written);
-    status_t status;
-    while ((status = flash_impl_get_write_status()) == E_BUSY) {
-      psleep(0);
-    }
+    status_t status = prv_wait_for_write_complete();
 #ifdef TEST_FLASH_LOCK_PROTECTION
     if (s_assert_write_error) {
       PBL_ASSERT(FAILED(status), "flash write unexpectedly succeeded: %" PRId32,
@@ -314,6 +484,7 @@ static uint32_t prv_flash_erase_start(uint32_t addr,
     .expected_duration = is_subsector?
         flash_impl_get_typical_subsector_erase_duration_ms() :
         flash_impl_get_typical_sector_erase_duration_ms(),
+    .resumed_ticks = rtc_get_ticks(),
   };
   stop_mode_disable(InhibitorFlash);  // FIXME: PBL-18028
   status_t status = is_subsector? flash_impl_blank_check_subsector(addr)
@@ -405,6 +405,15 @@ void flash_read_bytes(uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size
   flash_unlock();
 }
 
+// This part has no erase suspend handling to schedule around, so reads are simply performed
+// synchronously.
+void flash_read_bytes_async(FlashReadRequest *request, uint8_t *buffer, uint32_t start_addr,
+                            uint32_t buffer_size, FlashOperationCompleteCb on_complete,
+                            void *context) {
+  flash_read_bytes(buffer, start_addr, buffer_size);
+  on_complete(context, S_SUCCESS);
+}
+
 void flash_write_bytes(const uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size) {
   if (!buffer_size) {
     return;
@@ -27,6 +27,7 @@
 
 #include "kernel/core_dump.h"
 #include "kernel/core_dump_private.h"
+#include "kernel/core_dump_rle.h"
 
 #include "console/dbgserial.h"
 #include "kernel/logging_private.h"
@@ -111,22 +112,24 @@ typedef struct {
                              // for memory regions where reads smaller than 32
                              // bits will fail. The start pointer must also be
                              // word-aligned.
+  bool     compress;         // Dump as a CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunk. Only for RAM, as
+                             // it gets read by word. Start and length must be word-aligned.
 } MemoryRegion;
 
 // Memory regions to dump
 static const MemoryRegion MEMORY_REGIONS_DUMP[] = {
 #if MICRO_FAMILY_STM32F2
-  { .start = (void *)SRAM_BASE, .length = COREDUMP_RAM_SIZE },
+  { .start = (void *)SRAM_BASE, .length = COREDUMP_RAM_SIZE, .compress = true },
 #elif MICRO_FAMILY_NRF52840
-  { .start = (void *)0x20000000, .length = COREDUMP_RAM_SIZE },
+  { .start = (void *)0x20000000, .length = COREDUMP_RAM_SIZE, .compress = true },
 #else
-  { .start = (void *)SRAM1_BASE, .length = COREDUMP_RAM_SIZE },
+  { .start = (void *)SRAM1_BASE, .length = COREDUMP_RAM_SIZE, .compress = true },
 #endif
 #if PLATFORM_SNOWY || PLATFORM_SPALDING
-  { .start = (void *)CCMDATARAM_BASE, .length = (uint32_t)__CCM_RAM_size__ },
+  { .start = (void *)CCMDATARAM_BASE, .length = (uint32_t)__CCM_RAM_size__, .compress = true },
 #endif
 #if MICRO_FAMILY_STM32F7
-  { .start = (void *)RAMDTCM_BASE, .length = (uint32_t)__DTCM_RAM_size__ },
+  { .start = (void *)RAMDTCM_BASE, .length = (uint32_t)__DTCM_RAM_size__, .compress = true },
 #endif
 #if !MICRO_FAMILY_NRF5
   { .start = (void *)RCC, .length = sizeof(*RCC) },
@@ -438,12 +441,46 @@ static void prvTaskInfoCallback( const xPORT_TASK_INFO * const task_info, void *
                                         chunk_hdr.size);
 }
 
+// Static so it doesn't take up room on the fault handler's stack
+static CoreDumpRleEncoder s_rle_encoder;
+
+// The chunk header goes in last, once the encoded size is known. Until then it's still erased,
+// which reads as a terminator, so a core dump cut short while encoding is still readable.
+static void prv_write_compressed_memory_region(const MemoryRegion *region, uint32_t flash_base) {
+  CD_ASSERTN(s_flash_addr + sizeof(CoreDumpChunkHeader) + sizeof(CoreDumpRleMemoryHeader) +
+             CORE_DUMP_RLE_MAX_ENCODED_SIZE(region->length) - flash_base < CORE_DUMP_MAX_SIZE);
+  const uint32_t chunk_hdr_addr = s_flash_addr;
+  s_flash_addr += sizeof(CoreDumpChunkHeader);
+
+  CoreDumpRleMemoryHeader mem_hdr = {
+    .start = (uint32_t)region->start,
+    .length = region->length,
+  };
+  s_flash_addr += prv_flash_write_bytes(&mem_hdr, s_flash_addr, sizeof(mem_hdr));
+
+  core_dump_rle_init(&s_rle_encoder, prv_flash_write_bytes, s_flash_addr);
+  core_dump_rle_put_memory(&s_rle_encoder, region->start, region->length, watchdog_feed);
+  const uint32_t end_addr = core_dump_rle_finish(&s_rle_encoder);
+
+  CoreDumpChunkHeader chunk_hdr = {
+    .key = CORE_DUMP_CHUNK_KEY_MEMORY_RLE,
+    .size = end_addr - (chunk_hdr_addr + sizeof(CoreDumpChunkHeader)),
+  };
+  prv_flash_write_bytes(&chunk_hdr, chunk_hdr_addr, sizeof(chunk_hdr));
+  s_flash_addr = end_addr;
+}
+
 static void prv_write_memory_regions(const MemoryRegion *regions, unsigned int count,
                                      uint32_t flash_base) {
   CoreDumpChunkHeader chunk_hdr;
   chunk_hdr.key = CORE_DUMP_CHUNK_KEY_MEMORY;
 
   for (unsigned int i = 0; i < count; i++) {
+    if (regions[i].compress) {
+      prv_write_compressed_memory_region(&regions[i], flash_base);
+      continue;
+    }
+
     chunk_hdr.size = regions[i].length + sizeof(CoreDumpMemoryHeader);
     CD_ASSERTN(s_flash_addr + chunk_hdr.size - flash_base < CORE_DUMP_MAX_SIZE);
     s_flash_addr += prv_flash_write_bytes(&chunk_hdr, s_flash_addr,
@@ -648,6 +685,8 @@ EXTERNALLY_VISIBLE void core_dump_handler_c(void) {
   // ...
   // uint32_t          0xFFFFFFFF            // terminates list
   //
+  // RAM is stored as CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunks, see kernel/core_dump_rle.h.
+  //
   // For threads, we store a CoreDumpThreadInfo structure as the "chunk":
   //  chunk_key = 'THRD'
   //  chunk[] = { uint8_t  name[16];      // includes null termination
@@ -724,7 +763,8 @@ status_t core_dump_size(uint32_t flash_base, uint32_t *size) {
     } else if (chunk_hdr.key == CORE_DUMP_CHUNK_KEY_RAM
            || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_THREAD
            || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_EXTRA_REG
-           || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_MEMORY) {
+           || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_MEMORY
+           || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_MEMORY_RLE) {
       current_offset += sizeof(chunk_hdr) + chunk_hdr.size;
     } else {
       return E_INTERNAL;
@@ -94,7 +94,7 @@ typedef struct {
 // The first item in a core dump image is a CoreDumpImageHeader. That is followed by one or more
 // CoreDumpChunkHeader's, terminated by one with a key of CORE_DUMP_CHUNK_KEY_TERMINATOR
 #define CORE_DUMP_MAGIC                   0xF00DCAFE
-#define CORE_DUMP_VERSION                 1                   // Current version
+#define CORE_DUMP_VERSION                 2                   // Current version
 typedef struct PACKED {
   uint32_t    magic;                // Set to CORE_DUMP_MAGIC
 
@@ -112,6 +112,7 @@ typedef struct PACKED {
 #define CORE_DUMP_CHUNK_KEY_THREAD        2
 #define CORE_DUMP_CHUNK_KEY_EXTRA_REG     3
 #define CORE_DUMP_CHUNK_KEY_MEMORY        4
+#define CORE_DUMP_CHUNK_KEY_MEMORY_RLE    5  // Since version 2
 typedef struct PACKED {
   uint32_t    key;          // CORE_DUMP_CHUNK_KEY_.*
   uint32_t    size;
@@ -124,6 +125,13 @@ typedef struct PACKED {
   // uint8_t data[size - sizeof(CoreDumpMemoryHeader)];
 } CoreDumpMemoryHeader;
 
+// Header for segments of memory dumped with the encoding described in kernel/core_dump_rle.h
+typedef struct PACKED {
+  uint32_t start;   // start address of the chunk of dumped memory
+  uint32_t length;  // number of bytes of memory once decoded
+  // uint8_t encoded_data[size - sizeof(CoreDumpRleMemoryHeader)];
+} CoreDumpRleMemoryHeader;
+
 void coredump_assert(int line);
 #define CD_ASSERTN(expr) \
   do { \
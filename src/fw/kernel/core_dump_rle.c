@@ -0,0 +1,130 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kernel/core_dump_rle.h"
+
+#define TOKEN_SIZE (sizeof(uint16_t))
+#define WORD_SIZE (sizeof(uint32_t))
+
+#define WORDS_PER_WATCHDOG_FEED 1024
+
+static void prv_put_bytes(CoreDumpRleEncoder *encoder, const void *data, uint16_t length) {
+  const uint8_t *bytes = data;
+  for (uint16_t i = 0; i < length; i++) {
+    encoder->buffer[encoder->buffer_len++] = bytes[i];
+  }
+}
+
+static void prv_put_token(CoreDumpRleEncoder *encoder, uint16_t pos, uint32_t count, bool is_run) {
+  const uint16_t token = (count - 1) | (is_run ? CORE_DUMP_RLE_TOKEN_RUN_FLAG : 0);
+  encoder->buffer[pos] = token & 0xff;
+  encoder->buffer[pos + 1] = token >> 8;
+}
+
+static void prv_close_literal(CoreDumpRleEncoder *encoder) {
+  if (encoder->literal_count) {
+    prv_put_token(encoder, encoder->literal_pos, encoder->literal_count, false /* is_run */);
+    encoder->literal_count = 0;
+  }
+}
+
+static void prv_flush(CoreDumpRleEncoder *encoder) {
+  prv_close_literal(encoder);
+  if (encoder->buffer_len) {
+    encoder->addr += encoder->write(encoder->buffer, encoder->addr, encoder->buffer_len);
+    encoder->buffer_len = 0;
+  }
+}
+
+static void prv_reserve(CoreDumpRleEncoder *encoder, uint16_t length) {
+  if (encoder->buffer_len + length > CORE_DUMP_RLE_BUFFER_SIZE) {
+    prv_flush(encoder);
+  }
+}
+
+static void prv_put_run(CoreDumpRleEncoder *encoder, uint32_t word, uint32_t count) {
+  prv_close_literal(encoder);
+  prv_reserve(encoder, TOKEN_SIZE + WORD_SIZE);
+  prv_put_token(encoder, encoder->buffer_len, count, true /* is_run */);
+  encoder->buffer_len += TOKEN_SIZE;
+  prv_put_bytes(encoder, &word, WORD_SIZE);
+}
+
+static void prv_put_literal(CoreDumpRleEncoder *encoder, uint32_t word) {
+  if (encoder->literal_count == CORE_DUMP_RLE_MAX_COUNT) {
+    prv_close_literal(encoder);
+  }
+  if (encoder->literal_count == 0) {
+    prv_reserve(encoder, TOKEN_SIZE + WORD_SIZE);
+    encoder->literal_pos = encoder->buffer_len;
+    encoder->buffer_len += TOKEN_SIZE;
+  } else if (encoder->buffer_len + WORD_SIZE > CORE_DUMP_RLE_BUFFER_SIZE) {
+    // The literal continues with a new token after the flush
+    prv_flush(encoder);
+    encoder->literal_pos = 0;
+    encoder->buffer_len = TOKEN_SIZE;
+  }
+  prv_put_bytes(encoder, &word, WORD_SIZE);
+  encoder->literal_count++;
+}
+
+//! Encodes the words held back in case they turn out to be a run
+static void prv_put_pending_run(CoreDumpRleEncoder *encoder) {
+  if (encoder->run_count == 1) {
+    // A run of one word takes more room than the word by itself
+    prv_put_literal(encoder, encoder->run_word);
+  } else if (encoder->run_count > 1) {
+    prv_put_run(encoder, encoder->run_word, encoder->run_count);
+  }
+  encoder->run_count = 0;
+}
+
+void core_dump_rle_init(CoreDumpRleEncoder *encoder, CoreDumpRleWriteCallback write,
+                        uint32_t start_addr) {
+  *encoder = (CoreDumpRleEncoder) {
+    .write = write,
+    .addr = start_addr,
+  };
+}
+
+void core_dump_rle_put_word(CoreDumpRleEncoder *encoder, uint32_t word) {
+  if (encoder->run_count && (word == encoder->run_word) &&
+      (encoder->run_count < CORE_DUMP_RLE_MAX_COUNT)) {
+    encoder->run_count++;
+    return;
+  }
+  prv_put_pending_run(encoder);
+  encoder->run_word = word;
+  encoder->run_count = 1;
+}
+
+void core_dump_rle_put_memory(CoreDumpRleEncoder *encoder, const void *start, uint32_t length,
+                              void (*feed_watchdog)(void)) {
+  const volatile uint32_t *words = start;
+  const uint32_t num_words = length / WORD_SIZE;
+  for (uint32_t i = 0; i < num_words; i++) {
+    core_dump_rle_put_word(encoder, words[i]);
+    if (feed_watchdog && ((i % WORDS_PER_WATCHDOG_FEED) == 0)) {
+      feed_watchdog();
+    }
+  }
+}
+
+uint32_t core_dump_rle_finish(CoreDumpRleEncoder *encoder) {
+  prv_put_pending_run(encoder);
+  prv_flush(encoder);
+  return encoder->addr;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+//! @file core_dump_rle.h
+//! Word run-length encoding used for CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunks.
+//!
+//! RAM at the time of a crash is mostly zeroes, unused stack fill patterns and other repeated
+//! words, so memory is encoded 32 bits at a time as a sequence of runs and literals. Each one
+//! starts with a little endian uint16_t token:
+//!   bit 15 set:   a run, followed by one uint32_t that is repeated (count) times
+//!   bit 15 clear: a literal, followed by (count) uint32_t's that are copied as is
+//! Bits 0-14 hold (count - 1).
+//!
+//! The encoder streams its output to flash through a small fixed buffer and never allocates, so
+//! it can run from the fault handler. It only ever reads memory a word at a time.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CORE_DUMP_RLE_TOKEN_RUN_FLAG (1 << 15)
+#define CORE_DUMP_RLE_MAX_COUNT (CORE_DUMP_RLE_TOKEN_RUN_FLAG)
+
+#define CORE_DUMP_RLE_BUFFER_SIZE 256
+
+//! Upper bound of the size of the encoding of length bytes of memory. Runs never take more room
+//! than the words they replace, so the only overhead is the tokens of the literals, at most one
+//! for every buffer flush plus one for the last literal.
+#define CORE_DUMP_RLE_MAX_ENCODED_SIZE(length) \
+  ((length) + (2 * (((length) / (CORE_DUMP_RLE_BUFFER_SIZE - 8)) + 2)))
+
+//! Writes buffer_size bytes at start_addr, returns the number of bytes written
+typedef uint32_t (*CoreDumpRleWriteCallback)(const void *buffer, uint32_t start_addr,
+                                             uint32_t buffer_size);
+
+typedef struct {
+  CoreDumpRleWriteCallback write;
+  uint32_t addr;          //!< Where the buffer gets written to next
+  uint32_t run_word;
+  uint32_t run_count;     //!< Number of run_word's seen that haven't been encoded yet
+  uint16_t buffer_len;
+  uint16_t literal_pos;   //!< Offset of the token of the open literal in the buffer
+  uint16_t literal_count; //!< Number of words in the open literal, 0 if there is none
+  uint8_t buffer[CORE_DUMP_RLE_BUFFER_SIZE];
+} CoreDumpRleEncoder;
+
+void core_dump_rle_init(CoreDumpRleEncoder *encoder, CoreDumpRleWriteCallback write,
+                        uint32_t start_addr);
+
+void core_dump_rle_put_word(CoreDumpRleEncoder *encoder, uint32_t word);
+
+//! Encodes length bytes starting at start, which must both be word aligned.
+//! Calls feed_watchdog every now and then if it isn't NULL.
+void core_dump_rle_put_memory(CoreDumpRleEncoder *encoder, const void *start, uint32_t length,
+                              void (*feed_watchdog)(void));
+
+//! Writes out everything that is still buffered
+//! @return the address right after the last byte of the encoding
+uint32_t core_dump_rle_finish(CoreDumpRleEncoder *encoder);
@@ -89,6 +89,7 @@
 #include "system/bootbits.h"
 #include "system/logging.h"
 #include "system/passert.h"
+#include "system/profiler.h"
 #include "system/reset.h"
 #include "system/testinfra.h"
 #include "util/bitset.h"
@@ -490,11 +491,13 @@ void launcher_main_loop(void) {
     if (event_take_timeout(&e, 1000)) {
       const PebbleTaskBitset kernel_main_task_bit = (1 << PebbleTask_KernelMain);
       const bool is_not_masked_out_from_kernel_main = !(e.task_mask & kernel_main_task_bit);
+      PROFILER_EVENT_DISPATCH_START(e.type);
       if (is_not_masked_out_from_kernel_main) {
         prv_handle_event(&e);
       }
 
       event_service_handle_event(&e);
+      PROFILER_EVENT_DISPATCH_STOP(e.type);
 
       event_cleanup(&e);
 
@@ -23,7 +23,9 @@
 #include "os/tick.h"
 #include "system/logging.h"
 #include "system/passert.h"
-#include "util/list.h"
+#include "util/math.h"
+
+#include <string.h>
 
 #include "FreeRTOS.h"
 #include "queue.h"
@@ -32,9 +34,8 @@
 
 // Structure of a timer
 typedef struct TaskTimer {
-  //! Entry into either the running timers (manager->running_timers) list or the idle timers
-  //! (manager->idle_timers)
-  ListNode list_node;
+  //! Next timer in the same manager->timers_by_id bucket
+  struct TaskTimer *id_bucket_next;
 
   //! The tick value when this timer will expire (in ticks). If the timer isn't currently
   //! running (scheduled) this value will be zero.
@@ -42,6 +43,14 @@ typedef struct TaskTimer {
 
   RtcTicks period_ticks;
 
+  //! Value of manager->next_start_seq when this timer was last put into the running heap. Breaks
+  //! ties between timers that have the same expire_time.
+  uint32_t start_seq;
+
+  //! Index of this timer in the manager->running_timers heap. Only valid while expire_time is
+  //! non-zero.
+  uint32_t heap_idx;
+
   TaskTimerID id;            //<! ID assigned to this timer
 
   //! client provided callback function and argument
@@ -59,38 +68,179 @@ typedef struct TaskTimer {
   bool defer_delete:1;
 } TaskTimer;
 
+//! Initial number of entries in the running timers heap and the timers_by_id hash table
+#define TASK_TIMER_MIN_CAPACITY 8
+
+
+// =======================================================================================
+// Running timers heap
+
 // ------------------------------------------------------------------------------------
-// Comparator function for list_sorted_add
-// Returns the order in which (a, b) occurs
-// returns negative int for a descending value (a > b), positive for an ascending value (b > a),
-// 0 for equal
-static int prv_timer_expire_compare_func(void* a, void* b) {
-  if (((TaskTimer*)b)->expire_time < ((TaskTimer*)a)->expire_time) {
-    return -1;
-  } else if (((TaskTimer*)b)->expire_time > ((TaskTimer*)a)->expire_time) {
-    return 1;
-  } else {
-    return 0;
+// Returns true if timer a should fire before timer b. Timers with the same expire time fire in
+// the order they were started.
+static bool prv_timer_fires_before(const TaskTimer *a, const TaskTimer *b) {
+  if (a->expire_time != b->expire_time) {
+    return (a->expire_time < b->expire_time);
   }
+  return ((int32_t)(a->start_seq - b->start_seq) < 0);
 }
 
+static void prv_heap_set(TaskTimerManager *manager, uint32_t idx, TaskTimer *timer) {
+  manager->running_timers[idx] = timer;
+  timer->heap_idx = idx;
+}
+
+static void prv_heap_sift_up(TaskTimerManager *manager, uint32_t idx) {
+  TaskTimer *timer = manager->running_timers[idx];
+  while (idx > 0) {
+    const uint32_t parent_idx = (idx - 1) / 2;
+    TaskTimer *parent = manager->running_timers[parent_idx];
+    if (!prv_timer_fires_before(timer, parent)) {
+      break;
+    }
+    prv_heap_set(manager, idx, parent);
+    idx = parent_idx;
+  }
+  prv_heap_set(manager, idx, timer);
+}
+
+static void prv_heap_sift_down(TaskTimerManager *manager, uint32_t idx) {
+  TaskTimer *timer = manager->running_timers[idx];
+  while (true) {
+    uint32_t child_idx = 2 * idx + 1;
+    if (child_idx >= manager->num_running_timers) {
+      break;
+    }
+    TaskTimer *child = manager->running_timers[child_idx];
+    if (child_idx + 1 < manager->num_running_timers) {
+      TaskTimer *right = manager->running_timers[child_idx + 1];
+      if (prv_timer_fires_before(right, child)) {
+        child_idx++;
+        child = right;
+      }
+    }
+    if (!prv_timer_fires_before(child, timer)) {
+      break;
+    }
+    prv_heap_set(manager, idx, child);
+    idx = child_idx;
+  }
+  prv_heap_set(manager, idx, timer);
+}
 
 // ------------------------------------------------------------------------------------
-// Find timer by id
-static bool prv_id_list_filter(ListNode* node, void* data) {
-  TaskTimer* timer = (TaskTimer*)node;
-  return timer->id == (uint32_t) data;
+// Add a timer whose expire_time has been set to the running heap. Space for it is always
+// available, see prv_reserve_capacity().
+static void prv_heap_insert(TaskTimerManager *manager, TaskTimer *timer) {
+  PBL_ASSERTN(manager->num_running_timers < manager->running_timers_capacity);
+  timer->start_seq = manager->next_start_seq++;
+  const uint32_t idx = manager->num_running_timers++;
+  prv_heap_set(manager, idx, timer);
+  prv_heap_sift_up(manager, idx);
+}
+
+static void prv_heap_remove(TaskTimerManager *manager, TaskTimer *timer) {
+  const uint32_t idx = timer->heap_idx;
+  PBL_ASSERTN(idx < manager->num_running_timers && manager->running_timers[idx] == timer);
+
+  const uint32_t last_idx = --manager->num_running_timers;
+  if (idx == last_idx) {
+    return;
+  }
+  // Move the last timer into the hole and restore the heap order around it
+  prv_heap_set(manager, idx, manager->running_timers[last_idx]);
+  if (idx > 0 && prv_timer_fires_before(manager->running_timers[idx],
+                                        manager->running_timers[(idx - 1) / 2])) {
+    prv_heap_sift_up(manager, idx);
+  } else {
+    prv_heap_sift_down(manager, idx);
+  }
+}
+
+static TaskTimer *prv_heap_peek(TaskTimerManager *manager) {
+  return manager->num_running_timers ? manager->running_timers[0] : NULL;
+}
+
+
+// =======================================================================================
+// Timers by ID
+
+static TaskTimer **prv_id_bucket(TaskTimerManager *manager, TaskTimerID timer_id) {
+  // IDs are handed out sequentially, so the low bits are already well distributed
+  return &manager->timers_by_id[timer_id & (manager->num_id_buckets - 1)];
+}
+
+static void prv_id_table_add(TaskTimerManager *manager, TaskTimer *timer) {
+  TaskTimer **bucket = prv_id_bucket(manager, timer->id);
+  timer->id_bucket_next = *bucket;
+  *bucket = timer;
+}
+
+static void prv_id_table_remove(TaskTimerManager *manager, TaskTimer *timer) {
+  TaskTimer **link = prv_id_bucket(manager, timer->id);
+  while (*link != timer) {
+    PBL_ASSERTN(*link);
+    link = &(*link)->id_bucket_next;
+  }
+  *link = timer->id_bucket_next;
 }
 
+// ------------------------------------------------------------------------------------
+// Find timer by id
 static TaskTimer* prv_find_timer(TaskTimerManager *manager, TaskTimerID timer_id) {
   PBL_ASSERTN(timer_id != TASK_TIMER_INVALID_ID);
-  // Look for this timer in either the running or idle list
-  ListNode* node = list_find(manager->running_timers, prv_id_list_filter, (void*)timer_id);
-  if (!node) {
-    node = list_find(manager->idle_timers, prv_id_list_filter, (void*)timer_id);
+  PBL_ASSERTN(manager->num_id_buckets);
+  TaskTimer *timer = *prv_id_bucket(manager, timer_id);
+  while (timer && timer->id != timer_id) {
+    timer = timer->id_bucket_next;
+  }
+  PBL_ASSERTN(timer);
+  return timer;
+}
+
+// ------------------------------------------------------------------------------------
+// Make sure the running heap has room for num_timers timers and grow the ID hash table to keep
+// its chains short. Must be called with the manager mutex held.
+// @return false if the heap could not be grown
+static bool prv_reserve_capacity(TaskTimerManager *manager, uint32_t num_timers) {
+  if (num_timers > manager->running_timers_capacity) {
+    const uint32_t new_capacity = MAX(TASK_TIMER_MIN_CAPACITY,
+                                      2 * manager->running_timers_capacity);
+    TaskTimer **heap = kernel_malloc(new_capacity * sizeof(TaskTimer *));
+    if (!heap) {
+      return false;
+    }
+    if (manager->running_timers) {
+      memcpy(heap, manager->running_timers, manager->num_running_timers * sizeof(TaskTimer *));
+      kernel_free(manager->running_timers);
+    }
+    manager->running_timers = heap;
+    manager->running_timers_capacity = new_capacity;
   }
-  PBL_ASSERTN(node);
-  return (TaskTimer *)node;
+
+  if (num_timers > manager->num_id_buckets) {
+    const uint32_t new_num_buckets = MAX(TASK_TIMER_MIN_CAPACITY, 2 * manager->num_id_buckets);
+    TaskTimer **buckets = kernel_zalloc(new_num_buckets * sizeof(TaskTimer *));
+    if (!buckets) {
+      // Longer chains are fine, as long as we have a table at all
+      return (manager->num_id_buckets != 0);
+    }
+
+    TaskTimer **old_buckets = manager->timers_by_id;
+    const uint32_t old_num_buckets = manager->num_id_buckets;
+    manager->timers_by_id = buckets;
+    manager->num_id_buckets = new_num_buckets;
+    for (uint32_t i = 0; i < old_num_buckets; i++) {
+      TaskTimer *timer = old_buckets[i];
+      while (timer) {
+        TaskTimer *next = timer->id_bucket_next;
+        prv_id_table_add(manager, timer);
+        timer = next;
+      }
+    }
+    kernel_free(old_buckets);
+  }
+  return true;
 }
 
 
@@ -105,9 +255,15 @@ TaskTimerID task_timer_create(TaskTimerManager *manager) {
     return TASK_TIMER_INVALID_ID;
   }
 
-  // Grab lock on timer structures, create a unique ID for this timer and put it into our idle
-  // timers list
+  // Grab lock on timer structures, create a unique ID for this timer and add it to our table of
+  // timers. Reserve a slot in the running heap for it now so that starting it can't fail.
   mutex_lock(manager->mutex);
+  if (!prv_reserve_capacity(manager, manager->num_timers + 1)) {
+    mutex_unlock(manager->mutex);
+    kernel_free(timer);
+    return TASK_TIMER_INVALID_ID;
+  }
+
   *timer = (TaskTimer) {
     .id = manager->next_id++,
   };
@@ -116,7 +272,8 @@ TaskTimerID task_timer_create(TaskTimerManager *manager) {
   // second
   PBL_ASSERTN(timer->id != TASK_TIMER_INVALID_ID);
 
-  manager->idle_timers = list_insert_before(manager->idle_timers, &timer->list_node);
+  prv_id_table_add(manager, timer);
+  manager->num_timers++;
   mutex_unlock(manager->mutex);
 
   return timer->id;
@@ -150,13 +307,9 @@ bool task_timer_start(TaskTimerManager *manager, TaskTimerID timer_id,
     return false;
   }
 
-  // Remove it from its current list
+  // Remove it from the running heap if it's currently scheduled
   if (timer->expire_time) {
-    PBL_ASSERTN(list_contains(manager->running_timers, &timer->list_node));
-    list_remove(&timer->list_node, &manager->running_timers /* &head */, NULL /* &tail */);
-  } else {
-    PBL_ASSERTN(list_contains(manager->idle_timers, &timer->list_node));
-    list_remove(&timer->list_node, &manager->idle_timers /* &head */, NULL /* &tail */);
+    prv_heap_remove(manager, timer);
   }
 
   // Set timer variables
@@ -166,12 +319,11 @@ bool task_timer_start(TaskTimerManager *manager, TaskTimerID timer_id,
   timer->repeating = flags & TIMER_START_FLAG_REPEATING;
   timer->period_ticks = timeout_ticks;
 
-  // Insert into sorted order in the running list
-  manager->running_timers = list_sorted_add(manager->running_timers, &timer->list_node,
-                                            prv_timer_expire_compare_func, true);
+  // Insert into the running heap
+  prv_heap_insert(manager, timer);
 
   // Wake up our service task if this is the new head so that it can recompute its wait timeout
-  if (manager->running_timers == &timer->list_node) {
+  if (prv_heap_peek(manager) == timer) {
     xSemaphoreGive(manager->semaphore);
   }
   mutex_unlock(manager->mutex);
@@ -184,7 +336,7 @@ bool task_timer_start(TaskTimerManager *manager, TaskTimerID timer_id,
 bool task_timer_scheduled(TaskTimerManager *manager, TaskTimerID timer_id, uint32_t *expire_ms_p) {
   mutex_lock(manager->mutex);
 
-  // Find this timer in our list
+  // Find this timer
   TaskTimer* timer = prv_find_timer(manager, timer_id);
   PBL_ASSERTN(!timer->defer_delete);
 
@@ -211,15 +363,13 @@ bool task_timer_scheduled(TaskTimerManager *manager, TaskTimerID timer_id, uint3
 bool task_timer_stop(TaskTimerManager *manager, TaskTimerID timer_id) {
   mutex_lock(manager->mutex);
 
-  // Find this timer in our list
+  // Find this timer
   TaskTimer* timer = prv_find_timer(manager, timer_id);
   PBL_ASSERTN(!timer->defer_delete);
 
-  // Move it to the idle list if it's currently running
+  // Remove it from the running heap if it's currently running
   if (timer->expire_time) {
-    PBL_ASSERTN(list_contains(manager->running_timers, &timer->list_node));
-    list_remove(&timer->list_node, &manager->running_timers /* &head */, NULL /* &tail */);
-    manager->idle_timers = list_insert_before(manager->idle_timers, &timer->list_node);
+    prv_heap_remove(manager, timer);
   }
 
   // Clear the repeating flag so that if they call this method from a callback it won't get
@@ -237,7 +387,7 @@ bool task_timer_stop(TaskTimerManager *manager, TaskTimerID timer_id) {
 void task_timer_delete(TaskTimerManager *manager, TaskTimerID timer_id) {
   mutex_lock(manager->mutex);
 
-  // Find this timer in our list
+  // Find this timer
   TaskTimer* timer = prv_find_timer(manager, timer_id);
 
   // If it's already marked for deletion return
@@ -248,10 +398,8 @@ void task_timer_delete(TaskTimerManager *manager, TaskTimerID timer_id) {
 
   // Automatically stop it if it it's not stopped already
   if (timer->expire_time) {
+    prv_heap_remove(manager, timer);
     timer->expire_time = 0;
-    PBL_ASSERTN(list_contains(manager->running_timers, &timer->list_node));
-    list_remove(&timer->list_node, &manager->running_timers /* &head */, NULL /* &tail */);
-    manager->idle_timers = list_insert_before(manager->idle_timers, &timer->list_node);
   }
   timer->repeating = false; // In case it's currently executing, make sure we don't reschedule it
 
@@ -261,8 +409,8 @@ void task_timer_delete(TaskTimerManager *manager, TaskTimerID timer_id) {
     timer->defer_delete = true;
     mutex_unlock(manager->mutex);
   } else {
-    PBL_ASSERTN(list_contains(manager->idle_timers, &timer->list_node));
-    list_remove(&timer->list_node, &manager->idle_timers /* &head */, NULL /* &tail */);
+    prv_id_table_remove(manager, timer);
+    manager->num_timers--;
     mutex_unlock(manager->mutex);
     kernel_free(timer);
   }
@@ -293,16 +441,15 @@ TickType_t task_timer_manager_execute_expired_timers(TaskTimerManager *manager)
     // If no timer is ready yet, then ticks_to_wait will be > 0.
     mutex_lock(manager->mutex);
 
-    TaskTimer *next_timer = (TaskTimer*) manager->running_timers;
+    TaskTimer *next_timer = prv_heap_peek(manager);
     if (next_timer != NULL) {
       next_expiry_time = next_timer->expire_time;
       RtcTicks current_time = rtc_get_ticks();
 
       if (next_expiry_time <= current_time) {
-        // Found a timer that has expired! Move it from the running list to the idle talk and
-        // mark it as executing.
-        manager->running_timers = list_pop_head(manager->running_timers);
-        manager->idle_timers = list_insert_before(manager->idle_timers, &next_timer->list_node);
+        // Found a timer that has expired! Remove it from the running heap and mark it as
+        // executing.
+        prv_heap_remove(manager, next_timer);
 
         next_timer->executing = true;
         next_timer->expire_time = 0;
@@ -340,19 +487,18 @@ TickType_t task_timer_manager_execute_expired_timers(TaskTimerManager *manager)
     mutex_lock(manager->mutex);
     next_timer->executing = false;
 
-    // Re-insert into timers list now if it's a repeating timer and wasn't re-scheduled by the
-    // callback (next_timer->expire_time != 0)
+    // Re-insert into the running heap now if it's a repeating timer and wasn't re-scheduled by
+    // the callback (next_timer->expire_time != 0)
     if (next_timer->repeating && !next_timer->expire_time) {
       next_timer->expire_time = next_expiry_time + next_timer->period_ticks;
-      list_remove(&next_timer->list_node, &manager->idle_timers /* &head */, NULL /* &tail */);
-      manager->running_timers = list_sorted_add(manager->running_timers, &next_timer->list_node,
-                                                prv_timer_expire_compare_func, true);
+      prv_heap_insert(manager, next_timer);
     }
 
     // If it's been marked for deletion, take care of that now
     if (next_timer->defer_delete) {
-      PBL_ASSERTN(list_contains(manager->idle_timers, &next_timer->list_node));
-      list_remove(&next_timer->list_node, &manager->idle_timers /* &head */, NULL /* &tail */);
+      PBL_ASSERTN(!next_timer->expire_time);
+      prv_id_table_remove(manager, next_timer);
+      manager->num_timers--;
       mutex_unlock(manager->mutex);
 
       kernel_free(next_timer);
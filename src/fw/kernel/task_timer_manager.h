@@ -23,10 +23,26 @@
 typedef struct TaskTimerManager {
   PebbleMutex *mutex;
 
-  //! List of timers that are currently running
-  ListNode *running_timers;
-  //! List of timers that are allocated but unscheduled
-  ListNode *idle_timers;
+  //! Binary min-heap of the timers that are currently running, ordered by expire time. The
+  //! timer that expires next is always running_timers[0].
+  struct TaskTimer **running_timers;
+  //! Number of timers in the running_timers heap
+  uint32_t num_running_timers;
+  //! Number of entries allocated for the running_timers heap. This is grown when a timer is
+  //! created so that starting a timer never has to allocate.
+  uint32_t running_timers_capacity;
+
+  //! Hash table of all the allocated timers, running or not, indexed by timer ID. Each bucket is
+  //! a chain of timers linked through TaskTimer.id_bucket_next.
+  struct TaskTimer **timers_by_id;
+  //! Number of buckets in timers_by_id, always a power of 2
+  uint32_t num_id_buckets;
+  //! Number of allocated timers
+  uint32_t num_timers;
+
+  //! Incremented every time a timer is started. Timers with the same expire time fire in the
+  //! order in which they were started.
+  uint32_t next_start_seq;
 
   //! The next ID to assign to a new timer.
   TaskTimerID next_id;
@@ -16,6 +16,7 @@
 
 #pragma once
 #include <inttypes.h>
+#include <stdbool.h>
 
 #include "kernel/pebble_tasks.h"
 #include "util/uuid.h"
@@ -96,6 +97,29 @@ void analytics_add(AnalyticsMetric metric, int64_t amount, AnalyticsClient clien
 //! @param uuid The uuid of the app blob
 void analytics_add_for_uuid(AnalyticsMetric metric, int64_t amount, const Uuid *uuid);
 
+//! A counter for device metrics that are incremented so often that taking the analytics lock
+//! every time shows up in profiles. Increments are accumulated without taking the lock and get
+//! added to the metric when the heartbeat is collected. Declare one with
+//! ANALYTICS_BATCHED_COUNTER and don't mix it with analytics_set for the same metric.
+typedef struct AnalyticsBatchedCounter {
+  struct AnalyticsBatchedCounter *next;
+  AnalyticsMetric metric;
+  uint32_t pending;
+  bool registered;
+} AnalyticsBatchedCounter;
+
+#define ANALYTICS_BATCHED_COUNTER(name, device_metric) \
+  static AnalyticsBatchedCounter name = { .metric = (device_metric) }
+
+//! Increment a batched counter's metric
+//! @param counter The counter, @see ANALYTICS_BATCHED_COUNTER
+//! @param amount The amount to increment by
+void analytics_batched_add(AnalyticsBatchedCounter *counter, uint32_t amount);
+
+//! Increment a batched counter's metric by 1
+//! @param counter The counter, @see ANALYTICS_BATCHED_COUNTER
+void analytics_batched_inc(AnalyticsBatchedCounter *counter);
+
 //! Starts a stopwatch that integrates a "rate of things" over time.
 //! @param metric The metric of the stopwatch to start
 //! @param client If the metric is an app metric, this logs it to the app blob using the UUID of the given client.
@@ -48,3 +48,4 @@ extern void analytics_external_collect_chip_specific_parameters(void);
 extern void analytics_external_collect_bt_chip_heartbeat(void);
 extern void analytics_external_collect_kernel_heap_stats(void);
 extern void analytics_external_collect_accel_samples_received(void);
+extern void analytics_external_collect_event_service_stats(void);
@@ -258,6 +258,10 @@
   DEVICE(ANALYTICS_DEVICE_METRIC_HRM_WATCHDOG_TIMEOUT, UINT8) \
   DEVICE(ANALYTICS_DEVICE_METRIC_BLE_HRM_SHARING_TIME, UINT32) \
   \
+  DEVICE(ANALYTICS_DEVICE_METRIC_EVENT_QUEUE_HIGH_WATER_MARK_APP, UINT8) \
+  DEVICE(ANALYTICS_DEVICE_METRIC_EVENT_QUEUE_HIGH_WATER_MARK_WORKER, UINT8) \
+  DEVICE(ANALYTICS_DEVICE_METRIC_EVENT_COALESCED_COUNT, UINT32) \
+  \
   MARKER(ANALYTICS_DEVICE_METRIC_END) \
   \
   \
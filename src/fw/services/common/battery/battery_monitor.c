@@ -22,6 +22,7 @@
 #include "services/common/firmware_update.h"
 #include "services/common/new_timer/new_timer.h"
 #include "services/common/system_task.h"
+#include "services/normal/persist.h"
 #include "system/logging.h"
 #include "util/ratio.h"
 
@@ -132,6 +133,8 @@ static void prv_begin_standby_timer(void) {
 
 static void system_task_handle_battery_critical(void* data) {
   PBL_LOG_COLOR(LOG_LEVEL_INFO, BATT_LOG_COLOR, "Battery critical: go to standby mode");
+  // Apps' persist writes that are still sitting in the write-back cache would be lost otherwise
+  persist_service_flush_all();
   if (low_power_is_active()) {
     low_power_standby();
   } else {
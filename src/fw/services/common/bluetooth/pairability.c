@@ -72,8 +72,9 @@ static void prv_schedule_evaluation(void) {
   // We used to sparingly schedule the evaluation and had a bug because of this:
   // https://pebbletechnology.atlassian.net/browse/PBL-22884
   // Because this pretty much only happens in response to user input, don't bother limiting this,
-  // and always evaluate, even though the state might not have changed:
-  system_task_add_callback(evaluate_pairing_refcount, NULL);
+  // and always evaluate, even though the state might not have changed. An evaluation that hasn't
+  // run yet will see the latest state, so there's no need to queue up another one:
+  system_task_add_callback_coalesced(evaluate_pairing_refcount, NULL);
 }
 
 void bt_pairability_use(void) {
@@ -286,6 +286,21 @@ bool comm_session_send_buffer_write(SendBuffer *sb, const uint8_t *data, size_t
   return true;
 }
 
+uint8_t *comm_session_send_buffer_claim(SendBuffer *sb, size_t length) {
+  if (UNLIKELY((sb->payload_buffer_length - sb->written_length) < length)) {
+    return NULL;
+  }
+  uint8_t *claimed = sb->payload + sb->header.length + sb->written_length;
+  sb->written_length += length;
+  return claimed;
+}
+
+void comm_session_send_buffer_abort_write(SendBuffer *sb) {
+  bt_lock();
+  prv_destroy_send_buffer(sb);
+  bt_unlock();
+}
+
 void comm_session_send_buffer_end_write(SendBuffer *sb) {
   CommSession *session = sb->session;
   // Clear out the ListNode and set impl:
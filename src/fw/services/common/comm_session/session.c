@@ -28,6 +28,7 @@
 #include "services/common/comm_session/protocol.h"
 #include "services/common/comm_session/session_remote_version.h"
 #include "services/common/comm_session/session_send_buffer.h"
+#include "services/common/compositor/screenshot_pp.h"
 
 #include "kernel/events.h"
 #include "kernel/pbl_malloc.h"
@@ -269,6 +270,7 @@ void comm_session_close(CommSession *session, CommSessionCloseReason reason) {
   }
 
   // Cleanup:
+  screenshot_handle_session_closed(session);
   comm_session_receive_router_cleanup(session);
   comm_session_send_queue_cleanup(session);
   list_remove(&session->node, (ListNode **) &s_session_head, NULL);
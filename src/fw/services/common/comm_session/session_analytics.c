@@ -23,6 +23,12 @@
 #include "services/common/ping.h"
 #include "util/time/time.h"
 
+// Every packet adds to these, don't take the analytics lock for each one
+ANALYTICS_BATCHED_COUNTER(s_private_bytes_out, ANALYTICS_DEVICE_METRIC_BT_PRIVATE_BYTE_OUT_COUNT);
+ANALYTICS_BATCHED_COUNTER(s_public_bytes_out, ANALYTICS_DEVICE_METRIC_BT_PUBLIC_BYTE_OUT_COUNT);
+ANALYTICS_BATCHED_COUNTER(s_private_bytes_in, ANALYTICS_DEVICE_METRIC_BT_PRIVATE_BYTE_IN_COUNT);
+ANALYTICS_BATCHED_COUNTER(s_public_bytes_in, ANALYTICS_DEVICE_METRIC_BT_PUBLIC_BYTE_IN_COUNT);
+
 //! returns the analytic timer id we want to use
 static int prv_get_analytic_id_for_session(CommSession *session) {
   if (comm_session_analytics_get_transport_type(session) == CommSessionTransportType_PPoGATT) {
@@ -63,10 +69,10 @@ void comm_session_analytics_close_session(CommSession *session, CommSessionClose
 //! Increment "bytes sent" counter and perform app ping if due
 void comm_session_analytics_inc_bytes_sent(CommSession *session, uint16_t length) {
   CommSessionType type = comm_session_get_type(session);
-  AnalyticsMetric metric;
+  AnalyticsBatchedCounter *counter;
   switch (type) {
     case CommSessionTypeSystem:
-      metric = ANALYTICS_DEVICE_METRIC_BT_PRIVATE_BYTE_OUT_COUNT;
+      counter = &s_private_bytes_out;
 
       // We know that bluetooth is already active. If we just sent a message to the Pebble mobile
       // app, this is a good time to see if we should send our ping out to it as well.
@@ -74,19 +80,18 @@ void comm_session_analytics_inc_bytes_sent(CommSession *session, uint16_t length
       break;
 
     case CommSessionTypeApp:
-      metric = ANALYTICS_DEVICE_METRIC_BT_PUBLIC_BYTE_OUT_COUNT;
+      counter = &s_public_bytes_out;
       break;
 
     case CommSessionTypeInvalid:
     default:
       return;
   }
-  analytics_add(metric, length, AnalyticsClient_System);
+  analytics_batched_add(counter, length);
 }
 
 void comm_session_analytics_inc_bytes_received(CommSession *session, uint16_t length) {
-  const AnalyticsMetric metric = (comm_session_get_type(session) == CommSessionTypeSystem) ?
-                                                ANALYTICS_DEVICE_METRIC_BT_PRIVATE_BYTE_IN_COUNT :
-                                                ANALYTICS_DEVICE_METRIC_BT_PUBLIC_BYTE_IN_COUNT;
-  analytics_add(metric, length, AnalyticsClient_System);
+  AnalyticsBatchedCounter *counter = (comm_session_get_type(session) == CommSessionTypeSystem) ?
+                                          &s_private_bytes_in : &s_public_bytes_in;
+  analytics_batched_add(counter, length);
 }
@@ -56,6 +56,20 @@ SendBuffer * comm_session_send_buffer_begin_write(CommSession *session, uint16_t
 //! of this function when it does attempt to write more than `required_free_length`.
 bool comm_session_send_buffer_write(SendBuffer *send_buffer, const uint8_t *data, size_t length);
 
+//! Reserves space in the send buffer, so the caller can produce data straight into it instead of
+//! copying it in from a temporary buffer with comm_session_send_buffer_write().
+//! @note The caller must have called comm_session_send_buffer_begin_write() first.
+//! @param length Number of bytes to reserve
+//! @return Pointer to the reserved bytes, or NULL if there was not enough space left.
+uint8_t *comm_session_send_buffer_claim(SendBuffer *send_buffer, size_t length);
+
+//! Throws away everything written to the send buffer and releases it without sending anything.
+//! This is the alternative to comm_session_send_buffer_end_write() for when producing the message
+//! failed half-way.
+//! @note The caller must have called comm_session_send_buffer_begin_write() first.
+//! @note bt_lock() MUST NOT be held when making the call.
+void comm_session_send_buffer_abort_write(SendBuffer *send_buffer);
+
 //! Finish writing to the send buffer. Any enqueued data will be transmitted after this call,
 //! to the session that was passed in the ..._begin_write() call.
 //! @note The caller must have called comm_session_send_buffer_begin_write() first.
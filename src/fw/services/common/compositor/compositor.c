@@ -141,6 +141,8 @@ void compositor_app_framebuffer_fill_callback(GContext *ctx, int16_t y,
 
   bitblt_bitmap_into_bitmap(&dest_bitmap, &src_bitmap, GPoint(x_range_begin.integer, y),
                             GCompOpAssign, GColorWhite);
+  framebuffer_mark_dirty_rect(&s_framebuffer, GRect(x_range_begin.integer, y,
+                                                    src_bitmap.bounds.size.w, 1));
 }
 
 #if PBL_COLOR
@@ -175,11 +177,12 @@ void compositor_render_app(void) {
   if (gsize_equal(&app_framebuffer_size, &s_framebuffer.size)) {
 #if CAPABILITY_COMPOSITOR_USES_DMA && !TARGET_QEMU && !UNITTEST
     compositor_dma_run(s_framebuffer.buffer, app_framebuffer->buffer, FRAMEBUFFER_SIZE_BYTES);
+    framebuffer_dirty_all(&s_framebuffer);
 #else
-    GBitmap src_bitmap = compositor_get_app_framebuffer_as_bitmap();
-    GBitmap dest_bitmap = compositor_get_framebuffer_as_bitmap();
-
-    bitblt_bitmap_into_bitmap(&dest_bitmap, &src_bitmap, GPointZero, GCompOpAssign, GColorWhite);
+    // Apps tend to redraw their whole window every frame, so rather than trusting the app's
+    // dirty tracking, compare against what's already on screen and only flush the rows that
+    // actually changed.
+    framebuffer_copy_changed_rows(&s_framebuffer, app_framebuffer);
 #endif
   } else {
 #if PBL_COLOR
@@ -235,6 +238,7 @@ void compositor_render_app(void) {
                                     (uintptr_t)dst;
     memset(dst, GColorBlack.argb, bottom_bezel_length);
 #endif
+    framebuffer_dirty_all(&s_framebuffer);
   }
 
   if (s_state == CompositorState_AppAndModal) {
@@ -242,8 +246,6 @@ void compositor_render_app(void) {
   }
 
   PROFILER_NODE_STOP(compositor);
-
-  framebuffer_dirty_all(&s_framebuffer);
 }
 
 void compositor_render_modal(void) {
@@ -15,6 +15,7 @@
  */
 
 #include "compositor.h"
+#include "screenshot_pp.h"
 
 #include "applib/graphics/framebuffer.h"
 #include "applib/graphics/gtypes.h"
@@ -41,6 +42,10 @@ static bool prv_flush_get_next_line_cb(DisplayRow* row) {
 
   s_current_flush_line = MAX(s_current_flush_line, fb->dirty_rect.origin.y);
   const uint8_t y_end = fb->dirty_rect.origin.y + fb->dirty_rect.size.h;
+  // Every row carries its own address, so rows nothing was drawn into can be left out
+  while ((s_current_flush_line < y_end) && !framebuffer_is_row_dirty(fb, s_current_flush_line)) {
+    s_current_flush_line++;
+  }
   if (s_current_flush_line < y_end) {
     row->address = s_current_flush_line;
     void *fb_line = framebuffer_get_line(fb, s_current_flush_line);
@@ -86,6 +91,9 @@ void compositor_display_update(void (*handle_update_complete_cb)(void)) {
   if (!framebuffer_is_dirty(compositor_get_framebuffer())) {
     return;
   }
+  const GRect dirty_rect = compositor_get_framebuffer()->dirty_rect;
+  screenshot_mark_rows_dirty(dirty_rect.origin.y, dirty_rect.size.h);
+
   s_update_complete_handler = handle_update_complete_cb;
   s_current_flush_line = 0;
 
@@ -122,6 +122,8 @@ void prv_app_fb_fill_assign_horizontal_line(GContext *ctx, int16_t y, Fixed_S16_
   if (x1.integer > x2.integer) {
     return;
   }
+  // The blended last pixel can be the one after x2
+  graphics_context_mark_dirty_rect(ctx, GRect(x1.integer, y, x2.integer - x1.integer + 2, 1));
 
   GBitmap app_framebuffer = compositor_get_app_framebuffer_as_bitmap();
   // We only check the destination data rows above (and not also the source data rows) because we
@@ -176,6 +178,9 @@ void prv_app_fb_fill_assign_vertical_line(GContext *ctx, int16_t x, Fixed_S16_3
   GBitmap *framebuffer = &ctx->dest_bitmap;
   PBL_ASSERTN(framebuffer->bounds.origin.x == 0 && framebuffer->bounds.origin.y == 0);
 
+  // The blended last pixel can be the one after y2
+  graphics_context_mark_dirty_rect(ctx, GRect(x, y1.integer, 1, y2.integer - y1.integer + 2));
+
   GBitmap app_framebuffer = compositor_get_app_framebuffer_as_bitmap();
   // We assume that both source and destination are framebuffers using the native bitmap format
   PBL_ASSERTN(app_framebuffer.info.format == framebuffer->info.format);
@@ -253,6 +253,7 @@ static void prv_collapse_animation_update_round(GContext *ctx,
     GBitmap src_bitmap = compositor_get_app_framebuffer_as_bitmap();
     GBitmap dest_bitmap = compositor_get_framebuffer_as_bitmap();
     bitblt_bitmap_into_bitmap(&dest_bitmap, &src_bitmap, GPointZero, GCompOpAssign, GColorWhite);
+    framebuffer_dirty_all(compositor_get_framebuffer());
   }
 
   compositor_dot_transitions_collapsing_ring_animation_update(ctx, distance_normalized,
@@ -95,6 +95,9 @@ static void prv_port_hole_transition_animation_update(GContext *ctx,
 
   compositor_port_hole_transition_draw_outer_ring(ctx, ABS(current_offset_px), GColorBlack);
   s_data.animation_offset_px = current_offset_px;
+
+  // The blit and the pixel moves above bypass the context, so they don't mark anything dirty
+  framebuffer_dirty_all(compositor_get_framebuffer());
 }
 
 const CompositorTransition *compositor_port_hole_transition_app_get(
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "screenshot_encoder.h"
+
+#include <string.h>
+
+#define RLE_MAX_LITERAL (128)
+#define RLE_MIN_RUN (3)
+#define RLE_MAX_RUN (127 + RLE_MIN_RUN)
+
+static size_t prv_run_length(const uint8_t *src, size_t len) {
+  size_t run = 1;
+  while (run < len && run < RLE_MAX_RUN && src[run] == src[0]) {
+    run++;
+  }
+  return run;
+}
+
+size_t screenshot_rle_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_size) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < len) {
+    const size_t run = prv_run_length(&src[in], len - in);
+    if (run >= RLE_MIN_RUN) {
+      if (out + 2 > dst_size) {
+        return 0;
+      }
+      dst[out++] = 0x80 | (run - RLE_MIN_RUN);
+      dst[out++] = src[in];
+      in += run;
+      continue;
+    }
+
+    // Collect literals until the next run that is worth encoding
+    const size_t literal_start = in;
+    size_t literal_len = 0;
+    while (in < len && literal_len < RLE_MAX_LITERAL) {
+      if (in + 2 < len && src[in] == src[in + 1] && src[in] == src[in + 2]) {
+        break;
+      }
+      in++;
+      literal_len++;
+    }
+    if (out + 1 + literal_len > dst_size) {
+      return 0;
+    }
+    dst[out++] = literal_len - 1;
+    memcpy(&dst[out], &src[literal_start], literal_len);
+    out += literal_len;
+  }
+  return out;
+}
+
+static void prv_write_record_header(uint8_t *out, uint16_t row, uint16_t payload_len) {
+  out[0] = row >> 8;
+  out[1] = row & 0xff;
+  out[2] = payload_len >> 8;
+  out[3] = payload_len & 0xff;
+}
+
+size_t screenshot_encoder_write_row(uint16_t row, const uint8_t *data, size_t row_bytes,
+                                    bool rle, uint8_t *out) {
+  uint8_t *payload = &out[SCREENSHOT_ROW_RECORD_HEADER_SIZE];
+  // Only keep the compressed row if it is strictly shorter, that's how the decoder tells them apart
+  size_t payload_len = rle ? screenshot_rle_encode(data, row_bytes, payload, row_bytes - 1) : 0;
+  if (payload_len == 0) {
+    memcpy(payload, data, row_bytes);
+    payload_len = row_bytes;
+  }
+  prv_write_record_header(out, row, payload_len);
+  return SCREENSHOT_ROW_RECORD_HEADER_SIZE + payload_len;
+}
+
+size_t screenshot_encoder_write_end_of_frame(uint8_t *out) {
+  prv_write_record_header(out, SCREENSHOT_END_OF_FRAME_ROW, 0);
+  return SCREENSHOT_ROW_RECORD_HEADER_SIZE;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! @file screenshot_encoder.h
+//! Row records used by the encoded (version 3) screenshot format.
+//!
+//! An encoded screenshot is a sequence of row records terminated by an end-of-frame record.
+//! Each record is a big-endian uint16_t row index, a big-endian uint16_t payload length and the
+//! payload. A payload as long as the row is the raw row data, a shorter payload is the row
+//! compressed with the RLE scheme below. The end-of-frame record has a row index of
+//! SCREENSHOT_END_OF_FRAME_ROW and an empty payload.
+//!
+//! The RLE scheme is a PackBits variant: a control byte c < 128 is followed by c + 1 literal
+//! bytes, a control byte c >= 128 is followed by one byte which is repeated (c - 128) + 3 times.
+
+#define SCREENSHOT_END_OF_FRAME_ROW (0xffff)
+
+#define SCREENSHOT_ROW_RECORD_HEADER_SIZE (4)
+
+//! The most bytes screenshot_encoder_write_row() will write for a row of the given size
+#define SCREENSHOT_ROW_RECORD_MAX_SIZE(row_bytes) (SCREENSHOT_ROW_RECORD_HEADER_SIZE + (row_bytes))
+
+//! RLE compress a buffer.
+//! @return the number of bytes written, or 0 if the output wouldn't fit in dst_size bytes
+size_t screenshot_rle_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_size);
+
+//! Write the record for one row, compressing it if that makes it smaller.
+//! @param out must have room for SCREENSHOT_ROW_RECORD_MAX_SIZE(row_bytes) bytes
+//! @return the number of bytes written
+size_t screenshot_encoder_write_row(uint16_t row, const uint8_t *data, size_t row_bytes,
+                                    bool rle, uint8_t *out);
+
+//! Write the record that ends a frame.
+//! @param out must have room for SCREENSHOT_ROW_RECORD_HEADER_SIZE bytes
+//! @return the number of bytes written
+size_t screenshot_encoder_write_end_of_frame(uint8_t *out);
@@ -17,6 +17,7 @@
 #include "screenshot_pp.h"
 
 #include "compositor.h"
+#include "screenshot_encoder.h"
 
 #include "applib/graphics/framebuffer.h"
 #include "kernel/event_loop.h"
@@ -25,11 +26,22 @@
 #include "services/common/system_task.h"
 #include "system/logging.h"
 #include "util/attributes.h"
+#include "util/bitset.h"
+#include "util/math.h"
 #include "util/net.h"
 
+#include "FreeRTOS.h"
+
+#include <string.h>
+
 static const uint16_t SCREENSHOT_ENDPOINT_ID = 8000;
 static bool s_screenshot_in_progress = false;
 
+#define SCREENSHOT_ROW_BYTES (SCREEN_COLOR_DEPTH_BITS * DISP_COLS / 8)
+#define SCREENSHOT_ROW_BITSET_BYTES ((DISP_ROWS + 7) / 8)
+
+#define SCREENSHOT_ENCODED_VERSION (3)
+
 typedef enum {
   SCREENSHOT_OK = 0,
   SCREENSHOT_MALFORMED_COMMAND = 1,
@@ -37,12 +49,37 @@ typedef enum {
   SCREENSHOT_ALREADY_IN_PROGRESS = 3,
 } ScreenshotResponse;
 
+typedef enum {
+  //! Raw framebuffer, version 1 or 2 header
+  ScreenshotCommand_Legacy = 0x00,
+  //! Row records (see screenshot_encoder.h), version 3 header
+  ScreenshotCommand_Encoded = 0x01,
+} ScreenshotCommand;
+
+//! Sent as the second byte of ScreenshotCommand_Encoded and echoed back in the response header
+typedef enum {
+  //! RLE compress rows when that makes them smaller
+  ScreenshotFlag_RLE = 1 << 0,
+  //! Only send the rows that changed since the last frame sent to this session. In the response
+  //! this is cleared if the watch sent a full frame instead.
+  ScreenshotFlag_Delta = 1 << 1,
+} ScreenshotFlag;
+
 typedef struct FrameBufferState {
   FrameBuffer *fb;
   uint32_t row;
-  uint32_t col;
   uint32_t width;
   uint32_t height;
+  uint8_t flags;
+  bool encoded;
+  bool sent_end_of_frame;
+  //! Rows that go into an encoded frame, all of them unless it's a delta frame
+  uint8_t rows_to_send[SCREENSHOT_ROW_BITSET_BYTES];
+  //! Bytes of the current row or row record that haven't been sent yet
+  const uint8_t *pending;
+  uint32_t pending_length;
+  uint8_t *row_buffer;
+  uint8_t *record_buffer;
 } FrameBufferState;
 
 typedef struct ScreenshotState {
@@ -52,6 +89,11 @@ typedef struct ScreenshotState {
 } ScreenshotState;
 static ScreenshotState s_screenshot_state;
 
+//! Rows of the compositor framebuffer that changed since the last encoded screenshot
+static uint8_t s_dirty_rows[SCREENSHOT_ROW_BITSET_BYTES];
+//! The session that received the last complete encoded screenshot, delta frames build on it
+static CommSession *s_delta_base_session;
+
 typedef struct PACKED {
   uint8_t  response_code;
   uint32_t version;
@@ -59,6 +101,15 @@ typedef struct PACKED {
   uint32_t height;
 } ScreenshotHeader;
 
+typedef struct PACKED {
+  uint8_t  response_code;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint8_t  bits_per_pixel;
+  uint8_t  flags;
+} ScreenshotEncodedHeader;
+
 typedef struct ScreenshotErrorResponseData {
   CommSession *session;
   ScreenshotHeader header;
@@ -81,7 +132,23 @@ static void prv_send_error_response(CommSession *session, uint8_t response) {
       COMM_SESSION_DEFAULT_TIMEOUT);
 }
 
-static void prv_finish(ScreenshotState *state) {
+void screenshot_handle_session_closed(CommSession *session) {
+  if (session == s_delta_base_session) {
+    s_delta_base_session = NULL;
+  }
+}
+
+static void prv_finish(ScreenshotState *state, bool complete) {
+  FrameBufferState *fb_state = &state->framebuffer;
+  if (fb_state->encoded) {
+    // If the client didn't get the whole frame, the next delta has nothing to build on
+    s_delta_base_session = complete ? state->session : NULL;
+  }
+  kernel_free(fb_state->row_buffer);
+  kernel_free(fb_state->record_buffer);
+  fb_state->row_buffer = NULL;
+  fb_state->record_buffer = NULL;
+
   comm_session_set_responsiveness(state->session, BtConsumerPpScreenshot, ResponseTimeMax, 0);
   compositor_unfreeze();
   s_screenshot_in_progress = false;
@@ -92,55 +159,125 @@ static void prv_request_fast_connection(CommSession *session) {
                                   MIN_LATENCY_MODE_TIMEOUT_SCREENSHOT_SECS);
 }
 
-static uint32_t prv_framebuffer_next_chunk(FrameBufferState *restrict state,
-                                           uint32_t max_chunk_bytes, uint8_t *output_buffer) {
-  const uint32_t bytes_per_row = SCREEN_COLOR_DEPTH_BITS * DISP_COLS / 8;
-  const uint32_t cols_per_byte = DISP_COLS / bytes_per_row;
-
-  uint32_t remaining_chunk_bytes = max_chunk_bytes;
-  uint8_t *output_buffer_with_offset = output_buffer;
+static void prv_set_rows(uint8_t *row_bitset, int16_t y, int16_t h) {
+  const int16_t y_end = MIN(y + h, DISP_ROWS);
+  for (int16_t row = MAX(y, 0); row < y_end; row++) {
+    bitset8_set(row_bitset, row);
+  }
+}
 
-  while (remaining_chunk_bytes > 0 && state->row < state->height) {
-    const uint8_t *restrict framebuffer_row_data = (uint8_t *)framebuffer_get_line(state->fb,
-                                                                                   state->row);
-    const uint16_t framebuffer_current_column = state->col / cols_per_byte;
-    uint16_t remaining_framebuffer_row_bytes = bytes_per_row - framebuffer_current_column;
-    const bool framebuffer_row_is_larger_than_chunk =
-      (remaining_framebuffer_row_bytes > remaining_chunk_bytes);
-    if (framebuffer_row_is_larger_than_chunk) {
-      remaining_framebuffer_row_bytes = remaining_chunk_bytes;
-    }
+void screenshot_mark_rows_dirty(int16_t y, int16_t h) {
+  portENTER_CRITICAL();
+  prv_set_rows(s_dirty_rows, y, h);
+  portEXIT_CRITICAL();
+}
 
+//! Returns the data of a framebuffer row as it gets sent to the client
+static const uint8_t *prv_get_row(FrameBufferState *state, uint32_t row) {
+  const uint8_t *framebuffer_row_data = (uint8_t *)framebuffer_get_line(state->fb, row);
 #ifdef PLATFORM_SPALDING
-    const GBitmapDataRowInfoInternal *row_infos = g_gbitmap_spalding_data_row_infos;
-    const size_t framebuffer_row_min_pixel = row_infos[state->row].min_x;
-    const size_t framebuffer_row_max_pixel = row_infos[state->row].max_x;
-    for (uint32_t i = 0; i < remaining_framebuffer_row_bytes; i++) {
-      const uint32_t i_with_offset = i + framebuffer_current_column;
-      if (WITHIN(i_with_offset, framebuffer_row_min_pixel, framebuffer_row_max_pixel)) {
-        output_buffer_with_offset[i] = framebuffer_row_data[i_with_offset];
-      } else {
-        output_buffer_with_offset[i] = GColorClear.argb;
-      }
-    }
+  // Pixels outside of the round display aren't backed by the framebuffer
+  const GBitmapDataRowInfoInternal *row_infos = g_gbitmap_spalding_data_row_infos;
+  const GBitmapDataRowInfoInternal *row_info = &row_infos[row];
+  const uint32_t min_x = row_info->min_x;
+  const uint32_t max_x = MIN(row_info->max_x, SCREENSHOT_ROW_BYTES - 1);
+  uint8_t *row_buffer = state->row_buffer;
+  memset(row_buffer, GColorClear.argb, SCREENSHOT_ROW_BYTES);
+  if (min_x <= max_x) {
+    memcpy(&row_buffer[min_x], &framebuffer_row_data[min_x], max_x - min_x + 1);
+  }
+  return row_buffer;
 #else
-    memcpy(output_buffer_with_offset, framebuffer_row_data + framebuffer_current_column,
-           remaining_framebuffer_row_bytes);
+  return framebuffer_row_data;
 #endif
-    if (framebuffer_row_is_larger_than_chunk) {
-      state->col = remaining_chunk_bytes * cols_per_byte;
-    } else {
-      state->col = 0;
-      state->row++;
+}
+
+//! Queues up the next row (or row record) to be sent.
+//! @return false once the whole frame has been queued
+static bool prv_framebuffer_next_row(FrameBufferState *state) {
+  if (!state->encoded) {
+    if (state->row >= state->height) {
+      return false;
+    }
+    state->pending = prv_get_row(state, state->row);
+    state->pending_length = SCREENSHOT_ROW_BYTES;
+    state->row++;
+    return true;
+  }
+
+  while (state->row < state->height && !bitset8_get(state->rows_to_send, state->row)) {
+    state->row++;
+  }
+  if (state->row < state->height) {
+    state->pending_length = screenshot_encoder_write_row(
+        state->row, prv_get_row(state, state->row), SCREENSHOT_ROW_BYTES,
+        (state->flags & ScreenshotFlag_RLE), state->record_buffer);
+    state->row++;
+  } else if (!state->sent_end_of_frame) {
+    state->pending_length = screenshot_encoder_write_end_of_frame(state->record_buffer);
+    state->sent_end_of_frame = true;
+  } else {
+    return false;
+  }
+  state->pending = state->record_buffer;
+  return true;
+}
+
+static uint32_t prv_framebuffer_next_chunk(FrameBufferState *restrict state,
+                                           uint32_t max_chunk_bytes, uint8_t *output_buffer) {
+  uint32_t remaining_chunk_bytes = max_chunk_bytes;
+  uint8_t *output_buffer_with_offset = output_buffer;
+
+  while (remaining_chunk_bytes > 0) {
+    if (state->pending_length == 0 && !prv_framebuffer_next_row(state)) {
+      break;
     }
+    const uint32_t length = MIN(state->pending_length, remaining_chunk_bytes);
+    memcpy(output_buffer_with_offset, state->pending, length);
+    state->pending += length;
+    state->pending_length -= length;
 
-    remaining_chunk_bytes -= remaining_framebuffer_row_bytes;
-    output_buffer_with_offset += remaining_framebuffer_row_bytes;
+    remaining_chunk_bytes -= length;
+    output_buffer_with_offset += length;
   }
 
   return max_chunk_bytes - remaining_chunk_bytes;
 }
 
+static uint32_t prv_header_size(const ScreenshotState *state) {
+  return state->framebuffer.encoded ? sizeof(ScreenshotEncodedHeader) : sizeof(ScreenshotHeader);
+}
+
+static void prv_write_header(SendBuffer *sb, const ScreenshotState *state) {
+  const FrameBufferState *fb_state = &state->framebuffer;
+  if (fb_state->encoded) {
+    const ScreenshotEncodedHeader header = (const ScreenshotEncodedHeader) {
+      .response_code  = SCREENSHOT_OK,
+      .version        = htonl(SCREENSHOT_ENCODED_VERSION),
+      .width          = htonl(fb_state->width),
+      .height         = htonl(fb_state->height),
+      .bits_per_pixel = SCREEN_COLOR_DEPTH_BITS,
+      .flags          = fb_state->flags,
+    };
+    comm_session_send_buffer_write(sb, (const uint8_t *) &header, sizeof(header));
+    return;
+  }
+
+  const ScreenshotHeader header = (const ScreenshotHeader) {
+    .response_code = SCREENSHOT_OK,
+#if SCREEN_COLOR_DEPTH_BITS == 1
+    .version       = htonl(1),
+#elif SCREEN_COLOR_DEPTH_BITS == 8
+    .version       = htonl(2),
+#else
+#warning "Need SCREEN_COLOR_DEPTH_BITS for screenshot version."
+#endif
+    .width         = htonl(fb_state->width),
+    .height        = htonl(fb_state->height),
+  };
+  comm_session_send_buffer_write(sb, (const uint8_t *) &header, sizeof(header));
+}
+
 void screenshot_send_next_chunk(void* raw_state) {
   ScreenshotState* state = (ScreenshotState*)raw_state;
 
@@ -148,22 +285,25 @@ void screenshot_send_next_chunk(void* raw_state) {
   uint32_t max_buf_len = comm_session_send_buffer_get_max_payload_length(session);
   uint32_t session_len = 0;
   if (!state->sent_header) {
-    max_buf_len -= sizeof(ScreenshotHeader);
-    session_len += sizeof(ScreenshotHeader);
+    const uint32_t header_size = prv_header_size(state);
+    max_buf_len = (max_buf_len > header_size) ? max_buf_len - header_size : 0;
+    session_len += header_size;
   }
 
-  void *buffer = kernel_zalloc(max_buf_len);
-  if (!buffer) {
+  void *buffer = max_buf_len ? kernel_zalloc(max_buf_len) : NULL;
+  if (max_buf_len && !buffer) {
     PBL_LOG(LOG_LEVEL_WARNING, "Screenshot aborted, OOM.");
     prv_send_error_response(session, SCREENSHOT_OOM_ERROR);
-    prv_finish(state);
+    prv_finish(state, false /* complete */);
+    return;
   }
-  uint32_t len = prv_framebuffer_next_chunk(&state->framebuffer, max_buf_len, buffer);
+  uint32_t len = max_buf_len ? prv_framebuffer_next_chunk(&state->framebuffer, max_buf_len,
+                                                          buffer) : 0;
   session_len += len;
 
-  if (len == 0) {
+  if (max_buf_len && len == 0) {
     kernel_free(buffer);
-    prv_finish(state);
+    prv_finish(state, true /* complete */);
     return;
   }
 
@@ -172,31 +312,17 @@ void screenshot_send_next_chunk(void* raw_state) {
       !(sb = comm_session_send_buffer_begin_write(session, SCREENSHOT_ENDPOINT_ID,
                                                   session_len, COMM_SESSION_DEFAULT_TIMEOUT))) {
     PBL_LOG(LOG_LEVEL_WARNING, "Terminating screenshot send early: %"PRIu32, max_buf_len);
-    prv_finish(state);
+    kernel_free(buffer);
+    prv_finish(state, false /* complete */);
     return;
   }
 
-  if (state->sent_header) {
-    comm_session_send_buffer_write(sb, buffer, len);
-  } else {
-    const ScreenshotHeader header = (const ScreenshotHeader) {
-      .response_code = SCREENSHOT_OK,
-#if SCREEN_COLOR_DEPTH_BITS == 1
-      .version       = htonl(1),
-#elif SCREEN_COLOR_DEPTH_BITS == 8
-      .version       = htonl(2),
-#else
-#warning "Need SCREEN_COLOR_DEPTH_BITS for screenshot version."
-#endif
-      .width         = htonl(state->framebuffer.width),
-      .height        = htonl(state->framebuffer.height),
-    };
-    comm_session_send_buffer_write(sb, (const uint8_t *) &header, sizeof(header));
-    // Fill the rest of this packet with image data.
-    comm_session_send_buffer_write(sb, buffer, len);
-
+  if (!state->sent_header) {
+    prv_write_header(sb, state);
     state->sent_header = true;
   }
+  // Fill the rest of this packet with image data.
+  comm_session_send_buffer_write(sb, buffer, len);
   comm_session_send_buffer_end_write(sb);
 
   kernel_free(buffer);
@@ -206,9 +332,42 @@ void screenshot_send_next_chunk(void* raw_state) {
   system_task_add_callback(screenshot_send_next_chunk, state);
 }
 
+//! Sets up an encoded frame. Delta frames only carry the rows that changed since the frame the
+//! client got last, anything else falls back to sending every row.
+static bool prv_init_encoded_frame(CommSession *session, uint8_t flags, FrameBufferState *state) {
+  state->encoded = true;
+  state->record_buffer = kernel_malloc(SCREENSHOT_ROW_RECORD_MAX_SIZE(SCREENSHOT_ROW_BYTES));
+  if (!state->record_buffer) {
+    return false;
+  }
+
+  const bool delta = (flags & ScreenshotFlag_Delta) && (session == s_delta_base_session);
+  state->flags = flags & (ScreenshotFlag_RLE | (delta ? ScreenshotFlag_Delta : 0));
+  // The compositor keeps marking rows while it flushes, take them and start over in one go so
+  // that none get lost in between
+  portENTER_CRITICAL();
+  if (delta) {
+    memcpy(state->rows_to_send, s_dirty_rows, sizeof(s_dirty_rows));
+  }
+  memset(s_dirty_rows, 0, sizeof(s_dirty_rows));
+  portEXIT_CRITICAL();
+
+  if (delta) {
+    // Rows that have been drawn but haven't made it to the display yet
+    if (state->fb->is_dirty) {
+      prv_set_rows(state->rows_to_send, state->fb->dirty_rect.origin.y,
+                   state->fb->dirty_rect.size.h);
+    }
+  } else {
+    memset(state->rows_to_send, 0xff, sizeof(state->rows_to_send));
+  }
+  return true;
+}
+
 void screenshot_protocol_msg_callback(CommSession *session, const uint8_t* msg_data, unsigned int msg_len) {
-  uint8_t sub_command = msg_data[0];
-  if (sub_command != 0x00) {
+  uint8_t sub_command = (msg_len > 0) ? msg_data[0] : 0xff;
+  if (!(sub_command == ScreenshotCommand_Legacy ||
+        (sub_command == ScreenshotCommand_Encoded && msg_len >= 2))) {
     PBL_LOG(LOG_LEVEL_ERROR, "first byte can't be %u", sub_command);
     prv_send_error_response(session, SCREENSHOT_MALFORMED_COMMAND);
     return;
@@ -232,12 +391,27 @@ void screenshot_protocol_msg_callback(CommSession *session, const uint8_t* msg_d
     .framebuffer =  (FrameBufferState) {
       .fb = compositor_get_framebuffer(),
       .row = 0,
-      .col = 0,
       .width = DISP_COLS,
       .height = DISP_ROWS,
     },
     .sent_header = false,
   };
 
+  FrameBufferState *fb_state = &s_screenshot_state.framebuffer;
+  bool success = true;
+#ifdef PLATFORM_SPALDING
+  fb_state->row_buffer = kernel_malloc(SCREENSHOT_ROW_BYTES);
+  success = (fb_state->row_buffer != NULL);
+#endif
+  if (success && sub_command == ScreenshotCommand_Encoded) {
+    success = prv_init_encoded_frame(session, msg_data[1], fb_state);
+  }
+  if (!success) {
+    PBL_LOG(LOG_LEVEL_WARNING, "Screenshot aborted, OOM.");
+    prv_send_error_response(session, SCREENSHOT_OOM_ERROR);
+    prv_finish(&s_screenshot_state, false /* complete */);
+    return;
+  }
+
   screenshot_send_next_chunk(&s_screenshot_state);
 }
@@ -21,3 +21,11 @@
 
 //! Callback for handling a screenshot request message from the client
 void screenshot_protocol_msg_callback(CommSession *session, const uint8_t* data, unsigned int length);
+
+//! Record that rows of the compositor framebuffer are about to change on the display, so the next
+//! delta screenshot includes them
+void screenshot_mark_rows_dirty(int16_t y, int16_t h);
+
+//! Forget any delta screenshot state tied to a session that is closing, so a later session can't
+//! receive a delta against a frame it never got
+void screenshot_handle_session_closed(CommSession *session);
@@ -21,22 +21,34 @@
 #include "process_management/app_manager.h"
 #include "process_management/worker_manager.h"
 #include "os/mutex.h"
+#include "services/common/analytics/analytics.h"
 #include "services/common/event_service.h"
 #include "syscall/syscall_internal.h"
 #include "syscall/syscall.h"
 #include "system/logging.h"
 #include "system/passert.h"
+#include "util/math.h"
 
 #include "FreeRTOS.h"
 #include "queue.h"
 
 #include <string.h>
 
+typedef struct {
+  //! Tasks that have an event of this type waiting in their queue. Newer events get folded into
+  //! events[task] until the task dequeues it and picks them up with
+  //! sys_event_service_get_coalesced().
+  PebbleTaskBitset pending;
+  PebbleEvent events[NumPebbleTask];
+} EventServiceCoalesceState;
+
 typedef struct {
   int num_subscribers;
   QueueHandle_t subscribers[NumPebbleTask];
   EventServiceAddSubscriberCallback add_subscriber_callback;
   EventServiceRemoveSubscriberCallback remove_subscriber_callback;
+  //! Only allocated for event types with a coalescing policy
+  EventServiceCoalesceState *coalesce;
 } EventServiceEntry;
 
 typedef struct {
@@ -67,6 +79,55 @@ static PebbleMutex *s_plugin_list_mutex = NULL;
 // System apps can also use the service
 static EventServiceEntry *s_event_services[PEBBLE_NUM_EVENTS];
 
+// Most events seen waiting in each task's event queue, reset every time analytics are collected
+static uint16_t s_queue_high_water_marks[NumPebbleTask];
+static uint32_t s_num_coalesced_events;
+
+EventServiceCoalescePolicy event_service_get_coalesce_policy(PebbleEventType type) {
+  switch (type) {
+    // Subscribers only care about the current time / state, not about every change on the way
+    case PEBBLE_TICK_EVENT:
+    case PEBBLE_BATTERY_CONNECTION_EVENT:
+    case PEBBLE_BATTERY_STATE_CHANGE_EVENT:
+    case PEBBLE_COMPASS_DATA_EVENT:
+      return EventServiceCoalescePolicy_LatestValue;
+
+    case PEBBLE_CAPABILITIES_CHANGED_EVENT:
+      return EventServiceCoalescePolicy_CounterMerge;
+
+    default:
+      return EventServiceCoalescePolicy_None;
+  }
+}
+
+static void prv_merge_event(PebbleEvent *pending, const PebbleEvent *e) {
+  switch (event_service_get_coalesce_policy(e->type)) {
+    case EventServiceCoalescePolicy_LatestValue:
+      *pending = *e;
+      break;
+
+    case EventServiceCoalescePolicy_CounterMerge:
+      if (e->type == PEBBLE_CAPABILITIES_CHANGED_EVENT) {
+        // Every capability that changed in either event has changed since the last delivery
+        pending->capabilities.flags_diff.flags |= e->capabilities.flags_diff.flags;
+      } else {
+        WTF;
+      }
+      break;
+
+    case EventServiceCoalescePolicy_None:
+      WTF;
+  }
+}
+
+static void prv_clear_pending(EventServiceEntry *service, PebbleTask task) {
+  if (service->coalesce) {
+    portENTER_CRITICAL();
+    service->coalesce->pending &= ~(1 << task);
+    portEXIT_CRITICAL();
+  }
+}
+
 static void prv_event_service_unsubscribe(PebbleSubscriptionEvent *subscription) {
   EventServiceEntry *service = s_event_services[subscription->event_type];
 
@@ -143,6 +204,9 @@ void event_service_clear_process_subscriptions(PebbleTask task) {
     if ((service = s_event_services[i]) == NULL) {
       continue;
     }
+    // The process' event queue goes away with it, and with it any event that newer ones would
+    // have been folded into
+    prv_clear_pending(service, task);
     if (service->subscribers[task] == NULL) {
       continue;
     }
@@ -164,6 +228,7 @@ void event_service_init(PebbleEventType type, EventServiceAddSubscriberCallback
     EventServiceRemoveSubscriberCallback remove_subscriber_callback) {
   if(s_event_services[type] != NULL) {
     // an event service was already inited, free it
+    kernel_free(s_event_services[type]->coalesce);
     kernel_free(s_event_services[type]);
   }
 
@@ -171,6 +236,9 @@ void event_service_init(PebbleEventType type, EventServiceAddSubscriberCallback
   memset(s_event_services[type], 0, sizeof(*s_event_services[type]));
   s_event_services[type]->add_subscriber_callback = add_subscriber_callback;
   s_event_services[type]->remove_subscriber_callback = remove_subscriber_callback;
+  if (event_service_get_coalesce_policy(type) != EventServiceCoalescePolicy_None) {
+    s_event_services[type]->coalesce = kernel_zalloc_check(sizeof(EventServiceCoalesceState));
+  }
 }
 
 bool event_service_is_running(PebbleEventType event_type) {
@@ -212,6 +280,61 @@ static bool prv_steal_buffer(void *buf, EventServiceEntry *service, PebbleEvent
   }
 }
 
+//! @return true if the event got folded into one that is still waiting in the task's queue
+static bool prv_coalesce_into_pending(EventServiceEntry *service, PebbleTask task,
+                                      PebbleEvent *e) {
+  EventServiceCoalesceState *coalesce = service->coalesce;
+  if (!coalesce) {
+    return false;
+  }
+
+  const PebbleTaskBitset task_bit = (1 << task);
+  bool coalesced;
+  portENTER_CRITICAL();
+  coalesced = (coalesce->pending & task_bit);
+  if (coalesced) {
+    prv_merge_event(&coalesce->events[task], e);
+  } else {
+    // The copy we are about to queue becomes the pending event for newer ones to fold into
+    coalesce->events[task] = *e;
+    coalesce->pending |= task_bit;
+  }
+  portEXIT_CRITICAL();
+
+  if (coalesced) {
+    ++s_num_coalesced_events;
+  }
+  return coalesced;
+}
+
+static void prv_send_event_to_task(EventServiceEntry *service, PebbleTask task, PebbleEvent *e) {
+  if (prv_coalesce_into_pending(service, task, e)) {
+    return;
+  }
+
+  QueueHandle_t queue = service->subscribers[task];
+  if (prv_event_service_send_event(queue, e)) {
+    s_queue_high_water_marks[task] = MAX(s_queue_high_water_marks[task],
+                                         uxQueueMessagesWaiting(queue));
+    return;
+  }
+
+  prv_clear_pending(service, task);
+  PBL_LOG(LOG_LEVEL_INFO, "Queue full! %d not delivered to task %d!", (int)e->type, (int)task);
+#if !RELEASE
+  // For 3rd party apps, just close them. For a 1st party app or other task, reboot
+  // the watch
+  if (task == PebbleTask_App && app_manager_get_current_app_md()->is_unprivileged) {
+    app_manager_close_current_app(false);
+  } else if (task == PebbleTask_Worker &&
+             worker_manager_get_current_worker_md()->is_unprivileged) {
+    worker_manager_close_current_worker(false);
+  } else {
+    PBL_ASSERTN(0);
+  }
+#endif
+}
+
 void event_service_handle_event(PebbleEvent *e) {
   EventServiceEntry *service = s_event_services[e->type];
   if (service == NULL) {
@@ -232,22 +355,7 @@ void event_service_handle_event(PebbleEvent *e) {
         // because handling it inline could modify the event
         continue;
       } else {
-        if (!prv_event_service_send_event(service->subscribers[i], e)) {
-          PBL_LOG(LOG_LEVEL_INFO, "Queue full! %d not delivered to task %d!",
-                  (int)e->type, (int)i);
-#if !RELEASE
-          // For 3rd party apps, just close them. For a 1st party app or other task, reboot
-          // the watch
-          if (i == PebbleTask_App && app_manager_get_current_app_md()->is_unprivileged) {
-            app_manager_close_current_app(false);
-          } else if (i == PebbleTask_Worker &&
-                     worker_manager_get_current_worker_md()->is_unprivileged) {
-            worker_manager_close_current_worker(false);
-          } else {
-            PBL_ASSERTN(0);
-          }
-#endif
-        }
+        prv_send_event_to_task(service, i, e);
       }
     }
   }
@@ -393,3 +501,49 @@ DEFINE_SYSCALL(void, sys_event_service_cleanup, PebbleEvent *e) {
     }
   }
 }
+
+DEFINE_SYSCALL(void, sys_event_service_get_coalesced, PebbleEvent *e) {
+  if (PRIVILEGE_WAS_ELEVATED) {
+    syscall_assert_userspace_buffer(e, sizeof(PebbleEvent));
+  }
+
+  if (e->type >= PEBBLE_NUM_EVENTS) {
+    return;
+  }
+  EventServiceEntry *service = s_event_services[e->type];
+  if (!service || !service->coalesce) {
+    return;
+  }
+
+  const PebbleTask task = pebble_task_get_current();
+  const PebbleTaskBitset task_bit = (1 << task);
+  PebbleEvent latest;
+  bool pending;
+  portENTER_CRITICAL();
+  pending = (service->coalesce->pending & task_bit);
+  if (pending) {
+    latest = service->coalesce->events[task];
+    service->coalesce->pending &= ~task_bit;
+  }
+  portEXIT_CRITICAL();
+
+  if (pending) {
+    *e = latest;
+  }
+}
+
+uint16_t event_service_get_queue_high_water_mark(PebbleTask task) {
+  return s_queue_high_water_marks[task];
+}
+
+void analytics_external_collect_event_service_stats(void) {
+  analytics_set(ANALYTICS_DEVICE_METRIC_EVENT_QUEUE_HIGH_WATER_MARK_APP,
+                s_queue_high_water_marks[PebbleTask_App], AnalyticsClient_System);
+  analytics_set(ANALYTICS_DEVICE_METRIC_EVENT_QUEUE_HIGH_WATER_MARK_WORKER,
+                s_queue_high_water_marks[PebbleTask_Worker], AnalyticsClient_System);
+  analytics_set(ANALYTICS_DEVICE_METRIC_EVENT_COALESCED_COUNT, s_num_coalesced_events,
+                AnalyticsClient_System);
+
+  memset(s_queue_high_water_marks, 0, sizeof(s_queue_high_water_marks));
+  s_num_coalesced_events = 0;
+}
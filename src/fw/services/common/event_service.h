@@ -22,6 +22,18 @@
 typedef void (*EventServiceAddSubscriberCallback)(PebbleTask task);
 typedef void (*EventServiceRemoveSubscriberCallback)(PebbleTask task);
 
+//! How an event that is still waiting in a subscriber's queue gets combined with newer events of
+//! the same type, instead of queueing one copy per event.
+typedef enum {
+  //! Every event is queued for every subscriber
+  EventServiceCoalescePolicy_None = 0,
+  //! Only the current state matters, the pending event is overwritten with the newest one
+  EventServiceCoalescePolicy_LatestValue,
+  //! The event describes a change since the previous one, so the newer event's counters / flags
+  //! are accumulated into the pending one
+  EventServiceCoalescePolicy_CounterMerge,
+} EventServiceCoalescePolicy;
+
 //! Call once during system startup
 void event_service_system_init(void);
 
@@ -42,3 +54,11 @@ void event_service_clear_process_subscriptions(PebbleTask task);
 void* event_service_claim_buffer(PebbleEvent *e);
 //! This function expects the pointer returned by event_service_claim_buffer
 void event_service_free_claimed_buffer(void *ref);
+
+//! Returns the coalescing policy of an event type. Events of a type with a policy other than
+//! EventServiceCoalescePolicy_None must not carry a buffer (see event_get_buffer()).
+EventServiceCoalescePolicy event_service_get_coalesce_policy(PebbleEventType type);
+
+//! Returns the highest number of events seen waiting in the task's event queue since the last
+//! time the analytics were collected
+uint16_t event_service_get_queue_high_water_mark(PebbleTask task);
@@ -61,15 +61,33 @@ static bool s_hrm_present = false;
 static void prv_update_enable_timer_cb(void *context);
 
 
-static bool prv_match_session_ref(ListNode *found_node, void *data) {
-  const HRMSubscriberState *state = (HRMSubscriberState *)found_node;
-  return (state->session_ref == (HRMSessionRef)data);
+static HRMSubscriberState **prv_session_table_bucket(HRMSessionRef session) {
+  return &s_manager_state.session_table[session % HRM_MANAGER_SESSION_TABLE_SIZE];
+}
+
+static void prv_session_table_add(HRMSubscriberState *state) {
+  HRMSubscriberState **bucket = prv_session_table_bucket(state->session_ref);
+  state->next_in_bucket = *bucket;
+  *bucket = state;
+}
+
+static void prv_session_table_remove(HRMSubscriberState *state) {
+  HRMSubscriberState **link = prv_session_table_bucket(state->session_ref);
+  while (*link) {
+    if (*link == state) {
+      *link = state->next_in_bucket;
+      return;
+    }
+    link = &(*link)->next_in_bucket;
+  }
 }
 
 T_STATIC HRMSubscriberState * prv_get_subscriber_state_from_ref(HRMSessionRef session) {
-  ListNode *node = list_find(s_manager_state.subscribers, prv_match_session_ref,
-                             (void *)(uintptr_t)session);
-  return (HRMSubscriberState *)node;
+  HRMSubscriberState *state = *prv_session_table_bucket(session);
+  while (state && state->session_ref != session) {
+    state = state->next_in_bucket;
+  }
+  return state;
 }
 
 
@@ -127,6 +145,8 @@ T_STATIC void prv_read_event_from_buffer_and_consume(CircularBuffer *buffer,
 
 static void prv_remove_and_free_subscription(HRMSubscriberState *state) {
   list_remove((ListNode *)state, &s_manager_state.subscribers, NULL);
+  prv_session_table_remove(state);
+  kernel_free(state->batch_events);
   kernel_free(state);
 }
 
@@ -348,7 +368,7 @@ static void prv_update_hrm_enable_system_cb(void *unused) {
 
 // Timer callback that we use to re-enable the HR sensor in case we turned it off for a while
 static void prv_update_enable_timer_cb(void *context) {
-  system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+  system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
 }
 
 //! The system task needs its own handler for HRM data since we can't queue up generic events.
@@ -466,9 +486,101 @@ static void prv_populate_hrm_event(PebbleHRMEvent *event, HRMFeature feature, co
   }
 }
 
+// How many events a batched subscriber accumulates in one update interval, plus room for a
+// HRMEvent_SubscriptionExpiring event
+static uint16_t prv_batch_capacity(uint32_t update_interval_s, HRMFeature features) {
+  const uint32_t samples_per_batch = MAX(update_interval_s, 1);
+  const uint32_t events_per_sample = __builtin_popcount(features);
+  return MIN(samples_per_batch * events_per_sample + 1, HRM_MANAGER_MAX_BATCH_EVENTS);
+}
+
+// Resize the batch buffer after the update interval or features changed, keeping the newest
+// events that still fit
+static void prv_batch_resize(HRMSubscriberState *state) {
+  const uint16_t capacity = prv_batch_capacity(state->update_interval_s, state->features);
+  if (capacity == state->batch_capacity) {
+    return;
+  }
+  PebbleHRMEvent *events = kernel_malloc_check(capacity * sizeof(PebbleHRMEvent));
+  const uint16_t num_kept = MIN(state->batch_count, capacity);
+  if (num_kept) {
+    memcpy(events, &state->batch_events[state->batch_count - num_kept],
+           num_kept * sizeof(PebbleHRMEvent));
+  }
+  kernel_free(state->batch_events);
+  state->batch_events = events;
+  state->batch_capacity = capacity;
+  state->batch_count = num_kept;
+}
+
+static void prv_batch_append(HRMSubscriberState *state, const PebbleHRMEvent *event) {
+  if (state->batch_count == state->batch_capacity) {
+    // KernelBG hasn't picked up the batch yet, make room by dropping the oldest event
+    memmove(&state->batch_events[0], &state->batch_events[1],
+            (state->batch_count - 1) * sizeof(PebbleHRMEvent));
+    --state->batch_count;
+    ++s_manager_state.dropped_events;
+  }
+  if (state->batch_count == 0) {
+    state->batch_start_ticks = rtc_get_ticks();
+  }
+  state->batch_events[state->batch_count++] = *event;
+
+  // Don't hold back an expiring event, the subscriber may want to renew in time
+  if (event->event_type == HRMEvent_SubscriptionExpiring) {
+    state->batch_ready = true;
+  }
+}
+
+// Return true if this subscriber's batch covers a full update interval or can't take another
+// reading
+static bool prv_batch_is_due(const HRMSubscriberState *state, RtcTicks cur_ticks) {
+  if (state->batch_count == 0) {
+    return false;
+  }
+  const RtcTicks interval_ticks = milliseconds_to_ticks(state->update_interval_s * MS_PER_SECOND);
+  const RtcTicks covered_ticks = cur_ticks - state->batch_start_ticks
+      + milliseconds_to_ticks(HRM_MANAGER_SAMPLE_PERIOD_MS);
+  const uint16_t events_per_sample = __builtin_popcount(state->features);
+  return (covered_ticks >= interval_ticks) ||
+         (state->batch_count + events_per_sample > state->batch_capacity);
+}
+
+//! Delivers the batches of all batched subscribers that are due. Runs on KernelBG.
+//! Each batch is copied out and the lock released before its callback runs, because a subscriber
+//! that renews or unsubscribes from the callback resizes or frees its batch buffer.
+static void prv_system_task_batch_handler(void *unused) {
+  while (true) {
+    mutex_lock_recursive(s_manager_state.lock);
+    HRMSubscriberState *state = (HRMSubscriberState *)s_manager_state.subscribers;
+    while (state && !(state->batch_handler && state->batch_ready)) {
+      state = (HRMSubscriberState *)state->list_node.next;
+    }
+    if (!state) {
+      mutex_unlock_recursive(s_manager_state.lock);
+      return;
+    }
+    const HRMSubscriberBatchCallback batch_handler = state->batch_handler;
+    void *callback_context = state->callback_context;
+    const uint16_t num_events = state->batch_count;
+    PebbleHRMEvent *events = kernel_malloc_check(num_events * sizeof(PebbleHRMEvent));
+    memcpy(events, state->batch_events, num_events * sizeof(PebbleHRMEvent));
+    state->batch_count = 0;
+    state->batch_ready = false;
+    mutex_unlock_recursive(s_manager_state.lock);
+
+    batch_handler(events, num_events, callback_context);
+    kernel_free(events);
+  }
+}
+
 static bool prv_event_put(HRMSubscriberState *state, PebbleHRMEvent *event) {
     bool success;
-    if (state->queue) {
+    if (state->batch_handler) {
+      // Delivered with the rest of the batch, see prv_system_task_batch_handler
+      prv_batch_append(state, event);
+      success = true;
+    } else if (state->queue) {
       PebbleEvent e = {
         .type = PEBBLE_HRM_EVENT,
         .hrm = *event,
@@ -489,7 +601,7 @@ T_STATIC void prv_charger_event_cb(PebbleEvent *e, void *context) {
   }
   mutex_unlock_recursive(s_manager_state.lock);
 
-  system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+  system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
 }
 
 // Accept new data from the HR device driver.
@@ -516,6 +628,7 @@ void hrm_manager_new_data_cb(const HRMData *data) {
   time_t utc_now = rtc_get_time();
   RtcTicks cur_ticks = rtc_get_ticks();
   HRMFeature kernel_bg_features_sent = 0;
+  bool batch_ready = false;
 
   HRMSubscriberState *state = (HRMSubscriberState *)s_manager_state.subscribers;
   while (state) {
@@ -561,6 +674,11 @@ void hrm_manager_new_data_cb(const HRMData *data) {
       state->sent_expiration_event = true;
     }
 
+    if (state->batch_handler && !state->batch_ready && prv_batch_is_due(state, cur_ticks)) {
+      state->batch_ready = true;
+    }
+    batch_ready |= state->batch_ready;
+
     if (state->expire_utc && (utc_now >= state->expire_utc)) {
       // This subscription has expired
       expired_state = state;
@@ -574,19 +692,24 @@ void hrm_manager_new_data_cb(const HRMData *data) {
     }
   }
 
+  // Wake up KernelBG once for all of the batched subscribers that are due
+  if (batch_ready) {
+    system_task_add_callback_coalesced(prv_system_task_batch_handler, NULL);
+  }
+
   // Update the HRM enable state. If no subscribers need an update for a while, we can turn off the
   // HR sensor and set a timer to turn it on again later. To avoid this overhead on every callback,
   // we only check it once every HRM_CHECK_SENSOR_DISABLE_COUNT times
   if (++s_manager_state.check_disable_counter >= HRM_CHECK_SENSOR_DISABLE_COUNT) {
     s_manager_state.check_disable_counter = 0;
-    system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+    system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
   }
 unlock:
   mutex_unlock_recursive(s_manager_state.lock);
 }
 
 void hrm_manager_handle_prefs_changed(void) {
-  system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+  system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
 }
 
 void hrm_manager_init(void) {
@@ -607,18 +730,17 @@ void hrm_manager_init(void) {
   event_service_client_subscribe(&s_manager_state.charger_subscription);
 }
 
-HRMSessionRef hrm_manager_subscribe_with_callback(AppInstallId app_id, uint32_t update_interval_s,
-                                                  uint16_t expire_s, HRMFeature features,
-                                                  HRMSubscriberCallback callback, void *context) {
-  if (!s_hrm_present) {
-    return HRM_INVALID_SESSION_REF;
-  }
-
+// Adds a new subscriber for the current task. Assumes that s_manager_state.lock is held
+static HRMSubscriberState *prv_add_subscriber(AppInstallId app_id, uint32_t update_interval_s,
+                                              uint16_t expire_s, HRMFeature features,
+                                              HRMSubscriberCallback callback,
+                                              HRMSubscriberBatchCallback batch_callback,
+                                              void *context) {
   const PebbleTask current_task = pebble_task_get_current();
   bool is_app_subscription = false;
   if (current_task == PebbleTask_KernelBackground) {
     // KernelBG must provide a callback
-    PBL_ASSERTN(callback != NULL);
+    PBL_ASSERTN(callback != NULL || batch_callback != NULL);
   } else if (current_task == PebbleTask_KernelMain) {
     // KernelMain clients can either set a callback, or use the event_service interface.
   } else {
@@ -626,7 +748,6 @@ HRMSessionRef hrm_manager_subscribe_with_callback(AppInstallId app_id, uint32_t
     is_app_subscription = true;
   }
 
-  mutex_lock_recursive(s_manager_state.lock);
   HRMSessionRef session_ref = HRM_INVALID_SESSION_REF;
 
   // If there is already an existing subscription for this app, remove the old one before we
@@ -653,18 +774,52 @@ HRMSessionRef hrm_manager_subscribe_with_callback(AppInstallId app_id, uint32_t
     .queue = pebble_task_get_to_queue(current_task),
     .callback_handler = callback,
     .callback_context = context,
+    .batch_handler = batch_callback,
     .update_interval_s = update_interval_s,
     .expire_utc = (expire_s != 0) ? (rtc_get_time() + expire_s) : 0,
     .features = features,
   };
   s_manager_state.subscribers =
     list_insert_before(s_manager_state.subscribers, &state->list_node);
+  prv_session_table_add(state);
 
   // Update the HR enablement state
-  system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+  system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
+  return state;
+}
+
+HRMSessionRef hrm_manager_subscribe_with_callback(AppInstallId app_id, uint32_t update_interval_s,
+                                                  uint16_t expire_s, HRMFeature features,
+                                                  HRMSubscriberCallback callback, void *context) {
+  if (!s_hrm_present) {
+    return HRM_INVALID_SESSION_REF;
+  }
 
+  mutex_lock_recursive(s_manager_state.lock);
+  HRMSubscriberState *state = prv_add_subscriber(app_id, update_interval_s, expire_s, features,
+                                                 callback, NULL, context);
+  const HRMSessionRef session_ref = state->session_ref;
   mutex_unlock_recursive(s_manager_state.lock);
-  return state->session_ref;
+  return session_ref;
+}
+
+HRMSessionRef hrm_manager_subscribe_batched(AppInstallId app_id, uint32_t update_interval_s,
+                                            uint16_t expire_s, HRMFeature features,
+                                            HRMSubscriberBatchCallback callback, void *context) {
+  if (!s_hrm_present) {
+    return HRM_INVALID_SESSION_REF;
+  }
+  PBL_ASSERT_TASK(PebbleTask_KernelBackground);
+  // Diagnostics events own a heap allocated buffer, these aren't worth keeping around
+  PBL_ASSERTN(!(features & HRMFeature_Diagnostics));
+
+  mutex_lock_recursive(s_manager_state.lock);
+  HRMSubscriberState *state = prv_add_subscriber(app_id, update_interval_s, expire_s, features,
+                                                 NULL, callback, context);
+  prv_batch_resize(state);
+  const HRMSessionRef session_ref = state->session_ref;
+  mutex_unlock_recursive(s_manager_state.lock);
+  return session_ref;
 }
 
 DEFINE_SYSCALL(HRMSessionRef, sys_hrm_manager_app_subscribe,
@@ -682,7 +837,7 @@ DEFINE_SYSCALL(bool, sys_hrm_manager_unsubscribe, HRMSessionRef session) {
   HRMSubscriberState *state = prv_get_subscriber_state_from_ref(session);
   if (state) {
     prv_remove_and_free_subscription(state);
-    system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+    system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
     success = true;
   }
 
@@ -735,8 +890,11 @@ DEFINE_SYSCALL(bool, sys_hrm_manager_set_features, HRMSessionRef session, HRMFea
   bool success = false;
   mutex_lock_recursive(s_manager_state.lock);
   HRMSubscriberState *state = prv_get_subscriber_state_from_ref(session);
-  if (state) {
+  if (state && !(state->batch_handler && (features & HRMFeature_Diagnostics))) {
     state->features = features;
+    if (state->batch_handler) {
+      prv_batch_resize(state);
+    }
     success = true;
   }
   mutex_unlock_recursive(s_manager_state.lock);
@@ -753,9 +911,12 @@ DEFINE_SYSCALL(bool, sys_hrm_manager_set_update_interval, HRMSessionRef session,
     state->update_interval_s = update_interval_s;
     state->expire_utc = (expire_s != 0) ? (rtc_get_time() + expire_s) : 0;
     state->sent_expiration_event = false;
+    if (state->batch_handler) {
+      prv_batch_resize(state);
+    }
     success = true;
   }
-  system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+  system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
   mutex_unlock_recursive(s_manager_state.lock);
   return success;
 }
@@ -767,7 +928,7 @@ DEFINE_SYSCALL(bool, sys_hrm_manager_is_hrm_present) {
 void hrm_manager_enable(bool on) {
   mutex_lock_recursive(s_manager_state.lock);
   s_manager_state.enabled_run_level = on;
-  system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+  system_task_add_callback_coalesced(prv_update_hrm_enable_system_cb, NULL);
   mutex_unlock_recursive(s_manager_state.lock);
 }
 
@@ -32,6 +32,12 @@
 
 typedef void (*HRMSubscriberCallback)(PebbleHRMEvent *event, void *context);
 
+//! Callback for batched subscribers, see \ref hrm_manager_subscribe_batched
+//! @param events the events accumulated since the last batch, oldest first
+//! @param num_events the number of events in the array
+typedef void (*HRMSubscriberBatchCallback)(const PebbleHRMEvent *events, uint32_t num_events,
+                                           void *context);
+
 // We need roughly this many seconds of "spin up" time to get a good reading from the HR sensor
 // right after turning it on
 #define HRM_SENSOR_SPIN_UP_SEC 20
@@ -43,6 +49,7 @@ typedef struct AccelServiceState AccelServiceState;
 
 typedef struct HRMSubscriberState {
   ListNode list_node;
+  struct HRMSubscriberState *next_in_bucket; // Next subscriber in the same session table bucket
   HRMSessionRef session_ref;  // The session ref assigned to this subscriber
   AppInstallId app_id;        // The subscriber's app_id
   PebbleTask task;            // The subscriber's task
@@ -57,8 +64,26 @@ typedef struct HRMSubscriberState {
   HRMFeature features;        // what features the subscriber is interested in
 
   RtcTicks last_valid_ticks; // tick count the last time this subscriber received valid HR reading
+
+  // Only used for batched KernelBG subscribers
+  HRMSubscriberBatchCallback batch_handler;
+  PebbleHRMEvent *batch_events; // events accumulated since the last batch was delivered
+  uint16_t batch_capacity;
+  uint16_t batch_count;
+  RtcTicks batch_start_ticks;   // tick count when the oldest event in the batch was added
+  bool batch_ready;             // true while the batch waits for KernelBG to deliver it
 } HRMSubscriberState;
 
+// The HR sensor driver provides new data about once a second
+#define HRM_MANAGER_SAMPLE_PERIOD_MS (1000)
+
+// Batched subscribers can accumulate at most this many events, about a minute's worth of
+// BPM and HRV readings
+#define HRM_MANAGER_MAX_BATCH_EVENTS (120)
+
+// Number of buckets in the session-indexed subscriber table
+#define HRM_MANAGER_SESSION_TABLE_SIZE (8)
+
 // HRM manager expects to be update at 1Hz. To the system task, we can currently
 // expect up to 2 events / second. 8 items in the queue allows for up to a 4s stall if subscribed
 // to both BPM and LEDCurrent.
@@ -74,6 +99,8 @@ typedef struct HRMSubscriberState {
 struct HRMManagerState {
   PebbleRecursiveMutex *lock;
   ListNode *subscribers;
+  //! The subscribers hashed by session_ref, chained through next_in_bucket
+  HRMSubscriberState *session_table[HRM_MANAGER_SESSION_TABLE_SIZE];
 
   CircularBuffer system_task_event_buffer;
   uint32_t dropped_events; //!< Count of how many events for the system task have been dropped
@@ -119,3 +146,20 @@ struct HRMManagerState {
 HRMSessionRef hrm_manager_subscribe_with_callback(AppInstallId app_id, uint32_t update_interval_s,
                                                   uint16_t expire_s, HRMFeature features,
                                                   HRMSubscriberCallback callback, void *context);
+
+//! Subscription for KernelBG clients that want their updates in batches. Instead of waking up
+//! KernelBG for every new reading, the events of one update interval are accumulated and handed
+//! to the callback as an array once per interval.
+//! @param app_id the AppInstallId if this is an app or worker. If this is a system subscriber
+//!   use INSTALL_ID_INVALID
+//! @param update_interval_s how often to deliver a batch
+//! @param expire_s after this many seconds, this subscription will automatically expire. Pass 0
+//!   for no expiration.
+//! @param features A bitfield of the features the subscriber would like updates for.
+//!   HRMFeature_Diagnostics can not be batched.
+//! @param callback the KernelBG callback to call with each batch of HRM events
+//! @param context the context pointer for the callback
+//! @return the HRMSessionRef for this subscription. NULL on failure
+HRMSessionRef hrm_manager_subscribe_batched(AppInstallId app_id, uint32_t update_interval_s,
+                                            uint16_t expire_s, HRMFeature features,
+                                            HRMSubscriberBatchCallback callback, void *context);
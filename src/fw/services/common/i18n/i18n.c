@@ -33,6 +33,7 @@
 #include "mo.h"
 #include "kernel/event_loop.h"
 #include "kernel/pbl_malloc.h"
+#include "os/mutex.h"
 #include "resource/resource.h"
 #include "services/normal/filesystem/pfs.h"
 #include "shell/normal/language_ui.h"
@@ -51,19 +52,50 @@ typedef struct {
   const void *owner;
 } StringLookupInfo;
 
+//! Strings handed out by i18n_get are kept in lists hashed by their original string
+#define STRING_BUCKET_BITS (4)
+#define STRING_BUCKET_COUNT (1 << STRING_BUCKET_BITS)
+
 static struct DomainBinding {
   uint32_t resource_id;
   ResourceCallbackHandle watch_handle;
   bool need_reload;
   ResourceVersion version;
   MoHandle mohandle;
-  I18nString *strings_list;
+  I18nString *strings[STRING_BUCKET_COUNT];
   char iso_locale[ISO_LOCALE_LENGTH];
   char lang_name[LOCALE_NAME_LENGTH];
   uint16_t lang_version;
 } s_system_domain;
 
+//! A translation we've already looked up in the language pack. The translated string is stored
+//! in translated_string and the original string immediately after that.
+typedef struct {
+  ListNode node;
+  uint32_t original_hash;
+  uint32_t last_used;
+  uint16_t translated_len;  //!< 0 if the language pack doesn't have a translation
+  char *original_string;
+  char translated_string[];
+} TranslationCacheEntry;
+
+//! Windows translate the same strings every time they're pushed, often for several owners at
+//! once, so we keep the most recently used translations around no matter who asked for them.
+#define TRANSLATION_CACHE_BUCKET_BITS (4)
+#define TRANSLATION_CACHE_BUCKET_COUNT (1 << TRANSLATION_CACHE_BUCKET_BITS)
+#define TRANSLATION_CACHE_MAX_ENTRIES (48)
+//! Longer strings are rare and would make the cache take up a lot of the kernel heap
+#define TRANSLATION_CACHE_MAX_STRING_BYTES (64)
+
+static struct {
+  PebbleMutex *mutex;
+  TranslationCacheEntry *buckets[TRANSLATION_CACHE_BUCKET_COUNT];
+  int num_entries;
+  uint32_t use_count;
+} s_translation_cache;
+
 static void prv_list_flush(void);
+static void prv_translation_cache_flush(void);
 
 ///////////////////////////////////////////////////
 // MO File Hash Table
@@ -93,19 +125,27 @@ static uint32_t prv_next_index(uint32_t curidx, uint32_t hashsize, uint32_t step
   return curidx + step - (curidx >= hashsize - step ? hashsize : 0);
 }
 
+//! The gettext hash keeps the last characters of the string in its low bits, so strings that end
+//! the same way would all land in the same bucket. Mix all the bits in before picking one.
+static uint32_t prv_hash_bucket(uint32_t hash, unsigned int bucket_bits) {
+  return (hash * 2654435761u) >> (32 - bucket_bits);
+}
+
 //! Lookup a translated string.
 //! @param rlen[out] Can be NULL. If non-null will be populated with the length of the translated
 //!                  string.
 //! @param rstring[out] Can be NULL. If non-null this buffer will be populated with the translated
 //!                     string. This buffer will be null-terminated.
 //! @param rstring_len The length of the rstring buffer.
-static void prv_lookup(const char *msgid, struct DomainBinding *db,
+//! @return False if reading the language pack failed, in which case a length of 0 doesn't mean
+//!         that there is no translation.
+static bool prv_lookup(const char *msgid, struct DomainBinding *db,
                        size_t *rlen, char *rstring, size_t rstring_len) {
   MoHandle *mohandle = &db->mohandle;
   *rlen = 0;
 
   if (mohandle->mo.hdr.mo_hsize <= 2 || mohandle->mo.mo_htable == NULL) {
-    return;
+    return true;
   }
 
   uint32_t hashval = prv_gettext_hash(msgid);
@@ -116,19 +156,19 @@ static void prv_lookup(const char *msgid, struct DomainBinding *db,
     uint32_t strno = mohandle->mo.mo_htable[idx];
     if (strno-- == 0) {
       /* unexpected miss */
-      return;
+      return true;
     }
     MoEntry oentry;
     if (resource_load_byte_range_system(0, db->resource_id, mohandle->mo.hdr.mo_otable
             + sizeof(MoEntry) * strno, (uint8_t *)&oentry, sizeof(MoEntry)) != sizeof(MoEntry)) {
-      return;
+      return false;
     }
     if (len == oentry.len) {
       // Length of original matches, compare the contents
       char key[oentry.len + 1];
       if (resource_load_byte_range_system(0, db->resource_id, oentry.off, (uint8_t *)key,
             oentry.len) != oentry.len) {
-        return;
+        return false;
       }
       key[oentry.len] = '\0';
 
@@ -137,7 +177,7 @@ static void prv_lookup(const char *msgid, struct DomainBinding *db,
         MoEntry tentry;
         if (resource_load_byte_range_system(0, db->resource_id, mohandle->mo.hdr.mo_ttable
             + sizeof(MoEntry) * strno, (uint8_t *)&tentry, sizeof(MoEntry)) != sizeof(MoEntry)) {
-          return;
+          return false;
         }
         if (rstring) { // If we want the translated string, copy it out.
           // Make sure we don't read out more than the length of the buffer we're reading into.
@@ -146,7 +186,7 @@ static void prv_lookup(const char *msgid, struct DomainBinding *db,
 
           if (resource_load_byte_range_system(0, db->resource_id, tentry.off,
                                               (uint8_t *)rstring, read_length) != read_length) {
-            return;
+            return false;
           }
 
           rstring[read_length] = '\0';
@@ -154,13 +194,148 @@ static void prv_lookup(const char *msgid, struct DomainBinding *db,
         if (rlen) { // If we want the translated string length, copy it out.
           *rlen = tentry.len;
         }
-        return;
+        return true;
       }
     }
     idx = prv_next_index(idx, mohandle->mo.hdr.mo_hsize, step);
   }
 }
 
+///////////////////////////////////////////////////
+// Translation Cache
+
+static TranslationCacheEntry **prv_translation_cache_get_bucket(uint32_t original_hash) {
+  return &s_translation_cache.buckets[prv_hash_bucket(original_hash,
+                                                      TRANSLATION_CACHE_BUCKET_BITS)];
+}
+
+static bool prv_translation_cache_filter_callback(ListNode *found_node, void *data) {
+  TranslationCacheEntry *entry = (TranslationCacheEntry *)found_node;
+  StringLookupInfo *lookup_info = data;
+  return (entry->original_hash == lookup_info->hash &&
+          strcmp(entry->original_string, lookup_info->string) == 0);
+}
+
+static TranslationCacheEntry *prv_translation_cache_find(const char *msgid, uint32_t hash) {
+  StringLookupInfo lookup_info = {
+    .string = msgid,
+    .hash = hash,
+  };
+  TranslationCacheEntry *entry = (TranslationCacheEntry *)list_find(
+      (ListNode *)*prv_translation_cache_get_bucket(hash),
+      prv_translation_cache_filter_callback, &lookup_info);
+  if (entry) {
+    entry->last_used = ++s_translation_cache.use_count;
+  }
+  return entry;
+}
+
+static void prv_translation_cache_remove(TranslationCacheEntry *entry) {
+  list_remove(&entry->node, (ListNode **)prv_translation_cache_get_bucket(entry->original_hash),
+              NULL);
+  kernel_free(entry);
+  s_translation_cache.num_entries--;
+}
+
+static void prv_translation_cache_evict_least_recently_used(void) {
+  TranslationCacheEntry *oldest = NULL;
+  for (int i = 0; i < TRANSLATION_CACHE_BUCKET_COUNT; i++) {
+    ListNode *cur = (ListNode *)s_translation_cache.buckets[i];
+    while (cur) {
+      TranslationCacheEntry *entry = (TranslationCacheEntry *)cur;
+      // Wrapping the use count only makes us evict the wrong entry once in a while, that's ok
+      if (!oldest || entry->last_used < oldest->last_used) {
+        oldest = entry;
+      }
+      cur = list_get_next(cur);
+    }
+  }
+  if (oldest) {
+    prv_translation_cache_remove(oldest);
+  }
+}
+
+static void prv_translation_cache_add(const char *msgid, uint32_t hash,
+                                      const char *translated, size_t translated_len) {
+  const size_t original_len = strlen(msgid);
+  if (original_len + translated_len > TRANSLATION_CACHE_MAX_STRING_BYTES) {
+    return;
+  }
+
+  // It's just a cache, don't go out of our way to find room for it
+  TranslationCacheEntry *entry = kernel_malloc(sizeof(TranslationCacheEntry) + translated_len + 1
+                                               + original_len + 1);
+  if (!entry) {
+    return;
+  }
+  list_init(&entry->node);
+  entry->original_hash = hash;
+  entry->translated_len = translated_len;
+  memcpy(entry->translated_string, translated, translated_len);
+  entry->translated_string[translated_len] = '\0';
+  entry->original_string = &entry->translated_string[translated_len + 1];
+  strcpy(entry->original_string, msgid);
+
+  mutex_lock(s_translation_cache.mutex);
+  if (prv_translation_cache_find(msgid, hash)) {
+    // Somebody else beat us to it
+    kernel_free(entry);
+  } else {
+    if (s_translation_cache.num_entries >= TRANSLATION_CACHE_MAX_ENTRIES) {
+      prv_translation_cache_evict_least_recently_used();
+    }
+    entry->last_used = ++s_translation_cache.use_count;
+    TranslationCacheEntry **bucket = prv_translation_cache_get_bucket(hash);
+    *bucket = (TranslationCacheEntry *)list_prepend((ListNode *)*bucket, &entry->node);
+    s_translation_cache.num_entries++;
+  }
+  mutex_unlock(s_translation_cache.mutex);
+}
+
+static void prv_translation_cache_flush(void) {
+  mutex_lock(s_translation_cache.mutex);
+  for (int i = 0; i < TRANSLATION_CACHE_BUCKET_COUNT; i++) {
+    ListNode *cur = (ListNode *)s_translation_cache.buckets[i];
+    while (cur) {
+      ListNode *next = list_get_next(cur);
+      kernel_free(cur);
+      cur = next;
+    }
+    s_translation_cache.buckets[i] = NULL;
+  }
+  s_translation_cache.num_entries = 0;
+  mutex_unlock(s_translation_cache.mutex);
+}
+
+//! Same as prv_lookup, but checks the translation cache before going to the language pack.
+static void prv_lookup_cached(const char *msgid, struct DomainBinding *db,
+                              size_t *rlen, char *rstring, size_t rstring_len) {
+  const uint32_t hash = prv_gettext_hash(msgid);
+
+  mutex_lock(s_translation_cache.mutex);
+  const TranslationCacheEntry *entry = prv_translation_cache_find(msgid, hash);
+  if (entry) {
+    if (rstring && entry->translated_len) {
+      const size_t read_length = MIN(entry->translated_len, rstring_len - 1);
+      memcpy(rstring, entry->translated_string, read_length);
+      rstring[read_length] = '\0';
+    }
+    *rlen = entry->translated_len;
+  }
+  mutex_unlock(s_translation_cache.mutex);
+  if (entry) {
+    return;
+  }
+
+  // Don't remember a string as untranslated just because the language pack couldn't be read
+  const bool success = prv_lookup(msgid, db, rlen, rstring, rstring_len);
+
+  // Only cache the translation if we got all of it
+  if (success && rstring && *rlen < rstring_len) {
+    prv_translation_cache_add(msgid, hash, *rlen ? rstring : "", *rlen);
+  }
+}
+
 ///////////////////////////////////////////////////
 // MO File Mapping & Lookup
 
@@ -254,6 +429,7 @@ static bool prv_mapit(const uint32_t resource_id, struct DomainBinding *db) {
   /* save version */
   db->version = resource_get_version(SYSTEM_APP, resource_id);
   prv_list_flush();
+  prv_translation_cache_flush();
   prv_unmapit(db);
 
   unsigned int size;
@@ -311,14 +487,20 @@ fail:
 ///////////////////////////////////////////////////
 // Strings List Manipulation
 
+static I18nString **prv_list_get_bucket(uint32_t original_hash) {
+  return &s_system_domain.strings[prv_hash_bucket(original_hash, STRING_BUCKET_BITS)];
+}
+
 void prv_list_flush(void) {
-  ListNode *cur = (ListNode *)s_system_domain.strings_list;
-  while (cur) {
-    ListNode *next = list_get_next(cur);
-    kernel_free(cur);
-    cur = next;
+  for (int i = 0; i < STRING_BUCKET_COUNT; i++) {
+    ListNode *cur = (ListNode *)s_system_domain.strings[i];
+    while (cur) {
+      ListNode *next = list_get_next(cur);
+      kernel_free(cur);
+      cur = next;
+    }
+    s_system_domain.strings[i] = NULL;
   }
-  s_system_domain.strings_list = NULL;
 }
 
 static bool prv_list_string_filter_callback(ListNode *found_node, void *data) {
@@ -349,7 +531,7 @@ I18nString *prv_list_find_string(const char *string, const void *owner) {
     .hash = prv_gettext_hash(string),
     .owner = owner
   };
-  return (I18nString *)list_find((ListNode *)s_system_domain.strings_list,
+  return (I18nString *)list_find((ListNode *)*prv_list_get_bucket(lookup_info.hash),
       prv_list_string_filter_callback, (void *)&lookup_info);
 }
 
@@ -373,7 +555,7 @@ static const char *prv_list_add_string(const char *original_string, const char *
   i18n_string->original_string = &i18n_string->translated_string[translated_len + 1];
   strcpy(i18n_string->original_string, original_string);
 
-  I18nString **strings_list = &s_system_domain.strings_list;
+  I18nString **strings_list = prv_list_get_bucket(i18n_string->original_hash);
   *strings_list = (I18nString *)list_prepend((ListNode *)*strings_list, &i18n_string->node);
 
   if (translated_len > 0) {
@@ -384,7 +566,8 @@ static const char *prv_list_add_string(const char *original_string, const char *
 }
 
 static void prv_list_remove_string(I18nString *i18n_string) {
-  list_remove(&i18n_string->node, (ListNode **)&s_system_domain.strings_list, NULL);
+  list_remove(&i18n_string->node, (ListNode **)prv_list_get_bucket(i18n_string->original_hash),
+              NULL);
   kernel_free(i18n_string);
 }
 
@@ -435,7 +618,7 @@ const char *i18n_get(const char *msgid, const void *owner) {
   // Lookup the translation from the language pack and add it to our cache
   char translated[200];
   size_t len = 0;
-  prv_lookup(msgid, db, &len, translated, sizeof(translated));
+  prv_lookup_cached(msgid, db, &len, translated, sizeof(translated));
   if (len >= sizeof(translated)) {
     PBL_LOG(LOG_LEVEL_WARNING, "Truncated string: <%s>", msgid);
   }
@@ -463,7 +646,7 @@ void i18n_get_with_buffer(const char *msgid, char *buffer, size_t length) {
   }
 
   size_t len = 0;
-  prv_lookup(msgid, db, &len, buffer, length);
+  prv_lookup_cached(msgid, db, &len, buffer, length);
   if (len >= length) {
     PBL_LOG(LOG_LEVEL_WARNING, "Truncated string: <%s>", msgid);
   }
@@ -490,7 +673,7 @@ size_t i18n_get_length(const char *msgid) {
   }
 
   size_t len = 0;
-  prv_lookup(msgid, db, &len, NULL, 0);
+  prv_lookup_cached(msgid, db, &len, NULL, 0);
   if (len) { // String was found
     return len;
   }
@@ -510,13 +693,15 @@ void i18n_free(const char *original, const void *owner) {
 }
 
 void i18n_free_all(const void *owner) {
-  I18nString *cur_string = (I18nString *)list_find((ListNode *)s_system_domain.strings_list,
-      prv_list_owner_filter_callback, (void*)owner);
-  while (cur_string) {
-    I18nString *next_string = (I18nString *)list_find_next(&cur_string->node,
-        prv_list_owner_filter_callback, false, (void*)owner);
-    prv_list_remove_string(cur_string);
-    cur_string = next_string;
+  for (int i = 0; i < STRING_BUCKET_COUNT; i++) {
+    I18nString *cur_string = (I18nString *)list_find((ListNode *)s_system_domain.strings[i],
+        prv_list_owner_filter_callback, (void*)owner);
+    while (cur_string) {
+      I18nString *next_string = (I18nString *)list_find_next(&cur_string->node,
+          prv_list_owner_filter_callback, false, (void*)owner);
+      prv_list_remove_string(cur_string);
+      cur_string = next_string;
+    }
   }
 }
 
@@ -542,10 +727,15 @@ static void prv_resource_changed_callback(void *data) {
 static void prv_unset(void) {
   s_system_domain.need_reload = false;
   prv_list_flush();
+  prv_translation_cache_flush();
   prv_unmapit(&s_system_domain);
 }
 
 void i18n_set_resource(uint32_t resource_id) {
+  if (!s_translation_cache.mutex) {
+    s_translation_cache.mutex = mutex_create();
+  }
+
   // Remove prior watch, if any
   // Warning: you better be sure we're not calling from the resource changed callback.
   if (s_system_domain.watch_handle) {
@@ -18,6 +18,7 @@
 
 #include "system/logging.h"
 
+#include "console/prompt.h"
 #include "drivers/task_watchdog.h"
 #include "kernel/pebble_tasks.h"
 #include "kernel/util/task_init.h"
@@ -25,6 +26,15 @@
 #include "os/tick.h"
 #include "services/common/regular_timer.h"
 #include "system/passert.h"
+#include "system/reboot_reason.h"
+#include "system/reset.h"
+#include "util/attributes.h"
+#include "util/math.h"
+#include "util/size.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "FreeRTOS.h"
 #include "queue.h"
@@ -32,16 +42,47 @@
 
 #define SYSTEM_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
 
+#define SYSTEM_TASK_QUEUE_LENGTH (30)
+#define FROM_APP_SYSTEM_TASK_QUEUE_LENGTH (8)
+#define HIGH_PRIORITY_SYSTEM_TASK_QUEUE_LENGTH (8)
+
+//! Callbacks that get added while the queue is full wait here, instead of rebooting the watch
+#define SYSTEM_TASK_SPILL_LIST_LENGTH (32)
+
+//! Number of coalesced callbacks that can be waiting to run at the same time. Beyond that,
+//! coalesced callbacks are simply enqueued.
+#define SYSTEM_TASK_NUM_COALESCED (16)
+
 typedef struct {
   SystemTaskEventCallback cb;
   void *data;
+  TickType_t enqueued_ticks;
 } SystemTaskEvent;
 
+typedef struct {
+  SystemTaskEventCallback cb;
+  void *data;
+} SystemTaskPendingCallback;
+
 static QueueHandle_t s_system_task_queue;
 static QueueHandle_t s_from_app_system_task_queue;
+static QueueHandle_t s_high_priority_system_task_queue;
 
 static QueueSetHandle_t s_system_task_queue_set;
 
+//! FIFO of callbacks waiting for space in s_system_task_queue. Only the system task drains it.
+static struct {
+  SystemTaskEvent events[SYSTEM_TASK_SPILL_LIST_LENGTH];
+  uint8_t head;
+  uint8_t length;
+} s_spill_list;
+
+//! Coalesced callbacks that are waiting to run
+static SystemTaskPendingCallback s_pending_coalesced[SYSTEM_TASK_NUM_COALESCED];
+
+static SystemTaskCallbackStats s_callback_stats[SYSTEM_TASK_STATS_NUM_CALLBACKS];
+static SystemTaskQueueStats s_queue_stats;
+
 static SystemTaskEventCallback s_current_cb;
 
 static bool s_system_task_idle = true;
@@ -51,51 +92,252 @@ static bool prv_is_accepting_callbacks() {
   return s_system_task_queue != 0 && !s_should_block_callbacks;
 }
 
-static void system_task_idle_timer_callback(void* data) {
-  if (s_system_task_idle && uxQueueMessagesWaiting(s_system_task_queue_set) == 0) {
-    system_task_watchdog_feed();
+// Critical sections
+
+//! Callbacks can be added from ISRs as well, which must mask interrupts rather than use the task
+//! level critical section.
+//! @return The interrupt mask to pass to \ref prv_exit_critical
+static uint32_t prv_enter_critical(bool is_isr) {
+  if (is_isr) {
+    return portSET_INTERRUPT_MASK_FROM_ISR();
   }
+  portENTER_CRITICAL();
+  return 0;
 }
 
-static void system_task_main(void* paramater) {
-  task_watchdog_mask_set(PebbleTask_KernelBackground);
-  task_init();
+static void prv_exit_critical(bool is_isr, uint32_t saved_mask) {
+  if (is_isr) {
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(saved_mask);
+  } else {
+    portEXIT_CRITICAL();
+  }
+}
 
-  while (true) {
-    s_system_task_idle = true;
+// Coalescing
 
+static int prv_find_pending_coalesced(SystemTaskEventCallback cb, void *data) {
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_pending_coalesced); ++i) {
+    if (s_pending_coalesced[i].cb == cb && s_pending_coalesced[i].data == data) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//! @return True if an identical callback is already waiting to run, otherwise the callback gets
+//! marked as waiting.
+static bool prv_coalesce(SystemTaskEventCallback cb, void *data, bool is_isr) {
+  bool is_pending;
+  const uint32_t saved_mask = prv_enter_critical(is_isr);
+  {
+    is_pending = (prv_find_pending_coalesced(cb, data) >= 0);
+    if (is_pending) {
+      ++s_queue_stats.num_coalesced;
+    } else {
+      // If all slots are taken, the callback just doesn't get coalesced
+      const int free_idx = prv_find_pending_coalesced(NULL, NULL);
+      if (free_idx >= 0) {
+        s_pending_coalesced[free_idx] = (SystemTaskPendingCallback) { .cb = cb, .data = data };
+      }
+    }
+  }
+  prv_exit_critical(is_isr, saved_mask);
+  return is_pending;
+}
+
+//! Called right before a callback runs, so that adding it again from then on enqueues it again
+static void prv_clear_pending_coalesced(SystemTaskEventCallback cb, void *data) {
+  portENTER_CRITICAL();
+  {
+    const int idx = prv_find_pending_coalesced(cb, data);
+    if (idx >= 0) {
+      s_pending_coalesced[idx] = (SystemTaskPendingCallback) {};
+    }
+  }
+  portEXIT_CRITICAL();
+}
+
+// Spill list
+
+//! @return False if the spill list is full
+static bool prv_spill_list_push(const SystemTaskEvent *event) {
+  if (s_spill_list.length == SYSTEM_TASK_SPILL_LIST_LENGTH) {
+    return false;
+  }
+  const unsigned int idx = (s_spill_list.head + s_spill_list.length) % SYSTEM_TASK_SPILL_LIST_LENGTH;
+  s_spill_list.events[idx] = *event;
+  ++s_spill_list.length;
+  ++s_queue_stats.num_spilled;
+  s_queue_stats.max_spill_list_length = MAX(s_queue_stats.max_spill_list_length,
+                                            s_spill_list.length);
+  return true;
+}
+
+//! Moves as many spilled callbacks into the queue as fit, oldest first
+static void prv_drain_spill_list(void) {
+  while (true) {
+    // Only the system task takes events off the spill list, so the oldest one stays put while
+    // it gets sent. Leaving it on the list until then keeps callbacks that get added meanwhile
+    // spilling behind it, and there's never a need to squeeze it back in if the queue is full.
     SystemTaskEvent event;
+    portENTER_CRITICAL();
+    const bool is_empty = (s_spill_list.length == 0);
+    if (!is_empty) {
+      event = s_spill_list.events[s_spill_list.head];
+    }
+    portEXIT_CRITICAL();
+
+    // Don't call into the queue with interrupts masked
+    if (is_empty || !xQueueSendToBack(s_system_task_queue, &event, 0)) {
+      return;
+    }
+
+    portENTER_CRITICAL();
+    s_spill_list.head = (s_spill_list.head + 1) % SYSTEM_TASK_SPILL_LIST_LENGTH;
+    --s_spill_list.length;
+    portEXIT_CRITICAL();
+  }
+}
 
-    QueueSetMemberHandle_t activated_queue = xQueueSelectFromSet(s_system_task_queue_set, portMAX_DELAY);
+//! Enqueues the event behind everything that has been spilled already.
+//! @return False if neither the queue nor the spill list had space
+static bool prv_send_or_spill(const SystemTaskEvent *event, bool is_isr,
+                              bool *should_context_switch) {
+  bool success = true;
+  uint32_t saved_mask = prv_enter_critical(is_isr);
+  if (s_spill_list.length) {
+    success = prv_spill_list_push(event);
+    prv_exit_critical(is_isr, saved_mask);
+    return success;
+  }
+  prv_exit_critical(is_isr, saved_mask);
 
-    // Get event from the activated queue
-    portBASE_TYPE result = xQueueReceive(activated_queue, &event, 0);
+  if (is_isr) {
+    signed portBASE_TYPE woken = pdFALSE;
+    success = (xQueueSendToBackFromISR(s_system_task_queue, event, &woken) == pdTRUE);
+    *should_context_switch = (woken == pdTRUE);
+  } else {
+    success = (xQueueSendToBack(s_system_task_queue, event, 0) == pdTRUE);
+  }
+  if (!success) {
+    saved_mask = prv_enter_critical(is_isr);
+    success = prv_spill_list_push(event);
+    prv_exit_critical(is_isr, saved_mask);
+  }
+  return success;
+}
 
-    // I believe its possible that we just reset the queue and accidently
-    // pended an extra event to the queue set so handle that case gracefully
-    if (result) {
-      s_system_task_idle = false;
-      s_current_cb = event.cb;
-      event.cb(event.data);
-      mcu_fpu_cleanup();
-      s_current_cb = NULL;
+// Statistics
+
+static SystemTaskCallbackStats *prv_get_stats_entry(SystemTaskEventCallback cb) {
+  SystemTaskCallbackStats *least_run = &s_callback_stats[0];
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_callback_stats); ++i) {
+    SystemTaskCallbackStats *stats = &s_callback_stats[i];
+    if (stats->cb == cb) {
+      return stats;
+    }
+    if (stats->num_runs < least_run->num_runs) {
+      least_run = stats;
     }
+  }
+  *least_run = (SystemTaskCallbackStats) { .cb = cb };
+  return least_run;
+}
 
-    // Refresh the watchdog immediately, just in case that cb() took awhile to run.
+static void prv_record_stats(const SystemTaskEvent *event, TickType_t start_ticks,
+                             TickType_t end_ticks) {
+  SystemTaskCallbackStats *stats = prv_get_stats_entry(event->cb);
+  const uint32_t queue_latency_ticks = start_ticks - event->enqueued_ticks;
+  const uint32_t run_ticks = end_ticks - start_ticks;
+  ++stats->num_runs;
+  stats->total_queue_latency_ticks += queue_latency_ticks;
+  stats->max_queue_latency_ticks = MAX(stats->max_queue_latency_ticks, queue_latency_ticks);
+  stats->total_run_ticks += run_ticks;
+  stats->max_run_ticks = MAX(stats->max_run_ticks, run_ticks);
+}
+
+static void system_task_idle_timer_callback(void* data) {
+  if (s_system_task_idle && uxQueueMessagesWaiting(s_system_task_queue_set) == 0) {
     system_task_watchdog_feed();
   }
 }
 
-void system_task_init(void) {
-  static const int SYSTEM_TASK_QUEUE_LENGTH = 30;
-  static const int FROM_APP_SYSTEM_TASK_QUEUE_LENGTH = 8;
+//! Takes whichever event has been waiting longer, out of the regular and from-app queues. Ties go
+//! to the regular queue.
+static bool prv_receive_oldest_regular_event(SystemTaskEvent *event_out) {
+  SystemTaskEvent kernel_event;
+  SystemTaskEvent app_event;
+  const bool has_kernel_event = xQueuePeek(s_system_task_queue, &kernel_event, 0);
+  const bool has_app_event = xQueuePeek(s_from_app_system_task_queue, &app_event, 0);
+  if (!has_kernel_event && !has_app_event) {
+    return false;
+  }
+  const bool is_app_older = has_app_event &&
+      (!has_kernel_event ||
+       (int32_t)(app_event.enqueued_ticks - kernel_event.enqueued_ticks) < 0);
+  return xQueueReceive(is_app_older ? s_from_app_system_task_queue : s_system_task_queue,
+                       event_out, 0);
+}
+
+//! Waits for and runs the next callback.
+//! @return False if nothing was run within the timeout
+T_STATIC bool prv_process_next_event(TickType_t timeout_ticks) {
+  s_system_task_idle = true;
+
+  prv_drain_spill_list();
+
+  if (!xQueueSelectFromSet(s_system_task_queue_set, timeout_ticks)) {
+    return false;
+  }
+
+  // Each event in the member queues is announced exactly once in the queue set, so one event is
+  // waiting somewhere. High priority events jump ahead of the announced one. The others get served
+  // in the order they were added, like the queue set would, so that kernel callbacks can't starve
+  // the app's (and vice versa). Going by the announcement itself would reorder them once a high
+  // priority event has taken the place of one.
+  SystemTaskEvent event;
+  portBASE_TYPE result = xQueueReceive(s_high_priority_system_task_queue, &event, 0) ||
+                         prv_receive_oldest_regular_event(&event);
+
+  // I believe its possible that we just reset the queue and accidently
+  // pended an extra event to the queue set so handle that case gracefully
+  if (result) {
+    s_system_task_idle = false;
+    prv_clear_pending_coalesced(event.cb, event.data);
+    s_current_cb = event.cb;
+    const TickType_t start_ticks = xTaskGetTickCount();
+    event.cb(event.data);
+    prv_record_stats(&event, start_ticks, xTaskGetTickCount());
+    mcu_fpu_cleanup();
+    s_current_cb = NULL;
+  }
 
+  // Refresh the watchdog immediately, just in case that cb() took awhile to run.
+  system_task_watchdog_feed();
+  return result;
+}
+
+static void system_task_main(void* paramater) {
+  task_watchdog_mask_set(PebbleTask_KernelBackground);
+  task_init();
+
+  while (true) {
+    prv_process_next_event(portMAX_DELAY);
+  }
+}
+
+void system_task_init(void) {
   s_system_task_queue = xQueueCreate(SYSTEM_TASK_QUEUE_LENGTH, sizeof(SystemTaskEvent));
   s_from_app_system_task_queue = xQueueCreate(FROM_APP_SYSTEM_TASK_QUEUE_LENGTH, sizeof(SystemTaskEvent));
+  s_high_priority_system_task_queue = xQueueCreate(HIGH_PRIORITY_SYSTEM_TASK_QUEUE_LENGTH,
+                                                   sizeof(SystemTaskEvent));
 
-  s_system_task_queue_set = xQueueCreateSet(SYSTEM_TASK_QUEUE_LENGTH + FROM_APP_SYSTEM_TASK_QUEUE_LENGTH);
+  s_system_task_queue_set = xQueueCreateSet(SYSTEM_TASK_QUEUE_LENGTH +
+                                            FROM_APP_SYSTEM_TASK_QUEUE_LENGTH +
+                                            HIGH_PRIORITY_SYSTEM_TASK_QUEUE_LENGTH);
   xQueueAddToSet(s_system_task_queue, s_system_task_queue_set);
   xQueueAddToSet(s_from_app_system_task_queue, s_system_task_queue_set);
+  xQueueAddToSet(s_high_priority_system_task_queue, s_system_task_queue_set);
 
   extern uint32_t __kernel_bg_stack_start__[];
   extern uint32_t __kernel_bg_stack_size__[];
@@ -134,8 +376,7 @@ void system_task_watchdog_feed(void) {
 }
 
 static void handle_system_task_send_failure(SystemTaskEventCallback cb) {
-  register uintptr_t lr __asm("lr");
-  uintptr_t saved_lr = lr;
+  uintptr_t saved_lr = (uintptr_t)__builtin_return_address(0);
 
   PBL_LOG(LOG_LEVEL_ERROR, "System task queue full. Dropped cb: %p, current cb: %p", cb, s_current_cb);
 
@@ -153,34 +394,57 @@ static void handle_system_task_send_failure(SystemTaskEventCallback cb) {
   reset_due_to_software_failure();
 }
 
-bool system_task_add_callback_from_isr(SystemTaskEventCallback cb, void *data, bool* should_context_switch) {
+bool system_task_add_callback_from_isr_with_flags(SystemTaskEventCallback cb, void *data,
+                                                  SystemTaskCallbackFlags flags,
+                                                  bool *should_context_switch) {
+  *should_context_switch = false;
   if (!prv_is_accepting_callbacks()) {
     return false;
   }
+  if ((flags & SystemTaskCallbackFlag_Coalesce) && prv_coalesce(cb, data, true /* is_isr */)) {
+    return true;
+  }
   SystemTaskEvent event = {
     .cb = cb,
     .data = data,
+    .enqueued_ticks = xTaskGetTickCountFromISR(),
   };
 
-  signed portBASE_TYPE tmp;
-  bool success = (xQueueSendToBackFromISR(s_system_task_queue, &event, &tmp) == pdTRUE);
+  if (flags & SystemTaskCallbackFlag_HighPriority) {
+    signed portBASE_TYPE woken = pdFALSE;
+    if (xQueueSendToBackFromISR(s_high_priority_system_task_queue, &event, &woken) == pdTRUE) {
+      *should_context_switch = (woken == pdTRUE);
+      return true;
+    }
+    // Fall back to the regular queue
+  }
+
+  bool success = prv_send_or_spill(&event, true /* is_isr */, should_context_switch);
   if (!success) {
     handle_system_task_send_failure(cb);
   }
 
-  *should_context_switch = (tmp == pdTRUE);
-
   return success;
 }
 
-bool system_task_add_callback(SystemTaskEventCallback cb, void *data) {
+bool system_task_add_callback_from_isr(SystemTaskEventCallback cb, void *data, bool* should_context_switch) {
+  return system_task_add_callback_from_isr_with_flags(cb, data, SystemTaskCallbackFlag_None,
+                                                      should_context_switch);
+}
+
+bool system_task_add_callback_with_flags(SystemTaskEventCallback cb, void *data,
+                                         SystemTaskCallbackFlags flags) {
   if (!prv_is_accepting_callbacks()) {
     return false;
   }
+  if ((flags & SystemTaskCallbackFlag_Coalesce) && prv_coalesce(cb, data, false /* is_isr */)) {
+    return true;
+  }
 
   SystemTaskEvent event = {
     .cb = cb,
     .data = data,
+    .enqueued_ticks = xTaskGetTickCount(),
   };
 
   if (pebble_task_get_current() == PebbleTask_App) {
@@ -188,7 +452,15 @@ bool system_task_add_callback(SystemTaskEventCallback cb, void *data) {
     // FIXME: In the future when we want to bound the amount of time a syscall can take this will have to change.
     xQueueSendToBack(s_from_app_system_task_queue, &event, portMAX_DELAY);
     return true;
-  } else {
+  }
+
+  if ((flags & SystemTaskCallbackFlag_HighPriority) &&
+      xQueueSendToBack(s_high_priority_system_task_queue, &event, 0) == pdTRUE) {
+    return true;
+  }
+
+  bool should_context_switch;
+  if (!prv_send_or_spill(&event, false /* is_isr */, &should_context_switch)) {
     // Back ourselves up and wait a reasonable amount of time before failing. If the queue is really backed up
     // we want to fall through to the handle_system_task_send_failure and not just get killed by the watchdog.
     bool success = (xQueueSendToBack(s_system_task_queue, &event, milliseconds_to_ticks(3000)) == pdTRUE);
@@ -200,13 +472,32 @@ bool system_task_add_callback(SystemTaskEventCallback cb, void *data) {
   return true;
 }
 
+bool system_task_add_callback(SystemTaskEventCallback cb, void *data) {
+  return system_task_add_callback_with_flags(cb, data, SystemTaskCallbackFlag_None);
+}
+
+bool system_task_add_callback_coalesced(SystemTaskEventCallback cb, void *data) {
+  return system_task_add_callback_with_flags(cb, data, SystemTaskCallbackFlag_Coalesce);
+}
+
 void system_task_block_callbacks(bool block) {
   s_should_block_callbacks = block;
 }
 
 uint32_t system_task_get_available_space(void) {
   const bool is_app = pebble_task_get_current() == PebbleTask_App;
-  return uxQueueSpacesAvailable(is_app ? s_from_app_system_task_queue : s_system_task_queue);
+  if (is_app) {
+    return uxQueueSpacesAvailable(s_from_app_system_task_queue);
+  }
+  // Anything that doesn't fit in the queue gets spilled
+  uint32_t available_space;
+  portENTER_CRITICAL();
+  {
+    available_space = (s_spill_list.length ? 0 : uxQueueSpacesAvailable(s_system_task_queue)) +
+                      (SYSTEM_TASK_SPILL_LIST_LENGTH - s_spill_list.length);
+  }
+  portEXIT_CRITICAL();
+  return available_space;
 }
 
 void* system_task_get_current_callback(void) {
@@ -225,3 +516,44 @@ bool system_task_is_ready_to_run(void) {
   // check if system task is ready to go (instead of e.g. waiting for a mutex)
   return (bg_task_state == eReady);
 }
+
+bool system_task_get_callback_stats(SystemTaskEventCallback cb,
+                                    SystemTaskCallbackStats *stats_out) {
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_callback_stats); ++i) {
+    if (s_callback_stats[i].num_runs && s_callback_stats[i].cb == cb) {
+      *stats_out = s_callback_stats[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void system_task_get_queue_stats(SystemTaskQueueStats *stats_out) {
+  *stats_out = s_queue_stats;
+}
+
+void system_task_reset_stats(void) {
+  memset(s_callback_stats, 0, sizeof(s_callback_stats));
+  s_queue_stats = (SystemTaskQueueStats) {};
+}
+
+void command_system_task_stats(void) {
+  char buffer[80];
+  prompt_send_response_fmt(buffer, sizeof(buffer),
+                           "coalesced: %"PRIu32" spilled: %"PRIu32" max spill list: %"PRIu32,
+                           s_queue_stats.num_coalesced, s_queue_stats.num_spilled,
+                           s_queue_stats.max_spill_list_length);
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_callback_stats); ++i) {
+    const SystemTaskCallbackStats *stats = &s_callback_stats[i];
+    if (!stats->num_runs) {
+      continue;
+    }
+    prompt_send_response_fmt(buffer, sizeof(buffer),
+                             "%p: runs %"PRIu32" wait avg %"PRIu32" max %"PRIu32
+                             " run avg %"PRIu32" max %"PRIu32" (ticks)",
+                             stats->cb, stats->num_runs,
+                             stats->total_queue_latency_ticks / stats->num_runs,
+                             stats->max_queue_latency_ticks,
+                             stats->total_run_ticks / stats->num_runs, stats->max_run_ticks);
+  }
+}
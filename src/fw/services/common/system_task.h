@@ -43,6 +43,28 @@ bool system_task_add_callback_from_isr(SystemTaskEventCallback cb, void *data, b
 //! @param cb Callback function that will later be called from the system task
 bool system_task_add_callback(SystemTaskEventCallback cb, void *data);
 
+typedef enum {
+  SystemTaskCallbackFlag_None = 0,
+  //! Don't enqueue the callback if the same callback with the same data is still waiting to run.
+  //! Only use this for callbacks that act on the latest state, rather than on each request.
+  SystemTaskCallbackFlag_Coalesce = (1 << 0),
+  //! Run the callback ahead of all the regular ones. Reserve this for latency sensitive work that
+  //! is quick to run.
+  SystemTaskCallbackFlag_HighPriority = (1 << 1),
+} SystemTaskCallbackFlags;
+
+//! Same as system_task_add_callback, with the behavior tweaked by flags
+bool system_task_add_callback_with_flags(SystemTaskEventCallback cb, void *data,
+                                         SystemTaskCallbackFlags flags);
+
+//! Same as system_task_add_callback_from_isr, with the behavior tweaked by flags
+bool system_task_add_callback_from_isr_with_flags(SystemTaskEventCallback cb, void *data,
+                                                  SystemTaskCallbackFlags flags,
+                                                  bool *should_context_switch);
+
+//! Shorthand for system_task_add_callback_with_flags(cb, data, SystemTaskCallbackFlag_Coalesce)
+bool system_task_add_callback_coalesced(SystemTaskEventCallback cb, void *data);
+
 //! @param block True if callbacks should be rejected, False if they should be let through.
 void system_task_block_callbacks(bool block);
 
@@ -60,3 +82,35 @@ void system_task_enable_raised_priority(bool is_raised);
 
 //! @return True if the KernelBG task is ready to run (i.e. not blocked by mutex / queue)
 bool system_task_is_ready_to_run(void);
+
+//! Statistics of a callback that ran on the system task. All times are in RTOS ticks.
+typedef struct {
+  SystemTaskEventCallback cb;
+  uint32_t num_runs;
+  //! Time between adding the callback and it starting to run
+  uint32_t total_queue_latency_ticks;
+  uint32_t max_queue_latency_ticks;
+  //! Time it took the callback to run
+  uint32_t total_run_ticks;
+  uint32_t max_run_ticks;
+} SystemTaskCallbackStats;
+
+typedef struct {
+  //! Callbacks that weren't enqueued, because an identical one was still waiting to run
+  uint32_t num_coalesced;
+  //! Callbacks that went to the spill list, because the queue was full
+  uint32_t num_spilled;
+  uint32_t max_spill_list_length;
+} SystemTaskQueueStats;
+
+//! Number of different callbacks that statistics are kept for. When more callbacks run, the one
+//! that ran the least often makes room.
+#define SYSTEM_TASK_STATS_NUM_CALLBACKS (16)
+
+//! @return True and fills stats_out if statistics are kept for the callback
+bool system_task_get_callback_stats(SystemTaskEventCallback cb,
+                                    SystemTaskCallbackStats *stats_out);
+
+void system_task_get_queue_stats(SystemTaskQueueStats *stats_out);
+
+void system_task_reset_stats(void);
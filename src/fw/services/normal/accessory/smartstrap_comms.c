@@ -201,27 +201,36 @@ static void prv_read_timeout(void *context) {
   }
 }
 
-static void prv_store_byte(const uint8_t data) {
+static void prv_store_bytes(const uint8_t *data, size_t length) {
   // NOTE: THIS IS RUN WITHIN AN ISR
-  // The checksum byte is the last byte in the frame. This byte could be the last byte we receive
-  // (making it the checksum byte), so we always keep a 1 byte temporary buffer before storing the
-  // byte in the MBuf. This avoids us potentially overrunning a conservatively sized payload buffer;
+  if (length == 0) {
+    return;
+  }
+  // The checksum byte is the last byte in the frame. The last byte of this run could be the last
+  // byte we receive (making it the checksum byte), so we always keep a 1 byte temporary buffer
+  // before storing the byte in the MBuf. This avoids us potentially overrunning a conservatively
+  // sized payload buffer.
   if (s_read_info.length > 0) {
     // copy the previous byte from the footer_byte field into the payload
-    if (!mbuf_iterator_write_byte(&s_read_consumer.mbuf_iter,
-                                  s_read_info.footer_byte)) {
+    if (!mbuf_iterator_write_byte(&s_read_consumer.mbuf_iter, s_read_info.footer_byte)) {
       // no room left to store this byte
       s_read_info.should_drop = true;
     }
   }
-  // Store this byte in the footer_byte. Note that we will still calculate the checksum on this byte
-  // and verify that the checksum is 0 at the end, so if this byte is the actual footer byte (aka.
-  // the checksum), we will still include it in the checksum.
-  s_read_info.footer_byte = data;
+  const size_t payload_length = length - 1;
+  if (!s_read_info.should_drop &&
+      (mbuf_iterator_write_bytes(&s_read_consumer.mbuf_iter, data, payload_length) !=
+       payload_length)) {
+    s_read_info.should_drop = true;
+  }
+  // Store the last byte in the footer_byte. Note that we will still calculate the checksum on this
+  // byte and verify that the checksum is 0 at the end, so if this byte is the actual footer byte
+  // (aka. the checksum), we will still include it in the checksum.
+  s_read_info.footer_byte = data[payload_length];
 
   // increment the length and run the CRC calculation
-  s_read_info.length++;
-  crc8_calculate_bytes_streaming((uint8_t *)&data, sizeof(data), (uint8_t *)&s_read_info.checksum,
+  s_read_info.length += length;
+  crc8_calculate_bytes_streaming(data, length, (uint8_t *)&s_read_info.checksum,
                                  false /* !big_endian */);
 }
 
@@ -262,29 +271,42 @@ static void prv_handle_complete_frame(bool *should_context_switch) {
   }
 }
 
-bool smartstrap_handle_data_from_isr(uint8_t data) {
-  // NOTE: THIS IS RUN WITHIN AN ISR
-  if ((smartstrap_fsm_state_get() != SmartstrapStateReadInProgress) &&
-      (smartstrap_fsm_state_get() != SmartstrapStateNotifyInProgress)) {
-    return false;
-  }
+static bool prv_is_reading(void) {
+  return (smartstrap_fsm_state_get() == SmartstrapStateReadInProgress) ||
+         (smartstrap_fsm_state_get() == SmartstrapStateNotifyInProgress);
+}
 
+bool smartstrap_handle_data_buffer_from_isr(uint8_t *data, size_t length) {
+  // NOTE: THIS IS RUN WITHIN AN ISR
   bool should_context_switch = false;
-  bool hdlc_err;
-  bool should_store;
-  bool is_complete = hdlc_streaming_decode(&s_read_info.hdlc_ctx, &data, &should_store, &hdlc_err);
-  if (hdlc_err) {
-    // the rest of the frame is invalid
-    s_read_info.should_drop = true;
-  } else if (is_complete) {
-    prv_handle_complete_frame(&should_context_switch);
-  } else if (should_store && !s_read_info.should_drop) {
-    prv_store_byte(data);
+  // Once a valid frame completes we leave the reading states, so anything after it is ignored
+  while ((length > 0) && prv_is_reading()) {
+    size_t decoded_length;
+    bool is_complete;
+    bool hdlc_err;
+    const size_t consumed = hdlc_decode_buffer(&s_read_info.hdlc_ctx, data, length,
+                                               &decoded_length, &is_complete, &hdlc_err);
+    if (!s_read_info.should_drop) {
+      prv_store_bytes(data, decoded_length);
+    }
+    if (hdlc_err) {
+      // the rest of the frame is invalid
+      s_read_info.should_drop = true;
+    } else if (is_complete) {
+      prv_handle_complete_frame(&should_context_switch);
+    }
+    data += consumed;
+    length -= consumed;
   }
 
   return should_context_switch;
 }
 
+bool smartstrap_handle_data_from_isr(uint8_t data) {
+  // NOTE: THIS IS RUN WITHIN AN ISR
+  return smartstrap_handle_data_buffer_from_isr(&data, sizeof(data));
+}
+
 void prv_notify_timeout(void *context) {
   if (smartstrap_fsm_state_test_and_set(SmartstrapStateNotifyInProgress,
                                         SmartstrapStateReadComplete)) {
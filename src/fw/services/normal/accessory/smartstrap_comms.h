@@ -21,6 +21,7 @@
 #include "util/mbuf.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define SMARTSTRAP_PROTOCOL_VERSION 1
@@ -31,6 +32,10 @@ void smartstrap_comms_init(void);
 //! Called by accessory_manager when we receive a byte of data from the accessory port
 bool smartstrap_handle_data_from_isr(uint8_t c);
 
+//! Called by accessory_manager when it has a buffer of received data, such as a whole frame read by
+//! DMA. The data is decoded in place, so its contents are clobbered.
+bool smartstrap_handle_data_buffer_from_isr(uint8_t *data, size_t length);
+
 //! Called by accessory_manager when we receive a break character
 bool smartstrap_handle_break_from_isr(void);
 
@@ -70,9 +70,6 @@ Pebble App roject.
 #define KALG_SLEEP_HALF_WIDTH  4
 #define KALG_SLEEP_FILTER_WIDTH  (2 * KALG_SLEEP_HALF_WIDTH + 1)
 
-// 2^7 = 128 elements > 125 to allow fft
-#define KALG_FFT_WIDTH  128
-
 // 2^7 = 128 elements > 125 to allow fft
 static const int16_t KALG_FFT_WIDTH_PWR_TWO = 7;
 
@@ -495,6 +492,32 @@ static uint32_t prv_real_counts_from_raw(uint32_t raw) {
 }
 
 
+// -----------------------------------------------------------------------------------------
+// Twiddle factors for the FFT: sin_lookup(i * TRIG_MAX_ANGLE / KALG_FFT_WIDTH) for the first
+// quarter wave, i = 0 .. KALG_FFT_WIDTH / 4. The cosine of the same angle is the entry mirrored
+// around the quarter wave. These are exactly the values returned by sin_lookup() and
+// cos_lookup() for these angles, which keeps kalg_fft_real() bit-exact with the original
+// implementation that called them for every butterfly.
+static const int32_t s_fft_quarter_sin[KALG_FFT_WIDTH / 4 + 1] = {
+  0, 3215, 6423, 9616, 12785, 15923, 19024, 22078, 25079, 28020, 30893, 33692, 36409, 39039,
+  41575, 44010, 46340, 48558, 50659, 52638, 54490, 56211, 57797, 59243, 60546, 61704, 62713,
+  63571, 64276, 64825, 65219, 65456, 65535,
+};
+
+// Index pairs that are exchanged by the bit-reversal permutation of a KALG_FFT_WIDTH array
+static const uint8_t s_fft_bit_reverse_swaps[][2] = {
+  {1, 64}, {2, 32}, {3, 96}, {4, 16}, {5, 80}, {6, 48}, {7, 112}, {9, 72}, {10, 40},
+  {11, 104}, {12, 24}, {13, 88}, {14, 56}, {15, 120}, {17, 68}, {18, 36}, {19, 100}, {21, 84},
+  {22, 52}, {23, 116}, {25, 76}, {26, 44}, {27, 108}, {29, 92}, {30, 60}, {31, 124}, {33, 66},
+  {35, 98}, {37, 82}, {38, 50}, {39, 114}, {41, 74}, {43, 106}, {45, 90}, {46, 58}, {47, 122},
+  {49, 70}, {51, 102}, {53, 86}, {55, 118}, {57, 78}, {59, 110}, {61, 94}, {63, 126}, {67, 97},
+  {69, 81}, {71, 113}, {75, 105}, {77, 89}, {79, 121}, {83, 101}, {87, 117}, {91, 109},
+  {95, 125}, {103, 115}, {111, 123},
+};
+
+_Static_assert(KALG_FFT_WIDTH == 128, "FFT tables must be regenerated for a new KALG_FFT_WIDTH");
+
+
 // -----------------------------------------------------------------------------------------
 // Real-valued, in-place, 2-radix Fourier transform
 //
@@ -507,80 +530,80 @@ static uint32_t prv_real_counts_from_raw(uint32_t raw) {
 //   function and the floating point equivalents that are not important for its
 //   use here, but nonetheless documented in the accompaning Julia test code.
 //
+//   This runs on every axis of every epoch, 24 hours a day, so it is specialized for
+//   KALG_FFT_WIDTH: the bit-reversal permutation and the twiddle factors come from the
+//   precomputed tables above instead of being recomputed on every call. The butterflies and
+//   their rounding are unchanged, so the output is bit-exact with the original implementation
+//   (see fft_2radix_real() in the unit tests' reference code).
+//
 //   INPUT
-//     d = input signal array pointer
-//     width the width of d (must be a power of 2)
-//     width_log_2 the log base 2 of width: 2^width_log_2 = width
+//     d = input signal array pointer, KALG_FFT_WIDTH elements
 //
 //   OUTPUT
 //     d = fourier tranformed array pointer, with array of real coefficents of form
 //       [Re(0), Re(1),..., Re(N/2-1), Re(N/2), Im(N/2-1),..., Im(1)]
 //
-static void prv_fft_2radix_real(int16_t *d, int16_t width, int16_t width_log_2) {
-  int16_t n = width;
-  int16_t j = 1;
-  int16_t n1 = n -1;
-  int16_t k, dt;
-
-  for (int16_t i = 1; i <= n1; i++) {
-    if (i < j) {
-      dt = d[j-1];
-      d[j-1] = d[i-1];
-      d[i-1] = dt;
-    }
-    k = n/2;
-    while (k < j) {
-      j = j - k;
-      k = k / 2;
+void kalg_fft_real(int16_t *d) {
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_fft_bit_reverse_swaps); i++) {
+    const int a = s_fft_bit_reverse_swaps[i][0];
+    const int b = s_fft_bit_reverse_swaps[i][1];
+    const int16_t dt = d[a];
+    d[a] = d[b];
+    d[b] = dt;
+  }
+
+  for (int i = 0; i < KALG_FFT_WIDTH; i += 2) {
+    const int16_t dt = d[i];
+    d[i] = dt + d[i + 1];
+    d[i + 1] = dt - d[i + 1];
+  }
+
+  for (int n1 = 4; n1 <= KALG_FFT_WIDTH; n1 *= 2) {
+    const int n2 = n1 / 2;
+    const int n4 = n1 / 4;
+    // Step through the quarter wave table, which has KALG_FFT_WIDTH / 4 angle increments
+    const int stride = KALG_FFT_WIDTH / n1;
+
+    for (int i = 0; i < KALG_FFT_WIDTH; i += n1) {
+      const int16_t dt = d[i];
+      d[i] = dt + d[i + n2];
+      d[i + n2] = dt - d[i + n2];
+      d[i + n4 + n2] = -d[i + n4 + n2];
+
+      for (int j = 1; j < n4; j++) {
+        const int i1 = i + j;
+        const int i2 = i - j + n2;
+        const int i3 = i + j + n2;
+        const int i4 = i - j + n1;
+
+        const int32_t ss = s_fft_quarter_sin[j * stride];
+        const int32_t cc = s_fft_quarter_sin[KALG_FFT_WIDTH / 4 - j * stride];
+
+        const int16_t t1 = (int16_t) ((d[i3] * cc + d[i4] * ss) / TRIG_MAX_ANGLE);
+        const int16_t t2 = (int16_t) ((d[i3] * ss - d[i4] * cc) / TRIG_MAX_ANGLE);
+
+        d[i4] = d[i2] - t2;
+        d[i3] = -d[i2] - t2;
+        d[i2] = d[i1] - t1;
+        d[i1] = d[i1] + t1;
+      }
     }
-    j = j + k;
   }
+}
 
-  for (int16_t i = 1; i <= n; i += 2) {
-    dt = d[i-1];
-    d[i-1] = dt + d[i];
-    d[i] = dt - d[i];
-  }
-
-  int16_t n2 = 1;
-  int16_t n4, i1, i2, i3, i4, t1, t2;
-  int32_t E, A, ss, cc;
-
-  for (int16_t k = 2; k <= width_log_2 ; k++) {
-    n4 = n2;
-    n2 = 2 * n4;
-    n1 = 2 * n2;
-    E = TRIG_MAX_ANGLE / n1;
-
-    for (int16_t i = 1; i<= n; i+=n1) {
-      dt = d[i-1];
-      d[i-1] = dt + d[i+n2-1];
-      d[i+n2-1] = dt - d[i+n2-1];
-      d[i+n4+n2-1] = -1 * d[i+n4+n2-1];
-      A = E;
-      for (int16_t j = 1; j <= (n4-1); j++) {
-        i1 = i + j;
-        i2 = i - j + n2;
-        i3 = i + j + n2;
-        i4 = i - j + n1;
-
-        ss = sin_lookup(A);
-        cc = cos_lookup(A);
-
-        A = A + E;
-
-        t1 = (int16_t) ((d[i3-1] * cc + d[i4-1] * ss) / TRIG_MAX_ANGLE);
-        t2 = (int16_t) ((d[i3-1] * ss - d[i4-1] * cc) / TRIG_MAX_ANGLE);
+#if UNITTEST
+// The unit tests can substitute the reference FFT to compare step counts against it
+static KAlgFFTImplementation s_fft_implementation = kalg_fft_real;
 
-        d[i4-1] = d[i2-1] - t2;
-        d[i3-1] = -d[i2-1] - t2;
-        d[i2-1] = d[i1-1] - t1;
-        d[i1-1] = d[i1-1] + t1;
-      }
-    }
-  }
+void kalg_set_fft_implementation(KAlgFFTImplementation implementation) {
+  s_fft_implementation = implementation ? implementation : kalg_fft_real;
 }
 
+#define KALG_FFT_REAL(d) s_fft_implementation(d)
+#else
+#define KALG_FFT_REAL(d) kalg_fft_real(d)
+#endif
+
 
 // -----------------------------------------------------------------------------------------
 // Evaluate the magnitude of the FFT coefficents and write back to the first width/2 elements
@@ -658,8 +681,7 @@ static void prv_log_axis_magnitudes(const char *type_str, int16_t *d, int16_t st
 
 
 // -----------------------------------------------------------------------------------------
-static void prv_get_fftmag_0pad_mean0(int16_t *d, int16_t num_samples, int16_t fft_width,
-                                      int16_t fft_width_log_2, int16_t input_scale) {
+static void prv_get_fftmag_0pad_mean0(int16_t *d, int16_t num_samples, int16_t input_scale) {
   // reduce input magnitudes before taking FFT
   for (int16_t i = 0; i < num_samples; i++) {
     d[i] = d[i] / input_scale;
@@ -670,16 +692,16 @@ static void prv_get_fftmag_0pad_mean0(int16_t *d, int16_t num_samples, int16_t f
   for (int16_t i = 0 ; i < num_samples; i++) {
     d[i] = d[i] - mean;
   }
-  for (int16_t i = num_samples ; i < fft_width; i++) {
+  for (int16_t i = num_samples ; i < KALG_FFT_WIDTH; i++) {
     d[i] = 0;
   }
 
   // Compute the FFT coefficients
-  prv_fft_2radix_real(d, fft_width, fft_width_log_2);
+  KALG_FFT_REAL(d);
 
-  // Evaluate the magnitude of the coefficents and write back to the first fft_width/2
+  // Evaluate the magnitude of the coefficents and write back to the first KALG_FFT_WIDTH/2
   // elements
-  prv_fft_mag(d, fft_width);
+  prv_fft_mag(d, KALG_FFT_WIDTH);
 }
 
 
@@ -1191,8 +1213,8 @@ static uint32_t prv_analyze_epoch(KAlgState *state) {
     prv_log_axis_magnitudes("accel-after", &state->accel_samples[axis][0], 0,
                             state->num_samples - 1 /*index of last element*/);
 
-    prv_get_fftmag_0pad_mean0(&state->accel_samples[axis][0], state->num_samples, KALG_FFT_WIDTH,
-                              KALG_FFT_WIDTH_PWR_TWO, KALG_FFT_SCALE);
+    prv_get_fftmag_0pad_mean0(&state->accel_samples[axis][0], state->num_samples,
+                              KALG_FFT_SCALE);
 
     prv_log_axis_magnitudes("fft-axis", &state->accel_samples[axis][0], 0,
                             KALG_FFT_WIDTH / 2 - 1 /*index of last element*/);
@@ -29,6 +29,10 @@ typedef struct KAlgState KAlgState;
 // should be: KALG_SLEEP_PARAMS.max_wake_minutes_early + KALG_SLEEP_HALF_WIDTH + 1
 #define KALG_MAX_UNCERTAIN_SLEEP_M 19
 
+// Width of the FFT computed for each axis of an epoch.
+// 2^7 = 128 elements > 125 to allow fft
+#define KALG_FFT_WIDTH  128
+
 // Activity types, used in KAlgSleepSessionCallback callback
 typedef enum {
   // ActivityType_Sleep encapsulates an entire sleep session from sleep entry to wake, and
@@ -149,3 +153,17 @@ void kalg_get_sleep_stats(KAlgState *state, KAlgOngoingSleepStats *stats);
 //! Tells the algorithm whether or not it should automatically track activities
 //! @param enable true to start tracking, false to stop tracking
 void kalg_enable_activity_tracking(KAlgState *kalg_state, bool enable);
+
+// Compute the in-place, fixed-point, real-valued FFT that the step algorithm runs on each axis
+// of every epoch. The output is bit-exact with the original radix-2 implementation.
+// @param[in,out] d KALG_FFT_WIDTH input samples on entry. On exit, the coefficients in the form
+//   [Re(0), Re(1),..., Re(N/2-1), Re(N/2), Im(N/2-1),..., Im(1)]
+void kalg_fft_real(int16_t *d);
+
+#if UNITTEST
+typedef void (*KAlgFFTImplementation)(int16_t *d);
+
+// Used by unit tests - make kalg_analyze_samples() use a different FFT implementation so that
+// its step counts can be compared against kalg_fft_real(). Pass NULL to restore the default.
+void kalg_set_fft_implementation(KAlgFFTImplementation implementation);
+#endif
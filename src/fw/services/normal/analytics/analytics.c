@@ -131,6 +131,42 @@ void analytics_add(AnalyticsMetric metric, int64_t amount, AnalyticsClient clien
   analytics_add_for_uuid(metric, amount, analytics_uuid_for_client(client));
 }
 
+///////////////////
+// Batched Counters
+static AnalyticsBatchedCounter *s_batched_counters = NULL;
+
+void analytics_batched_add(AnalyticsBatchedCounter *counter, uint32_t amount) {
+  if (!counter->registered) {
+    // Only the first increment takes the lock, to put the counter on our list
+    analytics_storage_take_lock();
+    if (!counter->registered) {
+      PBL_ASSERTN(analytics_metric_kind(counter->metric) == ANALYTICS_METRIC_KIND_DEVICE &&
+                  analytics_metric_is_unsigned(counter->metric));
+      counter->next = s_batched_counters;
+      s_batched_counters = counter;
+      counter->registered = true;
+    }
+    analytics_storage_give_lock();
+  }
+
+  __atomic_fetch_add(&counter->pending, amount, __ATOMIC_RELAXED);
+}
+
+void analytics_batched_inc(AnalyticsBatchedCounter *counter) {
+  analytics_batched_add(counter, 1);
+}
+
+void analytics_batched_counters_flush(void) {
+  PBL_ASSERTN(analytics_storage_has_lock());
+
+  for (AnalyticsBatchedCounter *counter = s_batched_counters; counter; counter = counter->next) {
+    const uint32_t pending = __atomic_exchange_n(&counter->pending, 0, __ATOMIC_RELAXED);
+    if (pending) {
+      analytics_add(counter->metric, pending, AnalyticsClient_System);
+    }
+  }
+}
+
 ///////////////////
 // Stopwatches
 static bool prv_is_stopwatch_for_metric(ListNode *found_node, void *data) {
@@ -45,4 +45,5 @@ void analytics_external_update(void) {
   analytics_external_collect_bt_chip_heartbeat();
   analytics_external_collect_kernel_heap_stats();
   analytics_external_collect_accel_samples_received();
+  analytics_external_collect_event_service_stats();
 }
@@ -192,6 +192,9 @@ void analytics_logging_system_task_cb(void *ignored) {
     extern void analytics_stopwatches_update(uint64_t current_ticks);
     analytics_stopwatches_update(current_ticks);
 
+    extern void analytics_batched_counters_flush(void);
+    analytics_batched_counters_flush();
+
     // Hijack the device_hb and app_hb heartbeats from analytics_storage.
     // After this point, we own the memory, so analytics_storage will not
     // modify it anymore. Thus, we do not need to hold the lock while
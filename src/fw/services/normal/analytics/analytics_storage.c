@@ -25,6 +25,8 @@
 #include "system/logging.h"
 #include "system/passert.h"
 
+#include <string.h>
+
 static PebbleRecursiveMutex *s_analytics_storage_mutex = NULL;
 
 static AnalyticsHeartbeat *s_device_heartbeat = NULL;
@@ -32,6 +34,20 @@ static AnalyticsHeartbeatList *s_app_heartbeat_list = NULL;
 
 #define MAX_APP_HEARTBEATS    8
 
+//! The app heartbeats are also kept in an open addressed hash table keyed by UUID, so finding one
+//! doesn't walk the list. Twice as many buckets as heartbeats keeps the probes short.
+#define APP_HEARTBEAT_TABLE_SIZE (2 * MAX_APP_HEARTBEATS)
+static AnalyticsHeartbeatList *s_app_heartbeat_table[APP_HEARTBEAT_TABLE_SIZE];
+
+//! Nearly every app metric is for the foreground app or worker, so we check their heartbeats
+//! before even hashing the UUID.
+typedef enum {
+  ForegroundSlot_App,
+  ForegroundSlot_Worker,
+  ForegroundSlotCount,
+} ForegroundSlot;
+static AnalyticsHeartbeatList *s_foreground_slots[ForegroundSlotCount];
+
 void analytics_storage_init(void) {
   s_analytics_storage_mutex = mutex_create_recursive();
   PBL_ASSERTN(s_analytics_storage_mutex);
@@ -75,16 +91,44 @@ AnalyticsHeartbeatList *analytics_storage_hijack_app_heartbeats() {
 
   AnalyticsHeartbeatList *apps = s_app_heartbeat_list;
   s_app_heartbeat_list = NULL;
+  memset(s_app_heartbeat_table, 0, sizeof(s_app_heartbeat_table));
+  memset(s_foreground_slots, 0, sizeof(s_foreground_slots));
   return apps;
 }
 
 ///////////
 // Search
-static bool prv_is_app_node_with_uuid(ListNode *found_node, void *data) {
-  const Uuid *searching_for_uuid = (const Uuid*)data;
-  AnalyticsHeartbeatList *app_node = (AnalyticsHeartbeatList*)found_node;
-  const Uuid *found_uuid = analytics_heartbeat_get_uuid(app_node->heartbeat);
-  return uuid_equal(searching_for_uuid, found_uuid);
+static bool prv_is_app_node_with_uuid(const AnalyticsHeartbeatList *app_node, const Uuid *uuid) {
+  return (app_node && uuid_equal(uuid, analytics_heartbeat_get_uuid(app_node->heartbeat)));
+}
+
+static uint32_t prv_app_table_index(const Uuid *uuid) {
+  // App UUIDs are random, so any of their bytes make for a good hash
+  uint32_t words[sizeof(Uuid) / sizeof(uint32_t)];
+  memcpy(words, uuid, sizeof(words));
+  return (words[0] ^ words[1] ^ words[2] ^ words[3]) % APP_HEARTBEAT_TABLE_SIZE;
+}
+
+//! @return The table bucket that holds the heartbeat for uuid, or the empty bucket it belongs in
+static AnalyticsHeartbeatList **prv_app_table_find(const Uuid *uuid) {
+  uint32_t index = prv_app_table_index(uuid);
+  // There are always more buckets than heartbeats, so we'll hit an empty one eventually
+  while (s_app_heartbeat_table[index] &&
+         !prv_is_app_node_with_uuid(s_app_heartbeat_table[index], uuid)) {
+    index = (index + 1) % APP_HEARTBEAT_TABLE_SIZE;
+  }
+  return &s_app_heartbeat_table[index];
+}
+
+static void prv_update_foreground_slots(AnalyticsHeartbeatList *app_node, const Uuid *uuid) {
+  const Uuid *app_uuid = analytics_uuid_for_client(AnalyticsClient_App);
+  if (app_uuid && uuid_equal(app_uuid, uuid)) {
+    s_foreground_slots[ForegroundSlot_App] = app_node;
+  }
+  const Uuid *worker_uuid = analytics_uuid_for_client(AnalyticsClient_Worker);
+  if (worker_uuid && uuid_equal(worker_uuid, uuid)) {
+    s_foreground_slots[ForegroundSlot_Worker] = app_node;
+  }
 }
 
 static AnalyticsHeartbeatList *prv_app_node_create(const Uuid *uuid) {
@@ -96,6 +140,31 @@ static AnalyticsHeartbeatList *prv_app_node_create(const Uuid *uuid) {
   return app_heartbeat_node;
 }
 
+static AnalyticsHeartbeatList *prv_app_node_find(const Uuid *uuid) {
+  for (int i = 0; i < ForegroundSlotCount; i++) {
+    if (prv_is_app_node_with_uuid(s_foreground_slots[i], uuid)) {
+      return s_foreground_slots[i];
+    }
+  }
+
+  AnalyticsHeartbeatList **bucket = prv_app_table_find(uuid);
+  AnalyticsHeartbeatList *app_node = *bucket;
+  if (!app_node) {
+    if (list_count((ListNode *)s_app_heartbeat_list) >= MAX_APP_HEARTBEATS) {
+      ANALYTICS_LOG_DEBUG("No more app heartbeat sessions available");
+      return NULL;
+    }
+    app_node = prv_app_node_create(uuid);
+    s_app_heartbeat_list = (AnalyticsHeartbeatList*)list_prepend(
+      (ListNode*)s_app_heartbeat_list, &app_node->node);
+    *bucket = app_node;
+  }
+
+  // Not in a slot, maybe the foreground app or worker changed since they were filled in
+  prv_update_foreground_slots(app_node, uuid);
+  return app_node;
+}
+
 const Uuid *analytics_uuid_for_client(AnalyticsClient client) {
   const PebbleProcessMd *md;
   if (client == AnalyticsClient_CurrentTask) {
@@ -150,19 +219,8 @@ AnalyticsHeartbeat *analytics_storage_find(AnalyticsMetric metric, const Uuid *u
         uuid = &uuid_system;
       }
     }
-    ListNode *node = list_find((ListNode*)s_app_heartbeat_list,
-                               prv_is_app_node_with_uuid, (void*)uuid);
-    AnalyticsHeartbeatList *app_node = (AnalyticsHeartbeatList*)node;
-    if (!app_node) {
-      if (list_count((ListNode *)s_app_heartbeat_list) >= MAX_APP_HEARTBEATS) {
-        ANALYTICS_LOG_DEBUG("No more app heartbeat sessions available");
-        return NULL;
-      }
-      app_node = prv_app_node_create(uuid);
-      s_app_heartbeat_list = (AnalyticsHeartbeatList*)list_prepend(
-        (ListNode*)s_app_heartbeat_list, &app_node->node);
-    }
-    return app_node->heartbeat;
+    AnalyticsHeartbeatList *app_node = prv_app_node_find(uuid);
+    return (app_node ? app_node->heartbeat : NULL);
   }
   default:
     WTF;
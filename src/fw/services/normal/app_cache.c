@@ -21,12 +21,12 @@
 #include "kernel/pebble_tasks.h"
 #include "process_management/app_install_manager.h"
 #include "process_management/app_storage.h"
+#include "services/common/new_timer/new_timer.h"
 #include "services/common/system_task.h"
 #include "services/normal/blob_db/pin_db.h"
 #include "services/normal/filesystem/app_file.h"
 #include "services/normal/filesystem/pfs.h"
 #include "services/normal/settings/settings_file.h"
-#include "services/normal/settings/settings_file.h"
 #include "shell/normal/quick_launch.h"
 #include "shell/normal/watchface.h"
 #include "shell/prefs.h"
@@ -38,6 +38,8 @@
 #include "util/time/time.h"
 #include "util/units.h"
 
+#include <string.h>
+
 //! @file app_cache.c
 //! App Cache
 
@@ -56,6 +58,13 @@
 //! It is assumed that there will ALWAYS be space for a single application of maximum size based
 //! on the platform. The only time when this isn't true is the time between "add_entry" and the
 //! callback to clean up the cache.
+//!
+//! All entries are loaded into a RAM index when the cache is initialized. The index is a binary
+//! min-heap ordered by eviction priority, so lookups and eviction decisions never touch flash.
+//! Installs and removals are written through to the settings file right away. Launches only
+//! update the index; their launch count and timestamp are written back in one batch a little
+//! while later. A reset before that batch is written only loses some launch statistics, which
+//! makes the affected apps look a bit less recently used.
 
 #define APP_CACHE_FILE_NAME "appcache"
 
@@ -75,6 +84,11 @@
 // 4 quick launch apps, 1 default watchface, 1 default worker
 #define DO_NOT_EVICT_LIST_SIZE (NUM_BUTTONS + 2)
 
+//! How long launch statistics may stay in RAM only before they get written back to flash
+#define APP_CACHE_SYNC_DELAY_MS (60 * 1000)
+
+#define APP_CACHE_INDEX_MIN_CAPACITY 8
+
 static PebbleRecursiveMutex *s_app_cache_mutex = NULL;
 
 //! Actual data structure stored in flash about an app cache entry
@@ -85,66 +99,150 @@ typedef struct PACKED {
   uint16_t  launch_count;
 } AppCacheEntry;
 
+//! RAM copy of an app cache entry
 typedef struct {
-  ListNode node;
   AppInstallId id;
-  uint32_t size;
-  uint32_t priority;
-} EvictListNode;
-
+  uint32_t total_size;
+  time_t install_date;
+  time_t last_launch;
+  //! Launches that haven't been written back to flash yet
+  uint16_t unsynced_launches;
+  //! Only used by the scratch copy app_cache_free_up_space() picks its victims from
+  bool do_not_evict;
+} AppCacheIndexEntry;
+
+//! Binary min-heap of entries, the root is the next entry to evict
 typedef struct {
-  EvictListNode *list;
-  uint32_t bytes_needed;
-  uint32_t bytes_in_list;
-  const AppInstallId do_not_evict[DO_NOT_EVICT_LIST_SIZE];
-} EachEvictData;
+  AppCacheIndexEntry *entries;
+  uint16_t count;
+  uint16_t capacity;
+} AppCacheIndex;
+
+static AppCacheIndex s_index;
+
+static TimerID s_sync_timer = TIMER_INVALID_ID;
 
 //! Takes the information given in entry and calculates a new priority for the app.
 //!
 //! Policy rules:
 //! 1. App that has least recently launched or been installed app is evicted.
-static uint32_t prv_calculate_priority(AppCacheEntry *entry) {
+static uint32_t prv_calculate_priority(const AppCacheIndexEntry *entry) {
+  if (entry->do_not_evict) {
+    // give them an extremely high priority so that we only remove them if we really NEED to
+    return MAX_PRIORITY;
+  }
   return (uint32_t) MAX(entry->last_launch, entry->install_date);
 }
 
-//! Comparator for EvictListNode
-static int evict_node_comparator(void *a, void *b) {
-  EvictListNode *a_node = (EvictListNode *)a;
-  EvictListNode *b_node = (EvictListNode *)b;
-
-  if (b_node->priority > a_node->priority) {
-    return 1;
-  } else if (b_node->priority < a_node->priority) {
-    return -1;
-  } else {
-    // bigger applications to have a lower priority
-    if (b_node->size < a_node->size) {
-      return 1;
-    } else if (b_node->size > a_node->size) {
-      return -1;
-    } else {
-      return 0;
+//! @return true if a should be evicted before b
+static bool prv_evict_before(const AppCacheIndexEntry *a, const AppCacheIndexEntry *b) {
+  const uint32_t a_priority = prv_calculate_priority(a);
+  const uint32_t b_priority = prv_calculate_priority(b);
+  if (a_priority != b_priority) {
+    return (a_priority < b_priority);
+  }
+  // bigger applications to have a lower priority
+  return (a->total_size > b->total_size);
+}
+
+//////////////////////
+// Index Helpers
+//////////////////////
+
+static void prv_index_swap(AppCacheIndex *index, int a, int b) {
+  const AppCacheIndexEntry temp = index->entries[a];
+  index->entries[a] = index->entries[b];
+  index->entries[b] = temp;
+}
+
+static void prv_index_sift_up(AppCacheIndex *index, int i) {
+  while (i > 0) {
+    const int parent = (i - 1) / 2;
+    if (!prv_evict_before(&index->entries[i], &index->entries[parent])) {
+      break;
     }
+    prv_index_swap(index, i, parent);
+    i = parent;
   }
 }
 
-//! Trim the applications with highest priority while still keeping (bytes_in_list > bytes_needed)
-static void prv_trim_top_priorities(EvictListNode **list_node, uint32_t *bytes_in_list,
-                                              uint32_t bytes_needed) {
-  EvictListNode *node = *list_node;
-  while (node) {
-    EvictListNode *temp = node;
-    if (node->size <= (*bytes_in_list - bytes_needed)) {
-      *bytes_in_list -= node->size;
-      node = (EvictListNode *)list_pop_head((ListNode *)node);
-      kernel_free(temp);
-    } else {
+static void prv_index_sift_down(AppCacheIndex *index, int i) {
+  while (true) {
+    const int left = (2 * i) + 1;
+    const int right = left + 1;
+    int first = i;
+    if (left < index->count && prv_evict_before(&index->entries[left], &index->entries[first])) {
+      first = left;
+    }
+    if (right < index->count && prv_evict_before(&index->entries[right], &index->entries[first])) {
+      first = right;
+    }
+    if (first == i) {
       break;
     }
+    prv_index_swap(index, i, first);
+    i = first;
   }
-  *list_node = node;
 }
 
+//! Restores the heap order after the priority of entry i changed
+static void prv_index_update(AppCacheIndex *index, int i) {
+  prv_index_sift_up(index, i);
+  prv_index_sift_down(index, i);
+}
+
+//! @return the position of the entry with the given id, or -1 if there is none
+static int prv_index_find(AppCacheIndex *index, AppInstallId id) {
+  for (int i = 0; i < index->count; i++) {
+    if (index->entries[i].id == id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void prv_index_insert(AppCacheIndex *index, const AppCacheIndexEntry *entry) {
+  if (index->count == index->capacity) {
+    const uint16_t capacity = MAX(APP_CACHE_INDEX_MIN_CAPACITY, index->capacity * 2);
+    AppCacheIndexEntry *entries = kernel_malloc_check(capacity * sizeof(AppCacheIndexEntry));
+    if (index->entries) {
+      memcpy(entries, index->entries, index->count * sizeof(AppCacheIndexEntry));
+      kernel_free(index->entries);
+    }
+    index->entries = entries;
+    index->capacity = capacity;
+  }
+  index->entries[index->count] = *entry;
+  prv_index_sift_up(index, index->count++);
+}
+
+//! Moves the root to the end of the entries and shrinks the heap to exclude it
+//! @return the entry that was the root
+static AppCacheIndexEntry *prv_index_pop(AppCacheIndex *index) {
+  index->count--;
+  prv_index_swap(index, 0, index->count);
+  prv_index_sift_down(index, 0);
+  return &index->entries[index->count];
+}
+
+static void prv_index_remove(AppCacheIndex *index, int i) {
+  index->count--;
+  if (i == index->count) {
+    return;
+  }
+  index->entries[i] = index->entries[index->count];
+  prv_index_update(index, i);
+}
+
+static void prv_index_reset(AppCacheIndex *index) {
+  kernel_free(index->entries);
+  *index = (AppCacheIndex) {};
+}
+
+//////////////////////
+// Helpers
+//////////////////////
+
 //! Check if we need to free up some space in the cache. If so, do it.
 static void prv_cleanup_app_cache_if_needed(void *data) {
   uint32_t pfs_space = get_available_pfs_space();
@@ -157,14 +255,18 @@ static void prv_cleanup_app_cache_if_needed(void *data) {
   }
 }
 
-static void prv_delete_cache_callback(void *data) {
-  app_cache_flush();
-}
-
 static void prv_delete_cached_files(void) {
   pfs_remove_files(is_app_file_name);
 }
 
+//! Drops all entries and the binaries that belong to them
+static void prv_clear(void) {
+  new_timer_stop(s_sync_timer);
+  prv_index_reset(&s_index);
+  pfs_remove(APP_CACHE_FILE_NAME);
+  prv_delete_cached_files();
+}
+
 static bool prv_is_in_list(AppInstallId id, const AppInstallId list[], uint8_t len) {
   for (unsigned int i = 0; i < len; i++) {
     if (list[i] == id) {
@@ -174,55 +276,109 @@ static bool prv_is_in_list(AppInstallId id, const AppInstallId list[], uint8_t l
   return false;
 }
 
+//! Writes the launch statistics that are only in the index back to the settings file
+static void prv_sync(void) {
+  mutex_lock_recursive(s_app_cache_mutex);
+  {
+    SettingsFile file;
+    status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
+    if (rv != S_SUCCESS) {
+      goto unlock;
+    }
+
+    for (int i = 0; i < s_index.count; i++) {
+      AppCacheIndexEntry *index_entry = &s_index.entries[i];
+      if (index_entry->unsynced_launches == 0) {
+        continue;
+      }
+
+      AppCacheEntry entry;
+      rv = settings_file_get(&file, (uint8_t *)&index_entry->id, sizeof(AppInstallId),
+          (uint8_t *)&entry, sizeof(AppCacheEntry));
+      if (rv == S_SUCCESS) {
+        entry.last_launch = index_entry->last_launch;
+        entry.launch_count += index_entry->unsynced_launches;
+        rv = settings_file_set(&file, (uint8_t *)&index_entry->id, sizeof(AppInstallId),
+            (uint8_t *)&entry, sizeof(AppCacheEntry));
+      }
+      if (rv != S_SUCCESS) {
+        PBL_LOG(LOG_LEVEL_WARNING, "Failed to sync launches of app id %"PRIu32": %"PRId32,
+                index_entry->id, rv);
+      }
+      index_entry->unsynced_launches = 0;
+    }
+
+    settings_file_close(&file);
+  }
+unlock:
+  mutex_unlock_recursive(s_app_cache_mutex);
+}
+
+static void prv_sync_system_task_cb(void *unused) {
+  prv_sync();
+}
+
+static void prv_sync_timer_cb(void *unused) {
+  // Don't hold up the timer task with flash writes
+  system_task_add_callback_coalesced(prv_sync_system_task_cb, NULL);
+}
+
 //////////////////////
 // Settings Helpers
 //////////////////////
 
-//! Settings iterator function that finds the entry with the lowest calculated priority
-static bool prv_each_free_up_space(SettingsFile *file, SettingsRecordInfo *info, void *context) {
+typedef struct {
+  AppCacheIndex *index;
+  bool is_corrupt;
+} EachBuildIndexData;
+
+//! Settings iterator function that adds each entry to the index
+static bool prv_each_build_index(SettingsFile *file, SettingsRecordInfo *info, void *context) {
+  EachBuildIndexData *data = (EachBuildIndexData *)context;
+
   // check entry is valid
   if ((info->key_len != sizeof(AppInstallId)) || (info->val_len != sizeof(AppCacheEntry))) {
     PBL_LOG(LOG_LEVEL_WARNING,
             "Invalid cache entry with key_len: %u and val_len: %u, flushing",
             info->key_len, info->val_len);
-    system_task_add_callback(prv_delete_cache_callback, NULL);
+    data->is_corrupt = true;
     return false; // stop iterating, delete the file and binaries
   }
 
-  EachEvictData *data = (EachEvictData *)context;
-
   AppInstallId id;
   AppCacheEntry entry;
 
   info->get_key(file, (uint8_t *)&id, info->key_len);
   info->get_val(file, (uint8_t *)&entry, info->val_len);
 
-  // create node
-  EvictListNode *node = kernel_malloc_check(sizeof(EvictListNode));
-  list_init((ListNode *)node);
-
-  // give them an extremely high priority so that we only remove them if we really NEED to
-  // This list contains defaults that we shouldn't be removing.
-  uint32_t priority = 0;
-  if (prv_is_in_list(id, data->do_not_evict, DO_NOT_EVICT_LIST_SIZE)) {
-    priority = MAX_PRIORITY;
-  }
-
-  *node = (EvictListNode) {
+  const AppCacheIndexEntry index_entry = {
     .id = id,
-    .size = entry.total_size,
-    .priority = MAX(priority, prv_calculate_priority(&entry)),
+    .total_size = entry.total_size,
+    .install_date = entry.install_date,
+    .last_launch = entry.last_launch,
   };
+  prv_index_insert(data->index, &index_entry);
 
-  data->list = (EvictListNode *)list_sorted_add((ListNode *)data->list, (ListNode *)node,
-      evict_node_comparator, false);
-  data->bytes_in_list += node->size;
+  return true; // continue iterating
+}
 
-  if (data->bytes_in_list > data->bytes_needed) {
-    prv_trim_top_priorities(&data->list, &data->bytes_in_list, data->bytes_needed);
+//! Loads every entry of the settings file into the index
+static void prv_build_index(void) {
+  SettingsFile file;
+  status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
+  if (rv != S_SUCCESS) {
+    return;
   }
 
-  return true; // continue iterating
+  EachBuildIndexData data = {
+    .index = &s_index,
+  };
+  settings_file_each(&file, prv_each_build_index, &data);
+  settings_file_close(&file);
+
+  if (data.is_corrupt) {
+    prv_clear();
+  }
 }
 
 //////////////////////////
@@ -232,31 +388,25 @@ static bool prv_each_free_up_space(SettingsFile *file, SettingsRecordInfo *info,
 //! Updates metadata within the cache entry for the given AppInstallId. Will update such fields as
 //! launch count, last launch, and priority
 status_t app_cache_app_launched(AppInstallId app_id) {
-  status_t rv;
+  status_t rv = S_SUCCESS;
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    SettingsFile file;
-    rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
+    const int i = prv_index_find(&s_index, app_id);
+    if (i < 0) {
+      app_storage_delete_app(app_id);
+      rv = E_DOES_NOT_EXIST;
       goto unlock;
     }
 
-    AppCacheEntry entry = { 0 };
-    rv = settings_file_get(&file, (uint8_t *)&app_id, sizeof(AppInstallId),
-        (uint8_t *)&entry, sizeof(AppCacheEntry));
-
-    if (rv == S_SUCCESS) {
-      entry.last_launch = rtc_get_time();
-      entry.launch_count += 1;
+    AppCacheIndexEntry *entry = &s_index.entries[i];
+    entry->last_launch = rtc_get_time();
+    entry->unsynced_launches += 1;
+    prv_index_update(&s_index, i);
 
-      rv = settings_file_set(&file, (uint8_t *)&app_id, sizeof(AppInstallId),
-          (uint8_t *)&entry, sizeof(AppCacheEntry));
-    } else {
-      app_storage_delete_app(app_id);
-      settings_file_delete(&file, (uint8_t *)&app_id, sizeof(AppInstallId));
+    if (!new_timer_scheduled(s_sync_timer, NULL)) {
+      new_timer_start(s_sync_timer, APP_CACHE_SYNC_DELAY_MS, prv_sync_timer_cb, NULL,
+                      0 /* flags */);
     }
-
-    settings_file_close(&file);
   }
 unlock:
   mutex_unlock_recursive(s_app_cache_mutex);
@@ -270,103 +420,90 @@ status_t app_cache_free_up_space(uint32_t bytes_needed) {
     return E_INVALID_ARGUMENT;
   }
 
-  status_t rv;
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    SettingsFile file;
-    rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
+    if (s_index.count == 0) {
       goto unlock;
     }
 
     // we don't want to remove any default apps or quick launch apps, so keep them in a list.
-    EachEvictData evict_data = (EachEvictData) {
-      .bytes_needed = bytes_needed,
-      .do_not_evict = {
+    const AppInstallId do_not_evict[DO_NOT_EVICT_LIST_SIZE] = {
 #if !SHELL_SDK
-        quick_launch_get_app(BUTTON_ID_UP),
-        quick_launch_get_app(BUTTON_ID_SELECT),
-        quick_launch_get_app(BUTTON_ID_DOWN),
-        quick_launch_get_app(BUTTON_ID_BACK),
+      quick_launch_get_app(BUTTON_ID_UP),
+      quick_launch_get_app(BUTTON_ID_SELECT),
+      quick_launch_get_app(BUTTON_ID_DOWN),
+      quick_launch_get_app(BUTTON_ID_BACK),
 #endif
-        watchface_get_default_install_id(),
-        worker_preferences_get_default_worker(),
-      },
+      watchface_get_default_install_id(),
+      worker_preferences_get_default_worker(),
     };
 
-    settings_file_each(&file, prv_each_free_up_space, &evict_data);
-    settings_file_close(&file);
+    // Take entries off a copy of the index in priority order until they add up to enough space.
+    // The ones taken off end up at the back of the copy.
+    const size_t entries_size = s_index.count * sizeof(AppCacheIndexEntry);
+    AppCacheIndex candidates = {
+      .entries = kernel_malloc_check(entries_size),
+      .count = s_index.count,
+      .capacity = s_index.count,
+    };
+    memcpy(candidates.entries, s_index.entries, entries_size);
+    for (int i = 0; i < candidates.count; i++) {
+      AppCacheIndexEntry *entry = &candidates.entries[i];
+      entry->do_not_evict = prv_is_in_list(entry->id, do_not_evict, DO_NOT_EVICT_LIST_SIZE);
+    }
+    for (int i = (candidates.count / 2) - 1; i >= 0; i--) {
+      prv_index_sift_down(&candidates, i);
+    }
+
+    uint32_t bytes_found = 0;
+    while ((candidates.count > 0) && (bytes_found < bytes_needed)) {
+      bytes_found += prv_index_pop(&candidates)->total_size;
+    }
 
-    // remove all nodes found
-    EvictListNode *node = evict_data.list;
-    while (node) {
-      EvictListNode *temp = node;
+    // remove all entries found
+    for (int i = candidates.count; i < candidates.capacity; i++) {
+      const AppCacheIndexEntry *entry = &candidates.entries[i];
       PBL_LOG(LOG_LEVEL_DEBUG, "Deleting application binaries for app id: %"PRIu32", size: %"PRIu32,
-          node->id, node->size);
-      app_cache_remove_entry(node->id);
-      node = (EvictListNode *)list_pop_head((ListNode *)node);
-      kernel_free(temp);
+          entry->id, entry->total_size);
+      app_cache_remove_entry(entry->id);
     }
+    kernel_free(candidates.entries);
   }
 unlock:
   mutex_unlock_recursive(s_app_cache_mutex);
-  return rv;
+  return S_SUCCESS;
 }
 
 //////////////////////
 // AppCache Helpers
 //////////////////////
 
-// Remove the filename entry in the PFSFileList (via context) that corresponds to the
-// app install id passed in via info
-static bool prv_remove_matching_resource_file_callback(SettingsFile *file,
-                                                       SettingsRecordInfo *info,
-                                                       void *context) {
-  AppInstallId id;
-  // examine the SettingsRecordInfo and extract the AppInstallId from it
-  info->get_key(file, (uint8_t *)&id, info->key_len);
-  // the context passed in is really a pointer to the resource_list
-  PFSFileListEntry **resource_list = context;
+// Delete files from resource_list that don't correspond to entries in the app cache
+static void prv_app_cache_find_and_delete_orphans(PFSFileListEntry **resource_list) {
+  mutex_lock_recursive(s_app_cache_mutex);
+
+  // resource_list contains all of the resource files we found.  We only
+  // want to delete orphans so we can remove any entries from the list that correspond
+  // to items in the app cache...
   PFSFileListEntry *iter = *resource_list;
   while (iter) {
     // grab the next entry right now since we may delete the node we're looking at
     PFSFileListEntry *next = (PFSFileListEntry *)iter->list_node.next;
-    if (app_file_parse_app_id(iter->name) == id) {
-      // the AppInstallId of the file matches the one in the cache so we can remove this
+    if (prv_index_find(&s_index, app_file_parse_app_id(iter->name)) >= 0) {
+      // the AppInstallId of the file matches one in the cache so we can remove this
       // entry from the resource_list (since we don't want to delete it)
       // note: resource_list may be updated if we happen to remove the first entry in the list
       list_remove(&(iter->list_node), (ListNode**)resource_list, NULL);
       kernel_free(iter);  // free up the memory for the node we just removed
-      break; // we can quit now that we've found a match for this id
     }
     iter = next;
   }
-  return true;
-}
-
-// Delete files from resource_list that don't correspond to entries in the app cache
-static void prv_app_cache_find_and_delete_orphans(PFSFileListEntry **resource_list) {
-  mutex_lock_recursive(s_app_cache_mutex);
-
-  SettingsFile file;
-  status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-  if (rv != S_SUCCESS) {
-    mutex_unlock_recursive(s_app_cache_mutex);
-    return;
-  }
-  // resource_list contains all of the resource files we found.  We only
-  // want to delete orphans so we can remove any entries from the list that correspond
-  // to items in the app cache...
-  // prv_remove_matching_resource_file_callback scans resource_list and removes the entry
-  // corresponding to the passed-in application's id
-  settings_file_each(&file, prv_remove_matching_resource_file_callback, resource_list);
-  settings_file_close(&file);
 
   mutex_unlock_recursive(s_app_cache_mutex);
 
   // resource_list now only contains filenames of resource files that don't have corresponding
   // entries in the app cache. We can safely delete these files.
-  PFSFileListEntry *iter = *resource_list;
+  iter = *resource_list;
   while (iter) {
     PBL_LOG(LOG_LEVEL_INFO, "Orphaned resource file removed: %s", iter->name);
     pfs_remove(iter->name);
@@ -393,9 +530,12 @@ static void prv_purge_orphaned_resource_files(void) {
 //! Set up the app cache
 void app_cache_init(void) {
   s_app_cache_mutex = mutex_create_recursive();
+  s_sync_timer = new_timer_create();
 
   mutex_lock_recursive(s_app_cache_mutex);
   {
+    prv_index_reset(&s_index);
+
     // if no cache file exists, then we should go ahead and clean up any files that are left over
     int fd = pfs_open(APP_CACHE_FILE_NAME, OP_FLAG_READ, FILE_TYPE_STATIC, 0);
     if (fd < 0) {
@@ -403,6 +543,8 @@ void app_cache_init(void) {
       goto unlock;
     }
     pfs_close(fd);
+
+    prv_build_index();
   }
 
 unlock:
@@ -434,6 +576,22 @@ status_t app_cache_add_entry(AppInstallId app_id, uint32_t total_size) {
 
     settings_file_close(&file);
 
+    if (rv == S_SUCCESS) {
+      const AppCacheIndexEntry index_entry = {
+        .id = app_id,
+        .total_size = entry.total_size,
+        .install_date = entry.install_date,
+        .last_launch = entry.last_launch,
+      };
+      const int i = prv_index_find(&s_index, app_id);
+      if (i >= 0) {
+        s_index.entries[i] = index_entry;
+        prv_index_update(&s_index, i);
+      } else {
+        prv_index_insert(&s_index, &index_entry);
+      }
+    }
+
     // cleanup the cache if we need to
     system_task_add_callback(prv_cleanup_app_cache_if_needed, NULL);
   }
@@ -444,25 +602,21 @@ unlock:
 
 //! Tests if an entry with the given AppInstallId is in the cache
 bool app_cache_entry_exists(AppInstallId app_id) {
-  bool exists = false;
+  bool exists;
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    SettingsFile file;
-    status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
-      goto unlock;
-    }
-
-    exists = settings_file_exists(&file, (uint8_t *)&app_id, sizeof(AppInstallId));
+    exists = (prv_index_find(&s_index, app_id) >= 0);
 
     if (exists && !app_storage_app_exists(app_id)) {
-      settings_file_delete(&file, (uint8_t *)&app_id, sizeof(AppInstallId));
+      SettingsFile file;
+      if (settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE) == S_SUCCESS) {
+        settings_file_delete(&file, (uint8_t *)&app_id, sizeof(AppInstallId));
+        settings_file_close(&file);
+      }
+      prv_index_remove(&s_index, prv_index_find(&s_index, app_id));
       exists = false;
     }
-
-    settings_file_close(&file);
   }
-unlock:
   mutex_unlock_recursive(s_app_cache_mutex);
   return exists;
 }
@@ -485,6 +639,11 @@ status_t app_cache_remove_entry(AppInstallId app_id) {
     }
 
     settings_file_close(&file);
+
+    const int i = prv_index_find(&s_index, app_id);
+    if (i >= 0) {
+      prv_index_remove(&s_index, i);
+    }
   }
 
   if (rv == S_SUCCESS) {
@@ -507,8 +666,7 @@ void app_cache_flush(void) {
 
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    pfs_remove(APP_CACHE_FILE_NAME);
-    prv_delete_cached_files();
+    prv_clear();
   }
   mutex_unlock_recursive(s_app_cache_mutex);
 }
@@ -517,88 +675,27 @@ void app_cache_flush(void) {
 // Testing only
 ////////////////////////////////
 
-static bool prv_each_get_size(SettingsFile *file, SettingsRecordInfo *info, void *context) {
-  if ((info->key_len != sizeof(AppInstallId)) || (info->val_len != sizeof(AppCacheEntry))) {
-    return true; // continue iterating
-  }
-
-  uint32_t *cache_size = (uint32_t *)context;
-  AppCacheEntry entry;
-  info->get_val(file, (uint8_t *)&entry, info->val_len);
-  *cache_size += entry.total_size;
-
-  return true; // continue iterating
-}
-
 uint32_t app_cache_get_size(void) {
   uint32_t cache_size = 0;
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    SettingsFile file;
-    status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
-      goto unlock;
+    for (int i = 0; i < s_index.count; i++) {
+      cache_size += s_index.entries[i].total_size;
     }
-
-    settings_file_each(&file, prv_each_get_size, &cache_size);
-    settings_file_close(&file);
   }
-unlock:
   mutex_unlock_recursive(s_app_cache_mutex);
   return cache_size;
 }
 
-typedef struct {
-  AppInstallId id;
-  uint32_t priority;
-} AppCacheEachData;
-
-//! Settings iterator function that finds the entry with the lowest calculated priority
-static bool prv_each_min_priority(SettingsFile *file, SettingsRecordInfo *info, void *context) {
-  // check entry is valid
-  if ((info->key_len != sizeof(AppInstallId)) || (info->val_len != sizeof(AppCacheEntry))) {
-    return true; // continue iterating
-  }
-
-  AppCacheEachData *to_evict = (AppCacheEachData *)context;
-
-  AppInstallId id;
-  AppCacheEntry entry;
-
-  info->get_key(file, (uint8_t *)&id, info->key_len);
-  info->get_val(file, (uint8_t *)&entry, info->val_len);
-
-  uint32_t entry_priority = prv_calculate_priority(&entry);
-  if (entry_priority < to_evict->priority) {
-    to_evict->id = id;
-    to_evict->priority = entry_priority;
-  }
-
-  return true; // continue iterating
-}
-
 //! Find the entry in the app cache with the lowest calculated priority
 AppInstallId app_cache_get_next_eviction(void) {
   AppInstallId ret_value = INSTALL_ID_INVALID;
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    SettingsFile file;
-    status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
-      goto unlock;
+    if (s_index.count > 0) {
+      ret_value = s_index.entries[0].id;
     }
-
-    // set max so that any application will have a lower priority.
-    AppCacheEachData to_evict = {
-      .id = INSTALL_ID_INVALID,
-      .priority = MAX_PRIORITY,
-    };
-    settings_file_each(&file, prv_each_min_priority, (void *)&to_evict);
-
-    settings_file_close(&file);
-    ret_value = to_evict.id;
   }
-unlock:
   mutex_unlock_recursive(s_app_cache_mutex);
   return ret_value;
 }
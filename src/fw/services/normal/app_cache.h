@@ -45,6 +45,8 @@ status_t app_cache_remove_entry(AppInstallId app_id);
 bool app_cache_entry_exists(AppInstallId app_id);
 
 //! Increments data stored about an entry with the given AppInstallId in the AppCache
+//! The launch count and time are only written back to flash a little while later, along with
+//! those of any other apps launched in the meantime.
 status_t app_cache_app_launched(AppInstallId app_id);
 
 //! Ask the app cache to free up n bytes in case other parts of the system need room in the
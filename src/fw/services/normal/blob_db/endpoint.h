@@ -36,5 +36,18 @@ BlobDBToken blob_db_endpoint_send_writeback(BlobDBId db_id,
                                             const void *val,
                                             int val_len);
 
+//! Send a write (or WB, if writeback is set) message for the given blob db item. The value is
+//! read out of the database straight into the outgoing message instead of a temporary copy.
+//! @param val_len the length of the item's value, as returned by blob_db_get_len()
+//! @param[out] token_out the blob db transaction token
+//! @returns S_SUCCESS, or the error from reading the item. Nothing is sent in the latter case.
+status_t blob_db_endpoint_send_item(BlobDBId db_id,
+                                    bool writeback,
+                                    time_t last_updated,
+                                    const void *key,
+                                    int key_len,
+                                    int val_len,
+                                    BlobDBToken *token_out);
+
 //! Indicate that blob db sync is done for a given db id
 void blob_db_endpoint_send_sync_done(BlobDBId db_id);
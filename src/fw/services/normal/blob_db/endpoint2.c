@@ -142,7 +142,7 @@ static void prv_handle_wb_write_response(const uint8_t *data,
   BlobDBSyncSession *sync_session = blob_db_sync_get_session_for_token(token);
   if (sync_session) {
     if (response_code == BLOB_DB_SUCCESS) {
-      blob_db_sync_next(sync_session);
+      blob_db_sync_next(sync_session, token);
     } else {
       blob_db_sync_cancel(sync_session);
     }
@@ -239,13 +239,15 @@ static void prv_blob_db_msg_decode_and_handle(
   }
 }
 
-static uint16_t prv_send_write_writeback(BlobDBCommand cmd,
-                                         BlobDBId db_id,
-                                         time_t last_updated,
-                                         const uint8_t *key,
-                                         int key_len,
-                                         const uint8_t *val,
-                                         int val_len) {
+//! Starts a write or writeback message and writes everything up to the value into it.
+//! @return the send buffer, ready for val_len bytes of value to be written into it
+static SendBuffer *prv_begin_write_writeback(BlobDBCommand cmd,
+                                             BlobDBId db_id,
+                                             time_t last_updated,
+                                             const uint8_t *key,
+                                             int key_len,
+                                             int val_len,
+                                             BlobDBToken *token_out) {
   struct PACKED WritebackMetadata {
     BlobDBCommand cmd;
     BlobDBToken token;
@@ -257,6 +259,7 @@ static uint16_t prv_send_write_writeback(BlobDBCommand cmd,
     .db_id = db_id,
     .last_updated = last_updated,
   };
+  *token_out = writeback_metadata.token;
 
   size_t writeback_length = sizeof(writeback_metadata) +
                             sizeof(uint8_t) /* key length size*/ +
@@ -273,11 +276,27 @@ static uint16_t prv_send_write_writeback(BlobDBCommand cmd,
     comm_session_send_buffer_write(sb, (uint8_t *)&key_len, sizeof(uint8_t));
     comm_session_send_buffer_write(sb, key, key_len);
     comm_session_send_buffer_write(sb, (uint8_t *)&val_len, sizeof(uint16_t));
+  }
+
+  return sb;
+}
+
+static uint16_t prv_send_write_writeback(BlobDBCommand cmd,
+                                         BlobDBId db_id,
+                                         time_t last_updated,
+                                         const uint8_t *key,
+                                         int key_len,
+                                         const uint8_t *val,
+                                         int val_len) {
+  BlobDBToken token;
+  SendBuffer *sb = prv_begin_write_writeback(cmd, db_id, last_updated, key, key_len, val_len,
+                                             &token);
+  if (sb) {
     comm_session_send_buffer_write(sb, val, val_len);
     comm_session_send_buffer_end_write(sb);
   }
 
-  return writeback_metadata.token;
+  return token;
 }
 
 BlobDBToken blob_db_endpoint_send_write(BlobDBId db_id,
@@ -304,6 +323,37 @@ BlobDBToken blob_db_endpoint_send_writeback(BlobDBId db_id,
   return token;
 }
 
+status_t blob_db_endpoint_send_item(BlobDBId db_id,
+                                    bool writeback,
+                                    time_t last_updated,
+                                    const void *key,
+                                    int key_len,
+                                    int val_len,
+                                    BlobDBToken *token_out) {
+  const BlobDBCommand cmd = writeback ? BLOB_DB_COMMAND_WRITEBACK : BLOB_DB_COMMAND_WRITE;
+  SendBuffer *sb = prv_begin_write_writeback(cmd, db_id, last_updated, key, key_len, val_len,
+                                             token_out);
+  if (!sb) {
+    // Same as when the message gets lost on the way, the sync will time out
+    return S_SUCCESS;
+  }
+
+  uint8_t *val = comm_session_send_buffer_claim(sb, val_len);
+  if (!val) {
+    PBL_LOG(LOG_LEVEL_ERROR, "Item of %d bytes doesn't fit in the message", val_len);
+    comm_session_send_buffer_abort_write(sb);
+    return E_OUT_OF_RESOURCES;
+  }
+  const status_t status = blob_db_read(db_id, key, key_len, val, val_len);
+  if (FAILED(status)) {
+    comm_session_send_buffer_abort_write(sb);
+    return status;
+  }
+
+  comm_session_send_buffer_end_write(sb);
+  return S_SUCCESS;
+}
+
 void blob_db_endpoint_send_sync_done(BlobDBId db_id) {
   struct PACKED SyncDoneMsg {
     BlobDBCommand cmd;
@@ -23,14 +23,27 @@
 #include "services/common/system_task.h"
 #include "system/logging.h"
 #include "util/list.h"
+#include "util/math.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 
 #define SYNC_TIMEOUT_SECONDS 30
 
 static BlobDBSyncSession *s_sync_sessions = NULL;
 
+static uint8_t s_window_size = BLOB_DB_SYNC_DEFAULT_WINDOW_SIZE;
+
+static int prv_find_in_flight_index(const BlobDBSyncSession *session, BlobDBToken token) {
+  for (int i = 0; i < session->num_in_flight; i++) {
+    if (session->in_flight[i].token == token) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 static bool prv_session_id_filter_callback(ListNode *node, void *data) {
   BlobDBId db_id = (BlobDBId)data;
   BlobDBSyncSession *session = (BlobDBSyncSession *)node;
@@ -43,12 +56,16 @@ static bool prv_session_id_filter_callback(ListNode *node, void *data) {
 static bool prv_session_token_filter_callback(ListNode *node, void *data) {
   uint16_t token = (uint16_t)(uintptr_t)data;
   BlobDBSyncSession *session = (BlobDBSyncSession *)node;
-  return session->current_token == token;
+  return prv_find_in_flight_index(session, token) >= 0;
 }
 
 static void prv_timeout_kernelbg_callback(void *data) {
-  PBL_LOG(LOG_LEVEL_INFO, "Blob DB Sync timeout");
   BlobDBSyncSession *session = data;
+  if (!list_contains((ListNode *)s_sync_sessions, (ListNode *)session)) {
+    // The session finished or got cancelled while this callback was waiting to run
+    return;
+  }
+  PBL_LOG(LOG_LEVEL_INFO, "Blob DB Sync timeout");
   blob_db_sync_cancel(session);
 }
 
@@ -56,60 +73,103 @@ static void prv_timeout_timer_callback(void *data) {
   system_task_add_callback(prv_timeout_kernelbg_callback, data);
 }
 
-static void prv_send_writeback(BlobDBSyncSession *session) {
-  // we want to write-back the first item in the dirty list
+static void prv_item_done(BlobDBSyncSession *session, BlobDBDirtyItem *dirty_item) {
+  blob_db_mark_synced(session->db_id, dirty_item->key, dirty_item->key_len);
+  kernel_free(dirty_item);
+}
+
+//! Takes the first item off the dirty list and sends it
+//! @return false if the session got cancelled
+static bool prv_send_next_item(BlobDBSyncSession *session) {
   BlobDBDirtyItem *dirty_item = session->dirty_list;
+  list_remove((ListNode *)dirty_item, (ListNode **)&session->dirty_list, NULL);
+
   int item_size = blob_db_get_len(session->db_id, dirty_item->key, dirty_item->key_len);
   if (item_size == 0) {
     // item got removed during the sync. Go to the next one
-    blob_db_sync_next(session);
-    return;
+    prv_item_done(session, dirty_item);
+    return true;
   }
 
   if (!comm_session_get_system_session()) {
     PBL_LOG(LOG_LEVEL_INFO, "Cancelling sync: No route to phone");
+    kernel_free(dirty_item);
     blob_db_sync_cancel(session);
-    return;
+    return false;
   }
 
-  // read item into a temporary buffer
-  void *item_buf = kernel_malloc_check(item_size);
-  status_t status = blob_db_read(session->db_id,
-                                 dirty_item->key,
-                                 dirty_item->key_len,
-                                 item_buf, item_size);
-  if (PASSED(status)) {
-    regular_timer_add_multisecond_callback(&session->timeout_timer, SYNC_TIMEOUT_SECONDS);
-  } else if (status == E_DOES_NOT_EXIST) {
+  regular_timer_add_multisecond_callback(&session->timeout_timer, SYNC_TIMEOUT_SECONDS);
+
+  // The item gets read straight into the outgoing message
+  BlobDBToken token;
+  status_t status = blob_db_endpoint_send_item(session->db_id,
+                                               session->session_type == BlobDBSyncSessionTypeDB,
+                                               dirty_item->last_updated,
+                                               dirty_item->key,
+                                               dirty_item->key_len,
+                                               item_size,
+                                               &token);
+  if (status == E_DOES_NOT_EXIST) {
     // item was removed
-    blob_db_sync_next(session);
-  } else {
+    prv_item_done(session, dirty_item);
+    return true;
+  } else if (FAILED(status)) {
     // something went terribly wrong
     PBL_LOG(LOG_LEVEL_ERROR, "Failed to read blob DB during sync. Error code: 0x%"PRIx32, status);
+    kernel_free(dirty_item);
     blob_db_sync_cancel(session);
+    return false;
   }
 
-  // only one writeback in flight at a time
-  session->state = BlobDBSyncSessionStateWaitingForAck;
-
+  session->in_flight[session->num_in_flight++] = (BlobDBSyncInFlightItem) {
+    .item = dirty_item,
+    .token = token,
+  };
+  return true;
+}
 
+static void prv_finish_session(BlobDBSyncSession *session) {
+  PBL_LOG(LOG_LEVEL_INFO, "Finished syncing db %d, session type: %d", session->db_id,
+                                                                      session->session_type);
+  if (regular_timer_is_scheduled(&session->timeout_timer)) {
+    regular_timer_remove_callback(&session->timeout_timer);
+  }
   if (session->session_type == BlobDBSyncSessionTypeDB) {
-    session->current_token = blob_db_endpoint_send_writeback(session->db_id,
-                                                             dirty_item->last_updated,
-                                                             dirty_item->key,
-                                                             dirty_item->key_len,
-                                                             item_buf,
-                                                             item_size);
-  } else {
-    session->current_token = blob_db_endpoint_send_write(session->db_id,
-                                                         dirty_item->last_updated,
-                                                         dirty_item->key,
-                                                         dirty_item->key_len,
-                                                         item_buf,
-                                                         item_size);
+    // Only send the sync done when syncing an entire db
+    blob_db_endpoint_send_sync_done(session->db_id);
   }
+  list_remove((ListNode *)session, (ListNode **)&s_sync_sessions, NULL);
+  kernel_free(session);
+}
+
+//! Fills the window with items from the dirty list, or finishes the session once everything has
+//! been sent and acknowledged.
+static void prv_send_writebacks(BlobDBSyncSession *session) {
+  while (true) {
+    while (session->dirty_list && (session->num_in_flight < s_window_size)) {
+      if (!prv_send_next_item(session)) {
+        return;
+      }
+    }
 
-  kernel_free(item_buf);
+    if (session->num_in_flight > 0) {
+      session->state = BlobDBSyncSessionStateWaitingForAck;
+      return;
+    }
+    session->state = BlobDBSyncSessionStateIdle;
+
+    if (!session->dirty_list) {
+      // Check if new records became dirty while syncing the current list
+      // New records could have been added while we were syncing OR
+      // the list could be incomplete because we ran out of memory.
+      // Only do this once nothing is in flight, in flight items are still dirty.
+      session->dirty_list = blob_db_get_dirty_list(session->db_id);
+      if (!session->dirty_list) {
+        prv_finish_session(session);
+        return;
+      }
+    }
+  }
 }
 
 BlobDBSyncSession* prv_create_sync_session(BlobDBId db_id, BlobDBDirtyItem *dirty_list,
@@ -129,6 +189,10 @@ BlobDBSyncSession* prv_create_sync_session(BlobDBId db_id, BlobDBDirtyItem *dirt
   return session;
 }
 
+void blob_db_sync_set_window_size(uint8_t window_size) {
+  s_window_size = CLIP(window_size, 1, BLOB_DB_SYNC_MAX_WINDOW_SIZE);
+}
+
 //! Will not return sessions for individual records
 BlobDBSyncSession *blob_db_sync_get_session_for_id(BlobDBId db_id) {
   return (BlobDBSyncSession *)list_find((ListNode *)s_sync_sessions,
@@ -157,12 +221,13 @@ status_t blob_db_sync_db(BlobDBId db_id) {
   BlobDBSyncSession *session = blob_db_sync_get_session_for_id(db_id);
   if (session) {
     // already have a session in progress!
+    blob_db_util_free_dirty_list(dirty_list);
     return E_BUSY;
   }
 
   session = prv_create_sync_session(db_id, dirty_list, BlobDBSyncSessionTypeDB);
 
-  prv_send_writeback(session);
+  prv_send_writebacks(session);
 
   return S_SUCCESS;
 }
@@ -191,7 +256,7 @@ status_t blob_db_sync_record(BlobDBId db_id, const void *key, int key_len, time_
 
   session = prv_create_sync_session(db_id, dirty_list, BlobDBSyncSessionTypeRecord);
 
-  prv_send_writeback(session);
+  prv_send_writebacks(session);
 
   return S_SUCCESS;
 }
@@ -201,41 +266,28 @@ void blob_db_sync_cancel(BlobDBSyncSession *session) {
   if (regular_timer_is_scheduled(&session->timeout_timer)) {
     regular_timer_remove_callback(&session->timeout_timer);
   }
+  // Items which were in flight stay dirty and get synced next time
+  for (int i = 0; i < session->num_in_flight; i++) {
+    kernel_free(session->in_flight[i].item);
+  }
   blob_db_util_free_dirty_list(session->dirty_list);
   list_remove((ListNode *)session, (ListNode **)&s_sync_sessions, NULL);
   kernel_free(session);
 }
 
-void blob_db_sync_next(BlobDBSyncSession *session) {
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token) {
   PBL_LOG(LOG_LEVEL_DEBUG, "blob_db_sync_next");
-  BlobDBDirtyItem *dirty_item = session->dirty_list;
-  blob_db_mark_synced(session->db_id, dirty_item->key, dirty_item->key_len);
+  const int idx = prv_find_in_flight_index(session, token);
+  if (idx < 0) {
+    return;
+  }
 
-  // we're done with this item, we pop it off the stack
-  list_remove((ListNode *)dirty_item, (ListNode **)&session->dirty_list, NULL);
-  kernel_free(dirty_item);
+  // we're done with this item, take it out of the window
+  BlobDBDirtyItem *dirty_item = session->in_flight[idx].item;
+  session->num_in_flight--;
+  memmove(&session->in_flight[idx], &session->in_flight[idx + 1],
+          (session->num_in_flight - idx) * sizeof(BlobDBSyncInFlightItem));
+  prv_item_done(session, dirty_item);
 
-  if (session->dirty_list) {
-    prv_send_writeback(session);
-  } else {
-    // Check if new records became dirty while syncing the current list
-    // New records could have been added while we were syncing OR
-    // the list could be incomplete because we ran out of memory
-    session->dirty_list = blob_db_get_dirty_list(session->db_id);
-    if (session->dirty_list) {
-      prv_send_writeback(session);
-    } else {
-      PBL_LOG(LOG_LEVEL_INFO, "Finished syncing db %d, session type: %d", session->db_id,
-                                                                          session->session_type);
-      if (regular_timer_is_scheduled(&session->timeout_timer)) {
-        regular_timer_remove_callback(&session->timeout_timer);
-      }
-      if (session->session_type == BlobDBSyncSessionTypeDB) {
-        // Only send the sync done when syncing an entire db
-        blob_db_endpoint_send_sync_done(session->db_id);
-      }
-      list_remove((ListNode *)session, (ListNode **)&s_sync_sessions, NULL);
-      kernel_free(session);
-    }
-  }
+  prv_send_writebacks(session);
 }
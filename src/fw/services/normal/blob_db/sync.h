@@ -21,6 +21,13 @@
 
 #include "services/common/regular_timer.h"
 
+//! Maximum number of writebacks a sync session can have waiting for a response at once
+#define BLOB_DB_SYNC_MAX_WINDOW_SIZE 8
+
+#ifndef BLOB_DB_SYNC_DEFAULT_WINDOW_SIZE
+#define BLOB_DB_SYNC_DEFAULT_WINDOW_SIZE 4
+#endif
+
 typedef enum {
   BlobDBSyncSessionStateIdle = 0,
   BlobDBSyncSessionStateWaitingForAck = 1,
@@ -31,13 +38,22 @@ typedef enum {
   BlobDBSyncSessionTypeRecord,
 } BlobDBSyncSessionType;
 
+//! A dirty item which was sent to the phone and is waiting for a response
+typedef struct {
+  BlobDBDirtyItem *item;
+  BlobDBToken token;
+} BlobDBSyncInFlightItem;
+
 typedef struct {
   ListNode node;
   BlobDBSyncSessionState state;
   BlobDBId db_id;
+  //! Items which still need to be sent
   BlobDBDirtyItem *dirty_list;
   RegularTimerInfo timeout_timer;
-  BlobDBToken current_token;
+  //! Items which were sent, oldest first
+  BlobDBSyncInFlightItem in_flight[BLOB_DB_SYNC_MAX_WINDOW_SIZE];
+  uint8_t num_in_flight;
   BlobDBSyncSessionType session_type;
 } BlobDBSyncSession;
 
@@ -55,12 +71,17 @@ status_t blob_db_sync_record(BlobDBId db_id, const void *key, int key_len, time_
 //! returns NULL if no sync is in progress
 BlobDBSyncSession *blob_db_sync_get_session_for_id(BlobDBId db_id);
 
+//! Set how many writebacks a sync session may have waiting for a response at once. Sessions which
+//! are already running pick up the new size as they send their next items.
+//! @param window_size between 1 (stop-and-wait) and BLOB_DB_SYNC_MAX_WINDOW_SIZE
+void blob_db_sync_set_window_size(uint8_t window_size);
+
 //! Get the sync session currently waiting for a response with the given token
 //! return NULL if no sync is in progress
 BlobDBSyncSession *blob_db_sync_get_session_for_token(BlobDBToken token);
 
-//! Mark current item as synced and sync the next one
-void blob_db_sync_next(BlobDBSyncSession *session);
+//! Mark the item sent with the given token as synced and sync the next one
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token);
 
 //! Cancel the sync in progress. Pending items will be synced next time.
 void blob_db_sync_cancel(BlobDBSyncSession *session);
@@ -37,6 +37,7 @@
 #include "system/logging.h"
 #include "system/passert.h"
 #include "util/attributes.h"
+#include "util/list.h"
 #include "util/math.h"
 #include "util/string.h"
 
@@ -169,28 +170,134 @@ static void prv_update_bondings(BTBondingID id, BtPersistBondingType type) {
   }
 }
 
-//! Returns the size of the data read. If the buffer provided is too small then 0 is returned
-static int prv_file_get(const void *key, size_t key_len, void *data_out, size_t buf_len) {
-  unsigned int data_len = 0;
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//! RAM Mirror
+//!
+//! Every live record of the settings file is mirrored in RAM. The mirror is loaded once by
+//! bt_persistent_storage_init() and is authoritative from then on: lookups (which happen on every
+//! reconnect) never touch flash, writes go through to the file and only update the mirror once
+//! the file write has succeeded. Records are kept in file order and a rewritten record moves to
+//! the tail, just like it does in the settings file, so iterations that stop at the first match
+//! behave the same as they did when walking the file.
+//! @note prv_lock() must be held when accessing the mirror.
+
+typedef struct {
+  ListNode node;
+  uint8_t key_len;
+  uint16_t val_len;
+  //! key_len bytes of key, followed by val_len bytes of value
+  uint8_t data[];
+} BondingDBRecord;
+
+static BondingDBRecord *s_mirror_head = NULL;
+
+//! The record handed out by prv_mirror_get_key() / prv_mirror_get_val() while iterating
+static const BondingDBRecord *s_mirror_cursor = NULL;
+
+static uint8_t *prv_mirror_record_val(const BondingDBRecord *record) {
+  return (uint8_t *)&record->data[record->key_len];
+}
+
+static BondingDBRecord *prv_mirror_find(const void *key, size_t key_len) {
+  BondingDBRecord *record = s_mirror_head;
+  while (record) {
+    if (record->key_len == key_len && memcmp(record->data, key, key_len) == 0) {
+      return record;
+    }
+    record = (BondingDBRecord *)record->node.next;
+  }
+  return NULL;
+}
+
+static void prv_mirror_remove(BondingDBRecord *record) {
+  list_remove(&record->node, (ListNode **)&s_mirror_head, NULL);
+  kernel_free(record);
+}
+
+static BondingDBRecord *prv_mirror_append(const void *key, size_t key_len, size_t val_len) {
+  BondingDBRecord *record = kernel_malloc_check(sizeof(BondingDBRecord) + key_len + val_len);
+  *record = (BondingDBRecord) {
+    .key_len = key_len,
+    .val_len = val_len,
+  };
+  memcpy(record->data, key, key_len);
+  if (s_mirror_head) {
+    list_append(&s_mirror_head->node, &record->node);
+  } else {
+    s_mirror_head = record;
+  }
+  return record;
+}
+
+static void prv_mirror_set(const void *key, size_t key_len, const void *data_in, size_t data_len) {
+  BondingDBRecord *record = prv_mirror_find(key, key_len);
+  if (record) {
+    prv_mirror_remove(record);
+  }
+  if (data_in) {
+    record = prv_mirror_append(key, key_len, data_len);
+    memcpy(prv_mirror_record_val(record), data_in, data_len);
+  }
+}
+
+static void prv_mirror_get_key(SettingsFile *file, void *key, size_t key_len) {
+  PBL_ASSERTN(key_len <= s_mirror_cursor->key_len);
+  memcpy(key, s_mirror_cursor->data, key_len);
+}
+
+static void prv_mirror_get_val(SettingsFile *file, void *val, size_t val_len) {
+  PBL_ASSERTN(val_len <= s_mirror_cursor->val_len);
+  memcpy(val, prv_mirror_record_val(s_mirror_cursor), val_len);
+}
+
+static void prv_mirror_clear(void) {
+  while (s_mirror_head) {
+    prv_mirror_remove(s_mirror_head);
+  }
+}
+
+static bool prv_mirror_load_itr(SettingsFile *file, SettingsRecordInfo *info, void *context) {
+  // Deleted records linger in the file for a while, nobody is interested in them
+  if (info->key_len == 0 || info->val_len == 0) {
+    return true;
+  }
+  uint8_t key[info->key_len];
+  info->get_key(file, key, info->key_len);
+  BondingDBRecord *record = prv_mirror_append(key, info->key_len, info->val_len);
+  info->get_val(file, prv_mirror_record_val(record), info->val_len);
+  return true;
+}
+
+static void prv_mirror_load(void) {
   prv_lock();
   {
+    prv_mirror_clear();
+
     SettingsFile fd;
-    status_t rv = settings_file_open(&fd, BT_PERSISTENT_STORAGE_FILE_NAME,
-                                     BT_PERSISTENT_STORAGE_FILE_SIZE);
-    if (rv != S_SUCCESS) {
-      goto cleanup;
+    if (settings_file_open(&fd, BT_PERSISTENT_STORAGE_FILE_NAME,
+                           BT_PERSISTENT_STORAGE_FILE_SIZE) == S_SUCCESS) {
+      settings_file_each(&fd, prv_mirror_load_itr, NULL);
+      settings_file_close(&fd);
     }
+  }
+  prv_unlock();
+}
 
-    data_len = settings_file_get_len(&fd, key, key_len);
-    // If a big enough buffer wasn't passed in, then the data can't be read.
-    if (data_len > buf_len ||
-        settings_file_get(&fd, key, key_len, data_out, buf_len) != S_SUCCESS) {
-      data_len = 0;
+//! Returns the size of the data read. If the buffer provided is too small then 0 is returned
+//! @note Like settings_file_get(), the buffer is zeroed if the key does not exist or if the
+//! buffer is larger than the stored value.
+static int prv_file_get(const void *key, size_t key_len, void *data_out, size_t buf_len) {
+  unsigned int data_len = 0;
+  prv_lock();
+  {
+    const BondingDBRecord *record = prv_mirror_find(key, key_len);
+    if (!record || record->val_len < buf_len) {
+      memset(data_out, 0, buf_len);
+    } else if (record->val_len == buf_len) {
+      memcpy(data_out, prv_mirror_record_val(record), buf_len);
+      data_len = buf_len;
     }
-
-    settings_file_close(&fd);
   }
-cleanup:
   prv_unlock();
   return data_len;
 }
@@ -217,10 +324,19 @@ typedef enum {
 
 static GapBondingFileSetStatus prv_file_set(
     const void *key, size_t key_len, const void *data_in, size_t data_len) {
-  status_t rv;
+  status_t rv = S_SUCCESS;
   bool do_perform_update = true;
   prv_lock();
   {
+    // Don't bother rewriting the exact same info. Pairing info is precious,
+    // we want to minimize cases where we could mess it up
+    const BondingDBRecord *record = prv_mirror_find(key, key_len);
+    if (data_in && record && record->val_len == data_len &&
+        memcmp(prv_mirror_record_val(record), data_in, data_len) == 0) {
+      do_perform_update = false;
+      goto cleanup;
+    }
+
     SettingsFile fd;
     rv = settings_file_open(&fd, BT_PERSISTENT_STORAGE_FILE_NAME, BT_PERSISTENT_STORAGE_FILE_SIZE);
     if (rv != S_SUCCESS) {
@@ -229,30 +345,20 @@ static GapBondingFileSetStatus prv_file_set(
 
     // Only store data if data_in is a valid pointer, otherwise, clear the entry
     if (data_in) {
-      if (settings_file_get_len(&fd, key, key_len) == (int)data_len) {
-        uint8_t curr_val[data_len];
-
-        settings_file_get(&fd, key, key_len, &curr_val[0], data_len);
-
-        // Don't bother rewriting the exact same info. Pairing info is precious,
-        // we want to minimize cases where we could mess it up
-        if (memcmp(&curr_val, data_in, data_len) == 0) {
-          do_perform_update = false;
-        }
-      }
-
-      if (do_perform_update) {
-        s_bt_persistent_storage_updates++;
-        PBL_LOG_D(LOG_DOMAIN_BT_PAIRING_INFO, LOG_LEVEL_DEBUG,
-                  "Updating GAP Bonding DB Value <key, val>!");
-        PBL_HEXDUMP_D(LOG_DOMAIN_BT_PAIRING_INFO, LOG_LEVEL_DEBUG, (uint8_t *)key, key_len);
-        PBL_HEXDUMP_D(LOG_DOMAIN_BT_PAIRING_INFO, LOG_LEVEL_DEBUG, (uint8_t *)data_in, data_len);
-        rv = settings_file_set(&fd, key, key_len, (uint8_t*) data_in, data_len);
-      }
+      s_bt_persistent_storage_updates++;
+      PBL_LOG_D(LOG_DOMAIN_BT_PAIRING_INFO, LOG_LEVEL_DEBUG,
+                "Updating GAP Bonding DB Value <key, val>!");
+      PBL_HEXDUMP_D(LOG_DOMAIN_BT_PAIRING_INFO, LOG_LEVEL_DEBUG, (uint8_t *)key, key_len);
+      PBL_HEXDUMP_D(LOG_DOMAIN_BT_PAIRING_INFO, LOG_LEVEL_DEBUG, (uint8_t *)data_in, data_len);
+      rv = settings_file_set(&fd, key, key_len, (uint8_t*) data_in, data_len);
     } else {
       rv = settings_file_delete(&fd, key, key_len);
     }
     settings_file_close(&fd);
+
+    if (rv == S_SUCCESS) {
+      prv_mirror_set(key, key_len, data_in, data_len);
+    }
   }
 cleanup:
   prv_unlock();
@@ -264,23 +370,29 @@ cleanup:
   return (do_perform_update ? GapBondingFileSetUpdated : GapBondingFileSetNoUpdateNeeded);
 }
 
+//! Calls itr_cb for every record in the mirror, in file order. The callback gets a NULL file,
+//! which the getters in the SettingsRecordInfo don't need.
 //! Returns true if things were successful
 static bool prv_file_each(SettingsFileEachCallback itr_cb, void *itr_data) {
-  status_t rv;
   prv_lock();
   {
-    SettingsFile fd;
-    rv = settings_file_open(&fd, BT_PERSISTENT_STORAGE_FILE_NAME, BT_PERSISTENT_STORAGE_FILE_SIZE);
-    if (rv) {
-      goto cleanup;
+    for (const BondingDBRecord *record = s_mirror_head; record;
+         record = (const BondingDBRecord *)record->node.next) {
+      s_mirror_cursor = record;
+      SettingsRecordInfo info = {
+        .get_key = prv_mirror_get_key,
+        .key_len = record->key_len,
+        .get_val = prv_mirror_get_val,
+        .val_len = record->val_len,
+      };
+      if (!itr_cb(NULL, &info, itr_data)) {
+        break;
+      }
     }
-
-    settings_file_each(&fd, itr_cb, itr_data);
-    settings_file_close(&fd);
+    s_mirror_cursor = NULL;
   }
-cleanup:
   prv_unlock();
-  return (rv == S_SUCCESS);
+  return true;
 }
 
 
@@ -289,28 +401,26 @@ cleanup:
 //! apps. https://pebbletechnology.atlassian.net/browse/PBL-8391
 static BTBondingID prv_get_free_key() {
   BTBondingID free_key = BT_BONDING_ID_INVALID;
+  uint32_t used_ids[(BT_BONDING_ID_INVALID + 1) / 32] = {};
 
   prv_lock();
   {
-  SettingsFile fd;
-  status_t rv = settings_file_open(&fd, BT_PERSISTENT_STORAGE_FILE_NAME,
-                                   BT_PERSISTENT_STORAGE_FILE_SIZE);
-  if (rv) {
-    goto cleanup;
+    for (const BondingDBRecord *record = s_mirror_head; record;
+         record = (const BondingDBRecord *)record->node.next) {
+      if (record->key_len == sizeof(BTBondingID)) {
+        const BTBondingID id = record->data[0];
+        used_ids[id / 32] |= (1u << (id % 32));
+      }
+    }
   }
+  prv_unlock();
 
   for (BTBondingID id = 0; id < BT_BONDING_ID_INVALID; id++) {
-    if (!settings_file_exists(&fd, &id, sizeof(id))) {
+    if (!(used_ids[id / 32] & (1u << (id % 32)))) {
       free_key = id;
       break;
     }
   }
-
-  settings_file_close(&fd);
-
-  }
-cleanup:
-  prv_unlock();
   return free_key;
 }
 
@@ -1416,6 +1526,9 @@ void bt_persistent_storage_init(void) {
   // that tries to use the BT stack in this path.
   s_db_mutex = mutex_create();
 
+  // Everything below reads through the mirror, so it has to be loaded first
+  prv_mirror_load();
+
   prv_load_data_from_prf();
 
   // Load cached capability bits from flash
@@ -1436,7 +1549,7 @@ static void prv_delete_all_pairings_itr(SettingsFile *old_file, SettingsFile *ne
   void *data =  kernel_malloc_check(info->val_len);
   info->get_val(old_file, data, info->val_len);
 
-  settings_file_set(new_file, key, info->key_len, &data, info->val_len);
+  settings_file_set(new_file, key, info->key_len, data, info->val_len);
 
   kernel_free(key);
   kernel_free(data);
@@ -1449,12 +1562,24 @@ void bt_persistent_storage_delete_all_pairings(void) {
     status_t rv = settings_file_open(&fd, BT_PERSISTENT_STORAGE_FILE_NAME,
                                      BT_PERSISTENT_STORAGE_FILE_SIZE);
     if (rv) {
-      return;
+      goto cleanup;
     }
 
-    settings_file_rewrite(&fd, prv_delete_all_pairings_itr, NULL);
+    rv = settings_file_rewrite(&fd, prv_delete_all_pairings_itr, NULL);
     settings_file_close(&fd);
+
+    if (rv == S_SUCCESS) {
+      BondingDBRecord *record = s_mirror_head;
+      while (record) {
+        BondingDBRecord *next = (BondingDBRecord *)record->node.next;
+        if (record->key_len == sizeof(BTBondingID)) {
+          prv_mirror_remove(record);
+        }
+        record = next;
+      }
+    }
   }
+cleanup:
   prv_unlock();
 
   shared_prf_storage_erase_ble_pairing_data();
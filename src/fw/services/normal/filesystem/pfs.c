@@ -49,6 +49,16 @@ static PebbleRecursiveMutex *s_pfs_mutex = NULL;
 #define PFS_PAGES_PER_ERASE_SECTOR (SECTOR_SIZE_BYTES / PFS_PAGE_SIZE)
 #define GC_REGION_SIZE             SECTOR_SIZE_BYTES
 
+// pfs_compact() kicks in once fewer than PFS_COMPACT_LOW_WATER_PAGES pre-erased pages are left and
+// then garbage collects until PFS_COMPACT_RESERVE_PAGES are available again. This way allocating a
+// page for a write rarely has to wait on a garbage collection, while giving deleted pages time to
+// pile up so that each collection wins back as much space as possible
+#define PFS_COMPACT_LOW_WATER_PAGES (PFS_PAGES_PER_ERASE_SECTOR)
+#define PFS_COMPACT_RESERVE_PAGES   (2 * PFS_PAGES_PER_ERASE_SECTOR)
+// Garbage collection candidates which have been erased this many more times than the least worn
+// candidate are passed over so that the same sectors don't keep getting recycled
+#define PFS_WEAR_LEVEL_MAX_DELTA    16
+
 // The filesystem is broken into discrete blocks called 'pages'. Each page has
 // a header that describes the contents contained within it. Static fields are
 // CRC protected and are verified each time a file is opened. Convenience
@@ -231,6 +241,9 @@ typedef struct {
 } PFSFileChangedCallbackNode;
 
 static uint8_t *s_pfs_page_flags_cache = NULL;
+//! RAM mirror of the erase count of each erase sector. The counts themselves are persisted in the
+//! header of every page so this is rebuilt from flash whenever the filesystem size changes
+static uint32_t *s_pfs_sector_erase_counts = NULL;
 static uint16_t s_pfs_page_count = 0;
 static uint32_t s_pfs_size = 0;
 static ListNode *s_head_callback_node_list = NULL;
@@ -352,6 +365,50 @@ static void prv_build_page_flags_cache(void) {
   prv_invalidate_page_flags_cache_all();
 }
 
+//! @return The erase count of the sector which begins at 'start_page' as recorded in its page
+//!     headers. Pages which are mid-erase (or have never been formatted) are ignored
+static uint32_t prv_read_sector_erase_count(uint16_t start_page) {
+  uint32_t max_erase = 0;
+  for (uint16_t pg = start_page; pg < (start_page + PFS_PAGES_PER_ERASE_SECTOR); pg++) {
+    uint32_t erase_count;
+    prv_flash_read((uint8_t *)&erase_count, sizeof(erase_count),
+        prv_page_to_flash_offset(pg) + offsetof(PageHeader, erase_count));
+    if ((erase_count != 0xffffffff) && (erase_count > max_erase)) {
+      max_erase = erase_count;
+    }
+  }
+  return (max_erase);
+}
+
+static uint32_t prv_get_sector_erase_count(uint16_t region) {
+  return (s_pfs_sector_erase_counts) ? s_pfs_sector_erase_counts[region] : 0;
+}
+
+static void prv_set_sector_erase_count(uint16_t start_page, uint32_t erase_count) {
+  if (s_pfs_sector_erase_counts) {
+    s_pfs_sector_erase_counts[start_page / PFS_PAGES_PER_ERASE_SECTOR] = erase_count;
+  }
+}
+
+static void prv_build_sector_erase_counts(void) {
+  if (s_pfs_sector_erase_counts) {
+    kernel_free(s_pfs_sector_erase_counts);
+    s_pfs_sector_erase_counts = NULL;
+  }
+
+  int num_erase_regions = s_pfs_page_count / PFS_PAGES_PER_ERASE_SECTOR;
+  if (num_erase_regions == 0) {
+    return;
+  }
+
+  s_pfs_sector_erase_counts =
+      kernel_malloc_check(num_erase_regions * sizeof(*s_pfs_sector_erase_counts));
+  for (int region = 0; region < num_erase_regions; region++) {
+    s_pfs_sector_erase_counts[region] =
+        prv_read_sector_erase_count(region * PFS_PAGES_PER_ERASE_SECTOR);
+  }
+}
+
 static void update_curr_state(uint16_t start_page, uint32_t offset,
     uint16_t state) {
   offset += prv_page_to_flash_offset(start_page) + METADATA_OFFSET;
@@ -509,8 +566,8 @@ static status_t locate_flash_file(const char *name, uint16_t *page) {
 static int get_updated_erase_hdr(PageHeader *hdr, uint16_t page) {
   memset(hdr, 0xff, sizeof(*hdr));
 
-  // before wiping a page, get its erase_count. This is not currently used but
-  // enables future wear leveling improvements / analysis
+  // before wiping a page, get its erase_count so that it carries over the
+  // erase. Garbage collection uses these counts to spread wear across sectors
   prv_flash_read((uint8_t *)&hdr->erase_count, sizeof(hdr->erase_count),
       prv_page_to_flash_offset(page) + offsetof(PageHeader, erase_count));
   prv_flash_read((uint8_t *)&hdr->last_written, sizeof(hdr->last_written),
@@ -600,8 +657,8 @@ static uint32_t prv_get_sector_page_status(uint16_t region,
   return (sectors_active);
 }
 
-//! Scans through the filesystem and finds a sector with no pages that
-//! are active
+//! Scans through the filesystem and finds the least worn sector with no pages
+//! that are active
 //!
 //! @param skip_gc_region - will skip checking the region that is
 //!     used for garbage collection
@@ -613,6 +670,7 @@ static int prv_find_free_erase_region(bool skip_gc_region) {
 
   uint16_t gc_erase_block = s_gc_block.gc_start_page / PFS_PAGES_PER_ERASE_SECTOR;
 
+  int free_region = -1;
   for (int region = start_region; region < end_region; region++) {
     int erase_region = region % num_erase_regions;
 
@@ -622,12 +680,89 @@ static int prv_find_free_erase_region(bool skip_gc_region) {
 
     uint16_t free_pg;
     uint32_t sectors_active = prv_get_sector_page_status(erase_region, &free_pg);
-    if ((__builtin_popcount(sectors_active) == 0)) {
-      return (erase_region * PFS_PAGES_PER_ERASE_SECTOR);
+    if ((__builtin_popcount(sectors_active) == 0) &&
+        ((free_region == -1) || (prv_get_sector_erase_count(erase_region) <
+                                 prv_get_sector_erase_count(free_region)))) {
+      free_region = erase_region;
     }
   }
 
-  return (-1);
+  return (free_region == -1) ? -1 : (free_region * PFS_PAGES_PER_ERASE_SECTOR);
+}
+
+//! @param region - The erase sector we want to scan through
+//! @param sectors_active - Populated with the bitmask of occupied pages, see
+//!     prv_get_sector_page_status()
+//! @return The number of pages in the sector which are neither in use nor
+//!     erased, i.e the pages garbage collecting the sector would win back
+static int prv_get_sector_reclaimable_pages(uint16_t region, uint32_t *sectors_active) {
+  uint16_t start_pg = region * PFS_PAGES_PER_ERASE_SECTOR;
+  int reclaimable = 0;
+  *sectors_active = 0;
+  for (uint16_t pg = 0; pg < PFS_PAGES_PER_ERASE_SECTOR; pg++) {
+    uint8_t page_flags = prv_get_page_flags(start_pg + pg);
+    if (!page_is_unallocated(page_flags)) {
+      *sectors_active |= (0x1 << pg);
+    } else if (!page_is_erased(page_flags)) {
+      reclaimable++;
+    }
+  }
+  return (reclaimable);
+}
+
+//! Picks the sector garbage collection should run on next. Sectors which win
+//! back the most pages are preferred since they need the least data copied, but
+//! sectors which have been erased noticeably more often than the least worn
+//! candidate are passed over to spread wear out. Ties go to the least worn
+//! sector and then to the first one found scanning from 'start_region'
+//!
+//! @param start_region - The erase region to start scanning from
+//! @param sectors_active - Populated with the occupied page bitmask of the
+//!     chosen sector
+//! @return the beginning page of the chosen sector or -1 if there is nothing
+//!     to reclaim
+static int prv_find_gc_victim_region(uint16_t start_region, uint32_t *sectors_active) {
+  int num_erase_regions = s_pfs_page_count / PFS_PAGES_PER_ERASE_SECTOR;
+  uint16_t gc_erase_region = s_gc_block.gc_start_page / PFS_PAGES_PER_ERASE_SECTOR;
+
+  uint32_t min_erase_count = UINT32_MAX;
+  for (uint16_t region = 0; region < num_erase_regions; region++) {
+    uint16_t curr_region = (region + start_region) % num_erase_regions;
+    if (s_gc_block.block_valid && (gc_erase_region == curr_region)) {
+      continue;
+    }
+
+    uint32_t active;
+    if (prv_get_sector_reclaimable_pages(curr_region, &active) > 0) {
+      min_erase_count = MIN(min_erase_count, prv_get_sector_erase_count(curr_region));
+    }
+  }
+
+  int victim = -1;
+  int victim_reclaimable = 0;
+  for (uint16_t region = 0; region < num_erase_regions; region++) {
+    uint16_t curr_region = (region + start_region) % num_erase_regions;
+    if (s_gc_block.block_valid && (gc_erase_region == curr_region)) {
+      continue;
+    }
+
+    uint32_t active;
+    int reclaimable = prv_get_sector_reclaimable_pages(curr_region, &active);
+    uint32_t erase_count = prv_get_sector_erase_count(curr_region);
+    if ((reclaimable == 0) || ((erase_count - min_erase_count) > PFS_WEAR_LEVEL_MAX_DELTA)) {
+      continue;
+    }
+
+    if ((victim == -1) || (reclaimable > victim_reclaimable) ||
+        ((reclaimable == victim_reclaimable) &&
+         (erase_count < prv_get_sector_erase_count(victim)))) {
+      victim = curr_region;
+      victim_reclaimable = reclaimable;
+      *sectors_active = active;
+    }
+  }
+
+  return (victim == -1) ? -1 : (victim * PFS_PAGES_PER_ERASE_SECTOR);
 }
 
 static status_t garbage_collect_sector(uint16_t *free_page,
@@ -716,8 +851,9 @@ static status_t find_free_page(uint16_t *free_page, bool use_gc_allocator,
   PBL_ASSERTN((start_pg % PFS_PAGES_PER_ERASE_SECTOR) == 0);
 
   // if we could not find a free page in the sector we were previosuly using
-  // we need to scan through the erase regions and either perform some garbage
-  // collection or find an erased page in another erase region
+  // we need to scan through the erase regions and find an erased page in
+  // another erase region. Only once all the pre-erased pages have been used up
+  // do we have to stall the caller on garbage collection
   if (next_page == INVALID_PAGE) {
     int num_erase_regions = s_pfs_page_count / PFS_PAGES_PER_ERASE_SECTOR;
     uint16_t start_region = start_pg / PFS_PAGES_PER_ERASE_SECTOR;
@@ -730,17 +866,20 @@ static status_t find_free_page(uint16_t *free_page, bool use_gc_allocator,
         continue;
       }
 
-      uint32_t sectors_active = prv_get_sector_page_status(curr_region, &next_page);
+      prv_get_sector_page_status(curr_region, &next_page);
       if (next_page != INVALID_PAGE) {
         // we have found a page which is already erased
         break;
-      } else if (__builtin_popcount(sectors_active) < PFS_PAGES_PER_ERASE_SECTOR) {
-        // we can erase this region and have at least 1 free page after
-        uint16_t sector_start_pg = curr_region * PFS_PAGES_PER_ERASE_SECTOR;
-        garbage_collect_sector(&next_page, sector_start_pg, sectors_active);
-        break;
       }
     }
+
+    uint32_t sectors_active;
+    int sector_start_pg;
+    if ((next_page == INVALID_PAGE) &&
+        ((sector_start_pg = prv_find_gc_victim_region(start_region, &sectors_active)) >= 0)) {
+      // we can erase this region and have at least 1 free page after
+      garbage_collect_sector(&next_page, sector_start_pg, sectors_active);
+    }
   }
 
   if (next_page != INVALID_PAGE) { // a free page was found
@@ -1224,6 +1363,8 @@ void pfs_set_size(uint32_t new_size, bool new_region_erased) {
         (new_size/PFS_PAGE_SIZE), 1);
   }
 
+  prv_build_sector_erase_counts();
+
   update_last_written_page();
 }
 
@@ -1322,6 +1463,7 @@ static void prv_handle_sector_erase(uint16_t start_page, bool update_erase_count
   prv_flash_erase_sector(start_page);
   prv_write_erased_header_on_page_range(start_page,
       start_page + PFS_PAGES_PER_ERASE_SECTOR, max_erase);
+  prv_set_sector_erase_count(start_page, max_erase);
 
   if (last_written_pg != INVALID_PAGE) {
     hdr.last_written = LAST_WRITTEN_TAG;
@@ -1904,7 +2046,14 @@ static int pfs_open_gc_file(uint32_t space_needed, bool create) {
   file->is_tmp = false;
 
   if (s_gc_block.block_valid && create) {
-    prv_flash_erase_sector(s_gc_block.gc_start_page);
+    // This region gets erased more than any other so carry its erase count
+    // over rather than letting the file headers written next wipe it out
+    uint16_t gc_start_page = s_gc_block.gc_start_page;
+    uint32_t erase_count = prv_read_sector_erase_count(gc_start_page) + 1;
+    prv_flash_erase_sector(gc_start_page);
+    prv_write_erased_header_on_page_range(gc_start_page,
+        gc_start_page + PFS_PAGES_PER_ERASE_SECTOR, erase_count);
+    prv_set_sector_erase_count(gc_start_page, erase_count);
   }
 
   int res = file_found_or_added_to_pfs(fd, GC_FILE_NAME, file->op_flags,
@@ -1990,6 +2139,8 @@ static void recover_region_from_file(int fd) {
   prv_handle_sector_erase(gcdata.gc_start_page, false);
 
   copy_or_recover_gc_data(fd, &gcdata, false);
+  prv_set_sector_erase_count(gcdata.gc_start_page,
+                             prv_read_sector_erase_count(gcdata.gc_start_page));
 
 done:
   pfs_close_and_remove(fd);
@@ -2063,6 +2214,64 @@ done:
   return (E_INTERNAL);
 }
 
+//! @return the number of erased pages available for files to be written to
+static uint16_t prv_count_erased_pages(void) {
+  uint16_t gc_erase_region = s_gc_block.gc_start_page / PFS_PAGES_PER_ERASE_SECTOR;
+  uint16_t erased_pages = 0;
+  for (uint16_t pg = 0; pg < s_pfs_page_count; pg++) {
+    if (s_gc_block.block_valid && ((pg / PFS_PAGES_PER_ERASE_SECTOR) == gc_erase_region)) {
+      continue;
+    }
+    if (page_is_erased(prv_get_page_flags(pg))) {
+      erased_pages++;
+    }
+  }
+  return (erased_pages);
+}
+
+uint32_t pfs_compact(uint32_t max_elapsed_ticks) {
+  uint32_t start_ticks = rtc_get_ticks();
+  uint32_t sectors_collected = 0;
+
+  while (true) {
+    mutex_lock_recursive(s_pfs_mutex);
+    int sector_start_pg = -1;
+    uint32_t sectors_active = 0;
+    uint16_t target_pages = (sectors_collected == 0) ? PFS_COMPACT_LOW_WATER_PAGES :
+        PFS_COMPACT_RESERVE_PAGES;
+    // rotate the GC region out if it has seen enough use, just like pfs_open() does
+    prv_update_gc_reserved_region();
+    if (s_gc_block.block_valid && (prv_count_erased_pages() < target_pages)) {
+      sector_start_pg = prv_find_gc_victim_region(
+          s_last_page_written / PFS_PAGES_PER_ERASE_SECTOR, &sectors_active);
+    }
+
+    if (sector_start_pg >= 0) {
+      uint16_t free_page;
+      garbage_collect_sector(&free_page, sector_start_pg, sectors_active);
+      sectors_collected++;
+    }
+    mutex_unlock_recursive(s_pfs_mutex);
+
+    if (sector_start_pg < 0) {
+      break; // reserve is full or there is nothing left to reclaim
+    }
+
+    // give anything waiting on the filesystem a chance to run between sectors
+    psleep(2);
+
+    uint32_t elapsed_ticks = rtc_get_ticks() - start_ticks;
+    if (max_elapsed_ticks != 0 && (elapsed_ticks > max_elapsed_ticks)) {
+      break;
+    }
+  }
+
+  if (sectors_collected != 0) {
+    PBL_LOG(LOG_LEVEL_DEBUG, "Compacted %"PRIu32" sectors", sectors_collected);
+  }
+  return (sectors_collected);
+}
+
 status_t pfs_init(bool run_filesystem_check) {
   if (s_pfs_mutex == NULL) {
     s_pfs_mutex = mutex_create_recursive();
@@ -2129,6 +2338,7 @@ void pfs_format(bool write_erase_headers) {
   if (write_erase_headers) {
     prv_write_erased_header_on_page_range(0, s_pfs_page_count, 1);
   }
+  prv_build_sector_erase_counts();
 
   mutex_unlock_recursive(s_pfs_mutex);
   PBL_LOG(LOG_LEVEL_INFO, "FS-Format Done");
@@ -2383,4 +2593,16 @@ void test_force_reboot_during_garbage_collection(uint16_t start_page) {
 void test_override_last_written_page(uint16_t start_page) {
   s_test_last_page_written_override = s_last_page_written;
 }
+
+uint32_t test_get_sector_erase_count(uint16_t region) {
+  return prv_get_sector_erase_count(region);
+}
+
+uint32_t test_read_sector_erase_count(uint16_t region) {
+  return prv_read_sector_erase_count(region * PFS_PAGES_PER_ERASE_SECTOR);
+}
+
+uint16_t test_get_erased_page_count(void) {
+  return prv_count_erased_pages();
+}
 #endif
@@ -189,6 +189,14 @@ extern int pfs_sector_optimal_size(int min_size, int namelen);
 //! Returns the number of bytes available on the filesystem
 extern uint32_t get_available_pfs_space(void);
 
+//! Garbage collects sectors until a small reserve of pre-erased pages is available again, so that
+//! later writes don't have to stall on a sector erase. Meant to be run when the system is idle.
+//! Note: expects that the caller does _not_ hold the pfs mutex
+//! @param max_elapsed_ticks - The max amount of time to spend compacting. If 0, then there is
+//!    no timeout
+//! @return the number of sectors which were garbage collected
+extern uint32_t pfs_compact(uint32_t max_elapsed_ticks);
+
 //! Watch a file. The callback is called whenever the given file (by name) is closed with
 //! modifications or deleted
 //! @param filename - name of the file to watch
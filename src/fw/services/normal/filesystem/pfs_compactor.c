@@ -0,0 +1,52 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pfs_compactor.h"
+
+#include "drivers/rtc.h"
+#include "services/common/regular_timer.h"
+#include "services/common/system_task.h"
+#include "services/normal/filesystem/pfs.h"
+
+// How often to check whether the filesystem is running low on pre-erased pages
+#define PFS_COMPACTOR_INTERVAL_MINUTES 1
+// Upper bound on how long a single compaction pass may keep the system task busy
+#define PFS_COMPACTOR_MAX_TICKS (2 * RTC_TICKS_HZ)
+
+static RegularTimerInfo s_compactor_timer;
+static bool s_compaction_pending = false;
+
+static void prv_compact_system_task_cb(void *data) {
+  pfs_compact(PFS_COMPACTOR_MAX_TICKS);
+  s_compaction_pending = false;
+}
+
+static void prv_compactor_timer_cb(void *data) {
+  if (s_compaction_pending) {
+    return; // the last pass hasn't had a chance to run yet
+  }
+
+  // the system task runs at a low priority so this only gets serviced once
+  // everything more important has been handled
+  s_compaction_pending = system_task_add_callback(prv_compact_system_task_cb, NULL);
+}
+
+void pfs_compactor_init(void) {
+  s_compactor_timer = (RegularTimerInfo) {
+    .cb = prv_compactor_timer_cb,
+  };
+  regular_timer_add_multiminute_callback(&s_compactor_timer, PFS_COMPACTOR_INTERVAL_MINUTES);
+}
@@ -16,6 +16,8 @@
 
 #include "persist.h"
 
+#include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +25,8 @@
 #include "kernel/pbl_malloc.h"
 #include "os/mutex.h"
 #include "process_management/app_install_manager.h"
+#include "services/common/new_timer/new_timer.h"
+#include "services/common/system_task.h"
 #include "services/normal/filesystem/app_file.h"
 #include "services/normal/filesystem/pfs.h"
 #include "services/normal/legacy/persist_map.h"
@@ -34,12 +38,30 @@
 
 #define PERSIST_STORAGE_MAX_SPACE KiBYTES(6)
 
+//! Most value bytes / keys a store holds in its write-back cache before it gets flushed
+#define PERSIST_CACHE_MAX_BYTES (256)
+#define PERSIST_CACHE_MAX_ENTRIES (8)
+//! How long cached writes may wait for a flush
+#define PERSIST_CACHE_FLUSH_DELAY_MS (30 * 1000)
+
+//! A rewrite of an existing key that hasn't been written to the SettingsFile yet
+typedef struct PersistCacheEntry {
+  ListNode list_node;
+  uint32_t key;
+  uint16_t val_len;
+  uint8_t val[];
+} PersistCacheEntry;
+
 typedef struct PersistStore {
   ListNode  list_node;
   Uuid uuid;
   SettingsFile file;
   bool file_open;
   uint8_t usage_count;          //!< How many clients are using this store
+  uint8_t cache_entries;
+  uint16_t cache_bytes;
+  //! Oldest write first
+  PersistCacheEntry *cache;
 } PersistStore;
 
 // Each open client has a PersistStore structure linked into this list. If both
@@ -47,6 +69,7 @@ typedef struct PersistStore {
 // same store.
 static ListNode *s_client_stores;
 static PebbleMutex *s_mutex;
+static TimerID s_flush_timer = TIMER_INVALID_ID;
 
 
 static bool prv_uuid_list_filter(ListNode* node, void* data) {
@@ -68,6 +91,161 @@ static inline void prv_unlock(void) {
   mutex_unlock(s_mutex);
 }
 
+static PersistStore *prv_store_for_file(SettingsFile *file) {
+  return (PersistStore *)((uint8_t *)file - offsetof(PersistStore, file));
+}
+
+// Write-back cache
+////////////////////////////////////////////////////////////////////////////////
+
+static bool prv_cache_key_filter(ListNode *node, void *data) {
+  return (((PersistCacheEntry *)node)->key == (uintptr_t)data);
+}
+
+static PersistCacheEntry *prv_cache_find(PersistStore *store, uint32_t key) {
+  return (PersistCacheEntry *)list_find((ListNode *)store->cache, prv_cache_key_filter,
+                                        (void *)(uintptr_t)key);
+}
+
+static void prv_cache_remove(PersistStore *store, PersistCacheEntry *entry) {
+  list_remove(&entry->list_node, (ListNode **)&store->cache, NULL);
+  store->cache_entries--;
+  store->cache_bytes -= entry->val_len;
+  kernel_free(entry);
+}
+
+//! Writes out the store's cached values, oldest first. The caller must hold the mutex.
+static void prv_cache_flush(PersistStore *store) {
+  while (store->cache) {
+    PersistCacheEntry *entry = store->cache;
+    const status_t status = settings_file_set(&store->file, &entry->key, sizeof(entry->key),
+                                              entry->val, entry->val_len);
+    if (FAILED(status)) {
+      PBL_LOG(LOG_LEVEL_ERROR, "Failed to write back persist key %"PRIu32": %"PRId32,
+              entry->key, status);
+    }
+    prv_cache_remove(store, entry);
+  }
+}
+
+static void prv_flush_system_task_cb(void *unused) {
+  persist_service_flush_all();
+}
+
+static void prv_flush_timer_cb(void *unused) {
+  // Don't hold up the timer task with flash writes
+  system_task_add_callback_coalesced(prv_flush_system_task_cb, NULL);
+}
+
+//! Only rewrites that keep the size of an existing value are cached. Those can't change whether
+//! the key exists, its size or how much space the file uses, so any error they could run into is
+//! reported by a write-through write of the same size.
+static bool prv_cache_can_hold(PersistStore *store, uint32_t key, size_t val_len) {
+  if (val_len == 0 || val_len > PERSIST_CACHE_MAX_BYTES) {
+    return false;
+  }
+  if (settings_file_get_len(&store->file, &key, sizeof(key)) != (int)val_len) {
+    return false;
+  }
+  // settings_file_set() wants room for the new record before it drops the old one
+  const int record_size = sizeof(SettingsRecordHeader) + sizeof(key) + val_len;
+  return (store->file.used_space + record_size <= store->file.max_used_space);
+}
+
+//! @return true if the value got cached instead of written
+static bool prv_cache_write(PersistStore *store, uint32_t key, const void *val, size_t val_len) {
+  PersistCacheEntry *entry = prv_cache_find(store, key);
+  if (entry && entry->val_len == val_len) {
+    memcpy(entry->val, val, val_len);
+    return true;
+  }
+  if (entry) {
+    // The size changes, flush so the file sees the writes in order
+    return false;
+  }
+  if (!prv_cache_can_hold(store, key, val_len)) {
+    return false;
+  }
+
+  if (store->cache_entries == PERSIST_CACHE_MAX_ENTRIES ||
+      store->cache_bytes + val_len > PERSIST_CACHE_MAX_BYTES) {
+    prv_cache_flush(store);
+  }
+  entry = kernel_malloc(sizeof(PersistCacheEntry) + val_len);
+  if (!entry) {
+    return false;
+  }
+  *entry = (PersistCacheEntry) {
+    .key = key,
+    .val_len = val_len,
+  };
+  memcpy(entry->val, val, val_len);
+  if (store->cache) {
+    list_append((ListNode *)store->cache, &entry->list_node);
+  } else {
+    store->cache = entry;
+  }
+  store->cache_entries++;
+  store->cache_bytes += val_len;
+
+  if (!new_timer_scheduled(s_flush_timer, NULL)) {
+    new_timer_start(s_flush_timer, PERSIST_CACHE_FLUSH_DELAY_MS, prv_flush_timer_cb, NULL,
+                    0 /* flags */);
+  }
+  return true;
+}
+
+status_t persist_service_store_set(SettingsFile *file, uint32_t key,
+                                   const void *val, size_t val_len) {
+  PersistStore *store = prv_store_for_file(file);
+  if (prv_cache_write(store, key, val, val_len)) {
+    return S_SUCCESS;
+  }
+  // Anything else goes straight to flash, after the cached writes so that the file sees the
+  // writes in order
+  prv_cache_flush(store);
+  return settings_file_set(file, &key, sizeof(key), val, val_len);
+}
+
+status_t persist_service_store_get(SettingsFile *file, uint32_t key, void *val, size_t val_len) {
+  PersistCacheEntry *entry = prv_cache_find(prv_store_for_file(file), key);
+  if (!entry) {
+    return settings_file_get(file, &key, sizeof(key), val, val_len);
+  }
+  // Same behavior as settings_file_get()
+  if (val_len > entry->val_len) {
+    memset(val, 0, val_len);
+    return E_RANGE;
+  }
+  memcpy(val, entry->val, val_len);
+  return S_SUCCESS;
+}
+
+status_t persist_service_store_delete(SettingsFile *file, uint32_t key) {
+  PersistStore *store = prv_store_for_file(file);
+  PersistCacheEntry *entry = prv_cache_find(store, key);
+  if (entry) {
+    // Deleting the key supersedes the cached value
+    prv_cache_remove(store, entry);
+  }
+  prv_cache_flush(store);
+  return settings_file_delete(file, &key, sizeof(key));
+}
+
+void persist_service_flush_all(void) {
+  prv_lock();
+  {
+    PersistStore *store = (PersistStore *)s_client_stores;
+    while (store) {
+      prv_cache_flush(store);
+      store = (PersistStore *)store->list_node.next;
+    }
+  }
+  prv_unlock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 #define PERSIST_FILE_NAME_MAX_LENGTH sizeof("ps000001")
 
 static status_t prv_get_file_name(char *name, size_t buf_len, const Uuid *uuid) {
@@ -102,6 +280,7 @@ static bool prv_bad_persist_file_filter(const char *filename) {
 void persist_service_init(void) {
   persist_map_init();
   s_mutex = mutex_create();
+  s_flush_timer = new_timer_create();
 
   // Find and delete any AppInstallId-indexed persist files. Due to PBL-16663
   // (affecting FW 3.0-dp5 thru -dp7), the AppInstallId in the file name may not
@@ -181,6 +360,8 @@ void persist_service_client_close(const Uuid *uuid) {
                 list_contains(s_client_stores, &store->list_node) &&
                 store->usage_count >= 1);
 
+    // Don't leave the writes of an exiting process waiting for the flush timer
+    prv_cache_flush(store);
     if (--store->usage_count == 0) {
       if (store->file_open) {
         settings_file_close(&store->file);
@@ -27,6 +27,25 @@
 //! The persist service makes no attempt to make SettingsFile reentrant; it is
 //! the caller's responsibility to enforce mutual exclusion and prevent
 //! concurrent access to the SettingsFile.
+//!
+//! Apps tend to persist their state on every tick or tap. To keep that from
+//! turning into a flash write (and eventually a compaction) each time, rewrites
+//! of an existing key that keep the size of its value are held in a small
+//! per-store write-back cache. Writes to the same key are coalesced in there
+//! until the cache is flushed, which happens:
+//!  - when the cache is full,
+//!  - before any write that can't be cached (new key, size change, delete),
+//!  - at most PERSIST_CACHE_FLUSH_DELAY_MS after the first cached write,
+//!  - when a process using the store exits, and
+//!  - before the watch shuts down because the battery is critical.
+//!
+//! Crash consistency: a cached write is durable once it has been flushed, not
+//! when persist_write_*() returns. A crash or sudden power loss can lose the
+//! cached rewrites of the last flush interval, leaving those keys with the
+//! last value that was flushed. Every key is still updated atomically by the
+//! SettingsFile, and writes that are not cached reach flash after all writes
+//! made before them, but the cached keys of a single flush may land in any
+//! order.
 
 #include <stdint.h>
 #include <stddef.h>
@@ -47,6 +66,21 @@ SettingsFile *persist_service_lock_and_get_store(const Uuid *uuid);
 //! Unlock the given persist store.
 void persist_service_unlock_store(SettingsFile *store);
 
+//! Write a value to a store obtained with persist_service_lock_and_get_store(). The write
+//! might only reach flash on the next flush of the write-back cache.
+status_t persist_service_store_set(SettingsFile *store, uint32_t key,
+                                   const void *val, size_t val_len);
+
+//! Read a value from a locked store, including cached writes. Same semantics as
+//! settings_file_get().
+status_t persist_service_store_get(SettingsFile *store, uint32_t key, void *val, size_t val_len);
+
+//! Delete a key from a locked store.
+status_t persist_service_store_delete(SettingsFile *store, uint32_t key);
+
+//! Write out the cached writes of all open stores.
+void persist_service_flush_all(void);
+
 //! Call during each process's startup.
 void persist_service_client_open(const Uuid *uuid);
 
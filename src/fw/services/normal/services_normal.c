@@ -29,6 +29,7 @@
 #include "services/normal/blob_db/endpoint_private.h"
 #include "services/normal/data_logging/data_logging_service.h"
 #include "services/normal/filesystem/pfs.h"
+#include "services/normal/filesystem/pfs_compactor.h"
 #include "services/normal/protobuf_log/protobuf_log.h"
 #include "services/normal/music_endpoint.h"
 #include "services/normal/music_internal.h"
@@ -56,6 +57,8 @@ void services_normal_early_init(void) {
 }
 
 void services_normal_init(void) {
+  pfs_compactor_init();
+
   persist_service_init();
 
   app_install_manager_init();
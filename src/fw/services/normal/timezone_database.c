@@ -22,6 +22,7 @@
 #include "system/passert.h"
 
 #include <util/attributes.h>
+#include <util/math.h>
 #include <util/size.h>
 
 #include <string.h>
@@ -46,6 +47,13 @@
 //   For each link (35 bytes)
 //     2 bytes  - The region id this link maps to
 //     33 bytes - The name of the link that should be treated as an alias to the linked region
+// Link Index (optional, databases generated before it was added end after the links)
+//   4 bytes  - TIMEZONE_INDEX_MAGIC
+//   For each link (2 bytes)
+//     2 bytes  - Link number, in the order of the link names
+//
+// Databases that have the link index also guarantee that the regions are stored in name order,
+// which lets us binary search both the regions and the links.
 
 typedef struct PACKED {
   uint16_t region_count;
@@ -64,6 +72,9 @@ typedef struct PACKED {
 #define LINK_NAME_LENGTH 33
 #define LINK_BYTES (LINK_REGION_LENGTH + LINK_NAME_LENGTH)
 
+#define TIMEZONE_INDEX_MAGIC 0x58495a54 // "TZIX" in little endian
+#define LINK_INDEX_ENTRY_BYTES (sizeof(uint16_t))
+
 
 //! Names for all the continents we support. The timezone database stores continents as indexes
 //! into this constant array.
@@ -140,42 +151,45 @@ bool timezone_database_load_region_info(uint16_t region_id, TimezoneInfo *tz_inf
   return true;
 }
 
-bool timezone_database_load_region_name(uint16_t region_id, char *region_name) {
-  if (region_id > timezone_database_get_region_count()) {
-    return false;
-  }
-
+static bool prv_load_region_name(uint16_t region_id, char *region_name) {
   const int region_offset =
       // Skip over the region count
       TZDATA_HEADER_BYTES +
       // Skip over the regions list
       (region_id * REGION_BYTES);
 
-  // Read the continent index, which is the first byte
-  uint8_t continent_index = 0;
-  prv_database_read(region_offset, &continent_index, sizeof(continent_index));
-  PBL_ASSERTN(continent_index < ARRAY_LENGTH(CONTINENT_NAMES));
+  // The continent index and the city name are right beside each other, read them both at once
+  struct PACKED {
+    uint8_t continent_index;
+    char city_name[TIMEZONE_CITY_LENGTH];
+  } name_data;
+  if (!prv_database_read(region_offset, &name_data, sizeof(name_data))) {
+    region_name[0] = '\0';
+    return false;
+  }
+  PBL_ASSERTN(name_data.continent_index < ARRAY_LENGTH(CONTINENT_NAMES));
 
   // Copy the continent name into our buffer, followed by a slash.
-  const int continent_name_length = strlen(CONTINENT_NAMES[continent_index]);
-  memcpy(region_name, CONTINENT_NAMES[continent_index], continent_name_length);
+  const int continent_name_length = strlen(CONTINENT_NAMES[name_data.continent_index]);
+  memcpy(region_name, CONTINENT_NAMES[name_data.continent_index], continent_name_length);
   region_name[continent_name_length] = '/';
 
+  // Fill the rest of our buffer with city name. The city is zero padded unless it uses all
+  // TIMEZONE_CITY_LENGTH bytes, and the longest continent name + slash + city + null fits in
+  // TIMEZONE_NAME_LENGTH.
   char *city_name = region_name + continent_name_length + 1 /* slash */;
+  memcpy(city_name, name_data.city_name, TIMEZONE_CITY_LENGTH);
+  city_name[TIMEZONE_CITY_LENGTH] = '\0';
 
-  // How many bytes left we have of our buffer to fill in the city information.
-  const int remaining_size = (region_name + TIMEZONE_NAME_LENGTH) - city_name;
-
-  // Fill the rest of our buffer with city name.
-  // Our generation script will ensure that continent + slash + city name + null will always
-  // fit in our buffer with a null terminator to spare.
-  prv_database_read(region_offset + 1 /* continent index */, city_name, remaining_size);
+  return true;
+}
 
-  // FIXME: Perhaps we should refactor this to do one read instead of two? The information is
-  // right beside each other and it's pretty wasteful to do a 1 byte read followed by a 15 byte
-  // read as separate reads.
+bool timezone_database_load_region_name(uint16_t region_id, char *region_name) {
+  if (region_id > timezone_database_get_region_count()) {
+    return false;
+  }
 
-  return true;
+  return prv_load_region_name(region_id, region_name);
 }
 
 bool timezone_database_load_dst_rule(uint8_t dst_id, TimezoneDSTRule *start, TimezoneDSTRule *end) {
@@ -204,12 +218,35 @@ bool timezone_database_load_dst_rule(uint8_t dst_id, TimezoneDSTRule *start, Tim
   return true;
 }
 
-static int prv_search_regions_by_name(const char *region_name, int region_name_length) {
-  const int region_count = timezone_database_get_region_count();
+static int prv_get_link_section_offset(int region_count) {
+  return
+      // Skip over the region count
+      TZDATA_HEADER_BYTES +
+      // Skip over the regions list
+      (region_count * REGION_BYTES) +
+      // Skip over the DST list
+      ((prv_get_dst_rule_count() - 1) * DST_RULE_PAIR_BYTES);
+}
+
+//! @return The offset of the link name index, or -1 if this database doesn't have one
+static int prv_get_link_index_offset(int region_count, int link_count) {
+  const int link_index_offset = prv_get_link_section_offset(region_count) +
+                                (link_count * LINK_BYTES);
+
+  // Older databases end right after the links, so the read will come up short
+  uint32_t magic;
+  if (!prv_database_read(link_index_offset, &magic, sizeof(magic)) ||
+      magic != TIMEZONE_INDEX_MAGIC) {
+    return -1;
+  }
+  return link_index_offset + sizeof(magic);
+}
 
+static int prv_search_regions_linear(const char *region_name, int region_name_length,
+                                     int region_count) {
   for (int i = 0; i < region_count; i++) {
     char lookup_region_name[TIMEZONE_NAME_LENGTH];
-    timezone_database_load_region_name(i, lookup_region_name);
+    prv_load_region_name(i, lookup_region_name);
     if (strncmp(region_name, lookup_region_name, region_name_length) == 0) {
       return i;
     }
@@ -218,32 +255,99 @@ static int prv_search_regions_by_name(const char *region_name, int region_name_l
   return -1;
 }
 
-static int prv_search_links_by_name(const char *region_name, int region_name_length) {
+//! Finds the first region whose name starts with the given name, the same region
+//! prv_search_regions_linear would find given the regions are sorted by name.
+static int prv_search_regions_sorted(const char *region_name, int region_name_length,
+                                     int region_count) {
+  char lookup_region_name[TIMEZONE_NAME_LENGTH];
+
+  // Find the first region that doesn't sort before the name
+  int low = 0;
+  int high = region_count;
+  while (low < high) {
+    const int mid = low + ((high - low) / 2);
+    prv_load_region_name(mid, lookup_region_name);
+    if (strncmp(lookup_region_name, region_name, region_name_length) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  if (low < region_count) {
+    prv_load_region_name(low, lookup_region_name);
+    if (strncmp(region_name, lookup_region_name, region_name_length) == 0) {
+      return low;
+    }
+  }
+
+  return -1;
+}
+
+static int prv_search_regions_by_name(const char *region_name, int region_name_length,
+                                      bool sorted) {
+  const int region_count = timezone_database_get_region_count();
+
+  if (sorted) {
+    return prv_search_regions_sorted(region_name, region_name_length, region_count);
+  }
+  return prv_search_regions_linear(region_name, region_name_length, region_count);
+}
+
+static void prv_load_link(int link_section_offset, int link_number, uint16_t *linked_region_id,
+                          char *link_name) {
+  struct PACKED {
+    uint16_t region_id;
+    char name[LINK_NAME_LENGTH];
+  } link_data = {};
+  prv_database_read(link_section_offset + (link_number * LINK_BYTES), &link_data,
+                    sizeof(link_data));
+
+  *linked_region_id = link_data.region_id;
+  memcpy(link_name, link_data.name, LINK_NAME_LENGTH);
+  link_name[LINK_NAME_LENGTH] = '\0';
+}
+
+static int prv_search_links_by_name(const char *region_name, int region_name_length,
+                                    int link_index_offset) {
   char name_asciz[256] = {0};
-  memcpy(name_asciz, region_name, region_name_length);
+  memcpy(name_asciz, region_name, MIN(region_name_length, (int)sizeof(name_asciz) - 1));
 
   const int link_section_offset =
-      // Skip over the region count
-      TZDATA_HEADER_BYTES +
-      // Skip over the regions list
-      (timezone_database_get_region_count() * REGION_BYTES) +
-      // Skip over the DST list
-      ((prv_get_dst_rule_count() - 1) * DST_RULE_PAIR_BYTES);
-
+      prv_get_link_section_offset(timezone_database_get_region_count());
   const uint16_t link_count = prv_get_link_count();
 
-  for (int i = 0; i < link_count; i++) {
-    const int link_offset = link_section_offset + (i * LINK_BYTES);
+  uint16_t linked_region_id;
+  char link_name[LINK_NAME_LENGTH + 1]; // + max length + null terminator
 
-    char link_name[LINK_NAME_LENGTH + 1]; // + max length + null terminator
-    prv_database_read(link_offset + LINK_REGION_LENGTH, link_name, LINK_NAME_LENGTH);
-    link_name[sizeof(link_name) - 1] = '\0';
+  if (link_index_offset < 0) {
+    for (int i = 0; i < link_count; i++) {
+      prv_load_link(link_section_offset, i, &linked_region_id, link_name);
+      if (strncmp(name_asciz, link_name, LINK_NAME_LENGTH) == 0) {
+        // Found it!
+        return linked_region_id;
+      }
+    }
+    return -1;
+  }
 
-    if (strncmp(name_asciz, link_name, LINK_NAME_LENGTH) == 0) {
+  int low = 0;
+  int high = link_count - 1;
+  while (low <= high) {
+    const int mid = low + ((high - low) / 2);
+    uint16_t link_number;
+    prv_database_read(link_index_offset + (mid * LINK_INDEX_ENTRY_BYTES),
+                      &link_number, sizeof(link_number));
+    prv_load_link(link_section_offset, link_number, &linked_region_id, link_name);
+
+    const int cmp = strncmp(name_asciz, link_name, LINK_NAME_LENGTH);
+    if (cmp == 0) {
       // Found it!
-      uint16_t linked_region_id;
-      prv_database_read(link_offset, &linked_region_id, sizeof(linked_region_id));
       return linked_region_id;
+    } else if (cmp < 0) {
+      high = mid - 1;
+    } else {
+      low = mid + 1;
     }
   }
 
@@ -251,14 +355,18 @@ static int prv_search_links_by_name(const char *region_name, int region_name_len
 }
 
 int timezone_database_find_region_by_name(const char *region_name, int region_name_length) {
-  int region_id = prv_search_regions_by_name(region_name, region_name_length);
+  const int link_index_offset =
+      prv_get_link_index_offset(timezone_database_get_region_count(), prv_get_link_count());
+
+  int region_id = prv_search_regions_by_name(region_name, region_name_length,
+                                             (link_index_offset >= 0));
 
   if (region_id == -1) {
     // Might be a Link, let's check.
     // To explain: iOS, when not synchronized from the internet, uses _ancient_ IANA region names.
     // For example, when in California, iOS will send "US/Pacific" which hasn't been the name of
     // that timezone since 1993. So we need to support linked timezones sent from the phone.
-    region_id = prv_search_links_by_name(region_name, region_name_length);
+    region_id = prv_search_links_by_name(region_name, region_name_length, link_index_offset);
   }
 
   return region_id;
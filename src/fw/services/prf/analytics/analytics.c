@@ -33,6 +33,12 @@ void analytics_inc(AnalyticsMetric metric, AnalyticsClient client) {
 void analytics_add(AnalyticsMetric metric, int64_t amount, AnalyticsClient client) {
 }
 
+void analytics_batched_add(AnalyticsBatchedCounter *counter, uint32_t amount) {
+}
+
+void analytics_batched_inc(AnalyticsBatchedCounter *counter) {
+}
+
 void analytics_stopwatch_start(AnalyticsMetric metric, AnalyticsClient client) {
 }
 
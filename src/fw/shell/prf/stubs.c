@@ -88,6 +88,22 @@ SettingsFile * persist_service_lock_and_get_store(const Uuid *uuid) {
   return NULL;
 }
 
+status_t persist_service_store_set(SettingsFile *store, uint32_t key,
+                                   const void *val, size_t val_len) {
+  return E_INVALID_OPERATION;
+}
+
+status_t persist_service_store_get(SettingsFile *store, uint32_t key, void *val, size_t val_len) {
+  return E_INVALID_OPERATION;
+}
+
+status_t persist_service_store_delete(SettingsFile *store, uint32_t key) {
+  return E_INVALID_OPERATION;
+}
+
+void persist_service_flush_all(void) {
+}
+
 status_t persist_service_delete_file(const Uuid *uuid) {
   return E_INVALID_OPERATION;
 }
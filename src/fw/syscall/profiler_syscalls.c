@@ -62,7 +62,7 @@ DEFINE_SYSCALL(void, sys_profiler_node_start, ProfilerNode *node) {
     }
   }
 
-  node->start = DWT->CYCCNT;
+  profiler_node_start(node, DWT->CYCCNT);
 }
 
 DEFINE_SYSCALL(void, sys_profiler_node_stop, ProfilerNode *node) {
@@ -80,3 +80,9 @@ DEFINE_SYSCALL(void, sys_profiler_node_stop, ProfilerNode *node) {
 
   profiler_node_stop(node, dwt_cyc_cnt);
 }
+
+#if PROFILER_TRACE
+DEFINE_SYSCALL(void, sys_profiler_trace_event_dispatch, bool start, uint16_t event_type) {
+  profiler_trace_event_dispatch(start, event_type);
+}
+#endif
@@ -125,6 +125,9 @@ void sys_app_log(size_t length, void *log_buffer);
 void sys_event_service_client_subscribe(EventServiceInfo *handler);
 void sys_event_service_client_unsubscribe(EventServiceInfo *state, EventServiceInfo *handler);
 void sys_event_service_cleanup(PebbleEvent *e);
+//! Replaces a dequeued event with the newer events that got coalesced into it while it was
+//! waiting in the current task's queue, see event_service_get_coalesce_policy()
+void sys_event_service_get_coalesced(PebbleEvent *e);
 
 int sys_ble_scan_start(void);
 int sys_ble_scan_stop(void);
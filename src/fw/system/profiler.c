@@ -16,6 +16,7 @@
 
 #include "profiler.h"
 
+#include "kernel/pebble_tasks.h"
 #include "system/passert.h"
 #include "util/size.h"
 
@@ -99,10 +100,16 @@ void profiler_start(void) {
   DWT->CYCCNT = 0;
   DWT->CTRL |= 0x01;
   g_profiler.start = DWT->CYCCNT;
+#if PROFILER_TRACE
+  profiler_trace_start();
+#endif
 }
 
 void profiler_stop(void) {
   g_profiler.end = DWT->CYCCNT;
+#if PROFILER_TRACE
+  profiler_trace_stop();
+#endif
 }
 
 uint32_t profiler_node_get_last_cycles(ProfilerNode *node) {
@@ -115,22 +122,50 @@ uint32_t profiler_node_get_last_cycles(ProfilerNode *node) {
   return duration;
 }
 
+void profiler_node_start(ProfilerNode *node, uint32_t dwt_cyc_cnt) {
+  node->start = dwt_cyc_cnt;
+#if PROFILER_TRACE
+  profiler_trace_record(ProfilerTraceEventType_NodeStart, dwt_cyc_cnt, pebble_task_get_current(),
+                        0, node->module_name);
+#endif
+}
+
 void profiler_node_stop(ProfilerNode *node, uint32_t dwt_cyc_cnt) {
   node->end = dwt_cyc_cnt;
   ++node->count;
 
   node->total += profiler_node_get_last_cycles(node);
+#if PROFILER_TRACE
+  profiler_trace_record(ProfilerTraceEventType_NodeStop, dwt_cyc_cnt, pebble_task_get_current(),
+                        0, node->module_name);
+#endif
 }
 
-uint32_t profiler_cycles_to_us(uint32_t cycles) {
+#if PROFILER_TRACE
+void profiler_trace_event_dispatch(bool start, uint16_t event_type) {
+  profiler_trace_record(start ? ProfilerTraceEventType_DispatchStart :
+                                ProfilerTraceEventType_DispatchStop,
+                        DWT->CYCCNT, pebble_task_get_current(), event_type, NULL);
+}
+
+void profiler_trace_task_switched_in(void) {
+  profiler_trace_record(ProfilerTraceEventType_TaskSwitch, DWT->CYCCNT,
+                        pebble_task_get_current(), 0, NULL);
+}
+#endif
+
+static uint32_t prv_get_cpu_mhz(void) {
 #ifdef MICRO_FAMILY_NRF5
-  uint32_t mhz = NRFX_DELAY_CPU_FREQ_MHZ;
+  return NRFX_DELAY_CPU_FREQ_MHZ;
 #else
   RCC_ClocksTypeDef clocks;
   RCC_GetClocksFreq(&clocks);
-  uint32_t mhz = clocks.HCLK_Frequency / 1000000;
+  return clocks.HCLK_Frequency / 1000000;
 #endif
-  return cycles / mhz;
+}
+
+uint32_t profiler_cycles_to_us(uint32_t cycles) {
+  return cycles / prv_get_cpu_mhz();
 }
 
 uint32_t profiler_node_get_total_us(ProfilerNode *node) {
@@ -228,3 +263,14 @@ void command_profiler_start(void) {
 void command_profiler_stats(void) {
   PROFILER_PRINT_STATS;
 }
+
+#if PROFILER_TRACE
+static void prv_trace_dump_line(const char *line, void *context) {
+  char buf[80];
+  PROF_LOG(buf, sizeof(buf), "%s", line);
+}
+
+void command_profiler_trace(void) {
+  profiler_trace_dump(prv_get_cpu_mhz(), prv_trace_dump_line, NULL);
+}
+#endif
@@ -26,6 +26,10 @@
  *   command line.
  *  Alternatively, one can use the PROFILER_START and PROFILER_STOP macros to start and stop them at
  *   a specific point.
+ *
+ * Tracing:
+ *  Building with the "--profiler_trace" configure option also records a timeline of node
+ *   starts/stops, task switches and event dispatches. See system/profiler_trace.h.
  */
 
 #include <stdint.h>
@@ -39,6 +43,10 @@
 #include <mcu.h>
 #endif
 
+#if PROFILER_TRACE
+#include "system/profiler_trace.h"
+#endif
+
 typedef struct {
   ListNode list_node;
   char *module_name;
@@ -71,6 +79,10 @@ extern Profiler g_profiler;
 #define PROFILER_NODE_GET_TOTAL_CYCLES(node) (0)
 #define PROFILER_NODE_GET_COUNT(node) (0)
 #define PROFILER_NODE_GET_LAST_CYCLES(node) (0)
+#define PROFILER_EVENT_DISPATCH_START(event_type)
+#define PROFILER_EVENT_DISPATCH_STOP(event_type)
+#define SYS_PROFILER_EVENT_DISPATCH_START(event_type)
+#define SYS_PROFILER_EVENT_DISPATCH_STOP(event_type)
 
 #else
 
@@ -85,7 +97,7 @@ extern Profiler g_profiler;
 #define PROFILER_STOP profiler_stop()
 
 #define PROFILER_NODE_START(node) \
-  g_profiler_node_##node.start = DWT->CYCCNT
+  profiler_node_start(&g_profiler_node_##node, DWT->CYCCNT)
 
 #define PROFILER_NODE_STOP(node) \
   profiler_node_stop(&g_profiler_node_##node, DWT->CYCCNT)
@@ -111,6 +123,25 @@ extern Profiler g_profiler;
 #define PROFILER_NODE_GET_COUNT(node) \
   profiler_node_get_count(&g_profiler_node_##node)
 
+#if PROFILER_TRACE
+#define PROFILER_EVENT_DISPATCH_START(event_type) \
+  profiler_trace_event_dispatch(true, event_type)
+
+#define PROFILER_EVENT_DISPATCH_STOP(event_type) \
+  profiler_trace_event_dispatch(false, event_type)
+
+#define SYS_PROFILER_EVENT_DISPATCH_START(event_type) \
+  sys_profiler_trace_event_dispatch(true, event_type)
+
+#define SYS_PROFILER_EVENT_DISPATCH_STOP(event_type) \
+  sys_profiler_trace_event_dispatch(false, event_type)
+#else
+#define PROFILER_EVENT_DISPATCH_START(event_type)
+#define PROFILER_EVENT_DISPATCH_STOP(event_type)
+#define SYS_PROFILER_EVENT_DISPATCH_START(event_type)
+#define SYS_PROFILER_EVENT_DISPATCH_STOP(event_type)
+#endif // PROFILER_TRACE
+
 #endif // PROFILER
 
 void profiler_init(void);
@@ -118,6 +149,7 @@ void profiler_print_stats(void);
 void profiler_start(void);
 void profiler_stop(void);
 uint32_t profiler_cycles_to_us(uint32_t cycles);
+void profiler_node_start(ProfilerNode *node, uint32_t dwt_cyc_cnt);
 void profiler_node_stop(ProfilerNode *node, uint32_t dwt_cyc_cnt);
 uint32_t profiler_node_get_last_cycles(ProfilerNode *node);
 uint32_t profiler_node_get_total_us(ProfilerNode *node);
@@ -132,3 +164,9 @@ void sys_profiler_node_stop(ProfilerNode *node);
 void sys_profiler_start(void);
 void sys_profiler_stop(void);
 void sys_profiler_print_stats(void);
+
+//! Records the start or end of the dispatch of a PebbleEventType in the profiler trace
+void profiler_trace_event_dispatch(bool start, uint16_t event_type);
+void sys_profiler_trace_event_dispatch(bool start, uint16_t event_type);
+//! Hooked up to FreeRTOS's traceTASK_SWITCHED_IN()
+void profiler_trace_task_switched_in(void);
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if PROFILER_TRACE
+
+#include "profiler_trace.h"
+
+#include "util/math.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+_Static_assert((PROFILER_TRACE_NUM_EVENTS & (PROFILER_TRACE_NUM_EVENTS - 1)) == 0,
+               "PROFILER_TRACE_NUM_EVENTS must be a power of two");
+
+static struct {
+  ProfilerTraceEvent events[PROFILER_TRACE_NUM_EVENTS];
+  //! Total number of events recorded since the trace was started. The slot of the next event is
+  //! this value modulo the buffer size.
+  uint32_t head;
+  bool recording;
+} s_trace;
+
+void profiler_trace_start(void) {
+  s_trace.recording = false;
+  s_trace.head = 0;
+  s_trace.recording = true;
+}
+
+void profiler_trace_stop(void) {
+  s_trace.recording = false;
+}
+
+void profiler_trace_record(ProfilerTraceEventType type, uint32_t timestamp, PebbleTask task,
+                           uint16_t event_type, const char *node_name) {
+  if (!s_trace.recording) {
+    return;
+  }
+
+  // Claim a slot atomically so that an interrupt or a task switch landing in the middle of this
+  // can't end up writing to the same slot
+  const uint32_t idx = __atomic_fetch_add(&s_trace.head, 1, __ATOMIC_RELAXED);
+  s_trace.events[idx & (PROFILER_TRACE_NUM_EVENTS - 1)] = (ProfilerTraceEvent) {
+    .timestamp = timestamp,
+    .type = type,
+    .task = task,
+    .event_type = event_type,
+    .node_name = node_name,
+  };
+}
+
+uint32_t profiler_trace_get_num_events(void) {
+  return MIN(s_trace.head, (uint32_t)PROFILER_TRACE_NUM_EVENTS);
+}
+
+uint32_t profiler_trace_get_num_dropped(void) {
+  return s_trace.head - profiler_trace_get_num_events();
+}
+
+static void prv_format_event(char *buf, size_t buf_size, const ProfilerTraceEvent *event) {
+  switch ((ProfilerTraceEventType)event->type) {
+    case ProfilerTraceEventType_NodeStart:
+    case ProfilerTraceEventType_NodeStop:
+      snprintf(buf, buf_size, "PTRACE %"PRIu32" %c %u %s", event->timestamp,
+               (event->type == ProfilerTraceEventType_NodeStart) ? 'B' : 'E', event->task,
+               event->node_name);
+      return;
+    case ProfilerTraceEventType_TaskSwitch:
+      snprintf(buf, buf_size, "PTRACE %"PRIu32" S %u", event->timestamp, event->task);
+      return;
+    case ProfilerTraceEventType_DispatchStart:
+    case ProfilerTraceEventType_DispatchStop:
+      snprintf(buf, buf_size, "PTRACE %"PRIu32" %c %u %u", event->timestamp,
+               (event->type == ProfilerTraceEventType_DispatchStart) ? 'D' : 'd', event->task,
+               event->event_type);
+      return;
+  }
+  snprintf(buf, buf_size, "PTRACE %"PRIu32" ? %u", event->timestamp, event->task);
+}
+
+void profiler_trace_dump(uint32_t cycles_per_us, ProfilerTraceLineCallback cb, void *context) {
+  const bool was_recording = s_trace.recording;
+  s_trace.recording = false;
+
+  const uint32_t num_events = profiler_trace_get_num_events();
+  char buf[80];
+  snprintf(buf, sizeof(buf), "PTRACE begin %"PRIu32" %"PRIu32" %"PRIu32, cycles_per_us,
+           num_events, profiler_trace_get_num_dropped());
+  cb(buf, context);
+
+  // Interrupts and the idle task show up as PebbleTask_Unknown
+  for (int task = 0; task <= PebbleTask_Unknown; task++) {
+    if (task == NumPebbleTask) {
+      continue;
+    }
+    snprintf(buf, sizeof(buf), "PTRACE task %d %s", task, pebble_task_get_name(task));
+    cb(buf, context);
+  }
+
+  for (uint32_t i = s_trace.head - num_events; i != s_trace.head; i++) {
+    prv_format_event(buf, sizeof(buf), &s_trace.events[i & (PROFILER_TRACE_NUM_EVENTS - 1)]);
+    cb(buf, context);
+  }
+
+  cb("PTRACE end", context);
+  s_trace.recording = was_recording;
+}
+
+#endif // PROFILER_TRACE
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/* Profiler trace:
+ *  While the profiler only keeps totals per node, the trace records a timestamped event every
+ *  time a node starts or stops, a task is switched in or the event loop dispatches an event. The
+ *  events are kept in a ring buffer, so the most recent PROFILER_TRACE_NUM_EVENTS survive.
+ *
+ *  Build with the "--profiler_trace" configure option, then use the "profiler start",
+ *  "profiler stop" and "profiler trace" prompt commands. The dump can be converted into the
+ *  Chrome trace format (chrome://tracing, Perfetto) with tools/profiler_trace_to_chrome.py.
+ */
+
+#include "kernel/pebble_tasks.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef PROFILER_TRACE_NUM_EVENTS
+#define PROFILER_TRACE_NUM_EVENTS 512
+#endif
+
+typedef enum {
+  ProfilerTraceEventType_NodeStart,
+  ProfilerTraceEventType_NodeStop,
+  ProfilerTraceEventType_TaskSwitch,
+  ProfilerTraceEventType_DispatchStart,
+  ProfilerTraceEventType_DispatchStop,
+} ProfilerTraceEventType;
+
+typedef struct {
+  uint32_t timestamp;
+  uint8_t type; //!< ProfilerTraceEventType
+  uint8_t task; //!< PebbleTask which was running
+  uint16_t event_type; //!< PebbleEventType for dispatch events
+  const char *node_name; //!< ProfilerNode module_name for node events
+} ProfilerTraceEvent;
+
+//! Called for each line of a trace dump
+typedef void (*ProfilerTraceLineCallback)(const char *line, void *context);
+
+//! Clears the trace and starts recording
+void profiler_trace_start(void);
+
+//! Stops recording, the trace is kept until the next profiler_trace_start()
+void profiler_trace_stop(void);
+
+//! Safe to call from any task and from interrupts
+//! @param timestamp - cycle count at which the event happened
+void profiler_trace_record(ProfilerTraceEventType type, uint32_t timestamp, PebbleTask task,
+                           uint16_t event_type, const char *node_name);
+
+//! @return the number of events currently held in the trace
+uint32_t profiler_trace_get_num_events(void);
+
+//! @return the number of events which were overwritten because the trace filled up
+uint32_t profiler_trace_get_num_dropped(void);
+
+//! Formats the trace oldest event first, one line per callback
+//! @param cycles_per_us - rate of the clock the timestamps were taken with
+void profiler_trace_dump(uint32_t cycles_per_us, ProfilerTraceLineCallback cb, void *context);
@@ -17,6 +17,9 @@
 #include "hdlc.h"
 
 #include "system/passert.h"
+#include "util/math.h"
+
+#include <string.h>
 
 
 void hdlc_streaming_decode_reset(HdlcStreamingContext *ctx) {
@@ -64,3 +67,94 @@ bool hdlc_encode(uint8_t *data) {
   }
   return false;
 }
+
+static bool prv_is_special(uint8_t data) {
+  return (data == HDLC_FLAG) || (data == HDLC_ESCAPE);
+}
+
+//! Returns non-zero if any byte of the word is zero
+static uint32_t prv_has_zero_byte(uint32_t word) {
+  return (word - 0x01010101) & ~word & 0x80808080;
+}
+
+//! Returns the number of bytes before the first flag or escape byte (or length if there are none).
+//! Checks a word at a time since special bytes are rare in most payloads.
+static size_t prv_find_special(const uint8_t *data, size_t length) {
+  size_t i = 0;
+  for (; i + sizeof(uint32_t) <= length; i += sizeof(uint32_t)) {
+    uint32_t word;
+    memcpy(&word, &data[i], sizeof(word));
+    if (prv_has_zero_byte(word ^ 0x7E7E7E7E) || prv_has_zero_byte(word ^ 0x7D7D7D7D)) {
+      break;
+    }
+  }
+  while ((i < length) && !prv_is_special(data[i])) {
+    i++;
+  }
+  return i;
+}
+
+size_t hdlc_decode_buffer(HdlcStreamingContext *ctx, uint8_t *data, size_t length,
+                          size_t *decoded_length, bool *is_complete, bool *hdlc_error) {
+  PBL_ASSERTN(decoded_length != NULL && is_complete != NULL && hdlc_error != NULL);
+  *is_complete = false;
+  *hdlc_error = false;
+  size_t read_idx = 0;
+  size_t write_idx = 0;
+  while (read_idx < length) {
+    if (ctx->escape) {
+      const uint8_t escaped = data[read_idx++];
+      ctx->escape = false;
+      if (prv_is_special(escaped)) {
+        // an escape character can't be followed by a flag or another escape
+        *hdlc_error = true;
+        *is_complete = (escaped == HDLC_FLAG);
+        break;
+      }
+      data[write_idx++] = escaped ^ HDLC_ESCAPE_MASK;
+      continue;
+    }
+
+    // move the run of plain bytes down over any escape characters we've already dropped
+    const size_t run_length = prv_find_special(&data[read_idx], length - read_idx);
+    if (write_idx != read_idx) {
+      memmove(&data[write_idx], &data[read_idx], run_length);
+    }
+    read_idx += run_length;
+    write_idx += run_length;
+    if (read_idx == length) {
+      break;
+    }
+
+    if (data[read_idx++] == HDLC_FLAG) {
+      // we've reached the end of the frame
+      *is_complete = true;
+      break;
+    }
+    // ignore the escape character and escape the next one
+    ctx->escape = true;
+  }
+  *decoded_length = write_idx;
+  return read_idx;
+}
+
+size_t hdlc_encode_buffer(const uint8_t *data, size_t length, uint8_t *out, size_t out_length,
+                          size_t *encoded_length) {
+  PBL_ASSERTN(encoded_length != NULL);
+  size_t read_idx = 0;
+  size_t write_idx = 0;
+  while (read_idx < length) {
+    const size_t max_run_length = MIN(length - read_idx, out_length - write_idx);
+    const size_t run_length = prv_find_special(&data[read_idx], max_run_length);
+    memcpy(&out[write_idx], &data[read_idx], run_length);
+    read_idx += run_length;
+    write_idx += run_length;
+    if ((read_idx == length) || (write_idx + 2 > out_length)) {
+      break;
+    }
+    out[write_idx++] = HDLC_ESCAPE;
+    out[write_idx++] = data[read_idx++] ^ HDLC_ESCAPE_MASK;
+  }
+  *encoded_length = write_idx;
+  return read_idx;
+}
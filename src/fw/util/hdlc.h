@@ -16,8 +16,9 @@
 
 #pragma once
 
-#include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 static const uint8_t HDLC_FLAG = 0x7E;
 static const uint8_t HDLC_ESCAPE = 0x7D;
@@ -31,3 +32,26 @@ void hdlc_streaming_decode_reset(HdlcStreamingContext *ctx);
 bool hdlc_streaming_decode(HdlcStreamingContext *ctx, uint8_t *data, bool *complete,
                            bool *is_invalid);
 bool hdlc_encode(uint8_t *data);
+
+//! Decodes a buffer of received data in place, stopping after the first flag or invalid escape
+//! sequence so the caller can handle the end of the frame. The decoded bytes are identical to the
+//! ones hdlc_streaming_decode() would have stored for the same input.
+//! @param[in,out] data The received data, the decoded bytes are written back to the start of it
+//! @param[in] length The number of bytes in data
+//! @param[out] decoded_length The number of decoded bytes at the start of data
+//! @param[out] is_complete Whether decoding stopped on a flag
+//! @param[out] hdlc_error Whether decoding stopped on an invalid escape sequence
+//! @return The number of bytes of data which were consumed
+size_t hdlc_decode_buffer(HdlcStreamingContext *ctx, uint8_t *data, size_t length,
+                          size_t *decoded_length, bool *is_complete, bool *hdlc_error);
+
+//! Escapes a buffer for sending. Flags are not added. Stops early rather than splitting an escape
+//! sequence if the output buffer fills up, which needs at most 2 * length bytes.
+//! @param[in] data The data to encode
+//! @param[in] length The number of bytes in data
+//! @param[out] out The buffer to write the encoded data to
+//! @param[in] out_length The size of the out buffer
+//! @param[out] encoded_length The number of bytes written to out
+//! @return The number of bytes of data which were consumed
+size_t hdlc_encode_buffer(const uint8_t *data, size_t length, uint8_t *out, size_t out_length,
+                          size_t *encoded_length);
@@ -16,6 +16,10 @@
 
 #include "mbuf_iterator.h"
 
+#include "util/math.h"
+
+#include <string.h>
+
 bool prv_iter_to_valid_mbuf(MBufIterator *iter) {
   // advance the iterator to the next MBuf with data
   while ((iter->m != NULL) && (mbuf_get_length(iter->m) == 0)) {
@@ -65,6 +69,19 @@ bool mbuf_iterator_write_byte(MBufIterator *iter, uint8_t data) {
   return true;
 }
 
+size_t mbuf_iterator_write_bytes(MBufIterator *iter, const uint8_t *data, size_t length) {
+  size_t written = 0;
+  while ((written < length) && !mbuf_iterator_is_finished(iter)) {
+    uint8_t *buffer = mbuf_get_data(iter->m);
+    const size_t chunk_length = MIN(length - written,
+                                    mbuf_get_length(iter->m) - iter->data_index);
+    memcpy(&buffer[iter->data_index], &data[written], chunk_length);
+    iter->data_index += chunk_length;
+    written += chunk_length;
+  }
+  return written;
+}
+
 MBuf *mbuf_iterator_get_current_mbuf(MBufIterator *iter) {
   return iter->m;
 }
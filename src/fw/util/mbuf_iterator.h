@@ -41,5 +41,9 @@ bool mbuf_iterator_read_byte(MBufIterator *iter, uint8_t *data);
 //! Writes the next byte of data in the MBuf chain
 bool mbuf_iterator_write_byte(MBufIterator *iter, uint8_t data);
 
+//! Writes as much of a buffer of data as fits in the rest of the MBuf chain
+//! @return The number of bytes written
+size_t mbuf_iterator_write_bytes(MBufIterator *iter, const uint8_t *data, size_t length);
+
 //! Gets the MBuf which the next byte of data is in
 MBuf *mbuf_iterator_get_current_mbuf(MBufIterator *iter);
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// Helpers for the string routines that work a word at a time. Words are only ever loaded from
+// aligned addresses, which the Cortex-M0 requires, and an aligned load never crosses into memory
+// the caller doesn't own, even when it reaches past the end of the string.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t __attribute__((__may_alias__)) PblibcWord;
+
+#define PBLIBC_WORD_SIZE (sizeof(PblibcWord))
+#define PBLIBC_WORD_LOW_BITS ((PblibcWord)0x01010101)
+#define PBLIBC_WORD_HIGH_BITS ((PblibcWord)0x80808080)
+
+static inline bool pblibc_is_word_aligned(const void *p) {
+  return (((uintptr_t)p & (PBLIBC_WORD_SIZE - 1)) == 0);
+}
+
+//! Whether two pointers can become word aligned at the same time
+static inline bool pblibc_have_same_alignment(const void *p1, const void *p2) {
+  return ((((uintptr_t)p1 ^ (uintptr_t)p2) & (PBLIBC_WORD_SIZE - 1)) == 0);
+}
+
+//! Whether any of the bytes in the word are zero. Only says whether there is one, not where.
+static inline bool pblibc_word_has_zero_byte(PblibcWord word) {
+  return (((word - PBLIBC_WORD_LOW_BITS) & ~word & PBLIBC_WORD_HIGH_BITS) != 0);
+}
+
+//! A word with every byte set to c. XOR a word with it and look for a zero byte to find c.
+static inline PblibcWord pblibc_word_repeat_byte(unsigned char c) {
+  return (c * PBLIBC_WORD_LOW_BITS);
+}
@@ -20,14 +20,32 @@
 
 #include <stddef.h>
 #include <pblibc_private.h>
+#include <pblibc_word.h>
 
 void *memchr(const void *s, int c, size_t n) {
   const unsigned char *p = (const unsigned char*)s;
   unsigned char ch = (unsigned char)c;
-  for (size_t i = 0; i < n; i++) {
-    if (p[i] == ch) {
-      return (void*)&p[i];
+  while (n && !pblibc_is_word_aligned(p)) {
+    if (*p == ch) {
+      return (void*)p;
     }
+    p++;
+    n--;
+  }
+  // Bytes equal to ch become zero when XORed with the repeated pattern
+  const PblibcWord pattern = pblibc_word_repeat_byte(ch);
+  const PblibcWord *w = (const PblibcWord *)p;
+  while (n >= PBLIBC_WORD_SIZE && !pblibc_word_has_zero_byte(*w ^ pattern)) {
+    w++;
+    n -= PBLIBC_WORD_SIZE;
+  }
+  p = (const unsigned char *)w;
+  while (n) {
+    if (*p == ch) {
+      return (void*)p;
+    }
+    p++;
+    n--;
   }
   return NULL;
 }
@@ -20,10 +20,33 @@
 
 #include <stddef.h>
 #include <pblibc_private.h>
+#include <pblibc_word.h>
 
 int memcmp(const void *s1, const void *s2, size_t n) {
   const unsigned char *p1 = (const unsigned char*)s1;
   const unsigned char *p2 = (const unsigned char*)s2;
+  // Only compare words if both buffers line up, the M0 can't load unaligned words
+  if (pblibc_have_same_alignment(p1, p2)) {
+    while (n && !pblibc_is_word_aligned(p1)) {
+      int diff = *p1 - *p2;
+      if (diff) {
+        return diff;
+      }
+      p1++;
+      p2++;
+      n--;
+    }
+    const PblibcWord *w1 = (const PblibcWord *)p1;
+    const PblibcWord *w2 = (const PblibcWord *)p2;
+    while (n >= PBLIBC_WORD_SIZE && *w1 == *w2) {
+      w1++;
+      w2++;
+      n -= PBLIBC_WORD_SIZE;
+    }
+    // The bytes that differ, if any, are in the next word
+    p1 = (const unsigned char *)w1;
+    p2 = (const unsigned char *)w2;
+  }
   while (n--) {
     int diff = *p1 - *p2;
     if (diff) {
@@ -20,15 +20,40 @@
 //   char *strrchr(const char *s1, int c);
 ///////////////////////////////////////
 // Notes:
-//   Tuned for code size.
+//   strchr looks for c and the terminator a word at a time. strrchr is tuned for code size.
 
 #include <stddef.h>
 #include <string.h>
 #include <pblibc_private.h>
+#include <pblibc_word.h>
 
 char *strchr(const char *s, int c) {
-  size_t n = strlen(s) + 1;
-  return memchr(s, c, n);
+  const char *p = s;
+  char ch = (char)c;
+  while (!pblibc_is_word_aligned(p)) {
+    if (*p == ch) {
+      return (char*)p;
+    }
+    if (!*p) {
+      return NULL;
+    }
+    p++;
+  }
+  const PblibcWord pattern = pblibc_word_repeat_byte((unsigned char)ch);
+  const PblibcWord *w = (const PblibcWord *)p;
+  while (!pblibc_word_has_zero_byte(*w) && !pblibc_word_has_zero_byte(*w ^ pattern)) {
+    w++;
+  }
+  p = (const char *)w;
+  while (true) {
+    if (*p == ch) {
+      return (char*)p;
+    }
+    if (!*p) {
+      return NULL;
+    }
+    p++;
+  }
 }
 
 char *strrchr(const char *s, int c) {
@@ -23,21 +23,51 @@
 //   strcmp, strncmp
 ///////////////////////////////////////
 // Notes:
-//   Tuned for code size.
+//   Compares a word at a time when both strings have the same alignment.
 
 #include <stddef.h>
-#include <string.h>
+#include <stdint.h>
 #include <pblibc_private.h>
+#include <pblibc_word.h>
+
+static int prv_strncmp(const char *s1, const char *s2, size_t n) {
+  const unsigned char *p1 = (const unsigned char *)s1;
+  const unsigned char *p2 = (const unsigned char *)s2;
+  if (pblibc_have_same_alignment(p1, p2)) {
+    while (n && !pblibc_is_word_aligned(p1)) {
+      if (*p1 != *p2 || !*p1) {
+        return *p1 - *p2;
+      }
+      p1++;
+      p2++;
+      n--;
+    }
+    const PblibcWord *w1 = (const PblibcWord *)p1;
+    const PblibcWord *w2 = (const PblibcWord *)p2;
+    // Equal words without a terminator can be skipped whole
+    while (n >= PBLIBC_WORD_SIZE && *w1 == *w2 && !pblibc_word_has_zero_byte(*w1)) {
+      w1++;
+      w2++;
+      n -= PBLIBC_WORD_SIZE;
+    }
+    p1 = (const unsigned char *)w1;
+    p2 = (const unsigned char *)w2;
+  }
+  while (n) {
+    if (*p1 != *p2 || !*p1) {
+      return *p1 - *p2;
+    }
+    p1++;
+    p2++;
+    n--;
+  }
+  return 0;
+}
 
 int strcmp(const char *s1, const char *s2) {
-  size_t n = strlen(s1) + 1;
-  return memcmp(s1, s2, n);
+  return prv_strncmp(s1, s2, SIZE_MAX);
 }
 
 int strncmp(const char *s1, const char *s2, size_t n) {
-  size_t strn = strlen(s1) + 1;
-  if (strn < n) {
-    n = strn;
-  }
-  return memcmp(s1, s2, n);
+  return prv_strncmp(s1, s2, n);
 }
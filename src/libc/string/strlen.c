@@ -24,19 +24,46 @@
 
 #include <stddef.h>
 #include <pblibc_private.h>
+#include <pblibc_word.h>
 
 size_t strlen(const char *s) {
-  size_t len = 0;
-  while (*s++) {
-    len++;
+  const char *p = s;
+  while (!pblibc_is_word_aligned(p)) {
+    if (!*p) {
+      return p - s;
+    }
+    p++;
   }
-  return len;
+  const PblibcWord *w = (const PblibcWord *)p;
+  while (!pblibc_word_has_zero_byte(*w)) {
+    w++;
+  }
+  // Find which byte of the word was the terminator
+  p = (const char *)w;
+  while (*p) {
+    p++;
+  }
+  return p - s;
 }
 
 size_t strnlen(const char *s, size_t maxlen) {
-  size_t len = 0;
-  while (*s++ && maxlen--) {
-    len++;
+  const char *p = s;
+  while (maxlen && !pblibc_is_word_aligned(p)) {
+    if (!*p) {
+      return p - s;
+    }
+    p++;
+    maxlen--;
+  }
+  const PblibcWord *w = (const PblibcWord *)p;
+  while (maxlen >= PBLIBC_WORD_SIZE && !pblibc_word_has_zero_byte(*w)) {
+    w++;
+    maxlen -= PBLIBC_WORD_SIZE;
+  }
+  p = (const char *)w;
+  while (maxlen && *p) {
+    p++;
+    maxlen--;
   }
-  return len;
+  return p - s;
 }
@@ -71,6 +71,8 @@ static Write *s_write_head;
 
 static BTErrno s_write_return_value;
 
+static FakeGATTClientOpWriteCallback s_write_cb;
+
 static BTErrno fake_gatt_client_write(BLECharacteristic characteristic,
                                       const uint8_t *value,
                                       size_t value_length,
@@ -79,6 +81,9 @@ static BTErrno fake_gatt_client_write(BLECharacteristic characteristic,
   if (s_write_return_value != BTErrnoOK) {
     return s_write_return_value;
   }
+  if (s_write_cb) {
+    return s_write_cb(characteristic, value, value_length);
+  }
   Write *write = malloc(sizeof(Write));
   uint8_t *buffer;
   if (value_length) {
@@ -146,6 +151,7 @@ void gatt_client_op_cleanup(GAPLEClient client) {
 void fake_gatt_client_op_init(void) {
   s_read_return_value = BTErrnoOK;
   s_write_return_value = BTErrnoOK;
+  s_write_cb = NULL;
 }
 
 void fake_gatt_client_op_deinit(void) {
@@ -181,6 +187,10 @@ void fake_gatt_client_op_set_write_return_value(BTErrno e) {
   s_write_return_value = e;
 }
 
+void fake_gatt_client_op_set_write_callback(FakeGATTClientOpWriteCallback cb) {
+  s_write_cb = cb;
+}
+
 void fake_gatt_client_op_clear_write_list(void) {
   Write *write = s_write_head;
   while (write) {
@@ -31,6 +31,13 @@ void fake_gatt_client_op_assert_read(BLECharacteristic characteristic,
 
 void fake_gatt_client_op_set_write_return_value(BTErrno e);
 
+typedef BTErrno (*FakeGATTClientOpWriteCallback)(BLECharacteristic characteristic,
+                                                 const uint8_t *value, size_t value_length);
+
+//! When set, writes are handed to the callback instead of being queued up for the assert functions.
+//! The callback's return value is returned to the caller of the write.
+void fake_gatt_client_op_set_write_callback(FakeGATTClientOpWriteCallback cb);
+
 void fake_gatt_client_op_clear_write_list(void);
 
 void fake_gatt_client_op_assert_no_write(void);
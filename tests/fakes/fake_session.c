@@ -241,6 +241,30 @@ bool comm_session_send_buffer_write(SendBuffer *sb, const uint8_t *data, size_t
   return true;
 }
 
+uint8_t *comm_session_send_buffer_claim(SendBuffer *sb, size_t length) {
+  CommSession *session = (CommSession *) sb;
+  cl_assert(session);
+  cl_assert(session->temp_write_buffer);
+  if (length + session->bytes_written > session->max_out_payload_length) {
+    return NULL;
+  }
+
+  uint8_t *claimed = session->temp_write_buffer + session->bytes_written;
+  session->bytes_written += length;
+  return claimed;
+}
+
+void comm_session_send_buffer_abort_write(SendBuffer *sb) {
+  CommSession *session = (CommSession *) sb;
+  cl_assert(session);
+  cl_assert(session->temp_write_buffer);
+
+  kernel_free(session->temp_write_buffer);
+  session->temp_write_buffer = NULL;
+  session->endpoint_id = ~0;
+  session->bytes_written = 0;
+}
+
 void comm_session_send_buffer_end_write(SendBuffer *sb) {
   CommSession *session = (CommSession *) sb;
   cl_assert(session);
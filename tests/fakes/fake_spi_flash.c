@@ -16,6 +16,7 @@
 
 #include "fake_spi_flash.h"
 
+#include "drivers/flash.h"
 #include "flash_region/flash_region.h"
 #include "system/status_codes.h"
 
@@ -35,7 +36,9 @@ typedef struct FakeFlashState {
   jmp_buf *jmp_on_failure;
   uint8_t* storage; //! Allocated buffer of length bytes.
   uint32_t write_count;
+  uint32_t write_bytes_count;
   uint32_t erase_count;
+  uint32_t read_count;
 } FakeFlashState;
 
 static FakeFlashState s_state = { 0 };
@@ -60,6 +63,7 @@ void fake_spi_flash_init(uint32_t offset, uint32_t length) {
   s_state.length = length;
   s_state.storage = malloc(length);
   s_state.write_count = 0;
+  s_state.write_bytes_count = 0;
   // Note: this is a harness failure, not a code failure.
   cl_assert(s_state.storage != NULL);
   memset(s_state.storage, 0xff, length);
@@ -117,14 +121,23 @@ void flash_read_bytes(uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size
   cl_assert(start_addr >= s_state.offset);
   cl_assert(start_addr + buffer_size <= s_state.offset + s_state.length);
 
+  ++s_state.read_count;
   memcpy(buffer, s_state.storage + (start_addr - s_state.offset), buffer_size);
 }
 
+void flash_read_bytes_async(FlashReadRequest *request, uint8_t *buffer, uint32_t start_addr,
+                            uint32_t buffer_size, FlashOperationCompleteCb on_complete,
+                            void *context) {
+  flash_read_bytes(buffer, start_addr, buffer_size);
+  on_complete(context, S_SUCCESS);
+}
+
 void flash_write_bytes(const uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size) {
   cl_assert(start_addr >= s_state.offset);
   cl_assert(start_addr + buffer_size <= s_state.offset + s_state.length);
 
   ++s_state.write_count;
+  s_state.write_bytes_count += buffer_size;
 
   for (int i = 0; i < buffer_size; ++i) {
     if (s_state.jmp_on_failure != NULL) {
@@ -190,6 +203,14 @@ uint32_t fake_flash_write_count(void) {
   return s_state.write_count;
 }
 
+uint32_t fake_flash_write_bytes_count(void) {
+  return s_state.write_bytes_count;
+}
+
 uint32_t fake_flash_erase_count(void) {
   return s_state.erase_count;
 }
+
+uint32_t fake_flash_read_count(void) {
+  return s_state.read_count;
+}
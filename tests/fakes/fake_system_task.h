@@ -30,31 +30,79 @@ typedef struct {
   ListNode node;
   SystemTaskEventCallback callback;
   void *data;
+  bool is_high_priority;
+  bool is_running;
 } SystemTaskCallbackNode;
 
 static ListNode *s_system_task_callback_head = NULL;
 static bool s_invoke_as_current = false;
 static uint32_t system_task_available_space = ~(uint32_t)0;
 
-bool system_task_add_callback(SystemTaskEventCallback cb, void *data) {
+static bool prv_fake_system_task_is_pending(SystemTaskEventCallback cb, void *data) {
+  SystemTaskCallbackNode *node = (SystemTaskCallbackNode *) s_system_task_callback_head;
+  while (node) {
+    if (node->callback == cb && node->data == data && !node->is_running) {
+      return true;
+    }
+    node = (SystemTaskCallbackNode *) list_get_next(&node->node);
+  }
+  return false;
+}
+
+bool system_task_add_callback_with_flags(SystemTaskEventCallback cb, void *data,
+                                         SystemTaskCallbackFlags flags) {
+  cl_assert(cb);
+  if ((flags & SystemTaskCallbackFlag_Coalesce) && prv_fake_system_task_is_pending(cb, data)) {
+    return true;
+  }
+
   SystemTaskCallbackNode *node = (SystemTaskCallbackNode *) malloc(sizeof(SystemTaskCallbackNode));
   cl_assert(node != NULL);
   list_init(&node->node);
 
-  cl_assert(cb);
   node->callback = cb;
   node->data = data;
-
-  s_system_task_callback_head = list_prepend(s_system_task_callback_head, &node->node);
+  node->is_high_priority = (flags & SystemTaskCallbackFlag_HighPriority);
+
+  // The tail is invoked first, so high priority callbacks go right after the ones at the tail
+  SystemTaskCallbackNode *tail = (SystemTaskCallbackNode *) list_get_tail(s_system_task_callback_head);
+  if (node->is_high_priority && tail) {
+    SystemTaskCallbackNode *after = tail;
+    while (after && after->is_high_priority) {
+      after = (SystemTaskCallbackNode *) list_get_prev(&after->node);
+    }
+    if (after) {
+      list_insert_after(&after->node, &node->node);
+    } else {
+      s_system_task_callback_head = list_prepend(s_system_task_callback_head, &node->node);
+    }
+  } else {
+    s_system_task_callback_head = list_prepend(s_system_task_callback_head, &node->node);
+  }
   cl_assert(s_system_task_callback_head);
   system_task_available_space--;
   return true;
 }
 
+bool system_task_add_callback(SystemTaskEventCallback cb, void *data) {
+  return system_task_add_callback_with_flags(cb, data, SystemTaskCallbackFlag_None);
+}
+
+bool system_task_add_callback_coalesced(SystemTaskEventCallback cb, void *data) {
+  return system_task_add_callback_with_flags(cb, data, SystemTaskCallbackFlag_Coalesce);
+}
+
+bool system_task_add_callback_from_isr_with_flags(SystemTaskEventCallback cb, void *data,
+                                                  SystemTaskCallbackFlags flags,
+                                                  bool *should_context_switch) {
+  *should_context_switch = false;
+  return system_task_add_callback_with_flags(cb, data, flags);
+}
+
 bool system_task_add_callback_from_isr(SystemTaskEventCallback cb, void *data,
                                        bool *should_context_switch) {
-  *should_context_switch = false;
-  return system_task_add_callback(cb, data);
+  return system_task_add_callback_from_isr_with_flags(cb, data, SystemTaskCallbackFlag_None,
+                                                      should_context_switch);
 }
 
 uint32_t system_task_get_available_space(void) {
@@ -88,6 +136,7 @@ void fake_system_task_callbacks_invoke(int num_to_invoke) {
   while (node && num_to_invoke) {
     // do callback first, in case callback enqueues more callbacks
     if (node->callback) {
+      node->is_running = true;
       s_fake_system_task_current_cb = node->callback;
       node->callback(node->data);
       s_fake_system_task_current_cb = NULL;
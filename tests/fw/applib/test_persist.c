@@ -29,15 +29,15 @@
 
 // Stubs
 ////////////////////////////////////
+#include "fake_new_timer.h"
 #include "fake_rtc.h"
 #include "fake_spi_flash.h"
+#include "fake_system_task.h"
 #include "stubs_analytics.h"
 #include "stubs_hexdump.h"
 #include "stubs_logging.h"
 #include "stubs_mutex.h"
 #include "stubs_passert.h"
-#include "stubs_pbl_malloc.h"
-#include "stubs_pebble_tasks.h"
 #include "stubs_print.h"
 #include "stubs_prompt.h"
 #include "stubs_rand_ptr.h"
@@ -117,6 +117,8 @@ void test_persist__initialize(void) {
 
 void test_persist__cleanup(void) {
   persist_service_client_close(&test_uuid_a);
+  fake_system_task_callbacks_cleanup();
+  stub_new_timer_cleanup();
 }
 
 void test_persist__int(void) {
@@ -291,3 +293,108 @@ void test_persist__legacy2_max_usage(void) {
   // cl_assert_equal_i(persist_write_data(n + 1, &buffer, sizeof(buffer)),
   //                  E_OUT_OF_STORAGE);
 }
+
+void test_persist__rewrite_key_1000_times(void) {
+  const uint32_t key = 0;
+  cl_assert_equal_i(persist_write_int(key, -1), sizeof(int));
+
+  // Only the first rewrite gets cached, all other ones just update the cached value
+  const uint32_t bytes_before = fake_flash_write_bytes_count();
+  for (int i = 0; i < 1000; i++) {
+    cl_assert_equal_i(persist_write_int(key, i), sizeof(int));
+    cl_assert_equal_i(persist_read_int(key), i);
+  }
+  cl_assert_equal_i(fake_flash_write_bytes_count(), bytes_before);
+
+  // Flushing writes a single record, instead of one for every write
+  persist_service_flush_all();
+  const uint32_t bytes_written = fake_flash_write_bytes_count() - bytes_before;
+  cl_assert(bytes_written > 0);
+  cl_assert(bytes_written < 64);
+
+  persist_service_client_close(&test_uuid_a);
+  persist_service_client_open(&test_uuid_a);
+  cl_assert_equal_i(persist_read_int(key), 999);
+}
+
+void test_persist__flush_timer(void) {
+  const uint32_t key = 0;
+  cl_assert_equal_i(persist_write_int(key, 1), sizeof(int));
+  cl_assert_equal_i(persist_write_int(key, 2), sizeof(int));
+
+  const TimerID timer = stub_new_timer_get_next();
+  cl_assert(timer != TIMER_INVALID_ID);
+  const uint32_t bytes_before = fake_flash_write_bytes_count();
+
+  // The timer only defers the flush to KernelBG
+  cl_assert(stub_new_timer_fire(timer));
+  cl_assert_equal_i(fake_flash_write_bytes_count(), bytes_before);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert(fake_flash_write_bytes_count() > bytes_before);
+  cl_assert(!stub_new_timer_is_scheduled(timer));
+}
+
+void test_persist__flush_on_exit(void) {
+  const uint32_t key = 0;
+  cl_assert_equal_i(persist_write_int(key, 1), sizeof(int));
+  cl_assert_equal_i(persist_write_int(key, 2), sizeof(int));
+
+  persist_service_client_close(&test_uuid_a);
+  // Nothing cached is left behind for the flush timer
+  const uint32_t bytes_after_close = fake_flash_write_bytes_count();
+  persist_service_flush_all();
+  cl_assert_equal_i(fake_flash_write_bytes_count(), bytes_after_close);
+
+  persist_service_client_open(&test_uuid_a);
+  cl_assert_equal_i(persist_read_int(key), 2);
+}
+
+void test_persist__size_change_after_cached_write(void) {
+  const uint32_t key = 0;
+  cl_assert_equal_i(persist_write_int(key, 1), sizeof(int));
+  cl_assert_equal_i(persist_write_int(key, 2), sizeof(int));
+  cl_assert_equal_i(persist_write_bool(key, true), sizeof(bool));
+  cl_assert_equal_i(persist_get_size(key), sizeof(bool));
+  cl_assert_equal_i(persist_read_bool(key), true);
+
+  persist_service_client_close(&test_uuid_a);
+  persist_service_client_open(&test_uuid_a);
+  cl_assert_equal_i(persist_get_size(key), sizeof(bool));
+  cl_assert_equal_i(persist_read_bool(key), true);
+}
+
+void test_persist__delete_cached_key(void) {
+  const uint32_t key = 0;
+  cl_assert_equal_i(persist_write_int(key, 1), sizeof(int));
+  cl_assert_equal_i(persist_write_int(key, 2), sizeof(int));
+  cl_assert_equal_i(persist_delete(key), S_TRUE);
+  cl_assert_equal_b(persist_exists(key), false);
+
+  // The cached value must not come back when the cache gets flushed
+  persist_service_client_close(&test_uuid_a);
+  persist_service_client_open(&test_uuid_a);
+  cl_assert_equal_b(persist_exists(key), false);
+  cl_assert_equal_i(persist_read_int(key), 0);
+}
+
+void test_persist__cache_full(void) {
+  // More keys than the cache holds all keep their latest value
+  const int num_keys = 20;
+  for (int i = 0; i < num_keys; i++) {
+    cl_assert_equal_i(persist_write_int(i, 0), sizeof(int));
+  }
+  for (int round = 1; round <= 3; round++) {
+    for (int i = 0; i < num_keys; i++) {
+      cl_assert_equal_i(persist_write_int(i, round * 100 + i), sizeof(int));
+    }
+  }
+  for (int i = 0; i < num_keys; i++) {
+    cl_assert_equal_i(persist_read_int(i), 300 + i);
+  }
+
+  persist_service_client_close(&test_uuid_a);
+  persist_service_client_open(&test_uuid_a);
+  for (int i = 0; i < num_keys; i++) {
+    cl_assert_equal_i(persist_read_int(i), 300 + i);
+  }
+}
@@ -16,9 +16,12 @@
 
 #include "applib/graphics/gtypes.h"
 #include "applib/graphics/text_render.h"
+#include "util/size.h"
 
 #include "clar.h"
 
+#include <string.h>
+
 #include "stubs_applib_resource.h"
 #include "stubs_app_state.h"
 #include "stubs_compiled_with_legacy2_sdk.h"
@@ -28,89 +31,176 @@
 #include "stubs_resources.h"
 #include "stubs_syscalls.h"
 
-GBitmap* graphics_context_get_bitmap(GContext* ctx) { return NULL; }
+static GBitmap *s_bitmap;
+static GlyphData *s_glyph;
+
+GBitmap* graphics_context_get_bitmap(GContext* ctx) { return s_bitmap; }
 
 void graphics_context_mark_dirty_rect(GContext* ctx, GRect rect) {}
 
 const GlyphData* text_resources_get_glyph(FontCache* font_cache, const Codepoint codepoint,
-                                          FontInfo* fontinfo) { return NULL; }
-
+                                          FontInfo* fontinfo) { return s_glyph; }
 
-extern int32_t prv_convert_1bit_addr_to_8bit_x(GBitmap *dest_bitmap, uint32_t *block_addr,
-                                               int32_t y_offset);
-
-static int32_t prv_get_8bit_x_from_1bit_x(int32_t dest_1bit_x) {
-  return (((dest_1bit_x / 32) * 4)) * 8;
-}
+// Glyphs and reference rendering
+///////////////////////////////////////////////////////////
 
-void test_text_render__convert_1bit_to_8bit_144x168(void) {
-  GSize size = GSize(144, 168);
-  const int row_1bit_size_words = 1 + (size.w - 1) / 32;
+#define MAX_GLYPH_SIZE (64)
 
-  GBitmap *bitmap = gbitmap_create_blank(size, GBitmapFormat8Bit);
-  uintptr_t base = (uintptr_t)bitmap->addr;
+static uint32_t s_random;
 
-  int dest_x = 0;
-  int dest_y = 0;
-  uint32_t *block_addr = NULL;
+static uint32_t prv_random(void) {
+  s_random = s_random * 1103515245 + 12345;
+  return s_random >> 8;
+}
 
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+static int prv_random_range(int min, int max) {
+  return min + (int)(prv_random() % (uint32_t)(max - min + 1));
+}
 
-  dest_x = 50;
-  dest_y = 0;
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+static void prv_set_glyph(int width, int height, int left_offset, int top_offset,
+                          bool random_bits) {
+  s_glyph->header = (GlyphHeaderData) {
+    .width_px = width,
+    .height_px = height,
+    .left_offset_px = left_offset,
+    .top_offset_px = top_offset,
+  };
+  const size_t num_words = (MAX_GLYPH_SIZE * MAX_GLYPH_SIZE + 31) / 32;
+  for (size_t i = 0; i < num_words; i++) {
+    s_glyph->data[i] = random_bits ? ((prv_random() << 16) ^ prv_random()) : 0xaaaa5555;
+  }
+}
 
-  dest_x = 0;
-  dest_y = 50;
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+static bool prv_glyph_bit_is_set(int x, int y) {
+  const uint32_t index = y * s_glyph->header.width_px + x;
+  return (s_glyph->data[index / 32] & (1u << (index % 32)));
+}
 
-  dest_x = 20;
-  dest_y = 100;
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+//! Writes every set bit of the glyph that lands inside the clip box and the bitmap's data rows,
+//! one pixel at a time
+static void prv_render_reference(GContext *ctx, GBitmap *bitmap, GRect cursor) {
+  const GRect clip = ctx->draw_state.clip_box;
+  for (int y = 0; y < s_glyph->header.height_px; y++) {
+    const int dest_y = cursor.origin.y + s_glyph->header.top_offset_px + y;
+    if (dest_y < clip.origin.y || dest_y >= grect_get_max_y(&clip)) {
+      continue;
+    }
+    const GBitmapDataRowInfo row = gbitmap_get_data_row_info(bitmap, dest_y);
+    for (int x = 0; x < s_glyph->header.width_px; x++) {
+      const int dest_x = cursor.origin.x + s_glyph->header.left_offset_px + x;
+      if (dest_x < clip.origin.x || dest_x >= grect_get_max_x(&clip) ||
+          dest_x < row.min_x || dest_x > row.max_x || !prv_glyph_bit_is_set(x, y)) {
+        continue;
+      }
+      GColor color = ctx->draw_state.text_color;
+      if (ctx->draw_state.compositing_mode == GCompOpSet) {
+        color = gcolor_alpha_blend(color, (GColor) { .argb = row.data[dest_x] });
+      } else {
+        color.a = 3;
+      }
+      row.data[dest_x] = color.argb;
+    }
+  }
+}
 
-  gbitmap_destroy(bitmap);
+static void prv_fill_random(GBitmap *bitmap) {
+  uint8_t *data = bitmap->addr;
+  const size_t size = bitmap->row_size_bytes * bitmap->bounds.size.h;
+  for (size_t i = 0; i < size; i++) {
+    data[i] = prv_random();
+  }
 }
 
-void test_text_render__convert_1bit_to_8bit_180x180(void) {
-  GSize size = GSize(180, 180);
-  const int row_1bit_size_words = 1 + (size.w - 1) / 32;
+//! Renders random glyphs at random positions, colors and clip boxes and checks every pixel of the
+//! bitmap against the reference
+static void prv_check_random_glyphs(GBitmap *bitmap, int num_glyphs) {
+  const size_t size = bitmap->row_size_bytes * bitmap->bounds.size.h;
+  uint8_t *expected = malloc(size);
+  s_bitmap = bitmap;
+
+  for (int i = 0; i < num_glyphs; i++) {
+    prv_set_glyph(prv_random_range(1, MAX_GLYPH_SIZE), prv_random_range(1, MAX_GLYPH_SIZE),
+                  prv_random_range(-4, 4), prv_random_range(-4, 4), true);
+
+    GContext ctx = {};
+    const GRect bounds = bitmap->bounds;
+    if (prv_random() % 2) {
+      ctx.draw_state.clip_box = bounds;
+    } else {
+      const int x = prv_random_range(0, bounds.size.w - 1);
+      const int y = prv_random_range(0, bounds.size.h - 1);
+      ctx.draw_state.clip_box = GRect(x, y, prv_random_range(0, bounds.size.w - x),
+                                      prv_random_range(0, bounds.size.h - y));
+    }
+    ctx.draw_state.text_color = (GColor) { .argb = prv_random() };
+    ctx.draw_state.compositing_mode = (prv_random() % 2) ? GCompOpSet : GCompOpAssign;
+    const GRect cursor = GRect(prv_random_range(-MAX_GLYPH_SIZE, bounds.size.w),
+                               prv_random_range(-MAX_GLYPH_SIZE, bounds.size.h), 0, 0);
+
+    prv_fill_random(bitmap);
+    memcpy(expected, bitmap->addr, size);
+    render_glyph(&ctx, 'a', NULL, cursor);
+
+    uint8_t *rendered = bitmap->addr;
+    bitmap->addr = expected;
+    prv_render_reference(&ctx, bitmap, cursor);
+    bitmap->addr = rendered;
+    cl_assert_equal_m(rendered, expected, size);
+  }
+  free(expected);
+}
 
-  GBitmap *bitmap = gbitmap_create_blank(size, GBitmapFormat8Bit);
-  uintptr_t base = (uintptr_t)bitmap->addr;
+// Tests
+///////////////////////////////////////////////////////////
 
-  int dest_x = 0;
-  int dest_y = 0;
-  uint32_t *block_addr = NULL;
+#define ROUND_DISPLAY_SIZE (180)
 
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+static GBitmapDataRowInfoInternal s_round_row_infos[ROUND_DISPLAY_SIZE];
 
-  dest_x = 50;
-  dest_y = 0;
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+void test_text_render__initialize(void) {
+  s_random = 1;
+  // Real glyphs are followed by more font data, so leave a spare word after the bits
+  s_glyph = malloc(sizeof(GlyphData) + ((MAX_GLYPH_SIZE * MAX_GLYPH_SIZE + 31) / 32 + 1) * 4);
+}
 
-  dest_x = 0;
-  dest_y = 50;
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+void test_text_render__cleanup(void) {
+  free(s_glyph);
+  s_glyph = NULL;
+  s_bitmap = NULL;
+}
 
-  dest_x = 20;
-  dest_y = 100;
-  block_addr = (uint32_t *)(uintptr_t)(((dest_y * row_1bit_size_words) + (dest_x / 32)) * 4);
-  cl_assert_equal_i(prv_convert_1bit_addr_to_8bit_x(bitmap, block_addr, dest_y),
-                    prv_get_8bit_x_from_1bit_x(dest_x));
+void test_text_render__matches_reference_144x168(void) {
+  GBitmap *bitmap = gbitmap_create_blank(GSize(144, 168), GBitmapFormat8Bit);
+  prv_check_random_glyphs(bitmap, 5000);
+  gbitmap_destroy(bitmap);
+}
 
+void test_text_render__matches_reference_200x228(void) {
+  GBitmap *bitmap = gbitmap_create_blank(GSize(200, 228), GBitmapFormat8Bit);
+  prv_check_random_glyphs(bitmap, 5000);
   gbitmap_destroy(bitmap);
 }
+
+void test_text_render__matches_reference_round(void) {
+  // Rows get narrower towards the top and bottom, like on a round display
+  uint16_t offset = ROUND_DISPLAY_SIZE / 4;
+  for (int y = 0; y < ROUND_DISPLAY_SIZE; y++) {
+    const int inset = ABS(ROUND_DISPLAY_SIZE / 2 - y) / 2;
+    s_round_row_infos[y] = (GBitmapDataRowInfoInternal) {
+      .offset = offset - inset,
+      .min_x = inset,
+      .max_x = ROUND_DISPLAY_SIZE - 1 - inset,
+    };
+    offset += ROUND_DISPLAY_SIZE - 2 * inset;
+  }
+  GBitmap bitmap = {
+    .addr = malloc(ROUND_DISPLAY_SIZE * ROUND_DISPLAY_SIZE),
+    .row_size_bytes = ROUND_DISPLAY_SIZE,
+    .info.format = GBitmapFormat8BitCircular,
+    .info.version = GBITMAP_VERSION_CURRENT,
+    .bounds = GRect(0, 0, ROUND_DISPLAY_SIZE, ROUND_DISPLAY_SIZE),
+    .data_row_infos = s_round_row_infos,
+  };
+  prv_check_random_glyphs(&bitmap, 5000);
+  free(bitmap.addr);
+}
@@ -45,6 +45,7 @@
 #include "fake_gatt_client_subscriptions.h"
 #include "fake_new_timer.h"
 #include "fake_pbl_malloc.h"
+#include "fake_rtc.h"
 #include "fake_session.h"
 #include "fake_system_task.h"
 
@@ -86,6 +87,9 @@ extern Transport *ppogatt_client_for_uuid(const Uuid *uuid);
 extern bool ppogatt_has_client_for_uuid(const Uuid *uuid);
 extern uint32_t ppogatt_client_count(void);
 extern void ppogatt_trigger_rx_ack_send_timeout(void);
+extern void ppogatt_trigger_rto_timeout(void);
+extern bool ppogatt_is_rto_timer_scheduled(Transport *transport);
+extern uint32_t ppogatt_get_rto_ms(Transport *transport);
 extern TransportDestination ppogatt_get_destination(Transport *transport);
 
 static const uint8_t s_num_service_instances = 2;
@@ -270,6 +274,16 @@ static void prv_assert_sent_ack(BLECharacteristic characteristic, uint8_t sn) {
                                    GAPLEClientKernel, false /* is_response_required */);
 }
 
+static void prv_advance_ms(uint32_t ms) {
+  fake_rtc_increment_ticks(((RtcTicks)ms * RTC_TICKS_HZ) / 1000);
+}
+
+//! Lets enough time pass for any retransmission timeout to expire and fires the timer
+static void prv_expire_rto(void) {
+  prv_advance_ms(PPOGATT_MAX_RTO_MS);
+  ppogatt_trigger_rto_timeout();
+}
+
 static void prv_assert_sent_data(BLECharacteristic characteristic, uint8_t sn,
                                  const uint8_t *data, size_t length) {
   cl_assert(length <= MAX_PAYLOAD_SIZE);
@@ -293,6 +307,7 @@ void test_ppogatt__initialize(void) {
   prv_create_expected_reset_request();
   prv_create_expected_reset_complete();
   s_mtu_size = MTU_SIZE;
+  fake_rtc_init(0, 0);
   fake_pbl_malloc_clear_tracking();
   fake_gatt_client_op_init();
   fake_gatt_client_subscriptions_init();
@@ -893,32 +908,41 @@ void test_ppogatt__retransmit_timed_out_data_packets_all_at_once(void) {
                          s_short_data_fragment, sizeof(s_short_data_fragment) - sn);
   }
 
-  // Simulate the regular timer firing a bunch of times to expire the timeout for all the packets:
-  for (int i = 0; i < PPOGATT_TIMEOUT_TICKS; ++i) {
-    regular_timer_fire_seconds(PPOGATT_TIMEOUT_TICK_INTERVAL_SECS);
-  }
-
+  // Expire the timeout of the oldest packet:
+  prv_expire_rto();
   fake_comm_session_process_send_next();
 
+  uint8_t first_resent_sn = 0;
+  if (s_ppogatt_version > 0) {
+    // Only the oldest packet is sent again at first:
+    prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], 0 /* sn */,
+                         s_short_data_fragment, sizeof(s_short_data_fragment));
+    fake_gatt_client_op_assert_no_write();
+
+    // The server only Acks the resent packet, so it must have dropped the ones that followed:
+    prv_receive_ack(s_characteristics[0][PPoGATTCharacteristicData], 0 /* sn */);
+    first_resent_sn = 1;
+  }
+
   // The data should *NOT* get concatenated in a single packet, even though it might fit. The
   // fragmentation should be the same as the previous transmission pass, because there is a race
   // condition where there are Ack(s) in flight for the "original" data packets. Because we're
   // using the same SNs, we cannot change the fragmentation, because we cannot know whether they
   // would refer to the old or new fragmentation.
 
-  for (sn = 0; sn < s_tx_window_size; ++sn) {
+  for (sn = first_resent_sn; sn < s_tx_window_size; ++sn) {
     prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn /* sn */,
                          s_short_data_fragment, sizeof(s_short_data_fragment) - sn);
   }
+  fake_gatt_client_op_assert_no_write();
 }
 
-void test_ppogatt__retransmit_timed_out_data_packets_first_but_not_later_ones(void) {
+void test_ppogatt__retransmit_timed_out_data_packets_server_kept_later_ones(void) {
   test_ppogatt__open_session_when_found_pebble_app();
   uint8_t sn = 0;
   Transport *transport = ppogatt_client_for_uuid(&s_meta_v0_system.app_uuid);
 
   // Get s_tx_window_size packets in flight:
-  uint8_t secs_passed = 0;
   for (sn = 0; sn < s_tx_window_size; ++sn) {
     cl_assert_equal_b(fake_comm_session_send_buffer_write_raw_by_transport(transport,
                                                          s_short_data_fragment,
@@ -926,27 +950,32 @@ void test_ppogatt__retransmit_timed_out_data_packets_first_but_not_later_ones(vo
     ppogatt_send_next(transport);
     prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
                          s_short_data_fragment, sizeof(s_short_data_fragment) - sn);
-    if (sn == 0 || sn == 1) {
-      // Make the first and second packet time out each, one second earlier
-      // than the 3rd and 4rd packets:
-      regular_timer_fire_seconds(PPOGATT_TIMEOUT_TICK_INTERVAL_SECS);
-      ++secs_passed;
-    }
-    cl_assert(secs_passed < PPOGATT_TIMEOUT_TICKS);
-  }
-
-  // Simulate the regular timer firing a bunch of times to expire the timeout for the in-flight packets
-  // This will trigger a retransmit of the un-acked packets
-  for (int i = 0; i < PPOGATT_TIMEOUT_TICKS - 1; ++i) {
-    regular_timer_fire_seconds(PPOGATT_TIMEOUT_TICK_INTERVAL_SECS);
   }
 
+  // The first packet got lost, the server holds on to the others (if it can):
+  prv_expire_rto();
   fake_comm_session_process_send_next();
 
-  for (sn = 0; sn < s_tx_window_size; ++sn) {
-    prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn /* sn */,
+  const uint8_t num_resent = (s_ppogatt_version > 0) ? 1 : s_tx_window_size;
+  for (sn = 0; sn < num_resent; ++sn) {
+    prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
                          s_short_data_fragment, sizeof(s_short_data_fragment) - sn);
   }
+  fake_gatt_client_op_assert_no_write();
+
+  // The resent packet fills the hole, so the server Acks everything:
+  prv_receive_ack(s_characteristics[0][PPoGATTCharacteristicData], s_tx_window_size - 1);
+  fake_comm_session_process_send_next();
+  fake_gatt_client_op_assert_no_write();
+  cl_assert_equal_b(ppogatt_is_rto_timer_scheduled(transport), false);
+
+  // New data goes out right away:
+  cl_assert_equal_b(fake_comm_session_send_buffer_write_raw_by_transport(transport,
+                                                         s_short_data_fragment,
+                                                         sizeof(s_short_data_fragment)), true);
+  ppogatt_send_next(transport);
+  prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], s_tx_window_size,
+                       s_short_data_fragment, sizeof(s_short_data_fragment));
 }
 
 void test_ppogatt__retransmit_timed_out_data_packets_race_everything_acked_at_once(void) {
@@ -964,10 +993,8 @@ void test_ppogatt__retransmit_timed_out_data_packets_race_everything_acked_at_on
                          s_short_data_fragment, sizeof(s_short_data_fragment) - sn);
   }
 
-  // Time-out all packets in flight, rolling back for retransmission:
-  for (int i = 0; i < PPOGATT_TIMEOUT_TICKS; ++i) {
-    regular_timer_fire_seconds(PPOGATT_TIMEOUT_TICK_INTERVAL_SECS);
-  }
+  // Time-out the packets in flight, scheduling the retransmission:
+  prv_expire_rto();
 
   // Simulate receiving an ack for the last, after the roll-back, but before the packets are
   // retransmitted (the last part shouldn't matter much, but simplifies the test a bit)
@@ -1002,18 +1029,14 @@ void test_ppogatt__retransmit_max_number_of_times(void) {
 
   for (int j = 0; j < PPOGATT_TIMEOUT_COUNT_MAX - 1; ++j) {
     // Time-out the packet over and over until (max - 1) is reached:
-    for (int i = 0; i < PPOGATT_TIMEOUT_TICKS; ++i) {
-      regular_timer_fire_seconds(PPOGATT_TIMEOUT_TICK_INTERVAL_SECS);
-    }
+    prv_expire_rto();
     fake_comm_session_process_send_next();
     prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
                          s_short_data_fragment, sizeof(s_short_data_fragment) - sn);
   }
 
   // The last straw:
-  for (int i = 0; i < PPOGATT_TIMEOUT_TICKS; ++i) {
-    regular_timer_fire_seconds(PPOGATT_TIMEOUT_TICK_INTERVAL_SECS);
-  }
+  prv_expire_rto();
   prv_assert_sent_reset_request(s_characteristics[0][PPoGATTCharacteristicData]);
 }
 
@@ -1032,12 +1055,13 @@ void test_ppogatt__make_sure_timeout_reset_after_data_ack(void) {
   }
 
   for (int sn = 0; sn < num_packets; sn++) {
-    for (int i = 0; i < (PPOGATT_TIMEOUT_TICKS - 1); ++i) {
-      regular_timer_fire_seconds(PPOGATT_TIMEOUT_TICK_INTERVAL_SECS);
-    }
+    // Each Ack comes in just before the timeout would expire and restarts it:
+    cl_assert_equal_b(ppogatt_is_rto_timer_scheduled(transport), true);
+    prv_advance_ms(ppogatt_get_rto_ms(transport) - 1);
 
     prv_receive_ack(s_characteristics[0][PPoGATTCharacteristicData], sn /* sn */);
   }
+  cl_assert_equal_b(ppogatt_is_rto_timer_scheduled(transport), false);
 
   fake_comm_session_process_send_next();
 
@@ -1051,6 +1075,106 @@ void test_ppogatt__make_sure_timeout_reset_after_data_ack(void) {
   fake_gatt_client_op_assert_no_write();
 }
 
+void test_ppogatt__rto_adapts_to_measured_round_trip_time(void) {
+  test_ppogatt__open_session_when_found_pebble_app();
+  Transport *transport = ppogatt_client_for_uuid(&s_meta_v0_system.app_uuid);
+  cl_assert_equal_i(ppogatt_get_rto_ms(transport), PPOGATT_INITIAL_RTO_MS);
+
+  for (int i = 0; i < 40; ++i) {
+    const uint8_t sn = i % PPOGATT_SN_MOD_DIV;
+    cl_assert_equal_b(fake_comm_session_send_buffer_write_raw_by_transport(transport,
+                                                             s_short_data_fragment,
+                                                             sizeof(s_short_data_fragment)), true);
+    ppogatt_send_next(transport);
+    prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
+                         s_short_data_fragment, sizeof(s_short_data_fragment));
+    prv_advance_ms(1000);
+    prv_receive_ack(s_characteristics[0][PPoGATTCharacteristicData], sn);
+
+    if (i == 0) {
+      // First measurement: RTO = RTT + 4 * (RTT / 2)
+      cl_assert_equal_i(ppogatt_get_rto_ms(transport), 3000);
+    }
+  }
+  // The variation decays with a steady round trip time:
+  const uint32_t steady_rto_ms = ppogatt_get_rto_ms(transport);
+  cl_assert(steady_rto_ms >= 1000 && steady_rto_ms < 1100);
+
+  // A timeout backs off:
+  const uint8_t sn = 40 % PPOGATT_SN_MOD_DIV;
+  cl_assert_equal_b(fake_comm_session_send_buffer_write_raw_by_transport(transport,
+                                                           s_short_data_fragment,
+                                                           sizeof(s_short_data_fragment)), true);
+  ppogatt_send_next(transport);
+  prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
+                       s_short_data_fragment, sizeof(s_short_data_fragment));
+  prv_expire_rto();
+  fake_comm_session_process_send_next();
+  prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
+                       s_short_data_fragment, sizeof(s_short_data_fragment));
+  cl_assert_equal_i(ppogatt_get_rto_ms(transport), 2 * steady_rto_ms);
+
+  // The Ack for a retransmitted packet ends the back-off, but doesn't count as a measurement
+  // (Karn's algorithm):
+  prv_advance_ms(10);
+  prv_receive_ack(s_characteristics[0][PPoGATTCharacteristicData], sn);
+  cl_assert_equal_i(ppogatt_get_rto_ms(transport), steady_rto_ms);
+}
+
+void test_ppogatt__rto_clamped_to_minimum(void) {
+  test_ppogatt__open_session_when_found_pebble_app();
+  Transport *transport = ppogatt_client_for_uuid(&s_meta_v0_system.app_uuid);
+
+  cl_assert_equal_b(fake_comm_session_send_buffer_write_raw_by_transport(transport,
+                                                           s_short_data_fragment,
+                                                           sizeof(s_short_data_fragment)), true);
+  ppogatt_send_next(transport);
+  prv_advance_ms(20);
+  prv_receive_ack(s_characteristics[0][PPoGATTCharacteristicData], 0 /* sn */);
+  cl_assert_equal_i(ppogatt_get_rto_ms(transport), PPOGATT_MIN_RTO_MS);
+}
+
+void test_ppogatt__no_reset_on_short_timeouts_until_stalled(void) {
+  test_ppogatt__open_session_when_found_pebble_app();
+  Transport *transport = ppogatt_client_for_uuid(&s_meta_v0_system.app_uuid);
+
+  // Measure a short round trip time:
+  uint8_t sn = 0;
+  cl_assert_equal_b(fake_comm_session_send_buffer_write_raw_by_transport(transport,
+                                                           s_short_data_fragment,
+                                                           sizeof(s_short_data_fragment)), true);
+  ppogatt_send_next(transport);
+  prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
+                       s_short_data_fragment, sizeof(s_short_data_fragment));
+  prv_advance_ms(100);
+  prv_receive_ack(s_characteristics[0][PPoGATTCharacteristicData], sn);
+
+  // The link stalls:
+  ++sn;
+  cl_assert_equal_b(fake_comm_session_send_buffer_write_raw_by_transport(transport,
+                                                           s_short_data_fragment,
+                                                           sizeof(s_short_data_fragment)), true);
+  ppogatt_send_next(transport);
+  prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
+                       s_short_data_fragment, sizeof(s_short_data_fragment));
+
+  uint32_t stalled_ms = 0;
+  while (true) {
+    const uint32_t rto_ms = ppogatt_get_rto_ms(transport);
+    prv_advance_ms(rto_ms);
+    stalled_ms += rto_ms;
+    ppogatt_trigger_rto_timeout();
+    fake_comm_session_process_send_next();
+    if (stalled_ms >= PPOGATT_MIN_STALL_BEFORE_RESET_MS) {
+      break;
+    }
+    // Still retransmitting, not resetting yet:
+    prv_assert_sent_data(s_characteristics[0][PPoGATTCharacteristicData], sn,
+                         s_short_data_fragment, sizeof(s_short_data_fragment));
+  }
+  prv_assert_sent_reset_request(s_characteristics[0][PPoGATTCharacteristicData]);
+}
+
 void test_ppogatt__mtu_zero_due_to_disconnection(void) {
   test_ppogatt__open_session_when_found_pebble_app();
   Transport *transport = ppogatt_client_for_uuid(&s_meta_v0_system.app_uuid);
@@ -0,0 +1,613 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! Simulates a PPoGATT client sending a bulk transfer to a server over a lossy, slow link and
+//! reports the goodput. The link, the server and the timers are all driven from a single simulated
+//! clock, so the results are deterministic.
+
+#include "comm/ble/gatt_client_operations.h"
+#include "comm/ble/kernel_le_client/ppogatt/ppogatt.h"
+#include "comm/ble/kernel_le_client/ppogatt/ppogatt_internal.h"
+#include "services/common/comm_session/session_transport.h"
+#include "services/common/new_timer/new_timer.h"
+
+#include "util/list.h"
+#include "util/math.h"
+#include "util/size.h"
+
+#include "clar.h"
+
+#include <string.h>
+
+// Stubs
+///////////////////////////////////////////////////////////
+
+#define CUSTOM_LOG_INTERNAL
+#include "stubs_logging.h"
+
+#include "stubs_analytics.h"
+#include "stubs_bt_conn_mgr.h"
+#include "stubs_bt_lock.h"
+#include "stubs_mfg_info.h"
+#include "stubs_mutex.h"
+#include "stubs_passert.h"
+#include "stubs_print.h"
+#include "stubs_prompt.h"
+#include "stubs_rand_ptr.h"
+#include "stubs_regular_timer.h"
+#include "stubs_serial.h"
+
+// Fakes
+///////////////////////////////////////////////////////////
+
+#include "fake_gatt_client_operations.h"
+#include "fake_gatt_client_subscriptions.h"
+#include "fake_pbl_malloc.h"
+#include "fake_rtc.h"
+#include "fake_session.h"
+#include "fake_system_task.h"
+
+static void log_internal(uint8_t log_level, const char* src_filename, int src_line_number,
+                         const char* fmt, va_list args) {
+  // The retransmissions are expected, keep the output readable
+}
+
+//! GATT MTU without an MTU exchange, which makes the client use its largest window
+#define SIM_MTU_SIZE (GATT_MTU_MINIMUM)
+#define SIM_MAX_PACKET_SIZE (SIM_MTU_SIZE - 3 /* ATT Header size */)
+//! Window advertised by the server. It's kept below half of the sequence number space, so the
+//! server can tell packets that are ahead of the one it expects from duplicates of older ones.
+#define SIM_SERVER_RX_WINDOW (PPOGATT_SN_MOD_DIV / 2)
+#define SIM_TRANSFER_SIZE (16 * 1024)
+#define SIM_MAX_DURATION_MS (30 * 60 * 1000)
+
+static uint16_t s_mtu_size;
+
+int bt_driver_gap_le_disconnect(const BTDeviceInternal *peer_address) {
+  return 0;
+}
+
+uint16_t gap_le_connection_get_gatt_mtu(const BTDeviceInternal *device) {
+  return s_mtu_size;
+}
+
+GAPLEConnection *gap_le_connection_get_gateway(void) {
+  return NULL;
+}
+
+GAPLEConnection *gatt_client_characteristic_get_connection(BLECharacteristic characteristic_ref) {
+  return NULL;
+}
+
+BTDeviceInternal gatt_client_characteristic_get_device(BLECharacteristic characteristic_ref) {
+  return (BTDeviceInternal) {};
+}
+
+void launcher_task_add_callback(void (*callback)(void *data), void *data) {
+  callback(data);
+}
+
+extern Transport *ppogatt_client_for_uuid(const Uuid *uuid);
+extern uint32_t ppogatt_get_rto_ms(Transport *transport);
+
+// Simulated clock and timers
+///////////////////////////////////////////////////////////
+
+static uint32_t s_now_ms;
+
+typedef struct {
+  bool in_use;
+  bool scheduled;
+  uint32_t expire_ms;
+  NewTimerCallback cb;
+  void *cb_data;
+} SimTimer;
+
+static SimTimer s_timers[8];
+
+static SimTimer *prv_get_timer(TimerID timer) {
+  cl_assert(timer != TIMER_INVALID_ID && timer <= ARRAY_LENGTH(s_timers));
+  cl_assert(s_timers[timer - 1].in_use);
+  return &s_timers[timer - 1];
+}
+
+TimerID new_timer_create(void) {
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_timers); ++i) {
+    if (!s_timers[i].in_use) {
+      s_timers[i] = (SimTimer) { .in_use = true };
+      return i + 1;
+    }
+  }
+  cl_fail("Out of timers");
+  return TIMER_INVALID_ID;
+}
+
+bool new_timer_start(TimerID timer_id, uint32_t timeout_ms, NewTimerCallback cb, void *cb_data,
+                     uint32_t flags) {
+  cl_assert_equal_i(flags, 0);
+  SimTimer *timer = prv_get_timer(timer_id);
+  *timer = (SimTimer) {
+    .in_use = true,
+    .scheduled = true,
+    .expire_ms = s_now_ms + timeout_ms,
+    .cb = cb,
+    .cb_data = cb_data,
+  };
+  return true;
+}
+
+bool new_timer_stop(TimerID timer_id) {
+  prv_get_timer(timer_id)->scheduled = false;
+  return true;
+}
+
+bool new_timer_scheduled(TimerID timer_id, uint32_t *expire_ms_p) {
+  SimTimer *timer = prv_get_timer(timer_id);
+  if (timer->scheduled && expire_ms_p) {
+    *expire_ms_p = timer->expire_ms - s_now_ms;
+  }
+  return timer->scheduled;
+}
+
+void new_timer_delete(TimerID timer_id) {
+  prv_get_timer(timer_id)->in_use = false;
+}
+
+static SimTimer *prv_next_timer(void) {
+  SimTimer *next = NULL;
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_timers); ++i) {
+    SimTimer *timer = &s_timers[i];
+    if (timer->in_use && timer->scheduled && (!next || timer->expire_ms < next->expire_ms)) {
+      next = timer;
+    }
+  }
+  return next;
+}
+
+// Simulated link
+///////////////////////////////////////////////////////////
+
+typedef struct {
+  uint8_t ppogatt_version;
+  //! Whether the server holds on to packets that arrive after a missing one
+  bool server_keeps_out_of_order;
+  uint32_t loss_per_mille;
+  uint32_t one_way_latency_ms;
+  uint32_t jitter_ms;
+  //! Time on air per packet, from client to server
+  uint32_t air_time_ms;
+  //! Number of packets the BT controller queues up before it pushes back
+  uint32_t controller_queue_depth;
+} SimConfig;
+
+typedef struct {
+  uint32_t duration_ms;
+  uint32_t num_data_packets_sent;
+  uint32_t num_data_packets_resent;
+  uint32_t num_resets;
+  uint32_t final_rto_ms;
+} SimResult;
+
+typedef enum {
+  SimEventType_DeliverToServer,
+  SimEventType_DeliverToClient,
+  SimEventType_ControllerSlotFree,
+} SimEventType;
+
+typedef struct {
+  ListNode node;
+  uint32_t time_ms;
+  SimEventType type;
+  uint16_t length;
+  uint8_t data[SIM_MAX_PACKET_SIZE];
+} SimEvent;
+
+static const SimConfig *s_config;
+static SimResult s_result;
+
+static ListNode *s_events;
+static uint32_t s_rand_state;
+
+static uint32_t s_controller_queue_length;
+static bool s_controller_queue_full;
+static uint32_t s_air_free_ms;
+static uint32_t s_last_delivery_ms[2];
+
+static uint32_t prv_rand(void) {
+  s_rand_state = s_rand_state * 1103515245 + 12345;
+  return (s_rand_state >> 16) & 0x7fff;
+}
+
+static int prv_event_compare(void *a, void *b) {
+  return (int)(((SimEvent *)b)->time_ms - ((SimEvent *)a)->time_ms);
+}
+
+static void prv_add_event(uint32_t time_ms, SimEventType type, const uint8_t *data,
+                          uint16_t length) {
+  cl_assert(length <= SIM_MAX_PACKET_SIZE);
+  SimEvent *event = malloc(sizeof(SimEvent));
+  *event = (SimEvent) {
+    .time_ms = time_ms,
+    .type = type,
+    .length = length,
+  };
+  if (length) {
+    memcpy(event->data, data, length);
+  }
+  s_events = list_sorted_add(s_events, &event->node, prv_event_compare, true);
+}
+
+//! Hands a packet to the link, which loses it or delivers it in order after the latency.
+static void prv_link_send(uint32_t sent_ms, SimEventType type, const uint8_t *data,
+                          uint16_t length, bool can_be_lost) {
+  if (can_be_lost && (prv_rand() % 1000) < s_config->loss_per_mille) {
+    return;
+  }
+  uint32_t jitter_ms = s_config->jitter_ms ? (prv_rand() % (s_config->jitter_ms + 1)) : 0;
+  uint32_t deliver_ms = sent_ms + s_config->one_way_latency_ms + jitter_ms;
+  // The link never reorders packets:
+  deliver_ms = MAX(deliver_ms, s_last_delivery_ms[type]);
+  s_last_delivery_ms[type] = deliver_ms;
+  prv_add_event(deliver_ms, type, data, length);
+}
+
+// Simulated server (phone)
+///////////////////////////////////////////////////////////
+
+static const Uuid s_app_uuid = UUID_SYSTEM;
+static BLECharacteristic s_characteristics[PPoGATTCharacteristicNum] = {
+  [PPoGATTCharacteristicData] = 01,
+  [PPoGATTCharacteristicMeta] = 02,
+};
+
+static struct {
+  bool is_open;
+  uint8_t next_expected_sn;
+  //! Payloads that arrived after a missing packet, indexed by sn. Length 0 if none.
+  uint8_t out_of_order[PPOGATT_SN_MOD_DIV][SIM_MAX_PACKET_SIZE];
+  uint16_t out_of_order_length[PPOGATT_SN_MOD_DIV];
+  uint32_t num_bytes_received;
+  uint32_t first_data_ms;
+  uint32_t done_ms;
+} s_server;
+
+static uint8_t prv_pattern_byte(uint32_t offset) {
+  return (uint8_t)(offset * 31 + (offset >> 8));
+}
+
+static void prv_server_send(const PPoGATTPacket *packet, uint16_t length, bool can_be_lost) {
+  prv_link_send(s_now_ms, SimEventType_DeliverToClient, (const uint8_t *)packet, length,
+                can_be_lost);
+}
+
+static void prv_server_accept(const uint8_t *payload, uint16_t length) {
+  for (uint16_t i = 0; i < length; ++i) {
+    cl_assert_equal_i(payload[i], prv_pattern_byte(s_server.num_bytes_received + i));
+  }
+  s_server.num_bytes_received += length;
+  s_server.next_expected_sn = (s_server.next_expected_sn + 1) % PPOGATT_SN_MOD_DIV;
+  if (s_server.num_bytes_received == SIM_TRANSFER_SIZE) {
+    s_server.done_ms = s_now_ms;
+  }
+}
+
+static void prv_server_handle_data(const PPoGATTPacket *packet, uint16_t payload_length) {
+  if (s_server.first_data_ms == 0) {
+    s_server.first_data_ms = s_now_ms;
+  }
+  const uint32_t distance =
+      (PPOGATT_SN_MOD_DIV + packet->sn - s_server.next_expected_sn) % PPOGATT_SN_MOD_DIV;
+  if (distance != 0 && distance < SIM_SERVER_RX_WINDOW) {
+    if (s_config->server_keeps_out_of_order) {
+      memcpy(s_server.out_of_order[packet->sn], packet->payload, payload_length);
+      s_server.out_of_order_length[packet->sn] = payload_length;
+    }
+    // Otherwise it gets dropped until the client sends it again
+    return;
+  }
+
+  // A duplicate means the Ack for it got lost, so just Ack it again
+  if (distance == 0) {
+    prv_server_accept(packet->payload, payload_length);
+    uint8_t sn;
+    while ((sn = s_server.next_expected_sn), s_server.out_of_order_length[sn]) {
+      const uint16_t length = s_server.out_of_order_length[sn];
+      s_server.out_of_order_length[sn] = 0;
+      prv_server_accept(s_server.out_of_order[sn], length);
+    }
+  }
+
+  const PPoGATTPacket ack = {
+    .sn = (s_server.next_expected_sn + PPOGATT_SN_MOD_DIV - 1) % PPOGATT_SN_MOD_DIV,
+    .type = PPoGATTPacketTypeAck,
+  };
+  prv_server_send(&ack, sizeof(ack), true /* can_be_lost */);
+}
+
+static void prv_server_handle_packet(const uint8_t *data, uint16_t length) {
+  const PPoGATTPacket *packet = (const PPoGATTPacket *)data;
+  switch (packet->type) {
+    case PPoGATTPacketTypeResetRequest: {
+      if (s_server.is_open) {
+        ++s_result.num_resets;
+      }
+      s_server.is_open = true;
+      s_server.next_expected_sn = 0;
+      memset(s_server.out_of_order_length, 0, sizeof(s_server.out_of_order_length));
+      struct PACKED {
+        PPoGATTPacket header;
+        PPoGATTResetCompleteClientIDPayloadV1 payload;
+      } reset_complete = {
+        .header = {
+          .sn = 0,
+          .type = PPoGATTPacketTypeResetComplete,
+        },
+        .payload = {
+          .ppogatt_max_rx_window = SIM_SERVER_RX_WINDOW,
+          .ppogatt_max_tx_window = SIM_SERVER_RX_WINDOW,
+        },
+      };
+      const uint16_t reset_complete_length = (s_config->ppogatt_version > 0) ?
+          sizeof(reset_complete) : sizeof(PPoGATTPacket);
+      prv_server_send(&reset_complete.header, reset_complete_length, false /* can_be_lost */);
+      break;
+    }
+    case PPoGATTPacketTypeData:
+      prv_server_handle_data(packet, length - sizeof(PPoGATTPacket));
+      break;
+    default:
+      // Reset Complete from the client, no Acks because the server doesn't send data
+      break;
+  }
+}
+
+// Client side glue
+///////////////////////////////////////////////////////////
+
+static BTErrno prv_gatt_write_cb(BLECharacteristic characteristic, const uint8_t *value,
+                                 size_t value_length) {
+  cl_assert_equal_i(characteristic, s_characteristics[PPoGATTCharacteristicData]);
+  if (s_controller_queue_length >= s_config->controller_queue_depth) {
+    s_controller_queue_full = true;
+    return BTErrnoNotEnoughResources;
+  }
+  const PPoGATTPacket *packet = (const PPoGATTPacket *)value;
+  const bool is_data = (packet->type == PPoGATTPacketTypeData);
+  if (is_data) {
+    ++s_result.num_data_packets_sent;
+  }
+
+  ++s_controller_queue_length;
+  s_air_free_ms = MAX(s_air_free_ms, s_now_ms) + s_config->air_time_ms;
+  prv_add_event(s_air_free_ms, SimEventType_ControllerSlotFree, NULL, 0);
+  prv_link_send(s_air_free_ms, SimEventType_DeliverToServer, value, value_length,
+                is_data /* can_be_lost */);
+  return BTErrnoOK;
+}
+
+static uint32_t s_num_bytes_queued;
+
+static void prv_fill_send_buffer(Transport *transport) {
+  uint8_t chunk[128];
+  bool wrote = false;
+  while (s_num_bytes_queued < SIM_TRANSFER_SIZE) {
+    const uint32_t length = MIN(sizeof(chunk), SIM_TRANSFER_SIZE - s_num_bytes_queued);
+    for (uint32_t i = 0; i < length; ++i) {
+      chunk[i] = prv_pattern_byte(s_num_bytes_queued + i);
+    }
+    if (!fake_comm_session_send_buffer_write_raw_by_transport(transport, chunk, length)) {
+      break;
+    }
+    s_num_bytes_queued += length;
+    wrote = true;
+  }
+  if (wrote) {
+    fake_comm_session_process_send_next();
+  }
+}
+
+static void prv_handle_event(const SimEvent *event) {
+  switch (event->type) {
+    case SimEventType_DeliverToServer:
+      prv_server_handle_packet(event->data, event->length);
+      break;
+    case SimEventType_DeliverToClient:
+      ppogatt_handle_read_or_notification(s_characteristics[PPoGATTCharacteristicData],
+                                          event->data, event->length, BLEGATTErrorSuccess);
+      break;
+    case SimEventType_ControllerSlotFree:
+      --s_controller_queue_length;
+      if (s_controller_queue_full) {
+        s_controller_queue_full = false;
+        ppogatt_handle_buffer_empty();
+      }
+      break;
+  }
+}
+
+//! Advances the simulated clock to the next event or timer and processes it.
+static void prv_step(void) {
+  const SimEvent *event = (const SimEvent *)s_events;
+  SimTimer *timer = prv_next_timer();
+  cl_assert_(event || timer, "Deadlock: nothing left to happen");
+
+  if (timer && (!event || timer->expire_ms < event->time_ms)) {
+    s_now_ms = MAX(s_now_ms, timer->expire_ms);
+    fake_rtc_set_ticks(((RtcTicks)s_now_ms * RTC_TICKS_HZ) / 1000);
+    timer->scheduled = false;
+    timer->cb(timer->cb_data);
+  } else {
+    s_now_ms = MAX(s_now_ms, event->time_ms);
+    fake_rtc_set_ticks(((RtcTicks)s_now_ms * RTC_TICKS_HZ) / 1000);
+    s_events = list_pop_head(s_events);
+    prv_handle_event(event);
+    free((void *)event);
+  }
+  fake_system_task_callbacks_invoke_pending();
+}
+
+static uint32_t prv_goodput(const SimResult *result) {
+  return (SIM_TRANSFER_SIZE * 1000) / MAX(result->duration_ms, 1);
+}
+
+static bool s_is_sim_running;
+
+static void prv_teardown_sim(void) {
+  ppogatt_destroy();
+  while (s_events) {
+    ListNode *event = s_events;
+    s_events = list_pop_head(s_events);
+    free(event);
+  }
+  fake_system_task_callbacks_cleanup();
+  fake_gatt_client_op_deinit();
+  fake_gatt_client_subscriptions_deinit();
+  fake_comm_session_cleanup();
+  s_is_sim_running = false;
+}
+
+static void prv_run_sim(const SimConfig *config, SimResult *result_out) {
+  s_is_sim_running = true;
+  s_config = config;
+  s_result = (SimResult) {};
+  s_server = (__typeof__(s_server)) {};
+  s_events = NULL;
+  s_rand_state = 1;
+  s_now_ms = 0;
+  s_air_free_ms = 0;
+  s_controller_queue_length = 0;
+  s_controller_queue_full = false;
+  s_num_bytes_queued = 0;
+  memset(s_last_delivery_ms, 0, sizeof(s_last_delivery_ms));
+  memset(s_timers, 0, sizeof(s_timers));
+  s_mtu_size = SIM_MTU_SIZE;
+
+  fake_rtc_init(0, 0);
+  fake_gatt_client_op_init();
+  fake_gatt_client_op_set_write_callback(prv_gatt_write_cb);
+  fake_gatt_client_subscriptions_init();
+  fake_comm_session_init();
+  ppogatt_create();
+
+  // Discover the server and open the session:
+  ppogatt_handle_service_discovered(s_characteristics);
+  const PPoGATTMetaV0 meta = {
+    .ppogatt_min_version = PPOGATT_MIN_VERSION,
+    .ppogatt_max_version = config->ppogatt_version,
+    .app_uuid = s_app_uuid,
+  };
+  ppogatt_handle_read_or_notification(s_characteristics[PPoGATTCharacteristicMeta],
+                                      (const uint8_t *)&meta, sizeof(meta), BLEGATTErrorSuccess);
+  ppogatt_handle_subscribe(s_characteristics[PPoGATTCharacteristicData],
+                           BLESubscriptionNotifications, BLEGATTErrorSuccess);
+  while (fake_comm_session_open_call_count() == 0) {
+    prv_step();
+  }
+
+  Transport *transport = ppogatt_client_for_uuid(&s_app_uuid);
+  cl_assert(transport);
+  while (s_server.num_bytes_received < SIM_TRANSFER_SIZE) {
+    prv_fill_send_buffer(transport);
+    prv_step();
+    cl_assert_(s_now_ms < SIM_MAX_DURATION_MS, "Transfer didn't finish");
+  }
+
+  s_result.duration_ms = s_server.done_ms - s_server.first_data_ms;
+  const uint32_t num_unique_packets =
+      (SIM_TRANSFER_SIZE + SIM_MAX_PACKET_SIZE - sizeof(PPoGATTPacket) - 1) /
+      (SIM_MAX_PACKET_SIZE - sizeof(PPoGATTPacket));
+  s_result.num_data_packets_resent = s_result.num_data_packets_sent - num_unique_packets;
+  s_result.final_rto_ms = ppogatt_get_rto_ms(transport);
+  *result_out = s_result;
+
+  prv_teardown_sim();
+  fake_pbl_malloc_check_net_allocs();
+  fake_pbl_malloc_clear_tracking();
+}
+
+// Tests
+///////////////////////////////////////////////////////////
+
+static const SimConfig s_base_config = {
+  .one_way_latency_ms = 40,
+  .jitter_ms = 20,
+  .air_time_ms = 2,
+  .controller_queue_depth = 6,
+};
+
+void test_ppogatt_sim__cleanup(void) {
+  // Only when a simulation failed half-way:
+  if (s_is_sim_running) {
+    prv_teardown_sim();
+    fake_pbl_malloc_clear_tracking();
+  }
+}
+
+void test_ppogatt_sim__lossless_link(void) {
+  for (uint8_t version = 0; version <= PPOGATT_MAX_VERSION; ++version) {
+    SimConfig config = s_base_config;
+    config.ppogatt_version = version;
+    SimResult result;
+    prv_run_sim(&config, &result);
+    cl_assert_equal_i(result.num_resets, 0);
+    cl_assert_equal_i(result.num_data_packets_resent, 0);
+    // The timeout converged towards the round trip time:
+    cl_assert(result.final_rto_ms < PPOGATT_INITIAL_RTO_MS);
+  }
+}
+
+void test_ppogatt_sim__lossy_link(void) {
+  const uint32_t loss_rates_per_mille[] = { 10, 30, 50 };
+  for (unsigned int i = 0; i < ARRAY_LENGTH(loss_rates_per_mille); ++i) {
+    SimConfig config = s_base_config;
+    config.loss_per_mille = loss_rates_per_mille[i];
+
+    // Go-back-N
+    SimResult v0_result;
+    config.ppogatt_version = 0;
+    prv_run_sim(&config, &v0_result);
+
+    // Selective resend, with a server that drops out of order packets and one that keeps them
+    SimResult dropping_server_result;
+    config.ppogatt_version = 1;
+    prv_run_sim(&config, &dropping_server_result);
+
+    SimResult keeping_server_result;
+    config.server_keeps_out_of_order = true;
+    prv_run_sim(&config, &keeping_server_result);
+
+    cl_assert_equal_i(v0_result.num_resets, 0);
+    cl_assert_equal_i(dropping_server_result.num_resets, 0);
+    cl_assert_equal_i(keeping_server_result.num_resets, 0);
+
+    // Resending only the missing packets saves airtime when the server keeps the others:
+    cl_assert(keeping_server_result.num_data_packets_resent <
+              dropping_server_result.num_data_packets_resent);
+    cl_assert(prv_goodput(&keeping_server_result) > prv_goodput(&dropping_server_result));
+  }
+}
+
+void test_ppogatt_sim__slow_link(void) {
+  // Long round trips must not cause spurious retransmissions once the RTT has been measured
+  SimConfig config = s_base_config;
+  config.ppogatt_version = 1;
+  config.one_way_latency_ms = 900;
+  config.jitter_ms = 400;
+  SimResult result;
+  prv_run_sim(&config, &result);
+  cl_assert_equal_i(result.num_resets, 0);
+  cl_assert(result.final_rto_ms > 2 * config.one_way_latency_ms);
+}
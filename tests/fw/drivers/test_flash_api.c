@@ -16,6 +16,7 @@
 
 #include "clar.h"
 #include "fake_new_timer.h"
+#include "fake_rtc.h"
 #include "stubs_analytics.h"
 #include "stubs_freertos.h"
 #include "stubs_logging.h"
@@ -0,0 +1,491 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clar.h"
+#include "fake_new_timer.h"
+#include "stubs_analytics.h"
+#include "stubs_freertos.h"
+#include "stubs_logging.h"
+#include "stubs_mutex.h"
+#include "stubs_passert.h"
+#include "stubs_pebble_tasks.h"
+#include "stubs_prompt.h"
+#include "stubs_queue.h"
+#include "stubs_stop.h"
+#include "stubs_task_watchdog.h"
+#include "stubs_worker_manager.h"
+
+#include "drivers/flash.h"
+#include "drivers/flash/flash_impl.h"
+#include "drivers/rtc.h"
+#include "util/math.h"
+#include "util/size.h"
+
+#include <stdlib.h>
+
+void flash_api_reset_for_test(void);
+
+// The minimum time the flash API lets an erase run before suspending it again
+#define ERASE_MIN_SLICE_MS (100)
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulated time. psleep() advances the clock without running any timers since the caller is
+// holding the flash lock, the timers are run by prv_advance_ms().
+
+static uint64_t s_now_ms;
+static uint32_t s_num_psleep_zero;
+static uint32_t s_num_psleep_nonzero;
+static uint32_t s_psleep_total_ms;
+
+RtcTicks rtc_get_ticks(void) {
+  return (s_now_ms * RTC_TICKS_HZ) / 1000;
+}
+
+static void prv_elapse_ms(uint32_t ms) {
+  s_now_ms += ms;
+  for (StubTimer *timer = (StubTimer *)s_running_timers; timer;
+       timer = (StubTimer *)list_get_next(&timer->list_node)) {
+    timer->timeout_ms = (timer->timeout_ms > ms) ? (timer->timeout_ms - ms) : 0;
+  }
+}
+
+void psleep(int millis) {
+  if (millis) {
+    s_num_psleep_nonzero++;
+  } else {
+    s_num_psleep_zero++;
+  }
+  s_psleep_total_ms += millis;
+  prv_elapse_ms(millis);
+}
+
+static void prv_advance_ms(uint32_t ms) {
+  while (true) {
+    StubTimer *next = NULL;
+    for (StubTimer *timer = (StubTimer *)s_running_timers; timer;
+         timer = (StubTimer *)list_get_next(&timer->list_node)) {
+      if (!next || timer->timeout_ms < next->timeout_ms) {
+        next = timer;
+      }
+    }
+    if (!next || next->timeout_ms > ms) {
+      prv_elapse_ms(ms);
+      return;
+    }
+    ms -= next->timeout_ms;
+    prv_elapse_ms(next->timeout_ms);
+    stub_new_timer_fire(next->id);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulated flash part. An erase only makes progress while it isn't suspended, and reads assert
+// that no erase is actively running.
+
+#define SIM_FLASH_SIZE (128 * 1024)
+#define SIM_SECTOR_SIZE (32 * 1024)
+#define SIM_PAGE_SIZE (256)
+
+static uint8_t s_flash[SIM_FLASH_SIZE];
+static uint32_t s_sim_sector_erase_ms;
+static uint32_t s_num_read_sync_calls;
+static uint32_t s_write_busy_polls;
+static uint32_t s_write_busy_polls_left;
+
+static struct {
+  bool in_progress;
+  bool suspended;
+  FlashAddress addr;
+  uint32_t remaining_ms;
+  uint64_t resumed_ms;
+} s_sim_erase;
+
+static void prv_sim_erase_update(void) {
+  if (!s_sim_erase.in_progress || s_sim_erase.suspended) {
+    return;
+  }
+  const uint32_t elapsed_ms = s_now_ms - s_sim_erase.resumed_ms;
+  s_sim_erase.resumed_ms = s_now_ms;
+  if (elapsed_ms < s_sim_erase.remaining_ms) {
+    s_sim_erase.remaining_ms -= elapsed_ms;
+    return;
+  }
+  memset(&s_flash[s_sim_erase.addr], 0xff, SIM_SECTOR_SIZE);
+  s_sim_erase.in_progress = false;
+}
+
+status_t flash_impl_init(bool coredump_mode) {
+  return S_SUCCESS;
+}
+
+void flash_impl_use(void) {}
+void flash_impl_release_many(uint32_t num_locks) {}
+
+FlashAddress flash_impl_get_subsector_base_address(FlashAddress addr) {
+  return addr & ~(SIM_SECTOR_SIZE - 1);
+}
+
+FlashAddress flash_impl_get_sector_base_address(FlashAddress addr) {
+  return addr & ~(SIM_SECTOR_SIZE - 1);
+}
+
+static status_t prv_sim_erase_begin(FlashAddress addr) {
+  cl_assert(!s_sim_erase.in_progress);
+  s_sim_erase.in_progress = true;
+  s_sim_erase.suspended = false;
+  s_sim_erase.addr = flash_impl_get_sector_base_address(addr);
+  s_sim_erase.remaining_ms = s_sim_sector_erase_ms;
+  s_sim_erase.resumed_ms = s_now_ms;
+  return S_SUCCESS;
+}
+
+status_t flash_impl_erase_subsector_begin(FlashAddress addr) {
+  return prv_sim_erase_begin(addr);
+}
+
+status_t flash_impl_erase_sector_begin(FlashAddress addr) {
+  return prv_sim_erase_begin(addr);
+}
+
+status_t flash_impl_get_erase_status(void) {
+  prv_sim_erase_update();
+  if (!s_sim_erase.in_progress) {
+    return S_SUCCESS;
+  }
+  return s_sim_erase.suspended ? E_AGAIN : E_BUSY;
+}
+
+status_t flash_impl_erase_suspend(FlashAddress addr) {
+  prv_sim_erase_update();
+  if (!s_sim_erase.in_progress) {
+    return S_NO_ACTION_REQUIRED;
+  }
+  s_sim_erase.suspended = true;
+  return S_SUCCESS;
+}
+
+status_t flash_impl_erase_resume(FlashAddress addr) {
+  cl_assert(s_sim_erase.suspended);
+  s_sim_erase.suspended = false;
+  s_sim_erase.resumed_ms = s_now_ms;
+  return S_SUCCESS;
+}
+
+status_t flash_impl_blank_check_subsector(FlashAddress addr) {
+  return S_FALSE;
+}
+
+status_t flash_impl_blank_check_sector(FlashAddress addr) {
+  return S_FALSE;
+}
+
+status_t flash_impl_enter_low_power_mode(void) {
+  return S_SUCCESS;
+}
+
+status_t flash_impl_exit_low_power_mode(void) {
+  return S_SUCCESS;
+}
+
+uint32_t flash_impl_get_typical_subsector_erase_duration_ms(void) {
+  return s_sim_sector_erase_ms;
+}
+
+uint32_t flash_impl_get_typical_sector_erase_duration_ms(void) {
+  return s_sim_sector_erase_ms;
+}
+
+status_t flash_impl_read_sync(void *buffer, FlashAddress addr, size_t len) {
+  prv_sim_erase_update();
+  cl_assert(!s_sim_erase.in_progress || s_sim_erase.suspended);
+  cl_assert(addr + len <= SIM_FLASH_SIZE);
+  s_num_read_sync_calls++;
+  memcpy(buffer, &s_flash[addr], len);
+  return S_SUCCESS;
+}
+
+int flash_impl_write_page_begin(const void *buffer, FlashAddress addr, size_t len) {
+  prv_sim_erase_update();
+  cl_assert(!s_sim_erase.in_progress || s_sim_erase.suspended);
+  const size_t written = MIN(len, SIM_PAGE_SIZE - (addr % SIM_PAGE_SIZE));
+  for (size_t i = 0; i < written; i++) {
+    s_flash[addr + i] &= ((const uint8_t *)buffer)[i];
+  }
+  s_write_busy_polls_left = s_write_busy_polls;
+  return written;
+}
+
+status_t flash_impl_get_write_status(void) {
+  if (s_write_busy_polls_left) {
+    s_write_busy_polls_left--;
+    return E_BUSY;
+  }
+  return S_SUCCESS;
+}
+
+status_t flash_impl_set_burst_mode(bool enable) {
+  return S_SUCCESS;
+}
+
+status_t flash_impl_unprotect(void) {
+  return S_SUCCESS;
+}
+
+void flash_impl_enable_write_protection(void) {
+}
+
+status_t flash_impl_write_protect(FlashAddress start_sector, FlashAddress end_sector) {
+  return S_SUCCESS;
+}
+
+status_t flash_impl_set_nvram_erase_status(bool is_subsector, FlashAddress addr) {
+  return S_SUCCESS;
+}
+
+status_t flash_impl_clear_nvram_erase_status(void) {
+  return S_SUCCESS;
+}
+
+status_t flash_impl_get_nvram_erase_status(bool *is_subsector, FlashAddress *addr) {
+  return S_FALSE;
+}
+
+void flash_erase_init(void) {
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  FlashReadRequest request;
+  uint64_t issued_ms;
+  uint64_t completed_ms;
+  int num_completions;
+  status_t result;
+} TestRead;
+
+static void prv_read_complete(void *context, status_t result) {
+  TestRead *read = context;
+  read->completed_ms = s_now_ms;
+  read->num_completions++;
+  read->result = result;
+}
+
+static bool s_erase_complete;
+static uint64_t s_erase_complete_ms;
+static void prv_erase_complete(void *context, status_t result) {
+  cl_assert_equal_i(result, S_SUCCESS);
+  s_erase_complete = true;
+  s_erase_complete_ms = s_now_ms;
+}
+
+void test_flash_api_read_queue__initialize(void) {
+  s_now_ms = 0;
+  s_num_psleep_zero = 0;
+  s_num_psleep_nonzero = 0;
+  s_psleep_total_ms = 0;
+  s_num_read_sync_calls = 0;
+  s_write_busy_polls = 0;
+  s_write_busy_polls_left = 0;
+  s_sim_sector_erase_ms = 400;
+  s_sim_erase = (__typeof__(s_sim_erase)) {};
+  s_erase_complete = false;
+  for (int i = 0; i < SIM_FLASH_SIZE; i++) {
+    s_flash[i] = (uint8_t)(i * 7 + (i >> 8));
+  }
+
+  flash_api_reset_for_test();
+  flash_init();
+}
+
+void test_flash_api_read_queue__cleanup(void) {
+  stub_new_timer_cleanup();
+}
+
+void test_flash_api_read_queue__adjacent_reads_are_coalesced(void) {
+  uint8_t buffer[4 * 64];
+  uint8_t far_buffers[2][32];
+  TestRead reads[6] = {};
+
+  // Four reads that are contiguous in flash and in RAM, queued out of order
+  const int order[] = {2, 0, 3, 1};
+  for (int i = 0; i < ARRAY_LENGTH(order); i++) {
+    const int chunk = order[i];
+    flash_read_bytes_async(&reads[chunk].request, &buffer[chunk * 64], 0x1000 + chunk * 64, 64,
+                           prv_read_complete, &reads[chunk]);
+  }
+  // Two that aren't adjacent to anything
+  flash_read_bytes_async(&reads[4].request, far_buffers[0], 0x8000, 32, prv_read_complete,
+                         &reads[4]);
+  flash_read_bytes_async(&reads[5].request, far_buffers[1], 0x100, 32, prv_read_complete,
+                         &reads[5]);
+
+  // Nothing is read until the queue gets serviced
+  cl_assert_equal_i(s_num_read_sync_calls, 0);
+  prv_advance_ms(1);
+
+  cl_assert_equal_i(s_num_read_sync_calls, 3);
+  for (int i = 0; i < ARRAY_LENGTH(reads); i++) {
+    cl_assert_equal_i(reads[i].num_completions, 1);
+    cl_assert_equal_i(reads[i].result, S_SUCCESS);
+  }
+  cl_assert_equal_m(buffer, &s_flash[0x1000], sizeof(buffer));
+  cl_assert_equal_m(far_buffers[0], &s_flash[0x8000], 32);
+  cl_assert_equal_m(far_buffers[1], &s_flash[0x100], 32);
+}
+
+void test_flash_api_read_queue__sync_read_services_queue(void) {
+  uint8_t async_buffer[16];
+  uint8_t sync_buffer[16];
+  TestRead read = {};
+
+  flash_read_bytes_async(&read.request, async_buffer, 0x2000, sizeof(async_buffer),
+                         prv_read_complete, &read);
+  flash_read_bytes(sync_buffer, 0x3000, sizeof(sync_buffer));
+
+  cl_assert_equal_i(read.num_completions, 1);
+  cl_assert_equal_m(async_buffer, &s_flash[0x2000], sizeof(async_buffer));
+  cl_assert_equal_m(sync_buffer, &s_flash[0x3000], sizeof(sync_buffer));
+
+  // The queue timer has nothing left to do
+  prv_advance_ms(10);
+  cl_assert_equal_i(read.num_completions, 1);
+}
+
+void test_flash_api_read_queue__async_read_does_not_block_on_erase(void) {
+  flash_erase_sector(0x10000, prv_erase_complete, NULL);
+  prv_advance_ms(30);
+
+  uint8_t buffer[16];
+  TestRead read = {};
+  read.issued_ms = s_now_ms;
+  flash_read_bytes_async(&read.request, buffer, 0x100, sizeof(buffer), prv_read_complete, &read);
+  cl_assert_equal_i(s_psleep_total_ms, 0);
+
+  // Serviced as soon as the erase has had its minimum slice, which started 30ms ago
+  prv_advance_ms(ERASE_MIN_SLICE_MS - 30 - 2);
+  cl_assert_equal_i(read.num_completions, 0);
+  prv_advance_ms(4);
+  cl_assert_equal_i(read.num_completions, 1);
+  cl_assert_equal_m(buffer, &s_flash[0x100], sizeof(buffer));
+  cl_assert_equal_i(s_psleep_total_ms, 0);
+  cl_assert(s_sim_erase.suspended);
+
+  prv_advance_ms(1000);
+  cl_assert(s_erase_complete);
+}
+
+void test_flash_api_read_queue__sync_read_waits_for_rest_of_erase_slice(void) {
+  flash_erase_sector(0x10000, prv_erase_complete, NULL);
+  prv_advance_ms(60);
+
+  uint8_t buffer[16];
+  flash_read_bytes(buffer, 0x100, sizeof(buffer));
+  cl_assert(s_psleep_total_ms >= ERASE_MIN_SLICE_MS - 60 - 1);
+  cl_assert(s_psleep_total_ms <= ERASE_MIN_SLICE_MS - 60 + 1);
+  cl_assert(s_sim_erase.suspended);
+
+  // Once the erase has been resumed and has run for a full slice, reads don't wait at all
+  prv_advance_ms(ERASE_MIN_SLICE_MS + 10);
+  cl_assert(!s_sim_erase.suspended);
+  s_psleep_total_ms = 0;
+  flash_read_bytes(buffer, 0x100, sizeof(buffer));
+  cl_assert_equal_i(s_psleep_total_ms, 0);
+
+  prv_advance_ms(1000);
+  cl_assert(s_erase_complete);
+}
+
+void test_flash_api_read_queue__write_wait_sleeps_instead_of_spinning(void) {
+  uint8_t data[SIM_PAGE_SIZE];
+  memset(data, 0x5a, sizeof(data));
+
+  // A fast page program is only polled
+  s_write_busy_polls = 3;
+  flash_write_bytes(data, 0x4000, sizeof(data));
+  cl_assert_equal_i(s_num_psleep_zero, 3);
+  cl_assert_equal_i(s_num_psleep_nonzero, 0);
+
+  // A slow one makes the task sleep between polls
+  memset(&s_flash[0x5000], 0xff, sizeof(data));
+  s_num_psleep_zero = 0;
+  s_write_busy_polls = 20;
+  flash_write_bytes(data, 0x5000, sizeof(data));
+  cl_assert_equal_i(s_num_psleep_zero, 8);
+  cl_assert_equal_i(s_num_psleep_nonzero, 12);
+
+  cl_assert_equal_m(&s_flash[0x5000], data, sizeof(data));
+}
+
+// Issue reads at random intervals while a sector erase runs in the background and check that no
+// read waits for more than one erase slice, for both blocking and queued reads
+void test_flash_api_read_queue__read_latency_during_erase(void) {
+  enum { MAX_READS = 1000 };
+  static TestRead s_reads[MAX_READS];
+  uint8_t buffer[64];
+  s_sim_sector_erase_ms = 2000;
+  srand(0);
+
+  // Blocking reads
+  const uint64_t sync_start_ms = s_now_ms;
+  flash_erase_sector(0x10000, prv_erase_complete, NULL);
+  int num_reads = 0;
+  uint64_t max_latency_ms = 0;
+  while (!s_erase_complete && num_reads < MAX_READS) {
+    prv_advance_ms(1 + rand() % 30);
+    const uint64_t issued_ms = s_now_ms;
+    const uint32_t addr = rand() % (0x10000 - sizeof(buffer));
+    flash_read_bytes(buffer, addr, sizeof(buffer));
+    cl_assert_equal_m(buffer, &s_flash[addr], sizeof(buffer));
+    max_latency_ms = MAX(max_latency_ms, s_now_ms - issued_ms);
+    num_reads++;
+  }
+  prv_advance_ms(10000);
+  cl_assert(s_erase_complete);
+  const uint64_t sync_erase_ms = s_erase_complete_ms - sync_start_ms;
+  cl_assert(num_reads > 1);
+  cl_assert(max_latency_ms <= ERASE_MIN_SLICE_MS + 1);
+
+  // Queued reads
+  s_erase_complete = false;
+  const uint64_t async_start_ms = s_now_ms;
+  flash_erase_sector(0x10000, prv_erase_complete, NULL);
+  num_reads = 0;
+  while (!s_erase_complete && num_reads < MAX_READS) {
+    prv_advance_ms(1 + rand() % 30);
+    TestRead *read = &s_reads[num_reads++];
+    *read = (TestRead) { .issued_ms = s_now_ms };
+    const uint32_t addr = rand() % (0x10000 - sizeof(buffer));
+    const uint32_t psleep_before_ms = s_psleep_total_ms;
+    flash_read_bytes_async(&read->request, buffer, addr, sizeof(buffer), prv_read_complete,
+                           read);
+    // The caller never waits
+    cl_assert_equal_i(s_psleep_total_ms, psleep_before_ms);
+  }
+  prv_advance_ms(10000);
+  cl_assert(s_erase_complete);
+  const uint64_t async_erase_ms = s_erase_complete_ms - async_start_ms;
+  cl_assert(num_reads > 1);
+  max_latency_ms = 0;
+  for (int i = 0; i < num_reads; i++) {
+    cl_assert_equal_i(s_reads[i].num_completions, 1);
+    max_latency_ms = MAX(max_latency_ms, s_reads[i].completed_ms - s_reads[i].issued_ms);
+  }
+  cl_assert(max_latency_ms <= ERASE_MIN_SLICE_MS + 1);
+
+  // Neither kind of read starves the erase
+  cl_assert(sync_erase_ms < 2 * s_sim_sector_erase_ms);
+  cl_assert(async_erase_ms < 2 * s_sim_sector_erase_ms);
+}
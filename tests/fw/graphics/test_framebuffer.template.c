@@ -32,6 +32,58 @@
 ////////////////////////////////////
 static FrameBuffer framebuffer;
 
+// Helpers
+////////////////////////////////////
+
+static uint8_t *prv_row_bytes(FrameBuffer *f, int16_t y) {
+  return (uint8_t *)framebuffer_get_line(f, y);
+}
+
+//! Fills a framebuffer with the same pseudo random pixels every time
+static void prv_fill_noise(FrameBuffer *f) {
+  uint32_t state = 1;
+  uint8_t *bytes = (uint8_t *)f->buffer;
+  for (int i = 0; i < FRAMEBUFFER_SIZE_BYTES; i++) {
+    state = (state * 1103515245) + 12345;
+    bytes[i] = state >> 16;
+  }
+}
+
+typedef enum {
+  FrameChange_None,
+  FrameChange_SecondHand,
+  FrameChange_RowEnds,
+  FrameChange_Everything,
+  FrameChangeCount,
+} FrameChange;
+
+static void prv_apply_change(FrameBuffer *f, FrameChange change) {
+  const int last_byte = (DISP_COLS - 1) * SCREEN_COLOR_DEPTH_BITS / 8;
+  for (int16_t y = 0; y < DISP_ROWS; y++) {
+    uint8_t *row = prv_row_bytes(f, y);
+    switch (change) {
+      case FrameChange_SecondHand:
+        // A few pixels on a few dozen rows above the center of the screen
+        if (y >= 20 && y < DISP_ROWS / 2) {
+          row[last_byte / 2] ^= 0xff;
+        }
+        break;
+      case FrameChange_RowEnds:
+        // The slowest frame to compare: every row changes, but only at both of its ends
+        row[0] ^= 0xff;
+        row[last_byte] ^= 0xff;
+        break;
+      case FrameChange_Everything:
+        for (int i = 0; i <= last_byte; i++) {
+          row[i] ^= 0xff;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
 // Tests
 ////////////////////////////////////
 
@@ -57,3 +109,32 @@ void test_framebuffer_${BIT_DEPTH_NAME}__framebuffer_clear(void) {
 
   cl_assert(framebuffer.is_dirty == true);
 }
+
+void test_framebuffer_${BIT_DEPTH_NAME}__copy_changed_rows(void) {
+  static FrameBuffer s_frames[2];
+  static FrameBuffer s_screen;
+  const GSize size = GSize(DISP_COLS, DISP_ROWS);
+
+  for (FrameChange change = 0; change < FrameChangeCount; change++) {
+    framebuffer_init(&s_frames[0], &size);
+    prv_fill_noise(&s_frames[0]);
+    s_frames[1] = s_frames[0];
+    prv_apply_change(&s_frames[1], change);
+    framebuffer_init(&s_screen, &size);
+
+    // Only the rows that differ get copied and marked dirty
+    memcpy(s_screen.buffer, s_frames[0].buffer, FRAMEBUFFER_SIZE_BYTES);
+    framebuffer_reset_dirty(&s_screen);
+    framebuffer_copy_changed_rows(&s_screen, &s_frames[1]);
+    cl_assert(!memcmp(s_screen.buffer, s_frames[1].buffer, FRAMEBUFFER_SIZE_BYTES));
+    int changed_rows = 0;
+    for (int16_t y = 0; y < DISP_ROWS; y++) {
+      const bool row_changed = memcmp(prv_row_bytes(&s_frames[0], y),
+                                      prv_row_bytes(&s_frames[1], y),
+                                      FRAMEBUFFER_BYTES_PER_ROW) != 0;
+      cl_assert_equal_b(bitset8_get(s_screen.dirty_rows, y), row_changed);
+      changed_rows += row_changed ? 1 : 0;
+    }
+    cl_assert_equal_b(s_screen.is_dirty, changed_rows > 0);
+  }
+}
@@ -28,6 +28,7 @@
 #include "applib/graphics/gdraw_command_transforms.h"
 
 #include "util.h"
+#include "util/size.h"
 #include "test_graphics.h"
 #include "8bit/test_framebuffer.h"
 #include "weather_app_resources.h"
@@ -242,3 +243,125 @@ void _test_gdraw_command_transforms__scale_segmented_sequence(void) {
   }
 }
 
+
+static GDrawCommandImage *(*const s_image_creators[])(void) = {
+  weather_app_resource_create_sun,
+  weather_app_resource_create_cloud,
+  weather_app_resource_create_sun_25px,
+  weather_app_resource_create_cloud_25px,
+};
+
+//! The unfold effect with a bounce, the same stages kino_reel_scale_segmented builds
+static size_t prv_unfold_stages(GScaleSegmentedStage *stages, GSize size, int32_t normalized) {
+  const GRect from = GRect(8, 4, size.w / 4, size.h / 4);
+  const GRect to = GRect(0, 0, size.w, size.h);
+  const AnimationProgress first = animation_timing_scaled(normalized, 0,
+                                                          ANIMATION_NORMALIZED_MAX * 3 / 4);
+  const AnimationProgress second = animation_timing_scaled(normalized,
+                                                           ANIMATION_NORMALIZED_MAX * 3 / 4,
+                                                           ANIMATION_NORMALIZED_MAX);
+  stages[0] = (GScaleSegmentedStage) {
+    .size = size,
+    .from = from,
+    .to = grect_inset(to, GEdgeInsets(-4)),
+    .normalized = first,
+  };
+  stages[1] = (GScaleSegmentedStage) {
+    .size = size,
+    .from = grect_inset(to, GEdgeInsets(-4)),
+    .to = to,
+    .normalized = second,
+  };
+  return 2;
+}
+
+//! Copies the list and transforms it in place one stage at a time, the way each frame was drawn
+//! before the transforms could write into a separate list
+static void prv_scale_segmented_in_place(GDrawCommandList *list, GDrawCommandList *source,
+                                         const GScaleSegmentedStage *stages, size_t num_stages,
+                                         GPoint target, Fixed_S32_16 duration_fraction,
+                                         const GStrokeWidthScale *stroke_width) {
+  gdraw_command_list_copy(list, gdraw_command_list_get_data_size(source), source);
+  GPointIndexLookup *lookup = gdraw_command_list_create_index_lookup_by_distance(list, target);
+  for (size_t i = 0; i < num_stages; i++) {
+    gdraw_command_list_scale_segmented_to(list, stages[i].size, stages[i].from, stages[i].to,
+                                          stages[i].normalized, NULL, lookup, duration_fraction,
+                                          stages[i].is_offset);
+  }
+  free(lookup);
+  gdraw_command_list_scale_stroke_width(list, stroke_width->from, stroke_width->to,
+                                        stroke_width->from_op, stroke_width->to_op,
+                                        stroke_width->progress);
+}
+
+void test_gdraw_command_transforms__scale_segmented_from_matches_in_place(void) {
+  const Fixed_S32_16 duration_fraction = Fixed_S32_16(FIXED_S32_16_ONE.raw_value / 3);
+  for (size_t i = 0; i < ARRAY_LENGTH(s_image_creators); i++) {
+    GDrawCommandImage *image = s_image_creators[i]();
+    GDrawCommandList *source = gdraw_command_image_get_command_list(image);
+    const GSize size = gdraw_command_image_get_bounds_size(image);
+    const GPoint target = GPoint(size.w / 2, size.h);
+    const size_t data_size = gdraw_command_list_get_data_size(source);
+
+    GPointIndexLookup *lookup = gdraw_command_list_create_index_lookup_by_distance(source,
+                                                                                   target);
+    GPointSegmentedTiming *timing = gpoint_segmented_timing_create(lookup, duration_fraction);
+    free(lookup);
+    cl_assert(timing);
+
+    GDrawCommandList *expected = gdraw_command_list_clone(source);
+    GDrawCommandList *actual = gdraw_command_list_clone(source);
+    for (int32_t t = 0; t <= ANIMATION_NORMALIZED_MAX; t += ANIMATION_NORMALIZED_MAX / 64) {
+      GScaleSegmentedStage stages[2];
+      const size_t num_stages = prv_unfold_stages(stages, size, t);
+      const GStrokeWidthScale stroke_width = {
+        .from = Fixed_S16_3(FIXED_S16_3_ONE.raw_value * 3),
+        .to = FIXED_S16_3_ONE,
+        .from_op = GStrokeWidthOpSet,
+        .to_op = GStrokeWidthOpMultiply,
+        .progress = t,
+      };
+
+      // One stage and both stages, with the stroke width
+      for (size_t n = 1; n <= num_stages; n++) {
+        prv_scale_segmented_in_place(expected, source, stages, n, target, duration_fraction,
+                                     &stroke_width);
+        gdraw_command_list_scale_segmented_from(actual, source, stages, n, NULL, timing,
+                                                &stroke_width);
+        cl_assert_equal_m(actual, expected, data_size);
+      }
+    }
+
+    // The source is never written to
+    GDrawCommandImage *pristine = s_image_creators[i]();
+    cl_assert_equal_m(source, gdraw_command_image_get_command_list(pristine), data_size);
+
+    free(pristine);
+    free(expected);
+    free(actual);
+    free(timing);
+    free(image);
+  }
+}
+
+void test_gdraw_command_transforms__attract_to_square_from_matches_in_place(void) {
+  for (size_t i = 0; i < ARRAY_LENGTH(s_image_creators); i++) {
+    GDrawCommandImage *image = s_image_creators[i]();
+    GDrawCommandList *source = gdraw_command_image_get_command_list(image);
+    const GSize size = gdraw_command_image_get_bounds_size(image);
+    const size_t data_size = gdraw_command_list_get_data_size(source);
+
+    GDrawCommandList *expected = gdraw_command_list_clone(source);
+    GDrawCommandList *actual = gdraw_command_list_clone(source);
+    for (int32_t t = 0; t <= ANIMATION_NORMALIZED_MAX; t += ANIMATION_NORMALIZED_MAX / 16) {
+      gdraw_command_list_copy(expected, data_size, source);
+      gdraw_command_list_attract_to_square(expected, size, t);
+      gdraw_command_list_attract_to_square_from(actual, source, size, t);
+      cl_assert_equal_m(actual, expected, data_size);
+    }
+
+    free(expected);
+    free(actual);
+    free(image);
+  }
+}
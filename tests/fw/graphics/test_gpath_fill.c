@@ -0,0 +1,451 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clar.h"
+
+#include "applib/graphics/gpath.h"
+#include "applib/graphics/graphics.h"
+#include "util/math.h"
+#include "util/size.h"
+#include "util/trig.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Stubs
+////////////////////////////////////
+#include "stubs_app_state.h"
+#include "stubs_applib_resource.h"
+#include "stubs_compiled_with_legacy2_sdk.h"
+#include "stubs_heap.h"
+#include "stubs_language_ui.h"
+#include "stubs_logging.h"
+#include "stubs_passert.h"
+#include "stubs_pebble_tasks.h"
+#include "stubs_print.h"
+#include "stubs_resources.h"
+#include "stubs_serial.h"
+#include "stubs_syscalls.h"
+#include "stubs_ui_window.h"
+#include "stubs_unobstructed_area.h"
+
+// The fill's scratch memory comes out of the app heap, applib_malloc() is routed here by the
+// applib_malloc_app_heap override so the tests can limit how big the heap is
+
+typedef struct {
+  size_t bytes;
+  max_align_t data[];
+} HeapBlock;
+
+static size_t s_heap_size;
+static size_t s_heap_used;
+
+void *app_malloc(size_t bytes) {
+  if (bytes > s_heap_size - s_heap_used) {
+    return NULL;
+  }
+  HeapBlock *block = malloc(sizeof(HeapBlock) + bytes);
+  cl_assert(block);
+  block->bytes = bytes;
+  s_heap_used += bytes;
+  return block->data;
+}
+
+void *app_zalloc(size_t bytes) {
+  void *ptr = app_malloc(bytes);
+  if (ptr) {
+    memset(ptr, 0, bytes);
+  }
+  return ptr;
+}
+
+void app_free(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+  HeapBlock *block = (HeapBlock *)((uint8_t *)ptr - offsetof(HeapBlock, data));
+  s_heap_used -= block->bytes;
+  free(block);
+}
+
+void prv_fill_path_with_cb_aa(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
+                              void *user_data);
+
+// The fill callback records every span, so the fill can be compared with the per-row scan it
+// replaced without depending on how the spans get drawn
+
+typedef struct {
+  int16_t y;
+  Fixed_S16_3 x_begin;
+  Fixed_S16_3 x_end;
+  Fixed_S16_3 delta_begin;
+  Fixed_S16_3 delta_end;
+} Span;
+
+#define MAX_SPANS (64 * 1024)
+#define MAX_POINTS (256)
+
+typedef struct {
+  Span spans[MAX_SPANS];
+  int count;
+} SpanList;
+
+static SpanList s_expected;
+static SpanList s_actual;
+
+static void prv_record_span_cb(GContext *ctx, int16_t y, Fixed_S16_3 x_range_begin,
+                               Fixed_S16_3 x_range_end, Fixed_S16_3 delta_begin,
+                               Fixed_S16_3 delta_end, void *user_data) {
+  SpanList *list = user_data;
+  cl_assert(list->count < MAX_SPANS);
+  list->spans[list->count++] = (Span) {
+    .y = y,
+    .x_begin = x_range_begin,
+    .x_end = x_range_end,
+    .delta_begin = delta_begin,
+    .delta_end = delta_end,
+  };
+}
+
+// The fill as it was before the active edge table: every row scans every path segment and
+// selection sorts the intersections it finds
+////////////////////////////////////
+
+typedef struct {
+  Fixed_S16_3 x;
+  Fixed_S16_3 delta;
+} RefIntersection;
+
+static GPoint prv_rotate_offset_point(const GPoint *orig, int32_t rotation, const GPoint *offset) {
+  int32_t cosine = cos_lookup(rotation);
+  int32_t sine = sin_lookup(rotation);
+  GPoint result;
+  result.x = (int32_t)orig->x * cosine / TRIG_MAX_RATIO - (int32_t)orig->y * sine / TRIG_MAX_RATIO +
+             offset->x;
+  result.y = (int32_t)orig->y * cosine / TRIG_MAX_RATIO + (int32_t)orig->x * sine / TRIG_MAX_RATIO +
+             offset->y;
+  return result;
+}
+
+static void prv_ref_sort(RefIntersection *values, int length) {
+  for (int i = 0; i < length; i++) {
+    for (int j = i + 1; j < length; j++) {
+      if (values[i].x.raw_value > values[j].x.raw_value) {
+        RefIntersection t = values[i];
+        values[i] = values[j];
+        values[j] = t;
+      }
+    }
+  }
+}
+
+static void prv_reference_fill(GContext *ctx, GPath *path, bool antialiased,
+                               GPathDrawFilledCallback cb, void *user_data) {
+  const int n = path->num_points;
+  GPointPrecise rot_points[MAX_POINTS];
+  RefIntersection intersections_up[MAX_POINTS];
+  RefIntersection intersections_down[MAX_POINTS];
+  cl_assert(n <= MAX_POINTS);
+  if (n < 2) {
+    return;
+  }
+
+  // Non-AA works in whole pixels, which is the same as AA with the fraction bits left out
+  const int scale = antialiased ? FIXED_S16_3_ONE.raw_value : 1;
+  int min_x = INT16_MAX, max_x = INT16_MIN, min_y = INT16_MAX, max_y = INT16_MIN;
+  for (int i = 0; i < n; i++) {
+    const GPoint rot = prv_rotate_offset_point(&path->points[i], path->rotation, &path->offset);
+    if (antialiased) {
+      rot_points[i] = GPointPreciseFromGPoint(rot);
+    } else {
+      rot_points[i] = (GPointPrecise) {{ .raw_value = rot.x }, { .raw_value = rot.y }};
+    }
+  }
+  #define ROW(p) (antialiased ? (p).y.integer : (p).y.raw_value)
+  #define COL(p) (antialiased ? (p).x.integer : (p).x.raw_value)
+  bool start_is_down = false;
+  for (int i = n - 1; i > 0; i--) {
+    const GPointPrecise start = rot_points[i];
+    const GPointPrecise end = rot_points[(i + 1) % n];
+    if (ROW(end) != ROW(start)) {
+      start_is_down = ROW(end) > ROW(start);
+      break;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    min_x = MIN(min_x, COL(rot_points[i]));
+    max_x = MAX(max_x, COL(rot_points[i]));
+    min_y = MIN(min_y, ROW(rot_points[i]));
+    max_y = MAX(max_y, ROW(rot_points[i]));
+  }
+
+  const int16_t clip_min_x = ctx->draw_state.clip_box.origin.x -
+                             ctx->draw_state.drawing_box.origin.x;
+  const int16_t clip_max_x = ctx->draw_state.clip_box.size.w + clip_min_x;
+  if (!((max_x >= clip_min_x) && (min_x <= clip_max_x))) {
+    return;
+  }
+  const int16_t clip_min_y = ctx->draw_state.clip_box.origin.y -
+                             ctx->draw_state.drawing_box.origin.y;
+  const int16_t clip_max_y = ctx->draw_state.clip_box.size.h + clip_min_y;
+  min_y = MAX(min_y, clip_min_y);
+  max_y = MIN(max_y, clip_max_y);
+
+  for (int16_t i = min_y; i <= max_y; ++i) {
+    int up_count = 0;
+    int down_count = 0;
+    bool last_is_down = start_is_down;
+    for (int j = 0; j < n; j++) {
+      const GPointPrecise rot_start = rot_points[j];
+      const GPointPrecise rot_end = rot_points[(j + 1) % n];
+      if ((ROW(rot_start) - i) * (ROW(rot_end) - i) > 0) {
+        continue;
+      }
+      const bool is_down = (ROW(rot_end) != ROW(rot_start)) ? (ROW(rot_end) > ROW(rot_start)) :
+                                                              last_is_down;
+      if (!(ROW(rot_start) == i && last_is_down == is_down)) {
+        RefIntersection intersection;
+        if (antialiased) {
+          int16_t delta_x = rot_end.x.raw_value - rot_start.x.raw_value;
+          int16_t delta_y = rot_end.y.raw_value - rot_start.y.raw_value;
+          Fixed_S16_3 x = {.raw_value = rot_start.x.raw_value + delta_x *
+                                        (i * scale - rot_start.y.raw_value) / delta_y};
+          Fixed_S16_3 delta = {.raw_value = ABS(delta_x / delta_y) * FIXED_S16_3_ONE.raw_value};
+          if (delta.integer > 1) {
+            int16_t seg_min_x = MIN(rot_end.x.raw_value, rot_start.x.raw_value);
+            int16_t seg_max_x = MAX(rot_end.x.raw_value, rot_start.x.raw_value);
+            if (x.raw_value - (delta.raw_value / 2) < seg_min_x) {
+              delta.raw_value = (x.raw_value - seg_min_x) * 2;
+            }
+            if (x.raw_value + (delta.raw_value / 2) > seg_max_x) {
+              delta.raw_value = (seg_max_x - x.raw_value) * 2;
+            }
+          }
+          intersection = (RefIntersection) { x, delta };
+        } else {
+          int16_t x = rot_start.x.raw_value + (rot_end.x.raw_value - rot_start.x.raw_value) *
+                      (i - rot_start.y.raw_value) / (rot_end.y.raw_value - rot_start.y.raw_value);
+          intersection = (RefIntersection) { { .raw_value = x } };
+        }
+        if (is_down) {
+          intersections_down[down_count++] = intersection;
+        } else {
+          intersections_up[up_count++] = intersection;
+        }
+      }
+      last_is_down = is_down;
+    }
+    prv_ref_sort(intersections_up, up_count);
+    prv_ref_sort(intersections_down, down_count);
+
+    for (int j = 0; j < MIN(up_count, down_count); j++) {
+      RefIntersection a = intersections_up[j];
+      RefIntersection b = intersections_down[j];
+      const int16_t a_x = antialiased ? a.x.integer : a.x.raw_value;
+      const int16_t b_x = antialiased ? b.x.integer : b.x.raw_value;
+      if (a_x == b_x) {
+        continue;
+      }
+      if (a_x > b_x) {
+        RefIntersection t = a;
+        a = b;
+        b = t;
+      }
+      if (antialiased) {
+        cb(ctx, i, a.x, b.x, a.delta, b.delta, user_data);
+      } else {
+        cb(ctx, i, (Fixed_S16_3){.integer = a.x.raw_value}, (Fixed_S16_3){.integer = b.x.raw_value},
+           (Fixed_S16_3){.integer = -1}, (Fixed_S16_3){.integer = -1}, user_data);
+      }
+    }
+  }
+  #undef ROW
+  #undef COL
+}
+
+// Helpers
+////////////////////////////////////
+
+static GContext s_ctx;
+static GPoint s_points[MAX_POINTS];
+
+//! Random polygon around the screen. Coordinates are snapped to a coarse grid some of the time so
+//! there are plenty of horizontal segments, shared vertices and crossing edges.
+static GPath prv_random_path(int num_points) {
+  const bool snap = (rand() % 2) == 0;
+  for (int i = 0; i < num_points; i++) {
+    int16_t x = (rand() % 200) - 28;
+    int16_t y = (rand() % 230) - 31;
+    if (snap) {
+      x -= x % 16;
+      y -= y % 16;
+    }
+    s_points[i] = GPoint(x, y);
+  }
+  GPath path = {
+    .num_points = num_points,
+    .points = s_points,
+  };
+  if (rand() % 3 == 0) {
+    path.rotation = rand() % TRIG_MAX_ANGLE;
+    path.offset = GPoint(72, 84);
+    for (int i = 0; i < num_points; i++) {
+      s_points[i].x -= 72;
+      s_points[i].y -= 84;
+    }
+  }
+  return path;
+}
+
+//! Random polygon which doesn't cross itself, like an icon or a watch hand: points at increasing
+//! angles around the middle of the screen at random distances
+static GPath prv_random_simple_path(int num_points) {
+  for (int i = 0; i < num_points; i++) {
+    const int32_t angle = (i * TRIG_MAX_ANGLE) / num_points;
+    const int32_t radius = 20 + (rand() % 60);
+    s_points[i] = GPoint(72 + (sin_lookup(angle) * radius) / TRIG_MAX_RATIO,
+                         84 - (cos_lookup(angle) * radius) / TRIG_MAX_RATIO);
+  }
+  return (GPath) {
+    .num_points = num_points,
+    .points = s_points,
+  };
+}
+
+static void prv_fill(GPath *path, bool antialiased, GPathDrawFilledCallback cb, void *user_data) {
+  if (antialiased) {
+    prv_fill_path_with_cb_aa(&s_ctx, path, cb, user_data);
+  } else {
+    gpath_draw_filled_with_cb(&s_ctx, path, cb, user_data);
+  }
+}
+
+static void prv_check_matches_reference(GPath *path, bool antialiased) {
+  s_expected.count = 0;
+  s_actual.count = 0;
+  prv_reference_fill(&s_ctx, path, antialiased, prv_record_span_cb, &s_expected);
+  prv_fill(path, antialiased, prv_record_span_cb, &s_actual);
+  cl_assert_equal_i(s_actual.count, s_expected.count);
+  for (int i = 0; i < s_expected.count; i++) {
+    const Span *e = &s_expected.spans[i];
+    const Span *a = &s_actual.spans[i];
+    cl_assert_equal_i(a->y, e->y);
+    cl_assert_equal_i(a->x_begin.raw_value, e->x_begin.raw_value);
+    cl_assert_equal_i(a->x_end.raw_value, e->x_end.raw_value);
+    cl_assert_equal_i(a->delta_begin.raw_value, e->delta_begin.raw_value);
+    cl_assert_equal_i(a->delta_end.raw_value, e->delta_end.raw_value);
+  }
+}
+
+// Setup
+////////////////////////////////////
+
+void test_gpath_fill__initialize(void) {
+  srand(0);
+  s_heap_size = SIZE_MAX;
+  s_heap_used = 0;
+  s_ctx = (GContext) {
+    .draw_state = {
+      .clip_box = GRect(0, 0, 144, 168),
+      .drawing_box = GRect(0, 0, 144, 168),
+      .fill_color = GColorRed,
+      .stroke_color = GColorBlue,
+    },
+  };
+}
+
+void test_gpath_fill__cleanup(void) {
+  cl_assert_equal_i(s_heap_used, 0);
+}
+
+// Tests
+////////////////////////////////////
+
+void test_gpath_fill__random_polygons_match_reference(void) {
+  for (int run = 0; run < 2000; run++) {
+    GPath path = prv_random_path(8 + (rand() % (MAX_POINTS - 8 + 1)));
+    prv_check_matches_reference(&path, false /* antialiased */);
+    prv_check_matches_reference(&path, true /* antialiased */);
+  }
+}
+
+void test_gpath_fill__simple_polygons_match_reference(void) {
+  for (int run = 0; run < 500; run++) {
+    GPath path = prv_random_simple_path(8 + (rand() % (MAX_POINTS - 8 + 1)));
+    prv_check_matches_reference(&path, false /* antialiased */);
+    prv_check_matches_reference(&path, true /* antialiased */);
+  }
+}
+
+void test_gpath_fill__clipped_and_offset(void) {
+  // clip boxes and drawing boxes which cut through the path and move it around
+  const GRect clip_boxes[] = {
+    GRect(0, 0, 144, 168), GRect(20, 30, 50, 60), GRect(100, 150, 44, 18), GRect(0, 0, 144, 1),
+  };
+  const GRect drawing_boxes[] = {
+    GRect(0, 0, 144, 168), GRect(-30, 12, 144, 168), GRect(25, -40, 100, 100),
+  };
+  for (int run = 0; run < 200; run++) {
+    GPath path = prv_random_path(8 + (rand() % 57));
+    for (unsigned c = 0; c < ARRAY_LENGTH(clip_boxes); c++) {
+      for (unsigned d = 0; d < ARRAY_LENGTH(drawing_boxes); d++) {
+        s_ctx.draw_state.clip_box = clip_boxes[c];
+        s_ctx.draw_state.drawing_box = drawing_boxes[d];
+        prv_check_matches_reference(&path, false /* antialiased */);
+        prv_check_matches_reference(&path, true /* antialiased */);
+      }
+    }
+  }
+}
+
+//! The per-row scan needed a rotated point and an up and a down intersection per point, so a path
+//! that an app could fill before has to fit in the same heap. Plain fills only kept the
+//! intersections' x, antialiased fills kept their gradient too.
+void test_gpath_fill__fits_in_the_per_row_scan_heap(void) {
+  const size_t per_row_scan_bytes[2] = {
+    MAX_POINTS * (sizeof(GPoint) + 2 * sizeof(int16_t)),
+    MAX_POINTS * (sizeof(GPointPrecise) + 2 * sizeof(RefIntersection)),
+  };
+  for (int run = 0; run < 100; run++) {
+    GPath path = (run % 2) ? prv_random_path(MAX_POINTS) : prv_random_simple_path(MAX_POINTS);
+    for (int aa = 0; aa < 2; aa++) {
+      s_heap_size = per_row_scan_bytes[aa];
+      prv_check_matches_reference(&path, aa);
+      cl_assert(s_actual.count > 0);
+      cl_assert_equal_i(s_heap_used, 0);
+    }
+  }
+}
+
+void test_gpath_fill__degenerate(void) {
+  // all points on one row, all points on one column, and points repeated
+  GPoint flat[] = { {10, 20}, {50, 20}, {30, 20}, {90, 20} };
+  GPoint column[] = { {10, 20}, {10, 80}, {10, 50}, {10, 10} };
+  GPoint repeated[] = { {10, 10}, {10, 10}, {60, 70}, {60, 70}, {10, 70}, {10, 10} };
+  GPath paths[] = {
+    { .num_points = ARRAY_LENGTH(flat), .points = flat },
+    { .num_points = ARRAY_LENGTH(column), .points = column },
+    { .num_points = ARRAY_LENGTH(repeated), .points = repeated },
+  };
+  for (unsigned i = 0; i < ARRAY_LENGTH(paths); i++) {
+    prv_check_matches_reference(&paths[i], false /* antialiased */);
+    prv_check_matches_reference(&paths[i], true /* antialiased */);
+  }
+
+  // the stroke color is only borrowed for the antialiased edges
+  cl_assert(gcolor_equal(s_ctx.draw_state.stroke_color, GColorBlue));
+}
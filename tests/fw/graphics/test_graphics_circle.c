@@ -42,6 +42,8 @@ void graphics_private_draw_horizontal_line(){}
 void graphics_private_draw_vertical_line(){}
 void graphics_private_plot_pixel(){}
 void graphics_private_set_pixel(){}
+void graphics_private_release_frame_buffer(GContext *ctx, GBitmap *buffer) {}
+void graphics_context_mark_dirty_rect(GContext *ctx, GRect rect) {}
 
 /////////////////////////////
 
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "applib/graphics/gbitmap_png.h"
+
+#include "clar.h"
+#include "util.h"
+
+#include <util/size.h>
+
+#include <string.h>
+#include <stdio.h>
+
+// Fakes
+////////////////////////////////////
+#include "fake_resource_syscalls.h"
+
+// Stubs
+////////////////////////////////////
+#include "stubs_app_state.h"
+#include "stubs_heap.h"
+#include "stubs_logging.h"
+#include "stubs_passert.h"
+#include "stubs_resources.h"
+
+// Keeps track of how much the task heap is holding on to, which is where the decoded image and
+// the decoder's state live. Frees of pointers we haven't seen, like the bitmap data freed with
+// applib_free() after the measurement, are ignored.
+#define MAX_TRACKED_ALLOCS (32)
+
+static struct {
+  void *ptr;
+  size_t bytes;
+} s_allocs[MAX_TRACKED_ALLOCS];
+static size_t s_heap_used;
+static size_t s_heap_peak;
+
+static void prv_reset_heap_tracking(void) {
+  memset(s_allocs, 0, sizeof(s_allocs));
+  s_heap_used = 0;
+  s_heap_peak = 0;
+}
+
+void *task_malloc(size_t bytes) {
+  void *ptr = malloc(bytes);
+  for (int i = 0; ptr && i < MAX_TRACKED_ALLOCS; i++) {
+    if (!s_allocs[i].ptr) {
+      s_allocs[i].ptr = ptr;
+      s_allocs[i].bytes = bytes;
+      s_heap_used += bytes;
+      s_heap_peak = MAX(s_heap_peak, s_heap_used);
+      break;
+    }
+  }
+  return ptr;
+}
+
+void task_free(void *ptr) {
+  for (int i = 0; ptr && i < MAX_TRACKED_ALLOCS; i++) {
+    if (s_allocs[i].ptr == ptr) {
+      s_heap_used -= s_allocs[i].bytes;
+      s_allocs[i].ptr = NULL;
+      break;
+    }
+  }
+  free(ptr);
+}
+
+// Tests
+////////////////////////////////////
+
+// The PNGs from test_png.c, which get converted to Pebble PNG8s at build time
+static const char *s_test_pngs[] = {
+  "test_png__color_1_bit_jazzberry_jam.1bitpalette.png",
+  "test_png__color_1_bit.1bitpalette.png",
+  "test_png__color_1_bit_transparent.1bitpalette.png",
+  "test_png__color_2_bit.2bitpalette.png",
+  "test_png__color_2_bit_transparent.2bitpalette.png",
+  "test_png__color_4_bit.4bitpalette.png",
+  "test_png__color_4_bit_transparent.4bitpalette.png",
+  "test_png__color_8_bit.8bit.png",
+  "test_png__color_8_bit_transparent.8bit.png",
+  "test_png__color_8_bit_transparent_bpp_check.8bit.png",
+  "test_png__color_256_colors_check.raw.png",
+  "test_png__greyscale_1_bit.1bitpalette.png",
+  "test_png__greyscale_1_bit_black.1bitpalette.png",
+  "test_png__greyscale_1_bit_transparent.1bitpalette.png",
+  "test_png__greyscale_2_bit.2bitpalette.png",
+  "test_png__greyscale_2_bit_transparent.2bitpalette.png",
+  "test_png__greyscale_4_bit_transparent.4bitpalette.png",
+};
+
+void test_png_resource__cleanup(void) {
+  fake_resource_syscalls_cleanup();
+}
+
+//! Decodes the PNG from RAM, the way it worked before image data was streamed
+static GBitmap *prv_create_from_file(const char *filename) {
+  uint8_t *png_data = NULL;
+  const size_t png_size = load_file(filename, &png_data);
+  GBitmap *bitmap = gbitmap_create_from_png_data(png_data, png_size);
+  free(png_data);
+  return bitmap;
+}
+
+static GBitmap *prv_create_from_resource(uint32_t resource_id) {
+  GBitmap *bitmap = calloc(1, sizeof(GBitmap));
+  if (!gbitmap_init_with_resource_system(bitmap, 0, resource_id)) {
+    free(bitmap);
+    return NULL;
+  }
+  return bitmap;
+}
+
+static void prv_assert_bitmaps_equal(GBitmap *a, GBitmap *b) {
+  cl_assert(a && b);
+  const GBitmapFormat format = gbitmap_get_format(a);
+  cl_assert_equal_i(gbitmap_get_format(b), format);
+  cl_assert(grect_equal(&a->bounds, &b->bounds));
+  cl_assert_equal_i(a->row_size_bytes, b->row_size_bytes);
+  for (int y = 0; y < a->bounds.size.h; y++) {
+    cl_assert_equal_m((uint8_t *)a->addr + (y * a->row_size_bytes),
+                      (uint8_t *)b->addr + (y * b->row_size_bytes), a->row_size_bytes);
+  }
+  const int palette_size = gbitmap_get_palette_size(format);
+  if (palette_size) {
+    cl_assert_equal_m(gbitmap_get_palette(a), gbitmap_get_palette(b), palette_size);
+  }
+}
+
+void test_png_resource__matches_png_data(void) {
+  for (size_t i = 0; i < ARRAY_LENGTH(s_test_pngs); i++) {
+    const uint32_t resource_id =
+        sys_resource_load_file_as_resource(TEST_IMAGES_PATH, s_test_pngs[i]);
+    cl_assert(resource_id != UINT32_MAX);
+
+    GBitmap *expected = prv_create_from_file(s_test_pngs[i]);
+    GBitmap *bitmap = prv_create_from_resource(resource_id);
+    prv_assert_bitmaps_equal(bitmap, expected);
+    gbitmap_destroy(bitmap);
+    gbitmap_destroy(expected);
+  }
+}
+
+void test_png_resource__split_image_data(void) {
+  // The image data of test_png__color_8_bit cut up into IDAT chunks of 1, 6, 293, 1 and the rest
+  // of the bytes, so even the zlib header is split
+  const uint32_t resource_id = sys_resource_load_file_as_resource(
+      TEST_IMAGES_PATH, "test_png_resource__split_image_data.png");
+  GBitmap *expected = prv_create_from_file("test_png__color_8_bit.8bit.png");
+  GBitmap *bitmap = prv_create_from_resource(resource_id);
+  prv_assert_bitmaps_equal(bitmap, expected);
+  gbitmap_destroy(bitmap);
+  gbitmap_destroy(expected);
+}
+
+void test_png_resource__apng_first_frame(void) {
+  // APNGs still get loaded whole, the first frame can come with its own frame control
+  const char *filename = "test_gbitmap_sequence__color_2bit_bouncing_ball.apng";
+  const uint32_t resource_id = sys_resource_load_file_as_resource(TEST_IMAGES_PATH, filename);
+  GBitmap *expected = prv_create_from_file(filename);
+  GBitmap *bitmap = prv_create_from_resource(resource_id);
+  prv_assert_bitmaps_equal(bitmap, expected);
+  gbitmap_destroy(bitmap);
+  gbitmap_destroy(expected);
+}
+
+void test_png_resource__truncated(void) {
+  // Only the first part of the image data made it
+  uint8_t *png_data = NULL;
+  const size_t png_size = load_file("test_png__color_8_bit.8bit.png", &png_data);
+  char path[PATH_STRING_LENGTH];
+  snprintf(path, sizeof(path), "%s/test_png_resource__truncated.png", TEST_OUTPUT_PATH);
+  FILE *file = fopen(path, "wb");
+  cl_assert(file);
+  fwrite(png_data, 1, png_size / 2, file);
+  fclose(file);
+  free(png_data);
+
+  const uint32_t resource_id = sys_resource_load_file_as_resource(NULL, path);
+  prv_reset_heap_tracking();
+  cl_assert_equal_p(prv_create_from_resource(resource_id), NULL);
+  cl_assert_equal_i(s_heap_used, 0);
+}
+
+void test_png_resource__heap_usage(void) {
+  for (size_t i = 0; i < ARRAY_LENGTH(s_test_pngs); i++) {
+    const char *filename = s_test_pngs[i];
+    const uint32_t resource_id = sys_resource_load_file_as_resource(TEST_IMAGES_PATH, filename);
+    const size_t png_size = sys_resource_size(0, resource_id);
+
+    // Decoding from RAM also needs the whole PNG loaded, which isn't on the task heap here
+    prv_reset_heap_tracking();
+    GBitmap *bitmap = prv_create_from_file(filename);
+    const size_t ram_heap_peak = s_heap_peak + png_size;
+    gbitmap_destroy(bitmap);
+
+    prv_reset_heap_tracking();
+    bitmap = prv_create_from_resource(resource_id);
+    const size_t stream_heap_peak = s_heap_peak;
+    gbitmap_destroy(bitmap);
+
+    cl_assert(stream_heap_peak < ram_heap_peak);
+  }
+}
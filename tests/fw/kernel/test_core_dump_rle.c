@@ -0,0 +1,200 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clar.h"
+
+#include "kernel/core_dump_rle.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RAM_SIZE (192 * 1024)
+#define FLASH_SIZE (CORE_DUMP_RLE_MAX_ENCODED_SIZE(RAM_SIZE))
+
+static uint32_t s_ram[RAM_SIZE / sizeof(uint32_t)];
+static uint8_t s_flash[FLASH_SIZE];
+static uint8_t s_decoded[RAM_SIZE];
+static int s_num_writes;
+static int s_num_watchdog_feeds;
+
+static uint32_t prv_flash_write(const void *buffer, uint32_t start_addr, uint32_t buffer_size) {
+  cl_assert(buffer_size <= CORE_DUMP_RLE_BUFFER_SIZE);
+  cl_assert(start_addr + buffer_size <= FLASH_SIZE);
+  memcpy(&s_flash[start_addr], buffer, buffer_size);
+  s_num_writes++;
+  return buffer_size;
+}
+
+static void prv_watchdog_feed(void) {
+  s_num_watchdog_feeds++;
+}
+
+//! Same as decode() in tools/coredump_rle.py
+//! @return the decoded length, or -1 if the encoding is malformed
+static int prv_decode(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t out_len) {
+  uint32_t in_pos = 0;
+  uint32_t out_pos = 0;
+  while (in_pos < in_len) {
+    if (in_pos + sizeof(uint16_t) > in_len) {
+      return -1;
+    }
+    const uint16_t token = in[in_pos] | (in[in_pos + 1] << 8);
+    in_pos += sizeof(uint16_t);
+    const uint32_t count = (token & ~CORE_DUMP_RLE_TOKEN_RUN_FLAG) + 1;
+    const bool is_run = (token & CORE_DUMP_RLE_TOKEN_RUN_FLAG);
+    const uint32_t encoded_len = (is_run ? 1 : count) * sizeof(uint32_t);
+    if ((in_pos + encoded_len > in_len) || (out_pos + count * sizeof(uint32_t) > out_len)) {
+      return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      memcpy(&out[out_pos], &in[in_pos + (is_run ? 0 : i * sizeof(uint32_t))], sizeof(uint32_t));
+      out_pos += sizeof(uint32_t);
+    }
+    in_pos += encoded_len;
+  }
+  return out_pos;
+}
+
+static uint32_t prv_encode(const void *start, uint32_t length) {
+  CoreDumpRleEncoder encoder;
+  core_dump_rle_init(&encoder, prv_flash_write, 0);
+  core_dump_rle_put_memory(&encoder, start, length, prv_watchdog_feed);
+  return core_dump_rle_finish(&encoder);
+}
+
+//! Encodes the image and checks that it decodes back to the same thing
+//! @return the encoded length
+static uint32_t prv_check_round_trip(const void *start, uint32_t length) {
+  const uint32_t encoded_len = prv_encode(start, length);
+
+  cl_assert(encoded_len <= CORE_DUMP_RLE_MAX_ENCODED_SIZE(length));
+  cl_assert_equal_i(prv_decode(s_flash, encoded_len, s_decoded, sizeof(s_decoded)), length);
+  cl_assert(memcmp(s_decoded, start, length) == 0);
+  return encoded_len;
+}
+
+static void prv_fill(uint32_t *words, uint32_t num_words, uint32_t value) {
+  for (uint32_t i = 0; i < num_words; i++) {
+    words[i] = value;
+  }
+}
+
+static void prv_fill_random(uint32_t *words, uint32_t num_words) {
+  for (uint32_t i = 0; i < num_words; i++) {
+    words[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+  }
+}
+
+//! Lays out something that looks like the RAM of a running watch: initialized data, a heap with
+//! allocations and free blocks, task stacks that are mostly still at their fill pattern and a lot
+//! of zeroed .bss and buffers.
+static void prv_fill_representative_ram(uint32_t *ram) {
+  const uint32_t num_words = RAM_SIZE / sizeof(uint32_t);
+  memset(ram, 0, RAM_SIZE);
+  uint32_t pos = 0;
+
+  // .data: pointers and small constants
+  for (; pos < 2048; pos++) {
+    ram[pos] = (pos % 3) ? (0x08000000 + (rand() % 0x80000)) : (rand() % 16);
+  }
+  // .bss is zero, then a 64 KiB kernel heap
+  pos += 8192;
+  const uint32_t heap_end = pos + (16 * 1024);
+  while (pos < heap_end) {
+    const uint32_t block_words = 4 + (rand() % 128);
+    ram[pos] = (block_words << 16) | (rand() % 2);  // header
+    const bool is_free = (rand() % 3) == 0;
+    for (uint32_t i = 1; i < block_words && pos + i < heap_end; i++) {
+      if (is_free) {
+        ram[pos + i] = 0;
+      } else if (i % 4 == 0) {
+        // a struct with a list node and some fields
+        ram[pos + i] = 0x20000000 + (rand() % RAM_SIZE);
+      } else {
+        ram[pos + i] = (rand() % 4) ? (rand() % 256) : 0;
+      }
+    }
+    pos += block_words;
+  }
+  // task stacks, about a fifth of each one is used
+  const uint32_t stack_words[] = { 512, 1024, 2048, 1024, 512, 2048, 4096 };
+  for (unsigned int s = 0; s < sizeof(stack_words) / sizeof(stack_words[0]); s++) {
+    const uint32_t used = stack_words[s] / 5;
+    prv_fill(&ram[pos], stack_words[s] - used, 0xa5a5a5a5);
+    prv_fill_random(&ram[pos + stack_words[s] - used], used);
+    pos += stack_words[s];
+  }
+  // framebuffer with a mostly white screen
+  prv_fill(&ram[pos], (168 * 144) / sizeof(uint32_t), 0xffffffff);
+  for (uint32_t i = 0; i < 1000; i++) {
+    ram[pos + (rand() % ((168 * 144) / sizeof(uint32_t)))] = rand();
+  }
+  cl_assert(pos + (168 * 144) / sizeof(uint32_t) < num_words);
+}
+
+void test_core_dump_rle__initialize(void) {
+  srand(0);
+  memset(s_flash, 0xff, sizeof(s_flash));
+  memset(s_decoded, 0, sizeof(s_decoded));
+  s_num_writes = 0;
+  s_num_watchdog_feeds = 0;
+}
+
+void test_core_dump_rle__zeroes(void) {
+  memset(s_ram, 0, sizeof(s_ram));
+  const uint32_t encoded_len = prv_check_round_trip(s_ram, sizeof(s_ram));
+  // Two runs, as a run holds at most CORE_DUMP_RLE_MAX_COUNT words
+  cl_assert_equal_i(encoded_len, 2 * (sizeof(uint16_t) + sizeof(uint32_t)));
+  cl_assert(s_num_watchdog_feeds > 0);
+}
+
+void test_core_dump_rle__representative_ram(void) {
+  prv_fill_representative_ram(s_ram);
+  const uint32_t encoded_len = prv_check_round_trip(s_ram, sizeof(s_ram));
+  cl_assert(encoded_len < sizeof(s_ram) / 2);
+}
+
+void test_core_dump_rle__random(void) {
+  prv_fill_random(s_ram, RAM_SIZE / sizeof(uint32_t));
+  const uint32_t encoded_len = prv_check_round_trip(s_ram, sizeof(s_ram));
+  // Incompressible data only grows by a token per buffer written
+  cl_assert_equal_i(encoded_len, sizeof(s_ram) + (s_num_writes * sizeof(uint16_t)));
+}
+
+void test_core_dump_rle__short_runs_and_literals(void) {
+  // Every mix of runs of 1 to 3 words, which is where literals and runs hand over to each other
+  uint32_t *words = s_ram;
+  uint32_t num_words = 0;
+  for (uint32_t i = 0; i < 3000; i++) {
+    const uint32_t run = 1 + (rand() % 3);
+    prv_fill(&words[num_words], run, rand() % 4);
+    num_words += run;
+  }
+  prv_check_round_trip(words, num_words * sizeof(uint32_t));
+}
+
+void test_core_dump_rle__empty(void) {
+  cl_assert_equal_i(prv_encode(s_ram, 0), 0);
+  cl_assert_equal_i(s_num_writes, 0);
+}
+
+void test_core_dump_rle__malformed(void) {
+  const uint8_t truncated_literal[] = { 0x01, 0x00, 0xaa, 0xbb, 0xcc, 0xdd };
+  cl_assert_equal_i(prv_decode(truncated_literal, sizeof(truncated_literal), s_decoded,
+                               sizeof(s_decoded)), -1);
+  const uint8_t run[] = { 0x03, 0x80, 0xaa, 0xbb, 0xcc, 0xdd };
+  cl_assert_equal_i(prv_decode(run, sizeof(run), s_decoded, sizeof(s_decoded)), 16);
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kernel/task_timer.h"
+#include "kernel/task_timer_manager.h"
+
+#include "drivers/rtc.h"
+#include "util/size.h"
+
+#include "clar.h"
+
+#include <stdlib.h>
+
+// Stubs
+#include "stubs_logging.h"
+#include "stubs_mutex.h"
+#include "stubs_passert.h"
+#include "stubs_worker_manager.h"
+
+// Fakes
+#include "fake_pbl_malloc.h"
+#include "fake_pebble_tasks.h"
+#include "fake_rtc.h"
+
+static int s_num_semaphore_gives;
+
+signed portBASE_TYPE xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue,
+                                       TickType_t xTicksToWait, portBASE_TYPE xCopyPosition) {
+  s_num_semaphore_gives++;
+  return pdTRUE;
+}
+
+static TaskTimerManager s_manager;
+
+#define MAX_FIRED 1024
+static uintptr_t s_fired[MAX_FIRED];
+static int s_num_fired;
+
+static void prv_record_cb(void *data) {
+  cl_assert(s_num_fired < MAX_FIRED);
+  s_fired[s_num_fired++] = (uintptr_t)data;
+}
+
+static TaskTimerID s_self_delete_timer;
+static void prv_self_delete_cb(void *data) {
+  prv_record_cb(data);
+  task_timer_delete(&s_manager, s_self_delete_timer);
+}
+
+static void prv_advance_ms(uint32_t ms) {
+  fake_rtc_increment_ticks(milliseconds_to_ticks(ms));
+}
+
+void test_task_timer__initialize(void) {
+  fake_rtc_init(100, 1000);
+  s_num_semaphore_gives = 0;
+  s_num_fired = 0;
+  task_timer_manager_init(&s_manager, (SemaphoreHandle_t)1);
+}
+
+void test_task_timer__cleanup(void) {
+  kernel_free(s_manager.running_timers);
+  kernel_free(s_manager.timers_by_id);
+  fake_pbl_malloc_check_net_allocs();
+  fake_pbl_malloc_clear_tracking();
+}
+
+void test_task_timer__fires_in_expire_order(void) {
+  const uint32_t timeouts_ms[] = {300, 100, 500, 200, 400};
+  TaskTimerID timers[ARRAY_LENGTH(timeouts_ms)];
+  for (uintptr_t i = 0; i < ARRAY_LENGTH(timeouts_ms); i++) {
+    timers[i] = task_timer_create(&s_manager);
+    cl_assert(timers[i] != TASK_TIMER_INVALID_ID);
+    cl_assert(task_timer_start(&s_manager, timers[i], timeouts_ms[i], prv_record_cb, (void *)i,
+                               0));
+  }
+
+  // Only the timers that became the new head wake up the service loop
+  cl_assert_equal_i(s_num_semaphore_gives, 2);
+
+  TickType_t ticks_to_wait = task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(ticks_to_wait, milliseconds_to_ticks(100));
+  cl_assert_equal_i(s_num_fired, 0);
+
+  prv_advance_ms(250);
+  task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(s_num_fired, 2);
+  cl_assert_equal_i(s_fired[0], 1);
+  cl_assert_equal_i(s_fired[1], 3);
+
+  prv_advance_ms(1000);
+  ticks_to_wait = task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(ticks_to_wait, portMAX_DELAY);
+  cl_assert_equal_i(s_num_fired, 5);
+  cl_assert_equal_i(s_fired[2], 0);
+  cl_assert_equal_i(s_fired[3], 4);
+  cl_assert_equal_i(s_fired[4], 2);
+
+  for (int i = 0; i < ARRAY_LENGTH(timers); i++) {
+    cl_assert(!task_timer_scheduled(&s_manager, timers[i], NULL));
+    task_timer_delete(&s_manager, timers[i]);
+  }
+}
+
+void test_task_timer__equal_expire_times_fire_in_start_order(void) {
+  TaskTimerID timers[20];
+  for (uintptr_t i = 0; i < ARRAY_LENGTH(timers); i++) {
+    timers[i] = task_timer_create(&s_manager);
+    cl_assert(task_timer_start(&s_manager, timers[i], 50, prv_record_cb, (void *)i, 0));
+  }
+  // Restarting a timer moves it to the back of the line
+  cl_assert(task_timer_start(&s_manager, timers[3], 50, prv_record_cb, (void *)3, 0));
+
+  prv_advance_ms(50);
+  task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(s_num_fired, ARRAY_LENGTH(timers));
+  int fired_idx = 0;
+  for (uintptr_t i = 0; i < ARRAY_LENGTH(timers); i++) {
+    if (i != 3) {
+      cl_assert_equal_i(s_fired[fired_idx++], i);
+    }
+  }
+  cl_assert_equal_i(s_fired[fired_idx], 3);
+
+  for (int i = 0; i < ARRAY_LENGTH(timers); i++) {
+    task_timer_delete(&s_manager, timers[i]);
+  }
+}
+
+void test_task_timer__stop_reschedule_and_flags(void) {
+  TaskTimerID a = task_timer_create(&s_manager);
+  TaskTimerID b = task_timer_create(&s_manager);
+
+  cl_assert(task_timer_start(&s_manager, a, 100, prv_record_cb, (void *)1, 0));
+  cl_assert(task_timer_start(&s_manager, b, 200, prv_record_cb, (void *)2, 0));
+  cl_assert(!task_timer_start(&s_manager, a, 500, prv_record_cb, (void *)1,
+                              TIMER_START_FLAG_FAIL_IF_SCHEDULED));
+
+  uint32_t expire_ms;
+  cl_assert(task_timer_scheduled(&s_manager, a, &expire_ms));
+  cl_assert_equal_i(expire_ms, ticks_to_milliseconds(milliseconds_to_ticks(100)));
+
+  // Push a out past b
+  cl_assert(task_timer_start(&s_manager, a, 300, prv_record_cb, (void *)1, 0));
+  cl_assert(task_timer_stop(&s_manager, b));
+  cl_assert(!task_timer_scheduled(&s_manager, b, NULL));
+
+  prv_advance_ms(250);
+  task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(s_num_fired, 0);
+
+  prv_advance_ms(50);
+  task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(s_num_fired, 1);
+  cl_assert_equal_i(s_fired[0], 1);
+
+  task_timer_delete(&s_manager, a);
+  task_timer_delete(&s_manager, b);
+}
+
+void test_task_timer__repeating(void) {
+  TaskTimerID timer = task_timer_create(&s_manager);
+  cl_assert(task_timer_start(&s_manager, timer, 100, prv_record_cb, (void *)7,
+                             TIMER_START_FLAG_REPEATING));
+
+  for (int i = 1; i <= 5; i++) {
+    prv_advance_ms(100);
+    task_timer_manager_execute_expired_timers(&s_manager);
+    cl_assert_equal_i(s_num_fired, i);
+    cl_assert(task_timer_scheduled(&s_manager, timer, NULL));
+  }
+
+  task_timer_stop(&s_manager, timer);
+  prv_advance_ms(1000);
+  task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(s_num_fired, 5);
+  task_timer_delete(&s_manager, timer);
+}
+
+void test_task_timer__delete_from_callback(void) {
+  s_self_delete_timer = task_timer_create(&s_manager);
+  TaskTimerID other = task_timer_create(&s_manager);
+  cl_assert(task_timer_start(&s_manager, s_self_delete_timer, 10, prv_self_delete_cb, (void *)1,
+                             TIMER_START_FLAG_REPEATING));
+  cl_assert(task_timer_start(&s_manager, other, 20, prv_record_cb, (void *)2, 0));
+
+  prv_advance_ms(100);
+  task_timer_manager_execute_expired_timers(&s_manager);
+  cl_assert_equal_i(s_num_fired, 2);
+  cl_assert_equal_i(s_fired[0], 1);
+  cl_assert_equal_i(s_fired[1], 2);
+  cl_assert_equal_i(s_manager.num_timers, 1);
+
+  task_timer_delete(&s_manager, other);
+  cl_assert_equal_i(s_manager.num_timers, 0);
+}
+
+void test_task_timer__create_fails_on_oom(void) {
+  fake_malloc_set_largest_free_block(0);
+  cl_assert_equal_i(task_timer_create(&s_manager), TASK_TIMER_INVALID_ID);
+  fake_malloc_set_largest_free_block(~0);
+}
+
+// Create, schedule, reschedule, cancel and fire 500 timers
+void test_task_timer__many_timers(void) {
+  const int k_num_timers = 500;
+  TaskTimerID timers[k_num_timers];
+  uint32_t timeouts_ms[k_num_timers];
+  srand(0);
+
+  for (int i = 0; i < k_num_timers; i++) {
+    timers[i] = task_timer_create(&s_manager);
+    cl_assert(timers[i] != TASK_TIMER_INVALID_ID);
+  }
+
+  for (uintptr_t i = 0; i < k_num_timers; i++) {
+    cl_assert(task_timer_start(&s_manager, timers[i], 1000 + rand() % 10000, prv_record_cb,
+                               (void *)i, 0));
+  }
+
+  for (uintptr_t i = 0; i < k_num_timers; i++) {
+    timeouts_ms[i] = 1000 + rand() % 10000;
+    cl_assert(task_timer_start(&s_manager, timers[i], timeouts_ms[i], prv_record_cb, (void *)i,
+                               0));
+  }
+
+  // Cancel every other timer
+  for (int i = 0; i < k_num_timers; i += 2) {
+    cl_assert(task_timer_stop(&s_manager, timers[i]));
+  }
+
+  prv_advance_ms(11000);
+  task_timer_manager_execute_expired_timers(&s_manager);
+
+  for (int i = 0; i < k_num_timers; i++) {
+    task_timer_delete(&s_manager, timers[i]);
+  }
+
+  // Only the timers that weren't cancelled fired, in the order of their rescheduled timeouts
+  cl_assert_equal_i(s_num_fired, k_num_timers / 2);
+  for (int i = 0; i < s_num_fired; i++) {
+    cl_assert((s_fired[i] % 2) == 1);
+    if (i > 0) {
+      cl_assert(timeouts_ms[s_fired[i - 1]] <= timeouts_ms[s_fired[i]]);
+    }
+  }
+}
@@ -1347,6 +1347,107 @@ void test_kraepelin_algorithm__step_tests(void) {
 }
 
 
+// ---------------------------------------------------------------------------------------
+// The original radix-2 FFT, implemented in kraepelin_reference/fourier.c
+static void prv_reference_fft(int16_t *d) {
+  extern void fft_2radix_real(int16_t *d, int16_t dlenpwr);
+  fft_2radix_real(d, 7 /* log2(KALG_FFT_WIDTH) */);
+}
+
+
+// ---------------------------------------------------------------------------------------
+// Replay samples through kalg_analyze_samples() one minute at a time, the same way as
+// prv_feed_kalg_samples(), but without collecting stats.
+// @param[out] minute_steps the steps counted in each minute
+// @param[in,out] num_minutes size of minute_steps on entry, # of filled entries on exit
+// @return number of steps computed
+static uint32_t prv_replay_kalg_samples(AccelRawData *data, int num_samples,
+                                        uint16_t *minute_steps, int *num_minutes) {
+  uint32_t total_steps = 0;
+  int minute_idx = 0;
+
+  void *state = kernel_zalloc(kalg_state_size());
+  kalg_init(state, NULL);
+
+  while (num_samples) {
+    const int chunk_size = MIN(num_samples, KALG_SAMPLE_HZ * SECONDS_PER_MINUTE);
+    uint32_t consumed_samples;
+    uint32_t steps = kalg_analyze_samples(state, data, chunk_size, &consumed_samples);
+    if (chunk_size < KALG_SAMPLE_HZ * SECONDS_PER_MINUTE) {
+      steps += kalg_analyze_finish_epoch(state);
+    }
+
+    PBL_ASSERTN(minute_idx < *num_minutes);
+    minute_steps[minute_idx++] = steps;
+    total_steps += steps;
+    num_samples -= chunk_size;
+    data += chunk_size;
+  }
+
+  kernel_free(state);
+  *num_minutes = minute_idx;
+  return total_steps;
+}
+
+
+// ---------------------------------------------------------------------------------------
+// kalg_fft_real() must produce exactly the same coefficients as the original implementation
+void test_kraepelin_algorithm__fft_matches_reference(void) {
+  // Amplitudes from typical epochs up to ones that overflow the int16 butterflies
+  const int k_amplitudes[] = {30, 250, 2000, 16000, 32767};
+  const int k_iterations = 2000;
+  srand(0);
+
+  for (int a = 0; a < ARRAY_LENGTH(k_amplitudes); a++) {
+    const int amplitude = k_amplitudes[a];
+    for (int iter = 0; iter < k_iterations; iter++) {
+      int16_t data[KALG_FFT_WIDTH];
+      int16_t ref_data[KALG_FFT_WIDTH];
+      for (int i = 0; i < KALG_FFT_WIDTH; i++) {
+        data[i] = (rand() % (2 * amplitude + 1)) - amplitude;
+        ref_data[i] = data[i];
+      }
+
+      kalg_fft_real(data);
+      prv_reference_fft(ref_data);
+      cl_assert_equal_m(data, ref_data, sizeof(data));
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------------------------
+// Replay every recorded step sample set through the algorithm, using both the original FFT and
+// kalg_fft_real(), and verify that every minute's step count agrees exactly.
+void test_kraepelin_algorithm__replay_matches_reference(void) {
+  bool success = prv_sample_discovery_init(&s_accel_sample_discovery_state.common,
+                                           SampleFileType_AccelSamples, "activity/step_samples");
+  cl_assert(success);
+
+  uint32_t num_tests = 0;
+  StepFileTestEntry entry;
+  while (prv_accel_sample_discovery_next(&entry)) {
+    int num_minutes = 100;
+    uint16_t ref_minute_steps[num_minutes];
+    uint16_t minute_steps[num_minutes];
+    int ref_num_minutes = num_minutes;
+
+    kalg_set_fft_implementation(prv_reference_fft);
+    const uint32_t ref_steps = prv_replay_kalg_samples(entry.samples, entry.num_samples,
+                                                       ref_minute_steps, &ref_num_minutes);
+    kalg_set_fft_implementation(NULL);
+    const uint32_t steps = prv_replay_kalg_samples(entry.samples, entry.num_samples,
+                                                   minute_steps, &num_minutes);
+
+    cl_assert_equal_i(steps, ref_steps);
+    cl_assert_equal_i(num_minutes, ref_num_minutes);
+    cl_assert_equal_m(minute_steps, ref_minute_steps, num_minutes * sizeof(minute_steps[0]));
+    num_tests++;
+  }
+  cl_assert(num_tests > 0);
+}
+
+
 // ---------------------------------------------------------------------------------------
 static const char *prv_status_str(bool passed) {
     if (!passed) {
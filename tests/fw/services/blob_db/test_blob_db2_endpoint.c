@@ -68,6 +68,7 @@ static bool did_sync_db = false;
 static uint8_t sendbuffer[100];
 static int sendbuffer_length;
 static int sendbuffer_write_index;
+static bool s_send_buffer_full;
 
 extern void blob_db2_protocol_msg_callback(CommSession *session, const uint8_t* data, size_t length);
 
@@ -88,6 +89,19 @@ bool comm_session_send_buffer_write(SendBuffer *sb, const uint8_t *data, size_t
   return true;
 }
 
+uint8_t *comm_session_send_buffer_claim(SendBuffer *sb, size_t length) {
+  if (s_send_buffer_full) {
+    return NULL;
+  }
+  uint8_t *claimed = &sendbuffer[sendbuffer_write_index];
+  sendbuffer_write_index += length;
+  return claimed;
+}
+
+void comm_session_send_buffer_abort_write(SendBuffer *sb) {
+  sendbuffer_length = 0;
+}
+
 void comm_session_send_buffer_end_write(SendBuffer *sb) {
   cl_assert(sendbuffer_length > 0);
   cl_assert_equal_m(sendbuffer, s_expected_msg, sendbuffer_length);
@@ -108,7 +122,7 @@ extern BlobDBToken prv_new_token(void) {
   return token;
 }
 
-void blob_db_sync_next(BlobDBSyncSession *session) {
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token) {
   did_sync_next = true;
 }
 
@@ -134,6 +148,7 @@ void test_blob_db2_endpoint__initialize(void) {
   did_sync_db = false;
   sendbuffer_length = 0;
   sendbuffer_write_index = 0;
+  s_send_buffer_full = false;
   memset(sendbuffer, 0, sizeof(sendbuffer));
 }
 
@@ -300,3 +315,33 @@ void test_blob_db2_endpoint__send_write(void) {
   s_expected_msg = s_write_message;
   blob_db_endpoint_send_write(BlobDBIdiOSNotifPref, last_updated, &key, 1, &val, 1);
 }
+
+static const uint8_t s_writeback_from_db_message[] = {
+  BLOB_DB_COMMAND_WRITEBACK,      // cmd
+  0x22, 0x00,                     // token
+  BlobDBIdiOSNotifPref,           // db id
+  0x01, 0x00, 0x00, 0x00,         // last updated
+  0x01,                           // key_len
+  key,                            // key
+  0x01, 0x00,                     // val_len
+  0x00,                           // val, as read by the stubbed out db
+};
+
+void test_blob_db2_endpoint__send_item(void) {
+  s_expected_msg = s_writeback_from_db_message;
+  BlobDBToken sent_token;
+  cl_assert_equal_i(blob_db_endpoint_send_item(BlobDBIdiOSNotifPref, true /* writeback */,
+                                               last_updated, &key, 1, 1, &sent_token),
+                    S_SUCCESS);
+  cl_assert_equal_i(sent_token, token);
+}
+
+void test_blob_db2_endpoint__send_item_doesnt_fit(void) {
+  s_send_buffer_full = true;
+  BlobDBToken sent_token;
+  cl_assert_equal_i(blob_db_endpoint_send_item(BlobDBIdiOSNotifPref, true /* writeback */,
+                                               last_updated, &key, 1, 1, &sent_token),
+                    E_OUT_OF_RESOURCES);
+  // The message got thrown away
+  cl_assert_equal_i(sendbuffer_length, 0);
+}
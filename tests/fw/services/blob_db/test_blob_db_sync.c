@@ -34,57 +34,98 @@
 #include "services/normal/blob_db/api.h"
 #include "services/normal/blob_db/util.h"
 #include "services/normal/blob_db/sync.h"
+#include "util/math.h"
 #include "util/size.h"
 
+#include <stdio.h>
 
-// Writebacks counter
+
+// Fake phone
 ////////////////////////
 
+//! Responses the phone will send, in the order it sends them
+typedef struct {
+  BlobDBToken token;
+  uint32_t time_us;
+} PhoneResponse;
+
+#define MAX_PHONE_RESPONSES (BLOB_DB_SYNC_MAX_WINDOW_SIZE * 2)
+static PhoneResponse s_phone_responses[MAX_PHONE_RESPONSES];
+static int s_num_phone_responses;
+
+static BlobDBToken s_next_token;
+static int s_num_sent;
 static int s_num_writebacks;
 static int s_num_until_timeout;
+static int s_num_sync_done;
+static int s_max_in_flight;
+
+// Simulated link, each message occupies the link for s_tx_time_us and the response arrives
+// s_rtt_us after the message went out
+static uint32_t s_now_us;
+static uint32_t s_link_free_us;
+static uint32_t s_tx_time_us;
+static uint32_t s_rtt_us;
 
 void blob_db_endpoint_send_sync_done(BlobDBId db_id) {
-  return;
+  s_num_sync_done++;
 }
 
-static void prv_handle_response_from_phone(void *data) {
-  s_num_writebacks++;
-  BlobDBSyncSession *session = data;
-  blob_db_sync_next(session);
+static void prv_handle_response_from_phone(const PhoneResponse *response) {
+  s_now_us = MAX(s_now_us, response->time_us);
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_token(response->token);
+  if (session) {
+    s_num_writebacks++;
+    blob_db_sync_next(session, response->token);
+  }
 }
 
 static void prv_generate_responses_from_phone(void) {
-  while (fake_system_task_count_callbacks()) {
-    fake_system_task_callbacks_invoke_pending();
+  while (s_num_phone_responses || fake_system_task_count_callbacks()) {
+    if (s_num_phone_responses) {
+      const PhoneResponse response = s_phone_responses[0];
+      s_num_phone_responses--;
+      memmove(&s_phone_responses[0], &s_phone_responses[1],
+              s_num_phone_responses * sizeof(PhoneResponse));
+      prv_handle_response_from_phone(&response);
+    } else {
+      fake_system_task_callbacks_invoke_pending();
+    }
   }
 }
 
+status_t blob_db_endpoint_send_item(BlobDBId db_id,
+                                    bool writeback,
+                                    time_t last_updated,
+                                    const void *key,
+                                    int key_len,
+                                    int val_len,
+                                    BlobDBToken *token_out) {
+  uint8_t val[val_len];
+  status_t rv = blob_db_read(db_id, key, key_len, val, val_len);
+  if (FAILED(rv)) {
+    return rv;
+  }
 
-
-BlobDBToken blob_db_endpoint_send_writeback(BlobDBId db_id,
-                                            time_t last_updated,
-                                            const void *key,
-                                            int key_len,
-                                            const void *val,
-                                            int val_len) {
-  BlobDBSyncSession *session = blob_db_sync_get_session_for_id(db_id);
-  cl_assert(session != NULL);
-  if (s_num_until_timeout != 0 && s_num_writebacks >= s_num_until_timeout) {
+  *token_out = s_next_token++;
+  s_num_sent++;
+  if (s_num_until_timeout != 0 && s_num_sent > s_num_until_timeout) {
+    // The phone stops responding
+    BlobDBSyncSession *session = blob_db_sync_get_session_for_id(db_id);
+    cl_assert(session != NULL);
     fake_regular_timer_trigger(&session->timeout_timer);
-  } else {
-    system_task_add_callback(prv_handle_response_from_phone, session);
+    return S_SUCCESS;
   }
 
-  return 12345;
-}
+  s_link_free_us = MAX(s_now_us, s_link_free_us) + s_tx_time_us;
+  cl_assert(s_num_phone_responses < MAX_PHONE_RESPONSES);
+  s_phone_responses[s_num_phone_responses++] = (PhoneResponse) {
+    .token = *token_out,
+    .time_us = s_link_free_us + s_rtt_us,
+  };
+  s_max_in_flight = MAX(s_max_in_flight, s_num_phone_responses);
 
-BlobDBToken blob_db_endpoint_send_write(BlobDBId db_id,
-                                        time_t last_updated,
-                                        const void *key,
-                                        int key_len,
-                                        const void *val,
-                                        int val_len) {
-  return 0;
+  return S_SUCCESS;
 }
 
 // Tests
@@ -93,8 +134,18 @@ BlobDBToken blob_db_endpoint_send_write(BlobDBId db_id,
 void test_blob_db_sync__initialize(void) {
   fake_blob_db_set_id(BlobDBIdTest);
   blob_db_init_dbs();
+  blob_db_sync_set_window_size(BLOB_DB_SYNC_DEFAULT_WINDOW_SIZE);
+  s_num_phone_responses = 0;
+  s_next_token = 1;
+  s_num_sent = 0;
   s_num_until_timeout = 0;
   s_num_writebacks = 0;
+  s_num_sync_done = 0;
+  s_max_in_flight = 0;
+  s_now_us = 0;
+  s_link_free_us = 0;
+  s_tx_time_us = 0;
+  s_rtt_us = 0;
 }
 
 void test_blob_db_sync__cleanup(void) {
@@ -316,22 +367,137 @@ void test_blob_db_sync__find_session(void) {
   cl_assert(reminders_session);
   cl_assert_equal_i(reminders_session->db_id, BlobDBIdReminders);
 
-  test_session->current_token = 1;
-  pins_session->current_token = 2;
-  reminders_session->current_token = 3;
-
-  // check we can conjure them by token
-  cl_assert(test_session == blob_db_sync_get_session_for_token(1));
-  cl_assert(pins_session == blob_db_sync_get_session_for_token(2));
-  cl_assert(reminders_session == blob_db_sync_get_session_for_token(3));
+  // check we can conjure them by the token of any of their writebacks in flight
+  const int window = BLOB_DB_SYNC_DEFAULT_WINDOW_SIZE;
+  cl_assert_equal_i(test_session->num_in_flight, window);
+  cl_assert_equal_i(pins_session->num_in_flight, window);
+  cl_assert_equal_i(reminders_session->num_in_flight, window);
+  for (int i = 0; i < window; i++) {
+    cl_assert(test_session == blob_db_sync_get_session_for_token(1 + i));
+    cl_assert(pins_session == blob_db_sync_get_session_for_token(1 + window + i));
+    cl_assert(reminders_session == blob_db_sync_get_session_for_token(1 + 2 * window + i));
+  }
+  cl_assert(blob_db_sync_get_session_for_token(1 + 3 * window) == NULL);
 
   // Cancel the sync sessions so they get cleaned up
   blob_db_sync_cancel(test_session);
   blob_db_sync_cancel(pins_session);
   blob_db_sync_cancel(reminders_session);
+  s_num_phone_responses = 0;
 
   // reset fake blob db so cleanup doesn't assert
   fake_blob_db_set_id(BlobDBIdTest);
   blob_db_init_dbs();
 }
 
+
+void test_blob_db_sync__window_limits_writebacks_in_flight(void) {
+  char key[8];
+  for (int i = 0; i < 20; ++i) {
+    snprintf(key, sizeof(key), "key%02d", i);
+    blob_db_insert(BlobDBIdTest, (uint8_t *)key, strlen(key), (uint8_t *)"value", 5);
+  }
+
+  for (int window = 1; window <= BLOB_DB_SYNC_MAX_WINDOW_SIZE; window++) {
+    blob_db_sync_set_window_size(window);
+    s_max_in_flight = 0;
+    s_num_writebacks = 0;
+    cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+    BlobDBSyncSession *session = blob_db_sync_get_session_for_id(BlobDBIdTest);
+    cl_assert_equal_i(session->num_in_flight, window);
+    cl_assert_equal_i(session->state, BlobDBSyncSessionStateWaitingForAck);
+
+    prv_generate_responses_from_phone();
+    cl_assert_equal_i(s_num_writebacks, 20);
+    cl_assert_equal_i(s_max_in_flight, window);
+    cl_assert(blob_db_sync_get_session_for_id(BlobDBIdTest) == NULL);
+    cl_assert(blob_db_get_dirty_list(BlobDBIdTest) == NULL);
+
+    // make everything dirty again for the next round
+    for (int i = 0; i < 20; ++i) {
+      snprintf(key, sizeof(key), "key%02d", i);
+      blob_db_insert(BlobDBIdTest, (uint8_t *)key, strlen(key), (uint8_t *)"value", 5);
+    }
+  }
+}
+
+void test_blob_db_sync__out_of_order_responses(void) {
+  char *keys[] = { "key1", "key2", "key3", "key4", "key5" };
+  for (int i = 0; i < ARRAY_LENGTH(keys); ++i) {
+    blob_db_insert(BlobDBIdTest, (uint8_t *)keys[i], 4, (uint8_t *)"val", 3);
+  }
+
+  cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_id(BlobDBIdTest);
+  cl_assert_equal_i(session->num_in_flight, 4);
+
+  // The phone acks the third writeback first, which opens up the window for the fifth one
+  const BlobDBToken third = s_phone_responses[2].token;
+  blob_db_sync_next(session, third);
+  cl_assert(blob_db_sync_get_session_for_token(third) == NULL);
+  cl_assert_equal_i(session->num_in_flight, 4);
+  cl_assert_equal_i(s_num_sent, 5);
+
+  // Unknown tokens are ignored
+  blob_db_sync_next(session, 0xbeef);
+  cl_assert_equal_i(session->num_in_flight, 4);
+
+  prv_generate_responses_from_phone();
+  cl_assert_equal_i(s_num_sync_done, 1);
+  cl_assert(blob_db_get_dirty_list(BlobDBIdTest) == NULL);
+}
+
+void test_blob_db_sync__cancel_keeps_in_flight_items_dirty(void) {
+  char *keys[] = { "key1", "key2", "key3", "key4", "key5" };
+  for (int i = 0; i < ARRAY_LENGTH(keys); ++i) {
+    blob_db_insert(BlobDBIdTest, (uint8_t *)keys[i], 4, (uint8_t *)"val", 3);
+  }
+
+  cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_id(BlobDBIdTest);
+
+  // First writeback is acked, then the phone NACKs the second one
+  blob_db_sync_next(session, s_phone_responses[0].token);
+  blob_db_sync_cancel(session);
+  s_num_phone_responses = 0;
+
+  BlobDBDirtyItem *dirty_list = blob_db_get_dirty_list(BlobDBIdTest);
+  cl_assert_equal_i(list_count(&dirty_list->node), 4);
+  blob_db_util_free_dirty_list(dirty_list);
+}
+
+// Sync a few hundred records over a simulated link with a round trip time of a few connection
+// intervals, and check that each bigger window gets more records per second through
+void test_blob_db_sync__window_throughput(void) {
+  const int k_num_records = 300;
+  s_tx_time_us = 7500;
+  s_rtt_us = 90000;
+
+  char key[8];
+  uint8_t value[64];
+  memset(value, 0x5a, sizeof(value));
+
+  double records_per_second[BLOB_DB_SYNC_MAX_WINDOW_SIZE + 1] = {};
+  for (int window = 1; window <= BLOB_DB_SYNC_MAX_WINDOW_SIZE; window++) {
+    for (int i = 0; i < k_num_records; ++i) {
+      snprintf(key, sizeof(key), "rec%03d", i);
+      blob_db_insert(BlobDBIdTest, (uint8_t *)key, strlen(key), value, sizeof(value));
+    }
+    blob_db_sync_set_window_size(window);
+    s_now_us = 0;
+    s_link_free_us = 0;
+    s_num_writebacks = 0;
+
+    cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+    prv_generate_responses_from_phone();
+    cl_assert_equal_i(s_num_writebacks, k_num_records);
+
+    records_per_second[window] = k_num_records / (s_now_us / 1000000.0);
+    if (window > 1) {
+      cl_assert(records_per_second[window] > records_per_second[window - 1]);
+    }
+  }
+
+  // Stop-and-wait is bound by the round trip, a full window by the link itself
+  cl_assert(records_per_second[BLOB_DB_SYNC_MAX_WINDOW_SIZE] > 5 * records_per_second[1]);
+}
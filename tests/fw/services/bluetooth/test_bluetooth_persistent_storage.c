@@ -1397,3 +1397,108 @@ void test_bluetooth_persistent_storage__v1_bt_classic(void) {
   };
   cl_assert_equal_m(expected_raw_data, v1_data, sizeof(expected_raw_data));
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//! RAM Mirror
+
+static SMPairingInfo prv_pairing_info_for_index(uint8_t index) {
+  return (SMPairingInfo) {
+    .irk = (SMIdentityResolvingKey) {{
+      index, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+      0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, index,
+    }},
+    .identity = (BTDeviceInternal) {
+      .address = (BTDeviceAddress) {{index, 0x12, 0x13, 0x14, 0x15, 0x16}},
+      .is_classic = false,
+      .is_random_address = false,
+    },
+    .is_remote_identity_info_valid = true,
+  };
+}
+
+//! Stores non-gateway BLE pairings until the bonding DB is full, then swaps the last one for a
+//! gateway so lookups that stop at the first ANCS bonding have to walk past all of the others.
+//! @return the number of pairings stored
+static int prv_fill_bonding_db(BTBondingID *gateway_out) {
+  int count = 0;
+  BTBondingID last = BT_BONDING_ID_INVALID;
+  for (; count < BT_BONDING_ID_INVALID; count++) {
+    const SMPairingInfo info = prv_pairing_info_for_index(count);
+    const BTBondingID id = bt_persistent_storage_store_ble_pairing(&info, false /* is_gateway */,
+                                                                   "Device", false, 0);
+    if (id == BT_BONDING_ID_INVALID) {
+      break;
+    }
+    // So the BT driver knows about the bonding when it gets deleted
+    bonding_sync_add_bonding(&(BleBonding) { .pairing_info = info });
+    last = id;
+  }
+  cl_assert(count > 1);
+
+  bt_persistent_storage_delete_ble_pairing_by_id(last);
+  const SMPairingInfo info = prv_pairing_info_for_index(count - 1);
+  *gateway_out = bt_persistent_storage_store_ble_pairing(&info, true /* is_gateway */, "Gateway",
+                                                         false, 0);
+  cl_assert(*gateway_out != BT_BONDING_ID_INVALID);
+  bt_persistent_storage_set_active_gateway(*gateway_out);
+  return count;
+}
+
+void test_bluetooth_persistent_storage__mirror_matches_flash_after_init(void) {
+  BTBondingID gateway;
+  const int count = prv_fill_bonding_db(&gateway);
+
+  // Delete a couple of pairings and rename another, then reload everything from flash
+  const BTBondingID deleted = 3;
+  bt_persistent_storage_delete_ble_pairing_by_id(deleted);
+  bt_persistent_storage_delete_ble_pairing_by_id(deleted + 1);
+  cl_assert(bt_persistent_storage_update_ble_device_name(5, "Renamed"));
+  bt_persistent_storage_set_airplane_mode_enabled(true);
+
+  bt_persistent_storage_init();
+
+  for (int i = 0; i < count; i++) {
+    const SMPairingInfo info = prv_pairing_info_for_index(i);
+    SMIdentityResolvingKey irk_out;
+    char name_out[BT_DEVICE_NAME_BUFFER_SIZE];
+    const bool found = bt_persistent_storage_get_ble_pairing_by_addr(&info.identity, &irk_out,
+                                                                     name_out);
+    cl_assert_equal_b(found, (i != deleted && i != deleted + 1));
+    if (found) {
+      cl_assert_equal_m(&irk_out, &info.irk, sizeof(irk_out));
+      cl_assert_equal_s(name_out, (i == 5) ? "Renamed" : (i == count - 1) ? "Gateway" : "Device");
+    }
+  }
+  cl_assert_equal_i(bt_persistent_storage_get_ble_ancs_bonding(), gateway);
+  BTBondingID active_gateway;
+  cl_assert(bt_persistent_storage_get_active_gateway(&active_gateway, NULL));
+  cl_assert_equal_i(active_gateway, gateway);
+  cl_assert(bt_persistent_storage_get_airplane_mode_enabled());
+
+  // The freed key gets handed out again
+  const SMPairingInfo info = prv_pairing_info_for_index(0xee);
+  cl_assert_equal_i(bt_persistent_storage_store_ble_pairing(&info, false, NULL, false, 0),
+                    deleted);
+}
+
+void test_bluetooth_persistent_storage__repeated_reconnects(void) {
+  BTBondingID gateway;
+  const int count = prv_fill_bonding_db(&gateway);
+  const SMPairingInfo gateway_info = prv_pairing_info_for_index(count - 1);
+
+  // What happens when the gateway reconnects: the connection gets matched against the bondings,
+  // the ANCS / gateway bonding is looked up and the (unchanged) pairing gets stored again.
+  const int num_reconnects = 20;
+  for (int n = 0; n < num_reconnects; n++) {
+    SMIdentityResolvingKey irk_out;
+    char name_out[BT_DEVICE_NAME_BUFFER_SIZE];
+    cl_assert(bt_persistent_storage_get_ble_pairing_by_addr(&gateway_info.identity, &irk_out,
+                                                            name_out));
+    cl_assert_equal_i(bt_persistent_storage_get_ble_ancs_bonding(), gateway);
+    cl_assert(bt_persistent_storage_is_ble_ancs_bonding(gateway));
+    BTBondingID active_gateway;
+    cl_assert(bt_persistent_storage_get_active_gateway(&active_gateway, NULL));
+    cl_assert_equal_i(bt_persistent_storage_store_ble_pairing(&gateway_info, true, "Gateway",
+                                                              false, 0), gateway);
+  }
+}
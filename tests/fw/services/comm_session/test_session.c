@@ -83,6 +83,11 @@ void event_put(PebbleEvent* event) {
 void app_launch_trigger(void) {
 }
 
+static CommSession *s_screenshot_closed_session;
+void screenshot_handle_session_closed(CommSession *session) {
+  s_screenshot_closed_session = session;
+}
+
 void session_remote_version_start_requests(CommSession *session) {
 }
 
@@ -174,6 +179,7 @@ void test_session__initialize(void) {
   s_close_count = 0;
   s_last_closed_transport = NULL;
   s_dls_private_handle_disconnect_called = false;
+  s_screenshot_closed_session = NULL;
   s_comm_session_event_put = false;
   s_bt_driver_comm_is_current_task_send_next_task = false;
 }
@@ -212,6 +218,15 @@ void test_session__basic_open_close(void) {
   cl_assert_equal_b(comm_session_is_valid(session), false);
 }
 
+void test_session__close_forgets_screenshot_delta_base(void) {
+  Transport *transport = (Transport *) TransportID1;
+  CommSession *session = comm_session_open(transport, &s_transport_imp,
+                                           TransportDestinationSystem);
+  cl_assert_equal_p(s_screenshot_closed_session, NULL);
+  comm_session_close(session, CommSessionCloseReason_UnderlyingDisconnection);
+  cl_assert_equal_p(s_screenshot_closed_session, session);
+}
+
 void test_session__get_type_system(void) {
   Transport *transport = (Transport *) TransportID1;
   CommSession *session = comm_session_open(transport, &s_transport_imp,
@@ -67,6 +67,9 @@ size_t comm_session_send_queue_get_length(const CommSession *session) {
 void dls_private_handle_disconnect(void *data) {
 }
 
+void screenshot_handle_session_closed(CommSession *session) {
+}
+
 void session_remote_version_start_requests(CommSession *session) {
 }
 
@@ -375,3 +375,46 @@ void test_session_send_buffer__send_queue_interface(void) {
 
   prv_cleanup_send_buffer(write_sb);
 }
+
+void test_session_send_buffer__claim_and_abort(void) {
+  s_valid_session = &s_session;
+
+  const size_t max_length = comm_session_send_buffer_get_max_payload_length(&s_session);
+  SendBuffer *write_sb = comm_session_send_buffer_begin_write(&s_session, ENDPOINT_ID,
+                                                              max_length /* required_free_length */,
+                                                              TIMEOUT_MS);
+  const uint8_t header_data[] = { 1, 2, 3 };
+  cl_assert_equal_b(comm_session_send_buffer_write(write_sb, header_data, sizeof(header_data)),
+                    true);
+
+  // Claimed space follows what was written before:
+  uint8_t *claimed = comm_session_send_buffer_claim(write_sb, max_length - sizeof(header_data));
+  cl_assert(claimed);
+  memset(claimed, 0xaa, max_length - sizeof(header_data));
+  cl_assert_equal_p(comm_session_send_buffer_claim(write_sb, 1), NULL);
+
+  // Aborting releases the buffer without sending anything and makes the space available again:
+  comm_session_send_buffer_abort_write(write_sb);
+  cl_assert_equal_i(s_send_next_count, 0);
+  cl_assert_equal_i(comm_session_send_queue_get_length(s_valid_session), 0);
+
+  write_sb = comm_session_send_buffer_begin_write(&s_session, ENDPOINT_ID, max_length, 0);
+  cl_assert(write_sb);
+  claimed = comm_session_send_buffer_claim(write_sb, max_length);
+  cl_assert(claimed);
+  memset(claimed, 0x55, max_length);
+  comm_session_send_buffer_end_write(write_sb);
+  cl_assert_equal_i(s_send_next_count, 1);
+
+  const SessionSendQueueJob *job = (const SessionSendQueueJob *)write_sb;
+  uint8_t pp_data_out[sizeof(PebbleProtocolHeader) + max_length];
+  cl_assert_equal_i(s_default_kernel_send_job_impl.copy(job, 0, sizeof(pp_data_out), pp_data_out),
+                    sizeof(pp_data_out));
+  PebbleProtocolHeader *header = (PebbleProtocolHeader *) pp_data_out;
+  cl_assert_equal_i(header->length, htons(max_length));
+  for (int i = 0; i < max_length; ++i) {
+    cl_assert_equal_i(pp_data_out[sizeof(PebbleProtocolHeader) + i], 0x55);
+  }
+
+  prv_cleanup_send_buffer(write_sb);
+}
@@ -76,7 +76,7 @@ bool animation_destroy(Animation *animation) {
 
 static int s_app_window_render_count;
 FrameBuffer* app_state_get_framebuffer(void) {
-  // Not a great proxy for app rendering but good enough. This gets called twice per app render.
+  // Not a great proxy for app rendering but good enough. This gets called once per app render.
   ++s_app_window_render_count;
 
   return compositor_get_framebuffer();
@@ -369,7 +369,7 @@ void test_compositor__app_not_ready_modal_push_pop(void) {
 
   // Now the app has rendered something and we should actually update the display.
   compositor_app_render_ready();
-  cl_assert_equal_i(s_app_window_render_count, 2);
+  cl_assert_equal_i(s_app_window_render_count, 1);
 }
 
 void test_compositor__app_not_ready_cancelled_animation_deferred(void) {
@@ -401,7 +401,7 @@ void test_compositor__app_not_ready_cancelled_animation_deferred(void) {
 
   // Now the app has rendered something and we should actually update the display.
   compositor_app_render_ready();
-  cl_assert_equal_i(s_app_window_render_count, 2);
+  cl_assert_equal_i(s_app_window_render_count, 1);
   cl_assert_equal_i(s_count_animation_destroy, 1);
 }
 
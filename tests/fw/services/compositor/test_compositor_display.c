@@ -0,0 +1,266 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "clar.h"
+
+#include "applib/graphics/framebuffer.h"
+#include "applib/graphics/graphics.h"
+#include "drivers/display/display.h"
+#include "kernel/ui/modals/modal_manager.h"
+#include "services/common/compositor/compositor.h"
+#include "services/common/compositor/compositor_display.h"
+#include "services/common/compositor/default/compositor_port_hole_transitions.h"
+#include "services/common/compositor/default/compositor_round_flip_transitions.h"
+#include "util/trig.h"
+
+#include <string.h>
+
+// Stubs
+////////////////////////////////////
+#include "stubs_app_state.h"
+#include "stubs_applib_resource.h"
+#include "stubs_compiled_with_legacy2_sdk.h"
+#include "stubs_heap.h"
+#include "stubs_logging.h"
+#include "stubs_passert.h"
+#include "stubs_pbl_malloc.h"
+#include "stubs_pebble_tasks.h"
+#include "stubs_resources.h"
+#include "stubs_syscalls.h"
+#include "stubs_unobstructed_area.h"
+
+void screenshot_mark_rows_dirty(int16_t y, int16_t h) {}
+
+ModalProperty modal_manager_get_properties(void) {
+  return ModalProperty_Transparent;
+}
+
+// Fakes
+////////////////////////////////////
+
+static FrameBuffer s_framebuffer;
+static FrameBuffer s_app_framebuffer;
+
+FrameBuffer *compositor_get_framebuffer(void) {
+  return &s_framebuffer;
+}
+
+// The panel keeps every row it gets sent, so it can be compared with the framebuffer
+static uint8_t s_panel[DISP_ROWS][FRAMEBUFFER_BYTES_PER_ROW];
+static int s_rows_flushed;
+
+void display_update(NextRowCallback nrcb, UpdateCompleteCallback uccb) {
+  DisplayRow row;
+  while (nrcb(&row)) {
+    cl_assert(row.address < DISP_ROWS);
+    memcpy(s_panel[row.address], row.data, FRAMEBUFFER_BYTES_PER_ROW);
+    s_rows_flushed++;
+  }
+  uccb();
+}
+
+bool display_update_in_progress(void) {
+  return false;
+}
+
+GBitmap compositor_get_app_framebuffer_as_bitmap(void) {
+  return framebuffer_get_as_bitmap(&s_app_framebuffer, &s_app_framebuffer.size);
+}
+
+GBitmap compositor_get_framebuffer_as_bitmap(void) {
+  return framebuffer_get_as_bitmap(&s_framebuffer, &s_framebuffer.size);
+}
+
+// Helpers
+////////////////////////////////////
+
+//! Flushes the system framebuffer and returns how many rows went out. The rows of the dirty rect
+//! are what got flushed before the framebuffer kept track of individual rows.
+static int prv_flush(void) {
+  const int16_t dirty_rect_rows = s_framebuffer.is_dirty ? s_framebuffer.dirty_rect.size.h : 0;
+  s_rows_flushed = 0;
+  compositor_display_update(NULL);
+
+  for (int y = 0; y < DISP_ROWS; y++) {
+    cl_assert(!memcmp(s_panel[y], framebuffer_get_line(&s_framebuffer, y),
+                      FRAMEBUFFER_BYTES_PER_ROW));
+  }
+  cl_assert(s_rows_flushed <= dirty_rect_rows);
+  return s_rows_flushed;
+}
+
+static GPoint prv_hand_end(GPoint center, int32_t angle, int16_t length) {
+  return GPoint(center.x + (sin_lookup(angle) * length / TRIG_MAX_RATIO),
+                center.y - (cos_lookup(angle) * length / TRIG_MAX_RATIO));
+}
+
+//! Draws a whole analog watchface, the way an app redraws its window every frame
+static void prv_draw_watchface(GContext *ctx, int minute, int second) {
+  const GPoint center = GPoint(DISP_COLS / 2, DISP_ROWS / 2);
+
+  graphics_context_set_fill_color(ctx, GColorBlack);
+  graphics_fill_rect(ctx, &GRect(0, 0, DISP_COLS, DISP_ROWS));
+
+  graphics_context_set_antialiased(ctx, true);
+  graphics_context_set_stroke_color(ctx, GColorWhite);
+  graphics_context_set_stroke_width(ctx, 5);
+  graphics_draw_line(ctx, center, prv_hand_end(center, TRIG_MAX_ANGLE * minute / 60, 60));
+
+  graphics_context_set_stroke_color(ctx, GColorRed);
+  graphics_context_set_stroke_width(ctx, 1);
+  graphics_draw_line(ctx, center, prv_hand_end(center, TRIG_MAX_ANGLE * second / 60, 70));
+
+  graphics_context_set_fill_color(ctx, GColorWhite);
+  graphics_fill_circle(ctx, center, 4);
+}
+
+// Setup
+////////////////////////////////////
+
+static GContext s_ctx;
+
+void test_compositor_display__initialize(void) {
+  const GSize size = GSize(DISP_COLS, DISP_ROWS);
+  framebuffer_init(&s_framebuffer, &size);
+  framebuffer_init(&s_app_framebuffer, &size);
+  graphics_context_init(&s_ctx, &s_framebuffer, GContextInitializationMode_System);
+
+  memset(s_panel, 0, sizeof(s_panel));
+  framebuffer_clear(&s_framebuffer);
+  prv_flush();
+}
+
+// Tests
+////////////////////////////////////
+
+void test_compositor_display__clear_flushes_every_row(void) {
+  framebuffer_clear(&s_framebuffer);
+  cl_assert_equal_i(prv_flush(), DISP_ROWS);
+
+  // Nothing changed since, so nothing gets sent
+  cl_assert_equal_i(prv_flush(), 0);
+}
+
+void test_compositor_display__far_apart_updates(void) {
+  // A status bar at the top and a seconds dot near the bottom of the screen
+  graphics_context_set_fill_color(&s_ctx, GColorBlue);
+  graphics_fill_rect(&s_ctx, &GRect(0, 0, DISP_COLS, 16));
+  graphics_context_set_fill_color(&s_ctx, GColorRed);
+  graphics_fill_circle(&s_ctx, GPoint(DISP_COLS / 2, DISP_ROWS - 20), 4);
+
+  const int16_t dirty_rect_rows = s_framebuffer.dirty_rect.size.h;
+  const int rows = prv_flush();
+  cl_assert(rows >= 16 + 9);
+  cl_assert(rows <= 16 + 9 + 2);
+  cl_assert(rows < dirty_rect_rows / 4);
+}
+
+void test_compositor_display__clock_hand(void) {
+  // A short hand in the top right corner of the screen
+  graphics_context_set_antialiased(&s_ctx, true);
+  graphics_context_set_stroke_color(&s_ctx, GColorBlack);
+  graphics_context_set_stroke_width(&s_ctx, 1);
+  graphics_draw_line(&s_ctx, GPoint(100, 10), GPoint(130, 40));
+
+  const int rows = prv_flush();
+  cl_assert(rows >= 31);
+  cl_assert(rows <= 31 + 2);
+
+  graphics_context_set_stroke_width(&s_ctx, 5);
+  graphics_draw_line(&s_ctx, GPoint(10, 120), GPoint(40, 150));
+  cl_assert(prv_flush() <= 31 + 6);
+}
+
+void test_compositor_display__app_redraws_whole_window(void) {
+  GContext app_ctx;
+  graphics_context_init(&app_ctx, &s_app_framebuffer, GContextInitializationMode_App);
+
+  prv_draw_watchface(&app_ctx, 10, 0);
+  framebuffer_copy_changed_rows(&s_framebuffer, &s_app_framebuffer);
+  cl_assert_equal_i(prv_flush(), DISP_ROWS);
+
+  // The next frame only moves the second hand from 12 to 1 o'clock, but the app repaints
+  // everything so its own dirty rect covers the whole screen
+  framebuffer_reset_dirty(&s_app_framebuffer);
+  prv_draw_watchface(&app_ctx, 10, 5);
+  cl_assert_equal_i(s_app_framebuffer.dirty_rect.size.h, DISP_ROWS);
+
+  framebuffer_copy_changed_rows(&s_framebuffer, &s_app_framebuffer);
+  cl_assert(!memcmp(s_framebuffer.buffer, s_app_framebuffer.buffer, FRAMEBUFFER_SIZE_BYTES));
+  const int rows = prv_flush();
+  // Both the old and the new second hand sit above the center of the screen
+  cl_assert(rows > 0);
+  cl_assert(rows <= DISP_ROWS / 2);
+
+  // Redrawing the same frame doesn't send anything
+  prv_draw_watchface(&app_ctx, 10, 5);
+  framebuffer_copy_changed_rows(&s_framebuffer, &s_app_framebuffer);
+  cl_assert_equal_i(prv_flush(), 0);
+}
+
+void test_compositor_display__round_flip_transition_frame(void) {
+  // The app being transitioned to is a different color on every row
+  GContext app_ctx;
+  graphics_context_init(&app_ctx, &s_app_framebuffer, GContextInitializationMode_App);
+  for (int16_t y = 0; y < DISP_ROWS; y++) {
+    graphics_context_set_fill_color(&app_ctx, (GColor) { .argb = 0xc0 | (y % 64) });
+    graphics_fill_rect(&app_ctx, &GRect(0, y, DISP_COLS, 1));
+  }
+
+  // Early on the lid covers the left of the screen with the app framebuffer, and every row it
+  // copied has to reach the panel
+  const CompositorTransition *transition = compositor_round_flip_transition_get(false);
+  cl_assert(transition);
+  transition->update(&s_ctx, NULL, ANIMATION_NORMALIZED_MAX / 8);
+  cl_assert(prv_flush() > 0);
+  const int16_t center_y = DISP_ROWS / 2;
+  cl_assert(!memcmp(s_panel[center_y], framebuffer_get_line(&s_app_framebuffer, center_y),
+                    DISP_COLS / 4));
+
+  // The next frame grows the lid further across the screen
+  transition->update(&s_ctx, NULL, ANIMATION_NORMALIZED_MAX * 3 / 8);
+  cl_assert(prv_flush() > 0);
+  cl_assert(!memcmp(s_panel[center_y], framebuffer_get_line(&s_app_framebuffer, center_y),
+                    DISP_COLS / 2));
+}
+
+void test_compositor_display__port_hole_transition_last_frames(void) {
+  GContext app_ctx;
+  graphics_context_init(&app_ctx, &s_app_framebuffer, GContextInitializationMode_App);
+  for (int16_t y = 0; y < DISP_ROWS; y++) {
+    graphics_context_set_fill_color(&app_ctx, (GColor) { .argb = 0xc0 | (y % 64) });
+    graphics_fill_rect(&app_ctx, &GRect(0, y, DISP_COLS, 1));
+  }
+
+  // Near the end the app framebuffer is blitted a few pixels short of its final position and the
+  // ring that hides the gap is almost gone, but every row moved still has to reach the panel
+  const CompositorTransition *transition =
+      compositor_port_hole_transition_app_get(CompositorTransitionDirectionUp);
+  cl_assert(transition);
+  transition->init(NULL);
+  transition->update(&s_ctx, NULL, ANIMATION_NORMALIZED_MAX * 15 / 16);
+  cl_assert(prv_flush() > 0);
+
+  // The last frame puts the app where it belongs, which moves every row once more
+  transition->update(&s_ctx, NULL, ANIMATION_NORMALIZED_MAX);
+  prv_flush();
+  const int16_t center_y = DISP_ROWS / 2;
+  const int16_t ring_width = 8;
+  cl_assert(!memcmp(&s_panel[center_y][ring_width],
+                    framebuffer_get_line(&s_app_framebuffer, center_y) + ring_width,
+                    DISP_COLS - (2 * ring_width)));
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "clar.h"
+
+#include "services/common/compositor/screenshot_encoder.h"
+
+#include <string.h>
+
+// Stubs
+///////////////////////////////////////////////////////////
+
+#include "stubs_passert.h"
+
+// Reference decoder
+///////////////////////////////////////////////////////////
+
+#define WIDTH (144)
+#define HEIGHT (168)
+#define MAX_ENCODED_FRAME_SIZE (HEIGHT * SCREENSHOT_ROW_RECORD_MAX_SIZE(WIDTH) + \
+                                SCREENSHOT_ROW_RECORD_HEADER_SIZE)
+
+typedef uint8_t Frame[HEIGHT][WIDTH];
+
+static uint8_t s_encoded[MAX_ENCODED_FRAME_SIZE];
+
+static size_t prv_rle_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_size) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < len) {
+    const uint8_t control = src[in++];
+    if (control & 0x80) {
+      const size_t run = (control & 0x7f) + 3;
+      cl_assert(in < len);
+      cl_assert(out + run <= dst_size);
+      memset(&dst[out], src[in++], run);
+      out += run;
+    } else {
+      const size_t literal_len = control + 1;
+      cl_assert(in + literal_len <= len);
+      cl_assert(out + literal_len <= dst_size);
+      memcpy(&dst[out], &src[in], literal_len);
+      in += literal_len;
+      out += literal_len;
+    }
+  }
+  return out;
+}
+
+//! Applies an encoded frame on top of the previous one, the way a client would
+static void prv_decode_frame(const uint8_t *data, size_t len, Frame frame) {
+  size_t pos = 0;
+  while (true) {
+    cl_assert(pos + SCREENSHOT_ROW_RECORD_HEADER_SIZE <= len);
+    const uint16_t row = (data[pos] << 8) | data[pos + 1];
+    const uint16_t payload_len = (data[pos + 2] << 8) | data[pos + 3];
+    pos += SCREENSHOT_ROW_RECORD_HEADER_SIZE;
+    if (row == SCREENSHOT_END_OF_FRAME_ROW) {
+      cl_assert_equal_i(payload_len, 0);
+      break;
+    }
+    cl_assert(row < HEIGHT);
+    cl_assert(payload_len <= WIDTH);
+    cl_assert(pos + payload_len <= len);
+    if (payload_len == WIDTH) {
+      memcpy(frame[row], &data[pos], WIDTH);
+    } else {
+      cl_assert_equal_i(prv_rle_decode(&data[pos], payload_len, frame[row], WIDTH), WIDTH);
+    }
+    pos += payload_len;
+  }
+  cl_assert_equal_i(pos, len);
+}
+
+//! Encodes the rows that differ from the previous frame, or all of them if there is none
+static size_t prv_encode_frame(const Frame frame, const Frame previous, bool rle) {
+  size_t len = 0;
+  for (int row = 0; row < HEIGHT; row++) {
+    if (previous && memcmp(frame[row], previous[row], WIDTH) == 0) {
+      continue;
+    }
+    len += screenshot_encoder_write_row(row, frame[row], WIDTH, rle, &s_encoded[len]);
+  }
+  len += screenshot_encoder_write_end_of_frame(&s_encoded[len]);
+  cl_assert(len <= sizeof(s_encoded));
+  return len;
+}
+
+// Representative frames, 8 bit colors
+///////////////////////////////////////////////////////////
+
+#define COLOR_BLACK (0xc0)
+#define COLOR_WHITE (0xff)
+#define COLOR_COBALT (0xc6)
+
+static uint32_t s_random_state;
+
+static uint8_t prv_random(void) {
+  s_random_state = s_random_state * 1103515245 + 12345;
+  return s_random_state >> 16;
+}
+
+static void prv_fill_rect(Frame frame, int x, int y, int w, int h, uint8_t color) {
+  for (int row = y; row < y + h; row++) {
+    memset(&frame[row][x], color, w);
+  }
+}
+
+//! Blocky stand-in for a line of text: glyphs of random vertical strokes with gaps between them
+static void prv_draw_text(Frame frame, int x, int y, int num_glyphs, uint8_t color) {
+  for (int glyph = 0; glyph < num_glyphs; glyph++) {
+    const uint8_t strokes = prv_random();
+    for (int col = 0; col < 6; col++) {
+      if (strokes & (1 << col)) {
+        for (int row = y; row < y + 10; row++) {
+          frame[row][x + glyph * 8 + col] = color;
+        }
+      }
+    }
+  }
+}
+
+//! A menu: status bar, a highlighted row and a few rows of text
+static void prv_draw_menu(Frame frame) {
+  s_random_state = 1;
+  memset(frame, COLOR_WHITE, sizeof(Frame));
+  prv_fill_rect(frame, 0, 0, WIDTH, 16, COLOR_BLACK);
+  prv_draw_text(frame, 52, 3, 5, COLOR_WHITE);
+  for (int item = 0; item < 4; item++) {
+    const int y = 16 + item * 38;
+    const bool highlighted = (item == 1);
+    const uint8_t text_color = highlighted ? COLOR_WHITE : COLOR_BLACK;
+    if (highlighted) {
+      prv_fill_rect(frame, 0, y, WIDTH, 38, COLOR_COBALT);
+    }
+    prv_draw_text(frame, 8, y + 6, 12, text_color);
+    prv_draw_text(frame, 8, y + 22, 16, text_color);
+  }
+}
+
+static void prv_draw_gradient(Frame frame) {
+  for (int row = 0; row < HEIGHT; row++) {
+    for (int col = 0; col < WIDTH; col++) {
+      frame[row][col] = 0xc0 | ((col * 4 / WIDTH) << 4) | ((row * 4 / HEIGHT) << 2);
+    }
+  }
+}
+
+static void prv_draw_noise(Frame frame) {
+  s_random_state = 42;
+  for (int row = 0; row < HEIGHT; row++) {
+    for (int col = 0; col < WIDTH; col++) {
+      frame[row][col] = 0xc0 | (prv_random() & 0x3f);
+    }
+  }
+}
+
+static Frame s_frame;
+static Frame s_previous;
+static Frame s_decoded;
+
+static size_t prv_check_roundtrip(const Frame frame, const Frame previous, bool rle) {
+  const size_t len = prv_encode_frame(frame, previous, rle);
+  if (previous) {
+    memcpy(s_decoded, previous, sizeof(Frame));
+  } else {
+    memset(s_decoded, 0, sizeof(Frame));
+  }
+  prv_decode_frame(s_encoded, len, s_decoded);
+  cl_assert(memcmp(s_decoded, frame, sizeof(Frame)) == 0);
+  return len;
+}
+
+// Tests
+///////////////////////////////////////////////////////////
+
+void test_screenshot_encoder__initialize(void) {
+  memset(s_frame, 0, sizeof(s_frame));
+  memset(s_previous, 0, sizeof(s_previous));
+}
+
+void test_screenshot_encoder__rle_runs(void) {
+  uint8_t src[300];
+  uint8_t encoded[sizeof(src) * 2];
+  uint8_t decoded[sizeof(src)];
+
+  // One long run, longer than a single control byte covers
+  memset(src, 0x12, sizeof(src));
+  size_t len = screenshot_rle_encode(src, sizeof(src), encoded, sizeof(encoded));
+  cl_assert_equal_i(len, 6);
+  cl_assert_equal_i(prv_rle_decode(encoded, len, decoded, sizeof(decoded)), sizeof(src));
+  cl_assert(memcmp(src, decoded, sizeof(src)) == 0);
+
+  // Pairs stay in the literals, triples become runs, literals longer than 128 get split
+  for (size_t i = 0; i < sizeof(src); i++) {
+    src[i] = (i < 200) ? i / 2 : ((i < 203) ? 0xaa : i);
+  }
+  len = screenshot_rle_encode(src, sizeof(src), encoded, sizeof(encoded));
+  cl_assert_equal_i(len, (1 + 128) + (1 + 72) + 2 + (1 + 97));
+  cl_assert_equal_i(prv_rle_decode(encoded, len, decoded, sizeof(decoded)), sizeof(src));
+  cl_assert(memcmp(src, decoded, sizeof(src)) == 0);
+
+  // Doesn't write past the end of the output
+  memset(encoded, 0x55, sizeof(encoded));
+  cl_assert_equal_i(screenshot_rle_encode(src, sizeof(src), encoded, 100), 0);
+  for (size_t i = 100; i < sizeof(encoded); i++) {
+    cl_assert_equal_i(encoded[i], 0x55);
+  }
+}
+
+void test_screenshot_encoder__row_falls_back_to_raw(void) {
+  uint8_t row[WIDTH];
+  uint8_t record[SCREENSHOT_ROW_RECORD_MAX_SIZE(WIDTH)];
+  s_random_state = 7;
+  for (size_t i = 0; i < sizeof(row); i++) {
+    row[i] = prv_random();
+  }
+
+  cl_assert_equal_i(screenshot_encoder_write_row(0x102, row, WIDTH, true, record),
+                    sizeof(record));
+  cl_assert_equal_i(record[0], 0x01);
+  cl_assert_equal_i(record[1], 0x02);
+  cl_assert_equal_i((record[2] << 8) | record[3], WIDTH);
+  cl_assert(memcmp(&record[SCREENSHOT_ROW_RECORD_HEADER_SIZE], row, WIDTH) == 0);
+
+  // 139 literals and a run of 5 compress to one byte less than the raw row, which still counts
+  memset(row, COLOR_WHITE, sizeof(row));
+  for (int i = 0; i < 139; i++) {
+    row[i] = i;
+  }
+  cl_assert_equal_i(screenshot_encoder_write_row(0, row, WIDTH, true, record),
+                    SCREENSHOT_ROW_RECORD_HEADER_SIZE + WIDTH - 1);
+  cl_assert_equal_i((record[2] << 8) | record[3], WIDTH - 1);
+
+  // One more literal and the compressed row is as long as the raw one, so it isn't used
+  row[139] = 139;
+  cl_assert_equal_i(screenshot_encoder_write_row(0, row, WIDTH, true, record), sizeof(record));
+  cl_assert_equal_i((record[2] << 8) | record[3], WIDTH);
+  cl_assert(memcmp(&record[SCREENSHOT_ROW_RECORD_HEADER_SIZE], row, WIDTH) == 0);
+}
+
+void test_screenshot_encoder__full_frames(void) {
+  prv_draw_menu(s_frame);
+  const size_t menu_raw = prv_check_roundtrip(s_frame, NULL, false);
+  const size_t menu_rle = prv_check_roundtrip(s_frame, NULL, true);
+  cl_assert(menu_rle * 2 < menu_raw);
+
+  memset(s_frame, COLOR_WHITE, sizeof(s_frame));
+  cl_assert(prv_check_roundtrip(s_frame, NULL, true) < 1500);
+
+  prv_draw_gradient(s_frame);
+  prv_check_roundtrip(s_frame, NULL, true);
+
+  // Nothing to gain, but costs no more than the row records themselves
+  prv_draw_noise(s_frame);
+  const size_t noise_raw = prv_check_roundtrip(s_frame, NULL, false);
+  cl_assert_equal_i(prv_check_roundtrip(s_frame, NULL, true), noise_raw);
+  cl_assert_equal_i(noise_raw, sizeof(Frame) + (HEIGHT + 1) * SCREENSHOT_ROW_RECORD_HEADER_SIZE);
+}
+
+void test_screenshot_encoder__delta_frames(void) {
+  prv_draw_menu(s_previous);
+
+  // Nothing changed
+  memcpy(s_frame, s_previous, sizeof(Frame));
+  cl_assert_equal_i(prv_check_roundtrip(s_frame, s_previous, true),
+                    SCREENSHOT_ROW_RECORD_HEADER_SIZE);
+
+  // The clock in the status bar ticks over
+  s_random_state = 99;
+  prv_fill_rect(s_frame, 52, 3, 40, 10, COLOR_BLACK);
+  prv_draw_text(s_frame, 52, 3, 5, COLOR_WHITE);
+  const size_t clock_len = prv_check_roundtrip(s_frame, s_previous, true);
+  cl_assert(clock_len < 10 * SCREENSHOT_ROW_RECORD_MAX_SIZE(WIDTH) / 2);
+
+  // The highlight moves down one menu row
+  memcpy(s_frame, s_previous, sizeof(Frame));
+  prv_fill_rect(s_frame, 0, 54, WIDTH, 76, COLOR_WHITE);
+  prv_fill_rect(s_frame, 0, 92, WIDTH, 38, COLOR_COBALT);
+  prv_check_roundtrip(s_frame, s_previous, true);
+}
@@ -15,6 +15,7 @@
  */
 
 #include "util/uuid.h"
+#include "kernel/pbl_malloc.h"
 #include "services/common/analytics/analytics.h"
 #include "services/common/analytics/analytics_heartbeat.h"
 #include "services/common/analytics/analytics_storage.h"
@@ -67,13 +68,47 @@ CommSessionTransportType comm_session_analytics_get_transport_type(CommSession *
 void sys_analytics_logging_log_event(AnalyticsEventBlob *event_blob) {
 }
 
+static void prv_free_app_heartbeats(void) {
+  analytics_storage_take_lock();
+  AnalyticsHeartbeatList *app_node = analytics_storage_hijack_app_heartbeats();
+  analytics_storage_give_lock();
+
+  while (app_node) {
+    AnalyticsHeartbeatList *next = (AnalyticsHeartbeatList *)app_node->node.next;
+    kernel_free(app_node->heartbeat);
+    kernel_free(app_node);
+    app_node = next;
+  }
+}
+
+static int64_t prv_get_app_metric(AnalyticsMetric metric, const Uuid *uuid) {
+  analytics_storage_take_lock();
+  AnalyticsHeartbeat *heartbeat = analytics_storage_find(metric, uuid, AnalyticsClient_Ignore);
+  const int64_t value = heartbeat ? analytics_heartbeat_get(heartbeat, metric) : -1;
+  analytics_storage_give_lock();
+  return value;
+}
+
+static int64_t prv_get_device_metric(AnalyticsMetric metric) {
+  analytics_storage_take_lock();
+  AnalyticsHeartbeat *heartbeat = analytics_storage_find(metric, NULL, AnalyticsClient_System);
+  const int64_t value = analytics_heartbeat_get(heartbeat, metric);
+  analytics_storage_give_lock();
+  return value;
+}
+
+static Uuid prv_app_uuid(int i) {
+  return UuidMake(0x10 + i, 0x20, 0x30 * i, 0x40, 0x50, 0x60, 0x70, 0x80,
+                  0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0, 0xF0, 0x01 + (7 * i));
+}
+
 void test_analytics__initialize(void) {
   analytics_init();
   fake_rtc_init(0, 0);
 }
 
 void test_analytics__cleanup(void) {
-
+  prv_free_app_heartbeats();
 }
 
 // Make sure the stopwatches record time elapsed in ms (not ticks)
@@ -131,6 +166,104 @@ DataLoggingResult dls_log(DataLoggingSession *logging_session, const void *data,
   return DATA_LOGGING_SUCCESS;
 }
 
+void test_analytics__app_heartbeats(void) {
+  const AnalyticsMetric metric = ANALYTICS_APP_METRIC_MSG_OUT_COUNT;
+
+  // Room for 8 app heartbeats, UUID_SYSTEM counts as one
+  const Uuid uuid_system = UUID_SYSTEM;
+  analytics_inc_for_uuid(metric, &uuid_system);
+  for (int i = 0; i < 7; i++) {
+    const Uuid uuid = prv_app_uuid(i);
+    for (int j = 0; j <= i; j++) {
+      analytics_inc_for_uuid(metric, &uuid);
+    }
+  }
+  const Uuid one_too_many = prv_app_uuid(7);
+  analytics_inc_for_uuid(metric, &one_too_many);
+
+  cl_assert_equal_i(prv_get_app_metric(metric, &uuid_system), 1);
+  for (int i = 0; i < 7; i++) {
+    const Uuid uuid = prv_app_uuid(i);
+    cl_assert_equal_i(prv_get_app_metric(metric, &uuid), i + 1);
+  }
+  cl_assert_equal_i(prv_get_app_metric(metric, &one_too_many), -1);
+
+  // The foreground app is attributed to its own heartbeat, which there's no room left for
+  analytics_inc(metric, AnalyticsClient_App);
+  const Uuid test_uuid = TEST_UUID;
+  cl_assert_equal_i(prv_get_app_metric(metric, &test_uuid), -1);
+
+  // Collecting the heartbeats starts over with an empty table
+  prv_free_app_heartbeats();
+  analytics_inc(metric, AnalyticsClient_App);
+  analytics_inc(metric, AnalyticsClient_App);
+  analytics_inc_for_uuid(metric, &one_too_many);
+  cl_assert_equal_i(prv_get_app_metric(metric, &test_uuid), 2);
+  cl_assert_equal_i(prv_get_app_metric(metric, &one_too_many), 1);
+  cl_assert_equal_i(prv_get_app_metric(metric, &uuid_system), 0);
+}
+
+ANALYTICS_BATCHED_COUNTER(s_test_counter, ANALYTICS_DEVICE_METRIC_BT_PUBLIC_BYTE_OUT_COUNT);
+
+void test_analytics__batched_counter(void) {
+  const AnalyticsMetric metric = ANALYTICS_DEVICE_METRIC_BT_PUBLIC_BYTE_OUT_COUNT;
+  analytics_add(metric, 5, AnalyticsClient_System);
+
+  for (int i = 0; i < 100; i++) {
+    analytics_batched_inc(&s_test_counter);
+  }
+  analytics_batched_add(&s_test_counter, 1000);
+  cl_assert(s_test_counter.registered);
+
+  // The increments show up when the heartbeat is collected
+  cl_assert_equal_i(prv_get_device_metric(metric), 5);
+  extern void analytics_batched_counters_flush(void);
+  analytics_storage_take_lock();
+  analytics_batched_counters_flush();
+  analytics_storage_give_lock();
+  cl_assert_equal_i(prv_get_device_metric(metric), 1105);
+
+  analytics_storage_take_lock();
+  analytics_batched_counters_flush();
+  analytics_storage_give_lock();
+  cl_assert_equal_i(prv_get_device_metric(metric), 1105);
+}
+
+void test_analytics__many_increments(void) {
+  const int NUM_INCREMENTS = 1000000;
+  const AnalyticsMetric app_metric = ANALYTICS_APP_METRIC_MSG_OUT_COUNT;
+
+  // Fill the heartbeats up with other apps, the foreground app is created last
+  for (int i = 0; i < 7; i++) {
+    const Uuid uuid = prv_app_uuid(i);
+    analytics_inc_for_uuid(app_metric, &uuid);
+  }
+
+  for (int i = 0; i < NUM_INCREMENTS; i++) {
+    analytics_inc(app_metric, AnalyticsClient_App);
+  }
+
+  const Uuid background_uuid = prv_app_uuid(0);
+  for (int i = 0; i < NUM_INCREMENTS; i++) {
+    analytics_inc_for_uuid(app_metric, &background_uuid);
+  }
+
+  const AnalyticsMetric device_metric = ANALYTICS_DEVICE_METRIC_BT_PUBLIC_BYTE_OUT_COUNT;
+  const int64_t device_count = prv_get_device_metric(device_metric);
+  for (int i = 0; i < NUM_INCREMENTS; i++) {
+    analytics_inc(device_metric, AnalyticsClient_System);
+  }
+  cl_assert_equal_i(prv_get_device_metric(device_metric), device_count + NUM_INCREMENTS);
+
+  for (int i = 0; i < NUM_INCREMENTS; i++) {
+    analytics_batched_inc(&s_test_counter);
+  }
+
+  const Uuid test_uuid = TEST_UUID;
+  cl_assert_equal_i(prv_get_app_metric(app_metric, &test_uuid), NUM_INCREMENTS);
+  cl_assert_equal_i(prv_get_app_metric(app_metric, &background_uuid), NUM_INCREMENTS + 1);
+}
+
 DataLoggingSession *dls_create(uint32_t tag, DataLoggingItemType item_type, uint16_t item_size,
                                bool buffered, bool resume, const Uuid *uuid) {
   // We want a truthy value where dereferencing it *should* crash.
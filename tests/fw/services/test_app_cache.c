@@ -36,6 +36,7 @@
 #include "fake_spi_flash.h"
 #include "fake_system_task.h"
 #include "fake_events.h"
+#include "fake_new_timer.h"
 
 // Stubs
 ////////////////////////////////////
@@ -43,7 +44,6 @@
 #include "stubs_hexdump.h"
 #include "stubs_logging.h"
 #include "stubs_mutex.h"
-#include "stubs_pbl_malloc.h"
 #include "stubs_prompt.h"
 #include "stubs_serial.h"
 #include "stubs_sleep.h"
@@ -117,6 +117,7 @@ void test_app_cache__initialize(void) {
 
 void test_app_cache__cleanup(void) {
   fake_system_task_callbacks_cleanup();
+  stub_new_timer_cleanup();
 
   s_test_id_ql_up = 0;
   s_test_id_ql_down = 0;
@@ -289,10 +290,9 @@ void test_app_cache__corrupt_key(void) {
   settings_file_close(&file);
   // End Raw SettingsFile calls
 
-  // force iteration on the app_cache. This will find the corrupted entry, and delete the app cache
-  app_cache_free_up_space(1);
+  // reload the app_cache as on boot. This will find the corrupted entry, and delete the app cache
+  app_cache_init();
 
-  fake_system_task_callbacks_invoke_pending();
   cl_assert_equal_b(false, app_cache_entry_exists(app1.id));
   cl_assert_equal_b(false, app_cache_entry_exists(app2.id));
   cl_assert_equal_b(false, app_cache_entry_exists(app3.id));
@@ -630,3 +630,100 @@ void test_app_cache__purge_orphaned_files_no_apps(void) {
     prv_check_file_exists(descriptions[i].name);
   }
 }
+
+static void prv_sync_launches(void) {
+  const TimerID timer = stub_new_timer_get_next();
+  cl_assert(timer != TIMER_INVALID_ID);
+  cl_assert(stub_new_timer_fire(timer));
+  fake_system_task_callbacks_invoke_pending();
+}
+
+void test_app_cache__launches_synced_later(void) {
+  cl_assert_equal_i(S_SUCCESS, app_cache_add_entry(app1.id, app1.size));
+  cl_assert_equal_i(S_SUCCESS, app_cache_add_entry(app2.id, app2.size));
+  cl_assert_equal_i(S_SUCCESS, app_cache_add_entry(app3.id, app3.size));
+  fake_system_task_callbacks_invoke_pending();
+
+  rtc_set_time(rtc_get_time() + 2);
+
+  // launches don't touch flash until the sync timer fires
+  const uint32_t write_bytes = fake_flash_write_bytes_count();
+  for (int i = 0; i < 10; i++) {
+    cl_assert_equal_i(S_SUCCESS, app_cache_app_launched(app1.id));
+    cl_assert_equal_i(S_SUCCESS, app_cache_app_launched(app3.id));
+  }
+  cl_assert_equal_i(fake_flash_write_bytes_count(), write_bytes);
+  cl_assert_equal_i(app2.id, app_cache_get_next_eviction());
+
+  prv_sync_launches();
+  cl_assert(fake_flash_write_bytes_count() > write_bytes);
+
+  // the launch times made it to flash, so the eviction order survives a reboot
+  app_cache_init();
+  cl_assert_equal_i(app2.id, app_cache_get_next_eviction());
+
+  SettingsFile file;
+  cl_assert_equal_i(S_SUCCESS, settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE));
+  AppCacheEntry entry;
+  cl_assert_equal_i(S_SUCCESS, settings_file_get(&file, (uint8_t *)&app1.id, sizeof(AppInstallId),
+                                                 (uint8_t *)&entry, sizeof(AppCacheEntry)));
+  settings_file_close(&file);
+  cl_assert_equal_i(entry.launch_count, 10);
+  cl_assert_equal_i(entry.last_launch, rtc_get_time());
+}
+
+void test_app_cache__launch_removed_app(void) {
+  cl_assert_equal_i(S_SUCCESS, app_cache_add_entry(app1.id, app1.size));
+  cl_assert_equal_i(S_SUCCESS, app_cache_app_launched(app1.id));
+  cl_assert_equal_i(S_SUCCESS, app_cache_remove_entry(app1.id));
+
+  cl_assert(app_cache_app_launched(app1.id) != S_SUCCESS);
+  cl_assert_equal_b(false, app_cache_entry_exists(app1.id));
+
+  // syncing the launch of an app that is gone doesn't bring it back
+  prv_sync_launches();
+  app_cache_init();
+  cl_assert_equal_b(false, app_cache_entry_exists(app1.id));
+  cl_assert_equal_i(INSTALL_ID_INVALID, app_cache_get_next_eviction());
+}
+
+void test_app_cache__many_apps(void) {
+  const int k_num_apps = 100;
+  const int k_num_rounds = 10;
+  const uint32_t k_app_size = 10000;
+
+  for (int i = 1; i <= k_num_apps; i++) {
+    cl_assert_equal_i(S_SUCCESS, app_cache_add_entry(i, k_app_size));
+  }
+  fake_system_task_callbacks_invoke_pending();
+
+  // launch every app a few times, app 1 first in each round
+  const uint32_t write_bytes = fake_flash_write_bytes_count();
+  for (int round = 0; round < k_num_rounds; round++) {
+    for (int i = 1; i <= k_num_apps; i++) {
+      rtc_set_time(rtc_get_time() + 1);
+      cl_assert_equal_i(S_SUCCESS, app_cache_app_launched(i));
+    }
+  }
+  const uint32_t launch_write_bytes = fake_flash_write_bytes_count() - write_bytes;
+
+  prv_sync_launches();
+  const uint32_t sync_write_bytes = fake_flash_write_bytes_count() - write_bytes;
+
+  for (int i = 0; i < k_num_apps; i++) {
+    cl_assert_equal_i(1, app_cache_get_next_eviction());
+  }
+
+  cl_assert_equal_i(S_SUCCESS, app_cache_free_up_space((3 * k_app_size) - 1));
+
+  cl_assert_equal_i(launch_write_bytes, 0);
+  // one record per app, not one per launch
+  cl_assert(sync_write_bytes < (k_num_apps * 2 * (sizeof(AppInstallId) + sizeof(AppCacheEntry) +
+                                                  sizeof(SettingsRecordHeader))));
+
+  // the three least recently launched apps are gone
+  for (int i = 1; i <= k_num_apps; i++) {
+    cl_assert_equal_b(i > 3, app_cache_entry_exists(i));
+  }
+  cl_assert_equal_i(4, app_cache_get_next_eviction());
+}
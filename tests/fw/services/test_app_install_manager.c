@@ -52,6 +52,7 @@
 #include "stubs_logging.h"
 #include "stubs_memory_layout.h"
 #include "stubs_mutex.h"
+#include "stubs_new_timer.h"
 #include "stubs_passert.h"
 #include "stubs_pbl_malloc.h"
 #include "stubs_pebble_tasks.h"
@@ -132,6 +133,11 @@ bool system_task_add_callback(void (*cb)(void*), void *data) {
   return true;
 }
 
+bool system_task_add_callback_coalesced(void (*cb)(void*), void *data) {
+  cb(data);
+  return true;
+}
+
 #define APP_REGISTRY_FIXTURE_PATH "app_registry"
 
 #define APP1_APP_FIXTURE_NAME "feature-background-counter-app"
@@ -66,6 +66,7 @@
 #include "stubs_memory_layout.h"
 #include "stubs_menu_layer.h"
 #include "stubs_mutex.h"
+#include "stubs_new_timer.h"
 #include "stubs_passert.h"
 #include "stubs_pbl_malloc.h"
 #include "stubs_pebble_tasks.h"
@@ -0,0 +1,327 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clar.h"
+
+#include "applib/event_service_client.h"
+#include "kernel/events.h"
+#include "services/common/event_service.h"
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#include <string.h>
+
+#include "fake_pebble_tasks.h"
+
+#include "stubs_analytics.h"
+#include "stubs_app_manager.h"
+#include "stubs_freertos.h"
+#include "stubs_logging.h"
+#include "stubs_mutex.h"
+#include "stubs_passert.h"
+#include "stubs_pbl_malloc.h"
+#include "stubs_process_manager.h"
+#include "stubs_syscall_internal.h"
+
+// Fakes
+///////////////////////////////////////////////////////////
+
+void **event_get_buffer(PebbleEvent *event) {
+  return NULL;
+}
+
+void event_deinit(PebbleEvent *event) {
+}
+
+static EventServiceInfo s_app_event_service_state;
+static EventServiceInfo s_kernel_event_service_state;
+
+EventServiceInfo *app_state_get_event_service_state(void) {
+  return &s_app_event_service_state;
+}
+
+EventServiceInfo *worker_state_get_event_service_state(void) {
+  return NULL;
+}
+
+EventServiceInfo *kernel_applib_get_event_service_state(void) {
+  return &s_kernel_event_service_state;
+}
+
+// The app's event queue, nothing drains it until the test says so
+
+#define APP_QUEUE_LENGTH (8)
+
+typedef struct {
+  unsigned int head;
+  unsigned int count;
+  PebbleEvent items[APP_QUEUE_LENGTH];
+} FakeQueue;
+
+static FakeQueue s_app_queue;
+
+signed portBASE_TYPE xQueueGenericSend(QueueHandle_t queue, const void * const item,
+                                       TickType_t ticks_to_wait, portBASE_TYPE copy_position) {
+  FakeQueue *q = (FakeQueue *)queue;
+  if (q->count == APP_QUEUE_LENGTH) {
+    return pdFALSE;
+  }
+  q->items[(q->head + q->count++) % APP_QUEUE_LENGTH] = *(const PebbleEvent *)item;
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t queue) {
+  return ((FakeQueue *)queue)->count;
+}
+
+static bool prv_app_queue_receive(PebbleEvent *e) {
+  if (s_app_queue.count == 0) {
+    return false;
+  }
+  *e = s_app_queue.items[s_app_queue.head];
+  s_app_queue.head = (s_app_queue.head + 1) % APP_QUEUE_LENGTH;
+  s_app_queue.count--;
+  return true;
+}
+
+void sys_event_service_client_subscribe(EventServiceInfo *handler) {
+  PebbleSubscriptionEvent subscription = {
+    .subscribe = true,
+    .task = pebble_task_get_current(),
+    .event_type = handler->type,
+    .event_queue = (QueueHandle_t)&s_app_queue,
+  };
+  event_service_handle_subscription(&subscription);
+}
+
+void sys_event_service_client_unsubscribe(EventServiceInfo *state, EventServiceInfo *handler) {
+  list_remove(&handler->list_node, NULL, NULL);
+  PebbleSubscriptionEvent subscription = {
+    .subscribe = false,
+    .task = pebble_task_get_current(),
+    .event_type = handler->type,
+  };
+  event_service_handle_subscription(&subscription);
+}
+
+// Subscriber
+///////////////////////////////////////////////////////////
+
+#define MAX_RECEIVED (64)
+
+static PebbleEvent s_received[MAX_RECEIVED];
+static int s_num_received;
+
+static void prv_handler(PebbleEvent *e, void *context) {
+  cl_assert(s_num_received < MAX_RECEIVED);
+  s_received[s_num_received++] = *e;
+}
+
+static EventServiceInfo s_battery_info = {
+  .type = PEBBLE_BATTERY_STATE_CHANGE_EVENT,
+  .handler = prv_handler,
+};
+
+static EventServiceInfo s_button_info = {
+  .type = PEBBLE_BUTTON_DOWN_EVENT,
+  .handler = prv_handler,
+};
+
+static EventServiceInfo s_capabilities_info = {
+  .type = PEBBLE_CAPABILITIES_CHANGED_EVENT,
+  .handler = prv_handler,
+};
+
+//! Runs the app's event loop until its queue is empty
+static void prv_app_drain_queue(void) {
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  PebbleEvent e;
+  while (prv_app_queue_receive(&e)) {
+    event_service_client_handle_event(&e);
+  }
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+}
+
+static void prv_put_battery_event(uint8_t percent) {
+  PebbleEvent e = {
+    .type = PEBBLE_BATTERY_STATE_CHANGE_EVENT,
+    .battery_state.new_state.charge_percent = percent,
+  };
+  event_service_handle_event(&e);
+}
+
+static void prv_put_button_event(ButtonId button) {
+  PebbleEvent e = {
+    .type = PEBBLE_BUTTON_DOWN_EVENT,
+    .button.button_id = button,
+  };
+  event_service_handle_event(&e);
+}
+
+static void prv_put_capabilities_event(uint64_t flags_diff) {
+  PebbleEvent e = {
+    .type = PEBBLE_CAPABILITIES_CHANGED_EVENT,
+    .capabilities.flags_diff.flags = flags_diff,
+  };
+  event_service_handle_event(&e);
+}
+
+// Tests
+///////////////////////////////////////////////////////////
+
+void test_event_service__initialize(void) {
+  memset(&s_app_queue, 0, sizeof(s_app_queue));
+  s_app_event_service_state = (EventServiceInfo) {};
+  s_kernel_event_service_state = (EventServiceInfo) {};
+  s_num_received = 0;
+
+  analytics_external_collect_event_service_stats();
+  for (PebbleEventType type = 0; type < PEBBLE_NUM_EVENTS; type++) {
+    event_service_init(type, NULL, NULL);
+  }
+
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  event_service_client_subscribe(&s_battery_info);
+  event_service_client_subscribe(&s_button_info);
+  event_service_client_subscribe(&s_capabilities_info);
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+}
+
+void test_event_service__cleanup(void) {
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+  event_service_clear_process_subscriptions(PebbleTask_App);
+}
+
+void test_event_service__flood_slow_subscriber(void) {
+  // Far more state changes than the app's queue can hold, mixed with events that can't be
+  // coalesced. Nothing gets dropped and the app doesn't get killed for falling behind.
+  for (int i = 0; i < 1000; i++) {
+    prv_put_battery_event(i % 101);
+    if (i % 200 == 0) {
+      prv_put_button_event(BUTTON_ID_UP + (i / 200));
+    }
+  }
+  cl_assert_equal_i(s_app_queue.count, 6);
+  cl_assert_equal_i(event_service_get_queue_high_water_mark(PebbleTask_App), 6);
+
+  prv_app_drain_queue();
+
+  // The battery event keeps its place in the queue but carries the latest state
+  cl_assert_equal_i(s_num_received, 6);
+  cl_assert_equal_i(s_received[0].type, PEBBLE_BATTERY_STATE_CHANGE_EVENT);
+  cl_assert_equal_i(s_received[0].battery_state.new_state.charge_percent, 999 % 101);
+  for (int i = 1; i < 6; i++) {
+    cl_assert_equal_i(s_received[i].type, PEBBLE_BUTTON_DOWN_EVENT);
+    cl_assert_equal_i(s_received[i].button.button_id, BUTTON_ID_UP + (i - 1));
+  }
+}
+
+void test_event_service__new_event_after_delivery(void) {
+  prv_put_battery_event(10);
+  prv_put_battery_event(20);
+  prv_app_drain_queue();
+
+  prv_put_battery_event(30);
+  cl_assert_equal_i(s_app_queue.count, 1);
+  prv_app_drain_queue();
+
+  cl_assert_equal_i(s_num_received, 2);
+  cl_assert_equal_i(s_received[0].battery_state.new_state.charge_percent, 20);
+  cl_assert_equal_i(s_received[1].battery_state.new_state.charge_percent, 30);
+}
+
+void test_event_service__coalesce_after_dequeue(void) {
+  prv_put_battery_event(10);
+
+  // The app takes the event off its queue, then gets preempted before handling it
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  PebbleEvent e;
+  cl_assert(prv_app_queue_receive(&e));
+
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+  prv_put_battery_event(20);
+  cl_assert_equal_i(s_app_queue.count, 0);
+
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  event_service_client_handle_event(&e);
+  prv_app_drain_queue();
+
+  cl_assert_equal_i(s_num_received, 1);
+  cl_assert_equal_i(s_received[0].battery_state.new_state.charge_percent, 20);
+}
+
+void test_event_service__counter_merge(void) {
+  prv_put_capabilities_event(0x1);
+  prv_put_capabilities_event(0x4);
+  prv_put_capabilities_event(0x1 | 0x10);
+  cl_assert_equal_i(s_app_queue.count, 1);
+  prv_app_drain_queue();
+
+  cl_assert_equal_i(s_num_received, 1);
+  cl_assert(s_received[0].capabilities.flags_diff.flags == (0x1 | 0x4 | 0x10));
+}
+
+void test_event_service__resubscribe_with_pending_event(void) {
+  prv_put_battery_event(10);
+
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  event_service_client_unsubscribe(&s_battery_info);
+  event_service_client_subscribe(&s_battery_info);
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+
+  // The event is still in the queue, so the new one gets folded into it
+  prv_put_battery_event(20);
+  cl_assert_equal_i(s_app_queue.count, 1);
+  prv_app_drain_queue();
+
+  cl_assert_equal_i(s_num_received, 1);
+  cl_assert_equal_i(s_received[0].battery_state.new_state.charge_percent, 20);
+}
+
+void test_event_service__process_exit_drops_pending(void) {
+  prv_put_battery_event(10);
+
+  // The app exits without draining its queue, which gets thrown away
+  event_service_clear_process_subscriptions(PebbleTask_App);
+  memset(&s_app_queue, 0, sizeof(s_app_queue));
+  s_app_event_service_state = (EventServiceInfo) {};
+
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  event_service_client_subscribe(&s_battery_info);
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+
+  prv_put_battery_event(20);
+  cl_assert_equal_i(s_app_queue.count, 1);
+  prv_app_drain_queue();
+
+  cl_assert_equal_i(s_num_received, 1);
+  cl_assert_equal_i(s_received[0].battery_state.new_state.charge_percent, 20);
+}
+
+void test_event_service__high_water_mark(void) {
+  for (int i = 0; i < 4; i++) {
+    prv_put_button_event(BUTTON_ID_BACK);
+  }
+  prv_app_drain_queue();
+  prv_put_button_event(BUTTON_ID_BACK);
+  cl_assert_equal_i(event_service_get_queue_high_water_mark(PebbleTask_App), 4);
+  cl_assert_equal_i(event_service_get_queue_high_water_mark(PebbleTask_Worker), 0);
+
+  // Collecting the analytics starts a new measurement window
+  analytics_external_collect_event_service_stats();
+  cl_assert_equal_i(event_service_get_queue_high_water_mark(PebbleTask_App), 0);
+}
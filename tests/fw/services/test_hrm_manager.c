@@ -745,3 +745,245 @@ void test_hrm_manager__can_turn_sensor_on(void) {
   cl_assert(hrm_is_enabled(HRM));
 }
 
+
+// -----------------------------------------------------------------------------
+// Batched delivery
+// -----------------------------------------------------------------------------
+
+typedef struct {
+  int num_callbacks;
+  int num_events;
+  int num_bpm_events;
+  int num_led_events;
+  int num_expiring_events;
+} StreamCounts;
+
+static void prv_count_event(StreamCounts *counts, const PebbleHRMEvent *event) {
+  counts->num_events++;
+  switch (event->event_type) {
+    case HRMEvent_BPM:
+      cl_assert_equal_i(event->bpm.bpm, s_hrm_event_data.hrm_bpm);
+      counts->num_bpm_events++;
+      break;
+    case HRMEvent_LEDCurrent:
+      cl_assert_equal_i(event->led.current_ua, s_hrm_event_data.led_current_ua);
+      counts->num_led_events++;
+      break;
+    case HRMEvent_SubscriptionExpiring:
+      counts->num_expiring_events++;
+      break;
+    default:
+      cl_fail("Unexpected event type");
+  }
+}
+
+static void prv_counting_cb(PebbleHRMEvent *event, void *context) {
+  StreamCounts *counts = context;
+  counts->num_callbacks++;
+  prv_count_event(counts, event);
+}
+
+static void prv_counting_batch_cb(const PebbleHRMEvent *events, uint32_t num_events,
+                                  void *context) {
+  StreamCounts *counts = context;
+  counts->num_callbacks++;
+  cl_assert(num_events > 0);
+  for (uint32_t i = 0; i < num_events; i++) {
+    prv_count_event(counts, &events[i]);
+  }
+}
+
+//! Feeds a reading every second, running KernelBG after each one like it would on the watch
+//! @return how many times KernelBG got woken up
+static int prv_feed_stream(int seconds) {
+  int num_wakeups = 0;
+  for (int i = 0; i < seconds; i++) {
+    fake_rtc_increment_ticks(RTC_TICKS_HZ);
+    fake_rtc_increment_time(1);
+    prv_fake_send_new_data();
+    num_wakeups += fake_system_task_count_callbacks();
+    fake_system_task_callbacks_invoke_pending();
+  }
+  return num_wakeups;
+}
+
+typedef struct {
+  uint32_t update_interval_s;
+  HRMFeature features;
+} StreamSubscriber;
+
+static const StreamSubscriber s_stream_subscribers[] = {
+  { 10, HRMFeature_BPM },
+  { 10, HRMFeature_BPM },
+  { 5, HRMFeature_BPM | HRMFeature_LEDCurrent },
+};
+
+void test_hrm_manager__batched_stream(void) {
+  stub_pebble_tasks_set_current(PebbleTask_KernelBackground);
+  const int stream_s = 60;
+
+  // Every reading goes out one by one
+  StreamCounts single[ARRAY_LENGTH(s_stream_subscribers)] = {};
+  HRMSessionRef sessions[ARRAY_LENGTH(s_stream_subscribers)];
+  for (size_t i = 0; i < ARRAY_LENGTH(s_stream_subscribers); i++) {
+    sessions[i] = hrm_manager_subscribe_with_callback(
+        INSTALL_ID_INVALID, s_stream_subscribers[i].update_interval_s, 0 /* expire_s */,
+        s_stream_subscribers[i].features, prv_counting_cb, &single[i]);
+  }
+  fake_system_task_callbacks_invoke_pending();
+  const int single_wakeups = prv_feed_stream(stream_s);
+  for (size_t i = 0; i < ARRAY_LENGTH(s_stream_subscribers); i++) {
+    sys_hrm_manager_unsubscribe(sessions[i]);
+  }
+
+  // The same subscribers, batched
+  StreamCounts batched[ARRAY_LENGTH(s_stream_subscribers)] = {};
+  for (size_t i = 0; i < ARRAY_LENGTH(s_stream_subscribers); i++) {
+    sessions[i] = hrm_manager_subscribe_batched(
+        INSTALL_ID_INVALID, s_stream_subscribers[i].update_interval_s, 0 /* expire_s */,
+        s_stream_subscribers[i].features, prv_counting_batch_cb, &batched[i]);
+  }
+  fake_system_task_callbacks_invoke_pending();
+  const int batched_wakeups = prv_feed_stream(stream_s);
+  for (size_t i = 0; i < ARRAY_LENGTH(s_stream_subscribers); i++) {
+    sys_hrm_manager_unsubscribe(sessions[i]);
+  }
+
+  int single_callbacks = 0;
+  int batched_callbacks = 0;
+  for (size_t i = 0; i < ARRAY_LENGTH(s_stream_subscribers); i++) {
+    // Batching doesn't lose or duplicate anything...
+    cl_assert_equal_i(batched[i].num_bpm_events, stream_s);
+    cl_assert_equal_i(batched[i].num_bpm_events, single[i].num_bpm_events);
+    cl_assert_equal_i(batched[i].num_led_events, single[i].num_led_events);
+    // ...but only calls the subscriber once per update interval
+    cl_assert_equal_i(batched[i].num_callbacks,
+                      stream_s / s_stream_subscribers[i].update_interval_s);
+    single_callbacks += single[i].num_callbacks;
+    batched_callbacks += batched[i].num_callbacks;
+  }
+  cl_assert_equal_i(single_callbacks, 240);
+  cl_assert_equal_i(batched_callbacks, 24);
+
+  // One KernelBG wakeup per reading and feature vs. one per interval, shared by all of the
+  // subscribers that are due. Both include the periodic sensor enable check.
+  const int enable_checks = stream_s / HRM_CHECK_SENSOR_DISABLE_COUNT;
+  cl_assert_equal_i(single_wakeups, 2 * stream_s + enable_checks);
+  cl_assert_equal_i(batched_wakeups, (stream_s / 5) + enable_checks);
+}
+
+void test_hrm_manager__batched_expiring(void) {
+  stub_pebble_tasks_set_current(PebbleTask_KernelBackground);
+  StreamCounts counts = {};
+  const uint16_t expire_s = 30;
+  HRMSessionRef session_ref = hrm_manager_subscribe_batched(INSTALL_ID_INVALID, 10, expire_s,
+                                                            HRMFeature_BPM,
+                                                            prv_counting_batch_cb, &counts);
+  fake_system_task_callbacks_invoke_pending();
+
+  // The expiring event is due 10 s (one update interval) before the expiration and doesn't wait
+  // for the rest of the batch
+  prv_feed_stream(20);
+  cl_assert_equal_i(counts.num_callbacks, 2);
+  cl_assert_equal_i(counts.num_expiring_events, 1);
+  cl_assert_equal_i(counts.num_bpm_events, 20);
+
+  // After the expiration the subscription is gone
+  prv_feed_stream(10);
+  cl_assert(prv_get_subscriber_state_from_ref(session_ref) == NULL);
+  cl_assert_equal_i(counts.num_expiring_events, 1);
+}
+
+void test_hrm_manager__batched_set_update_interval(void) {
+  stub_pebble_tasks_set_current(PebbleTask_KernelBackground);
+  StreamCounts counts = {};
+  HRMSessionRef session_ref = hrm_manager_subscribe_batched(INSTALL_ID_INVALID, 10, 0,
+                                                            HRMFeature_BPM,
+                                                            prv_counting_batch_cb, &counts);
+  fake_system_task_callbacks_invoke_pending();
+  prv_feed_stream(4);
+  cl_assert_equal_i(counts.num_callbacks, 0);
+
+  // Shortening the interval keeps what has been accumulated so far
+  cl_assert(sys_hrm_manager_set_update_interval(session_ref, 2, 0));
+  prv_feed_stream(1);
+  cl_assert_equal_i(counts.num_callbacks, 1);
+  cl_assert_equal_i(counts.num_bpm_events, 3);
+
+  // Diagnostics can't be batched
+  cl_assert(!sys_hrm_manager_set_features(session_ref, HRMFeature_Diagnostics));
+  cl_assert(sys_hrm_manager_set_features(session_ref, HRMFeature_BPM | HRMFeature_LEDCurrent));
+  prv_feed_stream(2);
+  cl_assert_equal_i(counts.num_callbacks, 2);
+  cl_assert_equal_i(counts.num_bpm_events, 5);
+  cl_assert_equal_i(counts.num_led_events, 2);
+
+  sys_hrm_manager_unsubscribe(session_ref);
+}
+
+typedef struct {
+  StreamCounts counts;
+  HRMSessionRef session_ref;
+} RenewingSubscriber;
+
+static void prv_renewing_batch_cb(const PebbleHRMEvent *events, uint32_t num_events,
+                                  void *context) {
+  RenewingSubscriber *subscriber = context;
+  // Renewing with a shorter interval resizes the batch buffer, which must not pull the events
+  // out from under the callback
+  for (uint32_t i = 0; i < num_events; i++) {
+    if (events[i].event_type == HRMEvent_SubscriptionExpiring) {
+      cl_assert(sys_hrm_manager_set_update_interval(subscriber->session_ref, 2, 30));
+    }
+  }
+  prv_counting_batch_cb(events, num_events, &subscriber->counts);
+}
+
+void test_hrm_manager__batched_renew_from_callback(void) {
+  stub_pebble_tasks_set_current(PebbleTask_KernelBackground);
+  RenewingSubscriber subscriber = {};
+  subscriber.session_ref = hrm_manager_subscribe_batched(INSTALL_ID_INVALID, 10, 30,
+                                                         HRMFeature_BPM, prv_renewing_batch_cb,
+                                                         &subscriber);
+  fake_system_task_callbacks_invoke_pending();
+
+  // The expiring event comes with the second batch, which gets delivered in full
+  prv_feed_stream(20);
+  cl_assert_equal_i(subscriber.counts.num_callbacks, 2);
+  cl_assert_equal_i(subscriber.counts.num_expiring_events, 1);
+  cl_assert_equal_i(subscriber.counts.num_bpm_events, 20);
+
+  // After that the batches follow the new interval
+  prv_feed_stream(4);
+  cl_assert_equal_i(subscriber.counts.num_callbacks, 4);
+  cl_assert_equal_i(subscriber.counts.num_bpm_events, 24);
+
+  sys_hrm_manager_unsubscribe(subscriber.session_ref);
+}
+
+void test_hrm_manager__session_table(void) {
+  stub_pebble_tasks_set_current(PebbleTask_KernelBackground);
+  // More subscribers than there are buckets in the table
+  const int num_subscribers = 3 * HRM_MANAGER_SESSION_TABLE_SIZE + 1;
+  HRMSessionRef sessions[num_subscribers];
+  for (int i = 0; i < num_subscribers; i++) {
+    sessions[i] = hrm_manager_subscribe_with_callback(INSTALL_ID_INVALID, 1, 0, HRMFeature_BPM,
+                                                      prv_fake_hrm_1_cb, (void *)(uintptr_t)i);
+  }
+  for (int i = 0; i < num_subscribers; i++) {
+    HRMSubscriberState *state = prv_get_subscriber_state_from_ref(sessions[i]);
+    cl_assert(state);
+    cl_assert_equal_i(state->session_ref, sessions[i]);
+    cl_assert_equal_p(state->callback_context, (void *)(uintptr_t)i);
+  }
+
+  for (int i = 0; i < num_subscribers; i += 2) {
+    cl_assert(sys_hrm_manager_unsubscribe(sessions[i]));
+  }
+  for (int i = 0; i < num_subscribers; i++) {
+    HRMSubscriberState *state = prv_get_subscriber_state_from_ref(sessions[i]);
+    cl_assert_equal_b(state != NULL, (i % 2) == 1);
+    cl_assert_equal_b(sys_hrm_manager_unsubscribe(sessions[i]), (i % 2) == 1);
+  }
+  cl_assert(prv_get_subscriber_state_from_ref(HRM_INVALID_SESSION_REF) == NULL);
+}
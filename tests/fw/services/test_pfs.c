@@ -999,3 +999,152 @@ void test_pfs__doesnt_give_out_fd_zero(void) {
     cl_assert(fd > 0);
   }
 }
+
+extern uint32_t test_get_sector_erase_count(uint16_t region);
+extern uint32_t test_read_sector_erase_count(uint16_t region);
+extern uint16_t test_get_erased_page_count(void);
+
+static int prv_num_erase_regions(void) {
+  return ftl_get_size() / SECTOR_SIZE_BYTES;
+}
+
+void test_pfs__erase_counts_persist(void) {
+  for (int region = 0; region < prv_num_erase_regions(); region++) {
+    cl_assert_equal_i(test_get_sector_erase_count(region), 1);
+  }
+
+  // dirty up the first sector and then garbage collect it a few times
+  const int pages_per_sector = SECTOR_SIZE_BYTES / PFS_SECTOR_SIZE;
+  const uint16_t region = 0;
+  for (int i = 0; i < 3; i++) {
+    test_force_garbage_collection(region * pages_per_sector);
+  }
+  uint32_t erase_count = test_get_sector_erase_count(region);
+  cl_assert(erase_count > 1);
+  cl_assert_equal_i(erase_count, test_read_sector_erase_count(region));
+
+  // the counts should be rebuilt from the page headers after a reboot
+  pfs_reset_all_state();
+  pfs_init(false);
+  cl_assert_equal_i(test_get_sector_erase_count(region), erase_count);
+}
+
+void test_pfs__compact_restores_erased_reserve(void) {
+  const int pages_per_sector = SECTOR_SIZE_BYTES / PFS_SECTOR_SIZE;
+
+  // use up every erased page, keeping every other file around
+  char file_name[10];
+  int num_files = 0;
+  while (true) {
+    snprintf(file_name, sizeof(file_name), "file%d", num_files);
+    int fd = pfs_open(file_name, OP_FLAG_WRITE, FILE_TYPE_STATIC, 10);
+    if (fd < 0) {
+      break;
+    }
+    pfs_close(fd);
+    num_files++;
+    if (test_get_erased_page_count() == 0) {
+      break;
+    }
+  }
+  for (int i = 1; i < num_files; i += 2) {
+    snprintf(file_name, sizeof(file_name), "file%d", i);
+    cl_assert_equal_i(pfs_remove(file_name), S_SUCCESS);
+  }
+  cl_assert_equal_i(test_get_erased_page_count(), 0);
+
+  cl_assert(pfs_compact(0) > 0);
+  cl_assert(test_get_erased_page_count() >= (2 * pages_per_sector));
+
+  // nothing to do once the reserve has been built up
+  cl_assert_equal_i(pfs_compact(0), 0);
+
+  for (int i = 0; i < num_files; i++) {
+    snprintf(file_name, sizeof(file_name), "file%d", i);
+    int fd = pfs_open(file_name, OP_FLAG_READ, FILE_TYPE_STATIC, 0);
+    cl_assert_equal_b(fd >= 0, (i % 2) == 0);
+    if (fd >= 0) {
+      pfs_close(fd);
+    }
+  }
+}
+
+typedef struct {
+  uint32_t worst_write_erases;
+  uint32_t total_erases;
+} EnduranceResult;
+
+//! Fills most of the filesystem with data that never changes and then keeps rewriting a handful
+//! of files in the space which is left, optionally giving the compactor a chance to run every
+//! few writes as if the watch had gone idle
+static EnduranceResult prv_run_endurance_workload(bool run_compactor) {
+  const int num_hot_files = 8;
+  const int num_rewrites = 1500;
+  char file_name[16];
+
+  const int static_file_size = 8 * PFS_SECTOR_SIZE;
+  const int num_static_files = (pfs_get_size() * 3 / 4) / static_file_size;
+  for (int i = 0; i < num_static_files; i++) {
+    snprintf(file_name, sizeof(file_name), "static%d", i);
+    int fd = pfs_open(file_name, OP_FLAG_WRITE, FILE_TYPE_STATIC, static_file_size);
+    cl_assert(fd >= 0);
+    pfs_close(fd);
+  }
+
+  static uint8_t buf[4 * PFS_SECTOR_SIZE];
+  EnduranceResult result = {};
+  const uint32_t workload_start_erases = fake_flash_erase_count();
+  srand(0);
+  for (int i = 0; i < num_rewrites; i++) {
+    snprintf(file_name, sizeof(file_name), "hot%d", rand() % num_hot_files);
+    size_t size = 1 + rand() % sizeof(buf);
+    memset(buf, i, size);
+
+    const uint32_t erases_before = fake_flash_erase_count();
+    pfs_remove(file_name);
+    int fd = pfs_open(file_name, OP_FLAG_WRITE, FILE_TYPE_STATIC, size);
+    cl_assert(fd >= 0);
+    cl_assert_equal_i(pfs_write(fd, buf, size), size);
+    pfs_close(fd);
+    result.worst_write_erases =
+        MAX(result.worst_write_erases, fake_flash_erase_count() - erases_before);
+
+    if (run_compactor && ((i % 4) == 0)) {
+      pfs_compact(0);
+    }
+  }
+
+  result.total_erases = fake_flash_erase_count() - workload_start_erases;
+
+  for (int region = 0; region < prv_num_erase_regions(); region++) {
+    cl_assert_equal_i(test_get_sector_erase_count(region), test_read_sector_erase_count(region));
+  }
+
+  for (int i = 0; i < num_static_files; i++) {
+    snprintf(file_name, sizeof(file_name), "static%d", i);
+    int fd = pfs_open(file_name, OP_FLAG_READ, FILE_TYPE_STATIC, 0);
+    cl_assert(fd >= 0);
+    pfs_close(fd);
+  }
+
+  return result;
+}
+
+void test_pfs__endurance(void) {
+  EnduranceResult results[2];
+  for (int run_compactor = 0; run_compactor < 2; run_compactor++) {
+    fake_spi_flash_cleanup();
+    fake_spi_flash_init(0, 0x1000000);
+    pfs_reset_all_state();
+    pfs_init(false);
+    pfs_format(true /* write erase headers */);
+
+    results[run_compactor] = prv_run_endurance_workload(run_compactor);
+  }
+
+  // Once the compactor is given idle time, writes never have to wait on an erase...
+  cl_assert(results[0].worst_write_erases > 0);
+  cl_assert_equal_i(results[1].worst_write_erases, 0);
+  // ...and it doesn't get there by erasing twice as often
+  cl_assert(results[1].total_erases < 2 * results[0].total_erases);
+}
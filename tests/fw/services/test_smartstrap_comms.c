@@ -121,6 +121,18 @@ static void prv_do_read(uint8_t *data, int length, MBuf *read_mbuf, uint8_t *exp
   }
 }
 
+static void prv_do_read_buffer(const uint8_t *data, int length, MBuf *read_mbuf,
+                               uint8_t *expect_data, int expect_length) {
+  // the data is decoded in place, so hand over a copy like the DMA buffer would be
+  uint8_t buffer[length];
+  memcpy(buffer, data, length);
+  smartstrap_handle_data_buffer_from_isr(buffer, length);
+  fake_system_task_callbacks_invoke_pending();
+  fake_smartstrap_profiles_check_read_params(true, SmartstrapProfileRawData, expect_length);
+  cl_assert_equal_i(mbuf_get_length(read_mbuf), expect_length);
+  cl_assert_equal_m(mbuf_get_data(read_mbuf), expect_data, expect_length);
+}
+
 static void prv_do_read_notify(uint8_t *data, int length) {
   for (int i = 0; i < length; i++) {
     smartstrap_handle_data_from_isr(data[i]);
@@ -225,3 +237,45 @@ void test_smartstrap_comms__notification(void) {
   // process the fake context frame
   prv_do_read_notify(notify_context_raw, sizeof(notify_context_raw));
 }
+
+void test_smartstrap_comms__receive_frame_buffer(void) {
+  // write Mbuf
+  MBuf write_mbuf = MBUF_EMPTY;
+  uint8_t test_data[] = {0x7D, 0x7E, 0x00, 0x7E, 0x7D, 0x00};
+  mbuf_set_data(&write_mbuf, test_data, sizeof(test_data));
+  // read MBuf
+  MBuf read_mbuf = MBUF_EMPTY;
+  uint8_t read_data[sizeof(test_data)] = {0};
+  mbuf_set_data(&read_mbuf, read_data, sizeof(read_data));
+  // expected on-the-wire data from send
+  uint8_t send_raw[] = {0x7E, 0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0x7D, 0x5D, 0x7D, 0x5E,
+                        0x00, 0x7D, 0x5E, 0x7D, 0x5D, 0x00, 0x59, 0x7E};
+  // faked on-the-wire data for the whole response at once
+  uint8_t response_raw[] = {0x7E, 0x01, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x7D, 0x5D, 0x7D, 0x5E,
+                            0x00, 0x7D, 0x5E, 0x7D, 0x5D, 0x00, 0xC5, 0x7E};
+
+  prv_do_send(&write_mbuf, &read_mbuf, send_raw, sizeof(send_raw));
+  prv_do_read_buffer(response_raw, sizeof(response_raw), &read_mbuf, test_data, sizeof(test_data));
+}
+
+void test_smartstrap_comms__receive_frame_buffer_after_invalid(void) {
+  // write Mbuf
+  MBuf write_mbuf = MBUF_EMPTY;
+  uint8_t test_data[] = {0x00, 0x01};
+  mbuf_set_data(&write_mbuf, test_data, sizeof(test_data));
+  // read mbuf
+  MBuf read_mbuf = MBUF_EMPTY;
+  uint8_t read_data[sizeof(test_data)] = {0};
+  mbuf_set_data(&read_mbuf, read_data, sizeof(read_data));
+  // expected on-the-wire data for send
+  uint8_t expected[] = {0x7E, 0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x01, 0xEF, 0x7E};
+  // a frame with a bad checksum, one with a bad escape sequence, then the valid response followed
+  // by data which should be ignored since the read is complete
+  uint8_t response_raw[] = {0x7E, 0x01, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x01, 0x44, 0x7E,
+                            0x01, 0x00, 0x7D, 0x7D, 0x00, 0x00, 0x02, 0x00, 0x00, 0x01, 0x43, 0x7E,
+                            0x01, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x01, 0x43, 0x7E,
+                            0x01, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0xFF, 0xFF, 0x43, 0x7E};
+
+  prv_do_send(&write_mbuf, &read_mbuf, expected, sizeof(expected));
+  prv_do_read_buffer(response_raw, sizeof(response_raw), &read_mbuf, test_data, sizeof(test_data));
+}
@@ -0,0 +1,533 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clar.h"
+
+#include "services/common/system_task.h"
+#include "system/reboot_reason.h"
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+
+#include "util/size.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_pebble_tasks.h"
+
+#include "stubs_passert.h"
+#include "stubs_prompt.h"
+#include "stubs_regular_timer.h"
+#include "stubs_task_watchdog.h"
+
+extern bool prv_process_next_event(TickType_t timeout_ticks);
+
+// Fakes
+///////////////////////////////////////////////////////////
+
+// Linker symbols describing the KernelBG stack
+uint32_t __kernel_bg_stack_start__[1];
+uint32_t __kernel_bg_stack_size__[1];
+uint32_t __stack_guard_size__[1];
+
+void task_init(void) {
+}
+
+void mcu_fpu_cleanup(void) {
+}
+
+void pebble_task_create(PebbleTask pebble_task, TaskParameters_t *task_params,
+                        TaskHandle_t *handle) {
+}
+
+TaskHandle_t pebble_task_get_handle_for_task(PebbleTask task) {
+  return NULL;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+  return eReady;
+}
+
+static TickType_t s_tick_count;
+
+TickType_t milliseconds_to_ticks(uint32_t milliseconds) {
+  return milliseconds;
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return s_tick_count;
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+  return s_tick_count;
+}
+
+// Critical sections. The task level one must not be used from ISRs: on the real port it asserts
+// and unmasks interrupts on the way out.
+
+static bool s_in_isr;
+static int s_critical_nesting;
+static int s_isr_mask_nesting;
+
+void vPortEnterCritical(void) {
+  cl_assert(!s_in_isr);
+  ++s_critical_nesting;
+}
+
+void vPortExitCritical(void) {
+  cl_assert(!s_in_isr);
+  cl_assert(s_critical_nesting > 0);
+  --s_critical_nesting;
+}
+
+uint32_t ulPortSetInterruptMask(void) {
+  return s_isr_mask_nesting++;
+}
+
+void vPortClearInterruptMask(uint32_t mask) {
+  cl_assert_equal_i(mask, --s_isr_mask_nesting);
+}
+
+void pbl_log(uint8_t log_level, const char *src_filename, int src_line_number,
+             const char *fmt, ...) {
+}
+
+static RebootReason s_reboot_reason;
+static jmp_buf s_reset_jmp_buf;
+
+void reboot_reason_set(RebootReason *reason) {
+  s_reboot_reason = *reason;
+}
+
+//! Doesn't return, just like the real thing
+void reset_due_to_software_failure(void) {
+  longjmp(s_reset_jmp_buf, 1);
+}
+
+// Queues and the queue set. Nothing runs concurrently here, so a queue that is full or empty
+// stays that way, no matter how long one would wait. None of them may be used with interrupts
+// masked.
+
+#define MAX_QUEUES (4)
+#define MAX_QUEUE_LENGTH (64)
+
+typedef struct {
+  unsigned int length;
+  unsigned int item_size;
+  unsigned int head;
+  unsigned int count;
+  struct FakeQueue *set;
+  uint8_t items[MAX_QUEUE_LENGTH][32];
+} FakeQueue;
+
+static FakeQueue s_queues[MAX_QUEUES];
+static unsigned int s_num_queues;
+
+QueueHandle_t xQueueGenericCreate(unsigned portBASE_TYPE length, unsigned portBASE_TYPE item_size,
+                                  unsigned char type) {
+  cl_assert(s_num_queues < MAX_QUEUES);
+  cl_assert(length <= MAX_QUEUE_LENGTH);
+  cl_assert(item_size <= sizeof(s_queues[0].items[0]));
+  FakeQueue *queue = &s_queues[s_num_queues++];
+  *queue = (FakeQueue) { .length = length, .item_size = item_size };
+  return (QueueHandle_t)queue;
+}
+
+QueueSetHandle_t xQueueCreateSet(const UBaseType_t length) {
+  return (QueueSetHandle_t)xQueueGenericCreate(length, sizeof(QueueHandle_t),
+                                               queueQUEUE_TYPE_SET);
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t queue, QueueSetHandle_t set) {
+  ((FakeQueue *)queue)->set = (struct FakeQueue *)set;
+  return pdPASS;
+}
+
+static bool prv_push(FakeQueue *queue, const void *item) {
+  cl_assert_equal_i(s_critical_nesting, 0);
+  cl_assert_equal_i(s_isr_mask_nesting, 0);
+  if (queue->count == queue->length) {
+    return false;
+  }
+  memcpy(queue->items[(queue->head + queue->count) % queue->length], item, queue->item_size);
+  ++queue->count;
+  if (queue->set) {
+    cl_assert(prv_push((FakeQueue *)queue->set, &queue));
+  }
+  return true;
+}
+
+static bool prv_pop(FakeQueue *queue, void *item_out, bool just_peeking) {
+  cl_assert_equal_i(s_critical_nesting, 0);
+  if (queue->count == 0) {
+    return false;
+  }
+  memcpy(item_out, queue->items[queue->head], queue->item_size);
+  if (just_peeking) {
+    return true;
+  }
+  queue->head = (queue->head + 1) % queue->length;
+  --queue->count;
+  return true;
+}
+
+signed portBASE_TYPE xQueueGenericSend(QueueHandle_t queue, const void * const item,
+                                       TickType_t ticks_to_wait, portBASE_TYPE copy_position) {
+  return prv_push((FakeQueue *)queue, item) ? pdTRUE : pdFALSE;
+}
+
+signed portBASE_TYPE xQueueGenericSendFromISR(QueueHandle_t queue, const void * const item,
+                                              signed portBASE_TYPE *higher_priority_task_woken,
+                                              portBASE_TYPE copy_position) {
+  *higher_priority_task_woken = pdTRUE;
+  return prv_push((FakeQueue *)queue, item) ? pdTRUE : pdFALSE;
+}
+
+signed portBASE_TYPE xQueueGenericReceive(QueueHandle_t queue, void * const item_out,
+                                          TickType_t ticks_to_wait, portBASE_TYPE just_peeking) {
+  return prv_pop((FakeQueue *)queue, item_out, just_peeking) ? pdTRUE : pdFALSE;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t ticks_to_wait) {
+  QueueSetMemberHandle_t member;
+  return prv_pop((FakeQueue *)set, &member, false /* just_peeking */) ? member : NULL;
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t queue) {
+  return ((FakeQueue *)queue)->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(const QueueHandle_t queue) {
+  return ((FakeQueue *)queue)->length - ((FakeQueue *)queue)->count;
+}
+
+// Helpers
+///////////////////////////////////////////////////////////
+
+#define MAX_RUNS (128)
+
+static uintptr_t s_runs[MAX_RUNS];
+static unsigned int s_num_runs;
+
+static void prv_record_cb(void *data) {
+  cl_assert(s_num_runs < MAX_RUNS);
+  s_runs[s_num_runs++] = (uintptr_t)data;
+}
+
+static void prv_other_record_cb(void *data) {
+  prv_record_cb(data);
+}
+
+static void prv_readd_coalesced_cb(void *data) {
+  prv_record_cb(data);
+  if (s_num_runs == 1) {
+    system_task_add_callback_coalesced(prv_readd_coalesced_cb, data);
+  }
+}
+
+static void prv_slow_cb(void *data) {
+  s_tick_count += (uintptr_t)data;
+}
+
+#define NOOP_CB(n) static void prv_noop_cb_##n(void *data) {}
+NOOP_CB(0) NOOP_CB(1) NOOP_CB(2) NOOP_CB(3) NOOP_CB(4) NOOP_CB(5) NOOP_CB(6) NOOP_CB(7)
+NOOP_CB(8) NOOP_CB(9) NOOP_CB(10) NOOP_CB(11) NOOP_CB(12) NOOP_CB(13) NOOP_CB(14) NOOP_CB(15)
+NOOP_CB(16) NOOP_CB(17) NOOP_CB(18) NOOP_CB(19)
+
+static const SystemTaskEventCallback s_noop_cbs[] = {
+  prv_noop_cb_0, prv_noop_cb_1, prv_noop_cb_2, prv_noop_cb_3, prv_noop_cb_4,
+  prv_noop_cb_5, prv_noop_cb_6, prv_noop_cb_7, prv_noop_cb_8, prv_noop_cb_9,
+  prv_noop_cb_10, prv_noop_cb_11, prv_noop_cb_12, prv_noop_cb_13, prv_noop_cb_14,
+  prv_noop_cb_15, prv_noop_cb_16, prv_noop_cb_17, prv_noop_cb_18, prv_noop_cb_19,
+};
+
+static unsigned int prv_run_all(void) {
+  unsigned int num_run = 0;
+  while (prv_process_next_event(0)) {
+    ++num_run;
+  }
+  return num_run;
+}
+
+static void prv_assert_runs(const uintptr_t *expected, unsigned int num_expected) {
+  cl_assert_equal_i(s_num_runs, num_expected);
+  for (unsigned int i = 0; i < num_expected; ++i) {
+    cl_assert_equal_i(s_runs[i], expected[i]);
+  }
+}
+
+// Tests
+///////////////////////////////////////////////////////////
+
+void test_system_task__initialize(void) {
+  memset(s_queues, 0, sizeof(s_queues));
+  s_num_queues = 0;
+  s_num_runs = 0;
+  s_tick_count = 0;
+  s_reboot_reason = (RebootReason) {};
+  s_in_isr = false;
+  s_critical_nesting = 0;
+  s_isr_mask_nesting = 0;
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+  system_task_init();
+  system_task_reset_stats();
+}
+
+void test_system_task__cleanup(void) {
+  // Don't leave anything behind for the next test, the module state is static
+  s_in_isr = false;
+  prv_run_all();
+}
+
+void test_system_task__callbacks_run_in_order(void) {
+  for (uintptr_t i = 0; i < 5; ++i) {
+    cl_assert(system_task_add_callback(prv_record_cb, (void *)i));
+  }
+  cl_assert_equal_i(prv_run_all(), 5);
+  prv_assert_runs((uintptr_t[]) { 0, 1, 2, 3, 4 }, 5);
+}
+
+void test_system_task__coalesced_callback_is_enqueued_once(void) {
+  for (int i = 0; i < 3; ++i) {
+    cl_assert(system_task_add_callback_coalesced(prv_record_cb, (void *)1));
+  }
+  // Different data or a different callback isn't coalesced:
+  cl_assert(system_task_add_callback_coalesced(prv_record_cb, (void *)2));
+  cl_assert(system_task_add_callback_coalesced(prv_other_record_cb, (void *)1));
+  // Neither are regular callbacks:
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)1));
+
+  cl_assert_equal_i(prv_run_all(), 4);
+  prv_assert_runs((uintptr_t[]) { 1, 2, 1, 1 }, 4);
+
+  SystemTaskQueueStats queue_stats;
+  system_task_get_queue_stats(&queue_stats);
+  cl_assert_equal_i(queue_stats.num_coalesced, 2);
+
+  // Once it ran, it gets enqueued again:
+  cl_assert(system_task_add_callback_coalesced(prv_record_cb, (void *)1));
+  cl_assert_equal_i(prv_run_all(), 1);
+}
+
+void test_system_task__coalesced_callback_can_add_itself_again(void) {
+  // The callback isn't pending anymore while it runs
+  cl_assert(system_task_add_callback_coalesced(prv_readd_coalesced_cb, (void *)7));
+  cl_assert_equal_i(prv_run_all(), 2);
+  prv_assert_runs((uintptr_t[]) { 7, 7 }, 2);
+}
+
+void test_system_task__high_priority_callbacks_run_first(void) {
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)1));
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)2));
+  cl_assert(system_task_add_callback_with_flags(prv_record_cb, (void *)10,
+                                                SystemTaskCallbackFlag_HighPriority));
+  bool should_context_switch;
+  cl_assert(system_task_add_callback_from_isr_with_flags(prv_record_cb, (void *)11,
+                                                         SystemTaskCallbackFlag_HighPriority,
+                                                         &should_context_switch));
+  cl_assert(should_context_switch);
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)3));
+
+  cl_assert_equal_i(prv_run_all(), 5);
+  prv_assert_runs((uintptr_t[]) { 10, 11, 1, 2, 3 }, 5);
+}
+
+static void prv_add_from_app(uintptr_t data) {
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)data));
+  stub_pebble_tasks_set_current(PebbleTask_KernelMain);
+  ++s_tick_count;
+}
+
+void test_system_task__app_and_kernel_callbacks_run_in_arrival_order(void) {
+  prv_add_from_app(1);
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)2));
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)3));
+  prv_add_from_app(4);
+  // A high priority callback jumps the line, but doesn't change the order of the others:
+  cl_assert(system_task_add_callback_with_flags(prv_record_cb, (void *)10,
+                                                SystemTaskCallbackFlag_HighPriority));
+  prv_add_from_app(5);
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)6));
+
+  cl_assert_equal_i(prv_run_all(), 7);
+  prv_assert_runs((uintptr_t[]) { 10, 1, 2, 3, 4, 5, 6 }, 7);
+}
+
+static void prv_readd_kernel_cb(void *data) {
+  prv_record_cb(data);
+  ++s_tick_count;
+  if (s_num_runs < 20) {
+    cl_assert(system_task_add_callback(prv_readd_kernel_cb, data));
+  }
+}
+
+void test_system_task__kernel_callbacks_dont_starve_app_callbacks(void) {
+  // Kernel work keeps arriving, one callback after the other
+  cl_assert(system_task_add_callback(prv_readd_kernel_cb, (void *)1));
+  cl_assert(system_task_add_callback(prv_readd_kernel_cb, (void *)1));
+  prv_add_from_app(2);
+
+  cl_assert(prv_process_next_event(0));
+  cl_assert(prv_process_next_event(0));
+  cl_assert(prv_process_next_event(0));
+  prv_assert_runs((uintptr_t[]) { 1, 1, 2 }, 3);
+}
+
+void test_system_task__callbacks_from_isr_mask_interrupts(void) {
+  s_in_isr = true;
+  bool should_context_switch;
+  // Coalesced:
+  for (int i = 0; i < 3; ++i) {
+    cl_assert(system_task_add_callback_from_isr_with_flags(prv_other_record_cb, (void *)100,
+                                                           SystemTaskCallbackFlag_Coalesce,
+                                                           &should_context_switch));
+  }
+  cl_assert(system_task_add_callback_from_isr_with_flags(prv_other_record_cb, (void *)101,
+                                                         SystemTaskCallbackFlag_HighPriority,
+                                                         &should_context_switch));
+  // Enough to spill over:
+  const unsigned int num_callbacks = 40;
+  for (uintptr_t i = 0; i < num_callbacks; ++i) {
+    cl_assert(system_task_add_callback_from_isr(prv_record_cb, (void *)i,
+                                                &should_context_switch));
+  }
+  cl_assert_equal_i(s_isr_mask_nesting, 0);
+  cl_assert_equal_i(s_critical_nesting, 0);
+  s_in_isr = false;
+
+  SystemTaskQueueStats queue_stats;
+  system_task_get_queue_stats(&queue_stats);
+  cl_assert_equal_i(queue_stats.num_coalesced, 2);
+  cl_assert(queue_stats.num_spilled > 0);
+
+  cl_assert_equal_i(prv_run_all(), num_callbacks + 2);
+  for (uintptr_t i = 0; i < num_callbacks; ++i) {
+    cl_assert_equal_i(s_runs[i + 2], i);
+  }
+}
+
+void test_system_task__full_high_priority_lane_falls_back_to_regular_queue(void) {
+  const unsigned int num_callbacks = 20;
+  for (uintptr_t i = 0; i < num_callbacks; ++i) {
+    cl_assert(system_task_add_callback_with_flags(prv_record_cb, (void *)i,
+                                                  SystemTaskCallbackFlag_HighPriority));
+  }
+  cl_assert_equal_i(prv_run_all(), num_callbacks);
+  cl_assert_equal_i(s_num_runs, num_callbacks);
+  cl_assert_equal_i(s_reboot_reason.code, 0);
+}
+
+void test_system_task__overflow_is_spilled_instead_of_rebooting(void) {
+  const uint32_t initial_space = system_task_get_available_space();
+  // Fill the queue and spill over, from both tasks and ISRs:
+  const unsigned int num_callbacks = 50;
+  for (uintptr_t i = 0; i < num_callbacks; ++i) {
+    if (i % 2) {
+      bool should_context_switch;
+      cl_assert(system_task_add_callback_from_isr(prv_record_cb, (void *)i,
+                                                  &should_context_switch));
+    } else {
+      cl_assert(system_task_add_callback(prv_record_cb, (void *)i));
+    }
+  }
+  cl_assert_equal_i(s_reboot_reason.code, 0);
+  cl_assert_equal_i(system_task_get_available_space(), initial_space - num_callbacks);
+
+  SystemTaskQueueStats queue_stats;
+  system_task_get_queue_stats(&queue_stats);
+  cl_assert(queue_stats.num_spilled > 0);
+  cl_assert_equal_i(queue_stats.max_spill_list_length, queue_stats.num_spilled);
+
+  // Adding while the spill list is being drained keeps the order:
+  cl_assert(prv_process_next_event(0));
+  cl_assert(system_task_add_callback(prv_record_cb, (void *)num_callbacks));
+
+  cl_assert_equal_i(prv_run_all(), num_callbacks);
+  cl_assert_equal_i(s_num_runs, num_callbacks + 1);
+  for (uintptr_t i = 0; i <= num_callbacks; ++i) {
+    cl_assert_equal_i(s_runs[i], i);
+  }
+  cl_assert_equal_i(system_task_get_available_space(), initial_space);
+}
+
+void test_system_task__reboot_when_spill_list_is_full_too(void) {
+  const uint32_t available_space = system_task_get_available_space();
+  bool should_context_switch;
+  for (uintptr_t i = 0; i < available_space; ++i) {
+    cl_assert(system_task_add_callback_from_isr(prv_record_cb, (void *)i, &should_context_switch));
+  }
+
+  if (setjmp(s_reset_jmp_buf) == 0) {
+    system_task_add_callback_from_isr(prv_other_record_cb, NULL, &should_context_switch);
+    cl_fail("Should have rebooted");
+  }
+  cl_assert_equal_i(s_reboot_reason.code, RebootReasonCode_EventQueueFull);
+  cl_assert_equal_i(s_reboot_reason.event_queue.dropped_event,
+                    (uint32_t)(uintptr_t)prv_other_record_cb);
+}
+
+void test_system_task__stats_track_queue_latency_and_run_time(void) {
+  SystemTaskCallbackStats stats;
+  cl_assert(!system_task_get_callback_stats(prv_slow_cb, &stats));
+
+  // Enqueued at tick 0, runs at tick 0 for 5 ticks:
+  cl_assert(system_task_add_callback(prv_slow_cb, (void *)5));
+  // Enqueued at tick 0, runs at tick 5 for 20 ticks:
+  cl_assert(system_task_add_callback(prv_slow_cb, (void *)20));
+  cl_assert_equal_i(prv_run_all(), 2);
+  // Enqueued at tick 25, runs at tick 125 for 2 ticks:
+  cl_assert(system_task_add_callback(prv_slow_cb, (void *)2));
+  s_tick_count += 100;
+  cl_assert_equal_i(prv_run_all(), 1);
+
+  cl_assert(system_task_get_callback_stats(prv_slow_cb, &stats));
+  cl_assert(stats.cb == prv_slow_cb);
+  cl_assert_equal_i(stats.num_runs, 3);
+  cl_assert_equal_i(stats.total_queue_latency_ticks, 105);
+  cl_assert_equal_i(stats.max_queue_latency_ticks, 100);
+  cl_assert_equal_i(stats.total_run_ticks, 27);
+  cl_assert_equal_i(stats.max_run_ticks, 20);
+
+  system_task_reset_stats();
+  cl_assert(!system_task_get_callback_stats(prv_slow_cb, &stats));
+}
+
+void test_system_task__stats_make_room_for_new_callbacks(void) {
+  // prv_record_cb runs more often than the others, so it keeps its entry
+  for (int i = 0; i < 3; ++i) {
+    cl_assert(system_task_add_callback(prv_record_cb, NULL));
+  }
+  prv_run_all();
+
+  // More different callbacks than there are entries:
+  _Static_assert(ARRAY_LENGTH(s_noop_cbs) > SYSTEM_TASK_STATS_NUM_CALLBACKS, "Too few callbacks");
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_noop_cbs); ++i) {
+    cl_assert(system_task_add_callback(s_noop_cbs[i], NULL));
+    prv_run_all();
+  }
+  SystemTaskCallbackStats stats;
+  cl_assert(system_task_get_callback_stats(s_noop_cbs[ARRAY_LENGTH(s_noop_cbs) - 1], &stats));
+
+  cl_assert(system_task_get_callback_stats(prv_record_cb, &stats));
+  cl_assert_equal_i(stats.num_runs, 3);
+}
@@ -24,6 +24,9 @@
 #include "stubs_logging.h"
 #include "stubs_passert.h"
 
+#include "util/math.h"
+#include "util/size.h"
+
 #include <string.h>
 
 //! Find a region ID for the given region name.
@@ -31,13 +34,80 @@
 int timezone_database_find_region_by_name(const char *region_name, int region_name_length);
 
 #include "resource/resource.h"
+//! How much of s_timezone_database the resource is made up of, lets us pretend to be a database
+//! from before the link index was added.
+static size_t s_database_size;
+static int s_num_reads;
+
 size_t resource_load_byte_range_system(ResAppNum app_num, uint32_t resource_id,
                                        uint32_t start_offset, uint8_t *data, size_t num_bytes) {
+  s_num_reads++;
+  if (start_offset >= s_database_size) {
+    return 0;
+  }
+  num_bytes = MIN(num_bytes, s_database_size - start_offset);
   memcpy(data, ((uint8_t*) s_timezone_database) + start_offset, num_bytes);
   return num_bytes;
 }
 
-#define FIND_REGION(name) timezone_database_find_region_by_name(name, strlen(name));
+#define FIND_REGION(name) timezone_database_find_region_by_name(name, strlen(name))
+
+#define HEADER_BYTES 6
+#define REGION_BYTES 24
+#define DST_RULE_PAIR_BYTES 16
+#define LINK_BYTES 35
+#define LINK_NAME_OFFSET 2
+
+static uint16_t prv_header_field(int index) {
+  uint16_t value;
+  memcpy(&value, s_timezone_database + (index * sizeof(value)), sizeof(value));
+  return value;
+}
+
+static size_t prv_link_section_offset(void) {
+  return HEADER_BYTES + (prv_header_field(0) * REGION_BYTES) +
+         ((prv_header_field(1) - 1) * DST_RULE_PAIR_BYTES);
+}
+
+//! Where the database used to end before the link index was appended
+static size_t prv_legacy_database_size(void) {
+  return prv_link_section_offset() + (prv_header_field(2) * LINK_BYTES);
+}
+
+static const char *prv_link_name(int link_number) {
+  return (const char *)s_timezone_database + prv_link_section_offset() +
+         (link_number * LINK_BYTES) + LINK_NAME_OFFSET;
+}
+
+//! Looks up every region and link name in the database, storing the region each one resolves to
+//! in found_regions, regions first followed by links.
+static void prv_find_all_names(int *found_regions) {
+  const int region_count = timezone_database_get_region_count();
+  const int link_count = prv_header_field(2);
+
+  s_num_reads = 0;
+  for (int i = 0; i < region_count; i++) {
+    char region_name[TIMEZONE_NAME_LENGTH];
+    cl_assert(timezone_database_load_region_name(i, region_name));
+    found_regions[i] = FIND_REGION(region_name);
+
+    // Some names appear twice (Etc/GMT), those resolve to the first region with the name
+    char found_region_name[TIMEZONE_NAME_LENGTH];
+    cl_assert(found_regions[i] >= 0 && found_regions[i] <= i);
+    cl_assert(timezone_database_load_region_name(found_regions[i], found_region_name));
+    cl_assert_equal_s(found_region_name, region_name);
+  }
+  for (int i = 0; i < link_count; i++) {
+    const int found_region = FIND_REGION(prv_link_name(i));
+    cl_assert(found_region >= 0 && found_region < region_count);
+    found_regions[region_count + i] = found_region;
+  }
+}
+
+void test_timezone_database__initialize(void) {
+  s_database_size = sizeof(s_timezone_database);
+  s_num_reads = 0;
+}
 
 void test_timezone_database__get_region_count(void) {
   // Note this test will break every time we update the timezone database and that's ok. Just
@@ -128,3 +198,41 @@ void test_timezone_database__kazakhstan(void) {
     cl_assert_equal_i(tz_info.tm_gmtoff, 6 * 60 * 60); // +6 hours
   }
 }
+
+void test_timezone_database__link_count(void) {
+  // Every link the header counts is actually in the database, followed by the link index
+  cl_assert(prv_legacy_database_size() < sizeof(s_timezone_database));
+  cl_assert_equal_m(s_timezone_database + prv_legacy_database_size(), "TZIX", 4);
+  cl_assert_equal_i(sizeof(s_timezone_database),
+                    prv_legacy_database_size() + 4 + (prv_header_field(2) * sizeof(uint16_t)));
+}
+
+void test_timezone_database__find_all_names(void) {
+  const int name_count = timezone_database_get_region_count() + prv_header_field(2);
+  int indexed_regions[name_count];
+  int legacy_regions[name_count];
+
+  prv_find_all_names(indexed_regions);
+  const int indexed_reads = s_num_reads;
+
+  // A database without the link index still works, it just scans
+  s_database_size = prv_legacy_database_size();
+  prv_find_all_names(legacy_regions);
+  const int legacy_reads = s_num_reads;
+
+  cl_assert_equal_m(indexed_regions, legacy_regions, sizeof(indexed_regions));
+  cl_assert(indexed_reads * 10 < legacy_reads);
+}
+
+void test_timezone_database__find_missing_names(void) {
+  const char *missing[] = { "", "A", "Zulu/Time", "America/Waterloo", "US/Pacifi", "US/Pacific_" };
+  for (unsigned int i = 0; i < ARRAY_LENGTH(missing); i++) {
+    const int expected = FIND_REGION(missing[i]);
+    s_database_size = prv_legacy_database_size();
+    cl_assert_equal_i(FIND_REGION(missing[i]), expected);
+    s_database_size = sizeof(s_timezone_database);
+  }
+  cl_assert_equal_i(FIND_REGION("America/Waterloo"), -1);
+  cl_assert_equal_i(FIND_REGION("US/Pacific_"), -1);
+  cl_assert_equal_i(FIND_REGION("Zulu/Time"), -1);
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "system/profiler_trace.h"
+
+#include "clar.h"
+
+#include <stdio.h>
+#include <string.h>
+
+const char *pebble_task_get_name(PebbleTask task) {
+  switch (task) {
+    case PebbleTask_KernelMain: return "KernelMain";
+    case PebbleTask_App: return "App";
+    default: return "Other";
+  }
+}
+
+#define MAX_LINES (PROFILER_TRACE_NUM_EVENTS + NumPebbleTask + 8)
+static char s_lines[MAX_LINES][80];
+static int s_num_lines;
+
+static void prv_line_cb(const char *line, void *context) {
+  cl_assert(s_num_lines < MAX_LINES);
+  strncpy(s_lines[s_num_lines++], line, sizeof(s_lines[0]) - 1);
+}
+
+//! @return index of the first event line of the dump
+static int prv_dump(uint32_t cycles_per_us) {
+  s_num_lines = 0;
+  profiler_trace_dump(cycles_per_us, prv_line_cb, NULL);
+  // begin line, then one line per task plus one for PebbleTask_Unknown
+  return 1 + NumPebbleTask + 1;
+}
+
+void test_profiler_trace__initialize(void) {
+  profiler_trace_start();
+}
+
+void test_profiler_trace__cleanup(void) {
+  profiler_trace_stop();
+}
+
+void test_profiler_trace__dump_format(void) {
+  profiler_trace_record(ProfilerTraceEventType_TaskSwitch, 100, PebbleTask_KernelMain, 0, NULL);
+  profiler_trace_record(ProfilerTraceEventType_DispatchStart, 110, PebbleTask_KernelMain, 7, NULL);
+  profiler_trace_record(ProfilerTraceEventType_NodeStart, 120, PebbleTask_KernelMain, 0,
+                        "compositor");
+  profiler_trace_record(ProfilerTraceEventType_NodeStop, 4000, PebbleTask_KernelMain, 0,
+                        "compositor");
+  profiler_trace_record(ProfilerTraceEventType_DispatchStop, 4100, PebbleTask_KernelMain, 7, NULL);
+  profiler_trace_record(ProfilerTraceEventType_TaskSwitch, 4200, PebbleTask_App, 0, NULL);
+  cl_assert_equal_i(profiler_trace_get_num_events(), 6);
+  cl_assert_equal_i(profiler_trace_get_num_dropped(), 0);
+
+  const int first = prv_dump(64);
+  cl_assert_equal_s(s_lines[0], "PTRACE begin 64 6 0");
+  char expected[80];
+  snprintf(expected, sizeof(expected), "PTRACE task %d KernelMain", PebbleTask_KernelMain);
+  cl_assert_equal_s(s_lines[1 + PebbleTask_KernelMain], expected);
+  snprintf(expected, sizeof(expected), "PTRACE task %d Other", PebbleTask_Unknown);
+  cl_assert_equal_s(s_lines[first - 1], expected);
+
+  snprintf(expected, sizeof(expected), "PTRACE 100 S %d", PebbleTask_KernelMain);
+  cl_assert_equal_s(s_lines[first], expected);
+  snprintf(expected, sizeof(expected), "PTRACE 110 D %d 7", PebbleTask_KernelMain);
+  cl_assert_equal_s(s_lines[first + 1], expected);
+  snprintf(expected, sizeof(expected), "PTRACE 120 B %d compositor", PebbleTask_KernelMain);
+  cl_assert_equal_s(s_lines[first + 2], expected);
+  snprintf(expected, sizeof(expected), "PTRACE 4000 E %d compositor", PebbleTask_KernelMain);
+  cl_assert_equal_s(s_lines[first + 3], expected);
+  snprintf(expected, sizeof(expected), "PTRACE 4100 d %d 7", PebbleTask_KernelMain);
+  cl_assert_equal_s(s_lines[first + 4], expected);
+  snprintf(expected, sizeof(expected), "PTRACE 4200 S %d", PebbleTask_App);
+  cl_assert_equal_s(s_lines[first + 5], expected);
+  cl_assert_equal_s(s_lines[first + 6], "PTRACE end");
+  cl_assert_equal_i(s_num_lines, first + 7);
+}
+
+void test_profiler_trace__keeps_newest_events_when_full(void) {
+  const int num_recorded = PROFILER_TRACE_NUM_EVENTS * 2 + 10;
+  for (int i = 0; i < num_recorded; i++) {
+    profiler_trace_record(ProfilerTraceEventType_NodeStart, i, PebbleTask_App, 0, "render_app");
+  }
+  cl_assert_equal_i(profiler_trace_get_num_events(), PROFILER_TRACE_NUM_EVENTS);
+  cl_assert_equal_i(profiler_trace_get_num_dropped(), num_recorded - PROFILER_TRACE_NUM_EVENTS);
+
+  const int first = prv_dump(1);
+  char expected[80];
+  snprintf(expected, sizeof(expected), "PTRACE begin 1 %d %d", PROFILER_TRACE_NUM_EVENTS,
+           num_recorded - PROFILER_TRACE_NUM_EVENTS);
+  cl_assert_equal_s(s_lines[0], expected);
+  for (int i = 0; i < PROFILER_TRACE_NUM_EVENTS; i++) {
+    snprintf(expected, sizeof(expected), "PTRACE %d B %d render_app",
+             num_recorded - PROFILER_TRACE_NUM_EVENTS + i, PebbleTask_App);
+    cl_assert_equal_s(s_lines[first + i], expected);
+  }
+}
+
+void test_profiler_trace__stop_and_restart(void) {
+  profiler_trace_record(ProfilerTraceEventType_NodeStart, 1, PebbleTask_App, 0,
+                        "display_transfer");
+  profiler_trace_stop();
+  profiler_trace_record(ProfilerTraceEventType_NodeStop, 2, PebbleTask_App, 0,
+                        "display_transfer");
+  cl_assert_equal_i(profiler_trace_get_num_events(), 1);
+
+  // Dumping a stopped trace doesn't resume recording
+  prv_dump(1);
+  profiler_trace_record(ProfilerTraceEventType_NodeStop, 3, PebbleTask_App, 0,
+                        "display_transfer");
+  cl_assert_equal_i(profiler_trace_get_num_events(), 1);
+
+  profiler_trace_start();
+  cl_assert_equal_i(profiler_trace_get_num_events(), 0);
+  profiler_trace_record(ProfilerTraceEventType_NodeStop, 4, PebbleTask_App, 0,
+                        "display_transfer");
+  cl_assert_equal_i(profiler_trace_get_num_events(), 1);
+
+  // Dumping a running trace keeps it running
+  prv_dump(1);
+  profiler_trace_record(ProfilerTraceEventType_NodeStop, 5, PebbleTask_App, 0,
+                        "display_transfer");
+  cl_assert_equal_i(profiler_trace_get_num_events(), 2);
+}
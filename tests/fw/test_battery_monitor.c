@@ -67,6 +67,8 @@ bool firmware_update_is_in_progress(void) {
   return false;
 }
 
+void persist_service_flush_all(void) { }
+
 void battery_force_charge_enable(bool is_charging) { }
 
 bool stop_mode_is_allowed(void) {
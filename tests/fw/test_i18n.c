@@ -20,8 +20,12 @@
 #include "services/common/i18n/i18n.h"
 #include "services/common/i18n/mo.h"
 #include "services/normal/filesystem/pfs.h"
+#include "resource/resource.h"
 #include "resource/resource_ids.auto.h"
 #include "flash_region/flash_region.h"
+#include "util/size.h"
+
+#include <stdio.h>
 
 #define I18N_FIXTURE_PATH "i18n"
 
@@ -186,3 +190,121 @@ void test_i18n__reset_language(void) {
   test_i18n__cleanup();
   test_i18n__initialize();
 }
+
+void test_i18n__shared_between_owners(void) {
+  const char *first = i18n_get("Music", (void *)0x12345);
+  cl_assert_equal_s(first, "Musique");
+
+  // Another owner gets its own copy without going back to the language pack
+  const uint32_t read_count = fake_flash_read_count();
+  const char *second = i18n_get("Music", (void *)0xdeadbeef);
+  cl_assert_equal_s(second, "Musique");
+  cl_assert(first != second);
+
+  char buffer[20];
+  i18n_get_with_buffer("Music", buffer, sizeof(buffer));
+  cl_assert_equal_s(buffer, "Musique");
+  cl_assert_equal_i(i18n_get_length("Music"), strlen("Musique"));
+
+  // Strings without a translation are remembered too
+  i18n_get("abcd abcd", (void *)0x12345);
+  const uint32_t untranslated_read_count = fake_flash_read_count();
+  cl_assert_equal_s(i18n_get("abcd abcd", (void *)0xdeadbeef), "abcd abcd");
+  cl_assert_equal_i(fake_flash_read_count(), untranslated_read_count);
+  cl_assert(untranslated_read_count > read_count);
+
+  // The cached translations outlive the owners
+  i18n_free_all((void *)0x12345);
+  i18n_free_all((void *)0xdeadbeef);
+  const uint32_t freed_read_count = fake_flash_read_count();
+  cl_assert_equal_s(i18n_get("Music", __FILE__), "Musique");
+  cl_assert_equal_i(fake_flash_read_count(), freed_read_count);
+  i18n_free_all(__FILE__);
+}
+
+void test_i18n__language_change_flushes_cache(void) {
+  cl_assert_equal_s(i18n_get("Music", __FILE__), "Musique");
+  i18n_free_all(__FILE__);
+
+  shell_prefs_set_language_english(true);
+  i18n_set_resource(RESOURCE_ID_STRINGS);
+  cl_assert_equal_s(i18n_get("Music", __FILE__), "Music");
+  i18n_free_all(__FILE__);
+
+  char buffer[20];
+  i18n_get_with_buffer("Music", buffer, sizeof(buffer));
+  cl_assert_equal_s(buffer, "Music");
+
+  shell_prefs_set_language_english(false);
+  i18n_set_resource(RESOURCE_ID_STRINGS);
+  cl_assert_equal_s(i18n_get("Music", __FILE__), "Musique");
+  i18n_free_all(__FILE__);
+}
+
+void test_i18n__read_failure_isnt_cached(void) {
+  // Use up all the file descriptors, so the language pack can't be opened to read from it
+  int fds[8];
+  for (unsigned int i = 0; i < ARRAY_LENGTH(fds); i++) {
+    char name[8];
+    snprintf(name, sizeof(name), "fd%u", i);
+    fds[i] = pfs_open(name, OP_FLAG_WRITE, FILE_TYPE_STATIC, 10);
+    cl_assert(fds[i] >= 0);
+  }
+  cl_assert_equal_s(i18n_get("Music", __FILE__), "Music");
+  i18n_free_all(__FILE__);
+
+  // Once it can be read again, the translation shows up without reloading the language pack
+  for (unsigned int i = 0; i < ARRAY_LENGTH(fds); i++) {
+    pfs_close_and_remove(fds[i]);
+  }
+  cl_assert_equal_s(i18n_get("Music", __FILE__), "Musique");
+  i18n_free_all(__FILE__);
+}
+
+//! Loads the original of string number index of the language pack
+static void prv_load_msgid(const MoHeader *header, int index, char *msgid, size_t msgid_size) {
+  MoEntry entry;
+  resource_load_byte_range_system(SYSTEM_APP, RESOURCE_ID_STRINGS,
+                                  header->mo_otable + (index * sizeof(MoEntry)),
+                                  (uint8_t *)&entry, sizeof(entry));
+  cl_assert(entry.len < msgid_size);
+  resource_load_byte_range_system(SYSTEM_APP, RESOURCE_ID_STRINGS, entry.off,
+                                  (uint8_t *)msgid, entry.len);
+  msgid[entry.len] = '\0';
+}
+
+void test_i18n__repeated_window_pushes(void) {
+  // A settings window worth of strings from the language pack, skipping the "" header entry
+  const int WINDOW_STRINGS = 24;
+  const int NUM_PUSHES = 50;
+  MoHeader header;
+  resource_load_byte_range_system(SYSTEM_APP, RESOURCE_ID_STRINGS, 0, (uint8_t *)&header,
+                                  sizeof(header));
+  cl_assert(header.mo_nstring > WINDOW_STRINGS);
+
+  char msgids[WINDOW_STRINGS][100];
+  for (int i = 0; i < WINDOW_STRINGS; i++) {
+    prv_load_msgid(&header, i + 1, msgids[i], sizeof(msgids[i]));
+  }
+
+  uint32_t first_push_reads = 0;
+  const uint32_t start_read_count = fake_flash_read_count();
+  for (int push = 0; push < NUM_PUSHES; push++) {
+    // Each push is a new window, so a new owner
+    const void *owner = (void *)(uintptr_t)(push + 1);
+    for (int i = 0; i < WINDOW_STRINGS; i++) {
+      cl_assert(i18n_get(msgids[i], owner) != NULL);
+      cl_assert(i18n_get(msgids[i], owner) == i18n_get(msgids[i], owner));
+    }
+    i18n_free_all(owner);
+
+    if (push == 0) {
+      first_push_reads = fake_flash_read_count() - start_read_count;
+    }
+  }
+  const uint32_t total_reads = fake_flash_read_count() - start_read_count;
+
+  // Pushing the same window again is answered from the cache
+  cl_assert(first_push_reads > 0);
+  cl_assert(total_reads - first_push_reads < first_push_reads);
+}
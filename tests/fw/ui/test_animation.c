@@ -25,6 +25,7 @@
 #include "applib/ui/animation_private.h"
 #include "applib/legacy2/ui/animation_private_legacy2.h"
 #include "util/math.h"
+#include "util/size.h"
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -3751,3 +3752,89 @@ void test_animation__current_interpolate_override(void) {
 
   animation_destroy(a);
 }
+
+
+// --------------------------------------------------------------------------------------
+// Animations created while there is no handle table (e.g. because we ran out of memory) must
+// still be found, both before and after the table gets rebuilt
+void test_animation__handle_table_rebuild(void) {
+  AnimationState *state = kernel_applib_get_animation_state();
+  Animation *animations[8];
+  for (int i = 0; i < 5; i++) {
+    animations[i] = prv_create_test_animation();
+  }
+  cl_assert(animation_schedule(animations[2]));
+  cl_assert(state->aux->handle_table);
+
+  // Drop the table like we would on an allocation failure. animation.c gets its applib heap from
+  // the default applib_malloc.auto.h override, which is plain malloc()
+  free(state->aux->handle_table);
+  state->aux->handle_table = NULL;
+  state->aux->handle_table_size = 0;
+  for (int i = 0; i < 5; i++) {
+    cl_assert(animation_private_animation_find(animations[i]));
+  }
+
+  // The next create rebuilds the table from the scheduled and unscheduled lists
+  for (int i = 5; i < ARRAY_LENGTH(animations); i++) {
+    animations[i] = prv_create_test_animation();
+  }
+  cl_assert(state->aux->handle_table);
+  cl_assert_equal_i(state->aux->num_animations, ARRAY_LENGTH(animations));
+  for (int i = 0; i < ARRAY_LENGTH(animations); i++) {
+    AnimationPrivate *animation = animation_private_animation_find(animations[i]);
+    cl_assert(animation);
+    cl_assert_equal_p(animation->handle, animations[i]);
+  }
+
+  for (int i = 0; i < ARRAY_LENGTH(animations); i++) {
+    animation_destroy(animations[i]);
+    cl_assert_equal_p(animation_private_animation_find(animations[i]), NULL);
+    for (int j = i + 1; j < ARRAY_LENGTH(animations); j++) {
+      cl_assert(animation_private_animation_find(animations[j]));
+    }
+  }
+  cl_assert_equal_i(state->aux->num_animations, 0);
+}
+
+
+// --------------------------------------------------------------------------------------
+// Create, schedule, reschedule, look up, unschedule and destroy 500 animations
+void test_animation__many_animations(void) {
+  const int k_num_animations = 500;
+  Animation *animations[k_num_animations];
+  srand(0);
+
+  for (int i = 0; i < k_num_animations; i++) {
+    animations[i] = prv_create_test_animation();
+    cl_assert(animations[i]);
+    cl_assert(animation_set_auto_destroy(animations[i], false));
+  }
+
+  for (int i = 0; i < k_num_animations; i++) {
+    cl_assert(animation_set_delay(animations[i], rand() % 10000));
+    cl_assert(animation_schedule(animations[i]));
+  }
+
+  for (int i = 0; i < k_num_animations; i++) {
+    cl_assert(animation_unschedule(animations[i]));
+    cl_assert(animation_set_delay(animations[i], rand() % 10000));
+    cl_assert(animation_schedule(animations[i]));
+  }
+
+  for (int i = 0; i < k_num_animations; i++) {
+    cl_assert(animation_is_scheduled(animations[i]));
+  }
+
+  for (int i = 0; i < k_num_animations; i++) {
+    cl_assert(animation_unschedule(animations[i]));
+  }
+
+  for (int i = 0; i < k_num_animations; i++) {
+    cl_assert(animation_destroy(animations[i]));
+  }
+
+  for (int i = 0; i < k_num_animations; i++) {
+    cl_assert(!animation_is_scheduled(animations[i]));
+  }
+}
@@ -17,7 +17,10 @@
 #include "clar.h"
 
 #include "util/hdlc.h"
+#include "util/math.h"
+#include "util/size.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "stubs_passert.h"
@@ -25,6 +28,7 @@
 // Setup
 
 void test_hdlc__initialize(void) {
+  srand(0);
 }
 
 void test_hdlc__cleanup(void) {
@@ -178,3 +182,268 @@ void test_hdlc__encode_decode(void) {
   }
   cl_assert(read_idx == strlen(str));
 }
+
+// Buffer API
+
+//! Markers in a decode transcript, everything else is a stored byte
+#define MARK_COMPLETE (-1)
+#define MARK_ERROR (-2)
+#define MARK_COMPLETE_ERROR (-3)
+
+#define MAX_STREAM_LENGTH (64 * 1024)
+
+static uint8_t s_stream[MAX_STREAM_LENGTH];
+static uint8_t s_scratch[MAX_STREAM_LENGTH];
+static int s_expected[MAX_STREAM_LENGTH];
+static int s_actual[MAX_STREAM_LENGTH];
+
+//! Mostly plain bytes with enough special characters to exercise escaping
+static uint8_t prv_random_byte(void) {
+  static const uint8_t s_interesting[] = { HDLC_FLAG, HDLC_ESCAPE, HDLC_FLAG ^ HDLC_ESCAPE_MASK,
+                                           HDLC_ESCAPE ^ HDLC_ESCAPE_MASK };
+  const int r = rand();
+  return (r % 4 == 0) ? s_interesting[(r / 4) % ARRAY_LENGTH(s_interesting)] : (uint8_t)(r / 4);
+}
+
+static size_t prv_encode_per_byte(const uint8_t *data, size_t length, uint8_t *out) {
+  size_t out_length = 0;
+  for (size_t i = 0; i < length; i++) {
+    uint8_t c = data[i];
+    if (hdlc_encode(&c)) {
+      out[out_length++] = HDLC_ESCAPE;
+    }
+    out[out_length++] = c;
+  }
+  return out_length;
+}
+
+static int prv_marker(bool is_complete, bool hdlc_error) {
+  if (is_complete) {
+    return hdlc_error ? MARK_COMPLETE_ERROR : MARK_COMPLETE;
+  }
+  return MARK_ERROR;
+}
+
+//! Runs the per-byte decoder over the data and records what it stored and signalled
+static size_t prv_transcript_per_byte(const uint8_t *data, size_t length, int *transcript) {
+  HdlcStreamingContext ctx;
+  hdlc_streaming_decode_reset(&ctx);
+  size_t transcript_length = 0;
+  for (size_t i = 0; i < length; i++) {
+    uint8_t c = data[i];
+    bool should_store, hdlc_error;
+    const bool is_complete = hdlc_streaming_decode(&ctx, &c, &should_store, &hdlc_error);
+    if (should_store) {
+      transcript[transcript_length++] = c;
+    }
+    if (is_complete || hdlc_error) {
+      transcript[transcript_length++] = prv_marker(is_complete, hdlc_error);
+    }
+  }
+  return transcript_length;
+}
+
+//! Runs the buffer decoder over the data, fed in randomly sized chunks of up to max_chunk bytes
+static size_t prv_transcript_buffer(uint8_t *data, size_t length, size_t max_chunk,
+                                    int *transcript) {
+  HdlcStreamingContext ctx;
+  hdlc_streaming_decode_reset(&ctx);
+  size_t transcript_length = 0;
+  while (length > 0) {
+    const size_t random_length = 1 + (rand() % max_chunk);
+    size_t chunk_length = MIN(length, random_length);
+    while (chunk_length > 0) {
+      size_t decoded_length;
+      bool is_complete, hdlc_error;
+      const size_t consumed = hdlc_decode_buffer(&ctx, data, chunk_length, &decoded_length,
+                                                 &is_complete, &hdlc_error);
+      cl_assert(consumed > 0);
+      cl_assert(decoded_length <= consumed);
+      for (size_t i = 0; i < decoded_length; i++) {
+        transcript[transcript_length++] = data[i];
+      }
+      if (is_complete || hdlc_error) {
+        transcript[transcript_length++] = prv_marker(is_complete, hdlc_error);
+      } else {
+        cl_assert_equal_i(consumed, chunk_length);
+      }
+      data += consumed;
+      length -= consumed;
+      chunk_length -= consumed;
+    }
+  }
+  return transcript_length;
+}
+
+void test_hdlc__decode_buffer_in_place(void) {
+  uint8_t data[] = { 'a', 'b', HDLC_ESCAPE, HDLC_FLAG ^ HDLC_ESCAPE_MASK, 'c', HDLC_FLAG,
+                     'x', 'y' };
+  HdlcStreamingContext ctx;
+  hdlc_streaming_decode_reset(&ctx);
+  size_t decoded_length;
+  bool is_complete, hdlc_error;
+  cl_assert_equal_i(hdlc_decode_buffer(&ctx, data, sizeof(data), &decoded_length, &is_complete,
+                                       &hdlc_error), 6);
+  cl_assert_equal_i(decoded_length, 4);
+  cl_assert(is_complete);
+  cl_assert(!hdlc_error);
+  cl_assert_equal_m(data, "ab\x7e" "c", 4);
+
+  // the rest of the buffer is the start of the next frame
+  cl_assert_equal_i(hdlc_decode_buffer(&ctx, &data[6], 2, &decoded_length, &is_complete,
+                                       &hdlc_error), 2);
+  cl_assert_equal_i(decoded_length, 2);
+  cl_assert(!is_complete);
+  cl_assert_equal_m(&data[6], "xy", 2);
+
+  // an escape split across two buffers
+  data[0] = HDLC_ESCAPE;
+  cl_assert_equal_i(hdlc_decode_buffer(&ctx, data, 1, &decoded_length, &is_complete,
+                                       &hdlc_error), 1);
+  cl_assert_equal_i(decoded_length, 0);
+  data[0] = HDLC_ESCAPE ^ HDLC_ESCAPE_MASK;
+  cl_assert_equal_i(hdlc_decode_buffer(&ctx, data, 1, &decoded_length, &is_complete,
+                                       &hdlc_error), 1);
+  cl_assert_equal_i(decoded_length, 1);
+  cl_assert_equal_i(data[0], HDLC_ESCAPE);
+}
+
+void test_hdlc__decode_buffer_invalid(void) {
+  // two consecutive escape characters stop decoding after the second one
+  uint8_t data[] = { 'a', HDLC_ESCAPE, HDLC_ESCAPE, 'b', HDLC_ESCAPE, HDLC_FLAG };
+  HdlcStreamingContext ctx;
+  hdlc_streaming_decode_reset(&ctx);
+  size_t decoded_length;
+  bool is_complete, hdlc_error;
+  cl_assert_equal_i(hdlc_decode_buffer(&ctx, data, sizeof(data), &decoded_length, &is_complete,
+                                       &hdlc_error), 3);
+  cl_assert_equal_i(decoded_length, 1);
+  cl_assert(!is_complete);
+  cl_assert(hdlc_error);
+
+  // an escape character followed by a flag is both the end of the frame and an error
+  cl_assert_equal_i(hdlc_decode_buffer(&ctx, &data[3], 3, &decoded_length, &is_complete,
+                                       &hdlc_error), 3);
+  cl_assert_equal_i(decoded_length, 1);
+  cl_assert(is_complete);
+  cl_assert(hdlc_error);
+}
+
+void test_hdlc__encode_buffer_out_of_space(void) {
+  const uint8_t data[] = { 'a', 'b', HDLC_FLAG, 'c' };
+  uint8_t out[8];
+  size_t encoded_length;
+  // the escape sequence doesn't fit after "ab" so it's left for the next call
+  cl_assert_equal_i(hdlc_encode_buffer(data, sizeof(data), out, 3, &encoded_length), 2);
+  cl_assert_equal_i(encoded_length, 2);
+  cl_assert_equal_i(hdlc_encode_buffer(&data[2], 2, out, sizeof(out), &encoded_length), 2);
+  cl_assert_equal_i(encoded_length, 3);
+  const uint8_t expected[] = { HDLC_ESCAPE, HDLC_FLAG ^ HDLC_ESCAPE_MASK, 'c' };
+  cl_assert_equal_m(out, expected, sizeof(expected));
+
+  cl_assert_equal_i(hdlc_encode_buffer(data, sizeof(data), out, 0, &encoded_length), 0);
+  cl_assert_equal_i(encoded_length, 0);
+}
+
+void test_hdlc__random_frames_round_trip(void) {
+  const int NUM_FRAMES = 500;
+  const size_t MAX_FRAME_LENGTH = 100;
+  uint8_t frames[NUM_FRAMES][MAX_FRAME_LENGTH];
+  size_t frame_lengths[NUM_FRAMES];
+
+  // encode the frames back to back into one stream
+  size_t stream_length = 0;
+  s_stream[stream_length++] = HDLC_FLAG;
+  for (int f = 0; f < NUM_FRAMES; f++) {
+    frame_lengths[f] = rand() % MAX_FRAME_LENGTH;
+    for (size_t i = 0; i < frame_lengths[f]; i++) {
+      frames[f][i] = prv_random_byte();
+    }
+    // encode in pieces through a small output buffer, which must match the per-byte encoder
+    const size_t expected_length = prv_encode_per_byte(frames[f], frame_lengths[f], s_scratch);
+    const size_t out_size = 2 + (rand() % 16);
+    size_t read_idx = 0;
+    size_t write_idx = 0;
+    while (read_idx < frame_lengths[f]) {
+      size_t encoded_length;
+      read_idx += hdlc_encode_buffer(&frames[f][read_idx], frame_lengths[f] - read_idx,
+                                     &s_stream[stream_length + write_idx], out_size,
+                                     &encoded_length);
+      cl_assert(encoded_length > 0);
+      write_idx += encoded_length;
+    }
+    cl_assert_equal_i(write_idx, expected_length);
+    cl_assert_equal_m(&s_stream[stream_length], s_scratch, expected_length);
+    stream_length += write_idx;
+    s_stream[stream_length++] = HDLC_FLAG;
+  }
+  cl_assert(stream_length <= MAX_STREAM_LENGTH);
+
+  // decoding at arbitrary chunk boundaries gets the frames back, exactly like the per-byte decoder
+  const size_t expected_length = prv_transcript_per_byte(s_stream, stream_length, s_expected);
+  const size_t actual_length = prv_transcript_buffer(s_stream, stream_length, 64, s_actual);
+  cl_assert_equal_i(actual_length, expected_length);
+  cl_assert_equal_m(s_actual, s_expected, expected_length * sizeof(int));
+
+  size_t idx = 1;  // skip the opening flag
+  for (int f = 0; f < NUM_FRAMES; f++) {
+    for (size_t i = 0; i < frame_lengths[f]; i++) {
+      cl_assert_equal_i(s_actual[idx++], frames[f][i]);
+    }
+    cl_assert_equal_i(s_actual[idx++], MARK_COMPLETE);
+  }
+  cl_assert_equal_i(idx, actual_length);
+}
+
+void test_hdlc__random_garbage_matches_per_byte(void) {
+  // line noise full of bad escape sequences must be handled exactly like the per-byte decoder
+  for (int run = 0; run < 20; run++) {
+    const size_t length = 4096;
+    for (size_t i = 0; i < length; i++) {
+      s_stream[i] = prv_random_byte();
+    }
+    const size_t expected_length = prv_transcript_per_byte(s_stream, length, s_expected);
+    const size_t actual_length = prv_transcript_buffer(s_stream, length, 1 + run * 10, s_actual);
+    cl_assert_equal_i(actual_length, expected_length);
+    cl_assert_equal_m(s_actual, s_expected, expected_length * sizeof(int));
+  }
+}
+
+void test_hdlc__large_payload(void) {
+  // typical payload: few special characters
+  const size_t payload_length = MAX_STREAM_LENGTH / 4;
+  for (size_t i = 0; i < payload_length; i++) {
+    s_scratch[i] = (rand() % 64 == 0) ? HDLC_FLAG : (uint8_t)rand();
+  }
+
+  // the whole payload in one go, the same as the per-byte encoder
+  uint8_t *encoded = &s_stream[MAX_STREAM_LENGTH / 2];
+  const size_t encoded_length = prv_encode_per_byte(s_scratch, payload_length, s_stream);
+  size_t length;
+  cl_assert_equal_i(hdlc_encode_buffer(s_scratch, payload_length, encoded, MAX_STREAM_LENGTH / 2,
+                                       &length), payload_length);
+  cl_assert_equal_i(length, encoded_length);
+  cl_assert_equal_m(encoded, s_stream, encoded_length);
+
+  HdlcStreamingContext ctx;
+  hdlc_streaming_decode_reset(&ctx);
+  size_t decoded_length = 0;
+  for (size_t j = 0; j < encoded_length; j++) {
+    uint8_t c = s_stream[j];
+    bool should_store, hdlc_error;
+    hdlc_streaming_decode(&ctx, &c, &should_store, &hdlc_error);
+    if (should_store) {
+      s_stream[decoded_length++] = c;
+    }
+  }
+  cl_assert_equal_i(decoded_length, payload_length);
+  cl_assert_equal_m(s_stream, s_scratch, payload_length);
+
+  // the buffer decoder works in place
+  hdlc_streaming_decode_reset(&ctx);
+  bool is_complete, hdlc_error;
+  cl_assert_equal_i(hdlc_decode_buffer(&ctx, encoded, encoded_length, &decoded_length,
+                                       &is_complete, &hdlc_error), encoded_length);
+  cl_assert_equal_i(decoded_length, payload_length);
+  cl_assert_equal_m(encoded, s_scratch, payload_length);
+}
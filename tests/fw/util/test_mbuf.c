@@ -166,6 +166,31 @@ void test_mbuf__iter_modify(void) {
   }
 }
 
+void test_mbuf__iter_write_bytes(void) {
+  // write a buffer across an mbuf chain with an empty mbuf in the middle
+  uint8_t data1[] = {0, 0, 0};
+  uint8_t data3[] = {0, 0, 0};
+  const uint8_t src[] = {1, 2, 3, 4, 5, 6, 7};
+  MBufIterator iter;
+  MBuf mbuf1 = MBUF_EMPTY;
+  MBuf mbuf2 = MBUF_EMPTY;
+  MBuf mbuf3 = MBUF_EMPTY;
+  mbuf_set_data(&mbuf1, data1, 3);
+  mbuf_set_data(&mbuf3, data3, 3);
+  mbuf_append(&mbuf1, &mbuf2);
+  mbuf_append(&mbuf1, &mbuf3);
+  mbuf_iterator_init(&iter, &mbuf1);
+
+  cl_assert_equal_i(mbuf_iterator_write_bytes(&iter, src, 2), 2);
+  cl_assert(mbuf_iterator_write_byte(&iter, 3));
+  // only 3 of the remaining 4 bytes fit
+  cl_assert_equal_i(mbuf_iterator_write_bytes(&iter, &src[3], 4), 3);
+  cl_assert(mbuf_iterator_is_finished(&iter));
+  cl_assert_equal_i(mbuf_iterator_write_bytes(&iter, src, 1), 0);
+  cl_assert_equal_m(data1, src, 3);
+  cl_assert_equal_m(data3, &src[3], 3);
+}
+
 static int prv_get_free_list_length(void) {
   int len = 0;
   for (MBuf *m = s_free_list; m; m = mbuf_get_next(m)) {
@@ -49,3 +49,22 @@ void test_memchr__big_value(void) {
   uint8_t testbuf[8] = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0x78, 0xDE, 0xF0, };
   cl_assert_equal_p(memchr(testbuf, 0xF78, 8), testbuf+3);
 }
+
+// Every alignment, with the byte at every position and also just outside the searched range
+void test_memchr__alignments(void) {
+  uint8_t testbuf[80] __attribute__((aligned(4)));
+  for (size_t align = 0; align < 4; align++) {
+    for (size_t len = 0; len < 40; len++) {
+      for (size_t found_at = 0; found_at <= len; found_at++) {
+        // Neighbouring values and zeroes look a lot like the byte we're after to the word check
+        memset(testbuf, 0xFE, sizeof(testbuf));
+        testbuf[align + len + 1] = 0x00;
+        testbuf[align + found_at] = 0xFF;
+        testbuf[align + len] = 0xFF;
+        uint8_t *expected = (found_at < len) ? (testbuf + align + found_at) : NULL;
+        cl_assert_equal_p(memchr(testbuf + align, 0xFF, len), expected);
+        cl_assert_equal_p(memchr(testbuf + align, 0x1FF, len), expected);
+      }
+    }
+  }
+}
@@ -51,3 +51,31 @@ void test_memcmp__partial(void) {
   uint8_t testbuf2[9] = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0, 0xBA, };
   cl_assert_equal_b(!memcmp(testbuf1, testbuf2, 8), true);
 }
+
+static int prv_sign(int value) {
+  return (value > 0) - (value < 0);
+}
+
+// Every alignment of both buffers, with the difference at every position and in both directions
+void test_memcmp__alignments(void) {
+  uint8_t testbuf1[80] __attribute__((aligned(4)));
+  uint8_t testbuf2[80] __attribute__((aligned(4)));
+  for (size_t align1 = 0; align1 < 4; align1++) {
+    for (size_t align2 = 0; align2 < 4; align2++) {
+      for (size_t len = 0; len < 40; len++) {
+        for (size_t diff_at = 0; diff_at <= len; diff_at++) {
+          for (int direction = -1; direction <= 1; direction += 2) {
+            for (size_t i = 0; i < len + 4; i++) {
+              testbuf1[align1 + i] = testbuf2[align2 + i] = (uint8_t)(0x7F + i);
+            }
+            // The difference is either inside the compared range or just past it
+            testbuf2[align2 + diff_at] += direction;
+            const int expected = (diff_at < len) ? -direction : 0;
+            cl_assert_equal_i(prv_sign(memcmp(testbuf1 + align1, testbuf2 + align2, len)),
+                              expected);
+          }
+        }
+      }
+    }
+  }
+}
@@ -65,3 +65,28 @@ void test_strchr__r_end_of_string(void) {
   cl_assert_equal_p(strrchr(testbuf, '\0'), testbuf+7);
 }
 
+
+// Every alignment, with the character at every position, after the terminator or searching for
+// the terminator itself
+void test_strchr__alignments(void) {
+  char testbuf[80] __attribute__((aligned(4)));
+  for (size_t align = 0; align < 4; align++) {
+    for (size_t len = 0; len < 40; len++) {
+      char *s = testbuf + align;
+      memset(testbuf, 0x80, sizeof(testbuf));
+      s[len] = '\0';
+      s[len + 1] = 'Z';
+      cl_assert_equal_p(strchr(s, 'Z'), NULL);
+      cl_assert_equal_p(strchr(s, '\0'), s + len);
+      for (size_t found_at = 0; found_at < len; found_at++) {
+        memset(testbuf, 0x80, sizeof(testbuf));
+        s[len] = '\0';
+        s[found_at] = 'Z';
+        // A later match must not win over the first
+        s[len - 1] = 'Z';
+        cl_assert_equal_p(strchr(s, 'Z'), s + found_at);
+        cl_assert_equal_p(strchr(s, 0x100 + 'Z'), s + found_at);
+      }
+    }
+  }
+}
@@ -69,3 +69,53 @@ void test_strcmp__n_short(void) {
   char testbuf2[8] = "HelloAB\0";
   cl_assert_equal_b(!strncmp(testbuf1, testbuf2, 5), true);
 }
+
+static int prv_sign(int value) {
+  return (value > 0) - (value < 0);
+}
+
+static void prv_fill(char *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = (char)(0x70 + i);
+  }
+  buf[len] = '\0';
+}
+
+// Every alignment of both strings, ending early, ending late or differing at every position
+void test_strcmp__alignments(void) {
+  char testbuf1[80] __attribute__((aligned(4)));
+  char testbuf2[80] __attribute__((aligned(4)));
+  for (size_t align1 = 0; align1 < 4; align1++) {
+    for (size_t align2 = 0; align2 < 4; align2++) {
+      for (size_t len = 0; len < 40; len++) {
+        char *s1 = testbuf1 + align1;
+        char *s2 = testbuf2 + align2;
+        prv_fill(s1, len);
+        prv_fill(s2, len);
+        // Whatever comes after the terminators must not matter
+        s1[len + 1] = 'a';
+        s2[len + 1] = 'b';
+        cl_assert_equal_i(strcmp(s1, s2), 0);
+        cl_assert_equal_i(strncmp(s1, s2, len + 8), 0);
+
+        for (size_t diff_at = 0; diff_at < len; diff_at++) {
+          prv_fill(s2, len);
+          s2[diff_at]++;
+          cl_assert_equal_i(prv_sign(strcmp(s1, s2)), -1);
+          cl_assert_equal_i(prv_sign(strcmp(s2, s1)), 1);
+          cl_assert_equal_i(prv_sign(strncmp(s1, s2, diff_at + 1)), -1);
+          cl_assert_equal_i(strncmp(s1, s2, diff_at), 0);
+        }
+
+        // s2 is a prefix of s1
+        prv_fill(s2, len);
+        if (len) {
+          s2[len - 1] = '\0';
+          cl_assert_equal_i(prv_sign(strcmp(s1, s2)), 1);
+          cl_assert_equal_i(prv_sign(strcmp(s2, s1)), -1);
+          cl_assert_equal_i(strncmp(s1, s2, len - 1), 0);
+        }
+      }
+    }
+  }
+}
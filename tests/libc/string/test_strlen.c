@@ -34,3 +34,39 @@ void test_strlen__weird(void) {
   char testbuf[9] = "hi\0five";
   cl_assert_equal_i(strlen(testbuf), 2);
 }
+
+// Every alignment and length, with bytes that trip up a sloppy zero byte check around the string
+void test_strlen__alignments(void) {
+  char testbuf[80] __attribute__((aligned(4)));
+  for (size_t align = 0; align < 4; align++) {
+    for (size_t len = 0; len < 64; len++) {
+      memset(testbuf, 0x81, sizeof(testbuf));
+      testbuf[align + len] = '\0';
+      testbuf[align + len + 1] = '\0';
+      cl_assert_equal_i(strlen(testbuf + align), len);
+    }
+  }
+}
+
+void test_strnlen__basic(void) {
+  char testbuf[9] = "hi\0five";
+  cl_assert_equal_i(strnlen(testbuf, 8), 2);
+  cl_assert_equal_i(strnlen(testbuf, 2), 2);
+  cl_assert_equal_i(strnlen(testbuf, 1), 1);
+  cl_assert_equal_i(strnlen(testbuf, 0), 0);
+  cl_assert_equal_i(strnlen(testbuf, SIZE_MAX), 2);
+}
+
+void test_strnlen__alignments(void) {
+  char testbuf[80] __attribute__((aligned(4)));
+  for (size_t align = 0; align < 4; align++) {
+    for (size_t len = 0; len < 64; len++) {
+      memset(testbuf, 0x80, sizeof(testbuf));
+      testbuf[align + len] = '\0';
+      for (size_t maxlen = 0; maxlen < 72; maxlen++) {
+        const size_t expected = (maxlen < len) ? maxlen : len;
+        cl_assert_equal_i(strnlen(testbuf + align, maxlen), expected);
+      }
+    }
+  }
+}
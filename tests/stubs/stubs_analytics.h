@@ -32,6 +32,9 @@ void analytics_inc_for_uuid(AnalyticsMetric metric, const Uuid *uuid) {}
 void analytics_add(AnalyticsMetric metric, int64_t amount, AnalyticsClient client) {}
 void analytics_add_for_uuid(AnalyticsMetric metric, int64_t amount, const Uuid *uuid) {}
 
+void analytics_batched_add(AnalyticsBatchedCounter *counter, uint32_t amount) {}
+void analytics_batched_inc(AnalyticsBatchedCounter *counter) {}
+
 void analytics_stopwatch_start(AnalyticsMetric metric, AnalyticsClient client) {}
 void analytics_stopwatch_stop(AnalyticsMetric metric) {}
 
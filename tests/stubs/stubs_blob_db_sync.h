@@ -32,7 +32,7 @@ BlobDBSyncSession *blob_db_sync_get_session_for_token(BlobDBToken token) {
   return NULL;
 }
 
-void blob_db_sync_next(BlobDBSyncSession *session) {
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token) {
   return;
 }
 
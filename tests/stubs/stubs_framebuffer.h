@@ -24,6 +24,8 @@ volatile const int FrameBuffer_MaxY = DISP_ROWS;
 
 void WEAK framebuffer_mark_dirty_rect(FrameBuffer *f, GRect rect) {}
 
+void WEAK framebuffer_copy_changed_rows(FrameBuffer *f, const FrameBuffer *src) {}
+
 void WEAK framebuffer_init(FrameBuffer *f, const GSize *size) { f->size = *size; }
 
 GSize WEAK framebuffer_get_size(FrameBuffer *f) { return f->size; }
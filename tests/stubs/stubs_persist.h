@@ -77,6 +77,9 @@ void persist_service_client_open(const Uuid *uuid) {
 void persist_service_client_close(const Uuid *uuid) {
 }
 
+void persist_service_flush_all(void) {
+}
+
 status_t persist_service_delete_file(const Uuid *uuid) {
   return S_SUCCESS;
 }
@@ -23,6 +23,17 @@ bool system_task_add_callback(SystemTaskEventCallback cb, void *data) {
   return true;
 }
 
+bool system_task_add_callback_with_flags(SystemTaskEventCallback cb, void *data,
+                                         SystemTaskCallbackFlags flags) {
+  cb(data);
+  return true;
+}
+
+bool system_task_add_callback_coalesced(SystemTaskEventCallback cb, void *data) {
+  cb(data);
+  return true;
+}
+
 uint32_t system_task_get_available_space(void) {
   return 0;
 }
@@ -171,6 +171,11 @@ interrupt count respectively. */
 //#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() ulRunTimeStatsClock = 0
 //#define portGET_RUN_TIME_COUNTER_VALUE() ulRunTimeStatsClock
 
+#if PROFILER_TRACE
+  void profiler_trace_task_switched_in(void);
+  #define traceTASK_SWITCHED_IN() profiler_trace_task_switched_in()
+#endif
+
 #include "system/passert.h"
 #define configASSERT( x ) \
   PBL_ASSERT(x, "FreeRTOS assert at " __FILE_NAME__ ":%d", __LINE__);
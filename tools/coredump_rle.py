@@ -0,0 +1,126 @@
+# Copyright 2024 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Expands the CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunks of a core dump (see
+src/fw/kernel/core_dump_rle.h) into plain CORE_DUMP_CHUNK_KEY_MEMORY chunks, so that tools that
+only know the version 1 format can read it.
+
+Usage: python coredump_rle.py pebble_coredump.core -o expanded.core
+"""
+
+import argparse
+import struct
+
+CORE_DUMP_MAGIC = 0xF00DCAFE
+CORE_DUMP_VERSION_PLAIN = 1
+
+# magic, core_number:8 | version:24, time_stamp, serial_number[16], build_id[64]
+IMAGE_HEADER_FMT = '<III16s64s'
+IMAGE_HEADER_SIZE = struct.calcsize(IMAGE_HEADER_FMT)
+
+CHUNK_HEADER_FMT = '<II'
+CHUNK_HEADER_SIZE = struct.calcsize(CHUNK_HEADER_FMT)
+
+CHUNK_KEY_TERMINATOR = 0xFFFFFFFF
+CHUNK_KEY_MEMORY = 4
+CHUNK_KEY_MEMORY_RLE = 5
+
+RLE_MEMORY_HEADER_FMT = '<II'
+RLE_MEMORY_HEADER_SIZE = struct.calcsize(RLE_MEMORY_HEADER_FMT)
+
+RLE_TOKEN_RUN_FLAG = 1 << 15
+WORD_SIZE = 4
+
+
+class CoreDumpError(Exception):
+    pass
+
+
+def decode(data):
+    """ Decodes the encoded data of a CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunk """
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        if pos + 2 > len(data):
+            raise CoreDumpError('Truncated token at offset {}'.format(pos))
+        token, = struct.unpack_from('<H', data, pos)
+        pos += 2
+        count = (token & ~RLE_TOKEN_RUN_FLAG) + 1
+        if token & RLE_TOKEN_RUN_FLAG:
+            word = data[pos:pos + WORD_SIZE]
+            pos += WORD_SIZE
+            out += word * count
+        else:
+            word = data[pos:pos + count * WORD_SIZE]
+            pos += count * WORD_SIZE
+            out += word
+        if pos > len(data):
+            raise CoreDumpError('Truncated data for token at offset {}'.format(pos))
+    return bytes(out)
+
+
+def expand(core):
+    """ Returns the core dump with all compressed memory chunks replaced by plain ones """
+    if len(core) < IMAGE_HEADER_SIZE:
+        raise CoreDumpError('Too short for a core dump')
+    magic, core_and_version, time_stamp, serial, build_id = \
+        struct.unpack_from(IMAGE_HEADER_FMT, core, 0)
+    if magic != CORE_DUMP_MAGIC:
+        raise CoreDumpError('Bad magic 0x{:08x}'.format(magic))
+
+    core_number = core_and_version & 0xff
+    out = bytearray(struct.pack(IMAGE_HEADER_FMT, magic,
+                                core_number | (CORE_DUMP_VERSION_PLAIN << 8),
+                                time_stamp, serial, build_id))
+    pos = IMAGE_HEADER_SIZE
+    while True:
+        if pos + CHUNK_HEADER_SIZE > len(core):
+            raise CoreDumpError('Missing terminator')
+        key, size = struct.unpack_from(CHUNK_HEADER_FMT, core, pos)
+        if key == CHUNK_KEY_TERMINATOR:
+            out += core[pos:pos + CHUNK_HEADER_SIZE]
+            break
+
+        data = core[pos + CHUNK_HEADER_SIZE:pos + CHUNK_HEADER_SIZE + size]
+        if len(data) != size:
+            raise CoreDumpError('Truncated chunk at offset {}'.format(pos))
+        if key == CHUNK_KEY_MEMORY_RLE:
+            start, length = struct.unpack_from(RLE_MEMORY_HEADER_FMT, data, 0)
+            memory = decode(data[RLE_MEMORY_HEADER_SIZE:])
+            if len(memory) != length:
+                raise CoreDumpError('Memory at 0x{:08x} decoded to {} bytes instead of {}'.format(
+                    start, len(memory), length))
+            out += struct.pack(CHUNK_HEADER_FMT, CHUNK_KEY_MEMORY, WORD_SIZE + length)
+            out += struct.pack('<I', start)
+            out += memory
+        else:
+            out += core[pos:pos + CHUNK_HEADER_SIZE + size]
+        pos += CHUNK_HEADER_SIZE + size
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', type=argparse.FileType('rb'), help='Core dump from the watch')
+    parser.add_argument('-o', '--output', type=argparse.FileType('wb'), required=True,
+                        help='Where to write the expanded core dump')
+    args = parser.parse_args()
+
+    args.output.write(expand(args.input.read()))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,193 @@
+# Copyright 2024 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Converts the output of the "profiler trace" prompt command (see src/fw/system/profiler_trace.h)
+into the Chrome trace event format, which can be loaded in chrome://tracing or Perfetto.
+
+Each Pebble task gets its own track holding the profiler nodes and event dispatches it ran, and a
+separate "CPU" track shows which task was switched in at any point in time.
+
+Usage: python profiler_trace_to_chrome.py serial_log.txt -o trace.json
+"""
+
+import argparse
+import json
+import re
+import sys
+
+PID = 1
+CPU_TID = 1000
+TIMESTAMP_MASK = 0xffffffff
+
+_LINE_RE = re.compile(r'PTRACE (.*)$')
+
+
+def _parse_event_names(events_header):
+    """ Returns a dict of PebbleEventType value to name parsed from kernel/events.h """
+    names = {}
+    with open(events_header) as f:
+        source = f.read()
+    match = re.search(r'typedef enum\s*{(.*?)}\s*PebbleEventType;', source, re.DOTALL)
+    if not match:
+        return names
+
+    value = 0
+    for entry in re.sub(r'//.*', '', match.group(1)).split(','):
+        entry = entry.strip()
+        if not entry:
+            continue
+        name, _, explicit_value = entry.partition('=')
+        if explicit_value.strip():
+            value = int(explicit_value.strip(), 0)
+        names[value] = name.strip()
+        value += 1
+    return names
+
+
+class TraceConverter(object):
+    def __init__(self, event_names=None):
+        self.event_names = event_names or {}
+        self.cycles_per_us = 1
+        self.tasks = {}
+        self.num_dropped = 0
+        self.trace_events = []
+
+        self._last_timestamp = None
+        self._elapsed_cycles = 0
+        self._open_slices = {}  # tid -> stack of slice names
+        self._running_task = None
+        self._running_since_us = None
+
+    def _timestamp_us(self, timestamp):
+        # The cycle counter is only 32 bits wide, so unwrap it assuming events are in order
+        if self._last_timestamp is not None:
+            self._elapsed_cycles += (timestamp - self._last_timestamp) & TIMESTAMP_MASK
+        self._last_timestamp = timestamp
+        return float(self._elapsed_cycles) / self.cycles_per_us
+
+    def _task_name(self, tid):
+        return self.tasks.get(tid, 'Task %d' % tid)
+
+    def _begin(self, tid, name, cat, ts, args=None):
+        self._open_slices.setdefault(tid, []).append(name)
+        event = {'name': name, 'cat': cat, 'ph': 'B', 'ts': ts, 'pid': PID, 'tid': tid}
+        if args:
+            event['args'] = args
+        self.trace_events.append(event)
+
+    def _end(self, tid, name, cat, ts):
+        stack = self._open_slices.get(tid, [])
+        if name not in stack:
+            # The start of this slice was overwritten before the trace was dumped
+            return
+        # Close anything left open above it so that the slices stay properly nested
+        while stack:
+            open_name = stack.pop()
+            self.trace_events.append({'name': open_name, 'cat': cat, 'ph': 'E', 'ts': ts,
+                                      'pid': PID, 'tid': tid})
+            if open_name == name:
+                break
+
+    def _switch_to(self, tid, ts):
+        self._finish_running_slice(ts)
+        self._running_task = tid
+        self._running_since_us = ts
+
+    def _finish_running_slice(self, ts):
+        if self._running_task is None:
+            return
+        self.trace_events.append({'name': self._task_name(self._running_task), 'cat': 'sched',
+                                  'ph': 'X', 'ts': self._running_since_us,
+                                  'dur': ts - self._running_since_us, 'pid': PID,
+                                  'tid': CPU_TID})
+
+    def _event_name(self, event_type):
+        return self.event_names.get(event_type, 'Event %d' % event_type)
+
+    def feed_line(self, line):
+        match = _LINE_RE.search(line.rstrip())
+        if not match:
+            return
+        fields = match.group(1).split(' ', 3)
+
+        if fields[0] == 'begin':
+            self.cycles_per_us = max(int(fields[1]), 1)
+            self.num_dropped = int(fields[3])
+        elif fields[0] == 'task':
+            self.tasks[int(fields[1])] = fields[2] if len(fields) < 4 else ' '.join(fields[2:])
+        elif fields[0] == 'end':
+            return
+        else:
+            ts = self._timestamp_us(int(fields[0]))
+            kind = fields[1]
+            tid = int(fields[2])
+            if kind == 'B':
+                self._begin(tid, fields[3], 'node', ts)
+            elif kind == 'E':
+                self._end(tid, fields[3], 'node', ts)
+            elif kind == 'S':
+                self._switch_to(tid, ts)
+            elif kind == 'D':
+                event_type = int(fields[3])
+                self._begin(tid, self._event_name(event_type), 'event', ts,
+                            {'event_type': event_type})
+            elif kind == 'd':
+                self._end(tid, self._event_name(int(fields[3])), 'event', ts)
+
+    def finish(self):
+        end_ts = float(self._elapsed_cycles) / self.cycles_per_us
+        self._finish_running_slice(end_ts)
+        for tid, stack in self._open_slices.items():
+            while stack:
+                self.trace_events.append({'name': stack.pop(), 'ph': 'E', 'ts': end_ts,
+                                          'pid': PID, 'tid': tid})
+
+        metadata = [{'name': 'process_name', 'ph': 'M', 'pid': PID,
+                     'args': {'name': 'Pebble'}},
+                    {'name': 'thread_name', 'ph': 'M', 'pid': PID, 'tid': CPU_TID,
+                     'args': {'name': 'CPU'}}]
+        for tid, name in sorted(self.tasks.items()):
+            metadata.append({'name': 'thread_name', 'ph': 'M', 'pid': PID, 'tid': tid,
+                             'args': {'name': name}})
+
+        return {'traceEvents': metadata + self.trace_events,
+                'displayTimeUnit': 'ms',
+                'otherData': {'dropped_events': self.num_dropped}}
+
+
+def convert(lines, event_names=None):
+    converter = TraceConverter(event_names)
+    for line in lines:
+        converter.feed_line(line)
+    return converter.finish()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', nargs='?', type=argparse.FileType('r'), default=sys.stdin,
+                        help='Log containing a "profiler trace" dump (default: stdin)')
+    parser.add_argument('-o', '--output', type=argparse.FileType('w'), default=sys.stdout,
+                        help='Where to write the Chrome trace JSON (default: stdout)')
+    parser.add_argument('--events-header',
+                        help='Path to src/fw/kernel/events.h, used to name dispatched events')
+    args = parser.parse_args()
+
+    event_names = _parse_event_names(args.events_header) if args.events_header else None
+    json.dump(convert(args.input, event_names), args.output, indent=1)
+
+
+if __name__ == '__main__':
+    main()
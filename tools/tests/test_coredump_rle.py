@@ -0,0 +1,80 @@
+# Copyright 2024 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+import struct
+import sys
+import unittest
+
+# Allow us to run even if not at the `tools` directory.
+root_dir = os.path.abspath(os.path.join(os.path.dirname(__file__), os.pardir))
+sys.path.insert(0, root_dir)
+
+import coredump_rle
+from coredump_rle import CoreDumpError, decode, expand
+
+# A run of 3 zero words, a literal of 2 words and a run of 2 0xa5a5a5a5 words
+ENCODED = (b'\x02\x80' + b'\x00' * 4 +
+           b'\x01\x00' + b'\x11\x22\x33\x44' + b'\x55\x66\x77\x88' +
+           b'\x01\x80' + b'\xa5' * 4)
+DECODED = b'\x00' * 12 + b'\x11\x22\x33\x44\x55\x66\x77\x88' + b'\xa5' * 8
+
+THREAD_CHUNK = struct.pack('<II', 2, 8) + b'threadxx'
+TERMINATOR = struct.pack('<I', 0xFFFFFFFF) + b'\xff' * 4
+
+
+def _image_header(version):
+    return struct.pack(coredump_rle.IMAGE_HEADER_FMT, coredump_rle.CORE_DUMP_MAGIC,
+                       3 | (version << 8), 1234, b'Q123456789', b'build')
+
+
+class TestCoreDumpRle(unittest.TestCase):
+    def test_decode(self):
+        self.assertEqual(decode(ENCODED), DECODED)
+        self.assertEqual(decode(b''), b'')
+
+    def test_decode_truncated(self):
+        with self.assertRaises(CoreDumpError):
+            decode(ENCODED[:-1])
+        with self.assertRaises(CoreDumpError):
+            decode(b'\x01')
+
+    def test_expand(self):
+        rle_chunk = (struct.pack('<II', 5, 8 + len(ENCODED)) +
+                     struct.pack('<II', 0x20000000, len(DECODED)) + ENCODED)
+        core = _image_header(2) + rle_chunk + THREAD_CHUNK + TERMINATOR
+
+        memory_chunk = (struct.pack('<II', 4, 4 + len(DECODED)) +
+                        struct.pack('<I', 0x20000000) + DECODED)
+        # Everything after the terminator is erased flash that isn't part of the core dump
+        self.assertEqual(expand(core),
+                         _image_header(1) + memory_chunk + THREAD_CHUNK + TERMINATOR[:8])
+
+    def test_expand_plain(self):
+        core = _image_header(1) + THREAD_CHUNK + TERMINATOR[:8]
+        self.assertEqual(expand(core), core)
+
+    def test_expand_length_mismatch(self):
+        rle_chunk = (struct.pack('<II', 5, 8 + len(ENCODED)) +
+                     struct.pack('<II', 0x20000000, len(DECODED) + 4) + ENCODED)
+        with self.assertRaises(CoreDumpError):
+            expand(_image_header(2) + rle_chunk + TERMINATOR)
+
+    def test_expand_missing_terminator(self):
+        with self.assertRaises(CoreDumpError):
+            expand(_image_header(2) + THREAD_CHUNK)
+
+
+if __name__ == '__main__':
+    unittest.main()
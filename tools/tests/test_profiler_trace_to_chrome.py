@@ -0,0 +1,83 @@
+# Copyright 2024 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+import sys
+import unittest
+
+# Allow us to run even if not at the `tools` directory.
+root_dir = os.path.abspath(os.path.join(os.path.dirname(__file__), os.pardir))
+sys.path.insert(0, root_dir)
+
+from profiler_trace_to_chrome import convert
+
+TRACE_LOG = """\
+00:00:01.000 <garbage from the log>
+PROF 00:00:01.100 PTRACE begin 100 8 3
+PROF 00:00:01.100 PTRACE task 0 KernelMain
+PROF 00:00:01.100 PTRACE task 3 App
+PROF 00:00:01.100 PTRACE 4294967000 E 3 render_app
+PROF 00:00:01.100 PTRACE 4294967096 S 0
+PROF 00:00:01.100 PTRACE 4294967196 D 0 7
+PROF 00:00:01.100 PTRACE 100 B 0 compositor
+PROF 00:00:01.100 PTRACE 1100 E 0 compositor
+PROF 00:00:01.100 PTRACE 1200 d 0 7
+PROF 00:00:01.100 PTRACE 1300 S 3
+PROF 00:00:01.100 PTRACE 2300 B 3 render_app
+PROF 00:00:01.100 PTRACE end
+"""
+
+
+class TestProfilerTraceToChrome(unittest.TestCase):
+    def setUp(self):
+        self.trace = convert(TRACE_LOG.splitlines(), {7: 'PEBBLE_RENDER_READY_EVENT'})
+        self.events = self.trace['traceEvents']
+
+    def _events(self, **kwargs):
+        return [e for e in self.events
+                if all(e.get(key) == value for key, value in kwargs.items())]
+
+    def test_thread_names(self):
+        names = {e['tid']: e['args']['name'] for e in self._events(ph='M', name='thread_name')}
+        self.assertEqual(names, {0: 'KernelMain', 3: 'App', 1000: 'CPU'})
+        self.assertEqual(self.trace['otherData']['dropped_events'], 3)
+
+    def test_timestamps_unwrap(self):
+        begin, end = self._events(name='compositor')
+        # 4294967000 -> 100 wraps the 32 bit counter, 396 cycles at 100 cycles/us
+        self.assertEqual(begin['ts'], 3.96)
+        self.assertEqual(end['ts'] - begin['ts'], 10.0)
+
+    def test_dispatch_slices(self):
+        begin, end = self._events(name='PEBBLE_RENDER_READY_EVENT')
+        self.assertEqual((begin['ph'], end['ph']), ('B', 'E'))
+        self.assertEqual(begin['args'], {'event_type': 7})
+        self.assertEqual(end['ts'] - begin['ts'], 13.0)
+
+    def test_unmatched_slices(self):
+        # The stop without a start is dropped, the start without a stop is closed at the end
+        render = self._events(name='render_app')
+        self.assertEqual([e['ph'] for e in render], ['B', 'E'])
+        self.assertEqual(render[1]['ts'], 25.96)
+
+    def test_cpu_track(self):
+        running = self._events(tid=1000, ph='X')
+        self.assertEqual([e['name'] for e in running], ['KernelMain', 'App'])
+        self.assertEqual(running[0]['ts'], 0.96)
+        self.assertEqual(running[0]['dur'], 15.0)
+        self.assertEqual(running[1]['ts'], 15.96)
+
+
+if __name__ == '__main__':
+    unittest.main()
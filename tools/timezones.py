@@ -324,19 +324,36 @@ def zoneinfo_to_bin(zoneinfo_list, dstrule_list, zonelink_list, output_bin):
     # only reason we need 33 characters is for that
     # troublemaker 'America/Argentina/ComodRivadavia'
     TIMEZONE_LINK_NAME_LENGTH = 33
+    # Corresponds to TIMEZONE_INDEX_MAGIC in timezone_database.c
+    TIMEZONE_INDEX_MAGIC = b'TZIX'
 
     # format
     # 1 byte + 15 bytes + 2 bytes + 5 bytes + 1 byte = 24 bytes
     # Continent_index City gmt_offset_minutes tz_abbr dst_id
 
+    region_id_list = [continent + "/" + region
+                      for continent, region in (line.split(' ')[:2] for line in zoneinfo_list)]
+    # The firmware binary searches the regions by name, so they must be in name order
+    assert region_id_list == sorted(region_id_list)
+
+    # Resolve the links up front so the header only counts the ones we actually write
+    links = []
+    for line in zonelink_list:
+        target, linkname = line.split(' ')
+        try:
+            region_id = region_id_list.index(target)
+        except ValueError as e:
+            print("Couldn't find region, skipping:", e)
+            continue
+        links.append((region_id, linkname))
+
     # Unsigned short - count of entries
     output_bin.write(struct.pack('H', len(zoneinfo_list)))
     # Unsigned short - count of DST rules
     output_bin.write(struct.pack('H', len(dstzone_dict.values())))
     # Unsigned short - count of links
-    output_bin.write(struct.pack('H', len(zonelink_list)))
+    output_bin.write(struct.pack('H', len(links)))
 
-    region_id_list = []
     # write all the timezones to file
     for line in zoneinfo_list:
         continent, region, gmt_offset_minutes, tz_abbr, dst_zone = line.split(' ')
@@ -344,7 +361,6 @@ def zoneinfo_to_bin(zoneinfo_list, dstrule_list, zonelink_list, output_bin):
         # output the timezone continent index
         continent_index = tz_continent_dict[continent]
         output_bin.write(struct.pack('B', continent_index))
-        region_id_list.append(continent+"/"+region)
 
         # fixup and output the timezone region name
         output_bin.write(region.ljust(15, '\0').encode("utf8"))  # 15-character region zero padded
@@ -400,16 +416,16 @@ def zoneinfo_to_bin(zoneinfo_list, dstrule_list, zonelink_list, output_bin):
                 output_bin.write(struct.pack('B', 0))
 
     # write all the timezone links to file
-    for line in zonelink_list:
-        target, linkname = line.split(' ')
-        try:
-            region_id = region_id_list.index(target)
-        except ValueError as e:
-            print("Couldn't find region, skipping:", e)
-            continue
+    for region_id, linkname in links:
         output_bin.write(struct.pack('H', region_id))
         output_bin.write(linkname.ljust(TIMEZONE_LINK_NAME_LENGTH, '\0').encode("utf8"))
 
+    # write the link name index, the link numbers in the order of their names.
+    # Firmware that predates the index never reads past the links, so it's safe to append.
+    output_bin.write(TIMEZONE_INDEX_MAGIC)
+    for link_index, _ in sorted(enumerate(links), key=lambda link: link[1][1]):
+        output_bin.write(struct.pack('H', link_index))
+
 
 def build_zoneinfo_dict(olson_database):
     timezones = {}